@@ -160,6 +160,12 @@ Java_vsense_ar_TangoJNINative_onUpdateShadow(
   app.onUpdateShadow(vis);
 }
 
+JNIEXPORT void JNICALL
+Java_vsense_ar_TangoJNINative_onUpdateCPULighting(
+  JNIEnv* /*env*/, jobject  /*obj*/, jboolean enable) {
+  app.onUpdateCPULighting(enable);
+}
+
 JNIEXPORT void JNICALL
 Java_vsense_ar_TangoJNINative_onSetRenderObject(
   JNIEnv* /*env*/, jobject  /*obj*/, jint objectIdx) {
@@ -191,6 +197,16 @@ Java_vsense_ar_TangoJNINative_onSetDepthMapEnableFillHolesWithMax(JNIEnv* /*env*
   app.onSetDepthMapEnableFillHolesWithMax(enable);
 }
 
+JNIEXPORT void JNICALL
+Java_vsense_ar_TangoJNINative_onSetDepthMapIntegrationBudget(JNIEnv* /*env*/, jobject /*obj*/, jint budgetMS) {
+  app.onSetDepthMapIntegrationBudget((float)budgetMS);
+}
+
+JNIEXPORT void JNICALL
+Java_vsense_ar_TangoJNINative_onSetRestoreSnapshot(JNIEnv* /*env*/, jobject /*obj*/, jboolean enable) {
+  app.onSetRestoreSnapshot(enable);
+}
+
 JNIEXPORT void JNICALL
 Java_vsense_ar_TangoJNINative_onSetColorCorrectionEnable(JNIEnv* /*env*/, jobject  /*obj*/, jboolean enable) {
   app.onSetColorCorrectionEnable(enable);
@@ -216,6 +232,11 @@ Java_vsense_ar_TangoJNINative_onSetRenderNumberOrder(JNIEnv* /*env*/, jobject /*
   app.onSetRenderNumberOrder(orderNbr);
 }
 
+JNIEXPORT void JNICALL
+Java_vsense_ar_TangoJNINative_onSetRenderTransferBits(JNIEnv* /*env*/, jobject /*obj*/, jint transferBits) {
+  app.onSetRenderTransferBits(transferBits);
+}
+
 #ifdef __cplusplus
 }
 #endif
@@ -24,14 +24,23 @@
 #include <vsense/gl/PointCloudObject.h>
 #include <vsense/gl/VideoOverlay.h>
 #include <vsense/gl/EnvironmentMapOverlay.h>
+#include <vsense/gl/GLProgramDriver.h>
+#include <vsense/gl/ProgramCache.h>
 #include <vsense/gl/StaticMesh.h>
 #include <vsense/gl/Texture.h>
 #include <vsense/io/Image.h>
 #include <vsense/io/ObjReader.h>
+#include <vsense/sh/BandLimit.h>
 #include <vsense/sh/SphericalHarmonics.h>
+#include <vsense/sh/TemporalFilter.h>
 #include <vsense/depth/DepthMap.h>
+#include <vsense/em/EMSnapshot.h>
 #include <vsense/em/EnvironmentMap.h>
+#include <vsense/em/IntegrationController.h>
 #include <vsense/em/Process.h>
+#include <vsense/pc/PlaneDetector.h>
+#include <vsense/pc/PointCloud.h>
+#include <vsense/pc/VoxelGrid.h>
 
 #include <glm/gtc/matrix_access.hpp>
 #include <glm/gtx/quaternion.hpp>
@@ -49,6 +58,8 @@ const std::string StorageFolder = "/sdcard/TCD/";
 const std::string DataFolder = StorageFolder + "data/";
 const std::string MeshFolder = StorageFolder + "mesh/";
 const std::string SphericalHarmonicsFolder = StorageFolder + "sh/";
+const std::string ProgramCacheFolder = StorageFolder + "cache/";
+const std::string SnapshotFolder = StorageFolder + "snapshot/";
 
 const std::string BunnyBasename = "bunny";
 const std::string RafaBasename = "rafa";
@@ -67,14 +78,26 @@ const unsigned char HasBoth       = HasPointCloud | HasImage;
 
 const float ObjectOffset = 0.001f;
 
+const float PlaneThreshold     = 0.02f; // Maximum distance (m) from a point to the plane under the touch
+const float PlaneTimeBudget    = 30.f;  // Maximum time (ms) spent detecting planes on touch
+const float PlaneSupportRadius = 0.1f;  // Maximum distance (m) from the touch ray to the points of the plane
+const float PlaneVoxelSize     = 0.01f; // Size (m) of the voxels the points are averaged in before detecting planes
+
 const float AnimationRadius = 0.2f;
 
 const uint16_t MaxMissingFrames = 10;
 
 const float LimitSHCalculation = 5.f; // Recalculate SH every 10degs
 
-const std::string Perf_EM    = "EM";
-const std::string Perf_MSE    = "MSE";
+const std::string Perf_EM       = "EM (ms)";
+const std::string Perf_EMStages = "EM stages (ms)";
+const std::string Perf_MSE      = "MSE";
+const std::string Perf_EMObserved   = "EM observed (%)";
+const std::string Perf_EMStaleTiles = "EM stale tiles";
+
+const uint32_t CoverageReportFrames = 30;    // Frames projected between readbacks of the EM coverage, they wait for the GPU
+const float    StaleTileAge         = 150.f; // Mean age (frames) from which a tile of the EM coverage is stale
+const float    StaleTileCoverage    = 0.5f;  // Coverage below which a tile of the EM coverage is incomplete
 
 namespace {
 // The minimum Tango Core version required from this application.
@@ -115,6 +138,29 @@ enum {
   MortyIdx
 };
 
+/*
+ * Retrieves the wall time, so the waits for the GPU are included in the measurements.
+ * @return Time (ms) from an arbitrary point.
+ */
+double wallTimeMS() {
+  timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+
+  return (double)t.tv_sec*1000.0 + (double)t.tv_nsec/1000000.0;
+}
+
+/*
+ * Builds the filename of a snapshot.
+ * @param sequence Sequence number of the snapshot.
+ * @return Filename.
+ */
+std::string snapshotFilename(uint32_t sequence) {
+  char buffer[20];
+  sprintf(buffer, "%u", sequence);
+
+  return SnapshotFolder + "EM" + buffer + ".snap";
+}
+
 void TimeStats::printStats() {
   LOGI("V_SENSE_DEBUG: Frames: %d", nbrFrames);
   for (int i = 0; i < NbrStats; i++)
@@ -122,8 +168,20 @@ void TimeStats::printStats() {
 }
 
 PointCloudApp::PointCloudApp() : screenWidth_(0.0f), screenHeight_(0.0f), lastColorTimestamp_(0.0), isServiceConnected_(false), saveFiles_(false), renderBaseColor_(true), missingFrames_(0),
-                                 isGLInitialized_(false), recording_(false), isSceneCameraConfigured_(false), availableFlags_(0), displayRotation_(TangoSupportRotation::ROTATION_IGNORED) {
+                                 isGLInitialized_(false), recording_(false), saveSnapshot_(false), resetSHFilter_(false), resetSnapshots_(false), isSceneCameraConfigured_(false), availableFlags_(0), displayRotation_(TangoSupportRotation::ROTATION_IGNORED) {
   objIdx_ = 0;
+  maxSHOrder_ = 4;
+  maxMeshOrder_ = 4;
+  nbrSHNbrCoeffs_ = (maxSHOrder_ + 1)*(maxSHOrder_ + 1);
+  cpuLighting_ = false;
+  transferBits_ = 0;
+  coverageReportFrame_ = 0;
+  restoreSnapshot_ = false;
+  integrationBudget_ = em::IntegrationParams().budgetMS;
+  shFilterFrame_ = 0;
+  hasSHFilterFrame_ = false;
+
+  planeDetector_ = std::make_shared<pc::PlaneDetector>(PlaneThreshold, PlaneTimeBudget);
 }
 
 PointCloudApp::~PointCloudApp() {
@@ -312,6 +370,10 @@ void PointCloudApp::tangoDisconnect() {
 }
 
 void PointCloudApp::onSurfaceCreated(AAssetManager* assetManager) {
+  // Every program created from now on is loaded from its cached binary when the driver accepts it
+  mkdir(ProgramCacheFolder.c_str(), 0770);
+  gl::util::setProgramCache(std::make_shared<gl::ProgramCache>(std::make_shared<gl::GLProgramDriver>(), ProgramCacheFolder));
+
   videoOverlay_.reset(new gl::VideoOverlay(assetManager));
   videoOverlay_->setDisplayRotation(displayRotation_);
 
@@ -346,8 +408,10 @@ void PointCloudApp::onSurfaceCreated(AAssetManager* assetManager) {
   io::ObjReader::loadFromFile(MeshFolder + basenameStr + ".obj", virtualMesh, scale);
   virtualObject_.reset(new gl::SHMeshDotObject(assetManager_, virtualMesh));
   virtualObject_->transform(glm::vec3(0.f, 0.f, 0.f), glm::quat());
-  virtualObject_->updateCoefficients(SphericalHarmonicsFolder + basenameStr + MeshSOFile);
-  virtualObject_->updateRenderCoefficientsNumber(nbrSHNbrCoeffs_);
+  virtualObject_->updateCoefficients(SphericalHarmonicsFolder + basenameStr + MeshSOFile, maxMeshOrder_);
+  virtualObject_->setSHOrder(std::min(maxSHOrder_, maxMeshOrder_));
+  virtualObject_->setTransferQuantization((sh::TransferQuantization)transferBits_);
+  virtualObject_->setCPULighting(cpuLighting_);
 
   if(objIdx_ == MortyIdx) {
     std::shared_ptr<gl::Texture> meshTexture;
@@ -365,12 +429,31 @@ void PointCloudApp::onSurfaceCreated(AAssetManager* assetManager) {
 
   virtualPlaneObject_.reset(new gl::SHMeshPlaneDotObject(assetManager_, 0.02f));
   virtualPlaneObject_->transform(glm::vec3(0.f, 0.f, 0.f), glm::quat());
-  virtualPlaneObject_->updateCoefficients(SphericalHarmonicsFolder + basenameStr + ShadowFile, SphericalHarmonicsFolder + basenameStr + PlaneFile);
-  virtualPlaneObject_->updateRenderCoefficientsNumber(nbrSHNbrCoeffs_);
+  virtualPlaneObject_->updateCoefficients(SphericalHarmonicsFolder + basenameStr + ShadowFile, SphericalHarmonicsFolder + basenameStr + PlaneFile, maxMeshOrder_);
+  virtualPlaneObject_->setSHOrder(std::min(maxSHOrder_, maxMeshOrder_));
+  virtualPlaneObject_->setTransferQuantization((sh::TransferQuantization)transferBits_);
+  virtualPlaneObject_->setCPULighting(cpuLighting_);
 
   emProcess_.reset(new em::Process(assetManager));
   emProcess_->updateMaxError(maxMSE_);
   emProcess_->setMaxSHOrder(std::min(maxSHOrder_, maxMeshOrder_));
+  createIntegrationController();
+  coverageMap_.reset(new em::CoverageMap());
+  coverageReportFrame_ = 0;
+
+  mkdir(SnapshotFolder.c_str(), 0770);
+  snapshotWriter_.reset(new em::SnapshotWriter());
+  if(restoreSnapshot_)
+    restoreSnapshot();
+
+  // The objects are lit with the published coefficients, only uploaded when they change enough
+  int nbrCoeffs = sh::BandLimit::getNbrCoefficients(sh::MaxSHOrder);
+  shFilter_.reset(new sh::TemporalFilter(sh::TemporalFilterParams(), nbrCoeffs));
+  shFilteredTexture_.reset(new gl::Texture(1, nbrCoeffs, 4, GL_FLOAT, NULL));
+  hasSHFilterFrame_ = false;
+
+  virtualObject_->updateAmbientCoefficients(shFilteredTexture_);
+  virtualPlaneObject_->updateAmbientCoefficients(shFilteredTexture_);
 
   emOverlay_->updateTexture(emProcess_->getEnvironmentMap());
 
@@ -418,7 +501,7 @@ void PointCloudApp::onUpdateRenderData() {
         curAnimationAngle_ = 360.f;
     }
 
-    if (std::abs(lastCalculatedSHAngle_ - curAnimationAngle_) >= LimitSHCalculation) {
+    if (std::abs(lastCalculatedSHAngle_ - curAnimationAngle_) >= LimitSHCalculation && shFilter_->needsReprojection()) {
       lastCalculatedSHAngle_ = curAnimationAngle_;
 
 
@@ -427,9 +510,6 @@ void PointCloudApp::onUpdateRenderData() {
       emProcess_->updateSHCoefficients();
 
       emOverlay_->updateTexture(emProcess_->getEnvironmentMapAlt());
-
-      virtualObject_->updateAmbientCoefficients(emProcess_->getSHCoefficientsTexture());
-      virtualPlaneObject_->updateAmbientCoefficients(emProcess_->getSHCoefficientsTexture());
     }
 
     virtualObjAnimPos_ = pos;
@@ -439,9 +519,6 @@ void PointCloudApp::onUpdateRenderData() {
     emProcess_->translateEM();
     emProcess_->updateSHCoefficients();
     emOverlay_->updateTexture(emProcess_->getEnvironmentMap());
-
-    virtualObject_->updateAmbientCoefficients(emProcess_->getSHCoefficientsTexture());
-    virtualPlaneObject_->updateAmbientCoefficients(emProcess_->getSHCoefficientsTexture());
   }
 
   if (availableFlags_ == HasBoth)
@@ -503,6 +580,23 @@ void PointCloudApp::renderGL(const glm::mat4 &frame_area_desc_T_color_camera) {
   if (gizmoObject_)
     gizmoObject_->render(camera_.get());
 
+  if(resetSHFilter_) {
+    resetSHFilter_ = false;
+    resetSHFilter();
+  }
+
+  updateSHFilter();
+
+  if(resetSnapshots_) {
+    resetSnapshots_ = false;
+    resetSnapshots();
+  }
+
+  if(saveSnapshot_) {
+    saveSnapshot_ = false;
+    saveSnapshot();
+  }
+
   if (virtualObject_->isVisible())
     virtualObject_->render(camera_.get());
   if (virtualPlaneObject_)
@@ -563,23 +657,59 @@ void PointCloudApp::addCurrentFrame() {
   if(saveFiles_ && recording_)
     saveFiles(pointCloud, posePC, imgBuffer, poseIM);
 
-  clock_t t = clock();
+  // Frames adding little to the EM are skipped or integrated without the SH calculation to hold the time budget
+  glm::mat4 depthPose = glm::mat4_cast(glm::quat((float)posePC.orientation[3], (float)posePC.orientation[0], (float)posePC.orientation[1], (float)posePC.orientation[2]));
+  depthPose[3] = glm::vec4((float)posePC.translation[0], (float)posePC.translation[1], (float)posePC.translation[2], 1.f);
+
+  // Without a budget every frame is fully integrated
+  em::IntegrationDecision decision = em::IntegrationFull;
+  if(integrationController_) {
+    integrationController_->setCamera(glm::vec2(depthCameraIntrinsics_.fx, depthCameraIntrinsics_.fy), glm::vec2(depthCameraIntrinsics_.cx, depthCameraIntrinsics_.cy),
+                                      glm::uvec2(depthCameraIntrinsics_.width, depthCameraIntrinsics_.height));
+    integrationController_->setOrigin(emProcess_->getOrigin());
+    decision = integrationController_->update(depthPose, pointCloud->timestamp);
+    if(decision == em::IntegrationSkip)
+      return;
+  }
+
+  double t = wallTimeMS();
+
+  bool calculateSH = !isAnimated_ && decision == em::IntegrationFull && shFilter_->needsReprojection(); // Throttled while the lighting is static
+  emProcess_->addFrame(pointCloud, &posePC, &depthCameraIntrinsics_, imgBuffer, &poseIM, &colorCameraIntrinsics_, minConfidence_, recording_, calculateSH);
+
+  t = wallTimeMS() - t;
+  if(integrationController_)
+    integrationController_->reportCost(decision, (float)t);
 
-  t = clock() - t;
-  emProcess_->addFrame(pointCloud, &posePC, &depthCameraIntrinsics_, imgBuffer, &poseIM, &colorCameraIntrinsics_, minConfidence_, recording_, !isAnimated_);
-  perf_[Perf_EM] = (float)t/CLOCKS_PER_SEC;
+  // Time measured by the stages of the process, the rest is spent uploading the frame and waiting for the readbacks
+  const em::TimeStats& stats = emProcess_->getTimeStats();
+  double stagesMS = 0.0;
+  for(int i = 0; i <= em::EMTranslate; i++)
+    stagesMS += stats[i];
+
+  perf_[Perf_EM] = (float)t;
+  perf_[Perf_EMStages] = (float)stagesMS;
   perf_[Perf_MSE] = emProcess_->getLastCorrectionMatrixError();
 
-  virtualObject_->updateColorCorrectionMtx(emProcess_->getLastInvCorrectionMatrix());
-  virtualPlaneObject_->updateColorCorrectionMtx(emProcess_->getLastInvCorrectionMatrix());
+  // The coverage restarts when the frame index wraps around
+  uint32_t coverageFrame = emProcess_->getCoverageFrame();
+  if(coverageFrame < coverageReportFrame_ || coverageFrame >= coverageReportFrame_ + CoverageReportFrames) {
+    emProcess_->readCoverage(*coverageMap_);
 
-  if(!isAnimated_) {
-    if(recording_)
-      emOverlay_->updateTexture(emProcess_->getEnvironmentMap());
+    em::TileCoverage total = coverageMap_->getTotal(coverageFrame);
+    std::vector<size_t> staleTiles;
+    coverageMap_->findStaleTiles(coverageFrame, StaleTileAge, StaleTileCoverage, staleTiles);
 
-    virtualObject_->updateAmbientCoefficients(emProcess_->getSHCoefficientsTexture());
-    virtualPlaneObject_->updateAmbientCoefficients(emProcess_->getSHCoefficientsTexture());
+    perf_[Perf_EMObserved] = 100.f*total.coverage;
+    perf_[Perf_EMStaleTiles] = (float)staleTiles.size();
+    coverageReportFrame_ = coverageFrame;
   }
+
+  virtualObject_->updateColorCorrectionMtx(emProcess_->getLastInvCorrectionMatrix());
+  virtualPlaneObject_->updateColorCorrectionMtx(emProcess_->getLastInvCorrectionMatrix());
+
+  if(!isAnimated_ && recording_)
+    emOverlay_->updateTexture(emProcess_->getEnvironmentMap());
 }
 
 void PointCloudApp::saveFiles(const TangoPointCloud* pointCloud, const TangoPoseData& posePC, const TangoImageBuffer* image, const TangoPoseData& poseIM) {
@@ -652,37 +782,51 @@ void PointCloudApp::onTouchEvent(float x, float y) {
   }
   ret = TangoSupport_getPoseAtTime(lastColorTimestamp_, TANGO_COORDINATE_FRAME_AREA_DESCRIPTION,
                                    TANGO_COORDINATE_FRAME_CAMERA_COLOR, TANGO_SUPPORT_ENGINE_OPENGL,
-                                   TANGO_SUPPORT_ENGINE_TANGO, ROTATION_IGNORED, &poseColorCamera);
+                                   TANGO_SUPPORT_ENGINE_TANGO, displayRotation_, &poseColorCamera);
   if (ret != TANGO_SUCCESS) {
     LOGE("%s: could not get openglTcolor pose for last_gpu_timestamp_ %f.", __func__, lastColorTimestamp_);
     return;
   }
 
-  // Touch location in [0,1] range.
+  TangoCameraIntrinsics intrinsics;
+  if (TangoSupport_getCameraIntrinsicsBasedOnDisplayRotation(TANGO_CAMERA_COLOR, displayRotation_, &intrinsics) != TANGO_SUCCESS)
+    return;
+
+  // Points in world coordinates
+  glm::quat depthRotation((float)posePointCloud.orientation[3], (float)posePointCloud.orientation[0],
+                          (float)posePointCloud.orientation[1], (float)posePointCloud.orientation[2]);
+  glm::vec3 depthTranslation(posePointCloud.translation[0], posePointCloud.translation[1], posePointCloud.translation[2]);
+
+  std::vector<glm::vec3> points(pointCloud->num_points);
+  for (uint32_t i = 0; i < pointCloud->num_points; i++)
+    points[i] = depthRotation*glm::make_vec3(pointCloud->points[i]) + depthTranslation;
+
+  // One point per voxel, so the close surfaces sampled densely don't take most of the time budget
+  pc::PointCloud cloud, cloudDown;
+  cloud.addPoints(points.data(), nullptr, nullptr, nullptr, points.size());
+  if (!pc::VoxelGrid::downsample(cloud, cloudDown, PlaneVoxelSize))
+    return;
+
+  // Ray through the touch location (the rotated color camera looks along +Z with +Y pointing down)
   glm::vec2 uv(x / screenWidth_, y / screenHeight_);
 
-  // Fit plane model.
-  TangoSupportPlane* planes;
-  int nbrPlanes;
-  if (TangoSupport_fitMultiplePlaneModelsNearPoint(pointCloud, posePointCloud.translation,
-                                                   posePointCloud.orientation, glm::value_ptr(uv), displayRotation_,
-                                                   poseColorCamera.translation, poseColorCamera.orientation, &planes, &nbrPlanes) != TANGO_SUCCESS) {
+  glm::quat colorRotation((float)poseColorCamera.orientation[3], (float)poseColorCamera.orientation[0],
+                          (float)poseColorCamera.orientation[1], (float)poseColorCamera.orientation[2]);
+  glm::vec3 rayOrigin(poseColorCamera.translation[0], poseColorCamera.translation[1], poseColorCamera.translation[2]);
+  glm::vec3 rayDir((uv.x*intrinsics.width - intrinsics.cx) / intrinsics.fx, (uv.y*intrinsics.height - intrinsics.cy) / intrinsics.fy, 1.f);
+  rayDir = glm::normalize(colorRotation*rayDir);
+
+  // Detect the plane under the touch
+  pc::Plane plane;
+  glm::vec3 depthPosition;
+  if (!planeDetector_->detectAlongRay(cloudDown.getPositionPtr(), cloudDown.size(), rayOrigin, rayDir, PlaneSupportRadius, plane, depthPosition)) {
+    LOGI("V_SENSE_DEBUG: No plane found (%.2fms)", planeDetector_->getLastDetectionTime());
     return;
   }
 
-  // Cast down to float for other functions.
-  const glm::vec3 depthPosition = glm::vec3(planes[0].intersection_point[0],
-                                            planes[0].intersection_point[1],
-                                            planes[0].intersection_point[2]);
-
-  // Use world up as the second vector unless they are nearly parallel, in
-  // which case use world +Z.
-  const glm::vec3 planeNormal(planes[0].plane_equation[0],
-                              planes[0].plane_equation[1],
-                              planes[0].plane_equation[2]);
+  LOGI("V_SENSE_DEBUG: Plane detection: %.2fms", planeDetector_->getLastDetectionTime());
 
-  // Free the planes returned by the plane fit call
-  TangoSupport_freePlaneList(&planes);
+  const glm::vec3 planeNormal = plane.normal;
 
   glm::vec3 normalX = glm::vec3(1.f, 0.f, 0.f);  // also world up vector
 
@@ -729,6 +873,19 @@ void PointCloudApp::onStartRecord() {
 
 void PointCloudApp::onPauseRecord() {
   recording_ = false;
+  saveSnapshot_ = true;
+
+  if(integrationController_) {
+    const em::IntegrationStats& stats = integrationController_->getStats();
+    LOGI("V_SENSE_DEBUG: EM coverage: %f, frames full/reduced/skipped: %zu/%zu/%zu, spent: %fms", integrationController_->getCoverage(), stats.nbrFull,
+         stats.nbrReduced, stats.nbrSkipped, stats.spentMS);
+  }
+
+  if(shFilter_) {
+    const sh::TemporalFilterStats& stats = shFilter_->getStats();
+    LOGI("V_SENSE_DEBUG: SH sets: %zu, skipped: %f, max skipped change: %f, re-projections: %zu/%zu", stats.nbrUpdates, shFilter_->getSkippedFraction(),
+         stats.maxSkippedChange, stats.nbrReprojections, stats.nbrFrames);
+  }
 
   /*if(emProcess_)
     emProcess_->printStats();*/
@@ -804,6 +961,117 @@ void PointCloudApp::onUpdateShadow(bool vis) {
     virtualPlaneObject_->setVisibility(vis);
 }
 
+void PointCloudApp::onUpdateCPULighting(bool enable) {
+  cpuLighting_ = enable;
+
+  if(virtualObject_)
+    virtualObject_->setCPULighting(enable);
+  if(virtualPlaneObject_)
+    virtualPlaneObject_->setCPULighting(enable);
+}
+
+void PointCloudApp::updateSHFilter() {
+  if(!emProcess_ || !shFilter_)
+    return;
+
+  // Read back without stalling the GPU, a set is only filtered once
+  uint64_t age;
+  std::shared_ptr<glm::vec4> shCoeffs = emProcess_->getSHCoefficients(age);
+  uint64_t frame = emProcess_->getFrameIndex() - age;
+
+  if(!hasSHFilterFrame_ || frame != shFilterFrame_) {
+    shFilterFrame_ = frame;
+    hasSHFilterFrame_ = true;
+
+    if(shFilter_->update(shCoeffs.get(), lastColorTimestamp_))
+      shFilteredTexture_->updateData((void*)shFilter_->getPublished().data());
+  }
+
+  // The objects only evaluate the lighting again if the coefficients changed
+  if(cpuLighting_) {
+    const std::vector<glm::vec4>& published = shFilter_->getPublished();
+
+    if(virtualObject_)
+      virtualObject_->updateAmbientCoefficients(published.data(), (int)published.size());
+    if(virtualPlaneObject_)
+      virtualPlaneObject_->updateAmbientCoefficients(published.data(), (int)published.size());
+  }
+}
+
+void PointCloudApp::createIntegrationController() {
+  if(integrationBudget_ <= 0.f) {
+    integrationController_.reset();
+    return;
+  }
+
+  em::IntegrationParams params;
+  params.budgetMS = integrationBudget_;
+  integrationController_.reset(new em::IntegrationController(params));
+}
+
+void PointCloudApp::resetSHFilter() {
+  if(shFilter_)
+    shFilter_->reset();
+  hasSHFilterFrame_ = false;
+}
+
+void PointCloudApp::restoreSnapshot() {
+  double t = wallTimeMS();
+
+  // The chain starts with a full snapshot, every following file is a delta or restarts it
+  em::EMSnapshot snapshot;
+  uint32_t sequence = 0;
+  struct stat info;
+  while(stat(snapshotFilename(sequence).c_str(), &info) == 0) {
+    if(!snapshot.read(snapshotFilename(sequence)))
+      break;
+    sequence++;
+  }
+
+  if(sequence == 0 || !emProcess_->fromSnapshot(snapshot))
+    return;
+
+  snapshotWriter_->setBase(snapshot);
+
+  // The coefficients filtered so far belong to the EM replaced
+  resetSHFilter();
+
+  t = wallTimeMS() - t;
+  LOGI("V_SENSE_DEBUG: EM restored from %u snapshot(s) in %fms", sequence, t);
+}
+
+void PointCloudApp::saveSnapshot() {
+  if(!emProcess_ || !snapshotWriter_)
+    return;
+
+  em::EMSnapshot snapshot;
+  emProcess_->toSnapshot(snapshot);
+
+  uint32_t sequence = snapshotWriter_->hasBase() ? snapshotWriter_->getSequence() + 1 : 0;
+  if(!snapshotWriter_->write(snapshotFilename(sequence), snapshot)) {
+    LOGE("V_SENSE_DEBUG: Unable to save the EM snapshot");
+    return;
+  }
+
+  // The snapshots left by an older chain would be read after this one
+  struct stat info;
+  for(uint32_t next = sequence + 1; stat(snapshotFilename(next).c_str(), &info) == 0; next++)
+    remove(snapshotFilename(next).c_str());
+
+  const em::SnapshotStats& stats = snapshotWriter_->getLastStats();
+  LOGI("V_SENSE_DEBUG: EM snapshot %u (%s): %zu tiles, %zu/%zu bytes, %fms", sequence, stats.delta ? "delta" : "full", stats.nbrWritten, stats.fileBytes,
+       stats.rawBytes, stats.ms);
+}
+
+void PointCloudApp::resetSnapshots() {
+  if(snapshotWriter_)
+    snapshotWriter_->reset();
+
+  struct stat info;
+  for(uint32_t sequence = 0; stat(snapshotFilename(sequence).c_str(), &info) == 0; sequence++)
+    remove(snapshotFilename(sequence).c_str());
+}
+
 void PointCloudApp::onUpdateVideo(bool vis) {
   if(videoOverlay_)
     videoOverlay_->setVisibility(vis);
@@ -816,20 +1084,36 @@ std::string PointCloudApp::getStateString() {
   ss.precision(3);
   if(perf_.find(Perf_EM) != perf_.end())
     ss << Perf_EM << ": " << perf_[Perf_EM] << std::endl;
+  if(perf_.find(Perf_EMStages) != perf_.end())
+    ss << Perf_EMStages << ": " << perf_[Perf_EMStages] << std::endl;
   if(perf_.find(Perf_MSE) != perf_.end())
     ss << Perf_MSE << ": " << perf_[Perf_MSE] << std::endl;
+  if(perf_.find(Perf_EMObserved) != perf_.end())
+    ss << Perf_EMObserved << ": " << perf_[Perf_EMObserved] << ", " << Perf_EMStaleTiles << ": " << perf_[Perf_EMStaleTiles] << std::endl;
 
   if(emProcess_) {
     glm::vec3 emOrigin = emProcess_->getOrigin();
     ss << "EM Origin: " << emOrigin.x << ", " << emOrigin.y << ", " << emOrigin.z << std::endl;
   }
 
+  if(integrationController_) {
+    const em::IntegrationStats& stats = integrationController_->getStats();
+    ss << "EM coverage: " << 100.f*integrationController_->getCoverage() << "% (" << stats.nbrFull << "/" << stats.nbrReduced << "/" << stats.nbrSkipped
+       << " frames, " << stats.spentMS << "ms)" << std::endl;
+  }
+
+  if(shFilter_)
+    ss << "SH skipped: " << 100.f*shFilter_->getSkippedFraction() << "% (max change " << shFilter_->getStats().maxSkippedChange << ")" << std::endl;
+
   status += ss.str();
 
   return status;
 }
 
 void PointCloudApp::onStopProcess() {
+  // Called outside the GL thread, the filter and the snapshot chain are restarted before the next frame is rendered
+  resetSHFilter_ = true;
+  resetSnapshots_ = true;
 }
 
 void PointCloudApp::updateTexture() {
@@ -854,6 +1138,20 @@ void PointCloudApp::onSetDepthMapEnableFillHolesWithMax(bool enable) {
   depth::DepthMap::setEnableFillWithMax(enable);
 }
 
+void PointCloudApp::onSetDepthMapIntegrationBudget(float budgetMS) {
+  integrationBudget_ = std::max(budgetMS, 0.f);
+  if(emProcess_)
+    createIntegrationController();
+}
+
+void PointCloudApp::onSetRestoreSnapshot(bool enable) {
+  // Enabled after the surface was created, the EM is restored unless a snapshot was already saved or restored
+  if(enable && !restoreSnapshot_ && emProcess_ && snapshotWriter_ && !snapshotWriter_->hasBase())
+    restoreSnapshot();
+
+  restoreSnapshot_ = enable;
+}
+
 void PointCloudApp::onSetColorCorrectionEnable(bool enable) {
   em::EnvironmentMap::setColorCorrectionEnabled(enable);
 }
@@ -878,9 +1176,20 @@ void PointCloudApp::onSetRenderNumberOrder(int orderNbr) {
   if(emProcess_)
     emProcess_->setMaxSHOrder(std::min(maxSHOrder_, maxMeshOrder_));
   if(virtualObject_)
-    virtualObject_->updateRenderCoefficientsNumber(nbrSHNbrCoeffs_);
+    virtualObject_->setSHOrder(std::min(maxSHOrder_, maxMeshOrder_));
+  if(virtualPlaneObject_)
+    virtualPlaneObject_->setSHOrder(std::min(maxSHOrder_, maxMeshOrder_));
+}
+
+void PointCloudApp::onSetRenderTransferBits(int transferBits) {
+  if(transferBits != sh::Transfer8Bit && transferBits != sh::Transfer16Bit)
+    transferBits = sh::TransferFloat;
+  transferBits_ = transferBits;
+
+  if(virtualObject_)
+    virtualObject_->setTransferQuantization((sh::TransferQuantization)transferBits_);
   if(virtualPlaneObject_)
-    virtualPlaneObject_->updateRenderCoefficientsNumber(nbrSHNbrCoeffs_);
+    virtualPlaneObject_->setTransferQuantization((sh::TransferQuantization)transferBits_);
 }
 
 void PointCloudApp::onSetRenderObject(int objIdx) {
@@ -38,7 +38,10 @@ namespace vsense {
 
 namespace em {
   //class EnvironmentMap;
+  class CoverageMap;
+  class IntegrationController;
   class Process;
+  class SnapshotWriter;
 }
 
 namespace io {
@@ -57,6 +60,7 @@ namespace gl {
   class SHMeshObject;
   class SHMeshDotObject;
   class SHMeshPlaneDotObject;
+  class Texture;
   class VideoOverlay;
   class EnvironmentMapOverlay;
 }
@@ -65,6 +69,14 @@ namespace depth {
   class DepthMap;
 }
 
+namespace pc {
+  class PlaneDetector;
+}
+
+namespace sh {
+  class TemporalFilter;
+}
+
 namespace ar {
 
 const int NbrStats = 5;
@@ -238,6 +250,8 @@ public:
 
   void onUpdateShadow(bool vis);
 
+  void onUpdateCPULighting(bool enable);
+
   void onStopProcess();
 
   void onSetSaving(bool saving) { saveFiles_ = saving; }
@@ -248,6 +262,10 @@ public:
 
   void onSetDepthMapEnableFillHolesWithMax(bool enable);
 
+  void onSetDepthMapIntegrationBudget(float budgetMS);
+
+  void onSetRestoreSnapshot(bool enable);
+
   void onSetOctreeResolution(float resolution);
 
   void onSetOctreeMaxDepth(int depth);
@@ -266,6 +284,8 @@ public:
 
   void onSetRenderNumberOrder(int orderNbr);
 
+  void onSetRenderTransferBits(int transferBits);
+
   void onSetRenderObject(int objIdx);
 
 private:
@@ -309,6 +329,36 @@ private:
 
   void addCurrentFrame();
 
+  /**
+   * Filters the newest SH coefficients of the environment and passes the published ones to the virtual objects.
+   */
+  void updateSHFilter();
+
+  /**
+   * Restarts the temporal filter of the SH coefficients and its counters, the next set is published as calculated.
+   */
+  void resetSHFilter();
+
+  /**
+   * Creates the integration controller with the current budget, none if every frame is to be integrated.
+   */
+  void createIntegrationController();
+
+  /**
+   * Restores the EM from the snapshots of the previous session, full snapshot and deltas.
+   */
+  void restoreSnapshot();
+
+  /**
+   * Saves a snapshot of the EM, only the tiles changed since the last one when possible.
+   */
+  void saveSnapshot();
+
+  /**
+   * Forgets the base of the snapshot deltas and deletes the snapshots saved, the next one is written in full.
+   */
+  void resetSnapshots();
+
   /**
    * Saves the point cloud and color image.
    */
@@ -323,7 +373,11 @@ private:
   int maxSHOrder_;
   int maxMeshOrder_;
   bool renderBaseColor_; /*!< True if base color of virtual object is to be rendered. */
+  bool cpuLighting_; /*!< True if the lighting of the virtual objects is evaluated on the CPU. */
+  int transferBits_; /*!< Bits per SH transfer coefficient of the virtual objects, 0 for single precision. */
   float minConfidence_; /*!< Minimum confidence allowed to be used as trusted in a depth map. */
+  bool restoreSnapshot_; /*!< True if the EM saved by the previous session is restored. */
+  float integrationBudget_; /*!< Average time per frame allowed to add frames to the EM (ms), 0 to integrate every frame. */
 
   common::Status status_;       /*!< Current process status. */
 
@@ -349,9 +403,20 @@ private:
 
   //std::shared_ptr<em::EnvironmentMap>   envMap_;
   std::shared_ptr<em::Process> emProcess_;
+  std::shared_ptr<em::IntegrationController> integrationController_; /*!< Decides how every frame is added to the EM. */
+  std::shared_ptr<em::SnapshotWriter>        snapshotWriter_;        /*!< Writer of the EM snapshots, keeps the base of the deltas. */
+  std::shared_ptr<em::CoverageMap>           coverageMap_;           /*!< Coverage of the EM read back for the telemetry. */
+  uint32_t                                   coverageReportFrame_;   /*!< Coverage frame of the last readback. */
 
   std::shared_ptr<depth::DepthMap>      dm_;
 
+  std::shared_ptr<pc::PlaneDetector>    planeDetector_; /*!< Plane detector used to place the virtual object on touch. */
+
+  std::shared_ptr<sh::TemporalFilter>   shFilter_;          /*!< Temporal filter of the SH coefficients of the environment. */
+  std::shared_ptr<gl::Texture>          shFilteredTexture_; /*!< Texture holding the published SH coefficients. */
+  uint64_t                              shFilterFrame_;     /*!< Frame of the last SH coefficients filtered. */
+  bool                                  hasSHFilterFrame_;  /*!< True once SH coefficients were filtered. */
+
   TangoSupportPointCloudManager*  pointCloudManager_;  /*!< Point cloud data manager. */
   TangoSupportImageBufferManager* imageBufferManager_; /*!< Image (color) data manager */
 
@@ -361,6 +426,9 @@ private:
   std::atomic<bool> isSceneCameraConfigured_;
   std::atomic<bool> saveFiles_;                /*!< Flag to indicate if files are to be save. */
   std::atomic<bool> recording_;                /*!< Allowed values: -1 (continuous recording), 0 (stop recording), 1 (single shot) */
+  std::atomic<bool> saveSnapshot_;             /*!< True if a snapshot of the EM is to be saved by the GL thread. */
+  std::atomic<bool> resetSHFilter_;            /*!< True if the SH filter is to be restarted by the GL thread. */
+  std::atomic<bool> resetSnapshots_;           /*!< True if the snapshot chain is to be restarted by the GL thread. */
 
   std::string curSaveFolder_;
 
@@ -54,12 +54,16 @@ class Settings {
     public float   dmConfidence;
     public boolean dmFillHoles;
     public boolean dmFillHolesWithMax;
+    public int     dmIntegrationBudget;
+    public boolean dmRestoreSnapshot;
     public boolean ccEnable;
     public float   ccMaxVariance;
     public float   ccMaxError;
     public int     ccMinPoints;
     public int     rnNbrSamples;
     public int     rnNbrOrder;
+    public int     rnTransferBits;
+    public boolean rnCPULighting;
     public boolean rnSkipEmpty;
     public boolean rnRenderBaseColor;
     public int     rnObject;
@@ -444,6 +448,30 @@ public class MainActivity extends AppCompatActivity implements View.OnClickListe
             });
         }
 
+        int dmIntegrationBudget = prefs.getInt("dm_integration_budget", 15);
+        if(mAppSettings.dmIntegrationBudget != dmIntegrationBudget || firstTime) {
+            mAppSettings.dmIntegrationBudget = dmIntegrationBudget;
+
+            mGLView.queueEvent(new Runnable() {
+                @Override
+                public void run() {
+                    TangoJNINative.onSetDepthMapIntegrationBudget(mAppSettings.dmIntegrationBudget);
+                }
+            });
+        }
+
+        boolean dmRestoreSnapshot = prefs.getBoolean("dm_restore_snapshot", false);
+        if(mAppSettings.dmRestoreSnapshot != dmRestoreSnapshot || firstTime) {
+            mAppSettings.dmRestoreSnapshot = dmRestoreSnapshot;
+
+            mGLView.queueEvent(new Runnable() {
+                @Override
+                public void run() {
+                    TangoJNINative.onSetRestoreSnapshot(mAppSettings.dmRestoreSnapshot);
+                }
+            });
+        }
+
         boolean ccEnable = prefs.getBoolean("cc_enable", true);
         if(mAppSettings.ccEnable != ccEnable || firstTime) {
             mAppSettings.ccEnable = ccEnable;
@@ -505,6 +533,30 @@ public class MainActivity extends AppCompatActivity implements View.OnClickListe
             });
         }
 
+        int rnTransferBits = Integer.parseInt(prefs.getString("rn_transfer_bits", "0"));
+        if(mAppSettings.rnTransferBits != rnTransferBits || firstTime) {
+            mAppSettings.rnTransferBits = rnTransferBits;
+
+            mGLView.queueEvent(new Runnable() {
+                @Override
+                public void run() {
+                    TangoJNINative.onSetRenderTransferBits(mAppSettings.rnTransferBits);
+                }
+            });
+        }
+
+        boolean rnCPULighting = prefs.getBoolean("rn_cpu_lighting", false);
+        if(mAppSettings.rnCPULighting != rnCPULighting || firstTime) {
+            mAppSettings.rnCPULighting = rnCPULighting;
+
+            mGLView.queueEvent(new Runnable() {
+                @Override
+                public void run() {
+                    TangoJNINative.onUpdateCPULighting(mAppSettings.rnCPULighting);
+                }
+            });
+        }
+
         String rnObjectStr = prefs.getString("render_object", "bunny");
         int rnObject = rnObjectStr.compareTo("bunny") == 0 ? 0 : -1;
         if(rnObject < 0)
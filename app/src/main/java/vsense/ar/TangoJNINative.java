@@ -107,6 +107,9 @@ public class TangoJNINative {
 
     public static native void onUpdateShadow(boolean vis);
 
+    // User requested to evaluate the lighting of the virtual objects on the CPU
+    public static native void onUpdateCPULighting(boolean enable);
+
     public static native void onUpdateColorCorrection(boolean colorCorrection);
 
     // User requested to stop the current process
@@ -118,6 +121,12 @@ public class TangoJNINative {
 
     public static native void onSetDepthMapEnableFillHolesWithMax(boolean enable);
 
+    // Average time per frame allowed to add frames to the EM (ms), 0 to integrate every frame
+    public static native void onSetDepthMapIntegrationBudget(int budgetMS);
+
+    // Restores the EM saved by the previous session
+    public static native void onSetRestoreSnapshot(boolean enable);
+
     public static native void onSetColorCorrectionEnable(boolean enable);
 
     public static native void onSetColorCorrectionMaxError(float error);
@@ -128,5 +137,8 @@ public class TangoJNINative {
 
     public static native void onSetRenderNumberOrder(int orderNbr);
 
+    // Bits per SH transfer coefficient of the virtual objects, 0 for single precision
+    public static native void onSetRenderTransferBits(int transferBits);
+
     public static native void onSetRenderObject(int objectIdx);
 }
@@ -0,0 +1,36 @@
+# CPU code of the libraries built as a single static library (vsense_host) for the Linux tools, without Qt, GLES or Tango.
+# Sets the include folders and the compiler flags of the tools including it.
+IF(NOT VSENSE_INCLUDE_DIR)
+	SET(VSENSE_INCLUDE_DIR ${CMAKE_CURRENT_LIST_DIR}/../vsense-libs/include)
+ENDIF()
+INCLUDE_DIRECTORIES(${VSENSE_INCLUDE_DIR})
+
+FIND_PACKAGE(glm REQUIRED)
+INCLUDE_DIRECTORIES(${GLM_INCLUDE_DIRS} ${glm_INCLUDE_DIR})
+
+FIND_PACKAGE(Threads REQUIRED)
+
+IF(NOT CMAKE_BUILD_TYPE)
+	SET(CMAKE_BUILD_TYPE Release)
+ENDIF()
+SET(CMAKE_CXX_FLAGS "${CMAKE_CXX_FLAGS} -std=c++11 -Wall")
+
+IF(NOT TARGET vsense_host)
+	SET(VSENSE_SRC_DIR ${CMAKE_CURRENT_LIST_DIR}/../vsense-libs/src/main/cpp)
+	FILE(GLOB HOST_FILES
+		${VSENSE_SRC_DIR}/vsense_color/vsense/color/*.cpp
+		${VSENSE_SRC_DIR}/vsense_depth/vsense/depth/*.cpp
+		${VSENSE_SRC_DIR}/vsense_em/vsense/em/*.cpp
+		${VSENSE_SRC_DIR}/vsense_io/vsense/io/*.cpp
+		${VSENSE_SRC_DIR}/vsense_pc/vsense/pc/*.cpp
+		${VSENSE_SRC_DIR}/vsense_sh/vsense/sh/*.cpp
+		${VSENSE_SRC_DIR}/vsense_synth/vsense/synth/*.cpp)
+	# Parts of the GL library that don't call GL
+	LIST(APPEND HOST_FILES ${VSENSE_SRC_DIR}/vsense_gl/vsense/gl/ComputeScheduler.cpp ${VSENSE_SRC_DIR}/vsense_gl/vsense/gl/ProgramCache.cpp
+		${VSENSE_SRC_DIR}/vsense_gl/vsense/gl/ReadbackRing.cpp ${VSENSE_SRC_DIR}/vsense_gl/vsense/gl/ShaderSource.cpp)
+	# The GPU process and the OBJ reader depend on Qt/GLES and the Android assets
+	LIST(REMOVE_ITEM HOST_FILES ${VSENSE_SRC_DIR}/vsense_em/vsense/em/Process.cpp ${VSENSE_SRC_DIR}/vsense_io/vsense/io/ObjReader.cpp)
+
+	ADD_LIBRARY(vsense_host STATIC ${HOST_FILES})
+	TARGET_LINK_LIBRARIES(vsense_host ${CMAKE_THREAD_LIBS_INIT})
+ENDIF()
@@ -0,0 +1,86 @@
+#ifndef VSENSE_COMMON_HALF_H_
+#define VSENSE_COMMON_HALF_H_
+
+#include <cstdint>
+#include <cstring>
+
+namespace vsense { namespace common {
+
+/*
+ * Converts a single-precision value to half precision (IEEE 754 binary16), rounding to the nearest even value.
+ * Values out of range are converted to infinity and NaNs are preserved.
+ * @param value Value to convert.
+ * @return Half-precision bits.
+ */
+inline uint16_t floatToHalf(float value) {
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(float));
+
+	uint16_t sign = (uint16_t)((bits >> 16) & 0x8000);
+	uint32_t absBits = bits & 0x7fffffff;
+
+	if (absBits >= 0x7f800000) // Infinity or NaN
+		return sign | 0x7c00 | (absBits > 0x7f800000 ? 0x200 : 0);
+
+	if (absBits >= 0x477ff000) // Rounds to a value over the maximum half
+		return sign | 0x7c00;
+
+	if (absBits < 0x38800000) { // Subnormal half or zero
+		if (absBits < 0x33000000)
+			return sign;
+
+		uint32_t shift = 126 - (absBits >> 23);
+		uint32_t mantissa = (absBits & 0x7fffff) | 0x800000;
+		uint32_t half = mantissa >> shift;
+		uint32_t rest = mantissa & ((1u << shift) - 1);
+		uint32_t halfway = 1u << (shift - 1);
+		if ((rest > halfway) || ((rest == halfway) && (half & 1)))
+			half++;
+
+		return sign | (uint16_t)half;
+	}
+
+	uint32_t half = ((absBits >> 13) - (112 << 10));
+	uint32_t rest = absBits & 0x1fff;
+	if ((rest > 0x1000) || ((rest == 0x1000) && (half & 1)))
+		half++;
+
+	return sign | (uint16_t)half;
+}
+
+/*
+ * Converts a half-precision value (IEEE 754 binary16) to single precision, the conversion is exact.
+ * @param half Half-precision bits.
+ * @return Single-precision value.
+ */
+inline float halfToFloat(uint16_t half) {
+	uint32_t sign = (uint32_t)(half & 0x8000) << 16;
+	uint32_t exponent = (half >> 10) & 0x1f;
+	uint32_t mantissa = half & 0x3ff;
+	uint32_t bits;
+
+	if (exponent == 0x1f) { // Infinity or NaN
+		bits = sign | 0x7f800000 | (mantissa << 13);
+	} else if (exponent) {
+		bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+	} else if (mantissa) { // Subnormal, normalize it
+		exponent = 113;
+		while (!(mantissa & 0x400)) {
+			mantissa <<= 1;
+			exponent--;
+		}
+
+		bits = sign | (exponent << 23) | ((mantissa & 0x3ff) << 13);
+	} else {
+		bits = sign;
+	}
+
+	float value;
+	memcpy(&value, &bits, sizeof(float));
+
+	return value;
+}
+
+} }
+
+#endif
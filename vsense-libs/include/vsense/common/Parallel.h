@@ -0,0 +1,61 @@
+#ifndef VSENSE_COMMON_PARALLEL_H_
+#define VSENSE_COMMON_PARALLEL_H_
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <vector>
+
+namespace vsense { namespace common {
+
+/*
+ * Retrieves the number of threads supported by the hardware.
+ * @return Number of threads (at least 1).
+ */
+inline size_t hardwareThreads() {
+	size_t nbrThreads = std::thread::hardware_concurrency();
+
+	return nbrThreads > 0 ? nbrThreads : 1;
+}
+
+/*
+ * Runs a set of independent jobs on several threads. The calling thread also processes jobs and the function
+ * returns once all of them are finished.
+ * @param nbrJobs Number of jobs.
+ * @param job Function called with the index of every job.
+ * @param nbrThreads Maximum number of threads to use, 0 to use all available.
+ */
+inline void parallelFor(size_t nbrJobs, const std::function<void(size_t)>& job, size_t nbrThreads = 0) {
+	if (!nbrThreads)
+		nbrThreads = hardwareThreads();
+
+	nbrThreads = std::min(nbrThreads, nbrJobs);
+
+	if (nbrThreads <= 1) {
+		for (size_t i = 0; i < nbrJobs; i++)
+			job(i);
+
+		return;
+	}
+
+	std::atomic<size_t> nextJob(0);
+	auto worker = [&]() {
+		size_t curJob;
+		while ((curJob = nextJob++) < nbrJobs)
+			job(curJob);
+	};
+
+	std::vector<std::thread> threads;
+	for (size_t i = 1; i < nbrThreads; i++)
+		threads.push_back(std::thread(worker));
+
+	worker();
+
+	for (size_t i = 0; i < threads.size(); i++)
+		threads[i].join();
+}
+
+} }
+
+#endif
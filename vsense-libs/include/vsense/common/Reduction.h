@@ -0,0 +1,77 @@
+#ifndef VSENSE_COMMON_REDUCTION_H_
+#define VSENSE_COMMON_REDUCTION_H_
+
+#include <cstddef>
+#include <vector>
+
+namespace vsense { namespace common {
+
+/*
+ * The WorkGroupReduction class emulates on the CPU the reductions of the compute shaders built with the reduction
+ * library (reduction.glsl), adding the values in the same order as the GPU: a tree with halving strides within every
+ * work group (reduceWorkGroup) followed by the sequential sum, in row-major work-group order, of the partial results
+ * done by the last work group to finish. It allows checking the shader logic and its rounding without a GPU.
+ */
+template <typename T>
+class WorkGroupReduction {
+public:
+	/*
+	 * WorkGroupReduction constructor.
+	 * @param groupSize Number of invocations per work group, must be a power of two.
+	 */
+	WorkGroupReduction(size_t groupSize) : groupSize_(groupSize), scratch_(groupSize) {}
+
+	/*
+	 * Retrieves the number of invocations per work group.
+	 * @return Work-group size.
+	 */
+	size_t getGroupSize() const { return groupSize_; }
+
+	/*
+	 * Reduces the values of one work group, as done by reduceWorkGroup().
+	 * @param values Value of every invocation, indexed by gl_LocalInvocationIndex.
+	 * @return Sum over the work group.
+	 */
+	T reduceGroup(const T* values) {
+		for (size_t i = 0; i < groupSize_; i++)
+			scratch_[i] = values[i];
+
+		for (size_t stride = groupSize_ / 2; stride > 0; stride /= 2) {
+			for (size_t i = 0; i < stride; i++)
+				scratch_[i] += scratch_[i + stride];
+		}
+
+		return scratch_[0];
+	}
+
+	/*
+	 * Reduces the values of a whole dispatch, as done by the work groups and the last one to finish.
+	 * @param values Value of every invocation, the invocation i of the work group g is at g*groupSize + i.
+	 * @param nbrGroups Number of work groups (at least 1), in row-major order.
+	 * @param partials Optional pointer where the partial result of every work group is saved.
+	 * @return Sum over the dispatch.
+	 */
+	T reduceDispatch(const T* values, size_t nbrGroups, T* partials = nullptr) {
+		T result = reduceGroup(values);
+		if (partials)
+			partials[0] = result;
+
+		for (size_t g = 1; g < nbrGroups; g++) {
+			T partial = reduceGroup(values + g*groupSize_);
+			if (partials)
+				partials[g] = partial;
+
+			result += partial;
+		}
+
+		return result;
+	}
+
+private:
+	size_t         groupSize_; /*!< Number of invocations per work group. */
+	std::vector<T> scratch_;   /*!< Emulated shared memory. */
+};
+
+} }
+
+#endif
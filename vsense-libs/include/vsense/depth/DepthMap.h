@@ -4,6 +4,7 @@
 #include <vsense/pc/PointCloud.h>
 
 #include <memory>
+#include <vector>
 
 #ifdef __ANDROID__
 struct TangoPoseData;
@@ -18,6 +19,9 @@ typedef unsigned char uchar;
 namespace vsense {
   namespace io {
     class Image;
+    struct ImageMetadata;
+    struct PointCloudMetadata;
+    class RemapCache;
   }
 
 	namespace pc {
@@ -26,6 +30,8 @@ namespace vsense {
 
 namespace depth {
 
+class JointBilateralUpsampler;
+
 	/*
 	 * The DepthpPoint structure extends from pc::Point and adds depth information.
 	 */
@@ -45,6 +51,14 @@ struct DepthPoint : pc::Point {
 #endif
 };
 
+/*
+ * Methods available to detect reliable points in the depth map.
+ */
+enum ReliabilityMode {
+	ReliabilityReference = 0, /*!< Every pixel evaluates its full neighborhood (reference implementation). */
+	ReliabilitySlidingWindow  /*!< Separable running sums, the test is evaluated for 8 pixels at once. */
+};
+
 /*
  * The DepthMap class implements I/O operations and manipulations for RGB-D data.
  */
@@ -76,6 +90,48 @@ public:
 	 */
 	const DepthPoint* getDataPtr() const { return pts_.get(); }
 
+	/*
+	 * Retrieves a pointer to the upsampled points.
+	 * @return Pointer to the upsampled points, NULL if upsampling is disabled.
+	 */
+	const DepthPoint* getUpsampledDataPtr() const { return upPts_.get(); }
+
+	/*
+	 * Retrieves the width of the upsampled depth map.
+	 * @return Width, 0 if upsampling is disabled.
+	 */
+	size_t upsampledWidth() const { return upPts_ ? upWidth_ : 0; }
+
+	/*
+	 * Retrieves the height of the upsampled depth map.
+	 * @return Height, 0 if upsampling is disabled.
+	 */
+	size_t upsampledHeight() const { return upPts_ ? upHeight_ : 0; }
+
+	/*
+	 * Retrieves the number of pixels in the upsampled depth map.
+	 * @return Number of pixels, 0 if upsampling is disabled.
+	 */
+	size_t nbrUpsampledPixels() const { return upsampledWidth()*upsampledHeight(); }
+
+	/*
+	 * Retrieves the time spent upsampling the last frame.
+	 * @return Time in milliseconds.
+	 */
+	float getLastUpsamplingTime() const { return lastUpsamplingTime_; }
+
+	/*
+	 * Retrieves the time spent marking the reliable points of the last frame.
+	 * @return Time in milliseconds.
+	 */
+	float getLastReliabilityTime() const { return lastReliabilityTime_; }
+
+	/*
+	 * Retrieves the time spent estimating the depth of the holes of the last frame.
+	 * @return Time in milliseconds, 0 if holes weren't filled.
+	 */
+	float getLastHoleFillingTime() const { return lastHoleFillingTime_; }
+
 	/*
 	 * Retrieves the current pose of the RGB-D frame.
 	 * @return Matrix holding the pose.
@@ -91,6 +147,16 @@ public:
 	 */
 	bool readFiles(const std::string& filenamePC, const std::string& filenameIM, float confidence);
 
+	/*
+	 * Populates the object from a point cloud and an image already in memory, e.g. generated or preloaded.
+	 * @param pc Point cloud in the depth sensor's CS.
+	 * @param pcData Point cloud metadata.
+	 * @param img Color image, kept by the object.
+	 * @param imData Image metadata, its pose relative to the depth sensor.
+	 * @return True if successful.
+	 */
+	bool fillWithData(const pc::PointCloud& pc, const io::PointCloudMetadata& pcData, const std::shared_ptr<io::Image>& img, const io::ImageMetadata& imData);
+
 	/*
 	 * Converts the object to a rendereable point cloud.
 	 * @param pc Point cloud object where the content is to be saved.
@@ -121,6 +187,59 @@ public:
 	 */
 	static void setEnableFillWithMax(bool enable) { fillWithMax_ = enable; }
 
+	/*
+	 * Updates the resolution of the joint-bilateral depth upsampling stage.
+	 * The upsampled depth map keeps the depth sensor's aspect ratio, its width is the closest integer multiple of the 
+	 * depth map width to the requested fraction of the color image width.
+	 * @param fraction Fraction of the color image width, 0 to disable upsampling.
+	 */
+	static void setUpsamplingColorFraction(float fraction) { upsamplingColorFraction_ = fraction; }
+
+	/*
+	 * Replaces the precomputed mapping from pixels in the depth map to X/Z, Y/Z coordinates, read from a file by default.
+	 * @param ptMap Mapping of every pixel, NULL disables hole-filling and upsampling.
+	 */
+	static void setDepthMapping(const std::shared_ptr<glm::vec2>& ptMap) { ptMap_ = ptMap; }
+
+	/*
+	 * Retrieves the mapping from pixels in the depth map to X/Z, Y/Z coordinates.
+	 * @return Mapping of every pixel, NULL if not available.
+	 */
+	static const std::shared_ptr<glm::vec2>& getDepthMapping() { return ptMap_; }
+
+	/*
+	 * Updates the method used to detect reliable points.
+	 * @param mode Reliability mode.
+	 */
+	static void setReliabilityMode(ReliabilityMode mode) { reliabilityMode_ = mode; }
+
+	/*
+	 * Updates the size of the neighborhood used to detect reliable points.
+	 * @param size Window size, only 3 (3x3) and 5 (5x5) are supported.
+	 * @return True if the size is supported.
+	 */
+	static bool setReliabilityWindow(size_t size);
+
+	/*
+	 * Retrieves the size of the neighborhood used to detect reliable points.
+	 * @return Window size.
+	 */
+	static size_t reliabilityWindow() { return reliabilityWindow_; }
+
+	/*
+	 * Retrieves the limit of the chi-square test detecting reliable points, p = 0.05. Shared with the GPU test.
+	 * @param size Window size, 3 (3x3) or 5 (5x5).
+	 * @return Limit of the test.
+	 */
+	static float limitChiSquare(size_t size);
+
+	/*
+	 * Runs both reliability modes on the current frame and compares the resulting flags.
+	 * The flags of the active mode are kept in the object.
+	 * @return Number of pixels where both modes disagree.
+	 */
+	size_t compareReliabilityModes();
+
 	/*
 	 * Retrieves the width of the depth map.
 	 * @return Width.
@@ -160,6 +279,16 @@ private:
 	 */
 	void findKnownDepth(const glm::i16vec2& pos, const glm::i16vec2& dir, float& depth, float& dt);
 
+	/*
+	 * Creates the upsampled depth map from the known points, using the color image as guide.
+	 * @param imPose Pose of the color camera relative to the depth sensor.
+	 * @param image Color image.
+	 * @param distortion Distortion coefficients of the color camera.
+	 * @param f Focal length of the color camera.
+	 * @param c Principal point of the color camera.
+	 */
+	void upsample(const glm::mat4& imPose, const io::Image* image, const double* distortion, const glm::dvec2& f, const glm::dvec2& c);
+
 	/*
 	 * Reads the depth-mapping file.
 	 * This file contains precomputed mapping between the pixels in the depth map plane and the X/Z, Y/Z coordinates.
@@ -171,12 +300,34 @@ private:
 	 */
 	void markReliablePoints();
 
+	/*
+	 * Marks the reliable points evaluating the full neighborhood of every pixel.
+	 */
+	void markReliablePointsReference();
+
+	/*
+	 * Marks the reliable points using separable running sums of depth and squared depth.
+	 */
+	void markReliablePointsSlidingWindow();
+
 	std::shared_ptr<DepthPoint> pts_; /*!< Depth map points. */
 
 	glm::mat4 pose_; /*!< Pose in the world CS for the depth map. */
 
 	std::shared_ptr<io::Image> img_;  /*!< Current RGB image on the camera. */
 
+	std::shared_ptr<DepthPoint> upPts_;                 /*!< Upsampled depth map points. */
+	size_t upWidth_;                                    /*!< Width of the upsampled depth map. */
+	size_t upHeight_;                                   /*!< Height of the upsampled depth map. */
+	float lastUpsamplingTime_;                          /*!< Time in milliseconds spent upsampling the last frame. */
+	float lastReliabilityTime_;                         /*!< Time in milliseconds spent marking the reliable points of the last frame. */
+	float lastHoleFillingTime_;                         /*!< Time in milliseconds spent filling the holes of the last frame. */
+	std::shared_ptr<JointBilateralUpsampler> upsampler_; /*!< Filter used to upsample the depth map. */
+
+	std::vector<float> reliabilityData_; /*!< Scratch buffers used by the sliding-window reliability test. */
+
+	std::shared_ptr<io::RemapCache> colorMap_; /*!< Mapping from the pixels of the depth map to the color image, used by hole-filling. */
+
 	static std::shared_ptr<glm::vec2> ptMap_; /*!< Precomputed mapping from pixels in the depth map, to X/Z, Y/Z coordinates. */
 
 	static size_t width_;     /*!< Width in pixels for the depth map. */
@@ -185,6 +336,11 @@ private:
 
 	static bool fillHoles_; /*!< True if holes are to be filled in. */
 	static bool fillWithMax_; /*!< True if unknown depth is to be filled with sensor's maximum (4m). */
+
+	static float upsamplingColorFraction_;   /*!< Fraction of the color image width used for the upsampled depth map. */
+
+	static ReliabilityMode reliabilityMode_; /*!< Method used to detect reliable points. */
+	static size_t reliabilityWindow_;        /*!< Size of the neighborhood used to detect reliable points. */
 };
 
 } }
@@ -0,0 +1,96 @@
+#ifndef VSENSE_DEPTH_JOINTBILATERALUPSAMPLER_H_
+#define VSENSE_DEPTH_JOINTBILATERALUPSAMPLER_H_
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+#ifndef uchar
+typedef unsigned char uchar;
+#endif
+
+namespace vsense { namespace depth {
+
+/*
+ * The JointBilateralUpsampler class upsamples a depth map guided by a color image of higher resolution.
+ * The filter is applied separately (horizontal pass on the low-resolution rows, then vertical pass), the output is
+ * processed in tiles distributed over several threads.
+ */
+class JointBilateralUpsampler {
+public:
+	/*
+	 * JointBilateralUpsampler constructor.
+	 * @param factor Upsampling factor.
+	 * @param sigmaSpatial Standard deviation of the spatial kernel (low-resolution pixels).
+	 * @param sigmaRange Standard deviation of the range kernel (linear RGB).
+	 */
+	JointBilateralUpsampler(size_t factor = 2, float sigmaSpatial = 1.f, float sigmaRange = 0.1f);
+
+	/*
+	 * Updates the upsampling factor.
+	 * @param factor Upsampling factor.
+	 */
+	void setFactor(size_t factor);
+
+	/*
+	 * Retrieves the upsampling factor.
+	 * @return Upsampling factor.
+	 */
+	size_t factor() const { return factor_; }
+
+	/*
+	 * Updates the standard deviations of the filter's kernels.
+	 * @param sigmaSpatial Standard deviation of the spatial kernel (low-resolution pixels).
+	 * @param sigmaRange Standard deviation of the range kernel (linear RGB).
+	 */
+	void setSigmas(float sigmaSpatial, float sigmaRange);
+
+	/*
+	 * Updates the number of threads used by the filter.
+	 * @param nbrThreads Number of threads, 0 to use all available.
+	 */
+	void setNbrThreads(size_t nbrThreads) { nbrThreads_ = nbrThreads; }
+
+	/*
+	 * Upsamples a depth map.
+	 * @param depth Low-resolution depth (width x height).
+	 * @param color Low-resolution colors (width x height).
+	 * @param valid Low-resolution validity mask (width x height), non-zero for known depth.
+	 * @param width Width of the low-resolution depth map.
+	 * @param height Height of the low-resolution depth map.
+	 * @param guide High-resolution colors (width*factor x height*factor).
+	 * @param depthOut Output high-resolution depth (width*factor x height*factor).
+	 * @param weightOut Output accumulated weights (width*factor x height*factor), zero where no depth was estimated.
+	 */
+	void upsample(const float* depth, const glm::vec3* color, const uchar* valid, size_t width, size_t height, const glm::vec3* guide, float* depthOut, float* weightOut);
+
+private:
+	/*
+	 * Recalculates the spatial and range weight tables.
+	 */
+	void updateTables();
+
+	/*
+	 * Retrieves the range weight between two colors.
+	 * @param a First color.
+	 * @param b Second color.
+	 * @return Weight.
+	 */
+	float rangeWeight(const glm::vec3& a, const glm::vec3& b) const;
+
+	size_t factor_;      /*!< Upsampling factor. */
+	float sigmaSpatial_; /*!< Standard deviation of the spatial kernel. */
+	float sigmaRange_;   /*!< Standard deviation of the range kernel. */
+	size_t nbrThreads_;  /*!< Number of threads used, 0 for all available. */
+
+	std::vector<float> spatialWeights_; /*!< Spatial weights for every phase and tap. */
+	std::vector<int>   tapOffsets_;     /*!< Offset of the first tap for every phase. */
+	std::vector<float> rangeWeights_;   /*!< Range weights indexed by the quantized squared color distance. */
+
+	std::vector<float> rowDepth_;  /*!< Output of the horizontal pass (depth). */
+	std::vector<float> rowWeight_; /*!< Output of the horizontal pass (accumulated weights). */
+};
+
+} }
+
+#endif
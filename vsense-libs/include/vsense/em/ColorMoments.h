@@ -0,0 +1,69 @@
+#ifndef VSENSE_EM_COLORMOMENTS_H_
+#define VSENSE_EM_COLORMOMENTS_H_
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+
+namespace vsense { namespace em {
+
+/*
+ * The ColorMoments structure accumulates the second-order moments of pairs of current and reference colors. They are
+ * enough to obtain the mean squared error left after applying any 3x3 color correction in closed form:
+ *   sum|ref - M*cur|^2 = sum(ref.ref) - 2*trace(M*sum(cur*ref^T)) + trace(M*sum(cur*cur^T)*M^T)
+ * so the error can be accumulated in the same pass as the normal equations used to estimate the correction.
+ */
+struct ColorMoments {
+	/*
+	 * ColorMoments constructor.
+	 */
+	ColorMoments() : curCur(0.0), refCur(0.0), refRef(0.0), count(0) {}
+
+	/*
+	 * Adds a pair of colors.
+	 * @param cur Current color.
+	 * @param ref Reference color.
+	 */
+	void add(const glm::vec3& cur, const glm::vec3& ref);
+
+	/*
+	 * Adds a pair of RGB-D samples as projected to the EM, the sign of the depth is the reliability of the sample. Only
+	 * pairs where both samples are reliable are added, as the error is only estimated on them.
+	 * @param cur Current sample.
+	 * @param ref Reference sample.
+	 * @return True if the pair was added.
+	 */
+	bool addReliable(const glm::vec4& cur, const glm::vec4& ref);
+
+	/*
+	 * Adds the moments accumulated by another object.
+	 * @param moments Moments to add.
+	 */
+	void add(const ColorMoments& moments);
+
+	/*
+	 * Reads the moments from the final data of the color correction shader (environmentMapCorrect.comp): cur*cur^T in
+	 * columns 7 to 9, ref*cur^T in columns 10 to 12, and the number of pairs and ref.ref in column 6 of the second and
+	 * third rows.
+	 * @param data Final data, row-major.
+	 * @param width Width of the final data.
+	 * @return Moments.
+	 */
+	static ColorMoments fromCorrectionData(const float* data, size_t width);
+
+	/*
+	 * Calculates the mean squared error after applying a color correction to the current colors.
+	 * @param corr Color-correction matrix.
+	 * @return Mean squared error, negative if no pairs were added.
+	 */
+	double meanSquaredError(const glm::mat3& corr) const;
+
+	glm::dmat3 curCur;  /*!< Sum of cur*cur^T. */
+	glm::dmat3 refCur;  /*!< Sum of ref*cur^T (row from the reference, column from the current color). */
+	double     refRef;  /*!< Sum of ref.ref. */
+	uint32_t   count;   /*!< Number of pairs added. */
+};
+
+} }
+
+#endif
@@ -0,0 +1,198 @@
+#ifndef VSENSE_EM_COVERAGEMAP_H_
+#define VSENSE_EM_COVERAGEMAP_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace vsense { namespace em {
+
+const uint32_t CoverageCountBits = 8;                                   /*!< Bits of a texel holding its observation count. */
+const uint32_t CoverageMaxCount = (1u << CoverageCountBits) - 1;        /*!< Observation count saturating the texel. */
+const uint32_t CoverageMaxFrame = (1u << (32 - CoverageCountBits)) - 1; /*!< Last frame index that can be stored. */
+
+/*
+ * Coverage of a tile of the EM.
+ */
+struct TileCoverage {
+	TileCoverage() : coverage(0.f), singleFraction(0.f), meanAge(0.f) {}
+
+	float coverage;       /*!< Fraction of the texels observed. */
+	float singleFraction; /*!< Fraction of the observed texels seen in a single frame. */
+	float meanAge;        /*!< Average number of frames since the observed texels were last seen. */
+};
+
+/*
+ * The CoverageMap class keeps, for every texel of an equirectangular map, the index of the last frame that observed it
+ * and in how many frames it was observed, packed in 32 bits (frame << 8 | count, 0 if never observed) as in the
+ * r32ui image updated by environmentMapProject.comp and environmentMapResolve.comp. The frames start at 1 and a texel
+ * is counted once per frame, the count saturates at 255. The map is split in tiles whose number of observed texels,
+ * number of texels seen once and sum of last frames are updated with every observation, so the coverage and age of
+ * a tile are available in constant time and the ones of the whole map in the number of tiles.
+ */
+class CoverageMap {
+public:
+	/*
+	 * CoverageMap constructor.
+	 * @param tileSize Size in pixels of the tiles, rounded down to a power of two.
+	 */
+	CoverageMap(size_t tileSize = 32);
+
+	/*
+	 * Updates the dimensions of the map, every texel is cleared.
+	 * @param width Map width.
+	 * @param height Map height.
+	 */
+	void resize(size_t width, size_t height);
+
+	/*
+	 * Marks every texel as never observed.
+	 */
+	void clear();
+
+	/*
+	 * Records the observation of a texel, inlined as it runs for every texel stored.
+	 * @param offset Offset of the texel.
+	 * @param frame Index of the frame (1 to CoverageMaxFrame).
+	 */
+	void observe(size_t offset, uint32_t frame) {
+		uint32_t& texel = packed_[offset];
+		uint32_t lastFrame = texel >> CoverageCountBits;
+		if (lastFrame == frame) // Already counted in this frame
+			return;
+
+		uint32_t count = texel & CoverageMaxCount;
+		uint32_t row = (uint32_t)offset / (uint32_t)width_;
+		uint32_t col = (uint32_t)offset - row*(uint32_t)width_;
+		size_t tile = (row >> tileShift_)*tilesX_ + (col >> tileShift_);
+
+		if (count == 0) {
+			tileObserved_[tile]++;
+			tileSingle_[tile]++;
+		} else if (count == 1) {
+			tileSingle_[tile]--;
+		}
+
+		tileFrameSum_[tile] += frame - lastFrame;
+
+		if (count < CoverageMaxCount)
+			count++;
+		texel = (frame << CoverageCountBits) | count;
+	}
+
+	/*
+	 * Replaces every texel and recalculates the statistics, e.g. with the image read back from the GPU.
+	 * @param packed Packed value of every texel.
+	 */
+	void load(const uint32_t* packed);
+
+	/*
+	 * Retrieves the number of frames a texel was observed in.
+	 * @param offset Offset of the texel.
+	 * @return Observation count, 0 if never observed.
+	 */
+	uint32_t getCount(size_t offset) const { return packed_[offset] & CoverageMaxCount; }
+
+	/*
+	 * Retrieves the number of frames since a texel was last observed.
+	 * @param offset Offset of the texel.
+	 * @param frame Index of the current frame.
+	 * @return Age in frames, UINT32_MAX if never observed.
+	 */
+	uint32_t getAge(size_t offset, uint32_t frame) const;
+
+	/*
+	 * Retrieves the coverage of a tile.
+	 * @param tile Index of the tile.
+	 * @param frame Index of the current frame.
+	 * @return Coverage of the tile.
+	 */
+	TileCoverage getTile(size_t tile, uint32_t frame) const;
+
+	/*
+	 * Retrieves the coverage of the whole map, adding the counters of the tiles.
+	 * @param frame Index of the current frame.
+	 * @return Coverage of the map.
+	 */
+	TileCoverage getTotal(uint32_t frame) const;
+
+	/*
+	 * Finds the tiles needing new observations.
+	 * @param frame Index of the current frame.
+	 * @param maxMeanAge Mean age from which a tile is stale.
+	 * @param minCoverage Coverage below which a tile is incomplete.
+	 * @param tiles Indices of the stale or incomplete tiles, the least covered and oldest first.
+	 * @return Number of tiles found.
+	 */
+	size_t findStaleTiles(uint32_t frame, float maxMeanAge, float minCoverage, std::vector<size_t>& tiles) const;
+
+	/*
+	 * Retrieves the fraction of the map observed.
+	 * @return Coverage (0.f-1.f).
+	 */
+	float getCoverage() const { return packed_.empty() ? 0.f : (float)getNbrObserved() / packed_.size(); }
+
+	/*
+	 * Retrieves the number of texels observed.
+	 * @return Number of texels.
+	 */
+	size_t getNbrObserved() const;
+
+	/*
+	 * Retrieves the number of texels observed in a single frame.
+	 * @return Number of texels.
+	 */
+	size_t getNbrSingle() const;
+
+	/*
+	 * Retrieves the packed value of every texel.
+	 * @return Pointer to the texels.
+	 */
+	const uint32_t* getPackedPtr() const { return packed_.data(); }
+
+	/*
+	 * Retrieves the size of the tiles.
+	 * @return Tile size in pixels.
+	 */
+	size_t getTileSize() const { return tileSize_; }
+
+	/*
+	 * Retrieves the number of tiles horizontally.
+	 * @return Number of tiles.
+	 */
+	size_t getNbrTilesX() const { return tilesX_; }
+
+	/*
+	 * Retrieves the number of tiles vertically.
+	 * @return Number of tiles.
+	 */
+	size_t getNbrTilesY() const { return tilesY_; }
+
+private:
+	/*
+	 * Calculates the coverage from the counters.
+	 * @param nbrTexels Number of texels.
+	 * @param observed Number of texels observed.
+	 * @param single Number of texels observed once.
+	 * @param frameSum Sum of the last frames of the observed texels.
+	 * @param frame Index of the current frame.
+	 * @return Coverage.
+	 */
+	static TileCoverage toCoverage(size_t nbrTexels, size_t observed, size_t single, uint64_t frameSum, uint32_t frame);
+
+	size_t                width_;        /*!< Map width. */
+	size_t                height_;       /*!< Map height. */
+	size_t                tileSize_;     /*!< Tile size in pixels. */
+	uint32_t              tileShift_;    /*!< Log2 of the tile size. */
+	size_t                tilesX_;       /*!< Number of tiles horizontally. */
+	size_t                tilesY_;       /*!< Number of tiles vertically. */
+
+	std::vector<uint32_t> packed_;       /*!< Last frame and observation count of every texel. */
+	std::vector<uint32_t> tileObserved_; /*!< Number of texels observed per tile. */
+	std::vector<uint32_t> tileSingle_;   /*!< Number of texels observed once per tile. */
+	std::vector<uint64_t> tileFrameSum_; /*!< Sum of the last frames of the observed texels per tile. */
+};
+
+} }
+
+#endif
@@ -0,0 +1,155 @@
+#ifndef VSENSE_EM_DEPTHPREPROCESS_H_
+#define VSENSE_EM_DEPTHPREPROCESS_H_
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <vector>
+
+namespace vsense { namespace em {
+
+/*
+ * Parameters of the depth preprocessing, as set in the uniforms of the shaders.
+ */
+struct DepthPreprocessParams {
+	DepthPreprocessParams() : f(0.f), c(0.f), pose(1.f), radius(1), limitChiSquare(0.f), fillWithMax(false) {
+		for (int i = 0; i < 5; i++)
+			coeff[i] = 0.f;
+	}
+
+	glm::vec2 f;              /*!< Focal length of the color camera. */
+	glm::vec2 c;              /*!< Principal point of the color camera. */
+	float     coeff[5];       /*!< Distortion coefficients of the color camera. */
+	glm::mat4 pose;           /*!< Pose of the color camera. */
+	int       radius;         /*!< Half of the reliability window size, 1 (3x3) or 2 (5x5). */
+	float     limitChiSquare; /*!< Maximum chi-square value for a reliable pixel. */
+	bool      fillWithMax;    /*!< True if the holes are filled with the maximum depth. */
+};
+
+/*
+ * Number of image accesses done by the depth preprocessing.
+ */
+struct ImageTraffic {
+	ImageTraffic() : nbrDispatches(0), nbrReads(0), nbrWrites(0), nbrSharedReads(0) {}
+
+	size_t nbrDispatches;  /*!< Number of dispatches. */
+	size_t nbrReads;       /*!< Pixels loaded from the images. */
+	size_t nbrWrites;      /*!< Pixels stored to the images. */
+	size_t nbrSharedReads; /*!< Known-point lookups of the hole search served by the shared tile. */
+};
+
+/*
+ * The DepthPreprocess class is the CPU reference of the depth preprocessing done after depthMapInit.comp: marking the
+ * reliable points and filling the holes. Both the separate passes (depthMapMarkReliable.comp, depthMapFillHoles.comp)
+ * and the fused pass (depthMapPreprocess.comp) are implemented, processing the pixels in 8x8 work groups whose
+ * shared tile holds the known points of the group and its apron, as done by the shaders. Both produce the same maps.
+ */
+class DepthPreprocess {
+public:
+	/*
+	 * DepthPreprocess constructor.
+	 * @param width Width of the depth map.
+	 * @param height Height of the depth map.
+	 */
+	DepthPreprocess(int width, int height);
+
+	/*
+	 * Runs the fused pass.
+	 * @param depthMap RGB-D map written by the initialization.
+	 * @param pointsMap Points (XYZ, flags) written by the initialization.
+	 * @param colorImage Color image.
+	 * @param colorWidth Width of the color image.
+	 * @param colorHeight Height of the color image.
+	 * @param ptMapping Normalized coordinates of every depth-map pixel, (0, 0) if not mapped.
+	 * @param params Parameters.
+	 * @param depthOut Output RGB-D map, must be cleared.
+	 * @param pointsOut Output points, must be cleared.
+	 */
+	void runFused(const glm::vec4* depthMap, const glm::vec4* pointsMap, const glm::vec4* colorImage, int colorWidth, int colorHeight, 
+		const glm::vec2* ptMapping, const DepthPreprocessParams& params, glm::vec4* depthOut, glm::vec4* pointsOut);
+
+	/*
+	 * Runs the separate reliability and hole-filling passes.
+	 * @param depthMap RGB-D map written by the initialization.
+	 * @param pointsMap Points (XYZ, flags) written by the initialization, the final points are written to it.
+	 * @param colorImage Color image.
+	 * @param colorWidth Width of the color image.
+	 * @param colorHeight Height of the color image.
+	 * @param ptMapping Normalized coordinates of every depth-map pixel, (0, 0) if not mapped.
+	 * @param params Parameters.
+	 * @param depthOut Output RGB-D map, must be cleared.
+	 * @param pointsTmp Intermediate points, must be cleared.
+	 */
+	void runMultiPass(const glm::vec4* depthMap, glm::vec4* pointsMap, const glm::vec4* colorImage, int colorWidth, int colorHeight, 
+		const glm::vec2* ptMapping, const DepthPreprocessParams& params, glm::vec4* depthOut, glm::vec4* pointsTmp);
+
+	/*
+	 * Retrieves the image accesses of the last run.
+	 * @return Image traffic.
+	 */
+	const ImageTraffic& getLastTraffic() const { return traffic_; }
+
+private:
+	/*
+	 * Loads the tile of a work group and calculates the horizontal window sums.
+	 * @param groupX Horizontal index of the work group.
+	 * @param groupY Vertical index of the work group.
+	 * @param depthMap RGB-D map.
+	 * @param pointsMap Points.
+	 * @param radius Half of the reliability window size.
+	 */
+	void loadTile(int groupX, int groupY, const glm::vec4* depthMap, const glm::vec4* pointsMap, int radius);
+
+	/*
+	 * Tests the reliability of a known point with the current tile.
+	 * @param x Column of the pixel.
+	 * @param y Row of the pixel.
+	 * @param localX Column within the work group.
+	 * @param localY Row within the work group.
+	 * @param depthData RGB-D of the pixel.
+	 * @param params Parameters.
+	 * @return True if reliable.
+	 */
+	bool isReliable(int x, int y, int localX, int localY, const glm::vec4& depthData, const DepthPreprocessParams& params) const;
+
+	/*
+	 * Estimates the depth of a hole from the closest known points in eight directions.
+	 * @param x Column of the pixel.
+	 * @param y Row of the pixel.
+	 * @param isKnown Retrieves the depth of a pixel if known.
+	 * @return Estimated depth.
+	 */
+	template <typename KnownFunc>
+	float estimateDepth(int x, int y, KnownFunc isKnown) const;
+
+	/*
+	 * Fills a hole, as done by both hole-filling shaders.
+	 * @param x Column of the pixel.
+	 * @param y Row of the pixel.
+	 * @param colorImage Color image.
+	 * @param colorWidth Width of the color image.
+	 * @param colorHeight Height of the color image.
+	 * @param ptMapping Normalized coordinates of every depth-map pixel, (0, 0) if not mapped.
+	 * @param params Parameters.
+	 * @param isKnown Retrieves the depth of a pixel if known.
+	 * @param depthOut RGB-D of the filled pixel.
+	 * @param pointOut Point of the filled pixel.
+	 * @return True if the pixel was filled.
+	 */
+	template <typename KnownFunc>
+	bool fillHole(int x, int y, const glm::vec4* colorImage, int colorWidth, int colorHeight, const glm::vec2* ptMapping, 
+		const DepthPreprocessParams& params, KnownFunc isKnown, glm::vec4& depthOut, glm::vec4& pointOut);
+
+	int                    width_;       /*!< Width of the depth map. */
+	int                    height_;      /*!< Height of the depth map. */
+	int                    tileOriginX_; /*!< Column of the first pixel in the current tile. */
+	int                    tileOriginY_; /*!< Row of the first pixel in the current tile. */
+	std::vector<float>     tileDepth_;   /*!< Depth of the known pixels in the tile, 0 otherwise. */
+	std::vector<float>     tileInvalid_; /*!< 1 for the unknown pixels in the tile. */
+	std::vector<glm::vec3> tileRowSums_; /*!< Horizontal window sums: depth, squared depth, unknown pixels. */
+	ImageTraffic           traffic_;     /*!< Image accesses of the last run. */
+};
+
+} }
+
+#endif
@@ -0,0 +1,270 @@
+#ifndef VSENSE_EM_EMSNAPSHOT_H_
+#define VSENSE_EM_EMSNAPSHOT_H_
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace vsense { namespace em {
+
+const uint32_t EMSnapshotMagic = 0x534D4556; /*!< Identifier of the EM snapshot files ("VEMS"). */
+const uint32_t EMSnapshotVersion = 1;        /*!< Version of the format written. */
+
+const uint32_t SnapshotDelta = 0x01; /*!< The file only holds the tiles changed since the snapshot it is based on. */
+
+/*
+ * Planes of a snapshot.
+ */
+enum SnapshotPlaneId {
+	PlaneColor = 0,  /*!< RGB of every texel (glm::vec3, EnvironmentMap). */
+	PlaneDepth,      /*!< Depth of every texel, negative if empty (float, EnvironmentMap). */
+	PlaneFlags,      /*!< Reliability of every texel (uchar, EnvironmentMap). */
+	PlaneColorDepth, /*!< RGB and depth of every texel, the sign of the depth as flag (glm::vec4, Process). */
+	PlaneCoverage    /*!< Last frame and observation count of every texel (uint32_t, see CoverageMap). */
+};
+
+/*
+ * Per-texel data stored in a snapshot.
+ */
+struct SnapshotPlane {
+	uint32_t             id;          /*!< Identifier (SnapshotPlaneId). */
+	uint32_t             elementSize; /*!< Size in bytes of the value of a texel. */
+	std::vector<uint8_t> empty;       /*!< Value of the empty texels, not stored in the files. */
+	std::vector<uint8_t> data;        /*!< Value of every texel. */
+};
+
+/*
+ * Counters of the last snapshot written.
+ */
+struct SnapshotStats {
+	SnapshotStats() : nbrTiles(0), nbrWritten(0), rawBytes(0), fileBytes(0), delta(false), ms(0.f) {}
+
+	size_t nbrTiles;   /*!< Number of tiles of every plane. */
+	size_t nbrWritten; /*!< Number of tiles written, all planes included. */
+	size_t rawBytes;   /*!< Size of the planes in memory. */
+	size_t fileBytes;  /*!< Size of the file. */
+	bool   delta;      /*!< True if only the changed tiles were written. */
+	float  ms;         /*!< Time spent encoding and writing (ms). */
+};
+
+/*
+ * The EMSnapshot class holds the state of an EM so a session can be resumed without integrating its frames again:
+ * per-texel planes, origin, color-correction matrix, index of the last frame and SH coefficients. The snapshot files
+ * (version 1) hold a header, the state other than the planes and, per plane, the tiles having at least one non-empty
+ * texel. Every tile is stored as runs of empty texels and of literal values, so the unobserved regions of the EM cost
+ * a few bytes. A delta file only holds the tiles changed since the snapshot it is based on, a chain of files is
+ * restored by reading them in order.
+ */
+class EMSnapshot {
+public:
+	/*
+	 * EMSnapshot constructor.
+	 */
+	EMSnapshot();
+
+	/*
+	 * Removes every plane and sets the dimensions of the EM.
+	 * @param width EM width.
+	 * @param height EM height.
+	 */
+	void reset(uint32_t width, uint32_t height);
+
+	/*
+	 * Adds a plane, replacing the one with the same identifier.
+	 * @param id Identifier (SnapshotPlaneId).
+	 * @param elementSize Size in bytes of the value of a texel.
+	 * @param empty Value of the empty texels.
+	 * @param data Value of every texel, copied.
+	 */
+	void addPlane(uint32_t id, uint32_t elementSize, const void* empty, const void* data);
+
+	/*
+	 * Retrieves a plane.
+	 * @param id Identifier (SnapshotPlaneId).
+	 * @return Pointer to the plane, NULL if not in the snapshot.
+	 */
+	const SnapshotPlane* getPlane(uint32_t id) const;
+
+	/*
+	 * Reads a snapshot file. A full snapshot replaces the content, a delta is applied if it is based on the current
+	 * content.
+	 * @param filename Filename of the file to read.
+	 * @return True if successful, the content is left unchanged otherwise.
+	 */
+	bool read(const std::string& filename);
+
+	/*
+	 * Retrieves the EM width.
+	 * @return Width.
+	 */
+	uint32_t getWidth() const { return width_; }
+
+	/*
+	 * Retrieves the EM height.
+	 * @return Height.
+	 */
+	uint32_t getHeight() const { return height_; }
+
+	/*
+	 * Retrieves the planes.
+	 * @return Planes.
+	 */
+	const std::vector<SnapshotPlane>& getPlanes() const { return planes_; }
+
+	/*
+	 * Retrieves the sequence number of the last file written or read.
+	 * @return Sequence number.
+	 */
+	uint32_t getSequence() const { return sequence_; }
+
+	/*
+	 * Retrieves the location of the EM origin.
+	 * @return Origin.
+	 */
+	const glm::vec3& getOrigin() const { return origin_; }
+
+	/*
+	 * Updates the location of the EM origin.
+	 * @param origin Origin.
+	 */
+	void setOrigin(const glm::vec3& origin) { origin_ = origin; }
+
+	/*
+	 * Retrieves the last color-correction matrix.
+	 * @return Correction matrix.
+	 */
+	const glm::mat3& getCorrectionMatrix() const { return corrMtx_; }
+
+	/*
+	 * Updates the last color-correction matrix.
+	 * @param corrMtx Correction matrix.
+	 */
+	void setCorrectionMatrix(const glm::mat3& corrMtx) { corrMtx_ = corrMtx; }
+
+	/*
+	 * Retrieves the index of the last frame projected.
+	 * @return Index of the frame.
+	 */
+	uint32_t getFrameIndex() const { return frameIdx_; }
+
+	/*
+	 * Updates the index of the last frame projected.
+	 * @param frameIdx Index of the frame.
+	 */
+	void setFrameIndex(uint32_t frameIdx) { frameIdx_ = frameIdx; }
+
+	/*
+	 * Retrieves the SH coefficients of the EM.
+	 * @return SH coefficients, empty if not stored.
+	 */
+	const std::vector<glm::vec4>& getSHCoefficients() const { return shCoeffs_; }
+
+	/*
+	 * Updates the SH coefficients of the EM.
+	 * @param coeffs Pointer to the coefficients.
+	 * @param nbrCoeffs Number of coefficients.
+	 */
+	void setSHCoefficients(const glm::vec4* coeffs, size_t nbrCoeffs) { shCoeffs_.assign(coeffs, coeffs + nbrCoeffs); }
+
+private:
+	/*
+	 * Parses the content of a snapshot file.
+	 * @param buffer Content of the file.
+	 * @param filename Filename of the file, for the error messages.
+	 * @param apply True to update the snapshot, false to only check the file.
+	 * @return True if the file is valid.
+	 */
+	bool parse(const std::vector<uint8_t>& buffer, const std::string& filename, bool apply);
+
+	uint32_t                   width_;     /*!< EM width. */
+	uint32_t                   height_;    /*!< EM height. */
+	uint32_t                   sequence_;  /*!< Sequence number of the last file written or read. */
+	glm::vec3                  origin_;    /*!< Location of the EM origin. */
+	glm::mat3                  corrMtx_;   /*!< Last color-correction matrix. */
+	uint32_t                   frameIdx_;  /*!< Index of the last frame projected (see CoverageMap). */
+	std::vector<glm::vec4>     shCoeffs_;  /*!< SH coefficients of the EM, empty if not stored. */
+	std::vector<SnapshotPlane> planes_;    /*!< Per-texel data. */
+};
+
+/*
+ * The SnapshotWriter class writes the snapshots of an EM, keeping a hash of every tile written so the following
+ * snapshots can be written as deltas. A full snapshot is written when there's no base or the planes changed.
+ */
+class SnapshotWriter {
+public:
+	/*
+	 * SnapshotWriter constructor.
+	 * @param tileSize Size in texels of the tiles.
+	 */
+	SnapshotWriter(uint32_t tileSize = 64);
+
+	/*
+	 * Writes a snapshot.
+	 * @param filename Filename of the file to write.
+	 * @param snapshot Snapshot to write.
+	 * @param delta True to only write the tiles changed since the last snapshot written or set as base.
+	 * @return True if successful.
+	 */
+	bool write(const std::string& filename, const EMSnapshot& snapshot, bool delta = true);
+
+	/*
+	 * Uses a snapshot, e.g. the one restored, as base of the next delta.
+	 * @param snapshot Base snapshot.
+	 */
+	void setBase(const EMSnapshot& snapshot);
+
+	/*
+	 * Forgets the base, the next snapshot is written in full with sequence number 0.
+	 */
+	void reset();
+
+	/*
+	 * Retrieves the sequence number of the last snapshot written or set as base.
+	 * @return Sequence number.
+	 */
+	uint32_t getSequence() const { return sequence_; }
+
+	/*
+	 * Checks if there's a base for the next delta.
+	 * @return True if a base is set.
+	 */
+	bool hasBase() const { return hasBase_; }
+
+	/*
+	 * Retrieves the counters of the last snapshot written.
+	 * @return Counters.
+	 */
+	const SnapshotStats& getLastStats() const { return stats_; }
+
+private:
+	/*
+	 * Calculates the hash of every tile of the planes of a snapshot.
+	 * @param snapshot Snapshot.
+	 * @param hashes Hash of every tile, per plane.
+	 */
+	void hashTiles(const EMSnapshot& snapshot, std::vector<std::vector<uint64_t>>& hashes) const;
+
+	/*
+	 * Checks if a snapshot has the planes and dimensions of the base.
+	 * @param snapshot Snapshot.
+	 * @return True if a delta can be written.
+	 */
+	bool matchesBase(const EMSnapshot& snapshot) const;
+
+	uint32_t                                   tileSize_; /*!< Size in texels of the tiles. */
+	bool                                       hasBase_;  /*!< True if a snapshot was written or set as base. */
+	uint32_t                                   sequence_; /*!< Sequence number of the base. */
+	uint32_t                                   width_;    /*!< EM width of the base. */
+	uint32_t                                   height_;   /*!< EM height of the base. */
+	std::vector<std::pair<uint32_t, uint32_t>> layout_;   /*!< Identifier and element size of every plane of the base. */
+	std::vector<std::vector<uint64_t>>         hashes_;   /*!< Hash of every tile of the base, per plane. */
+	SnapshotStats                              stats_;    /*!< Counters of the last snapshot written. */
+};
+
+} }
+
+#endif
@@ -1,6 +1,10 @@
 #ifndef VSENSE_EM_ENVIRONMENTMAP_H_
 #define VSENSE_EM_ENVIRONMENTMAP_H_
 
+#include <vsense/em/ColorMoments.h>
+#include <vsense/em/CoverageMap.h>
+#include <vsense/em/EMSnapshot.h>
+#include <vsense/em/UniformityMask.h>
 #include <vsense/sh/SphericalHarmonics.h>
 
 #include <glm/glm.hpp>
@@ -112,11 +116,23 @@ public:
 	 */
 	static void setColorCorrectionEnabled(bool enabled) { colorCorrection_ = enabled; }
 
+	/*
+	 * Updates the state of the uniformity check, the points whose EM neighborhood isn't uniform are discarded.
+	 * @param enabled True if the check is to be performed, the uniformity mask is only allocated when enabled.
+	 */
+	static void setUniformityCheckEnabled(bool enabled) { checkUniformity_ = enabled; }
+
+	/*
+	 * Updates the state of the coverage tracking, the last frame and observation count of every pixel stored.
+	 * @param enabled True if the coverage is to be updated with every pixel stored.
+	 */
+	static void setCoverageTrackingEnabled(bool enabled) { trackCoverage_ = enabled; }
+
 	/*
 	 * Retrieves the last valid correction matrix.
 	 * @return Color correction matrix.
 	 */
-	const glm::dmat3& getLastCorrectionMatrix() const { return lastCorrMtx_; }
+	const glm::mat3& getLastCorrectionMatrix() const { return lastCorrMtx_; }
 
   /*
    * Retrieves the depth range.
@@ -130,6 +146,12 @@ public:
 	 */
 	float getLastError() { return lastError_; }
 
+	/*
+	 * Retrieves the time spent calculating the color-correction matrix and its error for the last frame.
+	 * @return Time in milliseconds, 0 if no correction was calculated.
+	 */
+	float getLastCorrectionTime() const { return lastCorrectionTime_; }
+
 	/*
 	 * Retrieves the amount of used points.
 	 * @return Number of used points.
@@ -148,6 +170,44 @@ public:
 	 */
 	uint32_t getSamplesNumber() { return nbrSamples_; }
 
+	/*
+	 * Retrieves the number of EM pixels that received data for the first time in the last frame.
+	 * @return Number of new pixels.
+	 */
+	uint32_t getLastNewPixels() { return lastNbrNewPixels_; }
+
+	/*
+	 * Calculates the fraction of the EM that contains data.
+	 * @return Coverage (0.f-1.f).
+	 */
+	float getCoverage() const;
+
+	/*
+	 * Retrieves the last frame and observation count of every pixel, with the coverage statistics per tile.
+	 * @return Coverage map.
+	 */
+	const CoverageMap& getCoverageMap() const { return coverage_; }
+
+	/*
+	 * Retrieves the index of the last frame projected to the EM, used to calculate the age of the pixels.
+	 * @return Index of the frame, 0 if none was projected.
+	 */
+	uint32_t getFrameIndex() const { return frameIdx_; }
+
+	/*
+	 * Stores the state of the EM in a snapshot: color, depth, flags and coverage planes, origin, correction matrix and
+	 * index of the last frame.
+	 * @param snapshot Snapshot.
+	 */
+	void toSnapshot(EMSnapshot& snapshot) const;
+
+	/*
+	 * Restores the state of the EM from a snapshot.
+	 * @param snapshot Snapshot created by toSnapshot with the dimensions of the EM.
+	 * @return True if successful.
+	 */
+	bool fromSnapshot(const EMSnapshot& snapshot);
+
 	/*
 	 * Warps the content of an EM to a new position.
 	 * @param srcEM Object holding the source EM.
@@ -189,6 +249,18 @@ public:
 	 */
 	bool isEmpty() const { return isEmpty_; }
 
+	/*
+	 * Retrieves the width of the EM.
+	 * @return EM's width.
+	 */
+	static size_t getWidth() { return width_; }
+
+	/*
+	 * Retrieves the height of the EM.
+	 * @return EM's height.
+	 */
+	static size_t getHeight() { return height_; }
+
 #ifdef _WINDOWS
     /*
 	 * Retrieves the amount of seconds required to calculate the color correction matrix.
@@ -228,18 +300,6 @@ public:
 	 */
 	static void setEMSize(size_t width, size_t height);
 
-	/*
-	 * Retrieves the width of the EM.
-	 * @return EM's width.
-	 */
-	static size_t getWidth() { return width_; }
-
-	/*
-	 * Retrieves the height of the EM.
-	 * @return EM's height.
-	 */
-	static size_t getHeight() { return height_; }
-
 	/*
 	 * Saves the EM externally.
 	 */
@@ -260,12 +320,23 @@ private:
 	void renderToImage();
 
 	/*
-	 * Checks if the neighborhood around the given sample is uniform.
+	 * Checks if the neighborhood around the given sample is uniform, the result is cached per tile of the EM.
 	 * @param sample Sample to check.
 	 * @return True if uniform.
 	 */
 	bool isEMNeighborhoodUniform(const EMSample& sample);
 
+	/*
+	 * Resets the uniformity mask after the maps are reallocated or fully overwritten, or releases it if the check is
+	 * disabled.
+	 */
+	void resetUniformityMask();
+
+	/*
+	 * Clears the observations of every pixel after the maps are reallocated or fully overwritten.
+	 */
+	void resetCoverage();
+
 	/*
 	 * Calculates the color-correction matrix.
 	 * @return True if successful.
@@ -279,18 +350,12 @@ private:
 	void projectPoints(float distToDev);
 
 	/*
-	 * Calculates the mean square error when applying the color-correcting matrix.
+	 * Calculates the mean square error when applying the color-correcting matrix, it is derived from the moments
+	 * accumulated while calculating the matrix.
 	 * @return Estimated mean square error.
 	 */
 	float calculateError();
 
-	/*
-	 * Calculates the square error when applying a color-correction matrix to a leaf.
-	 * @param sample Sample object containing the current point and reference value.	
-	 * @return Mean square error.
-	 */
-	float getSquaredError(const EMSample& sample);
-
 	glm::vec3 origin_; /*!< Position for the environment map's origin. */
 
 	bool isEmpty_; /*!< True if environment map is empty. */
@@ -301,13 +366,22 @@ private:
 
 	std::shared_ptr<io::Image>     img_;        /*!< Internal representation used as a Texture (sRGB). */
 
+	UniformityMask                 uniformMask_; /*!< Cached uniformity of the neighborhood of every pixel. */
+
+	CoverageMap                    coverage_;    /*!< Last frame and observation count of every pixel. */
+	uint32_t                       frameIdx_;    /*!< Index of the last frame projected. */
+
 	glm::vec2                      depthRange_;  /*!< Range of depth values contained in the EM. */
 
 	glm::mat3                     lastCorrMtx_;     /*!< Last valid color correction matrix. */
 	float                          lastError_;       /*!< Last mean squared error. */
 	uint32_t                       lastNbrUsedPts_;  /*!< Number of points used to calculate the correction matrix. */
+	ColorMoments                   lastMoments_;     /*!< Moments of the samples used to calculate the correction matrix. */
 	std::shared_ptr<EMSample>      lastSamples_;     /*!< Last set of samples used to calculate the correction matrix. */
 	uint32_t                       nbrSamples_;      /*!< Number of valid samples in the latSamples array. */
+	size_t                         samplesCapacity_; /*!< Number of samples allocated in the lastSamples array. */
+	uint32_t                       lastNbrNewPixels_; /*!< Number of EM pixels filled for the first time in the last frame. */
+	float                          lastCorrectionTime_; /*!< Time in milliseconds spent calculating the last correction matrix. */
 
 #ifdef _WINDOWS
 	float                          lastElapsedTime_; /*!< Amount of time in seconds used to calculate the correction matrix. */
@@ -320,6 +394,8 @@ private:
 	static int minNbrPoints_;        /*!< Minimum number of required paired points to calculate a correction matrix. */
 	static bool colorCorrection_;    /*!< True if color correction is to be enabled. */
 	static float maxAllowedWarpDif_; /*!< Maximum allowed difference in displacements when performing a warp. */
+	static bool checkUniformity_;    /*!< True if the points whose EM neighborhood isn't uniform are discarded. */
+	static bool trackCoverage_;      /*!< True if the coverage is updated with every pixel stored. */
 };
 
 } }
@@ -0,0 +1,232 @@
+#ifndef VSENSE_EM_INTEGRATIONCONTROLLER_H_
+#define VSENSE_EM_INTEGRATIONCONTROLLER_H_
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace vsense { namespace em {
+
+/*
+ * Ways a frame is added to the EM.
+ */
+enum IntegrationDecision {
+	IntegrationSkip = 0, /*!< The frame isn't added. */
+	IntegrationReduced,  /*!< The frame is projected to the EM but the SH coefficients aren't calculated again. */
+	IntegrationFull      /*!< The frame is projected to the EM and the SH coefficients are calculated. */
+};
+
+/*
+ * Parameters of the integration controller.
+ */
+struct IntegrationParams {
+	IntegrationParams() : budgetMS(15.f), burstFrames(3.f), fullCostMS(30.f), reducedCostMS(12.f), costSmoothing(0.2f), translationScale(0.25f),
+		rotationScale(0.5f), staleTime(10.f), poseWeight(1.f), emptyWeight(2.f), staleWeight(1.f), fullThreshold(0.3f), reducedThreshold(0.1f),
+		nominalDepth(2.f), gridWidth(64), gridHeight(32), raysX(16), raysY(12) {}
+
+	float budgetMS;         /*!< Average time per frame allowed for the integration (ms). */
+	float burstFrames;      /*!< Number of frame budgets that can be saved to integrate several frames in a row. */
+	float fullCostMS;       /*!< Initial estimate of the time of a full integration (ms). */
+	float reducedCostMS;    /*!< Initial estimate of the time of a reduced integration (ms). */
+	float costSmoothing;    /*!< Smoothing factor of the measured times. */
+	float translationScale; /*!< Translation from the last integrated frame giving a pose novelty of 1 (m). */
+	float rotationScale;    /*!< Rotation from the last integrated frame giving a pose novelty of 1 (rad). */
+	float staleTime;        /*!< Time since an EM region was refreshed giving a staleness of 1 (s). */
+	float poseWeight;       /*!< Weight of the pose novelty. */
+	float emptyWeight;      /*!< Weight of the empty fraction of the footprint. */
+	float staleWeight;      /*!< Weight of the staleness of the footprint. */
+	float fullThreshold;    /*!< Novelty from which a frame is fully integrated. */
+	float reducedThreshold; /*!< Novelty from which a frame is integrated without calculating the SH coefficients. */
+	float nominalDepth;     /*!< Depth assumed for the footprint, the depth of the frame isn't known before integrating it (m). */
+	int   gridWidth;        /*!< Width of the coverage grid (equirectangular). */
+	int   gridHeight;       /*!< Height of the coverage grid. */
+	int   raysX;            /*!< Horizontal number of rays sampling the footprint. */
+	int   raysY;            /*!< Vertical number of rays sampling the footprint. */
+};
+
+/*
+ * Expected novelty of a frame, every term in [0, 1].
+ */
+struct FrameNovelty {
+	FrameNovelty() : poseDelta(0.f), emptyFraction(0.f), staleness(0.f), novelty(0.f) {}
+
+	float poseDelta;     /*!< Motion from the last integrated frame. */
+	float emptyFraction; /*!< Fraction of the footprint never covered. */
+	float staleness;     /*!< Average time since the footprint was refreshed. */
+	float novelty;       /*!< Weighted average of the terms. */
+};
+
+/*
+ * Counters of the integration controller.
+ */
+struct IntegrationStats {
+	IntegrationStats() : nbrFrames(0), nbrFull(0), nbrReduced(0), nbrSkipped(0), spentMS(0.0) {}
+
+	size_t nbrFrames;  /*!< Number of frames received. */
+	size_t nbrFull;    /*!< Number of frames fully integrated. */
+	size_t nbrReduced; /*!< Number of frames integrated without calculating the SH coefficients. */
+	size_t nbrSkipped; /*!< Number of frames skipped. */
+	double spentMS;    /*!< Time spent integrating, measured when reported and estimated otherwise (ms). */
+};
+
+/*
+ * Coverage of the EM after a frame.
+ */
+struct CoverageSample {
+	double              timestamp; /*!< Time of the frame (s). */
+	IntegrationDecision decision;  /*!< Decision taken for the frame. */
+	float               novelty;   /*!< Expected novelty of the frame. */
+	float               coverage;  /*!< Fraction of the EM covered. */
+	double              spentMS;   /*!< Time spent integrating so far (ms). */
+};
+
+/*
+ * Pose of a recorded frame.
+ */
+struct RecordedPose {
+	double    timestamp; /*!< Time of the frame (s). */
+	glm::mat4 pose;      /*!< Transformation from the depth camera to the world. */
+};
+
+/*
+ * The IntegrationController class decides how every frame is added to the EM before it goes through the GPU. The
+ * footprint of a frame is estimated by casting a grid of rays from the depth camera (x right, y down, z forward) to a
+ * nominal depth and mapping them to a coarse equirectangular grid around the EM origin. The novelty of the frame
+ * weights the motion since the last integrated frame, the fraction of its footprint never covered and the time since
+ * its footprint was refreshed. A frame is integrated fully, without calculating the SH coefficients or not at all
+ * depending on its novelty and on the time left in a budget refilled every frame. The controller doesn't use the GPU,
+ * so recorded pose streams can be replayed to compare the EM coverage with the time spent.
+ */
+class IntegrationController {
+public:
+	/*
+	 * IntegrationController constructor.
+	 * @param params Parameters.
+	 */
+	IntegrationController(const IntegrationParams& params = IntegrationParams());
+
+	/*
+	 * Updates the intrinsics of the depth camera.
+	 * @param f Focal length in pixels.
+	 * @param c Optical center in pixels.
+	 * @param size Size of the depth map.
+	 */
+	void setCamera(const glm::vec2& f, const glm::vec2& c, const glm::uvec2& size);
+
+	/*
+	 * Updates the EM origin, the coverage is cleared if it moved.
+	 * @param origin Location of the EM origin.
+	 */
+	void setOrigin(const glm::vec3& origin);
+
+	/*
+	 * Estimates the novelty of a frame.
+	 * @param pose Transformation from the depth camera to the world.
+	 * @param timestamp Time of the frame (s).
+	 * @return Novelty.
+	 */
+	FrameNovelty estimate(const glm::mat4& pose, double timestamp) const;
+
+	/*
+	 * Decides how a frame is integrated, updating the coverage and the budget as if the decision was carried out.
+	 * @param pose Transformation from the depth camera to the world.
+	 * @param timestamp Time of the frame (s).
+	 * @return Decision.
+	 */
+	IntegrationDecision update(const glm::mat4& pose, double timestamp);
+
+	/*
+	 * Reports the measured time of the last integration, refining the estimated cost of its decision.
+	 * @param decision Decision carried out.
+	 * @param ms Time spent (ms).
+	 */
+	void reportCost(IntegrationDecision decision, float ms);
+
+	/*
+	 * Replays a recorded pose stream.
+	 * @param poses Pose of every frame.
+	 * @return Counters after the last frame.
+	 */
+	const IntegrationStats& replay(const std::vector<RecordedPose>& poses);
+
+	/*
+	 * Restarts the controller, clearing the coverage, counters and report.
+	 */
+	void reset();
+
+	/*
+	 * Retrieves the fraction of the EM covered.
+	 * @return Fraction of the cells of the coverage grid.
+	 */
+	float getCoverage() const;
+
+	/*
+	 * Retrieves the novelty of the last frame.
+	 * @return Novelty.
+	 */
+	const FrameNovelty& getLastNovelty() const { return lastNovelty_; }
+
+	/*
+	 * Retrieves the counters.
+	 * @return Counters.
+	 */
+	const IntegrationStats& getStats() const { return stats_; }
+
+	/*
+	 * Retrieves the coverage after every frame.
+	 * @return Coverage samples.
+	 */
+	const std::vector<CoverageSample>& getReport() const { return report_; }
+
+	/*
+	 * Retrieves the estimated cost of a decision.
+	 * @param decision Decision.
+	 * @return Estimated time (ms).
+	 */
+	float getCost(IntegrationDecision decision) const;
+
+	/*
+	 * Reads the poses of a session recorded by the app (PointCloud<i>.pc files) and the depth camera intrinsics.
+	 * @param folder Folder of the session, ending with a separator.
+	 * @param poses Pose of every frame.
+	 * @param f Focal length in pixels.
+	 * @param c Optical center in pixels.
+	 * @param size Size of the depth map.
+	 * @return True if at least one frame was read.
+	 */
+	static bool readRecordedPoses(const std::string& folder, std::vector<RecordedPose>& poses, glm::vec2& f, glm::vec2& c, glm::uvec2& size);
+
+private:
+	/*
+	 * Calculates the cells of the coverage grid seen by a frame.
+	 * @param pose Transformation from the depth camera to the world.
+	 * @param cells Indices of the cells, without repetitions.
+	 */
+	void footprint(const glm::mat4& pose, std::vector<int>& cells) const;
+
+	IntegrationParams           params_;       /*!< Parameters. */
+	glm::vec2                   f_;            /*!< Focal length of the depth camera in pixels. */
+	glm::vec2                   c_;            /*!< Optical center of the depth camera in pixels. */
+	glm::uvec2                  size_;         /*!< Size of the depth map. */
+	glm::vec3                   origin_;       /*!< Location of the EM origin. */
+	std::vector<double>         refreshed_;    /*!< Time every cell was last refreshed, negative if never covered. */
+	size_t                      nbrCovered_;   /*!< Number of cells covered. */
+	glm::mat4                   lastPose_;     /*!< Pose of the last integrated frame. */
+	bool                        hasPose_;      /*!< True once a frame was integrated. */
+	float                       credit_;       /*!< Time left in the budget (ms). */
+	float                       fullCost_;     /*!< Estimated time of a full integration (ms). */
+	float                       reducedCost_;  /*!< Estimated time of a reduced integration (ms). */
+	float                       charged_;      /*!< Time charged for the last integration (ms). */
+	FrameNovelty                lastNovelty_;  /*!< Novelty of the last frame. */
+	IntegrationStats            stats_;        /*!< Counters. */
+	std::vector<CoverageSample> report_;       /*!< Coverage after every frame. */
+	mutable std::vector<int>    cells_;        /*!< Cells of the footprint being evaluated. */
+	mutable std::vector<int>    cellStamps_;   /*!< Last footprint every cell was added to, removes the repetitions. */
+	mutable int                 stamp_;        /*!< Current footprint. */
+};
+
+} }
+
+#endif
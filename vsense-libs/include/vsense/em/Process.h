@@ -3,8 +3,15 @@
 
 #include <vsense/io/ImageReader.h>
 #include <vsense/io/PointCloudReader.h>
+#include <vsense/gl/ComputeScheduler.h>
+#include <vsense/em/CoverageMap.h>
+#include <vsense/em/EMSnapshot.h>
+#include <vsense/em/SortedScatter.h>
+#include <vsense/sh/BandLimit.h>
 
 #include <memory>
+#include <string>
+#include <vector>
 #include <glm/glm.hpp>
 
 #include <time.h>
@@ -36,6 +43,9 @@ struct AAssetManager;
 namespace vsense { 
 
 namespace gl {
+	class GLComputeCommands;
+	class PixelPackReadback;
+	class ReadbackRing;
 	class Texture;
 }
 
@@ -63,9 +73,13 @@ struct TimeStats {
 	 * TimeStats constructor.
 	 */
 	TimeStats() {
-		for (int i = 0; i <= EMTranslate; i++)
+		for (int i = 0; i <= EMTranslate; i++) {
 			timeMS[i] = 0.0;
+			nbrDispatches[i] = 0;
+		}
 
+		nbrStages = 0;
+		nbrBarriers = 0;
 		nbrFrames = 0;
 	}
 
@@ -81,7 +95,20 @@ struct TimeStats {
 		for (int i = 0; i <= EMTranslate; i++) {
 			timeMS[i] += ts[i];
 			timeMS[i] /= nbrFrames;
+
+			nbrDispatches[i] += ts.nbrDispatches[i];
 		}
+
+		nbrStages += ts.nbrStages;
+		nbrBarriers += ts.nbrBarriers;
+	}
+
+	/*
+	 * Counts a compute dispatch of a specific operation.
+	 * @param idx Index of the operation.
+	 */
+	void addDispatch(int idx) {
+		nbrDispatches[idx]++;
 	}
 
 #ifdef _WINDOWS
@@ -107,18 +134,23 @@ struct TimeStats {
 	 */
 	void printStats();
 #elif __ANDROID__
+	/*
+	 * Starts a specific timer, measuring the wall time so the waits for the GPU are included.
+	 * @param idx Index of the timer to start.
+	 */
 	void start(int idx) {
-		clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &t[idx]);
-}
+		clock_gettime(CLOCK_MONOTONIC, &t[idx]);
+	}
 
+	/*
+	 * Stops a specific timer.
+	 * @param idx Index of the timer to stop.
+	 */
 	void stop(int idx) {
 		timespec tF;
-		clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &tF);
+		clock_gettime(CLOCK_MONOTONIC, &tF);
 
-		if(tF.tv_nsec > t[idx].tv_nsec)		
-			timeMS[idx] = (double)(tF.tv_nsec - t[idx].tv_nsec) / 1000000.0;
-		else
-			timeMS[idx] = (double)(1000000000 + tF.tv_nsec - t[idx].tv_nsec) / 1000000.0;
+		timeMS[idx] = (double)(tF.tv_sec - t[idx].tv_sec)*1000.0 + (double)(tF.tv_nsec - t[idx].tv_nsec) / 1000000.0;
 	}
 
 	void printStats(std::ofstream& file);
@@ -138,8 +170,11 @@ struct TimeStats {
 #elif __ANDROID__
 	timespec t[EMTranslate + 1];       /*!< Timers used to measure the performance. */
 #endif
-	double   timeMS[EMTranslate + 1];  /*!< Current time per operation. */
-	uint32_t nbrFrames;                /*!< Number of frames used to calculate the average. */
+	double   timeMS[EMTranslate + 1];        /*!< Current time per operation. */
+	uint32_t nbrDispatches[EMTranslate + 1]; /*!< Compute dispatches per operation (total when accumulating frames). */
+	uint32_t nbrStages;                      /*!< Scheduled stages, each followed by a barrier when run in a fixed order. */
+	uint32_t nbrBarriers;                    /*!< Memory barriers issued by the scheduler. */
+	uint32_t nbrFrames;                      /*!< Number of frames used to calculate the average. */
 };
 
 
@@ -190,6 +225,39 @@ public:
 			return textureEnvironmentMap1_;
 	}
 
+	/*
+	 * Retrieves the texture holding the last frame and observation count of every EM texel (see CoverageMap).
+	 * @return Pointer to the texture.
+	 */
+	std::shared_ptr<gl::Texture> getCoverageTexture() { return textureCoverage_; }
+
+	/*
+	 * Reads the coverage of the EM back from the GPU, waiting for it. Meant for telemetry, not for every frame.
+	 * @param coverage Coverage map, resized to the EM.
+	 */
+	void readCoverage(CoverageMap& coverage);
+
+	/*
+	 * Stores the state of the EM in a snapshot, waiting for the GPU: current EM and coverage, origin, correction
+	 * matrix, index of the last frame and SH coefficients.
+	 * @param snapshot Snapshot.
+	 */
+	void toSnapshot(EMSnapshot& snapshot);
+
+	/*
+	 * Restores the state of the EM from a snapshot created by toSnapshot, so a session resumes without integrating
+	 * its frames again.
+	 * @param snapshot Snapshot.
+	 * @return True if successful.
+	 */
+	bool fromSnapshot(const EMSnapshot& snapshot);
+
+	/*
+	 * Retrieves the index of the last frame projected in the coverage of the EM.
+	 * @return Index of the frame (1 to CoverageMaxFrame), 0 if none.
+	 */
+	uint32_t getCoverageFrame() const { return coverageFrame_; }
+
 	/*
 	 * Retrieves the texture holding the SH coefficients.
 	 * @return Pointer to the texture.
@@ -221,11 +289,39 @@ public:
 	float getLastCorrectionMatrixError() { return lastCorrError_; }
 
 	/*
-	 * Retrieves the last SH coefficients related to the environment.
+	 * Retrieves the number of frames between the samples used to estimate the last correction matrix and the frame it
+	 * was applied to, always 0 with a synchronous readback.
+	 * @return Age in frames.
+	 */
+	uint64_t getLastCorrectionMatrixAge() { return lastCorrAge_; }
+
+	/*
+	 * Retrieves the index of the current frame, incremented every time the EM shaders run.
+	 * @return Index of the frame.
+	 */
+	uint64_t getFrameIndex() const { return frameIdx_; }
+
+	/*
+	 * Retrieves the last SH coefficients related to the environment, waiting for the GPU.
 	 * @return SH Coefficients.
 	 */
 	std::shared_ptr<glm::vec4> getSHCoefficients();
 
+	/*
+	 * Retrieves the newest SH coefficients read back without stalling the GPU. Blocks only if none was read back yet.
+	 * @param age Number of frames since the coefficients were calculated.
+	 * @return SH Coefficients.
+	 */
+	std::shared_ptr<glm::vec4> getSHCoefficients(uint64_t& age);
+
+	/*
+	 * Updates the number of readback buffers of the GPU results, a result is retrieved at the latest after the number
+	 * of buffers minus one frames. A single buffer makes the readback synchronous.
+	 * @param corrSlots Number of buffers for the color correction data.
+	 * @param shSlots Number of buffers for the SH coefficients.
+	 */
+	void setReadbackSlots(size_t corrSlots, size_t shSlots);
+
 	/*
 	 * Clears all the content in the textures.
 	 */
@@ -273,10 +369,16 @@ public:
 	bool needsTranslateEM() { return needsTranslateEM_; }
 
 	/*
-	 * Updates the maximum order to be used when calculating the SH coefificients.
-	 * @param maxOrder Maximum order.
+	 * Updates the maximum order to be used when calculating the SH coefificients, only the bands up to it are projected.
+	 * @param maxOrder Maximum order, clamped between sh::MinSHOrder and sh::MaxSHOrder.
+	 */
+	void setMaxSHOrder(int maxOrder) { maxOrder_ = sh::BandLimit::clampOrder(maxOrder); }
+
+	/*
+	 * Retrieves the maximum order used when calculating the SH coefficients.
+	 * @return Maximum order.
 	 */
-	void setMaxSHOrder(int maxOrder) { maxOrder_ = maxOrder; }
+	int getMaxSHOrder() const { return maxOrder_; }
 
 	/*
 	 * Toggles the use of color correction.
@@ -284,6 +386,34 @@ public:
 	 */
 	void updateDoColorCorrection(bool doCC) { doColorCorrection_ = doCC; }
 
+	/*
+	 * Updates the size of the neighborhood used to mark the reliable points in the depth map.
+	 * @param size Window size, only 3 (3x3) and 5 (5x5) are supported.
+	 * @return True if the size is supported.
+	 */
+	bool setReliabilityWindow(int size);
+
+	/*
+	 * Toggles the fused depth preprocessing, where the reliable points are marked and the holes filled in a single
+	 * dispatch (counted as DepthMapHoleFilling). The separate dispatches are used otherwise.
+	 * @param fused True if the fused kernel is to be used.
+	 */
+	void setFusedDepthPreprocessing(bool fused) { fusedDepthPreprocessing_ = fused; }
+
+	/*
+	 * Updates how the samples projected to the same EM texel are resolved. ScatterUnordered stores every sample in a
+	 * single dispatch, and the texel keeps whichever store lands last. The other modes sort the samples by texel and
+	 * store every texel once, so the EM doesn't depend on the scheduling of the GPU (counted as EMProjection).
+	 * @param mode Resolution of the samples.
+	 */
+	void setScatterMode(ScatterMode mode) { scatterMode_ = mode; }
+
+	/*
+	 * Retrieves the timing statistics of the last frame, including the number of compute dispatches per operation.
+	 * @return Timing statistics.
+	 */
+	const TimeStats& getTimeStats() const { return curTimeStats_; }
+
 #ifdef _WINDOWS
 	/*
 	 * Saves the EM.
@@ -307,6 +437,22 @@ private:
 	 */
 	void runEMShaders(float confidence, bool project, bool calculateSH);
 
+	/*
+	 * Queues the deterministic projection of the samples to the EM: keys, radix sort passes and resolution.
+	 * @param withinTrustedSphere True if the device is close to the EM origin.
+	 * @param coverageFrame Index of the frame in the coverage of the EM.
+	 */
+	void projectSorted(bool withinTrustedSphere, uint32_t coverageFrame);
+
+	/*
+	 * Dispatches one step of a radix sort pass.
+	 * @param elementsIn Elements sorted up to the previous pass.
+	 * @param elementsOut Elements sorted up to the current pass.
+	 * @param shift First bit of the digit sorted by the pass.
+	 * @param scatter False to count the digits, true to move the elements.
+	 */
+	void dispatchRadixSort(std::shared_ptr<gl::Texture> elementsIn, std::shared_ptr<gl::Texture> elementsOut, GLuint shift, bool scatter);
+
 	/*
 	 * Reads the binary file holding the mapping including the lens distortions.
 	 */
@@ -318,6 +464,37 @@ private:
 	 */
 	glm::mat3 calculateCorrectionMatrix();
 
+	/*
+	 * Reads the source of a shader.
+	 * @param filename Path to the shader in the resources (Windows) or the assets (Android).
+	 * @return Source of the shader, empty if not found.
+	 */
+	std::string readShaderSource(const std::string& filename);
+
+	/*
+	 * Assembles the source of a compute shader using the reduction library.
+	 * @param filename Filename of the compute shader within the shader folder.
+	 * @param localSize Work-group size, the number of invocations must be a power of two.
+	 * @param types GLSL types with a reduction instantiated.
+	 * @param source Assembled source.
+	 * @return True if successful.
+	 */
+	bool assembleReductionShader(const std::string& filename, const glm::ivec2& localSize, const std::vector<std::string>& types, std::string& source);
+
+	/*
+	 * Creates a compute shader program using the reduction library.
+	 * @param filename Filename of the compute shader within the shader folder.
+	 * @param localSize Work-group size, the number of invocations must be a power of two.
+	 * @param types GLSL types with a reduction instantiated.
+	 * @return Shader program.
+	 */
+	SHADER_OBJECT createReductionShaderProgram(const std::string& filename, const glm::ivec2& localSize, const std::vector<std::string>& types);
+
+	/*
+	 * Resets the atomic counter used by the reductions to find their last work group, and binds it.
+	 */
+	void resetReductionCounter();
+
 #ifdef _WINDOWS
 	/*
 	 * Reads a binary file holding an RGB image.
@@ -369,6 +546,8 @@ private:
 
 	// Mar reliable
 	SHADER_OBJECT shaderProgram3_;
+	GLuint radiusLocation_;
+	GLuint limitChiSquareLocation_;
 
 	// Fill holes		
 	SHADER_OBJECT shaderProgram4_;
@@ -379,6 +558,16 @@ private:
 	GLuint coeff_imLocation4_;
 	GLuint fillWithMaxLocation_;
 
+	// Fused mark reliable and fill holes
+	SHADER_OBJECT shaderProgram12_;
+	GLuint f_imLocation12_;
+	GLuint c_imLocation12_;
+	GLuint pose_imLocation12_;
+	GLuint coeff_imLocation12_;
+	GLuint fillWithMaxLocation12_;
+	GLuint radiusLocation12_;
+	GLuint limitChiSquareLocation12_;
+
 	// Environment map samples	
 	SHADER_OBJECT shaderProgram5_;
 	std::shared_ptr<gl::Texture> textureEnvironmentMap1_;
@@ -407,20 +596,37 @@ private:
 	std::shared_ptr<glm::vec4> samplesCur_;
 	glm::mat3 corrMtx_;
 	glm::mat3 invCorrMtx_;
-	GLuint numWGLocation6_;
-
-	// Environment map error estimation	
-	SHADER_OBJECT shaderProgram7_;
-	std::shared_ptr<gl::Texture> textureErrorAcc_;
-	std::shared_ptr<gl::Texture> textureCountAcc_;
-	std::shared_ptr<gl::Texture> textureFinalError_;
-	GLuint corrMtxLocation7_;
-	GLuint numWGLocation7_;
 
 	// Environment map project	
 	SHADER_OBJECT shaderProgram8_;
 	GLuint corrMtxLocation8_;
 	GLuint withinTrustedSphereLocation_;
+	GLuint frameIdxLocation8_;
+
+	// Environment map coverage
+	std::shared_ptr<gl::Texture> textureCoverage_;
+	std::shared_ptr<gl::Texture> textureCoverageWarped_; /*!< Coverage relocated by translateEM, swapped in when the EM is overwritten. */
+	uint32_t coverageFrame_;
+
+	// Environment map project (sorted scatter)
+	SHADER_OBJECT shaderProgram13_;
+	SHADER_OBJECT shaderProgram14_;
+	SHADER_OBJECT shaderProgram15_;
+	SHADER_OBJECT shaderProgram16_;
+	std::shared_ptr<gl::Texture> textureSortElements1_;
+	std::shared_ptr<gl::Texture> textureSortElements2_;
+	std::shared_ptr<gl::Texture> textureDigitOffsets_;
+	std::shared_ptr<gl::Texture> textureProjected_;
+	GLuint corrMtxLocation13_;
+	GLuint withinTrustedSphereLocation13_;
+	GLuint envMapSizeLocation13_;
+	GLuint nbrElementsLocation14_;
+	GLuint shiftLocation14_;
+	GLuint scatterLocation14_;
+	GLuint nbrGroupsLocation15_;
+	GLuint nbrElementsLocation16_;
+	GLuint modeLocation16_;
+	GLuint frameIdxLocation16_;
 
 	// Spherical Harmonics coefficients
 	SHADER_OBJECT shaderProgram9_;
@@ -433,7 +639,6 @@ private:
 	std::shared_ptr<gl::Texture> textureCoeffFinal1_;
 	std::shared_ptr<gl::Texture> textureCoeffFinal2_;
 	std::shared_ptr<gl::Texture> textureCoeffFinalCur_;
-	GLuint numWGLocation9_;	
 	GLuint maxOrderLocation_;
 
 	// Environmentmap relocation
@@ -459,12 +664,35 @@ private:
 
 	int maxOrder_;            /*!< Maximum order used in the SH computation. */
 
+	int reliabilityWindow_;   /*!< Size of the neighborhood used to mark reliable points. */
+
+	bool fusedDepthPreprocessing_; /*!< True if the reliable points are marked and the holes filled in a single pass. */
+
+	ScatterMode scatterMode_;      /*!< Resolution of the samples projected to the same EM texel. */
+
 	bool needsTranslateEM_;   /*!< True if the EM needs to be translated. */
 	bool curProject_;         /*!< True if the points are to be projected. */
 
 	std::ofstream statsFile_; /*!< File stream used to output the timing statistics. */
 
 	glm::dmat3 tmpInvCorrMtx_; /*!< Inverse of the correction matrix. */
+
+	GLuint reductionCounter_;  /*!< Atomic counter buffer used by the reductions. */
+
+	uint64_t frameIdx_;        /*!< Index of the current frame. */
+
+	gl::ComputeScheduler                   scheduler_;       /*!< Scheduler of the compute stages. */
+	std::shared_ptr<gl::GLComputeCommands> computeCommands_; /*!< Receiver of the scheduled commands. */
+
+	std::shared_ptr<gl::PixelPackReadback> corrReadback_; /*!< Readback buffers of the color correction data. */
+	std::shared_ptr<gl::ReadbackRing>      corrRing_;     /*!< Readback ring of the color correction data. */
+	uint64_t                               lastCorrAge_;  /*!< Age of the last color correction data. */
+
+	std::shared_ptr<gl::PixelPackReadback> shReadback_;    /*!< Readback buffers of the SH coefficients. */
+	std::shared_ptr<gl::ReadbackRing>      shRing_;        /*!< Readback ring of the SH coefficients. */
+	std::shared_ptr<glm::vec4>             shCoeffs_;      /*!< Newest SH coefficients read back. */
+	uint64_t                               shCoeffsFrame_; /*!< Frame of the newest SH coefficients read back. */
+	bool                                   hasSHCoeffs_;   /*!< True if SH coefficients were read back. */
 };
 
 } }
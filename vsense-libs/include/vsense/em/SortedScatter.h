@@ -0,0 +1,131 @@
+#ifndef VSENSE_EM_SORTEDSCATTER_H_
+#define VSENSE_EM_SORTEDSCATTER_H_
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace vsense { namespace em {
+
+/*
+ * Ways the samples projected to the same EM texel are resolved.
+ */
+enum ScatterMode {
+	ScatterUnordered = 0, /*!< Every sample is stored to its texel, the last store wins (unsynchronized on the GPU). */
+	ScatterNearest,       /*!< The texel keeps its nearest sample, the first one in sample order on ties. */
+	ScatterAverage        /*!< The texel keeps the average of its reliable samples, or of all of them if none is reliable. */
+};
+
+/*
+ * The SortedScatter class is the CPU implementation of the deterministic projection of the samples to the EM. The
+ * texel of every sample is used as its key (environmentMapProjectKeys.comp), the samples are sorted by key with a
+ * stable least-significant-digit radix sort of 4-bit digits (radixSort.comp and radixSortScan.comp), and every texel
+ * is then resolved once from the run of samples sharing its key (environmentMapResolve.comp). The work groups of the
+ * sort are emulated, so the passes move the samples exactly as the shaders do.
+ */
+class SortedScatter {
+public:
+	/*
+	 * SortedScatter constructor.
+	 * @param groupSize Number of invocations per work group of the sort, at most 255.
+	 */
+	SortedScatter(size_t groupSize = 64);
+
+	/*
+	 * Checks if a sample updates the EM and calculates its new value, as done by environmentMapProject.comp.
+	 * @param sampleRef Reference sample (RGB-D).
+	 * @param sampleCur Current sample (RGB-D, reliability as depth's sign).
+	 * @param sampleData Sample data (emPosX, emPosY, devDist, cosPlane).
+	 * @param corrMtx Color correction matrix.
+	 * @param withinTrustedSphere True if the device is close to the EM origin.
+	 * @param newData New value of the texel (RGB-D, reliability as depth's sign).
+	 * @return True if the sample updates the EM.
+	 */
+	static bool projectSample(const glm::vec4& sampleRef, const glm::vec4& sampleCur, const glm::vec4& sampleData, const glm::mat3& corrMtx,
+		bool withinTrustedSphere, glm::vec4& newData);
+
+	/*
+	 * Calculates the key and new value of every sample, as done by environmentMapProjectKeys.comp.
+	 * @param samplesRef Reference samples.
+	 * @param samplesCur Current samples.
+	 * @param samplesData Sample data.
+	 * @param nbrSamples Number of samples.
+	 * @param emWidth Width of the EM.
+	 * @param emHeight Height of the EM.
+	 * @param corrMtx Color correction matrix.
+	 * @param withinTrustedSphere True if the device is close to the EM origin.
+	 * @param keys Texel of every sample, emWidth*emHeight if the sample doesn't update the EM.
+	 * @param values New value of every sample updating the EM.
+	 */
+	static void computeKeys(const glm::vec4* samplesRef, const glm::vec4* samplesCur, const glm::vec4* samplesData, size_t nbrSamples, int emWidth,
+		int emHeight, const glm::mat3& corrMtx, bool withinTrustedSphere, std::vector<uint32_t>& keys, std::vector<glm::vec4>& values);
+
+	/*
+	 * Retrieves the number of radix passes needed to sort the keys of an EM.
+	 * @param nbrTexels Number of texels in the EM, also used as the key of the discarded samples.
+	 * @return Number of passes.
+	 */
+	static int getNbrPasses(uint32_t nbrTexels);
+
+	/*
+	 * Sorts the samples by key, keeping the sample order within a key. Every pass counts the digits per work group,
+	 * scans the counts in digit-major order and moves every sample to its offset plus its rank within the group.
+	 * @param keys Key of every sample.
+	 * @param nbrTexels Number of texels in the EM.
+	 * @param order Indices of the samples sorted by key.
+	 */
+	void sort(const std::vector<uint32_t>& keys, uint32_t nbrTexels, std::vector<uint32_t>& order);
+
+	/*
+	 * Resolves every texel updated by the samples, storing it once.
+	 * @param keys Key of every sample.
+	 * @param values New value of every sample.
+	 * @param order Indices of the samples sorted by key.
+	 * @param nbrTexels Number of texels in the EM.
+	 * @param mode Resolution of the samples of a texel, ScatterNearest or ScatterAverage.
+	 * @param envMap EM (RGB-D).
+	 * @return Number of texels stored.
+	 */
+	static size_t resolve(const std::vector<uint32_t>& keys, const std::vector<glm::vec4>& values, const std::vector<uint32_t>& order,
+		uint32_t nbrTexels, ScatterMode mode, glm::vec4* envMap);
+
+	/*
+	 * Projects the samples to the EM.
+	 * @param samplesRef Reference samples.
+	 * @param samplesCur Current samples.
+	 * @param samplesData Sample data.
+	 * @param nbrSamples Number of samples.
+	 * @param emWidth Width of the EM.
+	 * @param emHeight Height of the EM.
+	 * @param corrMtx Color correction matrix.
+	 * @param withinTrustedSphere True if the device is close to the EM origin.
+	 * @param mode Resolution of the samples of a texel, ScatterUnordered stores them in sample order.
+	 * @param envMap EM (RGB-D).
+	 * @return Number of texel stores.
+	 */
+	size_t project(const glm::vec4* samplesRef, const glm::vec4* samplesCur, const glm::vec4* samplesData, size_t nbrSamples, int emWidth,
+		int emHeight, const glm::mat3& corrMtx, bool withinTrustedSphere, ScatterMode mode, glm::vec4* envMap);
+
+	/*
+	 * Retrieves the number of dispatches of the last projection, as run on the GPU.
+	 * @return Number of dispatches.
+	 */
+	size_t getNbrDispatches() const { return nbrDispatches_; }
+
+private:
+	size_t                 groupSize_;     /*!< Number of invocations per work group of the sort. */
+	std::vector<uint32_t>  keys_;          /*!< Keys of the samples being sorted. */
+	std::vector<uint32_t>  offsets_;       /*!< Digit counts and offsets of every work group, in digit-major order. */
+	std::vector<uint32_t>  sorted_;        /*!< Indices of the samples after the current pass. */
+	std::vector<uint32_t>  sortedKeys_;    /*!< Keys of the samples after the current pass. */
+	std::vector<uint32_t>  computedKeys_;  /*!< Keys of the last projection. */
+	std::vector<glm::vec4> values_;        /*!< New values of the last projection. */
+	std::vector<uint32_t>  order_;         /*!< Sorted indices of the last projection. */
+	size_t                 nbrDispatches_; /*!< Number of dispatches of the last projection. */
+};
+
+} }
+
+#endif
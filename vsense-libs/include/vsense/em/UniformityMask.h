@@ -0,0 +1,108 @@
+#ifndef VSENSE_EM_UNIFORMITYMASK_H_
+#define VSENSE_EM_UNIFORMITYMASK_H_
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+namespace vsense { namespace em {
+
+/*
+ * The UniformityMask class caches, for every pixel of an equirectangular map, whether the colors in its neighborhood
+ * are uniform (the variance of every channel is below a threshold). The map is split in tiles that are evaluated
+ * lazily: a tile is only recalculated when queried after one of the pixels its neighborhoods read was modified.
+ * Within a tile the variances are obtained in constant time per pixel from summed-area tables of the color and the
+ * squared color. The neighborhoods wrap around horizontally and are clamped at the poles.
+ */
+class UniformityMask {
+public:
+	/*
+	 * UniformityMask constructor.
+	 * @param radius Radius of the square neighborhood in pixels.
+	 * @param maxVariance Maximum variance allowed for a neighborhood to be uniform.
+	 * @param tileSize Size in pixels of the tiles.
+	 */
+	UniformityMask(int radius = 1, float maxVariance = 0.0075f, size_t tileSize = 32);
+
+	/*
+	 * Updates the dimensions of the map, every tile is invalidated. The mask is only reallocated if they change.
+	 * @param width Map width.
+	 * @param height Map height.
+	 */
+	void resize(size_t width, size_t height);
+
+	/*
+	 * Updates the radius of the neighborhood, every tile is invalidated if it changes.
+	 * @param radius Radius of the square neighborhood in pixels.
+	 */
+	void setRadius(int radius);
+
+	/*
+	 * Releases the mask, resize must be called before it is used again.
+	 */
+	void clear();
+
+	/*
+	 * Checks if the mask is allocated.
+	 * @return True if resize wasn't called since the construction or the last clear.
+	 */
+	bool isEmpty() const { return mask_.empty(); }
+
+	/*
+	 * Invalidates every tile, used when the whole map is modified.
+	 */
+	void invalidateAll();
+
+	/*
+	 * Invalidates the tiles whose neighborhoods include a given pixel.
+	 * @param offset Offset of the modified pixel.
+	 */
+	void invalidate(size_t offset);
+
+	/*
+	 * Checks if the neighborhood of a pixel is uniform, its tile is recalculated first if invalid.
+	 * @param color Pointer to the color map.
+	 * @param offset Offset of the pixel.
+	 * @return True if uniform.
+	 */
+	bool isUniform(const glm::vec3* color, size_t offset);
+
+	/*
+	 * Retrieves the number of tile evaluations since the map was resized.
+	 * @return Number of tiles evaluated.
+	 */
+	size_t getNbrTileUpdates() const { return nbrTileUpdates_; }
+
+private:
+	/*
+	 * Resizes the summed-area tables to the tiles extended by the radius.
+	 */
+	void resizeTables();
+
+	/*
+	 * Recalculates the mask within a tile.
+	 * @param color Pointer to the color map.
+	 * @param tile Index of the tile.
+	 */
+	void updateTile(const glm::vec3* color, size_t tile);
+
+	size_t                     width_;          /*!< Map width. */
+	size_t                     height_;         /*!< Map height. */
+	int                        radius_;         /*!< Neighborhood radius in pixels. */
+	float                      maxVariance_;    /*!< Maximum variance for a uniform neighborhood. */
+	size_t                     tileSize_;       /*!< Tile size in pixels. */
+	size_t                     tilesX_;         /*!< Number of tiles horizontally. */
+	size_t                     tilesY_;         /*!< Number of tiles vertically. */
+
+	std::vector<unsigned char> mask_;           /*!< Per-pixel uniformity (1 if uniform). */
+	std::vector<unsigned char> valid_;          /*!< Per-tile validity (1 if the tile is up to date). */
+
+	std::vector<glm::dvec3>    sum_;            /*!< Summed-area table of the color (scratch). */
+	std::vector<glm::dvec3>    sumSq_;          /*!< Summed-area table of the squared color (scratch). */
+
+	size_t                     nbrTileUpdates_; /*!< Number of tile evaluations. */
+};
+
+} }
+
+#endif
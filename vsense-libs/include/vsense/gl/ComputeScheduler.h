@@ -0,0 +1,222 @@
+#ifndef VSENSE_GL_COMPUTESCHEDULER_H_
+#define VSENSE_GL_COMPUTESCHEDULER_H_
+
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace vsense { namespace gl {
+
+/*
+ * Memory barrier bits, mapped to the glMemoryBarrier() bits by the GL commands.
+ */
+enum BarrierBits {
+	BarrierNone          = 0,
+	BarrierImageAccess   = 1 << 0, /*!< GL_SHADER_IMAGE_ACCESS_BARRIER_BIT */
+	BarrierTextureFetch  = 1 << 1, /*!< GL_TEXTURE_FETCH_BARRIER_BIT */
+	BarrierTextureUpdate = 1 << 2, /*!< GL_TEXTURE_UPDATE_BARRIER_BIT */
+	BarrierFramebuffer   = 1 << 3, /*!< GL_FRAMEBUFFER_BARRIER_BIT */
+	BarrierAtomicCounter = 1 << 4, /*!< GL_ATOMIC_COUNTER_BARRIER_BIT */
+	BarrierBufferUpdate  = 1 << 5, /*!< GL_BUFFER_UPDATE_BARRIER_BIT */
+	BarrierAll           = (1 << 6) - 1
+};
+
+/*
+ * Ways a stage accesses a resource.
+ */
+enum AccessType {
+	AccessImageLoad = 0,  /*!< Image load in the shader. */
+	AccessImageStore,     /*!< Image store in the shader. */
+	AccessAtomicCounter,  /*!< Atomic counter operations in the shader. */
+	AccessTextureUpdate,  /*!< Texture upload or clear from the client (glTexSubImage2D). */
+	AccessBufferUpdate,   /*!< Buffer upload from the client (glBufferSubData). */
+	AccessPixelRead       /*!< Framebuffer read (glReadPixels). */
+};
+
+/*
+ * Access of a stage to a resource, identified by its address (e.g. the gl::Texture holding it).
+ */
+struct ResourceAccess {
+	ResourceAccess(const void* res, AccessType acc) : resource(res), type(acc) {}
+
+	const void* resource; /*!< Resource. */
+	AccessType  type;     /*!< Type of access. */
+};
+
+/*
+ * A stage is a unit of GPU work (typically binding a program and its images and dispatching it) along with the
+ * resources it accesses.
+ */
+struct ComputeStage {
+	std::string                 name;     /*!< Name of the stage, used in the command traces. */
+	std::vector<ResourceAccess> accesses; /*!< Resources accessed by the stage. */
+	std::function<void()>       run;      /*!< Issues the GL commands of the stage. */
+};
+
+/*
+ * The ComputeCommands class is the interface receiving the commands of the scheduler.
+ */
+class ComputeCommands {
+public:
+	virtual ~ComputeCommands() {}
+
+	/*
+	 * Issues a memory barrier.
+	 * @param bits Combination of BarrierBits.
+	 */
+	virtual void memoryBarrier(unsigned int bits) = 0;
+
+	/*
+	 * Runs a stage.
+	 * @param stage Stage to run.
+	 */
+	virtual void runStage(const ComputeStage& stage) = 0;
+};
+
+/*
+ * The RecordedComputeCommands class records the commands as a trace instead of issuing them, so the scheduling can be
+ * checked without a GPU.
+ */
+class RecordedComputeCommands : public ComputeCommands {
+public:
+	/*
+	 * Recorded command.
+	 */
+	struct Command {
+		bool         isBarrier; /*!< True for a barrier, false for a stage. */
+		unsigned int bits;      /*!< Barrier bits. */
+		std::string  stage;     /*!< Name of the stage. */
+	};
+
+	/*
+	 * RecordedComputeCommands constructor.
+	 * @param runStages True if the stages are also run.
+	 */
+	RecordedComputeCommands(bool runStages = false) : runStages_(runStages) {}
+
+	void memoryBarrier(unsigned int bits);
+	void runStage(const ComputeStage& stage);
+
+	/*
+	 * Retrieves the recorded trace.
+	 * @return Commands in issuing order.
+	 */
+	const std::vector<Command>& getTrace() const { return trace_; }
+
+	/*
+	 * Formats the trace, one command per line.
+	 * @return Trace as text.
+	 */
+	std::string toString() const;
+
+	/*
+	 * Clears the trace.
+	 */
+	void clear() { trace_.clear(); }
+
+private:
+	bool                 runStages_; /*!< True if the stages are also run. */
+	std::vector<Command> trace_;     /*!< Recorded commands. */
+};
+
+/*
+ * The ComputeScheduler class orders the queued stages by their dependencies and inserts only the barriers needed by
+ * their accesses. Two stages depend on each other if they access the same resource and at least one of them writes
+ * it. On flush(), the stages are grouped in levels (a stage runs one level after the latest stage it depends on) and
+ * a single barrier, with the bits required by the accesses of the level, is issued before every level. Pending writes
+ * are tracked across flushes, so a barrier is only issued once the written resource is accessed again.
+ */
+class ComputeScheduler {
+public:
+	/*
+	 * ComputeScheduler constructor.
+	 */
+	ComputeScheduler();
+
+	/*
+	 * Queues a stage.
+	 * @param name Name of the stage.
+	 * @param accesses Resources accessed by the stage.
+	 * @param run Issues the GL commands of the stage.
+	 */
+	void addStage(const std::string& name, const std::vector<ResourceAccess>& accesses, const std::function<void()>& run);
+
+	/*
+	 * Runs the queued stages.
+	 * @param commands Receiver of the commands.
+	 */
+	void flush(ComputeCommands& commands);
+
+	/*
+	 * Runs the queued stages and issues the barrier making every pending write visible, to hand over the resources to
+	 * code outside the scheduler.
+	 * @param commands Receiver of the commands.
+	 */
+	void synchronize(ComputeCommands& commands);
+
+	/*
+	 * Retrieves the number of stages run.
+	 * @return Number of stages.
+	 */
+	unsigned int getNbrStages() const { return nbrStages_; }
+
+	/*
+	 * Retrieves the number of barriers issued.
+	 * @return Number of barriers.
+	 */
+	unsigned int getNbrBarriers() const { return nbrBarriers_; }
+
+	/*
+	 * Resets the counters of stages and barriers.
+	 */
+	void resetCounters() { nbrStages_ = 0; nbrBarriers_ = 0; }
+
+private:
+	/*
+	 * State of a resource since the last barrier.
+	 */
+	struct ResourceState {
+		ResourceState() : dirtyBits(BarrierNone), readBits(BarrierNone) {}
+
+		unsigned int dirtyBits; /*!< Barrier bits still required by a shader write. */
+		unsigned int readBits;  /*!< Barrier bits still required before writing over a shader read. */
+	};
+
+	/*
+	 * Checks if two stages depend on each other.
+	 * @param first First stage.
+	 * @param second Second stage.
+	 * @return True if they share a resource written by at least one of them.
+	 */
+	static bool dependsOn(const ComputeStage& first, const ComputeStage& second);
+
+	/*
+	 * Retrieves the barrier bits required before an access.
+	 * @param access Access of the resource.
+	 * @return Barrier bits.
+	 */
+	unsigned int requiredBits(const ResourceAccess& access);
+
+	/*
+	 * Updates the state of a resource after an access.
+	 * @param access Access of the resource.
+	 */
+	void recordAccess(const ResourceAccess& access);
+
+	/*
+	 * Issues a barrier and updates the state of the resources.
+	 * @param bits Barrier bits.
+	 * @param commands Receiver of the commands.
+	 */
+	void issueBarrier(unsigned int bits, ComputeCommands& commands);
+
+	std::vector<ComputeStage>            queue_;       /*!< Queued stages. */
+	std::map<const void*, ResourceState> resources_;   /*!< State of the accessed resources. */
+	unsigned int                         nbrStages_;   /*!< Number of stages run. */
+	unsigned int                         nbrBarriers_; /*!< Number of barriers issued. */
+};
+
+} }
+
+#endif
@@ -13,6 +13,7 @@
 #include <vsense/gl/Transform.h>
 
 #include <memory>
+#include <string>
 
 #ifdef _WINDOWS
 #include <QOpenGLShaderProgram>
@@ -142,6 +143,13 @@ public:
   virtual void render(const glm::mat4 &viewMat, const glm::mat4 &projMat) = 0;
 
 protected:
+	/*
+	 * Reads the source of a shader from the resources (Windows) or the assets (Android).
+	 * @param filename Path of the shader.
+	 * @return Source of the shader, empty if it couldn't be read.
+	 */
+  std::string readShaderSource(const std::string& filename);
+
   bool initialized_; /*!< True if initialized. */
   bool visible_;     /*!< True if visible. */
 
@@ -0,0 +1,35 @@
+#ifndef VSENSE_GL_GLCOMPUTECOMMANDS_H_
+#define VSENSE_GL_GLCOMPUTECOMMANDS_H_
+
+#include <vsense/gl/ComputeScheduler.h>
+
+#ifdef _WINDOWS
+#include <QOpenGLFunctions>
+#include <QOpenGLFunctions_4_3_Core>
+#elif __ANDROID__
+#include <GLES3/gl31.h>
+#endif
+
+namespace vsense { namespace gl {
+
+/*
+ * The GLComputeCommands class issues the commands of the scheduler to the current OpenGL context.
+ */
+#ifdef _WINDOWS
+class GLComputeCommands : public ComputeCommands, protected QOpenGLFunctions_4_3_Core {
+#elif __ANDROID__
+class GLComputeCommands : public ComputeCommands {
+#endif
+public:
+	/*
+	 * GLComputeCommands constructor.
+	 */
+	GLComputeCommands();
+
+	void memoryBarrier(unsigned int bits);
+	void runStage(const ComputeStage& stage);
+};
+
+} }
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef VSENSE_GL_GLPROGRAMDRIVER_H_
+#define VSENSE_GL_GLPROGRAMDRIVER_H_
+
+#include <vsense/gl/ProgramCache.h>
+
+#ifdef _WINDOWS
+#include <QOpenGLFunctions>
+#include <QOpenGLFunctions_4_3_Core>
+#elif __ANDROID__
+#include <GLES3/gl31.h>
+#endif
+
+namespace vsense { namespace gl {
+
+/*
+ * The GLProgramDriver class compiles the programs and handles their binaries (glGetProgramBinary, glProgramBinary)
+ * with the current OpenGL context. The driver identifier is built from GL_VENDOR, GL_RENDERER and GL_VERSION.
+ */
+#ifdef _WINDOWS
+class GLProgramDriver : public ProgramDriver, protected QOpenGLFunctions_4_3_Core {
+#elif __ANDROID__
+class GLProgramDriver : public ProgramDriver {
+#endif
+public:
+	/*
+	 * GLProgramDriver constructor.
+	 */
+	GLProgramDriver();
+
+	std::string getDriverId();
+	bool supportsBinaries();
+	unsigned int compile(const std::vector<std::pair<ShaderStage, std::string>>& sources);
+	bool getBinary(unsigned int program, uint32_t& format, std::vector<unsigned char>& binary);
+	unsigned int loadBinary(uint32_t format, const std::vector<unsigned char>& binary);
+
+private:
+	/*
+	 * Checks the link status of a program, printing its log if it failed.
+	 * @param program Program.
+	 * @return True if linked.
+	 */
+	bool checkLinkStatus(GLuint program);
+};
+
+} }
+
+#endif
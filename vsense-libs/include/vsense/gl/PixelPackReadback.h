@@ -0,0 +1,67 @@
+#ifndef VSENSE_GL_PIXELPACKREADBACK_H_
+#define VSENSE_GL_PIXELPACKREADBACK_H_
+
+#include <vsense/gl/ReadbackRing.h>
+
+#include <vector>
+
+#ifdef _WINDOWS
+#include <QOpenGLFunctions>
+#include <QOpenGLFunctions_4_3_Core>
+#elif __ANDROID__
+#include <GLES3/gl31.h>
+#include <GLES3/gl3ext.h>
+#endif
+
+namespace vsense { namespace gl {
+
+class Texture;
+
+/*
+ * The PixelPackReadback class implements the readback buffers with one pixel buffer object per slot, filled
+ * asynchronously by glReadPixels and fenced with a sync object.
+ */
+#ifdef _WINDOWS
+class PixelPackReadback : public ReadbackBackend, protected QOpenGLFunctions_4_3_Core {
+#elif __ANDROID__
+class PixelPackReadback : public ReadbackBackend {
+#endif
+public:
+	/*
+	 * PixelPackReadback constructor.
+	 */
+	PixelPackReadback();
+
+	/*
+	 * PixelPackReadback destructor.
+	 */
+	~PixelPackReadback();
+
+	/*
+	 * Issues the copy of a texture into a slot, the size of the texture must match the slot size. The shader writes to
+	 * the texture must be made visible beforehand (GL_FRAMEBUFFER_BARRIER_BIT).
+	 * @param slot Index of the slot.
+	 * @param texture Texture to copy.
+	 */
+	void copyTexture(size_t slot, Texture& texture);
+
+	void allocate(size_t nbrSlots, size_t slotSize);
+	void fence(size_t slot);
+	bool isReady(size_t slot);
+	void wait(size_t slot);
+	bool read(size_t slot, void* data);
+
+private:
+	/*
+	 * Releases the buffers and the sync objects.
+	 */
+	void release();
+
+	size_t              slotSize_; /*!< Size of the slots in bytes. */
+	std::vector<GLuint> buffers_;  /*!< Pixel buffer object of every slot. */
+	std::vector<GLsync> syncs_;    /*!< Sync object of every slot. */
+};
+
+} }
+
+#endif
@@ -0,0 +1,227 @@
+#ifndef VSENSE_GL_PROGRAMCACHE_H_
+#define VSENSE_GL_PROGRAMCACHE_H_
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace vsense { namespace gl {
+
+const uint32_t ProgramBinaryMagic = 0x42505356; /*!< Identifier of the cached program binaries ("VSPB"). */
+const uint32_t ProgramBinaryVersion = 1;        /*!< Version of the cache files, older files are recompiled. */
+
+/*
+ * Stages of a shader program.
+ */
+enum ShaderStage {
+	StageVertex = 0, /*!< Vertex shader. */
+	StageFragment,   /*!< Fragment shader. */
+	StageCompute     /*!< Compute shader. */
+};
+
+/*
+ * The ShaderVariant class describes a program: the source of every stage and the definitions (e.g. SH order,
+ * work-group size or image format) inserted after their #version directive. Two variants with the same sources and
+ * definitions share the cached binary.
+ */
+class ShaderVariant {
+public:
+	/*
+	 * Adds a stage to the program.
+	 * @param stage Stage.
+	 * @param source Source of the stage, starting with the #version directive.
+	 */
+	void addStage(ShaderStage stage, const std::string& source);
+
+	/*
+	 * Adds a definition to every stage.
+	 * @param name Name of the macro.
+	 * @param value Value of the macro.
+	 */
+	void addDefine(const std::string& name, const std::string& value);
+
+	/*
+	 * Adds an integer definition to every stage.
+	 * @param name Name of the macro.
+	 * @param value Value of the macro.
+	 */
+	void addDefine(const std::string& name, int value);
+
+	/*
+	 * Assembles the sources of the stages with the definitions.
+	 * @param sources Stage and final source of every stage.
+	 * @return True if every stage has a #version directive.
+	 */
+	bool assemble(std::vector<std::pair<ShaderStage, std::string>>& sources) const;
+
+	/*
+	 * Retrieves the number of stages.
+	 * @return Number of stages.
+	 */
+	size_t getNbrStages() const { return stages_.size(); }
+
+private:
+	std::vector<std::pair<ShaderStage, std::string>> stages_;  /*!< Stage and source of every stage. */
+	std::vector<std::pair<std::string, std::string>> defines_; /*!< Definitions added after the version. */
+};
+
+/*
+ * The ProgramDriver class is the interface of the compilation and program binary functions used by ProgramCache.
+ */
+class ProgramDriver {
+public:
+	virtual ~ProgramDriver() {}
+
+	/*
+	 * Retrieves the identifier of the driver (vendor, renderer and version), binaries are only reused with the same one.
+	 * @return Identifier of the driver.
+	 */
+	virtual std::string getDriverId() = 0;
+
+	/*
+	 * Checks if the driver can retrieve and load program binaries.
+	 * @return True if supported.
+	 */
+	virtual bool supportsBinaries() = 0;
+
+	/*
+	 * Compiles and links a program from source.
+	 * @param sources Stage and source of every stage.
+	 * @return Program, 0 if it failed.
+	 */
+	virtual unsigned int compile(const std::vector<std::pair<ShaderStage, std::string>>& sources) = 0;
+
+	/*
+	 * Retrieves the binary of a linked program.
+	 * @param program Program.
+	 * @param format Format of the binary.
+	 * @param binary Content of the binary.
+	 * @return True if successful.
+	 */
+	virtual bool getBinary(unsigned int program, uint32_t& format, std::vector<unsigned char>& binary) = 0;
+
+	/*
+	 * Creates a program from a binary.
+	 * @param format Format of the binary.
+	 * @param binary Content of the binary.
+	 * @return Program, 0 if the driver rejected the binary.
+	 */
+	virtual unsigned int loadBinary(uint32_t format, const std::vector<unsigned char>& binary) = 0;
+};
+
+/*
+ * The ProgramCache class creates the programs of the shader variants, keeping the binaries of the linked programs in
+ * memory and on disk so the sources are only compiled once per driver. The key of a variant is a 64-bit FNV-1a hash
+ * of the driver identifier and the assembled sources, the binary of a variant is stored as <key>.bin holding a header
+ * (magic, version, key, format, size, hash of the binary) followed by the binary. A binary rejected by the driver, or a
+ * file that is truncated or from another version, is discarded and the program compiled from source again.
+ */
+class ProgramCache {
+public:
+	/*
+	 * ProgramCache constructor.
+	 * @param driver Compilation and program binary functions.
+	 * @param directory Folder holding the cache files, ending with a separator. Empty to only cache in memory.
+	 */
+	ProgramCache(std::shared_ptr<ProgramDriver> driver, const std::string& directory);
+
+	/*
+	 * Creates the program of a variant, from its cached binary if available.
+	 * @param variant Shader variant.
+	 * @return Program, 0 if it failed.
+	 */
+	unsigned int getProgram(const ShaderVariant& variant);
+
+	/*
+	 * Creates a program from its assembled sources, from its cached binary if available.
+	 * @param sources Stage and final source of every stage.
+	 * @return Program, 0 if it failed.
+	 */
+	unsigned int getProgram(const std::vector<std::pair<ShaderStage, std::string>>& sources);
+
+	/*
+	 * Calculates the key of a program.
+	 * @param sources Stage and final source of every stage.
+	 * @return Key of the program.
+	 */
+	uint64_t getKey(const std::vector<std::pair<ShaderStage, std::string>>& sources);
+
+	/*
+	 * Removes the cached binary of a program from memory and disk.
+	 * @param key Key of the program.
+	 */
+	void invalidate(uint64_t key);
+
+	/*
+	 * Retrieves the path of the cache file of a program.
+	 * @param key Key of the program.
+	 * @return Path of the file, empty if only cached in memory.
+	 */
+	std::string getFilename(uint64_t key) const;
+
+	/*
+	 * Retrieves the number of programs compiled from source.
+	 * @return Number of programs.
+	 */
+	size_t getNbrCompiled() const { return nbrCompiled_; }
+
+	/*
+	 * Retrieves the number of programs created from a cached binary.
+	 * @return Number of programs.
+	 */
+	size_t getNbrLoaded() const { return nbrLoaded_; }
+
+	/*
+	 * Retrieves the number of cached binaries discarded (rejected by the driver or invalid files).
+	 * @return Number of binaries.
+	 */
+	size_t getNbrDiscarded() const { return nbrDiscarded_; }
+
+	/*
+	 * Calculates the 64-bit FNV-1a hash of some data.
+	 * @param data Pointer to the data.
+	 * @param size Size of the data in bytes.
+	 * @param seed Hash of the preceding data.
+	 * @return Hash.
+	 */
+	static uint64_t hash(const void* data, size_t size, uint64_t seed = 0xcbf29ce484222325ULL);
+
+private:
+	/*
+	 * Cached binary of a program.
+	 */
+	struct ProgramBinary {
+		uint32_t                   format; /*!< Format of the binary. */
+		std::vector<unsigned char> data;   /*!< Content of the binary. */
+	};
+
+	/*
+	 * Reads the cached binary of a program from disk.
+	 * @param key Key of the program.
+	 * @param binary Cached binary.
+	 * @return True if a valid file was found.
+	 */
+	bool readBinary(uint64_t key, ProgramBinary& binary);
+
+	/*
+	 * Writes the cached binary of a program to disk.
+	 * @param key Key of the program.
+	 * @param binary Cached binary.
+	 * @return True if successful.
+	 */
+	bool writeBinary(uint64_t key, const ProgramBinary& binary);
+
+	std::shared_ptr<ProgramDriver>    driver_;       /*!< Compilation and program binary functions. */
+	std::string                       directory_;    /*!< Folder holding the cache files. */
+	std::map<uint64_t, ProgramBinary> binaries_;     /*!< Binaries cached in memory. */
+	size_t                            nbrCompiled_;  /*!< Number of programs compiled from source. */
+	size_t                            nbrLoaded_;    /*!< Number of programs created from a cached binary. */
+	size_t                            nbrDiscarded_; /*!< Number of discarded binaries. */
+};
+
+} }
+
+#endif
@@ -0,0 +1,200 @@
+#ifndef VSENSE_GL_READBACKRING_H_
+#define VSENSE_GL_READBACKRING_H_
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace vsense { namespace gl {
+
+/*
+ * The ReadbackBackend class is the interface of the buffers and fences used by ReadbackRing. Every slot holds the
+ * result of one copy issued by the user of the ring; a fence marks the end of the copy.
+ */
+class ReadbackBackend {
+public:
+	virtual ~ReadbackBackend() {}
+
+	/*
+	 * Allocates the buffers.
+	 * @param nbrSlots Number of slots.
+	 * @param slotSize Size of every slot in bytes.
+	 */
+	virtual void allocate(size_t nbrSlots, size_t slotSize) = 0;
+
+	/*
+	 * Inserts the fence of a slot, after its copy was issued.
+	 * @param slot Index of the slot.
+	 */
+	virtual void fence(size_t slot) = 0;
+
+	/*
+	 * Checks without blocking if the copy into a slot finished.
+	 * @param slot Index of the slot.
+	 * @return True if finished.
+	 */
+	virtual bool isReady(size_t slot) = 0;
+
+	/*
+	 * Blocks until the copy into a slot finished.
+	 * @param slot Index of the slot.
+	 */
+	virtual void wait(size_t slot) = 0;
+
+	/*
+	 * Copies the content of a finished slot.
+	 * @param slot Index of the slot.
+	 * @param data Pointer to the destination, of at least the slot size.
+	 * @return True if successful.
+	 */
+	virtual bool read(size_t slot, void* data) = 0;
+};
+
+/*
+ * The ReadbackRing class reads back GPU results without stalling the pipeline. Each frame the result is copied into
+ * the next of N slots and fenced, and the results are retrieved once their fences are signaled: a result from frame k
+ * is available, at the latest, at frame k+N-1, where the ring is full and retrieve() blocks on the oldest slot. With a
+ * single slot the readback is synchronous.
+ */
+class ReadbackRing {
+public:
+	/*
+	 * ReadbackRing constructor.
+	 * @param backend Buffers and fences of the ring.
+	 * @param nbrSlots Number of slots (at least 1).
+	 * @param slotSize Size of every slot in bytes.
+	 */
+	ReadbackRing(std::shared_ptr<ReadbackBackend> backend, size_t nbrSlots, size_t slotSize);
+
+	/*
+	 * Reserves the slot for the result of a frame, the copy into it must be issued before calling submit(). If every
+	 * slot is in flight, the oldest one is waited for and dropped.
+	 * @param frame Index of the frame.
+	 * @return Index of the slot.
+	 */
+	size_t acquire(uint64_t frame);
+
+	/*
+	 * Fences a slot after its copy was issued.
+	 * @param slot Index of the slot returned by acquire().
+	 */
+	void submit(size_t slot);
+
+	/*
+	 * Retrieves the newest finished result, the older ones are dropped. Blocks on the oldest slot only if none is
+	 * finished and the ring is full.
+	 * @param data Pointer to the destination, of at least the slot size.
+	 * @param curFrame Index of the current frame.
+	 * @param age Number of frames between the result and the current frame.
+	 * @return True if a result was retrieved.
+	 */
+	bool retrieve(void* data, uint64_t curFrame, uint64_t& age);
+
+	/*
+	 * Retrieves the newest result in flight, blocking until it is finished (synchronous fallback).
+	 * @param data Pointer to the destination, of at least the slot size.
+	 * @param curFrame Index of the current frame.
+	 * @param age Number of frames between the result and the current frame.
+	 * @return True if a result was in flight.
+	 */
+	bool retrieveNewest(void* data, uint64_t curFrame, uint64_t& age);
+
+	/*
+	 * Retrieves the number of slots.
+	 * @return Number of slots.
+	 */
+	size_t getNbrSlots() const { return nbrSlots_; }
+
+	/*
+	 * Retrieves the size of the slots.
+	 * @return Size in bytes.
+	 */
+	size_t getSlotSize() const { return slotSize_; }
+
+	/*
+	 * Retrieves the number of results in flight.
+	 * @return Number of results.
+	 */
+	size_t getNbrInFlight() const { return nbrInFlight_; }
+
+	/*
+	 * Retrieves the number of results dropped because a newer one was retrieved or the ring was full.
+	 * @return Number of results.
+	 */
+	size_t getNbrDropped() const { return nbrDropped_; }
+
+	/*
+	 * Retrieves the number of times the ring had to block.
+	 * @return Number of blocking waits.
+	 */
+	size_t getNbrBlocking() const { return nbrBlocking_; }
+
+private:
+	/*
+	 * Reads a finished slot and releases it along with the older ones.
+	 * @param count Number of slots to release, starting from the oldest.
+	 * @param data Pointer to the destination.
+	 * @param curFrame Index of the current frame.
+	 * @param age Number of frames between the result and the current frame.
+	 * @return True if successful.
+	 */
+	bool release(size_t count, void* data, uint64_t curFrame, uint64_t& age);
+
+	std::shared_ptr<ReadbackBackend> backend_;     /*!< Buffers and fences. */
+	size_t                           nbrSlots_;    /*!< Number of slots. */
+	size_t                           slotSize_;    /*!< Size of the slots in bytes. */
+	std::vector<uint64_t>            frames_;      /*!< Frame of the result in every slot. */
+	size_t                           oldest_;      /*!< Index of the oldest slot in flight. */
+	size_t                           nbrInFlight_; /*!< Number of slots in flight. */
+	size_t                           nbrDropped_;  /*!< Number of dropped results. */
+	size_t                           nbrBlocking_; /*!< Number of blocking waits. */
+};
+
+/*
+ * The CPUReadbackBackend class emulates the buffers and fences on the CPU, so the ring can be used without a GPU. The
+ * copy into a slot is emulated with write(), and a fence is signaled after a number of calls to advance() (the GPU
+ * progress) or when waited for.
+ */
+class CPUReadbackBackend : public ReadbackBackend {
+public:
+	/*
+	 * CPUReadbackBackend constructor.
+	 * @param latency Number of calls to advance() before a fence is signaled.
+	 */
+	CPUReadbackBackend(size_t latency = 1);
+
+	/*
+	 * Emulates the copy of a result into a slot.
+	 * @param slot Index of the slot.
+	 * @param data Pointer to the result, of the slot size.
+	 */
+	void write(size_t slot, const void* data);
+
+	/*
+	 * Emulates the progress of the GPU, every pending fence gets closer to be signaled.
+	 */
+	void advance();
+
+	/*
+	 * Retrieves the number of blocking waits on a pending fence.
+	 * @return Number of waits.
+	 */
+	size_t getNbrStalls() const { return nbrStalls_; }
+
+	void allocate(size_t nbrSlots, size_t slotSize);
+	void fence(size_t slot);
+	bool isReady(size_t slot);
+	void wait(size_t slot);
+	bool read(size_t slot, void* data);
+
+private:
+	size_t                     latency_;   /*!< Number of steps before a fence is signaled. */
+	size_t                     slotSize_;  /*!< Size of the slots in bytes. */
+	std::vector<unsigned char> buffers_;   /*!< Content of the slots. */
+	std::vector<int>           remaining_; /*!< Steps before the fence of every slot is signaled, -1 if not fenced. */
+	size_t                     nbrStalls_; /*!< Number of blocking waits on a pending fence. */
+};
+
+} }
+
+#endif
@@ -2,9 +2,17 @@
 #define VSENSE_GL_SHMESHPLANEDOTOBJECT_H_
 
 #include <vsense/gl/DrawableObject.h>
+#include <vsense/sh/BandLimit.h>
 #include <vsense/sh/SphericalHarmonics.h>
+#include <vsense/sh/TransferEvaluator.h>
+#include <vsense/sh/TransferPacker.h>
 
+#include <map>
 #include <memory>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
 
 namespace vsense {
 
@@ -38,6 +46,11 @@ public:
 	SHMeshPlaneDotObject(AAssetManager* assetManager, float scale = 1.f);
 #endif
 
+	/*
+	 * SHMeshPlaneDotObject destructor, deletes the programs of every shader variant created.
+	 */
+	~SHMeshPlaneDotObject();
+
 	/*
 	 * Renders the object.
 	 * @param viewMat View matrix.
@@ -49,8 +62,9 @@ public:
 	 * Updates the SH coefficients used to represent the occlusions of the plane with the virtual object.
 	 * @param shadowFile Filename with the coefficients (occluded).
 	 * @param planeFilename Filename with the coefficients (not-occluded).
+	 * @param maxOrder Highest order stored, the higher bands in the files are skipped.
 	 */
-	void updateCoefficients(const std::string& shadowFilename, const std::string& planeFilename);
+	void updateCoefficients(const std::string& shadowFilename, const std::string& planeFilename, int maxOrder = sh::MaxSHOrder);
 
 	/*
 	 * Updates the SH coefficients representing the environment.
@@ -58,6 +72,13 @@ public:
 	 */
 	void updateAmbientCoefficients(std::shared_ptr<gl::Texture> texture) {coeffsAmb_ = texture;}
 
+	/*
+	 * Updates the SH coefficients representing the environment used when the lighting is evaluated on the CPU.
+	 * @param coeffs Environment coefficients.
+	 * @param nbrCoeffs Number of coefficients.
+	 */
+	void updateAmbientCoefficients(const glm::vec4* coeffs, int nbrCoeffs);
+
 	/*
 	 * Loads the plane description from an OBJ file.
 	 * @param filename OBJ filename.
@@ -65,10 +86,52 @@ public:
 	void loadFromFile(const std::string& filename);
 
 	/*
-	 * Updates the number of coefficients to render (not used).
+	 * Updates the number of coefficients to render, selecting the order with all its bands available.
 	 * @param rernderCoeffNbr Number of coefficients.
 	 */
-	void updateRenderCoefficientsNumber(int renderCoeffNbr) { renderCoeffNbr_ = renderCoeffNbr; }
+	void updateRenderCoefficientsNumber(int renderCoeffNbr) { setSHOrder(sh::BandLimit::getOrder(renderCoeffNbr)); }
+
+	/*
+	 * Selects the SH order used to render, switching to the shader variant specialized for it. The order is clamped
+	 * to the supported range and to the order of the shadow coefficients.
+	 * @param order SH order.
+	 * @return True if the variant is available.
+	 */
+	bool setSHOrder(int order);
+
+	/*
+	 * Retrieves the SH order used to render.
+	 * @return SH order.
+	 */
+	int getSHOrder() const { return shOrder_; }
+
+	/*
+	 * Selects the storage of the transfer coefficients in the texture, switching to the shader variant unpacking it
+	 * and repacking the loaded coefficients.
+	 * @param quantization Storage of the coefficients.
+	 * @return True if the variant is available.
+	 */
+	bool setTransferQuantization(sh::TransferQuantization quantization);
+
+	/*
+	 * Retrieves the storage of the transfer coefficients.
+	 * @return Storage of the coefficients.
+	 */
+	sh::TransferQuantization getTransferQuantization() const { return quantization_; }
+
+	/*
+	 * Toggles the evaluation of the lighting of the vertices on the CPU, done only when the environment coefficients
+	 * or the order change, instead of in the vertex shader.
+	 * @param enable True if the lighting is evaluated on the CPU.
+	 * @return True if the variant is available.
+	 */
+	bool setCPULighting(bool enable);
+
+	/*
+	 * Checks if the lighting of the vertices is evaluated on the CPU.
+	 * @return True if evaluated on the CPU.
+	 */
+	bool getCPULighting() const { return cpuLighting_; }
 
 	/*
 	 * Updates the color correction matrix. Currently, this is not used in the shader.
@@ -101,6 +164,16 @@ private:
 	 */
 	void createMesh(float scale = 1.f);
 
+	/*
+	 * Queries the locations of the shader variables of the current program.
+	 */
+	void initializeLocations();
+
+	/*
+	 * Creates the texture of the transfer coefficients with the current storage.
+	 */
+	void updateTransferTexture();
+
 	std::shared_ptr<Texture> shadowTexture_; /*!< Texture holding the SH coefficients for the mesh. */
 	std::shared_ptr<Texture> coeffsAmb_;     /*!< Texture holding the SH coefficients for the environment. */
 
@@ -130,6 +203,29 @@ private:
 
 	float shFactor_ = 1.f;    /*!< SH factor applied. */
 	float shadowColor_;       /*!< Color of the shadow. */
+
+	int meshOrder_;           /*!< Order of the stored shadow coefficients, -1 if not loaded. */
+	int shOrder_;             /*!< Order used to render. */
+
+	std::string vertexSource_;   /*!< Source of the vertex shader before its specialization. */
+	std::string fragmentSource_; /*!< Source of the fragment shader. */
+
+	uint32_t   nbrVertices_;  /*!< Number of vertices with coefficients. */
+	glm::ivec2 coeffTexDim_;  /*!< Size of the single-precision coefficients, in coefficients. */
+
+	sh::TransferQuantization quantization_; /*!< Storage of the transfer coefficients. */
+
+	bool                   cpuLighting_;         /*!< True if the lighting is evaluated on the CPU. */
+	sh::TransferEvaluator  evaluator_;           /*!< CPU evaluation of the lighting of the vertices. */
+	std::vector<glm::vec4> ambientCoeffs_;       /*!< Environment coefficients used on the CPU. */
+	GLuint                 shBlockedLocation_;   /*!< Location of the lighting evaluated on the CPU. */
+	GLuint                 shUnblockedLocation_; /*!< Location of the lighting of the plane without the object. */
+
+#ifdef _WINDOWS
+	std::map<std::tuple<int, int, bool>, QOpenGLShaderProgram*> programs_; /*!< Shader variant of every order, storage and lighting used. */
+#elif __ANDROID__
+	std::map<std::tuple<int, int, bool>, GLuint> programs_;                /*!< Shader variant of every order, storage and lighting used. */
+#endif
 };
 
 } }
@@ -0,0 +1,77 @@
+#ifndef VSENSE_GL_SHADERSOURCE_H_
+#define VSENSE_GL_SHADERSOURCE_H_
+
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace vsense { namespace gl {
+
+/*
+ * The ShaderSource class assembles the source of a compute shader before its compilation. The definitions are
+ * inserted right after the #version directive, followed by the reduction library (reduction.glsl) and one
+ * instantiation of the reduction template (reductionType.glsl) per requested type. The shader can then declare its
+ * work group as (LOCAL_SIZE_X, LOCAL_SIZE_Y) and use reduceWorkGroup() and reductionFinishWorkGroup().
+ */
+class ShaderSource {
+public:
+	/*
+	 * ShaderSource constructor.
+	 * @param source Source of the shader, starting with the #version directive.
+	 */
+	ShaderSource(const std::string& source);
+
+	/*
+	 * Adds a definition to the shader.
+	 * @param name Name of the macro.
+	 * @param value Value of the macro.
+	 */
+	void addDefine(const std::string& name, const std::string& value);
+
+	/*
+	 * Adds an integer definition to the shader.
+	 * @param name Name of the macro.
+	 * @param value Value of the macro.
+	 */
+	void addDefine(const std::string& name, int value);
+
+	/*
+	 * Updates the size of the work group, defining LOCAL_SIZE_X, LOCAL_SIZE_Y and REDUCTION_GROUP_SIZE.
+	 * @param sizeX Number of invocations along X.
+	 * @param sizeY Number of invocations along Y.
+	 * @return True if the number of invocations is a power of two, as required by the reduction tree.
+	 */
+	bool setLocalSize(int sizeX, int sizeY);
+
+	/*
+	 * Requests an instantiation of reduceWorkGroup() for a GLSL type.
+	 * @param type GLSL type supporting the += operator (e.g. float, vec4 or mat3).
+	 */
+	void addReductionType(const std::string& type);
+
+	/*
+	 * Assembles the final source.
+	 * @param reductionLib Source of the reduction library.
+	 * @param reductionTemplate Source of the reduction template.
+	 * @param result Assembled source.
+	 * @return True if the source has a #version directive.
+	 */
+	bool assemble(const std::string& reductionLib, const std::string& reductionTemplate, std::string& result) const;
+
+	/*
+	 * Checks if a work-group size can be used with the reduction tree.
+	 * @param size Number of invocations in the work group.
+	 * @return True if the size is a power of two.
+	 */
+	static bool isValidGroupSize(int size) { return (size > 0) && !(size & (size - 1)); }
+
+private:
+	std::string                                      source_;         /*!< Source of the shader. */
+	std::vector<std::pair<std::string, std::string>> defines_;        /*!< Definitions added after the version. */
+	std::vector<std::string>                         reductionTypes_; /*!< Types with a reduction instantiated. */
+	bool                                             hasLocalSize_;   /*!< True if the work-group size was set. */
+};
+
+} }
+
+#endif
@@ -23,6 +23,10 @@
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtx/matrix_decompose.hpp>
 
+#include <vsense/gl/ProgramCache.h>
+
+#include <memory>
+
 #ifdef __ANDROID__
 #include <stdlib.h>
 #include <jni.h>
@@ -83,6 +87,12 @@ void decomposeMatrix(const glm::mat4& transformMat, glm::vec3* translation, glm:
  */
 void checkGlError(const char* operation);
 
+/*
+ * Sets the cache used by createProgram, the programs are then created from their cached binaries when available.
+ * @param cache Program cache, null to always compile from source.
+ */
+void setProgramCache(std::shared_ptr<ProgramCache> cache);
+
 /*
  * Creates a shader program.
  * @param vertexSource Source to the vertex shader.
@@ -3,6 +3,7 @@
 
 #include <glm/glm.hpp>
 
+#include <istream>
 #include <memory>
 #include <string>
 
@@ -47,6 +48,15 @@ public:
 	 */
 	static bool read(const std::string& filename, std::shared_ptr<Image>& img, ImageMetadata& imData);
 
+	/*
+	 * Reads a Tango image and its metadata from a stream, in the layout of the binary files.
+	 * @param in Stream positioned at the start of the image.
+	 * @param img Image object where the image is to be loaded.
+	 * @param imData Image metadata.
+	 * @return True if successful.
+	 */
+	static bool read(std::istream& in, std::shared_ptr<Image>& img, ImageMetadata& imData);
+
 private:
 	/*
 	 * ImageReader constructor disabled.
@@ -0,0 +1,44 @@
+#ifndef VSENSE_IO_IMAGEWRITER_H_
+#define VSENSE_IO_IMAGEWRITER_H_
+
+#include <vsense/io/ImageReader.h>
+
+#include <ostream>
+#include <string>
+
+namespace vsense { namespace io {
+
+/*
+ * The ImageWriter class stores images in the layout saved by the Tango app (PointCloud<i>.im): the metadata followed by
+ * the NV21 planes, so they can be read back by ImageReader.
+ */
+class ImageWriter {
+public:
+	/*
+	 * Writes an image and its metadata.
+	 * @param filename Filename of the file to write.
+	 * @param img Image to write, its width and height must be multiples of 2.
+	 * @param imData Image metadata, the size is taken from the image.
+	 * @return True if successful.
+	 */
+	static bool write(const std::string& filename, const Image& img, const ImageMetadata& imData);
+
+	/*
+	 * Writes an image and its metadata to a stream.
+	 * @param out Output stream.
+	 * @param img Image to write, its width and height must be multiples of 2.
+	 * @param imData Image metadata, the size is taken from the image.
+	 * @return True if successful.
+	 */
+	static bool write(std::ostream& out, const Image& img, const ImageMetadata& imData);
+
+private:
+	/*
+	 * ImageWriter constructor disabled.
+	 */
+	ImageWriter() {}
+};
+
+} }
+
+#endif
@@ -5,6 +5,9 @@
 
 #include <glm/glm.hpp>
 
+#include <istream>
+#include <string>
+
 namespace vsense { namespace io {
 
 /*
@@ -40,10 +43,29 @@ public:
 	 * @param filename Filename to read.
 	 * @param pc Point cloud object where the file is to be loaded.
 	 * @param pcData Point cloud metadata.
-	 * @return minConf Minimum accepted confidence.
+	 * @param minConf Minimum accepted confidence.
+	 * @return True if complete, the points read are kept otherwise.
 	 */
 	static bool read(const std::string& filename, pc::PointCloud& pc, PointCloudMetadata& pcData, float minConf = -1);
 
+	/*
+	 * Reads a Tango point cloud and its metadata from a stream, in the layout of the binary files.
+	 * @param in Stream positioned at the start of the point cloud.
+	 * @param pc Point cloud object where the points are to be added.
+	 * @param pcData Point cloud metadata.
+	 * @param minConf Minimum accepted confidence.
+	 * @return True if complete, the points read are kept otherwise.
+	 */
+	static bool read(std::istream& in, pc::PointCloud& pc, PointCloudMetadata& pcData, float minConf = -1);
+
+	/*
+	 * Reads a point cloud stored in the compact binary format (see PointCloudWriter).
+	 * @param filename Filename to read.
+	 * @param pc Point cloud object where the points are to be added.
+	 * @return True if successful.
+	 */
+	static bool readCompact(const std::string& filename, pc::PointCloud& pc);
+
 private:
 	/*
 	 * PointCloudReader constructor disabled.
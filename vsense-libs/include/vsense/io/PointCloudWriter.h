@@ -0,0 +1,71 @@
+#ifndef VSENSE_IO_POINTCLOUDWRITER_H_
+#define VSENSE_IO_POINTCLOUDWRITER_H_
+
+#include <vsense/io/PointCloudReader.h>
+#include <vsense/pc/PointCloud.h>
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+namespace vsense { namespace io {
+
+const uint32_t CompactPointCloudMagic = 0x42435056; /*!< Identifier of the compact point cloud files ("VPCB"). */
+
+const uint32_t HalfPositions  = 0x01; /*!< Positions stored in half precision. */
+const uint32_t ByteConfidence = 0x02; /*!< Confidence stored in 8 bits. */
+
+/*
+ * The PointCloudWriter class stores point clouds on disk. The compact binary format holds a header followed by
+ * each attribute stored contiguously (positions, RGB colors, flags and confidence) so it can be loaded with a
+ * single read per attribute by PointCloudReader::readCompact. Positions can optionally be stored in half precision
+ * (about 1 mm resolution at 2 m) and the confidence in 8 bits.
+ */
+class PointCloudWriter {
+public:
+	/*
+	 * Writes a point cloud in the compact binary format.
+	 * @param filename Filename of the file to write.
+	 * @param pc Point cloud to write.
+	 * @param options Combination of HalfPositions and ByteConfidence, 0 to store them in single precision.
+	 * @return True if successful.
+	 */
+	static bool write(const std::string& filename, const pc::PointCloud& pc, uint32_t options = 0);
+
+	/*
+	 * Writes a point cloud as a text file, one point per line with its position and 8-bit color.
+	 * @param filename Filename of the file to write.
+	 * @param pc Point cloud to write.
+	 * @param decimals Number of decimals used for the positions (at most 9).
+	 * @return True if successful.
+	 */
+	static bool writeXYZ(const std::string& filename, const pc::PointCloud& pc, int decimals = 6);
+
+	/*
+	 * Writes a point cloud in the layout saved by the Tango app (PointCloud<i>.pc), read by PointCloudReader::read.
+	 * @param filename Filename of the file to write.
+	 * @param pc Point cloud to write, in the depth sensor's CS.
+	 * @param pcData Point cloud metadata, the number of points is taken from the point cloud.
+	 * @return True if successful.
+	 */
+	static bool writeTango(const std::string& filename, const pc::PointCloud& pc, const PointCloudMetadata& pcData);
+
+	/*
+	 * Writes a point cloud in the layout saved by the Tango app to a stream.
+	 * @param out Output stream.
+	 * @param pc Point cloud to write, in the depth sensor's CS.
+	 * @param pcData Point cloud metadata, the number of points is taken from the point cloud.
+	 * @return True if successful.
+	 */
+	static bool writeTango(std::ostream& out, const pc::PointCloud& pc, const PointCloudMetadata& pcData);
+
+private:
+	/*
+	 * PointCloudWriter constructor disabled.
+	 */
+	PointCloudWriter();
+};
+
+} }
+
+#endif
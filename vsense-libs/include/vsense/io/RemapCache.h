@@ -0,0 +1,158 @@
+#ifndef VSENSE_IO_REMAPCACHE_H_
+#define VSENSE_IO_REMAPCACHE_H_
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+namespace vsense { namespace io {
+
+class Image;
+
+/*
+ * The RemapCache class stores the mapping between a grid of pixels and the image captured by a camera with lens
+ * distortion, so the camera image can be sampled without evaluating the distortion polynomial for every pixel. The grid
+ * is either the undistorted camera image or the rays of another sensor (e.g. the depth sensor). The mapping is built once
+ * per set of intrinsics and stored as the index of the nearest source pixel, and as the index of the top-left source
+ * pixel plus the bilinear fractions in fixed point (1/128 of a pixel). The nearest pixels are the ones found with
+ * Image::undistortAndProject. The remapped colors are the bilinear interpolation at the quantized source locations rounded
+ * to the nearest integer, exactly, on every path; at the exact source locations they differ by at most 1 plus the largest
+ * color difference between neighbor pixels divided by 128.
+ */
+class RemapCache {
+public:
+	/*
+	 * RemapCache constructor.
+	 */
+	RemapCache();
+
+	/*
+	 * Builds the mapping for a camera. The undistorted image has the same size and intrinsics as the camera image.
+	 * @param width Image width.
+	 * @param height Image height.
+	 * @param coeff Pointer to the distortion coefficients.
+	 * @param f Focal length in pixels (intrinsics).
+	 * @param c Optical center in pixels (intrinsics).
+	 * @param nbrThreads Number of threads, 0 to use all available.
+	 */
+	void build(size_t width, size_t height, const double* coeff, const glm::dvec2& f, const glm::dvec2& c, size_t nbrThreads = 0);
+
+	/*
+	 * Builds the mapping from the rays of a sensor to the image of a camera, the points at Z = 1 along the rays are
+	 * projected into the camera.
+	 * @param rays X/Z, Y/Z coordinates of the ray of every pixel of the grid.
+	 * @param width Width of the grid.
+	 * @param height Height of the grid.
+	 * @param pose Transformation from the sensor's CS to the camera's CS.
+	 * @param srcWidth Width of the camera image.
+	 * @param srcHeight Height of the camera image.
+	 * @param coeff Pointer to the distortion coefficients of the camera.
+	 * @param f Focal length in pixels (intrinsics).
+	 * @param c Optical center in pixels (intrinsics).
+	 * @param nbrThreads Number of threads, 0 to use all available.
+	 */
+	void build(const glm::vec2* rays, size_t width, size_t height, const glm::mat4& pose, size_t srcWidth, size_t srcHeight,
+		const double* coeff, const glm::dvec2& f, const glm::dvec2& c, size_t nbrThreads = 0);
+
+	/*
+	 * Checks if the mapping was built for a given camera.
+	 * @param width Image width.
+	 * @param height Image height.
+	 * @param coeff Pointer to the distortion coefficients.
+	 * @param f Focal length in pixels (intrinsics).
+	 * @param c Optical center in pixels (intrinsics).
+	 * @return True if the mapping can be used for the camera.
+	 */
+	bool matches(size_t width, size_t height, const double* coeff, const glm::dvec2& f, const glm::dvec2& c) const;
+
+	/*
+	 * Checks if the mapping was built for a given sensor and camera.
+	 * @param rays X/Z, Y/Z coordinates of the ray of every pixel of the grid, compared by address.
+	 * @param pose Transformation from the sensor's CS to the camera's CS.
+	 * @param srcWidth Width of the camera image.
+	 * @param srcHeight Height of the camera image.
+	 * @param coeff Pointer to the distortion coefficients of the camera.
+	 * @param f Focal length in pixels (intrinsics).
+	 * @param c Optical center in pixels (intrinsics).
+	 * @return True if the mapping can be used for the sensor and the camera.
+	 */
+	bool matches(const glm::vec2* rays, const glm::mat4& pose, size_t srcWidth, size_t srcHeight, const double* coeff,
+		const glm::dvec2& f, const glm::dvec2& c) const;
+
+	/*
+	 * Undistorts an image.
+	 * @param src Image captured by the camera.
+	 * @param dst Undistorted image (size of the grid), pixels mapped outside the source image are set to zero.
+	 * @param nbrThreads Number of threads, 0 to use all available.
+	 * @return True if successful.
+	 */
+	bool remap(const Image& src, Image& dst, size_t nbrThreads = 0) const;
+
+	/*
+	 * Retrieves the location in the camera image corresponding to a pixel of the undistorted image.
+	 * @param row Row of the undistorted pixel.
+	 * @param col Column of the undistorted pixel.
+	 * @param loc Location in the camera image (quantized).
+	 * @return True if the location falls within the camera image.
+	 */
+	bool sourceLocation(size_t row, size_t col, glm::vec2& loc) const;
+
+	/*
+	 * Retrieves the camera pixel nearest to the location of a pixel of the grid.
+	 * @param idx Index of the pixel of the grid.
+	 * @return Index of the camera pixel, -1 if the location falls outside the camera image.
+	 */
+	int32_t nearestSource(size_t idx) const { return nearest_[idx]; }
+
+	/*
+	 * Calculates the spherical angles of the rows and columns of an equirectangular image, matching
+	 * Image::imageXToPhi and Image::imageYToTheta.
+	 * @param width Image width.
+	 * @param height Image height.
+	 * @param phi Phi angle of every column.
+	 * @param theta Theta angle of every row.
+	 */
+	static void sphericalTables(size_t width, size_t height, std::vector<float>& phi, std::vector<float>& theta);
+
+	static const int FractionBits = 7; /*!< Bits used for the bilinear fractions. */
+
+private:
+	/*
+	 * Allocates the mapping and stores the parameters it is built for.
+	 * @param width Width of the grid.
+	 * @param height Height of the grid.
+	 * @param srcWidth Width of the camera image.
+	 * @param srcHeight Height of the camera image.
+	 * @param coeff Pointer to the distortion coefficients.
+	 * @param f Focal length in pixels (intrinsics).
+	 * @param c Optical center in pixels (intrinsics).
+	 */
+	void reset(size_t width, size_t height, size_t srcWidth, size_t srcHeight, const double* coeff, const glm::dvec2& f, const glm::dvec2& c);
+
+	/*
+	 * Stores the location in the camera image of a pixel of the grid.
+	 * @param idx Index of the pixel of the grid.
+	 * @param loc Location in the camera image.
+	 */
+	void setLocation(size_t idx, const glm::vec2& loc);
+
+	size_t     width_;     /*!< Width of the grid. */
+	size_t     height_;    /*!< Height of the grid. */
+	size_t     srcWidth_;  /*!< Width of the camera image. */
+	size_t     srcHeight_; /*!< Height of the camera image. */
+	double     coeff_[5];  /*!< Distortion coefficients used to build the mapping. */
+	glm::dvec2 f_;         /*!< Focal length used to build the mapping. */
+	glm::dvec2 c_;         /*!< Optical center used to build the mapping. */
+	const glm::vec2* rays_; /*!< Rays of the grid, NULL for the undistorted camera image. */
+	glm::mat4  pose_;      /*!< Transformation from the rays' CS to the camera's CS. */
+
+	std::vector<int32_t> nearest_; /*!< Index of the nearest source pixel, -1 if outside the image. */
+	std::vector<int32_t> offset_;  /*!< Index of the top-left source pixel, -1 if outside the image. */
+	std::vector<uint8_t> fracX_;   /*!< Horizontal bilinear fraction. */
+	std::vector<uint8_t> fracY_;   /*!< Vertical bilinear fraction. */
+};
+
+} }
+
+#endif
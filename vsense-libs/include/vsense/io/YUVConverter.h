@@ -0,0 +1,70 @@
+#ifndef VSENSE_IO_YUVCONVERTER_H_
+#define VSENSE_IO_YUVCONVERTER_H_
+
+#include <cstddef>
+
+#ifndef uchar
+typedef unsigned char uchar;
+#endif
+
+namespace vsense { namespace io {
+
+/*
+ * The YUVConverter class converts NV21 (YCrCb 4:2:0, semi-planar) frames as delivered by the Tango color camera to RGBA.
+ * The BT.601 coefficients are applied in fixed-point arithmetic, the 8-bit output matches the float conversion used
+ * before for every possible input. Rows are distributed over several threads and converted with SSE2 or NEON when
+ * available. Frames can optionally be downscaled by 2 or 4 in the same pass, averaging Y and chroma over each block.
+ * RGBA images can also be encoded as NV21, e.g. to write synthetic frames in the format of the Tango recordings.
+ */
+class YUVConverter {
+public:
+	/*
+	 * Converts a NV21 frame to RGBA8.
+	 * @param y Pointer to the luma plane.
+	 * @param vu Pointer to the interleaved chroma plane (V first).
+	 * @param width Frame width, must be a multiple of 2*scale.
+	 * @param height Frame height, must be a multiple of 2*scale.
+	 * @param stride Distance in bytes between two rows of both planes.
+	 * @param rgba Output image, (width/scale)x(height/scale) pixels with 4 channels.
+	 * @param scale Downscaling factor (1, 2 or 4).
+	 * @param nbrThreads Number of threads, 0 to use all available.
+	 * @return True if successful.
+	 */
+	static bool convertNV21(const uchar* y, const uchar* vu, size_t width, size_t height, size_t stride, uchar* rgba, size_t scale = 1, size_t nbrThreads = 0);
+
+	/*
+	 * Converts a NV21 frame to RGBA32F, the channels are the 8-bit values divided by 255.
+	 * @param y Pointer to the luma plane.
+	 * @param vu Pointer to the interleaved chroma plane (V first).
+	 * @param width Frame width, must be a multiple of 2*scale.
+	 * @param height Frame height, must be a multiple of 2*scale.
+	 * @param stride Distance in bytes between two rows of both planes.
+	 * @param rgba Output image, (width/scale)x(height/scale) pixels with 4 channels.
+	 * @param scale Downscaling factor (1, 2 or 4).
+	 * @param nbrThreads Number of threads, 0 to use all available.
+	 * @return True if successful.
+	 */
+	static bool convertNV21(const uchar* y, const uchar* vu, size_t width, size_t height, size_t stride, float* rgba, size_t scale = 1, size_t nbrThreads = 0);
+
+	/*
+	 * Encodes a RGBA8 image as NV21 with the inverse of the conversion above, the chroma is averaged over 2x2 pixels.
+	 * @param rgba Input image with 4 channels.
+	 * @param width Image width, must be a multiple of 2.
+	 * @param height Image height, must be a multiple of 2.
+	 * @param y Output luma plane, width*height bytes.
+	 * @param vu Output interleaved chroma plane (V first), width*height/2 bytes.
+	 * @param nbrThreads Number of threads, 0 to use all available.
+	 * @return True if successful.
+	 */
+	static bool convertToNV21(const uchar* rgba, size_t width, size_t height, uchar* y, uchar* vu, size_t nbrThreads = 0);
+
+private:
+	/*
+	 * YUVConverter constructor disabled.
+	 */
+	YUVConverter() {}
+};
+
+} }
+
+#endif
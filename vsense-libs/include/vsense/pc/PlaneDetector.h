@@ -0,0 +1,203 @@
+#ifndef VSENSE_PC_PLANEDETECTOR_H_
+#define VSENSE_PC_PLANEDETECTOR_H_
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+namespace vsense { namespace pc {
+
+class PointCloud;
+
+/*
+ * Plane found in a point cloud. Points satisfy dot(normal, p) + distance = 0.
+ */
+struct Plane {
+	glm::vec3 normal;              /*!< Unit normal of the plane. */
+	float     distance;            /*!< Signed distance from the origin. */
+	glm::vec3 centroid;            /*!< Centroid of the inliers. */
+	float     rmsError;            /*!< Root mean square distance of the inliers to the plane. */
+	std::vector<uint32_t> inliers; /*!< Indices of the inliers. */
+
+	/*
+	 * Plane constructor.
+	 */
+	Plane() : normal(0.f, 1.f, 0.f), distance(0.f), centroid(0.f, 0.f, 0.f), rmsError(0.f) {}
+
+	/*
+	 * Calculates the signed distance from a point to the plane.
+	 * @param pt Point.
+	 * @return Signed distance.
+	 */
+	float signedDistance(const glm::vec3& pt) const { return glm::dot(normal, pt) + distance; }
+};
+
+/*
+ * The PlaneDetector class implements the detection of planes in point clouds using preemptive RANSAC.
+ * Hypotheses are generated in rounds processed in parallel. Within a round, hypotheses are scored over blocks of points
+ * and only the best half survives each block. The best hypothesis is refined by local optimization (least squares over its inliers) and the number of
+ * rounds adapts to the inlier ratio found so far. Several planes are found by removing the inliers of the previous ones.
+ */
+class PlaneDetector {
+public:
+	/*
+	 * PlaneDetector constructor.
+	 * @param threshold Maximum distance from a point to a plane to be considered inlier.
+	 * @param timeBudget Maximum time in ms spent in a detection, 0 for no limit.
+	 */
+	PlaneDetector(float threshold = 0.02f, float timeBudget = 30.f);
+
+	/*
+	 * Updates the inlier threshold.
+	 * @param threshold Maximum distance from a point to a plane to be considered inlier.
+	 */
+	void setThreshold(float threshold) { threshold_ = threshold; }
+
+	/*
+	 * Updates the time budget.
+	 * @param timeBudget Maximum time in ms spent in a detection, 0 for no limit.
+	 */
+	void setTimeBudget(float timeBudget) { timeBudget_ = timeBudget; }
+
+	/*
+	 * Updates the confidence used to terminate the search.
+	 * @param confidence Probability of having drawn at least one sample free of outliers.
+	 */
+	void setConfidence(float confidence) { confidence_ = confidence; }
+
+	/*
+	 * Updates the maximum number of hypotheses generated per plane.
+	 * @param maxHypotheses Maximum number of hypotheses.
+	 */
+	void setMaxHypotheses(size_t maxHypotheses) { maxHypotheses_ = maxHypotheses; }
+
+	/*
+	 * Updates the maximum number of planes found in a detection.
+	 * @param maxPlanes Maximum number of planes.
+	 */
+	void setMaxPlanes(size_t maxPlanes) { maxPlanes_ = maxPlanes; }
+
+	/*
+	 * Updates the minimum number of inliers for a plane to be accepted.
+	 * @param minInliers Minimum number of inliers.
+	 */
+	void setMinInliers(size_t minInliers) { minInliers_ = minInliers; }
+
+	/*
+	 * Updates the number of threads used to score the hypotheses.
+	 * @param nbrThreads Number of threads, 0 to use all available.
+	 */
+	void setNbrThreads(size_t nbrThreads) { nbrThreads_ = nbrThreads; }
+
+	/*
+	 * Updates the seed of the random generator, detections with the same seed and input are repeatable.
+	 * @param seed Seed.
+	 */
+	void setSeed(uint32_t seed) { seed_ = seed; }
+
+	/*
+	 * Detects planes in a set of points.
+	 * @param points Pointer to the positions.
+	 * @param nbrPoints Number of points.
+	 * @param planes Planes found, sorted by number of inliers.
+	 * @return Number of planes found.
+	 */
+	size_t detect(const glm::vec3* points, size_t nbrPoints, std::vector<Plane>& planes);
+
+	/*
+	 * Detects planes in a point cloud.
+	 * @param pc Point cloud.
+	 * @param planes Planes found, sorted by number of inliers.
+	 * @return Number of planes found.
+	 */
+	size_t detect(const PointCloud& pc, std::vector<Plane>& planes);
+
+	/*
+	 * Detects the plane hit first by a ray. Only the points within the support radius of the ray are sampled and only
+	 * planes with inliers close to the intersection are considered.
+	 * @param points Pointer to the positions.
+	 * @param nbrPoints Number of points.
+	 * @param origin Origin of the ray.
+	 * @param direction Direction of the ray.
+	 * @param supportRadius Maximum distance from the ray to the points sampled and from the intersection to the closest inlier.
+	 * @param plane Plane found, its normal faces the ray's origin.
+	 * @param intersection Intersection between the ray and the plane.
+	 * @return True if a plane was found.
+	 */
+	bool detectAlongRay(const glm::vec3* points, size_t nbrPoints, const glm::vec3& origin, const glm::vec3& direction, float supportRadius, Plane& plane, glm::vec3& intersection);
+
+	/*
+	 * Retrieves the time spent in the last detection.
+	 * @return Time in ms.
+	 */
+	float getLastDetectionTime() const { return lastDetectionTime_; }
+
+	/*
+	 * Retrieves the number of hypotheses generated in the last detection.
+	 * @return Number of hypotheses.
+	 */
+	size_t getLastNbrHypotheses() const { return lastNbrHypotheses_; }
+
+private:
+	/*
+	 * Detects planes among a subset of points, the start time of the detection must be set.
+	 * @param points Pointer to the positions.
+	 * @param candidates Sorted indices of the points that can be used, the inliers of the planes found are removed.
+	 * @param planes Planes found, sorted by number of inliers.
+	 * @return Number of planes found.
+	 */
+	size_t detectAmong(const glm::vec3* points, std::vector<uint32_t>& candidates, std::vector<Plane>& planes);
+
+	/*
+	 * Finds the best plane among a subset of points.
+	 * @param points Pointer to the positions.
+	 * @param candidates Indices of the points that can be used.
+	 * @param deadline Time (ms since the start of the detection) when the search must stop, 0 for no limit.
+	 * @param seed Seed used to generate the hypotheses.
+	 * @param plane Plane found.
+	 * @return True if a plane with enough inliers was found.
+	 */
+	bool findPlane(const glm::vec3* points, const std::vector<uint32_t>& candidates, float deadline, uint32_t seed, Plane& plane);
+
+	/*
+	 * Refines a plane with a least squares fit over its inliers.
+	 * @param points Pointer to the positions.
+	 * @param indices Indices of the points to consider.
+	 * @param plane Plane to refine, the inliers are updated.
+	 * @return True if the fit succeeded.
+	 */
+	bool refinePlane(const glm::vec3* points, const std::vector<uint32_t>& indices, Plane& plane) const;
+
+	/*
+	 * Counts the inliers of a plane.
+	 * @param points Pointer to the positions.
+	 * @param indices Indices of the points to consider.
+	 * @param plane Plane.
+	 * @return Number of inliers.
+	 */
+	size_t countInliers(const glm::vec3* points, const std::vector<uint32_t>& indices, const Plane& plane) const;
+
+	/*
+	 * Retrieves the time since the start of the detection.
+	 * @return Time in ms.
+	 */
+	float elapsed() const;
+
+	float    threshold_;     /*!< Inlier threshold. */
+	float    timeBudget_;    /*!< Maximum time per detection (ms), 0 for no limit. */
+	float    confidence_;    /*!< Confidence used for the adaptive termination. */
+	size_t   maxHypotheses_; /*!< Maximum number of hypotheses per plane. */
+	size_t   maxPlanes_;     /*!< Maximum number of planes per detection. */
+	size_t   minInliers_;    /*!< Minimum number of inliers per plane. */
+	size_t   nbrThreads_;    /*!< Number of threads used, 0 for all available. */
+	uint32_t seed_;          /*!< Seed of the random generator. */
+
+	double startTime_;         /*!< Start time of the current detection (ms). */
+	float  lastDetectionTime_; /*!< Duration of the last detection (ms). */
+	size_t lastNbrHypotheses_; /*!< Number of hypotheses generated in the last detection. */
+};
+
+} }
+
+#endif
@@ -6,6 +6,8 @@
 #include <glm/glm.hpp>
 
 #include <algorithm>
+#include <cfloat>
+#include <string>
 #include <vector>
 
 namespace vsense { namespace pc {
@@ -29,6 +31,7 @@ struct Point {
 		this->pos = glm::vec3(0.f, 0.f, 0.f);
 		this->color = glm::vec3(1.f, 1.f, 1.f);		
 		this->flags = UnknownPoint;
+		this->confidence = 1.f;
 	}
 
 	/*
@@ -36,16 +39,19 @@ struct Point {
 	 * @param pos Point position.
 	 * @param color RGB color for the point.
 	 * @param flags Flags related to the point.
+	 * @param confidence Confidence of the measurement (0.f-1.f).
 	 */
-	Point(const glm::vec3& pos, const glm::vec3& color, uchar flags = 0) {
+	Point(const glm::vec3& pos, const glm::vec3& color, uchar flags = 0, float confidence = 1.f) {
 		this->pos = pos;
 		this->color = color;		
 		this->flags = flags;
+		this->confidence = confidence;
 	}
 
-	glm::vec3       pos;     /*!< Position of the point. */
-	glm::vec3       color;   /*!< Color of the point (linearized).*/
-	uchar           flags;   /*!< Flags for the point. */
+	glm::vec3       pos;        /*!< Position of the point. */
+	glm::vec3       color;      /*!< Color of the point (linearized).*/
+	uchar           flags;      /*!< Flags for the point. */
+	float           confidence; /*!< Confidence of the measurement (0.f-1.f). */
 };
 
 /*
@@ -111,6 +117,12 @@ public:
 	 */
 	void resize(size_t size);	
 
+	/*
+	 * Reserves memory for a number of points without changing the size of the point cloud.
+	 * @param size Number of points.
+	 */
+	void reserve(size_t size);
+
 	/*
 	 * Retrieves a point at a given index location.
 	 * @param idx Index of the point to retrieve.
@@ -124,21 +136,51 @@ public:
 	 */
 	void addPoint(const Point& pt);
 
+	/*
+	 * Adds a collection of points to the point cloud, memory is reserved once for all of them.
+	 * @param pts Pointer to the first point to add.
+	 * @param nbrPts Number of points to add.
+	 */
+	void addPoints(const Point* pts, size_t nbrPts);
+
+	/*
+	 * Adds the points of another point cloud.
+	 * @param pc Point cloud whose points are to be added.
+	 */
+	void addPoints(const PointCloud& pc);
+
+	/*
+	 * Adds a collection of points stored as separate arrays, memory is reserved once for all of them.
+	 * @param pos Pointer to the first position.
+	 * @param col Pointer to the first color, if null the points are white.
+	 * @param flags Pointer to the first flags value, if null the points are flagged as unknown.
+	 * @param conf Pointer to the first confidence value, if null the confidence is 1.
+	 * @param nbrPts Number of points to add.
+	 */
+	void addPoints(const glm::vec3* pos, const glm::vec4* col, const uchar* flags, const float* conf, size_t nbrPts);
+
 #ifdef _WINDOWS
   void loadFromFile(const std::string& pcFilename, const std::string& imFilename);
+#endif
 
 	/*
 	 * Transforms the point cloud using the given transformation and stores it within another point cloud object.
+	 * The bounding box of the resulting point cloud is calculated in the same pass.
 	 * @param pose Transformation to use on the point cloud.
 	 * @param pcOut Resulting point cloud after applying the transformation.
 	 */
 	void transformPointCloud(const glm::mat4& pose, PointCloud& pcOut);
 
+	/*
+	 * Transforms the point cloud in place, the bounding box is updated in the same pass.
+	 * @param pose Transformation to use on the point cloud.
+	 */
+	void transform(const glm::mat4& pose);
+
 	/*
 	 * Recalculated the limits of the bounding box based on the point cloud's content.
 	 */
 	void recalculateBoundingBox();
-#endif
 
 	/*
 	 * Retrieves the bounding box.
@@ -165,6 +207,7 @@ public:
 		pos_.clear();
 		col_.clear();
 		flag_.clear();
+		conf_.clear();
 
 		bb_ = BoundingBox();
 	}
@@ -181,12 +224,29 @@ public:
 	 */
 	const glm::vec4* getColorsPtr() const;
 
+	/*
+	 * Retrieves the pointer to the first element in the flags vector.
+	 * @return Pointer to the first element in the flags vector.
+	 */
+	const uchar* getFlagsPtr() const;
+
+	/*
+	 * Retrieves the pointer to the first element in the confidence vector.
+	 * @return Pointer to the first element in the confidence vector.
+	 */
+	const float* getConfidencePtr() const;
+
+	/*
+	 * Saves the point cloud as a text file, one point per line with its position and 8-bit color.
+	 * @param filename Filename of the file to write.
+	 */
 	void saveToXYZFile(const std::string& filename);
 
 private:
 	std::vector<glm::vec3> pos_;     /*!< Positions of the branch's nodes. */
 	std::vector<glm::vec4> col_;     /*!< Colors of the branch's nodes. */
 	std::vector<uchar>     flag_;    /*!< Flags of the branch's nodes. */
+	std::vector<float>     conf_;    /*!< Confidence of the branch's nodes. */
 	glm::vec3              devPos_;  /*!< Position of the device. */
 
 	short                  frameID_; /*!< Point cloud frame ID. */
@@ -0,0 +1,56 @@
+#ifndef VSENSE_PC_POINTTRANSFORM_H_
+#define VSENSE_PC_POINTTRANSFORM_H_
+
+#include <glm/glm.hpp>
+
+namespace vsense { namespace pc {
+
+struct BoundingBox;
+
+/*
+ * The PointTransform class implements the rigid transformation of packed position arrays. The bounding box of the
+ * transformed positions is computed in the same pass, four points are processed at once using SSE2 or NEON.
+ */
+class PointTransform {
+public:
+	/*
+	 * Transforms a set of positions, the input and output can be the same array (in-place).
+	 * @param pose Transformation to apply.
+	 * @param in Pointer to the input positions.
+	 * @param out Pointer to the output positions.
+	 * @param nbrPts Number of positions.
+	 * @param bb Bounding box of the transformed positions, ignored if nullptr.
+	 */
+	static void transform(const glm::mat4& pose, const glm::vec3* in, glm::vec3* out, size_t nbrPts, BoundingBox* bb = nullptr);
+
+	/*
+	 * Transforms a set of positions splitting the work over several threads, the input and output can be the same array.
+	 * @param pose Transformation to apply.
+	 * @param in Pointer to the input positions.
+	 * @param out Pointer to the output positions.
+	 * @param nbrPts Number of positions.
+	 * @param bb Bounding box of the transformed positions, ignored if nullptr.
+	 * @param nbrThreads Number of threads, 0 to use all available.
+	 */
+	static void transformParallel(const glm::mat4& pose, const glm::vec3* in, glm::vec3* out, size_t nbrPts, BoundingBox* bb = nullptr, size_t nbrThreads = 0);
+
+	/*
+	 * Calculates the bounding box of a set of positions.
+	 * @param in Pointer to the positions.
+	 * @param nbrPts Number of positions.
+	 * @param bb Resulting bounding box, invalid if there are no positions.
+	 */
+	static void bound(const glm::vec3* in, size_t nbrPts, BoundingBox& bb);
+
+	static const size_t ParallelThreshold = 262144; /*!< Number of points from which splitting the work pays off. */
+
+private:
+	/*
+	 * PointTransform constructor.
+	 */
+	PointTransform() {}
+};
+
+} }
+
+#endif
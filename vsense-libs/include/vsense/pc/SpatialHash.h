@@ -0,0 +1,96 @@
+#ifndef VSENSE_PC_SPATIALHASH_H_
+#define VSENSE_PC_SPATIALHASH_H_
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+namespace vsense { namespace pc {
+
+class PointCloud;
+
+/*
+ * The SpatialHash class implements a neighborhood index for point clouds. Points are bucketed in cubic cells and
+ * the occupied cells are stored in an open-addressing hash table.
+ */
+class SpatialHash {
+public:
+	/*
+	 * SpatialHash constructor.
+	 * @param cellSize Size of the cells' side, ideally close to the typical search radius.
+	 */
+	SpatialHash(float cellSize = 0.05f);
+
+	/*
+	 * Builds the index for a point cloud. The positions are copied, so the point cloud can be modified afterwards.
+	 * @param pc Point cloud to index.
+	 * @return True if successful.
+	 */
+	bool build(const PointCloud& pc);
+
+	/*
+	 * Finds all points within a given distance.
+	 * @param pt Query position.
+	 * @param radius Search radius.
+	 * @param indices Indices of the points found (point cloud order).
+	 * @param sqDistances Squared distances of the points found.
+	 * @return Number of points found.
+	 */
+	size_t radiusSearch(const glm::vec3& pt, float radius, std::vector<size_t>& indices, std::vector<float>& sqDistances) const;
+
+	/*
+	 * Finds the closest points to a given position.
+	 * @param pt Query position.
+	 * @param k Number of points to find.
+	 * @param indices Indices of the points found, sorted by distance (point cloud order).
+	 * @param sqDistances Squared distances of the points found.
+	 * @return Number of points found (less than k only if the index holds less points).
+	 */
+	size_t knnSearch(const glm::vec3& pt, size_t k, std::vector<size_t>& indices, std::vector<float>& sqDistances) const;
+
+	/*
+	 * Retrieves the number of indexed points.
+	 * @return Number of points.
+	 */
+	size_t size() const { return pos_.size(); }
+
+	/*
+	 * Retrieves the number of occupied cells.
+	 * @return Number of cells.
+	 */
+	size_t nbrCells() const { return cellKeys_.size(); }
+
+private:
+	/*
+	 * Retrieves the index of an occupied cell.
+	 * @param cell Cell coordinates.
+	 * @return Index of the cell, -1 if the cell is empty.
+	 */
+	int64_t findCell(const glm::ivec3& cell) const;
+
+	/*
+	 * Checks the points inside a cell and keeps the closest ones.
+	 * @param cellIdx Index of the cell.
+	 * @param pt Query position.
+	 * @param k Number of points to keep.
+	 * @param heap Max-heap with the closest points found so far (squared distance, position index).
+	 */
+	void collectNearest(size_t cellIdx, const glm::vec3& pt, size_t k, std::vector<std::pair<float, uint32_t> >& heap) const;
+
+	float cellSize_;         /*!< Size of the cells' side. */
+	glm::vec3 origin_;       /*!< Position of the corner of cell (0, 0, 0). */
+	glm::ivec3 maxCell_;     /*!< Largest cell coordinates. */
+
+	std::vector<uint64_t> cellKeys_;  /*!< Keys of the occupied cells. */
+	std::vector<uint32_t> cellStart_; /*!< First point of every cell, the last entry is the number of points. */
+	std::vector<uint32_t> table_;     /*!< Hash table mapping keys to cell indices. */
+	uint64_t tableMask_;              /*!< Mask applied to the hashed keys. */
+
+	std::vector<glm::vec3> pos_;      /*!< Point positions sorted by cell. */
+	std::vector<uint32_t>  idx_;      /*!< Original index of every sorted point. */
+};
+
+} }
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef VSENSE_PC_VOXELGRID_H_
+#define VSENSE_PC_VOXELGRID_H_
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+
+namespace vsense { namespace pc {
+
+class PointCloud;
+
+/*
+ * The VoxelGrid class implements the downsampling of point clouds using a regular grid.
+ * All points falling within a voxel are replaced by a single point.
+ */
+class VoxelGrid {
+public:
+	/*
+	 * Downsamples a point cloud. The position and confidence of the new points are the averages of the points in each
+	 * voxel, the color is averaged using the confidence as weight and the flags are taken from the most confident point.
+	 * @param pcIn Point cloud to downsample.
+	 * @param pcOut Resulting point cloud, its previous content is discarded.
+	 * @param voxelSize Size of the voxels' side.
+	 * @return True if successful.
+	 */
+	static bool downsample(const PointCloud& pcIn, PointCloud& pcOut, float voxelSize);
+
+	/*
+	 * Packs the coordinates of a cell into a single key.
+	 * @param x Coordinate along the X axis (0 to MaxCoord).
+	 * @param y Coordinate along the Y axis (0 to MaxCoord).
+	 * @param z Coordinate along the Z axis (0 to MaxCoord).
+	 * @return Key for the cell.
+	 */
+	static uint64_t cellKey(uint32_t x, uint32_t y, uint32_t z) { return ((uint64_t)x << 42) | ((uint64_t)y << 21) | (uint64_t)z; }
+
+	static const uint32_t MaxCoord = (1 << 21) - 1; /*!< Maximum cell coordinate along any axis. */
+
+private:
+	/*
+	 * VoxelGrid constructor.
+	 */
+	VoxelGrid() {}
+};
+
+} }
+
+#endif
@@ -0,0 +1,96 @@
+#ifndef VSENSE_SH_BANDLIMIT_H_
+#define VSENSE_SH_BANDLIMIT_H_
+
+#include <vsense/sh/SphericalHarmonics.h>
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <vector>
+
+namespace vsense { namespace sh {
+
+const int MinSHOrder = 1; /*!< Lowest SH order used to render. */
+const int MaxSHOrder = 9; /*!< Highest SH order computed and stored. */
+
+/*
+ * Error of a band-limited evaluation with respect to the highest order available.
+ */
+struct OrderError {
+	OrderError() : order(0), rmse(0.f), relativeError(0.f) {}
+
+	int   order;         /*!< SH order. */
+	float rmse;          /*!< Root-mean-square error. */
+	float relativeError; /*!< RMSE divided by the RMS value of the reference. */
+};
+
+/*
+ * The BandLimit class is the CPU reference of the band-limited SH evaluation done by the renderers, where only the
+ * coefficients of the bands up to the selected order are used. It provides the per-order error figures used to tune
+ * the SH order without a GPU.
+ */
+class BandLimit {
+public:
+	/*
+	 * Retrieves the number of coefficients up to an order.
+	 * @param order SH order.
+	 * @return Number of coefficients.
+	 */
+	static int getNbrCoefficients(int order) { return (order + 1)*(order + 1); }
+
+	/*
+	 * Retrieves the order of a number of coefficients, the highest one with all its bands available.
+	 * @param nbrCoeffs Number of coefficients.
+	 * @return SH order, -1 if there are no coefficients.
+	 */
+	static int getOrder(int nbrCoeffs);
+
+	/*
+	 * Clamps an order to the supported range.
+	 * @param order SH order.
+	 * @return Order between MinSHOrder and MaxSHOrder.
+	 */
+	static int clampOrder(int order);
+
+	/*
+	 * Evaluates the diffuse lighting of a vertex, as done by shmeshDot.vert.
+	 * @param order SH order.
+	 * @param transfer Transfer (self-occlusion) coefficients of the vertex.
+	 * @param ambient Ambient coefficients.
+	 * @return Diffuse lighting.
+	 */
+	static glm::vec3 evalDiffuse(int order, const float* transfer, const glm::vec3* ambient);
+
+	/*
+	 * Calculates the error of the diffuse lighting of every order with respect to the highest order available.
+	 * @param transfer Transfer coefficients of every vertex.
+	 * @param nbrVertices Number of vertices.
+	 * @param vertexCoeffs Number of transfer coefficients per vertex.
+	 * @param ambient Ambient coefficients.
+	 * @param ambientCoeffs Number of ambient coefficients.
+	 * @param errors Error of every order from MinSHOrder.
+	 */
+	static void computeDiffuseErrors(const float* transfer, size_t nbrVertices, int vertexCoeffs, const glm::vec3* ambient, int ambientCoeffs,
+		std::vector<OrderError>& errors);
+
+	/*
+	 * Calculates the error of the environment reconstructed with every order with respect to the highest order
+	 * available, over a regular grid of directions weighted by their solid angle.
+	 * @param coeffs Environment coefficients.
+	 * @param gridWidth Number of directions along phi, half of them along theta.
+	 * @param errors Error of every order from MinSHOrder.
+	 */
+	static void computeEnvironmentErrors(const SHCoefficients3& coeffs, int gridWidth, std::vector<OrderError>& errors);
+
+	/*
+	 * Selects the lowest order within an error budget.
+	 * @param errors Error of every order, sorted by order.
+	 * @param maxRelativeError Maximum relative error.
+	 * @return Selected order, the highest one if none is within the budget.
+	 */
+	static int selectOrder(const std::vector<OrderError>& errors, float maxRelativeError);
+};
+
+} }
+
+#endif
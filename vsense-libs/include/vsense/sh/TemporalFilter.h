@@ -0,0 +1,162 @@
+#ifndef VSENSE_SH_TEMPORALFILTER_H_
+#define VSENSE_SH_TEMPORALFILTER_H_
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <vector>
+
+namespace vsense { namespace sh {
+
+/*
+ * Filters applied to the successive SH coefficient sets.
+ */
+enum TemporalFilterMode {
+	FilterNone = 0,    /*!< The coefficients are used as calculated. */
+	FilterExponential, /*!< Exponential moving average. */
+	FilterOneEuro      /*!< One Euro filter, the cutoff frequency increases with the speed of the coefficients. */
+};
+
+/*
+ * Parameters of the temporal filter.
+ */
+struct TemporalFilterParams {
+	TemporalFilterParams() : mode(FilterOneEuro), alpha(0.3f), minCutoff(1.f), beta(0.5f), derivativeCutoff(1.f), changeThreshold(0.01f),
+		wakeThreshold(0.04f), staticUpdates(30), staticInterval(15) {}
+
+	TemporalFilterMode mode;             /*!< Filter applied to the coefficients. */
+	float              alpha;            /*!< Smoothing factor of the exponential filter, 1 to disable smoothing. */
+	float              minCutoff;        /*!< Minimum cutoff frequency of the One Euro filter (Hz). */
+	float              beta;             /*!< Increase of the cutoff frequency with the speed of the coefficients. */
+	float              derivativeCutoff; /*!< Cutoff frequency of the speed of the coefficients (Hz). */
+	float              changeThreshold;  /*!< Change from the published set below which a filtered set is not published. */
+	float              wakeThreshold;    /*!< Change between a calculated set and the filtered one leaving the static state. */
+	int                staticUpdates;    /*!< Consecutive filtered sets moving less than the change threshold entering the static state. */
+	int                staticInterval;   /*!< Frames between two re-projections of the SH coefficients while static. */
+	std::vector<float> bandWeights;      /*!< Weight of every band in the change, 1 for the bands not given. */
+};
+
+/*
+ * Counters of the temporal filter.
+ */
+struct TemporalFilterStats {
+	TemporalFilterStats() : nbrUpdates(0), nbrPublished(0), nbrFrames(0), nbrReprojections(0), maxSkippedChange(0.f) {}
+
+	size_t nbrUpdates;       /*!< Number of coefficient sets filtered. */
+	size_t nbrPublished;     /*!< Number of filtered sets published. */
+	size_t nbrFrames;        /*!< Number of frames asking for a re-projection. */
+	size_t nbrReprojections; /*!< Number of re-projections allowed. */
+	float  maxSkippedChange; /*!< Largest change between a skipped set and the published one. */
+};
+
+/*
+ * The TemporalFilter class smooths the SH coefficients of the environment calculated over time and decides when they
+ * changed enough to be uploaded and used to render. The change between two sets is their L2 distance with the bands
+ * weighted: sqrt(sum_l w_l sum_m |a_lm - b_lm|^2), RGB channels included. With unit weights, the lighting of a vertex
+ * with transfer coefficients T differs by at most |T|*change from the lighting with the published set, so the
+ * threshold bounds the error of every skipped set. The static state works as a hysteresis: it is entered after a
+ * number of consecutive filtered sets moving less than the change threshold and left once a calculated set departs
+ * from the filtered one by more than the wake threshold, in between the SH coefficients are re-projected at a
+ * reduced rate.
+ */
+class TemporalFilter {
+public:
+	/*
+	 * TemporalFilter constructor.
+	 * @param params Parameters.
+	 * @param nbrCoeffs Number of coefficients per set.
+	 */
+	TemporalFilter(const TemporalFilterParams& params, int nbrCoeffs);
+
+	/*
+	 * Filters a new set of coefficients.
+	 * @param coeffs Calculated coefficients (RGB, the fourth component is kept as is).
+	 * @param timestamp Time of the set in seconds.
+	 * @return True if the filtered set is published, false if it's too close to the published one.
+	 */
+	bool update(const glm::vec4* coeffs, double timestamp);
+
+	/*
+	 * Checks if the SH coefficients are to be re-projected this frame, counting the frames while static.
+	 * @return True if the coefficients are to be re-projected.
+	 */
+	bool needsReprojection();
+
+	/*
+	 * Restarts the filter and clears its counters, the next set is published as calculated.
+	 */
+	void reset();
+
+	/*
+	 * Retrieves the published coefficients, the ones to render with.
+	 * @return Published coefficients.
+	 */
+	const std::vector<glm::vec4>& getPublished() const { return published_; }
+
+	/*
+	 * Retrieves the last filtered coefficients.
+	 * @return Filtered coefficients.
+	 */
+	const std::vector<glm::vec4>& getFiltered() const { return filtered_; }
+
+	/*
+	 * Retrieves the change between the last filtered set and the published one when it was filtered.
+	 * @return Change.
+	 */
+	float getLastChange() const { return lastChange_; }
+
+	/*
+	 * Checks if the coefficients are considered static.
+	 * @return True if static.
+	 */
+	bool isStatic() const { return static_; }
+
+	/*
+	 * Retrieves the counters.
+	 * @return Counters.
+	 */
+	const TemporalFilterStats& getStats() const { return stats_; }
+
+	/*
+	 * Retrieves the fraction of the filtered sets not published.
+	 * @return Fraction of skipped sets.
+	 */
+	float getSkippedFraction() const;
+
+	/*
+	 * Calculates the weighted change between two coefficient sets.
+	 * @param a First set.
+	 * @param b Second set.
+	 * @param nbrCoeffs Number of coefficients.
+	 * @param bandWeights Weight of every band, 1 for the bands not given.
+	 * @return Change.
+	 */
+	static float distance(const glm::vec4* a, const glm::vec4* b, int nbrCoeffs, const std::vector<float>& bandWeights);
+
+private:
+	/*
+	 * Calculates the smoothing factor of a low-pass filter.
+	 * @param cutoff Cutoff frequency (Hz).
+	 * @param dt Time since the previous set (s).
+	 * @return Smoothing factor.
+	 */
+	static float smoothingFactor(float cutoff, float dt);
+
+	TemporalFilterParams   params_;      /*!< Parameters. */
+	int                    nbrCoeffs_;   /*!< Number of coefficients per set. */
+	std::vector<glm::vec4> filtered_;    /*!< Last filtered set. */
+	std::vector<glm::vec4> previous_;    /*!< Filtered set before the last one. */
+	std::vector<glm::vec4> speed_;       /*!< Filtered speed of the coefficients (One Euro). */
+	std::vector<glm::vec4> published_;   /*!< Published set. */
+	double                 lastTime_;    /*!< Time of the last set. */
+	bool                   hasSet_;      /*!< True once a set was filtered. */
+	float                  lastChange_;  /*!< Change of the last filtered set from the published one. */
+	bool                   static_;      /*!< True if the coefficients are static. */
+	int                    quietSets_;   /*!< Consecutive filtered sets below the change threshold. */
+	int                    quietFrames_; /*!< Frames since the last re-projection while static. */
+	TemporalFilterStats    stats_;       /*!< Counters. */
+};
+
+} }
+
+#endif
@@ -0,0 +1,108 @@
+#ifndef VSENSE_SH_TRANSFEREVALUATOR_H_
+#define VSENSE_SH_TRANSFEREVALUATOR_H_
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <vector>
+
+namespace vsense { namespace sh {
+
+/*
+ * The TransferEvaluator class evaluates the diffuse lighting of the vertices on the CPU: the dot product of their SH
+ * transfer coefficients with the environment coefficients, done by shmeshDot.vert and shmeshPlaneDot.vert otherwise.
+ * The transfer coefficients are stored by groups of four vertices, coefficient-major within a group, so the products
+ * of four vertices are calculated at once using SSE2 or NEON. The lighting is only evaluated again when the transfer
+ * coefficients, the environment coefficients or the order change.
+ */
+class TransferEvaluator {
+public:
+	/*
+	 * TransferEvaluator constructor.
+	 */
+	TransferEvaluator();
+
+	/*
+	 * Updates the transfer coefficients of the vertices.
+	 * @param coeffs Coefficients of every vertex, one after the other.
+	 * @param nbrVertices Number of vertices.
+	 * @param coeffNbr Number of coefficients per vertex.
+	 */
+	void setTransfer(const float* coeffs, size_t nbrVertices, int coeffNbr);
+
+	/*
+	 * Updates the environment coefficients.
+	 * @param coeffs Environment coefficients (RGB, the fourth component is ignored).
+	 * @param nbrCoeffs Number of coefficients.
+	 */
+	void setEnvironment(const glm::vec4* coeffs, int nbrCoeffs);
+
+	/*
+	 * Updates the SH order evaluated, clamped to the coefficients available.
+	 * @param order SH order.
+	 */
+	void setOrder(int order);
+
+	/*
+	 * Evaluates the lighting if anything changed since the last evaluation.
+	 * @param nbrThreads Number of threads, 0 to use all available.
+	 * @return True if the lighting was evaluated.
+	 */
+	bool update(size_t nbrThreads = 0);
+
+	/*
+	 * Evaluates the lighting of every vertex.
+	 * @param nbrThreads Number of threads, 0 to use all available.
+	 */
+	void evaluate(size_t nbrThreads = 0);
+
+	/*
+	 * Retrieves the lighting of the vertices of the last evaluation.
+	 * @return Lighting (RGB) of every vertex.
+	 */
+	const std::vector<glm::vec3>& getLighting() const { return lighting_; }
+
+	/*
+	 * Retrieves the number of coefficients evaluated per vertex.
+	 * @return Number of coefficients.
+	 */
+	int getNbrEvaluatedCoefficients() const;
+
+	/*
+	 * Retrieves the number of evaluations done.
+	 * @return Number of evaluations.
+	 */
+	size_t getNbrEvaluations() const { return nbrEvaluations_; }
+
+	/*
+	 * Calculates the dot product of a set of transfer coefficients with the environment coefficients.
+	 * @param transfer Transfer coefficients.
+	 * @param env Environment coefficients.
+	 * @param nbrCoeffs Number of coefficients.
+	 * @return Lighting (RGB).
+	 */
+	static glm::vec3 dot(const float* transfer, const glm::vec4* env, int nbrCoeffs);
+
+	static const size_t VerticesPerJob = 4096; /*!< Number of vertices evaluated per job, multiple of the SIMD width. */
+
+private:
+	/*
+	 * Evaluates the lighting of a range of vertices.
+	 * @param firstGroup First group of four vertices.
+	 * @param nbrGroups Number of groups.
+	 */
+	void evaluateGroups(size_t firstGroup, size_t nbrGroups);
+
+	std::vector<float>     transfer_;       /*!< Transfer coefficients, by groups of four vertices. */
+	std::vector<float>     env_;            /*!< Environment coefficients, three consecutive channels per coefficient. */
+	std::vector<glm::vec3> lighting_;       /*!< Lighting of every vertex. */
+	size_t                 nbrVertices_;    /*!< Number of vertices. */
+	int                    coeffNbr_;       /*!< Number of transfer coefficients per vertex. */
+	int                    order_;          /*!< SH order evaluated, -1 for every coefficient available. */
+	bool                   dirty_;          /*!< True if the lighting has to be evaluated again. */
+	size_t                 nbrEvaluations_; /*!< Number of evaluations done. */
+};
+
+} }
+
+#endif
@@ -0,0 +1,133 @@
+#ifndef VSENSE_SH_TRANSFERPACKER_H_
+#define VSENSE_SH_TRANSFERPACKER_H_
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace vsense { namespace sh {
+
+/*
+ * Storage of the SH transfer coefficients of the vertices in the texture read by the vertex shaders.
+ */
+enum TransferQuantization {
+	TransferFloat = 0,  /*!< RGBA32F, one coefficient per component. */
+	Transfer8Bit = 8,   /*!< RGBA8UI, 8-bit coefficients and a per-vertex scale. */
+	Transfer16Bit = 16  /*!< RGBA16UI, 16-bit coefficients and a per-vertex scale. */
+};
+
+/*
+ * Texture memory and lighting error of a quantization.
+ */
+struct TransferPackingStats {
+	TransferPackingStats() : sizeBytes(0), floatSizeBytes(0), maxCoeffError(0.f), lightingRmse(0.f), relativeLightingError(0.f) {}
+
+	size_t sizeBytes;             /*!< Size of the packed texture. */
+	size_t floatSizeBytes;        /*!< Size of the texture with single-precision coefficients. */
+	float  maxCoeffError;         /*!< Maximum absolute error of a coefficient. */
+	float  lightingRmse;          /*!< RMSE of the diffuse lighting of the vertices. */
+	float  relativeLightingError; /*!< Lighting RMSE divided by the RMS lighting. */
+};
+
+/*
+ * The TransferPacker class quantizes the SH transfer coefficients of the vertices as unpacked by shmeshDot.vert and
+ * shmeshPlaneDot.vert (SH_TRANSFER_BITS 8 or 16). Every vertex holds its coefficients followed by its scale, the
+ * maximum absolute coefficient rounded up to half precision, stored in one 16-bit slot or in two 8-bit slots (low
+ * byte first). The vertex is padded to whole texels, so its coefficients are fetched four at a time. A coefficient c
+ * is stored as round(c/scale*M) + M + 1, with M = 2^(bits-1) - 1, and unpacked as (q - M - 1)*scale/M.
+ */
+class TransferPacker {
+public:
+	/*
+	 * TransferPacker constructor.
+	 * @param quantization Storage of the coefficients.
+	 * @param coeffNbr Number of coefficients per vertex.
+	 * @param verticesPerRow Number of vertices per row of the texture.
+	 */
+	TransferPacker(TransferQuantization quantization, int coeffNbr, int verticesPerRow = 40);
+
+	/*
+	 * Retrieves the number of 16-bit or 8-bit slots holding the scale of a vertex.
+	 * @return Number of slots, 0 for single-precision coefficients.
+	 */
+	int getScaleSlots() const;
+
+	/*
+	 * Retrieves the number of texels per vertex.
+	 * @return Number of texels.
+	 */
+	int getTexelsPerVertex() const { return texelsPerVertex_; }
+
+	/*
+	 * Retrieves the width of the texture.
+	 * @return Width in texels.
+	 */
+	int getWidth() const { return texelsPerVertex_*verticesPerRow_; }
+
+	/*
+	 * Retrieves the height of the texture.
+	 * @param nbrVertices Number of vertices.
+	 * @return Height in texels.
+	 */
+	int getHeight(size_t nbrVertices) const { return (int)((nbrVertices + verticesPerRow_ - 1) / verticesPerRow_); }
+
+	/*
+	 * Retrieves the size of the texture.
+	 * @param nbrVertices Number of vertices.
+	 * @return Size in bytes.
+	 */
+	size_t getSizeBytes(size_t nbrVertices) const;
+
+	/*
+	 * Packs the coefficients of the vertices.
+	 * @param coeffs Coefficients of every vertex, coeffNbr per vertex.
+	 * @param nbrVertices Number of vertices.
+	 * @param packed Content of the texture (components of 32-bit floats, 16-bit or 8-bit unsigned integers).
+	 */
+	void pack(const float* coeffs, size_t nbrVertices, std::vector<unsigned char>& packed) const;
+
+	/*
+	 * Unpacks the coefficients of a vertex, as done by the vertex shaders.
+	 * @param packed Content of the texture.
+	 * @param vertex Index of the vertex.
+	 * @param coeffs Coefficients of the vertex.
+	 */
+	void unpack(const std::vector<unsigned char>& packed, size_t vertex, float* coeffs) const;
+
+	/*
+	 * Packs the coefficients and measures the texture memory and the error of the diffuse lighting.
+	 * @param coeffs Coefficients of every vertex.
+	 * @param nbrVertices Number of vertices.
+	 * @param ambient Ambient coefficients, at least coeffNbr.
+	 * @return Statistics of the quantization.
+	 */
+	TransferPackingStats measure(const float* coeffs, size_t nbrVertices, const glm::vec3* ambient) const;
+
+private:
+	/*
+	 * Retrieves the value of a slot of the texture.
+	 * @param packed Content of the texture.
+	 * @param slot Index of the slot.
+	 * @return Value of the slot.
+	 */
+	uint32_t getSlot(const std::vector<unsigned char>& packed, size_t slot) const;
+
+	/*
+	 * Stores the value of a slot of the texture.
+	 * @param packed Content of the texture.
+	 * @param slot Index of the slot.
+	 * @param value Value of the slot.
+	 */
+	void setSlot(std::vector<unsigned char>& packed, size_t slot, uint32_t value) const;
+
+	TransferQuantization quantization_;    /*!< Storage of the coefficients. */
+	int                  coeffNbr_;        /*!< Number of coefficients per vertex. */
+	int                  verticesPerRow_;  /*!< Number of vertices per row of the texture. */
+	int                  texelsPerVertex_; /*!< Number of texels per vertex. */
+};
+
+} }
+
+#endif
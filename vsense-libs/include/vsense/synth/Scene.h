@@ -0,0 +1,168 @@
+#ifndef VSENSE_SYNTH_SCENE_H_
+#define VSENSE_SYNTH_SCENE_H_
+
+#include <vsense/sh/SphericalHarmonics.h>
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace vsense { namespace synth {
+
+/*
+ * An axis-aligned box standing in the room.
+ */
+struct SceneBox {
+	glm::vec3 min_;    /*!< Minimum corner. */
+	glm::vec3 max_;    /*!< Maximum corner. */
+	glm::vec3 albedo_; /*!< Diffuse albedo. */
+};
+
+/*
+ * A sphere, its albedo is darkened on horizontal stripes so it isn't uniform.
+ */
+struct SceneSphere {
+	glm::vec3 center_; /*!< Center. */
+	float     radius_; /*!< Radius. */
+	glm::vec3 albedo_; /*!< Diffuse albedo. */
+};
+
+/*
+ * A rectangular area light, emitting on the side of the normal (cross product of its half sides).
+ */
+struct SceneLight {
+	glm::vec3 center_;   /*!< Center. */
+	glm::vec3 halfU_;    /*!< Half of the first side. */
+	glm::vec3 halfV_;    /*!< Half of the second side. */
+	glm::vec3 radiance_; /*!< Emitted radiance (linear RGB). */
+};
+
+/*
+ * Surface found along a ray.
+ */
+struct SceneHit {
+	float     dist_;     /*!< Distance from the origin of the ray. */
+	glm::vec3 pos_;      /*!< Position. */
+	glm::vec3 normal_;   /*!< Normal, facing the ray. */
+	glm::vec3 albedo_;   /*!< Diffuse albedo. */
+	glm::vec3 emission_; /*!< Emitted radiance, zero except for the lights. */
+};
+
+/*
+ * The Scene class describes an analytic room (walls with a checkerboard, boxes, spheres and area lights) that is ray
+ * traced to generate synthetic RGB-D sessions. Surfaces are diffuse and lit by the area lights, with hard shadows, and a
+ * constant ambient term. Colors are linear RGB, as the colors of the depth maps and the EM.
+ */
+class Scene {
+public:
+	/*
+	 * Scene constructor, an empty room.
+	 * @param roomMin Minimum corner of the room.
+	 * @param roomMax Maximum corner of the room.
+	 */
+	Scene(const glm::vec3& roomMin, const glm::vec3& roomMax);
+
+	/*
+	 * Creates a furnished room: two boxes, three spheres and two lights on the ceiling.
+	 * @param seed Seed moving the objects and changing their albedo, 0 for the reference layout.
+	 * @return Scene.
+	 */
+	static std::shared_ptr<Scene> createRoom(uint32_t seed = 0);
+
+	/*
+	 * Adds a box.
+	 * @param box Box to add.
+	 */
+	void addBox(const SceneBox& box) { boxes_.push_back(box); }
+
+	/*
+	 * Adds a sphere.
+	 * @param sphere Sphere to add.
+	 */
+	void addSphere(const SceneSphere& sphere) { spheres_.push_back(sphere); }
+
+	/*
+	 * Adds an area light.
+	 * @param light Light to add.
+	 */
+	void addLight(const SceneLight& light) { lights_.push_back(light); }
+
+	/*
+	 * Sets the ambient radiance reaching every surface.
+	 * @param ambient Ambient radiance.
+	 */
+	void setAmbient(const glm::vec3& ambient) { ambient_ = ambient; }
+
+	/*
+	 * Finds the first surface along a ray.
+	 * @param org Origin of the ray.
+	 * @param dir Normalized direction of the ray.
+	 * @param hit Surface found.
+	 * @param includeLights False to ignore the lights, as for the shadow rays.
+	 * @return True if a surface was found.
+	 */
+	bool intersect(const glm::vec3& org, const glm::vec3& dir, SceneHit& hit, bool includeLights = true) const;
+
+	/*
+	 * Calculates the radiance reaching a point from a direction.
+	 * @param org Origin of the ray.
+	 * @param dir Normalized direction of the ray.
+	 * @param dist Distance to the surface seen, NULL if not needed.
+	 * @return Radiance (linear RGB), black if no surface is found.
+	 */
+	glm::vec3 radiance(const glm::vec3& org, const glm::vec3& dir, float* dist = NULL) const;
+
+	/*
+	 * Projects the radiance seen from a point onto the SH basis, with the spherical coordinates of the EM. The radiance
+	 * is scaled by the exposure and clamped to 1, the range the color camera can capture.
+	 * @param pos Point in the world.
+	 * @param order SH order.
+	 * @param nbrSamples Number of directions sampled (Fibonacci lattice).
+	 * @param exposure Scale of the radiance.
+	 * @return SH coefficients.
+	 */
+	std::shared_ptr<sh::SHCoefficients3> projectSH(const glm::vec3& pos, int order, size_t nbrSamples, float exposure = 1.f) const;
+
+	/*
+	 * Converts spherical coordinates of the EM to a direction in the world (see EnvironmentMap::addDepthMapFrame).
+	 * @param theta Polar angle from the Y axis.
+	 * @param phi Azimuth from the Z axis towards the X axis.
+	 * @return Direction.
+	 */
+	static glm::vec3 toDirection(float theta, float phi);
+
+	/*
+	 * Retrieves the minimum corner of the room.
+	 * @return Minimum corner.
+	 */
+	const glm::vec3& getRoomMin() const { return roomMin_; }
+
+	/*
+	 * Retrieves the maximum corner of the room.
+	 * @return Maximum corner.
+	 */
+	const glm::vec3& getRoomMax() const { return roomMax_; }
+
+private:
+	/*
+	 * Calculates the radiance leaving a surface.
+	 * @param hit Surface.
+	 * @return Radiance.
+	 */
+	glm::vec3 shade(const SceneHit& hit) const;
+
+	glm::vec3                roomMin_;       /*!< Minimum corner of the room. */
+	glm::vec3                roomMax_;       /*!< Maximum corner of the room. */
+	glm::vec3                wallAlbedo_[6]; /*!< Albedo of the walls: -X, +X, floor, ceiling, -Z, +Z. */
+	float                    checkerSize_;   /*!< Size of the squares of the walls. */
+	glm::vec3                ambient_;       /*!< Ambient radiance. */
+	std::vector<SceneBox>    boxes_;         /*!< Boxes. */
+	std::vector<SceneSphere> spheres_;       /*!< Spheres. */
+	std::vector<SceneLight>  lights_;        /*!< Area lights. */
+};
+
+} }
+
+#endif
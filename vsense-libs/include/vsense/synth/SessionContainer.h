@@ -0,0 +1,108 @@
+#ifndef VSENSE_SYNTH_SESSIONCONTAINER_H_
+#define VSENSE_SYNTH_SESSIONCONTAINER_H_
+
+#include <vsense/synth/SessionGenerator.h>
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace vsense { namespace synth {
+
+const uint32_t SessionContainerMagic = 0x53535356; /*!< Identifier of the session containers ("VSSS"). */
+const uint32_t SessionContainerVersion = 1;        /*!< Version of the session containers written. */
+
+/*
+ * The SessionContainerWriter class stores a whole session in a single file. The header is followed by the frames, each
+ * one with the point cloud and the image in the layout of the Tango recordings and optionally its ground-truth SH
+ * coefficients, and by a table with the offset of every frame written when the container is closed.
+ */
+class SessionContainerWriter {
+public:
+	/*
+	 * SessionContainerWriter constructor.
+	 */
+	SessionContainerWriter();
+
+	/*
+	 * SessionContainerWriter destructor, closes the container.
+	 */
+	~SessionContainerWriter();
+
+	/*
+	 * Creates a container.
+	 * @param filename Filename of the container.
+	 * @param shOrder Order of the ground-truth SH coefficients of every frame, -1 if not stored, up to sh::MaxSHOrder.
+	 * @return True if successful.
+	 */
+	bool open(const std::string& filename, int shOrder = -1);
+
+	/*
+	 * Appends a frame.
+	 * @param frame Frame to append.
+	 * @param groundTruth Ground-truth SH coefficients, NULL for zeros.
+	 * @return True if successful.
+	 */
+	bool append(const Frame& frame, const sh::SHCoefficients3* groundTruth = NULL);
+
+	/*
+	 * Writes the table of the frames and closes the container.
+	 * @return True if successful.
+	 */
+	bool close();
+
+private:
+	std::ofstream         file_;    /*!< Container being written. */
+	int                   shOrder_; /*!< Order of the ground-truth SH coefficients, -1 if not stored. */
+	std::vector<uint64_t> offsets_; /*!< Offset of every frame written. */
+};
+
+/*
+ * The SessionContainerReader class reads the frames of a container in any order. Reads aren't thread-safe.
+ */
+class SessionContainerReader {
+public:
+	/*
+	 * SessionContainerReader constructor.
+	 */
+	SessionContainerReader() : shOrder_(-1) {}
+
+	/*
+	 * Opens a container. The header and the table of the frames are checked against the size of the file.
+	 * @param filename Filename of the container.
+	 * @return True if successful.
+	 */
+	bool open(const std::string& filename);
+
+	/*
+	 * Reads a frame.
+	 * @param idx Index of the frame.
+	 * @param frame Frame read, its point cloud is cleared first.
+	 * @param groundTruth Ground-truth SH coefficients, NULL if not needed.
+	 * @param minConf Minimum confidence of the points kept.
+	 * @return True if successful.
+	 */
+	bool read(size_t idx, Frame& frame, sh::SHCoefficients3* groundTruth = NULL, float minConf = -1.f);
+
+	/*
+	 * Retrieves the number of frames.
+	 * @return Number of frames.
+	 */
+	size_t size() const { return offsets_.size(); }
+
+	/*
+	 * Retrieves the order of the ground-truth SH coefficients.
+	 * @return SH order, -1 if not stored.
+	 */
+	int getSHOrder() const { return shOrder_; }
+
+private:
+	std::ifstream         file_;    /*!< Container being read. */
+	int                   shOrder_; /*!< Order of the ground-truth SH coefficients, -1 if not stored. */
+	std::vector<uint64_t> offsets_; /*!< Offset of every frame. */
+};
+
+} }
+
+#endif
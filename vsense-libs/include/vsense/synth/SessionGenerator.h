@@ -0,0 +1,116 @@
+#ifndef VSENSE_SYNTH_SESSIONGENERATOR_H_
+#define VSENSE_SYNTH_SESSIONGENERATOR_H_
+
+#include <vsense/io/ImageReader.h>
+#include <vsense/io/PointCloudReader.h>
+#include <vsense/pc/PointCloud.h>
+#include <vsense/sh/SphericalHarmonics.h>
+
+#include <glm/glm.hpp>
+
+#include <memory>
+
+namespace vsense { namespace io {
+	class Image;
+} }
+
+namespace vsense { namespace synth {
+
+class Scene;
+
+/*
+ * A RGB-D frame as recorded by the Tango app (PointCloud<i>.pc and PointCloud<i>.im).
+ */
+struct Frame {
+	pc::PointCloud             pc;     /*!< Point cloud in the depth sensor's CS. */
+	io::PointCloudMetadata     pcData; /*!< Point cloud metadata, its pose in the world. */
+	std::shared_ptr<io::Image> img;    /*!< Color image. */
+	io::ImageMetadata          imData; /*!< Image metadata, its pose relative to the depth sensor. */
+};
+
+/*
+ * The SessionConfig structure holds the sensors and the trajectory of a synthetic session. The defaults match the Tango
+ * recordings: 224x172 depth frames at 5Hz and 1920x1080 color images.
+ */
+struct SessionConfig {
+	/*
+	 * SessionConfig constructor, with the default values.
+	 */
+	SessionConfig();
+
+	uint32_t   depthWidth_;    /*!< Width of the depth sensor. */
+	uint32_t   depthHeight_;   /*!< Height of the depth sensor. */
+	glm::dvec2 depthF_;        /*!< Focal length of the depth sensor in pixels. */
+	uint32_t   imageWidth_;    /*!< Width of the color camera, multiple of 2. */
+	uint32_t   imageHeight_;   /*!< Height of the color camera, multiple of 2. */
+	glm::dvec2 imageF_;        /*!< Focal length of the color camera in pixels. */
+	float      exposure_;      /*!< Scale of the radiance captured by the color camera, the lights saturate. */
+	double     frameTime_;     /*!< Time between frames in seconds. */
+	float      noise_;         /*!< Standard deviation of the depth noise at 1m, grows with the squared depth. */
+	float      holeRate_;      /*!< Fraction of the points missing. */
+	float      maxDepth_;      /*!< Maximum depth measured. */
+	size_t     framesPerTurn_; /*!< Frames of a full turn of the device. */
+	float      pathRadius_;    /*!< Radius of the circle followed by the device. */
+	uint32_t   seed_;          /*!< Seed of the depth noise and holes. */
+};
+
+/*
+ * The SessionGenerator class ray traces a scene into a synthetic RGB-D session: the device turns around the vertical
+ * axis while moving on a small circle and looking up and down. Every frame is generated on its own from its index, so
+ * sessions of any length can be streamed and a frame is the same whatever the length of the session or the number of
+ * threads. The radiance seen from the device is available as SH coefficients to check the accuracy of the EM.
+ */
+class SessionGenerator {
+public:
+	/*
+	 * SessionGenerator constructor.
+	 * @param scene Scene to render.
+	 * @param config Sensors and trajectory.
+	 */
+	SessionGenerator(const std::shared_ptr<Scene>& scene, const SessionConfig& config = SessionConfig());
+
+	/*
+	 * Calculates the pose of the depth sensor for a frame.
+	 * @param idx Index of the frame.
+	 * @param rot Orientation, the sensor looks along +Z.
+	 * @param pos Position in the world.
+	 */
+	void getPose(size_t idx, glm::mat3& rot, glm::vec3& pos) const;
+
+	/*
+	 * Generates a frame.
+	 * @param idx Index of the frame.
+	 * @param frame Frame generated, its point cloud is cleared first.
+	 * @param nbrThreads Number of threads rendering the color image, 0 to use all available.
+	 */
+	void generate(size_t idx, Frame& frame, size_t nbrThreads = 1) const;
+
+	/*
+	 * Calculates the SH coefficients of the radiance reaching the device for a frame (see Scene::projectSH).
+	 * @param idx Index of the frame.
+	 * @param order SH order.
+	 * @param nbrSamples Number of directions sampled.
+	 * @return SH coefficients.
+	 */
+	std::shared_ptr<sh::SHCoefficients3> groundTruthSH(size_t idx, int order, size_t nbrSamples = 20000) const;
+
+	/*
+	 * Retrieves the scene.
+	 * @return Scene.
+	 */
+	const std::shared_ptr<Scene>& getScene() const { return scene_; }
+
+	/*
+	 * Retrieves the configuration of the session.
+	 * @return Configuration.
+	 */
+	const SessionConfig& getConfig() const { return config_; }
+
+private:
+	std::shared_ptr<Scene> scene_;  /*!< Scene rendered. */
+	SessionConfig          config_; /*!< Sensors and trajectory. */
+};
+
+} }
+
+#endif
@@ -0,0 +1,377 @@
+#include "Benchmark.h"
+
+#include <vsense/common/Parallel.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <type_traits>
+
+const uint32_t BenchmarkVersion = 1; // Version of the JSON files written
+
+/*
+ * Skips the white space of a JSON text.
+ * @param text JSON text.
+ * @param pos Position in the text, updated.
+ */
+void skipSpace(const std::string& text, size_t& pos) {
+	while (pos < text.size() && isspace((unsigned char)text[pos]))
+		pos++;
+}
+
+/*
+ * Reads a JSON value, a string or a number. Objects and arrays aren't expected in the results.
+ * @param text JSON text.
+ * @param pos Position of the value in the text, updated.
+ * @param value Value read, without the quotes if a string.
+ * @return True if successful.
+ */
+bool readValue(const std::string& text, size_t& pos, std::string& value) {
+	skipSpace(text, pos);
+	if (pos >= text.size())
+		return false;
+
+	value.clear();
+	if (text[pos] == '"') {
+		for (pos++; pos < text.size() && text[pos] != '"'; pos++) {
+			if (text[pos] == '\\' && pos + 1 < text.size())
+				pos++;
+			value += text[pos];
+		}
+
+		return pos++ < text.size();
+	}
+
+	while (pos < text.size() && text[pos] != ',' && text[pos] != '}' && text[pos] != ']' && !isspace((unsigned char)text[pos]))
+		value += text[pos++];
+
+	return !value.empty();
+}
+
+/*
+ * Reads the fields of a flat JSON object.
+ * @param text JSON text.
+ * @param pos Position of the opening brace in the text, updated.
+ * @param fields Value of every field.
+ * @return True if successful.
+ */
+bool readObject(const std::string& text, size_t& pos, std::map<std::string, std::string>& fields) {
+	fields.clear();
+
+	skipSpace(text, pos);
+	if (pos >= text.size() || text[pos++] != '{')
+		return false;
+
+	for (;;) {
+		skipSpace(text, pos);
+		if (pos >= text.size())
+			return false;
+		if (text[pos] == '}') {
+			pos++;
+			return true;
+		}
+		if (text[pos] == ',') {
+			pos++;
+			continue;
+		}
+
+		std::string key, value;
+		if (!readValue(text, pos, key))
+			return false;
+
+		skipSpace(text, pos);
+		if (pos >= text.size() || text[pos++] != ':')
+			return false;
+
+		if (!readValue(text, pos, value))
+			return false;
+
+		fields[key] = value;
+	}
+}
+
+/*
+ * Escapes a string written to a JSON file.
+ * @param text Text to escape.
+ * @return Escaped text.
+ */
+std::string escapeJSON(const std::string& text) {
+	std::string escaped;
+	for (size_t i = 0; i < text.size(); i++) {
+		if (text[i] == '"' || text[i] == '\\')
+			escaped += '\\';
+		if ((unsigned char)text[i] >= 0x20)
+			escaped += text[i];
+	}
+
+	return escaped;
+}
+
+/*
+ * Stream buffer discarding everything, the libraries print their progress on every frame.
+ */
+class NullBuffer : public std::streambuf {
+protected:
+	int overflow(int c) override { return c; }
+};
+
+/*
+ * Runs a case or a check with std::cout discarded.
+ * @param func Function to run.
+ * @return Result of the function.
+ */
+template<typename F>
+typename std::result_of<F()>::type runSilently(const F& func) {
+	static NullBuffer nullBuffer;
+	std::streambuf* coutBuffer = std::cout.rdbuf(&nullBuffer);
+	typename std::result_of<F()>::type result = func();
+	std::cout.rdbuf(coutBuffer);
+
+	return result;
+}
+
+BenchmarkSuite::BenchmarkSuite(size_t nbrRuns, size_t nbrWarmup) : nbrRuns_(std::max(nbrRuns, (size_t)1)), nbrWarmup_(nbrWarmup) {
+}
+
+void BenchmarkSuite::add(const std::string& name, const BenchmarkFunc& func, double items, float tolerance) {
+	BenchmarkCase benchCase;
+	benchCase.name = name;
+	benchCase.func = func;
+	benchCase.items = items;
+	benchCase.tolerance = tolerance;
+
+	cases_.push_back(benchCase);
+}
+
+void BenchmarkSuite::addCheck(const std::string& name, const CheckFunc& func) {
+	BenchmarkCheck check;
+	check.name = name;
+	check.func = func;
+
+	checks_.push_back(check);
+}
+
+std::vector<std::string> BenchmarkSuite::getNames() const {
+	std::vector<std::string> names(cases_.size());
+	for (size_t i = 0; i < cases_.size(); i++)
+		names[i] = cases_[i].name;
+
+	return names;
+}
+
+std::vector<std::string> BenchmarkSuite::getCheckNames() const {
+	std::vector<std::string> names(checks_.size());
+	for (size_t i = 0; i < checks_.size(); i++)
+		names[i] = checks_[i].name;
+
+	return names;
+}
+
+size_t BenchmarkSuite::runChecks(const std::string& filter, size_t& nbrRun) const {
+	size_t nbrFailed = 0;
+	nbrRun = 0;
+
+	for (size_t i = 0; i < checks_.size(); i++) {
+		const BenchmarkCheck& check = checks_[i];
+		if (!filter.empty() && check.name.find(filter) == std::string::npos)
+			continue;
+
+		std::cout << std::left << std::setw(40) << check.name << std::flush;
+
+		std::string details;
+		bool isPassed = runSilently([&]() { return check.func(details); });
+		std::cout << (isPassed ? "  ok" : "  FAILED") << (details.empty() ? "" : "  ") << details << std::endl;
+
+		nbrRun++;
+		if (!isPassed)
+			nbrFailed++;
+	}
+
+	return nbrFailed;
+}
+
+size_t BenchmarkSuite::run(const std::string& filter) {
+	results_.clear();
+
+	std::vector<double> times(nbrRuns_);
+	for (size_t i = 0; i < cases_.size(); i++) {
+		const BenchmarkCase& benchCase = cases_[i];
+		if (!filter.empty() && benchCase.name.find(filter) == std::string::npos)
+			continue;
+
+		std::cout << std::left << std::setw(40) << benchCase.name << std::flush;
+
+		for (size_t run = 0; run < nbrWarmup_; run++)
+			runSilently(benchCase.func);
+
+		for (size_t run = 0; run < nbrRuns_; run++)
+			times[run] = runSilently(benchCase.func);
+
+		BenchmarkResult result;
+		result.name = benchCase.name;
+		result.nbrRuns = nbrRuns_;
+		result.items = benchCase.items;
+		result.tolerance = benchCase.tolerance;
+
+		double sum = 0.0, sumSq = 0.0;
+		for (size_t run = 0; run < nbrRuns_; run++) {
+			sum += times[run];
+			sumSq += times[run] * times[run];
+		}
+		result.mean = sum / nbrRuns_;
+		result.stdDev = sqrt(std::max(0.0, sumSq / nbrRuns_ - result.mean*result.mean));
+
+		// The median is robust to the runs disturbed by other processes
+		std::sort(times.begin(), times.end());
+		result.min = times[0];
+		result.median = (nbrRuns_ % 2) ? times[nbrRuns_ / 2] : 0.5*(times[nbrRuns_ / 2 - 1] + times[nbrRuns_ / 2]);
+
+		std::cout << std::right << std::fixed << std::setprecision(3) << std::setw(10) << result.median << " ms  (min "
+			<< result.min << ", sd " << result.stdDev << ")";
+		if (result.items > 0.0 && result.median > 0.0) {
+			double rate = result.items / result.median * 1e3; // Items per second
+			if (rate >= 1e6)
+				std::cout << "  " << std::setprecision(1) << rate * 1e-6 << " M/s";
+			else
+				std::cout << "  " << std::setprecision(1) << rate << " /s";
+		}
+		std::cout << std::endl;
+
+		results_.push_back(result);
+	}
+
+	return results_.size();
+}
+
+bool BenchmarkSuite::writeJSON(const std::string& filename, const std::string& label) const {
+	std::ofstream file(filename);
+	if (!file.is_open()) {
+		std::cout << "Unable to write " << filename << std::endl;
+		return false;
+	}
+
+	file << std::setprecision(6);
+	file << "{\n";
+	file << "  \"suite\": \"vsense_bench\",\n";
+	file << "  \"version\": " << BenchmarkVersion << ",\n";
+	file << "  \"label\": \"" << escapeJSON(label) << "\",\n";
+	file << "  \"threads\": " << vsense::common::hardwareThreads() << ",\n";
+	file << "  \"results\": [\n";
+	for (size_t i = 0; i < results_.size(); i++) {
+		const BenchmarkResult& result = results_[i];
+		file << "    {\"name\": \"" << escapeJSON(result.name) << "\", \"runs\": " << result.nbrRuns << ", \"median_ms\": " << result.median
+			<< ", \"min_ms\": " << result.min << ", \"mean_ms\": " << result.mean << ", \"stddev_ms\": " << result.stdDev
+			<< ", \"items\": " << result.items;
+		if (result.tolerance >= 0.f)
+			file << ", \"tolerance\": " << result.tolerance;
+		file << "}" << (i + 1 < results_.size() ? "," : "") << "\n";
+	}
+	file << "  ]\n";
+	file << "}\n";
+
+	return file.good();
+}
+
+bool BenchmarkSuite::readJSON(const std::string& filename, std::vector<BenchmarkResult>& results) {
+	results.clear();
+
+	std::ifstream file(filename);
+	if (!file.is_open()) {
+		std::cout << "Unable to read " << filename << std::endl;
+		return false;
+	}
+
+	std::stringstream buffer;
+	buffer << file.rdbuf();
+	std::string text = buffer.str();
+
+	size_t pos = text.find("\"results\"");
+	if (pos == std::string::npos || (pos = text.find('[', pos)) == std::string::npos) {
+		std::cout << filename << " has no results" << std::endl;
+		return false;
+	}
+	pos++;
+
+	std::map<std::string, std::string> fields;
+	for (;;) {
+		skipSpace(text, pos);
+		if (pos >= text.size()) {
+			std::cout << filename << " is truncated" << std::endl;
+			return false;
+		}
+		if (text[pos] == ']')
+			break;
+		if (text[pos] == ',') {
+			pos++;
+			continue;
+		}
+
+		if (!readObject(text, pos, fields) || !fields.count("name") || !fields.count("median_ms")) {
+			std::cout << filename << " has an invalid result" << std::endl;
+			return false;
+		}
+
+		BenchmarkResult result;
+		result.name = fields["name"];
+		result.median = atof(fields["median_ms"].c_str());
+		result.min = atof(fields["min_ms"].c_str());
+		result.mean = atof(fields["mean_ms"].c_str());
+		result.stdDev = atof(fields["stddev_ms"].c_str());
+		result.items = atof(fields["items"].c_str());
+		result.nbrRuns = (size_t)atol(fields["runs"].c_str());
+		if (fields.count("tolerance"))
+			result.tolerance = (float)atof(fields["tolerance"].c_str());
+
+		results.push_back(result);
+	}
+
+	return true;
+}
+
+size_t BenchmarkSuite::compare(const std::vector<BenchmarkResult>& baseline, float tolerance, double minDeltaMS) const {
+	std::map<std::string, const BenchmarkResult*> baseResults;
+	for (size_t i = 0; i < baseline.size(); i++)
+		baseResults[baseline[i].name] = &baseline[i];
+
+	std::cout << std::endl << std::left << std::setw(40) << "Case" << std::right << std::setw(12) << "Baseline" << std::setw(12)
+		<< "Current" << std::setw(10) << "Change" << std::endl;
+
+	size_t nbrRegressions = 0;
+	for (size_t i = 0; i < results_.size(); i++) {
+		const BenchmarkResult& result = results_[i];
+		std::cout << std::left << std::setw(40) << result.name << std::right << std::fixed << std::setprecision(3);
+
+		std::map<std::string, const BenchmarkResult*>::const_iterator it = baseResults.find(result.name);
+		if (it == baseResults.end()) {
+			std::cout << std::setw(12) << "-" << std::setw(12) << result.median << std::setw(10) << "-" << "  new" << std::endl;
+			continue;
+		}
+
+		// The tolerance stored in the baseline has priority, so noisy cases can be relaxed without rebuilding
+		const BenchmarkResult& base = *it->second;
+		float caseTolerance = base.tolerance >= 0.f ? base.tolerance : (result.tolerance >= 0.f ? result.tolerance : tolerance);
+
+		double delta = result.median - base.median;
+		double change = base.median > 0.0 ? delta / base.median : 0.0;
+
+		std::cout << std::setw(12) << base.median << std::setw(12) << result.median << std::setw(9) << std::showpos
+			<< std::setprecision(1) << change*100.0 << "%" << std::noshowpos;
+
+		if (change > caseTolerance && delta > minDeltaMS) {
+			std::cout << "  SLOWER (tolerance " << std::setprecision(0) << caseTolerance*100.f << "%)";
+			nbrRegressions++;
+		} else if (-change > caseTolerance && -delta > minDeltaMS) {
+			std::cout << "  faster";
+		}
+		std::cout << std::endl;
+	}
+
+	return nbrRegressions;
+}
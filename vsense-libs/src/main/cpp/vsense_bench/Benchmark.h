@@ -0,0 +1,162 @@
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <string>
+#include <vector>
+
+/*
+ * Timings of a benchmark case.
+ */
+struct BenchmarkResult {
+	BenchmarkResult() : nbrRuns(0), median(0.0), min(0.0), mean(0.0), stdDev(0.0), items(0.0), tolerance(-1.f) {}
+
+	std::string name;      /*!< Name of the case, group first (e.g. "sh.evalSH"). */
+	size_t      nbrRuns;   /*!< Number of timed runs. */
+	double      median;    /*!< Median time of a run (ms). */
+	double      min;       /*!< Minimum time of a run (ms). */
+	double      mean;      /*!< Average time of a run (ms). */
+	double      stdDev;    /*!< Standard deviation of the time of a run (ms). */
+	double      items;     /*!< Number of items (samples, pixels, frames) processed per run, 0 if not relevant. */
+	float       tolerance; /*!< Relative slowdown accepted for the case, negative to use the default. */
+};
+
+/*
+ * A benchmark case runs once and returns the time measured in milliseconds. Cases timing a stage of a larger operation
+ * return the time of that stage only.
+ */
+typedef std::function<double()> BenchmarkFunc;
+
+/*
+ * A check verifies the results of the code timed by the cases (e.g. that two implementations agree) and describes
+ * what it found.
+ */
+typedef std::function<bool(std::string& details)> CheckFunc;
+
+/*
+ * The BenchmarkSuite class runs a set of benchmark cases, writes their timings as JSON and compares them with the ones
+ * of a previous run (baseline) to detect regressions. It also runs the checks verifying the results of the code timed.
+ */
+class BenchmarkSuite {
+public:
+	/*
+	 * BenchmarkSuite constructor.
+	 * @param nbrRuns Number of timed runs of every case.
+	 * @param nbrWarmup Number of runs of every case before the timed ones.
+	 */
+	BenchmarkSuite(size_t nbrRuns = 15, size_t nbrWarmup = 2);
+
+	/*
+	 * Adds a case.
+	 * @param name Name of the case, group first (e.g. "sh.evalSH").
+	 * @param func Function running the case once.
+	 * @param items Number of items processed per run, 0 if not relevant.
+	 * @param tolerance Relative slowdown accepted for the case, negative to use the default.
+	 */
+	void add(const std::string& name, const BenchmarkFunc& func, double items = 0.0, float tolerance = -1.f);
+
+	/*
+	 * Adds a check.
+	 * @param name Name of the check, group first (e.g. "replay.synthetic30.consistency").
+	 * @param func Function running the check.
+	 */
+	void addCheck(const std::string& name, const CheckFunc& func);
+
+	/*
+	 * Retrieves the names of the cases added.
+	 * @return Names.
+	 */
+	std::vector<std::string> getNames() const;
+
+	/*
+	 * Retrieves the names of the checks added.
+	 * @return Names.
+	 */
+	std::vector<std::string> getCheckNames() const;
+
+	/*
+	 * Runs the checks.
+	 * @param filter Substring the names of the checks to run contain, empty to run every check.
+	 * @param nbrRun Number of checks run.
+	 * @return Number of checks failed.
+	 */
+	size_t runChecks(const std::string& filter, size_t& nbrRun) const;
+
+	/*
+	 * Runs the cases.
+	 * @param filter Substring the names of the cases to run contain, empty to run every case.
+	 * @return Number of cases run.
+	 */
+	size_t run(const std::string& filter = "");
+
+	/*
+	 * Retrieves the timings of the cases run.
+	 * @return Timings.
+	 */
+	const std::vector<BenchmarkResult>& getResults() const { return results_; }
+
+	/*
+	 * Writes the timings of the cases run.
+	 * @param filename Filename of the JSON file.
+	 * @param label Free text identifying the run (e.g. commit or device).
+	 * @return True if successful.
+	 */
+	bool writeJSON(const std::string& filename, const std::string& label) const;
+
+	/*
+	 * Reads the timings written by writeJSON.
+	 * @param filename Filename of the JSON file.
+	 * @param results Timings read.
+	 * @return True if successful.
+	 */
+	static bool readJSON(const std::string& filename, std::vector<BenchmarkResult>& results);
+
+	/*
+	 * Compares the timings of the cases run with a baseline and prints the differences. A case regresses when its
+	 * median is slower than the one of the baseline by more than both the relative tolerance and the minimum difference.
+	 * @param baseline Timings of the baseline.
+	 * @param tolerance Relative slowdown accepted for the cases without their own tolerance.
+	 * @param minDeltaMS Slowdown in milliseconds below which a case never regresses.
+	 * @return Number of cases that regressed.
+	 */
+	size_t compare(const std::vector<BenchmarkResult>& baseline, float tolerance, double minDeltaMS) const;
+
+	/*
+	 * Times a function.
+	 * @param func Function to time.
+	 * @return Time in milliseconds.
+	 */
+	template<typename F>
+	static double measure(F func) {
+		std::chrono::high_resolution_clock::time_point t = std::chrono::high_resolution_clock::now();
+		func();
+		std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - t;
+
+		return elapsed.count();
+	}
+
+private:
+	/*
+	 * A case added to the suite.
+	 */
+	struct BenchmarkCase {
+		std::string   name;      /*!< Name of the case. */
+		BenchmarkFunc func;      /*!< Function running the case once. */
+		double        items;     /*!< Number of items processed per run. */
+		float         tolerance; /*!< Relative slowdown accepted for the case. */
+	};
+
+	/*
+	 * A check added to the suite.
+	 */
+	struct BenchmarkCheck {
+		std::string name; /*!< Name of the check. */
+		CheckFunc   func; /*!< Function running the check. */
+	};
+
+	size_t                       nbrRuns_;   /*!< Number of timed runs of every case. */
+	size_t                       nbrWarmup_; /*!< Number of runs of every case before the timed ones. */
+	std::vector<BenchmarkCase>   cases_;     /*!< Cases added. */
+	std::vector<BenchmarkCheck>  checks_;    /*!< Checks added. */
+	std::vector<BenchmarkResult> results_;   /*!< Timings of the cases run. */
+};
@@ -0,0 +1,97 @@
+#pragma once
+
+#include "Benchmark.h"
+#include "Session.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+/*
+ * Adds the microbenchmarks of the CPU kernels: color conversion, SH evaluation and projection, the stages of the depth
+ * maps, upsampling included, and the EM integration, with and without the coverage tracking, warping and snapshots,
+ * and the checks that the upsampled depth doesn't bleed across edges, that the color correction error from the moments
+ * matches the per-sample error and that a chain of snapshot deltas is read back as written.
+ * @param suite Suite where the cases are added.
+ * @param session Session whose frames are used by the depth and EM cases.
+ * @param upsamplingFraction Fraction of the color image width the depth maps are upsampled to.
+ */
+void addMicroBenchmarks(BenchmarkSuite& suite, const std::shared_ptr<Session>& session, float upsamplingFraction);
+
+/*
+ * Adds the undistortion cases, with the remap cache and evaluating the distortion for every pixel, the conversion of
+ * NV21 color frames, in floating point as before and with the YUV converter, and the checks that the remap cache matches
+ * the distortion model and that the converter matches the floating point conversion.
+ * @param suite Suite where the cases are added.
+ * @param session Session whose mapping from the depth map to the color image is checked.
+ */
+void addIOBenchmarks(BenchmarkSuite& suite, const std::shared_ptr<Session>& session);
+
+/*
+ * Adds the point cloud cases, run on the point clouds of a session accumulated in world coordinates: the downsampling
+ * and the neighbor queries of the spatial hash on subsets of 10k to 1M points, checked against a brute-force search, the
+ * transformation of the accumulated points one at a time, with SIMD and in parallel, and the reading and writing of the
+ * point cloud files of a frame, with the checks that each variant gives the same points, and the plane detection on
+ * touch, checked against the walls and boxes of the synthetic room.
+ * @param suite Suite where the cases are added.
+ * @param session Synthetic session whose frames are accumulated, written and touched.
+ */
+void addPCBenchmarks(BenchmarkSuite& suite, const std::shared_ptr<Session>& session);
+
+/*
+ * Adds the cases of the CPU references of the EM shaders, run on the frames of a session: the fused and separate passes
+ * of the depth preprocessing, and the check that both produce the same maps, and the unordered and sorted scatters of
+ * the samples to the EM, and the check that the sorted scatter doesn't depend on the work-group size.
+ * @param suite Suite where the cases are added.
+ * @param session Session whose frames are used.
+ */
+void addEMBenchmarks(BenchmarkSuite& suite, const std::shared_ptr<Session>& session);
+
+/*
+ * Adds the cases of the SH rendering references, run on synthetic transfer coefficients and the radiance of the
+ * synthetic room: the report of the error of every SH order, the memory and error of every quantization of the
+ * transfer coefficients, the lighting of the vertices on the CPU for several numbers of vertices, and the temporal
+ * filter of the SH coefficients on a synthetic sequence with a lighting switch.
+ * @param suite Suite where the cases are added.
+ */
+void addSHBenchmarks(BenchmarkSuite& suite);
+
+/*
+ * Adds the replays of a session through the depth maps and the EM, with the frames processed sequentially and with the
+ * depth maps of several frames processed in parallel or with the uniformity check of the EM enabled, and the check that
+ * the sequential and frame-parallel replays produce the same EM. The poses of the session are also replayed through
+ * the integration controller, reporting the frames it would integrate and the coverage of the EM. The session is also
+ * replayed with the depth maps upsampled, reporting the time per frame and the coverage of the EM against the replay
+ * at the resolution of the depth sensor. The uniformity queries of two turns of the session are replayed with the cached
+ * mask and evaluating every neighborhood, with the check that both give the same result.
+ * @param suite Suite where the cases are added.
+ * @param session Session to replay.
+ * @param nbrThreads Maximum number of threads of the frame-parallel replay, 0 to use all available.
+ * @param upsamplingFraction Fraction of the color image width the depth maps are upsampled to.
+ * @param folder Folder the session was recorded to, its poses are read as done offline, empty if not recorded.
+ */
+void addReplayBenchmarks(BenchmarkSuite& suite, const std::shared_ptr<Session>& session, size_t nbrThreads, float upsamplingFraction, const std::string& folder = "");
+
+/*
+ * Adds the generation of a synthetic frame and the checks of the generator and the session containers: the frames are
+ * the same whatever the number of threads, and the containers are read back and rejected when damaged.
+ * @param suite Suite where the cases are added.
+ */
+void addSynthBenchmarks(BenchmarkSuite& suite);
+
+/*
+ * Adds the checks of the GPU code that run without a GPU: the shaders built with the reduction library are assembled
+ * and their summation order is emulated on the CPU (see common::WorkGroupReduction), and the latency and ordering of
+ * the readback ring are checked with the emulated buffers and fences (see gl::CPUReadbackBackend). The keys,
+ * storage and invalidation of the program cache are checked with a recorded driver.
+ * @param suite Suite where the cases are added.
+ */
+void addGLBenchmarks(BenchmarkSuite& suite);
+
+/*
+ * Writes the shaders built with the reduction library, assembled as by Process for every GLSL version, so they can be
+ * validated offline (e.g. glslangValidator).
+ * @param folder Existing folder where the shaders are written.
+ * @return True if every shader was written.
+ */
+bool writeReductionShaders(const std::string& folder);
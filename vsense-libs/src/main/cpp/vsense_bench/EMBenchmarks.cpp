@@ -0,0 +1,374 @@
+#include "Cases.h"
+
+#include <vsense/depth/DepthMap.h>
+#include <vsense/em/DepthPreprocess.h>
+#include <vsense/em/SortedScatter.h>
+#include <vsense/io/Image.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <sstream>
+
+using namespace vsense;
+
+const size_t DepthPreprocessWindow = 3; // Reliability window of the app
+
+const int ScatterEMWidth = 1000;       // EM of the app
+const int ScatterEMHeight = 500;
+const int ScatterRegionWidth = 160;    // Texels covered by a frame, ~1.5 samples per texel
+const int ScatterRegionHeight = 160;
+const size_t ScatterSamples = 224*172; // One sample per depth pixel
+const size_t ScatterGroupSizes[] = { 1, 64, 255 };
+
+/*
+ * Input of the depth preprocessing, as written by depthMapInit.comp for a frame.
+ */
+struct PreprocessFrame {
+	int                        width;       /*!< Width of the depth map. */
+	int                        height;      /*!< Height of the depth map. */
+	int                        colorWidth;  /*!< Width of the color image. */
+	int                        colorHeight; /*!< Height of the color image. */
+	std::vector<glm::vec4>     depthMap;    /*!< RGB-D map. */
+	std::vector<glm::vec4>     pointsMap;   /*!< Points (XYZ, flags). */
+	std::vector<glm::vec4>     colorImage;  /*!< Linear color image. */
+	std::shared_ptr<glm::vec2> ptMapping;   /*!< Normalized coordinates of every depth-map pixel. */
+	em::DepthPreprocessParams  params;      /*!< Parameters. */
+};
+
+/*
+ * Initializes the maps of the depth preprocessing from a frame, as done by depthMapInit.comp and
+ * depth::DepthMap::fillWithData.
+ * @param session Session providing the mapping of the depth pixels.
+ * @param frame Frame.
+ * @return Input of the depth preprocessing.
+ */
+std::shared_ptr<PreprocessFrame> createPreprocessFrame(const Session& session, const SessionFrame& frame) {
+	session.useDepthMapping();
+
+	std::shared_ptr<PreprocessFrame> input(new PreprocessFrame());
+	input->width = (int)depth::DepthMap::width();
+	input->height = (int)depth::DepthMap::height();
+	input->colorWidth = (int)frame.img->cols();
+	input->colorHeight = (int)frame.img->rows();
+	input->ptMapping = depth::DepthMap::getDepthMapping();
+
+	const io::ImageMetadata& imData = frame.imData;
+	glm::mat4 imPose = io::ImageMetadata(imData).asPose();
+
+	em::DepthPreprocessParams& params = input->params;
+	params.f = glm::vec2(imData.f_);
+	params.c = glm::vec2(imData.c_);
+	for (int i = 0; i < 5; i++)
+		params.coeff[i] = (float)imData.distortion_[i];
+	params.pose = imPose;
+	params.radius = (int)DepthPreprocessWindow / 2;
+	params.limitChiSquare = depth::DepthMap::limitChiSquare(DepthPreprocessWindow);
+
+	input->colorImage.resize(input->colorWidth*input->colorHeight);
+	for (int row = 0; row < input->colorHeight; row++) {
+		for (int col = 0; col < input->colorWidth; col++)
+			input->colorImage[row*input->colorWidth + col] = glm::vec4(frame.img->pixelAsVector(row, col, true), 1.f);
+	}
+
+	input->depthMap.assign(input->width*input->height, glm::vec4(0.f));
+	input->pointsMap.assign(input->width*input->height, glm::vec4(0.f));
+	for (size_t i = 0; i < frame.pc.size(); i++) {
+		const pc::Point pt = frame.pc.at(i);
+
+		glm::vec3 ptTrans = glm::vec3(imPose*glm::vec4(pt.pos, 1.f));
+		glm::vec2 ptColor = io::Image::undistortAndProject(ptTrans, imData.distortion_, imData.f_, imData.c_);
+		ptColor.x = floor(ptColor.x + 0.5f);
+		ptColor.y = floor(ptColor.y + 0.5f);
+		if ((ptColor.x < 0) || (ptColor.x >= input->colorWidth) || (ptColor.y < 0) || (ptColor.y >= input->colorHeight))
+			continue;
+
+		glm::vec2 ptDepth = io::Image::undistortAndProject(pt.pos, frame.pcData.distortion_, frame.pcData.f_, frame.pcData.c_);
+		ptDepth = glm::vec2(input->width - 1.f, input->height - 1.f) - ptDepth;
+		int x = (int)std::max(0.f, std::min(input->width - 1.f, std::floor(ptDepth.x + 0.5f)));
+		int y = (int)std::max(0.f, std::min(input->height - 1.f, std::floor(ptDepth.y + 0.5f)));
+
+		size_t idx = y*input->width + x;
+		input->depthMap[idx] = glm::vec4(glm::vec3(input->colorImage[(int)ptColor.y*input->colorWidth + (int)ptColor.x]), ptTrans.z);
+		input->pointsMap[idx] = glm::vec4(pt.pos, 1.f);
+	}
+
+	return input;
+}
+
+/*
+ * Runs the fused pass of the depth preprocessing reference.
+ * @param input Input of the depth preprocessing.
+ * @param preprocess Reference.
+ * @param depthOut Output RGB-D map.
+ * @param pointsOut Output points.
+ */
+void runFused(const PreprocessFrame& input, em::DepthPreprocess& preprocess, std::vector<glm::vec4>& depthOut, std::vector<glm::vec4>& pointsOut) {
+	depthOut.assign(input.depthMap.size(), glm::vec4(0.f));
+	pointsOut.assign(input.pointsMap.size(), glm::vec4(0.f));
+
+	preprocess.runFused(input.depthMap.data(), input.pointsMap.data(), input.colorImage.data(), input.colorWidth, input.colorHeight,
+		input.ptMapping.get(), input.params, depthOut.data(), pointsOut.data());
+}
+
+/*
+ * Runs the separate passes of the depth preprocessing reference.
+ * @param input Input of the depth preprocessing.
+ * @param preprocess Reference.
+ * @param depthOut Output RGB-D map.
+ * @param pointsOut Output points.
+ * @param pointsTmp Intermediate points.
+ */
+void runMultiPass(const PreprocessFrame& input, em::DepthPreprocess& preprocess, std::vector<glm::vec4>& depthOut, std::vector<glm::vec4>& pointsOut,
+	std::vector<glm::vec4>& pointsTmp) {
+	depthOut.assign(input.depthMap.size(), glm::vec4(0.f));
+	pointsOut = input.pointsMap;
+	pointsTmp.assign(input.pointsMap.size(), glm::vec4(0.f));
+
+	preprocess.runMultiPass(input.depthMap.data(), pointsOut.data(), input.colorImage.data(), input.colorWidth, input.colorHeight,
+		input.ptMapping.get(), input.params, depthOut.data(), pointsTmp.data());
+}
+
+/*
+ * Formats the image accesses of a run.
+ * @param traffic Image accesses.
+ * @return Accesses as text.
+ */
+std::string formatTraffic(const em::ImageTraffic& traffic) {
+	std::stringstream text;
+	text << traffic.nbrDispatches << " dispatches, " << traffic.nbrReads << " reads, " << traffic.nbrWrites << " writes, "
+		<< traffic.nbrSharedReads << " shared reads";
+
+	return text.str();
+}
+
+/*
+ * Runs the fused and the separate passes of the depth preprocessing reference on the frames of a session and checks
+ * they produce the same maps.
+ * @param session Session whose frames are preprocessed.
+ * @param details Frames compared and image accesses of the last one.
+ * @return True if both produce the same maps for every frame.
+ */
+bool checkDepthPreprocess(const Session& session, std::string& details) {
+	std::vector<glm::vec4> depthFused, pointsFused, depthMulti, pointsMulti, pointsTmp;
+	em::ImageTraffic trafficFused, trafficMulti;
+	size_t nbrFrames = 0, nbrDiff = 0, nbrFilled = 0, nbrReliable = 0;
+	for (size_t f = 0; f < session.size(); f++) {
+		const SessionFrame& frame = session.at(f);
+		if (!frame.img)
+			continue;
+
+		std::shared_ptr<PreprocessFrame> input = createPreprocessFrame(session, frame);
+		em::DepthPreprocess preprocess(input->width, input->height);
+
+		runFused(*input, preprocess, depthFused, pointsFused);
+		trafficFused = preprocess.getLastTraffic();
+		runMultiPass(*input, preprocess, depthMulti, pointsMulti, pointsTmp);
+		trafficMulti = preprocess.getLastTraffic();
+
+		for (size_t i = 0; i < depthFused.size(); i++) {
+			if (memcmp(&depthFused[i], &depthMulti[i], sizeof(glm::vec4)) || memcmp(&pointsFused[i], &pointsMulti[i], sizeof(glm::vec4)))
+				nbrDiff++;
+			if (input->pointsMap[i].w == 0.f && pointsFused[i].w != 0.f)
+				nbrFilled++;
+			if (pointsFused[i].w > 2.f)
+				nbrReliable++;
+		}
+		nbrFrames++;
+	}
+
+	std::stringstream text;
+	text << nbrDiff << " pixels differ in " << nbrFrames << " frames (" << nbrReliable << " reliable, " << nbrFilled << " filled), fused: "
+		<< formatTraffic(trafficFused) << ", multipass: " << formatTraffic(trafficMulti);
+	details = text.str();
+
+	return nbrFrames && nbrReliable && nbrFilled && !nbrDiff;
+}
+
+/*
+ * Samples projected to the EM in a frame, with several samples per texel.
+ */
+struct ScatterFrame {
+	std::vector<glm::vec4> samplesRef;  /*!< Reference samples (RGB-D). */
+	std::vector<glm::vec4> samplesCur;  /*!< Current samples (RGB-D, reliability as depth's sign). */
+	std::vector<glm::vec4> samplesData; /*!< Sample data (emPosX, emPosY, devDist, cosPlane). */
+	glm::mat3              corrMtx;     /*!< Color correction matrix. */
+};
+
+/*
+ * Creates the samples of a frame covering a region of the EM, some of them missing, unreliable or behind the reference.
+ * @return Samples.
+ */
+std::shared_ptr<ScatterFrame> createScatterFrame() {
+	std::mt19937 rng(1);
+	std::uniform_real_distribution<float> uniform(0.f, 1.f);
+	std::uniform_int_distribution<int> distribX(0, ScatterRegionWidth - 1);
+	std::uniform_int_distribution<int> distribY(0, ScatterRegionHeight - 1);
+
+	std::shared_ptr<ScatterFrame> frame(new ScatterFrame());
+	frame->samplesRef.resize(ScatterSamples);
+	frame->samplesCur.resize(ScatterSamples);
+	frame->samplesData.resize(ScatterSamples);
+	frame->corrMtx = glm::mat3(1.05f, 0.02f, 0.f, 0.f, 0.97f, 0.01f, 0.01f, 0.f, 1.02f);
+
+	for (size_t i = 0; i < ScatterSamples; i++) {
+		glm::vec3 color(uniform(rng), uniform(rng), uniform(rng));
+
+		float curDepth = 0.5f + 4.f*uniform(rng);
+		float chance = uniform(rng);
+		if (chance < 0.1f)
+			curDepth = 0.f;       // Hole
+		else if (chance < 0.3f)
+			curDepth = -curDepth; // Unreliable
+
+		float refDepth = (uniform(rng) < 0.5f) ? 0.f : 0.5f + 4.f*uniform(rng);
+
+		frame->samplesRef[i] = glm::vec4(color, refDepth);
+		frame->samplesCur[i] = glm::vec4(color, curDepth);
+		frame->samplesData[i] = glm::vec4((float)(ScatterEMWidth / 2 + distribX(rng)) + 0.5f, (float)(ScatterEMHeight / 2 + distribY(rng)) + 0.5f,
+			0.2f*uniform(rng), uniform(rng));
+	}
+
+	return frame;
+}
+
+/*
+ * Projects the samples of a frame one at a time in sample order, keeping for every texel its samples in that order, and
+ * resolves the texels as the sorted scatter documents it.
+ * @param frame Samples.
+ * @param mode Resolution of the samples of a texel.
+ * @param envMap EM (RGB-D).
+ * @param nbrContended Number of texels updated by more than one sample.
+ */
+void scatterSerial(const ScatterFrame& frame, em::ScatterMode mode, std::vector<glm::vec4>& envMap, size_t& nbrContended) {
+	std::vector<std::vector<glm::vec4>> texels(envMap.size());
+	for (size_t i = 0; i < ScatterSamples; i++) {
+		glm::vec4 newData;
+		if (em::SortedScatter::projectSample(frame.samplesRef[i], frame.samplesCur[i], frame.samplesData[i], frame.corrMtx, false, newData))
+			texels[(int)frame.samplesData[i].y*ScatterEMWidth + (int)frame.samplesData[i].x].push_back(newData);
+	}
+
+	nbrContended = 0;
+	for (size_t t = 0; t < texels.size(); t++) {
+		const std::vector<glm::vec4>& values = texels[t];
+		if (values.empty())
+			continue;
+		if (values.size() > 1)
+			nbrContended++;
+
+		if (mode == em::ScatterUnordered) {
+			envMap[t] = values.back();
+		} else if (mode == em::ScatterNearest) {
+			envMap[t] = values[0];
+			for (size_t i = 1; i < values.size(); i++) {
+				if (std::abs(values[i].w) < std::abs(envMap[t].w))
+					envMap[t] = values[i];
+			}
+		} else {
+			glm::vec4 sumReliable(0.f), sumAll(0.f);
+			float nbrReliable = 0.f;
+			for (size_t i = 0; i < values.size(); i++) {
+				glm::vec4 absValue(values[i].x, values[i].y, values[i].z, std::abs(values[i].w));
+				if (values[i].w > 0.f) {
+					sumReliable += absValue;
+					nbrReliable += 1.f;
+				}
+				sumAll += absValue;
+			}
+
+			if (nbrReliable > 0.f) {
+				envMap[t] = sumReliable / nbrReliable;
+			} else {
+				envMap[t] = sumAll / (float)values.size();
+				envMap[t].w = -envMap[t].w;
+			}
+		}
+	}
+}
+
+/*
+ * Projects the samples of a frame with every scatter mode and several work-group sizes of the sort, and checks the EM
+ * matches the serial projection bitwise, so the result doesn't depend on the scheduling of the work groups.
+ * @param details Texels compared and contended.
+ * @return True if every projection matches the serial one.
+ */
+bool checkSortedScatter(std::string& details) {
+	std::shared_ptr<ScatterFrame> frame = createScatterFrame();
+	const em::ScatterMode modes[] = { em::ScatterUnordered, em::ScatterNearest, em::ScatterAverage };
+
+	size_t nbrDiff = 0, nbrContended = 0, nbrRuns = 0;
+	for (size_t m = 0; m < 3; m++) {
+		std::vector<glm::vec4> expected(ScatterEMWidth*ScatterEMHeight, glm::vec4(0.f));
+		scatterSerial(*frame, modes[m], expected, nbrContended);
+
+		for (size_t g = 0; g < sizeof(ScatterGroupSizes) / sizeof(ScatterGroupSizes[0]); g++) {
+			em::SortedScatter scatter(ScatterGroupSizes[g]);
+			std::vector<glm::vec4> envMap(ScatterEMWidth*ScatterEMHeight, glm::vec4(0.f));
+			scatter.project(frame->samplesRef.data(), frame->samplesCur.data(), frame->samplesData.data(), ScatterSamples, ScatterEMWidth, ScatterEMHeight,
+				frame->corrMtx, false, modes[m], envMap.data());
+
+			for (size_t t = 0; t < envMap.size(); t++) {
+				if (memcmp(&envMap[t], &expected[t], sizeof(glm::vec4)))
+					nbrDiff++;
+			}
+			nbrRuns++;
+		}
+	}
+
+	std::stringstream text;
+	text << nbrDiff << " texels differ in " << nbrRuns << " projections, " << nbrContended << " texels updated by several samples";
+	details = text.str();
+
+	return nbrContended && !nbrDiff;
+}
+
+void addEMBenchmarks(BenchmarkSuite& suite, const std::shared_ptr<Session>& session) {
+	suite.addCheck("em.sortedScatter.determinism", checkSortedScatter);
+
+	// Racy scatter of the GPU (last store wins) and sorted scatter, per sample projected
+	std::shared_ptr<ScatterFrame> scatterFrame = createScatterFrame();
+	const char* scatterNames[] = { "em.scatter.unordered", "em.scatter.sortedNearest", "em.scatter.sortedAverage" };
+	const em::ScatterMode scatterModes[] = { em::ScatterUnordered, em::ScatterNearest, em::ScatterAverage };
+	for (size_t m = 0; m < 3; m++) {
+		em::ScatterMode mode = scatterModes[m];
+		suite.add(scatterNames[m], [scatterFrame, mode]() {
+			em::SortedScatter scatter;
+			std::vector<glm::vec4> envMap(ScatterEMWidth*ScatterEMHeight, glm::vec4(0.f));
+
+			return BenchmarkSuite::measure([&]() {
+				scatter.project(scatterFrame->samplesRef.data(), scatterFrame->samplesCur.data(), scatterFrame->samplesData.data(), ScatterSamples,
+					ScatterEMWidth, ScatterEMHeight, scatterFrame->corrMtx, false, mode, envMap.data());
+			});
+		}, (double)ScatterSamples);
+	}
+
+	if (!session || !session->size())
+		return;
+
+	std::shared_ptr<Session> frames = session;
+	suite.addCheck("em.depthPreprocess.equivalence", [frames](std::string& details) {
+		return checkDepthPreprocess(*frames, details);
+	});
+
+	std::shared_ptr<PreprocessFrame> input = createPreprocessFrame(*session, session->at(session->size() / 2));
+	double nbrPixels = (double)input->width*input->height;
+
+	suite.add("em.depthPreprocess.fused", [input]() {
+		em::DepthPreprocess preprocess(input->width, input->height);
+		std::vector<glm::vec4> depthOut, pointsOut;
+
+		return BenchmarkSuite::measure([&]() {
+			runFused(*input, preprocess, depthOut, pointsOut);
+		});
+	}, nbrPixels);
+
+	suite.add("em.depthPreprocess.multiPass", [input]() {
+		em::DepthPreprocess preprocess(input->width, input->height);
+		std::vector<glm::vec4> depthOut, pointsOut, pointsTmp;
+
+		return BenchmarkSuite::measure([&]() {
+			runMultiPass(*input, preprocess, depthOut, pointsOut, pointsTmp);
+		});
+	}, nbrPixels);
+}
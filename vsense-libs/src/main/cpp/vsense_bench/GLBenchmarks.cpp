@@ -0,0 +1,872 @@
+#include "Cases.h"
+
+#include <vsense/common/Reduction.h>
+#include <vsense/em/SortedScatter.h>
+#include <vsense/gl/ComputeScheduler.h>
+#include <vsense/gl/ProgramCache.h>
+#include <vsense/gl/ReadbackRing.h>
+#include <vsense/gl/ShaderSource.h>
+
+#include <algorithm>
+#include <cfloat>
+#include <cstdio>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <random>
+#include <sstream>
+
+using namespace vsense;
+
+const glm::ivec2 CorrLocalSize(8, 8); // Work groups of the color correction, see Process.cpp
+const glm::ivec2 SHLocalSize(4, 4);   // Work groups of the SH coefficients, see Process.cpp
+const size_t NbrReductionGroups = 40;
+const size_t NbrRingFrames = 100;
+const size_t MaxRingSlots = 3;
+const size_t MaxRingLatency = 4;     // Frames before a copy finishes on the emulated GPU
+const uint32_t EMTexels = 1000 * 500; // Texels of the EM on the GPU, see Process.cpp
+const size_t NbrPipelineFrames = 3;   // The pending writes are carried over from the previous frames
+const uint32_t RecordedBinaryFormat = 0x52504256; // "VBPR"
+const char* ProgramCacheFolder = "./";            // The cache files are removed by the check
+
+/*
+ * A compute shader built with the reduction library, as assembled by Process.
+ */
+struct ReductionShader {
+	const char*              filename;  /*!< Filename of the shader, without the .in extension. */
+	glm::ivec2               localSize; /*!< Work-group size. */
+	std::vector<std::string> types;     /*!< Types with a reduction instantiated. */
+};
+
+const ReductionShader ReductionShaders[] = {
+	{ "environmentMapCorrect.comp", CorrLocalSize, { "float", "vec3", "mat3" } },
+	{ "envMapSHCoefficients.comp", SHLocalSize, { "vec4" } }
+};
+
+const char* GLSLVersions[] = { "310 es", "430" }; // Android and desktop, see the CMake scripts configuring the shaders
+
+/*
+ * Reads a shader of the assets, with the version configured by CMake.
+ * @param filename Filename of the shader, without the .in extension.
+ * @param version GLSL version.
+ * @param source Source of the shader.
+ * @return True if the file was read.
+ */
+bool readShader(const std::string& filename, const std::string& version, std::string& source) {
+	std::ifstream file(std::string(VSENSE_SHADER_DIR) + "/" + filename + ".in");
+	if (!file.is_open())
+		return false;
+
+	std::stringstream text;
+	text << file.rdbuf();
+	source = text.str();
+
+	const std::string token = "@VERSION_GLSL@";
+	size_t pos = source.find(token);
+	if (pos != std::string::npos)
+		source.replace(pos, token.size(), version);
+
+	return true;
+}
+
+/*
+ * Assembles a shader built with the reduction library.
+ * @param shader Shader to assemble.
+ * @param version GLSL version.
+ * @param source Assembled source.
+ * @return True if the shader and the library were read and assembled.
+ */
+bool assembleShader(const ReductionShader& shader, const std::string& version, std::string& source) {
+	std::string shaderSource, reductionLib, reductionTemplate;
+	if (!readShader(shader.filename, version, shaderSource) || !readShader("reduction.glsl", version, reductionLib) ||
+		!readShader("reductionType.glsl", version, reductionTemplate))
+		return false;
+
+	gl::ShaderSource assembler(shaderSource);
+	if (!assembler.setLocalSize(shader.localSize.x, shader.localSize.y))
+		return false;
+
+	for (size_t i = 0; i < shader.types.size(); i++)
+		assembler.addReductionType(shader.types[i]);
+
+	return assembler.assemble(reductionLib, reductionTemplate, source);
+}
+
+bool writeReductionShaders(const std::string& folder) {
+	for (size_t i = 0; i < sizeof(ReductionShaders) / sizeof(ReductionShader); i++) {
+		for (size_t v = 0; v < sizeof(GLSLVersions) / sizeof(const char*); v++) {
+			std::string source;
+			if (!assembleShader(ReductionShaders[i], GLSLVersions[v], source)) {
+				std::cout << "Unable to assemble " << ReductionShaders[i].filename << std::endl;
+				return false;
+			}
+
+			// glslangValidator infers the stage from the .comp extension
+			std::string name = ReductionShaders[i].filename;
+			std::string version = GLSLVersions[v];
+			version.erase(std::remove(version.begin(), version.end(), ' '), version.end());
+			name.insert(name.rfind('.'), "_" + version);
+
+			std::ofstream file(folder + "/" + name);
+			file << source;
+			if (!file.good()) {
+				std::cout << "Unable to write " << folder << "/" << name << std::endl;
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+/*
+ * Assembles the shaders built with the reduction library and checks every token was replaced.
+ * @param details Shaders assembled.
+ * @return True if every shader was assembled.
+ */
+bool checkReductionShaders(std::string& details) {
+	size_t nbrShaders = 0;
+	for (size_t i = 0; i < sizeof(ReductionShaders) / sizeof(ReductionShader); i++) {
+		std::string source;
+		if (!assembleShader(ReductionShaders[i], GLSLVersions[0], source) || source.find("REDUCTION_TYPE") != std::string::npos ||
+			source.find("@VERSION_GLSL@") != std::string::npos) {
+			details = std::string(ReductionShaders[i].filename) + " couldn't be assembled";
+			return false;
+		}
+
+		nbrShaders++;
+	}
+
+	std::stringstream text;
+	text << nbrShaders << " shaders assembled for GLSL " << GLSLVersions[0];
+	details = text.str();
+
+	return true;
+}
+
+/*
+ * Calculates the relative difference between a reduction and the sum in double precision.
+ * @param value Result of the reduction.
+ * @param expected Sum in double precision.
+ * @return Relative difference.
+ */
+float relativeError(float value, double expected) {
+	return (float)(fabs(value - expected) / std::max(fabs(expected), 1e-30));
+}
+
+/*
+ * Calculates the largest relative difference between the elements of a reduction and the sum in double precision.
+ * @param value Result of the reduction.
+ * @param expected Sum in double precision.
+ * @return Largest relative difference.
+ */
+float relativeError(const glm::vec4& value, const glm::dvec4& expected) {
+	float error = 0.f;
+	for (int i = 0; i < 4; i++)
+		error = std::max(error, relativeError(value[i], expected[i]));
+
+	return error;
+}
+
+/*
+ * Calculates the largest relative difference between the elements of a reduction and the sum in double precision.
+ * @param value Result of the reduction.
+ * @param expected Sum in double precision.
+ * @return Largest relative difference.
+ */
+float relativeError(const glm::mat3& value, const glm::dmat3& expected) {
+	float error = 0.f;
+	for (int i = 0; i < 3; i++) {
+		for (int j = 0; j < 3; j++)
+			error = std::max(error, relativeError(value[i][j], expected[i][j]));
+	}
+
+	return error;
+}
+
+/*
+ * Reduces the values of a dispatch as the shaders do and checks the partial results add up to the result and the
+ * result is within the rounding bound of the summation (depth of the tree plus number of work groups).
+ * @param values Value of every invocation, non-negative so the bound is relative to the sum.
+ * @param expected Sum in double precision.
+ * @param groupSize Number of invocations per work group.
+ * @param error Relative error found.
+ * @return True if the result is within the bound.
+ */
+template <typename T, typename D>
+bool checkDispatch(const std::vector<T>& values, const D& expected, size_t groupSize, float& error) {
+	common::WorkGroupReduction<T> reduction(groupSize);
+	size_t nbrGroups = values.size() / groupSize;
+
+	std::vector<T> partials(nbrGroups);
+	T result = reduction.reduceDispatch(values.data(), nbrGroups, partials.data());
+
+	T sum = partials[0];
+	for (size_t g = 1; g < nbrGroups; g++)
+		sum += partials[g];
+
+	error = relativeError(result, expected);
+
+	return sum == result && error <= (log2((double)groupSize) + nbrGroups)*FLT_EPSILON;
+}
+
+/*
+ * Emulates the reductions of the color correction (counts and mat3 moments) and of the SH coefficients (vec4) and
+ * compares them with the sums in double precision. The values are non-negative, as the counts and the moments.
+ * @param details Errors found.
+ * @return True if the counts are exact and the sums within the rounding bound.
+ */
+bool checkWorkGroupReduction(std::string& details) {
+	std::mt19937 rng(1);
+	std::uniform_real_distribution<float> distrib(0.f, 1.f);
+	std::uniform_int_distribution<int> distribCount(0, 16);
+
+	size_t corrGroupSize = CorrLocalSize.x*CorrLocalSize.y;
+	size_t nbrCorr = corrGroupSize*NbrReductionGroups;
+
+	// Samples used per invocation, 4x4 at most, which must be exact
+	std::vector<float> counts(nbrCorr);
+	double expectedCount = 0.;
+	for (size_t i = 0; i < nbrCorr; i++) {
+		counts[i] = (float)distribCount(rng);
+		expectedCount += counts[i];
+	}
+
+	float errorCount;
+	bool isCountValid = checkDispatch(counts, expectedCount, corrGroupSize, errorCount) && errorCount == 0.f;
+
+	std::vector<glm::mat3> moments(nbrCorr);
+	glm::dmat3 expectedMoments(0.);
+	for (size_t i = 0; i < nbrCorr; i++) {
+		glm::vec3 color(distrib(rng), distrib(rng), distrib(rng));
+		moments[i] = glm::outerProduct(color, color);
+		expectedMoments += glm::dmat3(moments[i]);
+	}
+
+	float errorMoments;
+	bool isMomentsValid = checkDispatch(moments, expectedMoments, corrGroupSize, errorMoments);
+
+	size_t shGroupSize = SHLocalSize.x*SHLocalSize.y;
+	size_t nbrSH = shGroupSize*NbrReductionGroups;
+	std::vector<glm::vec4> coeffs(nbrSH);
+	glm::dvec4 expectedCoeffs(0.);
+	for (size_t i = 0; i < nbrSH; i++) {
+		coeffs[i] = glm::vec4(distrib(rng), distrib(rng), distrib(rng), distrib(rng));
+		expectedCoeffs += glm::dvec4(coeffs[i]);
+	}
+
+	float errorCoeffs;
+	bool isCoeffsValid = checkDispatch(coeffs, expectedCoeffs, shGroupSize, errorCoeffs);
+
+	std::stringstream text;
+	text << "relative errors: count " << errorCount << ", mat3 " << errorMoments << ", vec4 " << errorCoeffs;
+	details = text.str();
+
+	return isCountValid && isMomentsValid && isCoeffsValid;
+}
+
+/*
+ * Runs a session through a readback ring, every frame the emulated GPU progresses, the frame index is copied into a
+ * slot and the newest finished result is retrieved.
+ * @param nbrSlots Number of slots.
+ * @param latency Frames before a copy finishes.
+ * @param details Frame where the ring misbehaved.
+ * @return True if every result is retrieved in order, with the age of min(latency, slots - 1) frames, and the ring
+ * blocks only if the latency is over that age.
+ */
+bool checkRing(size_t nbrSlots, size_t latency, std::string& details) {
+	std::shared_ptr<gl::CPUReadbackBackend> backend(new gl::CPUReadbackBackend(latency));
+	gl::ReadbackRing ring(backend, nbrSlots, sizeof(uint64_t));
+
+	uint64_t expectedAge = std::min(latency, nbrSlots - 1);
+	uint64_t lastFrame = 0;
+	std::stringstream text;
+	for (uint64_t frame = 0; frame < NbrRingFrames; frame++) {
+		backend->advance();
+
+		size_t slot = ring.acquire(frame);
+		backend->write(slot, &frame);
+		ring.submit(slot);
+
+		uint64_t result, age;
+		bool isRetrieved = ring.retrieve(&result, frame, age);
+		if (frame < expectedAge) { // Nothing finished yet
+			if (!isRetrieved)
+				continue;
+
+			text << nbrSlots << " slots, latency " << latency << ": frame " << result << " retrieved at frame " << frame;
+			details = text.str();
+			return false;
+		}
+
+		if (!isRetrieved || age != expectedAge || result != frame - age || (frame > expectedAge && result <= lastFrame)) {
+			text << nbrSlots << " slots, latency " << latency << ": at frame " << frame << " retrieved " << isRetrieved << ", age " << age;
+			details = text.str();
+			return false;
+		}
+		lastFrame = result;
+	}
+
+	if ((ring.getNbrBlocking() > 0) != (latency > nbrSlots - 1)) {
+		text << nbrSlots << " slots, latency " << latency << ": blocked " << ring.getNbrBlocking() << " times";
+		details = text.str();
+		return false;
+	}
+
+	// The synchronous fallback retrieves the newest result
+	size_t slot = ring.acquire(NbrRingFrames);
+	uint64_t frame = NbrRingFrames;
+	backend->write(slot, &frame);
+	ring.submit(slot);
+
+	uint64_t result, age;
+	if (!ring.retrieveNewest(&result, NbrRingFrames, age) || result != NbrRingFrames || age || ring.getNbrInFlight()) {
+		text << nbrSlots << " slots, latency " << latency << ": the newest result wasn't retrieved";
+		details = text.str();
+		return false;
+	}
+
+	return true;
+}
+
+/*
+ * Checks the readback ring with every number of slots and latency up to the maximums.
+ * @param details Configurations checked or the first failure.
+ * @return True if every configuration behaves as documented.
+ */
+bool checkReadbackRing(std::string& details) {
+	for (size_t nbrSlots = 1; nbrSlots <= MaxRingSlots; nbrSlots++) {
+		for (size_t latency = 0; latency <= MaxRingLatency; latency++) {
+			if (!checkRing(nbrSlots, latency, details))
+				return false;
+		}
+	}
+
+	std::stringstream text;
+	text << "1-" << MaxRingSlots << " slots, latency 0-" << MaxRingLatency << " frames, " << NbrRingFrames << " frames each";
+	details = text.str();
+
+	return true;
+}
+
+/*
+ * Retrieves the barrier bit making a shader write visible to an access.
+ * @param type Type of access.
+ * @return Barrier bit.
+ */
+unsigned int visibilityBit(gl::AccessType type) {
+	switch (type) {
+	case gl::AccessImageLoad:
+	case gl::AccessImageStore:
+		return gl::BarrierImageAccess;
+	case gl::AccessAtomicCounter:
+		return gl::BarrierAtomicCounter;
+	case gl::AccessTextureUpdate:
+		return gl::BarrierTextureUpdate;
+	case gl::AccessBufferUpdate:
+		return gl::BarrierBufferUpdate;
+	case gl::AccessPixelRead:
+		return gl::BarrierFramebuffer;
+	}
+
+	return gl::BarrierNone;
+}
+
+/*
+ * The ValidatingCommands class runs the stages of the scheduler and checks every access to a resource written by a
+ * shader comes after a barrier with the bit it requires.
+ */
+class ValidatingCommands : public gl::ComputeCommands {
+public:
+	ValidatingCommands() : nbrHazards_(0) {}
+
+	void memoryBarrier(unsigned int bits) {
+		for (std::map<const void*, unsigned int>::iterator it = visibleBits_.begin(); it != visibleBits_.end(); ++it)
+			it->second |= bits;
+	}
+
+	void runStage(const gl::ComputeStage& stage) {
+		for (size_t i = 0; i < stage.accesses.size(); i++) {
+			std::map<const void*, unsigned int>::const_iterator it = visibleBits_.find(stage.accesses[i].resource);
+			if ((it != visibleBits_.end()) && !(it->second & visibilityBit(stage.accesses[i].type)))
+				nbrHazards_++;
+		}
+
+		for (size_t i = 0; i < stage.accesses.size(); i++) {
+			if ((stage.accesses[i].type == gl::AccessImageStore) || (stage.accesses[i].type == gl::AccessAtomicCounter))
+				visibleBits_[stage.accesses[i].resource] = gl::BarrierNone;
+		}
+
+		if (stage.run)
+			stage.run();
+	}
+
+	/*
+	 * Retrieves the number of accesses without the barrier they require.
+	 * @return Number of accesses.
+	 */
+	size_t getNbrHazards() const { return nbrHazards_; }
+
+private:
+	std::map<const void*, unsigned int> visibleBits_; /*!< Barrier bits issued since the last shader write. */
+	size_t                              nbrHazards_;  /*!< Number of accesses without the barrier they require. */
+};
+
+/*
+ * Stages queued by em::Process for a frame, with the same accesses, run through the scheduler on the CPU. Only the
+ * addresses of the resources are used, so they are stand-ins for the textures and buffers.
+ */
+class EMPipelineTrace {
+public:
+	/*
+	 * Textures and buffers of the pipeline.
+	 */
+	enum Resource {
+		TexY = 0, TexC, ColorImg, PointCloud, PtMapping, DepthMap1, DepthMap2, PointsMap1, PointsMap2, SamplesRef, SamplesCur,
+		SamplesData, EMCur, Coverage, SortElements1, SortElements2, Projected, DigitOffsets, MatAAcc, MatBAcc, WCurAcc,
+		WRefAcc, UsedAcc, FinalData, ReductionCounter, RandomSamples, CoeffRAcc, CoeffGAcc, CoeffBAcc, CoeffAAcc,
+		CoeffFinal1, CoeffFinal2, NbrResources
+	};
+
+	/*
+	 * EMPipelineTrace constructor.
+	 * @param isFused True if the depth map is preprocessed in a single pass.
+	 * @param isSorted True if the samples are projected with the sorted scatter.
+	 */
+	EMPipelineTrace(bool isFused, bool isSorted) : isFused_(isFused), isSorted_(isSorted), frameIdx_(0), resources_(NbrResources) {}
+
+	/*
+	 * Queues and runs the stages of a frame integrated in the EM with color correction and SH coefficients, in the order
+	 * of Process::runEMShaders.
+	 */
+	void runFrame() {
+		scheduler_.resetCounters();
+		stages_.clear();
+		executed_.clear();
+
+		add("ConvertRGB", { load(TexY), load(TexC), store(ColorImg) });
+		add("DepthMapInit", { access(DepthMap1, gl::AccessTextureUpdate), access(DepthMap2, gl::AccessTextureUpdate),
+			access(PointsMap1, gl::AccessTextureUpdate), access(PointsMap2, gl::AccessTextureUpdate), load(PointCloud), load(ColorImg),
+			store(DepthMap1), store(PointsMap1) });
+
+		if (isFused_)
+			add("DepthMapPreprocess", { load(ColorImg), load(PtMapping), load(DepthMap1), store(DepthMap2), load(PointsMap1), store(PointsMap2) });
+		else {
+			add("DepthMapReliable", { load(DepthMap1), load(PointsMap1), store(PointsMap2) });
+			add("DepthMapHoleFilling", { load(ColorImg), load(PtMapping), load(DepthMap1), store(DepthMap2), load(PointsMap2), store(PointsMap1) });
+		}
+
+		Resource pointsMap = isFused_ ? PointsMap2 : PointsMap1;
+		add("EMSampling", { access(SamplesRef, gl::AccessTextureUpdate), access(SamplesCur, gl::AccessTextureUpdate),
+			access(SamplesData, gl::AccessTextureUpdate), load(DepthMap2), load(pointsMap), load(EMCur), store(SamplesRef),
+			store(SamplesCur), store(SamplesData) });
+
+		add("EMColorCorrection", { access(FinalData, gl::AccessTextureUpdate), access(ReductionCounter, gl::AccessBufferUpdate),
+			access(ReductionCounter, gl::AccessAtomicCounter), load(SamplesRef), load(SamplesCur), store(MatAAcc), store(MatBAcc),
+			store(WCurAcc), store(WRefAcc), store(UsedAcc), store(FinalData) });
+		add("EMColorCorrectionReadback", { access(FinalData, gl::AccessPixelRead) });
+		scheduler_.flush(commands_);
+
+		if (isSorted_) {
+			add("EMProjectionKeys", { load(SamplesRef), load(SamplesCur), load(SamplesData), store(SortElements1), store(Projected) });
+
+			Resource elementsIn = SortElements1, elementsOut = SortElements2;
+			for (int pass = 0; pass < em::SortedScatter::getNbrPasses(EMTexels); pass++) {
+				add("EMProjectionSortCount", { load(elementsIn), store(DigitOffsets) });
+				add("EMProjectionSortScan", { load(DigitOffsets), store(DigitOffsets) });
+				add("EMProjectionSortScatter", { load(elementsIn), load(DigitOffsets), store(elementsOut) });
+				std::swap(elementsIn, elementsOut);
+			}
+
+			add("EMProjectionResolve", { load(elementsIn), load(Projected), store(EMCur), load(Coverage), store(Coverage) });
+		} else
+			add("EMProjection", { load(SamplesRef), load(SamplesCur), load(SamplesData), store(EMCur), load(Coverage), store(Coverage) });
+
+		// The SH coefficients alternate between two textures
+		Resource coeffFinal = (frameIdx_ % 2) ? CoeffFinal2 : CoeffFinal1;
+		add("EMSHCoefficients", { access(coeffFinal, gl::AccessTextureUpdate), access(ReductionCounter, gl::AccessBufferUpdate),
+			access(ReductionCounter, gl::AccessAtomicCounter), load(EMCur), load(RandomSamples), store(CoeffRAcc), store(CoeffGAcc),
+			store(CoeffBAcc), store(CoeffAAcc), store(coeffFinal) });
+		add("EMSHCoefficientsReadback", { access(coeffFinal, gl::AccessPixelRead) });
+		scheduler_.synchronize(commands_);
+
+		// Hands over the textures to the rendering
+		scheduler_.synchronize(commands_);
+		frameIdx_++;
+	}
+
+	/*
+	 * Checks the stages depending on each other ran in the order they were queued.
+	 * @return True if the order of the dependent stages was kept.
+	 */
+	bool isOrderKept() const {
+		std::vector<size_t> position(stages_.size());
+		for (size_t i = 0; i < executed_.size(); i++)
+			position[executed_[i]] = i;
+
+		for (size_t j = 0; j < stages_.size(); j++) {
+			for (size_t i = 0; i < j; i++) {
+				if (dependsOn(stages_[i], stages_[j]) && position[i] > position[j])
+					return false;
+			}
+		}
+
+		return executed_.size() == stages_.size();
+	}
+
+	/*
+	 * Retrieves the number of stages of the last frame.
+	 * @return Number of stages, one barrier each before the scheduler.
+	 */
+	unsigned int getNbrStages() const { return scheduler_.getNbrStages(); }
+
+	/*
+	 * Retrieves the number of barriers of the last frame.
+	 * @return Number of barriers.
+	 */
+	unsigned int getNbrBarriers() const { return scheduler_.getNbrBarriers(); }
+
+	/*
+	 * Retrieves the number of accesses without the barrier they require.
+	 * @return Number of accesses.
+	 */
+	size_t getNbrHazards() const { return commands_.getNbrHazards(); }
+
+private:
+	/*
+	 * Creates the access to a resource.
+	 * @param res Resource.
+	 * @param type Type of access.
+	 * @return Access.
+	 */
+	gl::ResourceAccess access(Resource res, gl::AccessType type) const { return gl::ResourceAccess(&resources_[res], type); }
+
+	/*
+	 * Creates an image load of a resource.
+	 * @param res Resource.
+	 * @return Access.
+	 */
+	gl::ResourceAccess load(Resource res) const { return access(res, gl::AccessImageLoad); }
+
+	/*
+	 * Creates an image store to a resource.
+	 * @param res Resource.
+	 * @return Access.
+	 */
+	gl::ResourceAccess store(Resource res) const { return access(res, gl::AccessImageStore); }
+
+	/*
+	 * Queues a stage, recording when it runs.
+	 * @param name Name of the stage.
+	 * @param accesses Resources accessed by the stage.
+	 */
+	void add(const std::string& name, const std::vector<gl::ResourceAccess>& accesses) {
+		size_t idx = stages_.size();
+		stages_.push_back(accesses);
+
+		std::vector<size_t>* executed = &executed_;
+		scheduler_.addStage(name, accesses, [executed, idx]() {
+			executed->push_back(idx);
+		});
+	}
+
+	/*
+	 * Checks if two stages depend on each other.
+	 * @param first Accesses of the first stage.
+	 * @param second Accesses of the second stage.
+	 * @return True if they share a resource written by at least one of them.
+	 */
+	static bool dependsOn(const std::vector<gl::ResourceAccess>& first, const std::vector<gl::ResourceAccess>& second) {
+		for (size_t i = 0; i < first.size(); i++) {
+			for (size_t j = 0; j < second.size(); j++) {
+				if ((first[i].resource == second[j].resource) && (isWriteAccess(first[i].type) || isWriteAccess(second[j].type)))
+					return true;
+			}
+		}
+
+		return false;
+	}
+
+	/*
+	 * Checks if an access writes the resource.
+	 * @param type Type of access.
+	 * @return True if the resource is written.
+	 */
+	static bool isWriteAccess(gl::AccessType type) {
+		return (type != gl::AccessImageLoad) && (type != gl::AccessPixelRead);
+	}
+
+	bool                                         isFused_;    /*!< True if the depth map is preprocessed in a single pass. */
+	bool                                         isSorted_;   /*!< True if the samples are projected with the sorted scatter. */
+	size_t                                       frameIdx_;   /*!< Index of the frame. */
+	std::vector<char>                            resources_;  /*!< Stand-ins of the resources. */
+	gl::ComputeScheduler                         scheduler_;  /*!< Scheduler under test. */
+	ValidatingCommands                           commands_;   /*!< Receiver of the commands. */
+	std::vector<std::vector<gl::ResourceAccess>> stages_;     /*!< Accesses of the stages queued in the frame. */
+	std::vector<size_t>                          executed_;   /*!< Stages of the frame in running order. */
+};
+
+/*
+ * Runs the EM pipeline through the scheduler for every depth preprocessing and projection mode, and compares its
+ * barriers with the single barrier per stage issued before the scheduler.
+ * @param details Stages and barriers per frame of every mode.
+ * @return True if no access misses its barrier, the dependent stages keep their order and fewer barriers are issued.
+ */
+bool checkEMPipelineBarriers(std::string& details) {
+	std::stringstream text;
+	bool isValid = true;
+	for (int mode = 0; mode < 4; mode++) {
+		bool isFused = (mode & 1) != 0, isSorted = (mode & 2) != 0;
+
+		EMPipelineTrace trace(isFused, isSorted);
+		bool isOrderKept = true;
+		for (size_t frame = 0; frame < NbrPipelineFrames; frame++) {
+			trace.runFrame();
+			isOrderKept = isOrderKept && trace.isOrderKept();
+		}
+
+		isValid = isValid && isOrderKept && !trace.getNbrHazards() && (trace.getNbrBarriers() < trace.getNbrStages());
+
+		text << (mode ? ", " : "") << (isFused ? "fused" : "multipass") << "/" << (isSorted ? "sorted" : "unordered") << " "
+			<< trace.getNbrBarriers() << " barriers for " << trace.getNbrStages() << " stages";
+		if (trace.getNbrHazards())
+			text << " (" << trace.getNbrHazards() << " hazards)";
+		if (!isOrderKept)
+			text << " (reordered)";
+	}
+	details = text.str();
+
+	return isValid;
+}
+
+/*
+ * The RecordedProgramDriver class emulates the driver without a GPU, so the keys, storage and invalidation of the
+ * program cache can be checked. The binaries hold the driver identifier and the sources, and a binary is rejected if it
+ * was created by another driver identifier or if the rejection of binaries is forced.
+ */
+class RecordedProgramDriver : public gl::ProgramDriver {
+public:
+	/*
+	 * RecordedProgramDriver constructor.
+	 * @param driverId Identifier of the driver.
+	 */
+	RecordedProgramDriver(const std::string& driverId) : driverId_(driverId), rejectBinaries_(false), nbrCompiles_(0), nbrBinaryLoads_(0) {}
+
+	/*
+	 * Updates the identifier of the driver, emulating a driver update.
+	 * @param driverId Identifier of the driver.
+	 */
+	void setDriverId(const std::string& driverId) { driverId_ = driverId; }
+
+	/*
+	 * Forces the rejection of every binary.
+	 * @param reject True if the binaries are to be rejected.
+	 */
+	void setRejectBinaries(bool reject) { rejectBinaries_ = reject; }
+
+	/*
+	 * Retrieves the number of compilations.
+	 * @return Number of compilations.
+	 */
+	size_t getNbrCompiles() const { return nbrCompiles_; }
+
+	/*
+	 * Retrieves the number of binaries loaded.
+	 * @return Number of binaries.
+	 */
+	size_t getNbrBinaryLoads() const { return nbrBinaryLoads_; }
+
+	std::string getDriverId() { return driverId_; }
+
+	bool supportsBinaries() { return true; }
+
+	unsigned int compile(const std::vector<std::pair<gl::ShaderStage, std::string>>& sources) {
+		nbrCompiles_++;
+
+		std::string binary = driverId_ + "\n";
+		for (size_t i = 0; i < sources.size(); i++) {
+			if (sources[i].second.find("#version") == std::string::npos) // Emulates a compilation error
+				return 0;
+
+			binary += std::to_string((int)sources[i].first) + ":" + sources[i].second + "\n";
+		}
+
+		programs_.push_back(binary);
+
+		return (unsigned int)programs_.size();
+	}
+
+	bool getBinary(unsigned int program, uint32_t& format, std::vector<unsigned char>& binary) {
+		if (!program || (program > programs_.size()))
+			return false;
+
+		format = RecordedBinaryFormat;
+		binary.assign(programs_[program - 1].begin(), programs_[program - 1].end());
+
+		return true;
+	}
+
+	unsigned int loadBinary(uint32_t format, const std::vector<unsigned char>& binary) {
+		if (rejectBinaries_ || (format != RecordedBinaryFormat))
+			return 0;
+
+		std::string content(binary.begin(), binary.end());
+		if (content.compare(0, driverId_.size() + 1, driverId_ + "\n")) // Created by another driver
+			return 0;
+
+		nbrBinaryLoads_++;
+		programs_.push_back(content);
+
+		return (unsigned int)programs_.size();
+	}
+
+	/*
+	 * Retrieves the binary of a program, as created or loaded.
+	 * @param program Program.
+	 * @return Binary, empty if the program doesn't exist.
+	 */
+	std::string getProgramBinary(unsigned int program) const {
+		return (program && (program <= programs_.size())) ? programs_[program - 1] : std::string();
+	}
+
+private:
+	std::string              driverId_;       /*!< Identifier of the driver. */
+	bool                     rejectBinaries_; /*!< True if every binary is rejected. */
+	std::vector<std::string> programs_;       /*!< Binary of every program, indexed by program - 1. */
+	size_t                   nbrCompiles_;    /*!< Number of compilations. */
+	size_t                   nbrBinaryLoads_; /*!< Number of binaries loaded. */
+};
+
+/*
+ * Checks if a file exists.
+ * @param filename Path of the file.
+ * @return True if it can be opened.
+ */
+bool fileExists(const std::string& filename) {
+	std::ifstream file(filename, std::ios::in | std::ios::binary);
+
+	return file.is_open();
+}
+
+/*
+ * Creates a shader variant as used by the SH shaders, a vertex and a fragment stage with the SH order defined.
+ * @param order SH order.
+ * @return Shader variant.
+ */
+gl::ShaderVariant createVariant(int order) {
+	gl::ShaderVariant variant;
+	variant.addStage(gl::StageVertex, "#version 310 es\nvoid main() { gl_Position = vec4(float(SH_ORDER)); }\n");
+	variant.addStage(gl::StageFragment, "#version 310 es\nprecision mediump float;\nout vec4 color;\nvoid main() { color = vec4(1.0); }\n");
+	variant.addDefine("SH_ORDER", order);
+
+	return variant;
+}
+
+/*
+ * Creates programs through the program cache with the recorded driver and checks their keys, the binaries stored in
+ * memory and on disk, and that the binaries are discarded when invalidated, damaged, rejected or from another driver.
+ * @param details First step failing or programs created.
+ * @return True if every step compiles or loads the expected programs.
+ */
+bool checkProgramCache(std::string& details) {
+	std::shared_ptr<RecordedProgramDriver> driver(new RecordedProgramDriver("Recorded|1"));
+	gl::ShaderVariant variant = createVariant(2);
+
+	std::vector<std::pair<gl::ShaderStage, std::string>> sources, sourcesOther;
+	if (!variant.assemble(sources) || !createVariant(3).assemble(sourcesOther)) {
+		details = "the variants couldn't be assembled";
+		return false;
+	}
+
+	// Keys: the same sources share the key, the definitions and the driver change it
+	gl::ProgramCache cache(driver, ProgramCacheFolder);
+	uint64_t key = cache.getKey(sources);
+	driver->setDriverId("Recorded|2");
+	uint64_t keyDriver = cache.getKey(sources);
+	driver->setDriverId("Recorded|1");
+	if ((key != cache.getKey(sources)) || (key == cache.getKey(sourcesOther)) || (key == keyDriver)) {
+		details = "the keys don't identify the sources and the driver";
+		return false;
+	}
+
+	std::string filename = cache.getFilename(key);
+	std::remove(filename.c_str());
+
+	// Storage: compiled once, then loaded from memory and, by a new cache, from disk
+	unsigned int program = cache.getProgram(variant);
+	bool isValid = program && fileExists(filename) && cache.getProgram(variant) && (cache.getNbrCompiled() == 1) && (cache.getNbrLoaded() == 1);
+	if (!isValid)
+		details = "the program isn't compiled once and loaded from memory";
+
+	gl::ProgramCache cacheDisk(driver, ProgramCacheFolder);
+	unsigned int programDisk = isValid ? cacheDisk.getProgram(variant) : 0;
+	if (isValid && (!programDisk || (cacheDisk.getNbrLoaded() != 1) || (driver->getProgramBinary(programDisk) != driver->getProgramBinary(program)))) {
+		details = "the program isn't loaded from disk";
+		isValid = false;
+	}
+
+	// Invalidation: the file is removed and the program compiled again
+	if (isValid) {
+		cacheDisk.invalidate(key);
+		if (fileExists(filename) || !cacheDisk.getProgram(variant) || (cacheDisk.getNbrCompiled() != 1)) {
+			details = "the invalidated program isn't compiled again";
+			isValid = false;
+		}
+	}
+
+	// A damaged file is discarded
+	if (isValid) {
+		std::fstream file(filename, std::ios::in | std::ios::out | std::ios::binary);
+		file.seekp(-1, std::ios::end);
+		file.put('#');
+		file.close();
+
+		gl::ProgramCache cacheDamaged(driver, ProgramCacheFolder);
+		if (!cacheDamaged.getProgram(variant) || (cacheDamaged.getNbrDiscarded() != 1) || (cacheDamaged.getNbrCompiled() != 1)) {
+			details = "the damaged file isn't discarded";
+			isValid = false;
+		}
+	}
+
+	// A binary rejected by the driver is discarded and compiled again
+	if (isValid) {
+		driver->setRejectBinaries(true);
+		gl::ProgramCache cacheRejected(driver, ProgramCacheFolder);
+		if (!cacheRejected.getProgram(variant) || (cacheRejected.getNbrDiscarded() != 1) || (cacheRejected.getNbrCompiled() != 1)) {
+			details = "the rejected binary isn't compiled again";
+			isValid = false;
+		}
+		driver->setRejectBinaries(false);
+	}
+
+	// A driver update changes the key, the binary of the previous driver isn't loaded
+	if (isValid) {
+		driver->setDriverId("Recorded|2");
+		gl::ProgramCache cacheUpdated(driver, ProgramCacheFolder);
+		if (!cacheUpdated.getProgram(variant) || (cacheUpdated.getNbrLoaded() != 0) || (cacheUpdated.getNbrCompiled() != 1)) {
+			details = "the binary of the previous driver is loaded";
+			isValid = false;
+		}
+		std::remove(cacheUpdated.getFilename(keyDriver).c_str());
+		driver->setDriverId("Recorded|1");
+	}
+
+	std::remove(filename.c_str());
+
+	if (isValid) {
+		std::stringstream text;
+		text << driver->getNbrCompiles() << " compilations, " << driver->getNbrBinaryLoads() << " binaries loaded";
+		details = text.str();
+	}
+
+	return isValid;
+}
+
+void addGLBenchmarks(BenchmarkSuite& suite) {
+	suite.addCheck("gl.reductionShaders", checkReductionShaders);
+	suite.addCheck("gl.workGroupReduction", checkWorkGroupReduction);
+	suite.addCheck("gl.readbackRing", checkReadbackRing);
+	suite.addCheck("gl.computeScheduler.em", checkEMPipelineBarriers);
+	suite.addCheck("gl.programCache", checkProgramCache);
+}
@@ -0,0 +1,346 @@
+#include "Cases.h"
+
+#include <vsense/depth/DepthMap.h>
+#include <vsense/io/Image.h>
+#include <vsense/io/RemapCache.h>
+#include <vsense/io/YUVConverter.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+using namespace vsense;
+
+const size_t RemapWidth = 960;   // Synthetic color camera, see Session::getSyntheticConfig
+const size_t RemapHeight = 540;
+const glm::dvec2 RemapF(740.0, 740.0);
+const glm::dvec2 RemapC(479.5, 269.5);
+const double RemapDistortion[5] = { 0.1, -0.2, 0.05, 0.0, 0.0 }; // Brown's 3 polynomial
+
+const size_t YUVWidth = 1920;  // Tango color camera
+const size_t YUVHeight = 1080;
+
+/*
+ * A NV21 frame, as delivered by the color camera.
+ */
+struct NV21Frame {
+	std::vector<uchar> y;  /*!< Luma plane. */
+	std::vector<uchar> vu; /*!< Interleaved chroma plane (V first). */
+};
+
+/*
+ * Creates a smooth RGBA image, so the quantization of the source locations stays within the documented tolerance.
+ * @return Image.
+ */
+std::shared_ptr<io::Image> createSmoothImage() {
+	std::shared_ptr<io::Image> img(new io::Image(RemapWidth, RemapHeight));
+	for (size_t row = 0; row < RemapHeight; row++) {
+		uchar* pixel = img->row(row);
+		for (size_t col = 0; col < RemapWidth; col++, pixel += 4) {
+			pixel[0] = (uchar)(255 * col / (RemapWidth - 1));
+			pixel[1] = (uchar)(255 * row / (RemapHeight - 1));
+			pixel[2] = (uchar)(127.5f + 127.5f*sinf(0.02f*col)*cosf(0.03f*row));
+			pixel[3] = 255;
+		}
+	}
+
+	return img;
+}
+
+/*
+ * Interpolates a channel of an image bilinearly.
+ * @param img Image.
+ * @param loc Location, its top-left and bottom-right neighbors must be within the image.
+ * @param chan Channel.
+ * @return Interpolated value.
+ */
+double bilinear(const io::Image& img, const glm::vec2& loc, int chan) {
+	size_t x0 = (size_t)floor(loc.x);
+	size_t y0 = (size_t)floor(loc.y);
+	double fx = loc.x - x0;
+	double fy = loc.y - y0;
+
+	const uchar* top = img.row_const(y0) + x0 * 4 + chan;
+	const uchar* bottom = img.row_const(y0 + 1) + x0 * 4 + chan;
+
+	return (top[0] * (1. - fx) + top[4] * fx)*(1. - fy) + (bottom[0] * (1. - fx) + bottom[4] * fx)*fy;
+}
+
+/*
+ * Undistorts an image evaluating the distortion polynomial for every pixel, as the remap cache replaces.
+ * @param src Image captured by the camera.
+ * @param dst Undistorted image.
+ */
+void undistortDirect(const io::Image& src, io::Image& dst) {
+	for (size_t row = 0; row < RemapHeight; row++) {
+		uchar* out = dst.row(row);
+		for (size_t col = 0; col < RemapWidth; col++, out += 4) {
+			glm::vec3 ray((float)((col - RemapC.x) / RemapF.x), (float)((row - RemapC.y) / RemapF.y), 1.f);
+			glm::vec2 loc = io::Image::undistortAndProject(ray, RemapDistortion, RemapF, RemapC);
+			if ((loc.x < 0.f) || (loc.y < 0.f) || (loc.x + 1.f >= RemapWidth) || (loc.y + 1.f >= RemapHeight)) {
+				out[0] = out[1] = out[2] = out[3] = 0;
+				continue;
+			}
+
+			for (int chan = 0; chan < 4; chan++)
+				out[chan] = (uchar)floor(bilinear(src, loc, chan) + 0.5);
+		}
+	}
+}
+
+/*
+ * Remaps an image and compares it with the bilinear interpolation at the quantized source locations, which must match
+ * exactly, and at the exact source locations, which must be within the documented tolerance (see io::RemapCache).
+ * @param details Largest differences found.
+ * @return True if the remapped image is within tolerance.
+ */
+bool checkRemap(std::string& details) {
+	std::shared_ptr<io::Image> src = createSmoothImage();
+	io::Image dst(RemapWidth, RemapHeight);
+
+	io::RemapCache cache;
+	cache.build(RemapWidth, RemapHeight, RemapDistortion, RemapF, RemapC);
+	cache.remap(*src, dst);
+
+	// Largest color difference between neighbor pixels
+	int maxStep = 0;
+	for (size_t row = 0; row + 1 < RemapHeight; row++) {
+		const uchar* pixel = src->row_const(row);
+		for (size_t col = 0; col + 1 < RemapWidth; col++, pixel += 4) {
+			for (int chan = 0; chan < 4; chan++)
+				maxStep = std::max(maxStep, std::max(abs(pixel[chan + 4] - pixel[chan]), abs(pixel[chan + RemapWidth * 4] - pixel[chan])));
+		}
+	}
+
+	double maxDiffQuantized = 0., maxDiffExact = 0.;
+	for (size_t row = 0; row < RemapHeight; row++) {
+		const uchar* out = dst.row_const(row);
+		for (size_t col = 0; col < RemapWidth; col++, out += 4) {
+			glm::vec2 locQuantized;
+			if (!cache.sourceLocation(row, col, locQuantized))
+				continue;
+
+			glm::vec3 ray((float)((col - RemapC.x) / RemapF.x), (float)((row - RemapC.y) / RemapF.y), 1.f);
+			glm::vec2 locExact = io::Image::undistortAndProject(ray, RemapDistortion, RemapF, RemapC);
+
+			for (int chan = 0; chan < 4; chan++) {
+				maxDiffQuantized = std::max(maxDiffQuantized, fabs(out[chan] - floor(bilinear(*src, locQuantized, chan) + 0.5)));
+				if (locExact.x + 1.f < RemapWidth && locExact.y + 1.f < RemapHeight)
+					maxDiffExact = std::max(maxDiffExact, fabs(out[chan] - bilinear(*src, locExact, chan)));
+			}
+		}
+	}
+
+	double tolerance = 1. + maxStep / 128.;
+
+	char buffer[160];
+	sprintf(buffer, "%.0f from the quantized locations, %.3f from the exact ones (tolerance %.3f)", maxDiffQuantized, maxDiffExact, tolerance);
+	details = buffer;
+
+	return maxDiffQuantized == 0. && maxDiffExact <= tolerance;
+}
+
+/*
+ * Maps the pixels of the depth map to the color image of a frame with the remap cache and evaluating the distortion
+ * polynomial for every pixel, as the hole-filling did, and checks they agree.
+ * @param session Session providing the mapping of the depth pixels and the pose between the cameras.
+ * @param details Pixels compared.
+ * @return True if every pixel maps to the same color pixel.
+ */
+bool checkColorMap(const Session& session, std::string& details) {
+	session.useDepthMapping();
+
+	const std::shared_ptr<glm::vec2>& ptMap = depth::DepthMap::getDepthMapping();
+	const io::ImageMetadata& imData = session.at(0).imData;
+	glm::mat4 imPose = io::ImageMetadata(imData).asPose();
+	size_t width = depth::DepthMap::width();
+	size_t height = depth::DepthMap::height();
+
+	io::RemapCache cache;
+	cache.build(ptMap.get(), width, height, imPose, imData.width_, imData.height_, imData.distortion_, imData.f_, imData.c_);
+
+	size_t nbrDiff = 0, nbrInside = 0;
+	for (size_t idx = 0; idx < width*height; idx++) {
+		const glm::vec2& ptDepth = ptMap.get()[idx];
+
+		glm::vec3 ptTrans = glm::vec3(imPose*glm::vec4(ptDepth.x, ptDepth.y, 1.f, 1.f));
+		glm::vec2 ptColor = io::Image::undistortAndProject(ptTrans, imData.distortion_, imData.f_, imData.c_);
+		ptColor.x = floor(ptColor.x + 0.5f);
+		ptColor.y = floor(ptColor.y + 0.5f);
+
+		int32_t expected = -1;
+		if ((ptColor.x >= 0) && (ptColor.x < imData.width_) && (ptColor.y >= 0) && (ptColor.y < imData.height_))
+			expected = (int32_t)(ptColor.y*imData.width_ + ptColor.x);
+
+		if (expected >= 0)
+			nbrInside++;
+		if (cache.nearestSource(idx) != expected)
+			nbrDiff++;
+	}
+
+	char buffer[128];
+	sprintf(buffer, "%u of %u depth pixels differ, %u inside the color image", (unsigned int)nbrDiff, (unsigned int)(width*height), (unsigned int)nbrInside);
+	details = buffer;
+
+	return nbrInside && !nbrDiff;
+}
+
+/*
+ * Creates a NV21 frame encoding a smooth image with noise, so every chroma and luma value is likely to appear.
+ * @return Frame.
+ */
+std::shared_ptr<NV21Frame> createNV21Frame() {
+	std::mt19937 rng(1);
+	std::uniform_int_distribution<int> noise(-24, 24);
+
+	std::vector<uchar> rgba(YUVWidth*YUVHeight * 4);
+	uchar* pixel = rgba.data();
+	for (size_t row = 0; row < YUVHeight; row++) {
+		for (size_t col = 0; col < YUVWidth; col++, pixel += 4) {
+			float base[3] = { 255.f * col / (YUVWidth - 1), 255.f * row / (YUVHeight - 1), 127.5f + 127.5f*sinf(0.01f*col)*cosf(0.02f*row) };
+			for (int chan = 0; chan < 3; chan++)
+				pixel[chan] = (uchar)std::max(std::min(base[chan] + noise(rng), 255.f), 0.f);
+			pixel[3] = 255;
+		}
+	}
+
+	std::shared_ptr<NV21Frame> frame(new NV21Frame());
+	frame->y.resize(YUVWidth*YUVHeight);
+	frame->vu.resize(YUVWidth*YUVHeight / 2);
+	io::YUVConverter::convertToNV21(rgba.data(), YUVWidth, YUVHeight, frame->y.data(), frame->vu.data());
+
+	return frame;
+}
+
+/*
+ * Converts a NV21 frame to RGBA8 one pixel at a time in floating point, as the app did before io::YUVConverter.
+ * @param y Pointer to the luma plane.
+ * @param vu Pointer to the interleaved chroma plane (V first).
+ * @param width Frame width.
+ * @param height Frame height.
+ * @param rgba Output image with 4 channels.
+ */
+void convertNV21Reference(const uchar* y, const uchar* vu, size_t width, size_t height, uchar* rgba) {
+	for (size_t row = 0; row < height; row++) {
+		const uchar* chroma = vu + width * (row >> 1);
+		for (size_t col = 0; col < width; col++, rgba += 4) {
+			float lum = y[row*width + col];
+			float cr = chroma[col & ~(size_t)1];
+			float cb = chroma[(col & ~(size_t)1) + 1];
+
+			rgba[0] = (uchar)std::max(std::min(lum + 1.370705f*(cr - 128), 255.f), 0.f);
+			rgba[1] = (uchar)std::max(std::min(lum - 0.698001f*(cr - 128) - 0.337633f*(cb - 128), 255.f), 0.f);
+			rgba[2] = (uchar)std::max(std::min(lum + 1.732446f*(cb - 128), 255.f), 0.f);
+			rgba[3] = 255;
+		}
+	}
+}
+
+/*
+ * Converts a NV21 frame with io::YUVConverter and checks the 8-bit output matches the floating point conversion
+ * exactly and the 32-bit output is the 8-bit one normalized.
+ * @param frame Frame converted.
+ * @param details Channels that differ.
+ * @return True if both outputs match.
+ */
+bool checkYUV(const NV21Frame& frame, std::string& details) {
+	size_t nbrValues = YUVWidth * YUVHeight * 4;
+	std::vector<uchar> ref(nbrValues), rgba8(nbrValues);
+	std::vector<float> rgba32f(nbrValues);
+
+	convertNV21Reference(frame.y.data(), frame.vu.data(), YUVWidth, YUVHeight, ref.data());
+	bool isConverted = io::YUVConverter::convertNV21(frame.y.data(), frame.vu.data(), YUVWidth, YUVHeight, YUVWidth, rgba8.data());
+	isConverted &= io::YUVConverter::convertNV21(frame.y.data(), frame.vu.data(), YUVWidth, YUVHeight, YUVWidth, rgba32f.data());
+	if (!isConverted) {
+		details = "unable to convert the frame";
+		return false;
+	}
+
+	size_t nbrDiff8 = 0, nbrDiff32 = 0;
+	for (size_t i = 0; i < nbrValues; i++) {
+		if (rgba8[i] != ref[i])
+			nbrDiff8++;
+		if (fabs(rgba32f[i] - ref[i] / 255.f) > 1e-6f)
+			nbrDiff32++;
+	}
+
+	char buffer[160];
+	sprintf(buffer, "%u of %u channels differ in RGBA8, %u in RGBA32F", (unsigned int)nbrDiff8, (unsigned int)nbrValues, (unsigned int)nbrDiff32);
+	details = buffer;
+
+	return !nbrDiff8 && !nbrDiff32;
+}
+
+void addIOBenchmarks(BenchmarkSuite& suite, const std::shared_ptr<Session>& session) {
+	suite.addCheck("io.remapCache.remap", checkRemap);
+
+	if (session && session->size()) {
+		std::shared_ptr<Session> frames = session;
+		suite.addCheck("io.remapCache.colorMap", [frames](std::string& details) {
+			return checkColorMap(*frames, details);
+		});
+	}
+
+	std::shared_ptr<io::Image> src = createSmoothImage();
+	std::shared_ptr<io::Image> dst(new io::Image(RemapWidth, RemapHeight));
+	std::shared_ptr<io::RemapCache> cache(new io::RemapCache());
+	double nbrPixels = (double)RemapWidth*RemapHeight;
+
+	suite.add("io.remapCache.build", [cache]() {
+		return BenchmarkSuite::measure([&]() {
+			cache->build(RemapWidth, RemapHeight, RemapDistortion, RemapF, RemapC);
+		});
+	}, nbrPixels);
+
+	suite.add("io.remapCache.remap", [cache, src, dst]() {
+		if (!cache->matches(RemapWidth, RemapHeight, RemapDistortion, RemapF, RemapC))
+			cache->build(RemapWidth, RemapHeight, RemapDistortion, RemapF, RemapC);
+
+		return BenchmarkSuite::measure([&]() {
+			cache->remap(*src, *dst);
+		});
+	}, nbrPixels);
+
+	suite.add("io.undistort.direct", [src, dst]() {
+		return BenchmarkSuite::measure([&]() {
+			undistortDirect(*src, *dst);
+		});
+	}, nbrPixels);
+
+	// Conversion of the color frames, one pixel at a time in floating point, in fixed point and downscaled
+	std::shared_ptr<NV21Frame> frame = createNV21Frame();
+	suite.addCheck("io.yuv.exact", [frame](std::string& details) {
+		return checkYUV(*frame, details);
+	});
+
+	std::shared_ptr<std::vector<uchar>> rgba8(new std::vector<uchar>(YUVWidth*YUVHeight * 4));
+	std::shared_ptr<std::vector<float>> rgba32f(new std::vector<float>(YUVWidth*YUVHeight * 4));
+	double nbrYUVPixels = (double)YUVWidth*YUVHeight;
+
+	suite.add("io.yuv.reference", [frame, rgba8]() {
+		return BenchmarkSuite::measure([&]() {
+			convertNV21Reference(frame->y.data(), frame->vu.data(), YUVWidth, YUVHeight, rgba8->data());
+		});
+	}, nbrYUVPixels);
+
+	const size_t Scales[] = { 1, 2, 4 };
+	for (size_t scale : Scales) {
+		std::string name = "io.yuv.rgba8";
+		if (scale > 1)
+			name += "Scale" + std::to_string(scale);
+
+		suite.add(name, [frame, rgba8, scale]() {
+			return BenchmarkSuite::measure([&]() {
+				io::YUVConverter::convertNV21(frame->y.data(), frame->vu.data(), YUVWidth, YUVHeight, YUVWidth, rgba8->data(), scale);
+			});
+		}, nbrYUVPixels);
+	}
+
+	suite.add("io.yuv.rgba32f", [frame, rgba32f]() {
+		return BenchmarkSuite::measure([&]() {
+			io::YUVConverter::convertNV21(frame->y.data(), frame->vu.data(), YUVWidth, YUVHeight, YUVWidth, rgba32f->data());
+		});
+	}, nbrYUVPixels);
+}
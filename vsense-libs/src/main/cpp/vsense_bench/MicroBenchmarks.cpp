@@ -0,0 +1,687 @@
+#include "Cases.h"
+
+#include <vsense/color/Color.h>
+#include <vsense/common/Reduction.h>
+#include <vsense/depth/DepthMap.h>
+#include <vsense/depth/JointBilateralUpsampler.h>
+#include <vsense/em/EMSnapshot.h>
+#include <vsense/em/EnvironmentMap.h>
+#include <vsense/sh/SphericalHarmonics.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <random>
+
+using namespace vsense;
+
+const size_t NbrColors = 1 << 20;
+const size_t NbrDirections = 1 << 16;
+const size_t NbrSHSamples = 100000;
+
+const glm::vec3 WarpOffset(0.3f, 0.f, 0.2f); // Displacement of the origin warped to
+const float StaleTileAge = 10.f;               // Mean age (frames) from which a tile of the coverage is stale
+const float StaleTileCoverage = 0.5f;          // Coverage below which a tile of the coverage is incomplete
+
+const uint32_t SnapshotTileSize = 64;                   // Tiles of the snapshot deltas, as in the app
+const char*    SnapshotFiles[3] = { "vsense_bench_check0.snap", "vsense_bench_check1.snap", "vsense_bench_check2.snap" };
+
+const size_t UpsamplingWidth = 224;     // Depth sensor
+const size_t UpsamplingHeight = 172;
+const size_t UpsamplingEdgeCol = 112;   // First column of the far side of the synthetic depth edge
+const float UpsamplingHoles = 0.1f;     // Fraction of the depth pixels without measurement
+const float UpsamplingTolerance = 0.01f; // Largest error (m) on the smooth side of the synthetic depth edge
+const float UpsamplingBleed = 0.1f;      // Error (m) from which a pixel takes the depth of the other side of the edge
+
+const glm::ivec2 CorrLocalSize(8, 8);          // Work groups of the color correction, see Process.cpp
+const glm::ivec2 CorrSamplesPerInvocation(4, 4); // SamplesX, SamplesY in environmentMapCorrect.comp
+const size_t CorrFinalDataWidth = 13;            // Columns of the final data of environmentMapCorrect.comp
+const float CorrMaxDepthDiff = 0.01f;            // MaxDepthDiff in environmentMapCorrect.comp
+const double CorrErrorTolerance = 1e-4;          // Relative difference allowed with the error in double precision
+const double CorrErrorToleranceGPU = 1e-3;       // Relative difference allowed with the error accumulated in single precision
+
+volatile float Sink; // Keeps the results of the kernels alive
+
+/*
+ * Integrates the first half of a session, so the EM cases run on a partly filled EM as during a session.
+ */
+struct WarmEM {
+	WarmEM() : isReady(false) {}
+
+	/*
+	 * Prepares the EM, the first time only.
+	 * @param session Session to integrate.
+	 */
+	void prepare(const Session& session) {
+		if (isReady)
+			return;
+
+		session.useDepthMapping();
+
+		size_t half = session.size() / 2;
+		for (size_t i = 0; i < half; i++) {
+			const SessionFrame& frame = session.at(i);
+			dm.fillWithData(frame.pc, frame.pcData, frame.img, frame.imData);
+			em.addDepthMapFrame(&dm, true, false);
+		}
+		em.toSnapshot(snapshot);
+
+		const SessionFrame& frame = session.at(half);
+		dm.fillWithData(frame.pc, frame.pcData, frame.img, frame.imData);
+
+		em.addDepthMapFrame(&dm, true, false);
+		em.toSnapshot(next);
+		em.fromSnapshot(snapshot);
+
+		isReady = true;
+	}
+
+	bool                isReady;  /*!< True once the EM is prepared. */
+	em::EnvironmentMap  em;       /*!< EM holding the first half of the session. */
+	em::EMSnapshot      snapshot; /*!< State of the EM after the first half, restored before every run. */
+	em::EMSnapshot      next;     /*!< State of the EM after the next frame, written as delta of the first half. */
+	depth::DepthMap     dm;       /*!< Depth map of the next frame. */
+};
+
+/*
+ * Adds the next frame to the warm EM with and without the coverage tracking, checking the coverage is only updated when
+ * enabled, and reports the coverage of the EM and its stale tiles.
+ * @param warm Warm EM.
+ * @param session Session the EM is prepared with.
+ * @param details Coverage of the EM and number of stale tiles.
+ * @return True if the coverage is only updated when enabled, with the frame added.
+ */
+bool checkCoverageTracking(WarmEM& warm, const Session& session, std::string& details) {
+	warm.prepare(session);
+
+	warm.em.fromSnapshot(warm.snapshot);
+	size_t nbrTexels = (size_t)em::EnvironmentMap::getWidth()*em::EnvironmentMap::getHeight();
+	std::vector<uint32_t> before(warm.em.getCoverageMap().getPackedPtr(), warm.em.getCoverageMap().getPackedPtr() + nbrTexels);
+
+	em::EnvironmentMap::setCoverageTrackingEnabled(false);
+	warm.em.addDepthMapFrame(&warm.dm, true, false);
+	em::EnvironmentMap::setCoverageTrackingEnabled(true);
+	bool isUnchanged = !memcmp(before.data(), warm.em.getCoverageMap().getPackedPtr(), sizeof(uint32_t)*nbrTexels);
+
+	warm.em.fromSnapshot(warm.snapshot);
+	warm.em.addDepthMapFrame(&warm.dm, true, false);
+
+	const em::CoverageMap& coverage = warm.em.getCoverageMap();
+	uint32_t frame = warm.em.getFrameIndex();
+	size_t nbrSeen = 0;
+	for (size_t i = 0; i < nbrTexels; i++) {
+		if (coverage.getAge(i, frame) == 0)
+			nbrSeen++;
+	}
+
+	em::TileCoverage total = coverage.getTotal(frame);
+	std::vector<size_t> staleTiles;
+	coverage.findStaleTiles(frame, StaleTileAge, StaleTileCoverage, staleTiles);
+
+	char buffer[256];
+	sprintf(buffer, "%u texels seen in frame %u, %.1f%% observed (%.1f%% once, mean age %.1f), %u/%u stale tiles, %s without tracking",
+		(unsigned int)nbrSeen, frame, 100.f*total.coverage, 100.f*total.singleFraction, total.meanAge, (unsigned int)staleTiles.size(),
+		(unsigned int)(coverage.getNbrTilesX()*coverage.getNbrTilesY()), isUnchanged ? "unchanged" : "updated");
+	details = buffer;
+
+	return isUnchanged && nbrSeen > 0;
+}
+
+/*
+ * Accumulates the moments of the color correction as environmentMapCorrect.comp does: every invocation adds the
+ * reliable pairs of its block of samples in single precision, the work groups reduce them and the last one to finish
+ * adds the partial results, which are packed in the final data read by Process.
+ * @param samplesCur Current RGB-D samples, the sign of the depth is the reliability.
+ * @param samplesRef Reference RGB-D samples.
+ * @param width Width of the samples image.
+ * @param height Height of the samples image.
+ * @return Final data, CorrFinalDataWidth x 3 values (only the moments are written).
+ */
+std::vector<float> emulateCorrectionShader(const std::vector<glm::vec4>& samplesCur, const std::vector<glm::vec4>& samplesRef, size_t width, size_t height) {
+	glm::ivec2 groupSamples = CorrLocalSize*CorrSamplesPerInvocation;
+	glm::ivec2 nbrGroups(((int)width + groupSamples.x - 1) / groupSamples.x, ((int)height + groupSamples.y - 1) / groupSamples.y);
+	size_t groupSize = CorrLocalSize.x*CorrLocalSize.y;
+	size_t nbrInvocations = groupSize*nbrGroups.x*nbrGroups.y;
+
+	std::vector<glm::mat3> momCur(nbrInvocations, glm::mat3(0.f)), momRef(nbrInvocations, glm::mat3(0.f));
+	std::vector<float> refRef(nbrInvocations, 0.f), errUsed(nbrInvocations, 0.f);
+	for (int gy = 0; gy < nbrGroups.y; gy++) {
+		for (int gx = 0; gx < nbrGroups.x; gx++) {
+			for (size_t local = 0; local < groupSize; local++) {
+				size_t idx = (gy*nbrGroups.x + gx)*groupSize + local;
+				glm::ivec2 pos(gx*CorrLocalSize.x + (int)local % CorrLocalSize.x, gy*CorrLocalSize.y + (int)local / CorrLocalSize.x);
+
+				for (int offsetY = 0; offsetY < CorrSamplesPerInvocation.y; offsetY++) {
+					size_t y = pos.y*CorrSamplesPerInvocation.y + offsetY;
+					for (int offsetX = 0; offsetX < CorrSamplesPerInvocation.x && y < height; offsetX++) {
+						size_t x = pos.x*CorrSamplesPerInvocation.x + offsetX;
+						if (x >= width)
+							break;
+
+						const glm::vec4& ref = samplesRef[y*width + x];
+						const glm::vec4& cur = samplesCur[y*width + x];
+						if ((ref.a == 0.f) || (cur.a == 0.f) || (fabs(fabs(ref.a) - fabs(cur.a)) >= CorrMaxDepthDiff))
+							continue;
+
+						if ((ref.a > 0.f) && (cur.a > 0.f)) {
+							glm::vec3 curColor(cur), refColor(ref);
+							momCur[idx] += glm::outerProduct(curColor, curColor);
+							momRef[idx] += glm::outerProduct(refColor, curColor);
+							refRef[idx] += glm::dot(refColor, refColor);
+							errUsed[idx] += 1.f;
+						}
+					}
+				}
+			}
+		}
+	}
+
+	common::WorkGroupReduction<glm::mat3> reductionMat(groupSize);
+	common::WorkGroupReduction<float> reductionFloat(groupSize);
+	size_t nbrGroupsTotal = nbrGroups.x*nbrGroups.y;
+	glm::mat3 totalCur = reductionMat.reduceDispatch(momCur.data(), nbrGroupsTotal);
+	glm::mat3 totalRef = reductionMat.reduceDispatch(momRef.data(), nbrGroupsTotal);
+
+	std::vector<float> data(CorrFinalDataWidth * 3, 0.f);
+	data[CorrFinalDataWidth + 6] = reductionFloat.reduceDispatch(errUsed.data(), nbrGroupsTotal);
+	data[CorrFinalDataWidth * 2 + 6] = reductionFloat.reduceDispatch(refRef.data(), nbrGroupsTotal);
+	for (int i = 0; i < 3; i++) {
+		for (int j = 0; j < 3; j++) { // imageStore(finalData, ivec2(i + 7, j), momCur[i][j])
+			data[j*CorrFinalDataWidth + i + 7] = totalCur[i][j];
+			data[j*CorrFinalDataWidth + i + 10] = totalRef[i][j];
+		}
+	}
+
+	return data;
+}
+
+/*
+ * Adds the next frame to the warm EM and compares the mean squared error of the color correction derived from the
+ * moments with the error of every sample after the correction: for the samples used by the EM, and for the reliable
+ * pairs of the samples as paired by the CPU branch of Process and by environmentMapCorrect.comp, emulated.
+ * @param warm Warm EM.
+ * @param session Session the EM is prepared with.
+ * @param details Errors and relative differences.
+ * @return True if the errors from the moments are within tolerance.
+ */
+bool checkCorrectionError(WarmEM& warm, const Session& session, std::string& details) {
+	warm.prepare(session);
+
+	warm.em.fromSnapshot(warm.snapshot);
+	warm.em.addDepthMapFrame(&warm.dm, false, false); // Projecting would correct the samples in place
+
+	const glm::mat3& corrMtx = warm.em.getLastCorrectionMatrix();
+	const em::EMSample* samples = warm.em.getLastSamples().get();
+	size_t nbrSamples = warm.em.getSamplesNumber();
+
+	// Error of every sample used by the EM
+	double sumError = 0.;
+	size_t nbrUsed = 0;
+	for (size_t i = 0; i < nbrSamples; i++) {
+		if (!samples[i].used)
+			continue;
+
+		glm::dvec3 diff = glm::dvec3(samples[i].refColor) - glm::dvec3(corrMtx*samples[i].curColor);
+		sumError += glm::dot(diff, diff);
+		nbrUsed++;
+	}
+
+	if (!nbrUsed || warm.em.getLastError() < 0.f) {
+		details = "no correction calculated";
+		return false;
+	}
+
+	double emError = sumError / nbrUsed;
+	double emDiff = fabs(warm.em.getLastError() - emError) / emError;
+
+	// The samples as written by the EM projection of Process, the depth is negative if unreliable and 0 if unknown
+	size_t width = depth::DepthMap::width(), height = depth::DepthMap::height();
+	std::vector<glm::vec4> samplesCur(width*height, glm::vec4(0.f)), samplesRef(width*height, glm::vec4(0.f));
+	for (size_t i = 0; i < std::min(nbrSamples, width*height); i++) {
+		samplesCur[i] = glm::vec4(samples[i].curColor, samples[i].curIsReliable ? samples[i].curDepth : -samples[i].curDepth);
+		if (samples[i].refDepth >= 0.f)
+			samplesRef[i] = glm::vec4(samples[i].refColor, samples[i].refIsReliable ? samples[i].refDepth : -samples[i].refDepth);
+	}
+
+	// CPU branch of Process::calculateCorrectionMatrix and per-sample error of the same pairs
+	em::ColorMoments cpuMoments;
+	sumError = 0.;
+	for (size_t i = 0; i < width*height; i++) {
+		const glm::vec4& ref = samplesRef[i];
+		const glm::vec4& cur = samplesCur[i];
+		if ((ref.a == 0.f) || (cur.a == 0.f) || (fabs(fabs(ref.a) - fabs(cur.a)) >= CorrMaxDepthDiff))
+			continue;
+
+		if (cpuMoments.addReliable(cur, ref)) {
+			glm::dvec3 diff = glm::dvec3(glm::vec3(ref)) - glm::dvec3(corrMtx*glm::vec3(cur));
+			sumError += glm::dot(diff, diff);
+		}
+	}
+
+	if (!cpuMoments.count) {
+		details = "no reliable pairs";
+		return false;
+	}
+
+	double pairError = sumError / cpuMoments.count;
+	double cpuDiff = fabs(cpuMoments.meanSquaredError(corrMtx) - pairError) / pairError;
+
+	std::vector<float> finalData = emulateCorrectionShader(samplesCur, samplesRef, width, height);
+	em::ColorMoments gpuMoments = em::ColorMoments::fromCorrectionData(finalData.data(), CorrFinalDataWidth);
+	double gpuDiff = fabs(gpuMoments.meanSquaredError(corrMtx) - pairError) / pairError;
+
+	char buffer[320];
+	sprintf(buffer, "EM %g over %u samples (relative difference %.2g), %u reliable pairs %g (CPU branch %.2g, shader %.2g, %u pairs)",
+		emError, (unsigned int)nbrUsed, emDiff, cpuMoments.count, pairError, cpuDiff, gpuDiff, gpuMoments.count);
+	details = buffer;
+
+	return emDiff <= CorrErrorTolerance && cpuDiff <= CorrErrorTolerance && gpuMoments.count == cpuMoments.count && gpuDiff <= CorrErrorToleranceGPU;
+}
+
+/*
+ * Writes a chain of snapshots of the warm EM, full, delta with the next frame and delta with only the sign of some
+ * depths changed, pairs of them in the top bit of consecutive words of a tile so they would cancel out in a weak hash,
+ * and checks the chain is read back as the last snapshot.
+ * @param warm Warm EM.
+ * @param session Session the EM is prepared with.
+ * @param details Size and time of every snapshot written.
+ * @return True if the chain is read back as the last snapshot.
+ */
+bool checkSnapshotChain(WarmEM& warm, const Session& session, std::string& details) {
+	warm.prepare(session);
+
+	// Sign of the second and fourth depths of the first row of every tile, the top bits of its first two words
+	em::EMSnapshot flipped = warm.next;
+	const em::SnapshotPlane* depthPlane = flipped.getPlane(em::PlaneDepth);
+	if (!depthPlane || depthPlane->elementSize != sizeof(float)) {
+		details = "no depth plane";
+		return false;
+	}
+
+	uint32_t width = flipped.getWidth();
+	std::vector<float> depths(depthPlane->data.size() / sizeof(float));
+	memcpy(depths.data(), depthPlane->data.data(), depthPlane->data.size());
+
+	size_t nbrFlipped = 0;
+	for (uint32_t y = 0; y < flipped.getHeight(); y += SnapshotTileSize) {
+		for (uint32_t x = 0; x + 3 < width; x += SnapshotTileSize, nbrFlipped += 2) {
+			depths[(size_t)y*width + x + 1] = -depths[(size_t)y*width + x + 1];
+			depths[(size_t)y*width + x + 3] = -depths[(size_t)y*width + x + 3];
+		}
+	}
+	flipped.addPlane(em::PlaneDepth, sizeof(float), depthPlane->empty.data(), depths.data());
+
+	const em::EMSnapshot* chain[3] = { &warm.snapshot, &warm.next, &flipped };
+	em::SnapshotWriter writer(SnapshotTileSize);
+	em::SnapshotStats stats[3];
+	bool isWritten = true;
+	for (int i = 0; i < 3 && isWritten; i++) {
+		isWritten = writer.write(SnapshotFiles[i], *chain[i], i > 0);
+		stats[i] = writer.getLastStats();
+	}
+
+	em::EMSnapshot restored;
+	bool isRead = isWritten;
+	std::chrono::high_resolution_clock::time_point t = std::chrono::high_resolution_clock::now();
+	for (int i = 0; i < 3 && isRead; i++)
+		isRead = restored.read(SnapshotFiles[i]);
+	std::chrono::duration<double, std::milli> readMS = std::chrono::high_resolution_clock::now() - t;
+
+	for (int i = 0; i < 3; i++)
+		remove(SnapshotFiles[i]);
+
+	bool isEqual = isRead && restored.getPlanes().size() == flipped.getPlanes().size();
+	for (size_t p = 0; isEqual && p < flipped.getPlanes().size(); p++) {
+		const em::SnapshotPlane* plane = restored.getPlane(flipped.getPlanes()[p].id);
+		isEqual = plane && plane->data == flipped.getPlanes()[p].data;
+	}
+
+	char buffer[320];
+	sprintf(buffer, "full %u KB (%.2f ms), frame delta %u KB (%u tiles, %.2f ms), sign delta %u KB (%u tiles, %u depths), read in %.2f ms, %s",
+		(unsigned int)(stats[0].fileBytes / 1024), stats[0].ms, (unsigned int)(stats[1].fileBytes / 1024), (unsigned int)stats[1].nbrWritten, stats[1].ms,
+		(unsigned int)(stats[2].fileBytes / 1024), (unsigned int)stats[2].nbrWritten, (unsigned int)nbrFlipped, readMS.count(),
+		isEqual ? "read back as written" : "differs from the last snapshot");
+	details = buffer;
+
+	return isEqual && stats[2].delta && stats[2].nbrWritten > 0;
+}
+
+/*
+ * Runs the sliding-window and the per-pixel reliability tests on every frame of a session, with both window sizes, and
+ * checks they flag the same points.
+ * @param session Session whose frames are tested.
+ * @param details Pixels where the tests disagree.
+ * @return True if the tests agree on every pixel.
+ */
+bool checkReliabilityModes(const Session& session, std::string& details) {
+	session.useDepthMapping();
+
+	depth::DepthMap dm;
+	size_t curWindow = depth::DepthMap::reliabilityWindow();
+	size_t nbrDiff = 0, nbrTested = 0, nbrReliable = 0;
+	const size_t windows[] = { 3, 5 };
+	for (int w = 0; w < 2; w++) {
+		depth::DepthMap::setReliabilityWindow(windows[w]);
+		for (size_t i = 0; i < session.size(); i++) {
+			const SessionFrame& frame = session.at(i);
+			if (!dm.fillWithData(frame.pc, frame.pcData, frame.img, frame.imData))
+				continue;
+
+			nbrDiff += dm.compareReliabilityModes();
+			nbrTested += depth::DepthMap::nbrPixels();
+
+			const depth::DepthPoint* curPt = dm.getDataPtr();
+			for (size_t p = 0; p < depth::DepthMap::nbrPixels(); p++, curPt++) {
+				if (curPt->flags & pc::ReliablePoint)
+					nbrReliable++;
+			}
+		}
+	}
+	depth::DepthMap::setReliabilityWindow(curWindow);
+
+	char buffer[128];
+	sprintf(buffer, "%u of %u pixels differ, %u reliable", (unsigned int)nbrDiff, (unsigned int)nbrTested, (unsigned int)nbrReliable);
+	details = buffer;
+
+	return nbrReliable && !nbrDiff;
+}
+
+/*
+ * Upsamples a synthetic depth map with holes, a slanted plane and a far plane side by side with different colors, and
+ * checks the estimated depth reproduces the plane and doesn't bleed across the edge, which a filter without the range
+ * kernel does.
+ * @param details Largest error, pixels taking the depth across the edge and pixels estimated.
+ * @return True if every pixel is estimated within tolerance and none bleeds across the edge.
+ */
+bool checkUpsampler(std::string& details) {
+	const size_t factor = 2;
+	const glm::vec3 nearColor(0.1f, 0.1f, 0.1f), farColor(0.9f, 0.8f, 0.7f);
+	const float farDepth = 3.f;
+
+	std::mt19937 rng(1);
+	std::uniform_real_distribution<float> uniform(0.f, 1.f);
+
+	size_t nbrPixels = UpsamplingWidth*UpsamplingHeight;
+	std::vector<float> depth(nbrPixels);
+	std::vector<glm::vec3> color(nbrPixels);
+	std::vector<uchar> valid(nbrPixels);
+	for (size_t row = 0; row < UpsamplingHeight; row++) {
+		for (size_t col = 0; col < UpsamplingWidth; col++) {
+			size_t idx = row*UpsamplingWidth + col;
+			bool isNear = col < UpsamplingEdgeCol;
+			depth[idx] = isNear ? 1.f + 0.002f*col + 0.001f*row : farDepth;
+			color[idx] = isNear ? nearColor : farColor;
+			valid[idx] = uniform(rng) >= UpsamplingHoles;
+		}
+	}
+
+	size_t upWidth = UpsamplingWidth*factor, upHeight = UpsamplingHeight*factor;
+	std::vector<glm::vec3> guide(upWidth*upHeight);
+	for (size_t row = 0; row < upHeight; row++) {
+		for (size_t col = 0; col < upWidth; col++)
+			guide[row*upWidth + col] = col < UpsamplingEdgeCol*factor ? nearColor : farColor;
+	}
+
+	std::vector<float> upDepth(upWidth*upHeight), upWeight(upWidth*upHeight);
+	size_t nbrBleeding[2] = { 0, 0 };
+	size_t nbrEstimated = 0;
+	float maxError = 0.f;
+
+	// With the default range kernel and with a range kernel so wide the filter is only spatial
+	const float sigmasRange[2] = { 0.1f, 100.f };
+	for (int f = 0; f < 2; f++) {
+		depth::JointBilateralUpsampler upsampler(factor, 1.f, sigmasRange[f]);
+		upsampler.upsample(depth.data(), color.data(), valid.data(), UpsamplingWidth, UpsamplingHeight, guide.data(), upDepth.data(), upWeight.data());
+
+		for (size_t row = 0; row < upHeight; row++) {
+			float y = (row + 0.5f) / factor - 0.5f;
+			for (size_t col = 0; col < upWidth; col++) {
+				size_t idx = row*upWidth + col;
+				if (upWeight[idx] <= 0.f)
+					continue;
+
+				float x = (col + 0.5f) / factor - 0.5f;
+				bool isNear = col < UpsamplingEdgeCol*factor;
+				float expected = isNear ? 1.f + 0.002f*x + 0.001f*y : farDepth;
+				float error = fabs(upDepth[idx] - expected);
+
+				if (error > UpsamplingBleed)
+					nbrBleeding[f]++;
+				else if (!f)
+					maxError = std::max(maxError, error);
+				if (!f)
+					nbrEstimated++;
+			}
+		}
+	}
+
+	char buffer[224];
+	sprintf(buffer, "%u of %u pixels estimated, largest error %.4fm, %u pixels take the depth across the edge (%u without the range kernel)",
+		(unsigned int)nbrEstimated, (unsigned int)(upWidth*upHeight), maxError, (unsigned int)nbrBleeding[0], (unsigned int)nbrBleeding[1]);
+	details = buffer;
+
+	return nbrEstimated == upWidth*upHeight && maxError <= UpsamplingTolerance && !nbrBleeding[0];
+}
+
+void addMicroBenchmarks(BenchmarkSuite& suite, const std::shared_ptr<Session>& session, float upsamplingFraction) {
+	std::mt19937 rng(1);
+	std::uniform_real_distribution<float> uniform(0.f, 1.f);
+
+	// Color conversion
+	std::shared_ptr<std::vector<glm::vec3>> colors(new std::vector<glm::vec3>(NbrColors));
+	for (size_t i = 0; i < NbrColors; i++)
+		(*colors)[i] = glm::vec3(uniform(rng), uniform(rng), uniform(rng));
+
+	suite.add("color.rgb2hsv", [colors]() {
+		return BenchmarkSuite::measure([&]() {
+			float sum = 0.f;
+			for (size_t i = 0; i < colors->size(); i++)
+				sum += color::Color::rgb2hsv((*colors)[i]).x;
+			Sink = sum;
+		});
+	}, (double)NbrColors);
+
+	// SH reconstruction, order 2 as used for the lighting and 4 as the highest hard-coded order
+	std::shared_ptr<std::vector<glm::vec3>> dirs(new std::vector<glm::vec3>(NbrDirections));
+	for (size_t i = 0; i < NbrDirections; i++) {
+		float theta = acos(1.f - 2.f*uniform(rng));
+		float phi = 6.2831853f*uniform(rng);
+		(*dirs)[i] = sh::SphericalHarmonics::toVector(phi, theta);
+	}
+
+	for (int order = 2; order <= 4; order += 2) {
+		std::shared_ptr<std::vector<glm::vec3>> coeffs(new std::vector<glm::vec3>((order + 1)*(order + 1)));
+		for (size_t i = 0; i < coeffs->size(); i++)
+			(*coeffs)[i] = glm::vec3(uniform(rng), uniform(rng), uniform(rng));
+
+		char name[32];
+		sprintf(name, "sh.evalSHSum.order%d", order);
+
+		suite.add(name, [dirs, coeffs, order]() {
+			return BenchmarkSuite::measure([&]() {
+				glm::vec3 sum(0.f);
+				for (size_t i = 0; i < dirs->size(); i++)
+					sum += sh::SphericalHarmonics::evalSHSum(order, *coeffs, (*dirs)[i]);
+				Sink = sum.x;
+			});
+		}, (double)NbrDirections);
+	}
+
+	std::shared_ptr<std::vector<sh::SphericalSample3>> samples(new std::vector<sh::SphericalSample3>(NbrSHSamples));
+	for (size_t i = 0; i < NbrSHSamples; i++) {
+		glm::vec2 sphCoords(acos(1.f - 2.f*uniform(rng)), 6.2831853f*uniform(rng)); // theta, phi
+		(*samples)[i] = sh::SphericalSample3(sphCoords, glm::vec3(uniform(rng), uniform(rng), uniform(rng)));
+	}
+
+	suite.add("sh.projectSamples", [samples]() {
+		return BenchmarkSuite::measure([&]() {
+			std::shared_ptr<sh::SHCoefficients3> coeffs = sh::SphericalHarmonics::projectSamples(2, *samples);
+			Sink = (*coeffs)[0].x;
+		});
+	}, (double)NbrSHSamples);
+
+	if (!session || session->size() < 2)
+		return;
+
+	// Depth map stages, timed inside the depth map
+	std::shared_ptr<depth::DepthMap> dm(new depth::DepthMap());
+	std::shared_ptr<Session> frames = session;
+	const size_t frameIdx = session->size() / 2;
+
+	suite.add("depth.fillWithData", [dm, frames, frameIdx]() {
+		frames->useDepthMapping();
+
+		const SessionFrame& frame = frames->at(frameIdx);
+		return BenchmarkSuite::measure([&]() {
+			dm->fillWithData(frame.pc, frame.pcData, frame.img, frame.imData);
+		});
+	}, (double)depth::DepthMap::nbrPixels());
+
+	const depth::ReliabilityMode modes[] = { depth::ReliabilitySlidingWindow, depth::ReliabilityReference };
+	const char* modeNames[] = { "depth.markReliablePoints", "depth.markReliablePoints.reference" };
+	for (int i = 0; i < 2; i++) {
+		depth::ReliabilityMode mode = modes[i];
+		suite.add(modeNames[i], [dm, frames, frameIdx, mode]() {
+			frames->useDepthMapping();
+
+			depth::DepthMap::setReliabilityMode(mode);
+			const SessionFrame& frame = frames->at(frameIdx);
+			dm->fillWithData(frame.pc, frame.pcData, frame.img, frame.imData);
+			depth::DepthMap::setReliabilityMode(depth::ReliabilitySlidingWindow);
+
+			return (double)dm->getLastReliabilityTime();
+		}, (double)depth::DepthMap::nbrPixels());
+	}
+
+	suite.addCheck("depth.markReliablePoints.equivalence", [frames](std::string& details) {
+		return checkReliabilityModes(*frames, details);
+	});
+
+	suite.addCheck("depth.upsample", checkUpsampler);
+
+	// Upsampling with the fraction of the color image width of the replays, timed inside the depth map
+	suite.add("depth.upsample", [dm, frames, frameIdx, upsamplingFraction]() {
+		frames->useDepthMapping();
+
+		depth::DepthMap::setUpsamplingColorFraction(upsamplingFraction);
+		const SessionFrame& frame = frames->at(frameIdx);
+		dm->fillWithData(frame.pc, frame.pcData, frame.img, frame.imData);
+		depth::DepthMap::setUpsamplingColorFraction(0.f);
+
+		return (double)dm->getLastUpsamplingTime();
+	}, (double)depth::DepthMap::nbrPixels());
+
+	suite.add("depth.estimateDepth", [dm, frames, frameIdx]() {
+		frames->useDepthMapping();
+
+		const SessionFrame& frame = frames->at(frameIdx);
+		dm->fillWithData(frame.pc, frame.pcData, frame.img, frame.imData);
+
+		return (double)dm->getLastHoleFillingTime();
+	});
+
+	// EM stages, every run starts from the same partly filled EM
+	std::shared_ptr<WarmEM> warm(new WarmEM());
+
+	suite.add("em.addDepthMapFrame", [warm, frames]() {
+		warm->prepare(*frames);
+
+		warm->em.fromSnapshot(warm->snapshot);
+		return BenchmarkSuite::measure([&]() {
+			warm->em.addDepthMapFrame(&warm->dm, true, false);
+		});
+	}, (double)depth::DepthMap::nbrPixels());
+
+	// Same frame without updating the coverage of the EM
+	suite.add("em.addDepthMapFrame.noCoverage", [warm, frames]() {
+		warm->prepare(*frames);
+
+		warm->em.fromSnapshot(warm->snapshot);
+		em::EnvironmentMap::setCoverageTrackingEnabled(false);
+
+		double time = BenchmarkSuite::measure([&]() {
+			warm->em.addDepthMapFrame(&warm->dm, true, false);
+		});
+
+		em::EnvironmentMap::setCoverageTrackingEnabled(true);
+
+		return time;
+	}, (double)depth::DepthMap::nbrPixels());
+
+	suite.addCheck("em.addDepthMapFrame.coverage", [warm, frames](std::string& details) {
+		return checkCoverageTracking(*warm, *frames, details);
+	});
+
+	suite.add("em.calculateCorrectionMtx", [warm, frames]() {
+		warm->prepare(*frames);
+
+		warm->em.fromSnapshot(warm->snapshot);
+		warm->em.addDepthMapFrame(&warm->dm, true, false);
+
+		return (double)warm->em.getLastCorrectionTime();
+	});
+
+	suite.addCheck("em.correctionError.moments", [warm, frames](std::string& details) {
+		return checkCorrectionError(*warm, *frames, details);
+	});
+
+	// Snapshots of the EM, as saved and restored by the app
+	double nbrTexels = (double)em::EnvironmentMap::getWidth()*em::EnvironmentMap::getHeight();
+	suite.add("em.snapshot.writeFull", [warm, frames]() {
+		warm->prepare(*frames);
+
+		em::SnapshotWriter writer(SnapshotTileSize);
+		double time = BenchmarkSuite::measure([&]() {
+			writer.write(SnapshotFiles[0], warm->snapshot, false);
+		});
+		remove(SnapshotFiles[0]);
+
+		return time;
+	}, nbrTexels);
+
+	suite.add("em.snapshot.writeDelta", [warm, frames]() {
+		warm->prepare(*frames);
+
+		em::SnapshotWriter writer(SnapshotTileSize);
+		writer.setBase(warm->snapshot);
+		double time = BenchmarkSuite::measure([&]() {
+			writer.write(SnapshotFiles[1], warm->next);
+		});
+		remove(SnapshotFiles[1]);
+
+		return time;
+	}, nbrTexels);
+
+	suite.add("em.snapshot.readChain", [warm, frames]() {
+		warm->prepare(*frames);
+
+		em::SnapshotWriter writer(SnapshotTileSize);
+		writer.write(SnapshotFiles[0], warm->snapshot, false);
+		writer.write(SnapshotFiles[1], warm->next);
+
+		em::EMSnapshot restored;
+		double time = BenchmarkSuite::measure([&]() {
+			restored.read(SnapshotFiles[0]);
+			restored.read(SnapshotFiles[1]);
+		});
+		remove(SnapshotFiles[0]);
+		remove(SnapshotFiles[1]);
+
+		return time;
+	}, nbrTexels);
+
+	suite.addCheck("em.snapshot.chain", [warm, frames](std::string& details) {
+		return checkSnapshotChain(*warm, *frames, details);
+	});
+
+	std::shared_ptr<em::EnvironmentMap> warped(new em::EnvironmentMap());
+	suite.add("em.fromWarp", [warm, warped, frames]() {
+		warm->prepare(*frames);
+
+		warm->em.fromSnapshot(warm->snapshot);
+		glm::vec3 posWorld = warm->em.getOrigin() + WarpOffset;
+		return BenchmarkSuite::measure([&]() {
+			warped->fromWarp(warm->em, posWorld);
+		});
+	}, (double)em::EnvironmentMap::getWidth()*em::EnvironmentMap::getHeight());
+}
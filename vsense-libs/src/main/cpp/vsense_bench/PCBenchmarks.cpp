@@ -0,0 +1,693 @@
+#include "Cases.h"
+
+#include <vsense/io/PointCloudReader.h>
+#include <vsense/io/PointCloudWriter.h>
+#include <vsense/pc/PlaneDetector.h>
+#include <vsense/pc/PointCloud.h>
+#include <vsense/pc/PointTransform.h>
+#include <vsense/pc/SpatialHash.h>
+#include <vsense/pc/VoxelGrid.h>
+#include <vsense/synth/Scene.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <random>
+
+using namespace vsense;
+
+const float VoxelSize = 0.01f;      // Voxels of the plane detection on touch
+const float PlaneThreshold = 0.02f; // Inlier threshold of the plane detection on touch
+const float SupportRadius = 0.1f;   // Support radius of the plane detection on touch
+
+const size_t PlaneCheckFrames = 10;        // Frames of the session touched to check the plane detection
+const size_t PlaneCheckRays = 20;          // Rays per frame, through random points of the frame
+const float PlanarNormalCos = 0.9999f;     // The room's walls and boxes are axis-aligned, the spheres aren't planar
+const double MinDetectionRate = 0.85;      // Fraction of the rays meeting a plane where it must be found
+const double MaxMedianAngleError = 3.0;    // Median angle (degrees) between the normals found and the scene's
+
+const float HashCellSize = 0.05f;   // Cells of the spatial hash, close to the query radius
+const float QueryRadius = 0.05f;    // Radius of the neighbor queries
+const size_t QueryNeighbors = 16;   // Neighbors of the k-nearest queries
+const size_t NbrQueries = 1000;     // Queries timed per case
+const size_t NbrCheckQueries = 200; // Queries compared with the brute-force search
+
+const char* TangoFile = "vsense_bench_pc.pc";        // Temporary files of the point cloud I/O cases
+const char* CompactFile = "vsense_bench_pc.pcc";
+const char* XYZFile = "vsense_bench_pc.xyz";
+
+/*
+ * A depth frame in world coordinates, downsampled as on touch, and the ray through the center of the depth sensor.
+ */
+struct TouchFrame {
+	pc::PointCloud cloud;  /*!< Points of the frame in world coordinates, one per voxel. */
+	glm::vec3      origin; /*!< Origin of the ray. */
+	glm::vec3      dir;    /*!< Direction of the ray. */
+};
+
+/*
+ * Prepares the plane detection on touch for a frame of a session.
+ * @param frame Frame touched.
+ * @return Frame in world coordinates and ray.
+ */
+std::shared_ptr<TouchFrame> createTouchFrame(const SessionFrame& frame) {
+	std::shared_ptr<TouchFrame> touch(new TouchFrame());
+
+	SessionFrame world = frame;
+	glm::mat4 pose = world.pcData.asPose();
+	world.pc.transform(pose);
+	pc::VoxelGrid::downsample(world.pc, touch->cloud, VoxelSize);
+
+	// The depth sensor looks along +Z
+	touch->origin = glm::vec3(pose[3]);
+	touch->dir = glm::normalize(glm::vec3(pose[2]));
+
+	return touch;
+}
+
+/*
+ * Detects the plane along the ray of a frame and checks it is where the ray meets the closest points.
+ * @param touch Frame touched.
+ * @param details Intersection and points sampled.
+ * @return True if a plane is found in front of the points close to the ray.
+ */
+bool checkDetectAlongRay(const TouchFrame& touch, std::string& details) {
+	pc::PlaneDetector detector(PlaneThreshold, 0.f);
+
+	pc::Plane plane;
+	glm::vec3 hit;
+	if (!detector.detectAlongRay(touch.cloud.getPositionPtr(), touch.cloud.size(), touch.origin, touch.dir, SupportRadius, plane, hit)) {
+		details = "no plane found";
+		return false;
+	}
+
+	// The closest points to the ray must lie on the plane found
+	const glm::vec3* pos = touch.cloud.getPositionPtr();
+	float closestDist = -1.f, closestT = 0.f;
+	for (size_t i = 0; i < touch.cloud.size(); i++) {
+		glm::vec3 rel = pos[i] - touch.origin;
+		float t = glm::dot(rel, touch.dir);
+		float dist = glm::length(rel - touch.dir*t);
+		if (t > 0.f && (closestDist < 0.f || dist < closestDist)) {
+			closestDist = dist;
+			closestT = t;
+		}
+	}
+
+	float hitT = glm::dot(hit - touch.origin, touch.dir);
+
+	char buffer[128];
+	sprintf(buffer, "hit at %.3fm, closest point to the ray at %.3fm, %u inliers", hitT, closestT, (unsigned int)plane.inliers.size());
+	details = buffer;
+
+	return fabs(hitT - closestT) <= 2.f*PlaneThreshold + closestDist;
+}
+
+/*
+ * Touches frames spread over the synthetic session along rays through random points of each frame, and compares the
+ * planes detected with the surfaces of the room (see synth::Scene::createRoom) met by the same rays. Only rays meeting a
+ * wall or a box are counted, a detection is successful if the hit is where the ray meets the surface.
+ * @param session Synthetic session.
+ * @param details Success rate and angle error of the normals.
+ * @return True if the success rate and the median angle error are within the thresholds.
+ */
+bool checkPlaneDetection(const Session& session, std::string& details) {
+	std::shared_ptr<synth::Scene> scene = synth::Scene::createRoom();
+	pc::PlaneDetector detector(PlaneThreshold, 0.f);
+	std::mt19937 rng(1);
+
+	size_t nbrRays = 0, nbrDetected = 0;
+	std::vector<double> angleErrors;
+	size_t nbrFrames = std::min(PlaneCheckFrames, session.size());
+	for (size_t i = 0; i < nbrFrames; i++) {
+		std::shared_ptr<TouchFrame> touch = createTouchFrame(session.at(i*session.size() / nbrFrames));
+		if (!touch->cloud.size())
+			continue;
+
+		const glm::vec3* pos = touch->cloud.getPositionPtr();
+		std::uniform_int_distribution<size_t> pointDist(0, touch->cloud.size() - 1);
+		for (size_t j = 0; j < PlaneCheckRays; j++) {
+			glm::vec3 dir = glm::normalize(pos[pointDist(rng)] - touch->origin);
+
+			synth::SceneHit surface;
+			if (!scene->intersect(touch->origin, dir, surface, false))
+				continue;
+
+			glm::vec3 absNormal = glm::abs(surface.normal_);
+			if (std::max(absNormal.x, std::max(absNormal.y, absNormal.z)) < PlanarNormalCos)
+				continue;
+
+			nbrRays++;
+
+			pc::Plane plane;
+			glm::vec3 hit;
+			if (!detector.detectAlongRay(pos, touch->cloud.size(), touch->origin, dir, SupportRadius, plane, hit))
+				continue;
+
+			if (fabs(glm::dot(hit - touch->origin, dir) - surface.dist_) > 2.f*PlaneThreshold)
+				continue;
+
+			nbrDetected++;
+			double cosAngle = std::min(1.0, fabs((double)glm::dot(plane.normal, surface.normal_)));
+			angleErrors.push_back(acos(cosAngle)*180.0 / M_PI);
+		}
+	}
+
+	if (!nbrDetected) {
+		details = "no plane detected";
+		return false;
+	}
+
+	std::sort(angleErrors.begin(), angleErrors.end());
+	double meanAngle = 0.0;
+	for (double angle : angleErrors)
+		meanAngle += angle;
+	meanAngle /= angleErrors.size();
+	double medianAngle = angleErrors[angleErrors.size() / 2];
+	double rate = (double)nbrDetected / nbrRays;
+
+	char buffer[192];
+	sprintf(buffer, "%u of %u rays (%.1f%%), angle error median %.2f, mean %.2f, max %.2f degrees", (unsigned int)nbrDetected,
+		(unsigned int)nbrRays, rate*100.0, medianAngle, meanAngle, angleErrors.back());
+	details = buffer;
+
+	return rate >= MinDetectionRate && medianAngle <= MaxMedianAngleError;
+}
+
+/*
+ * Accumulates the point clouds of a session in world coordinates, as when the depth frames of a scan are merged.
+ * @param session Session whose frames are accumulated.
+ * @return Point cloud holding the points of every frame.
+ */
+std::shared_ptr<pc::PointCloud> accumulateSession(const Session& session) {
+	std::shared_ptr<pc::PointCloud> cloud(new pc::PointCloud());
+
+	size_t nbrPoints = 0;
+	for (size_t i = 0; i < session.size(); i++)
+		nbrPoints += session.at(i).pc.size();
+	cloud->reserve(nbrPoints);
+
+	pc::PointCloud world;
+	for (size_t i = 0; i < session.size(); i++) {
+		SessionFrame frame = session.at(i);
+		frame.pc.transformPointCloud(frame.pcData.asPose(), world);
+		cloud->addPoints(world);
+	}
+
+	return cloud;
+}
+
+/*
+ * Takes evenly spaced points of a point cloud, so the subset covers the same extent with a lower density.
+ * @param cloud Point cloud sampled.
+ * @param nbrPts Number of points taken.
+ * @return Subset of the point cloud.
+ */
+std::shared_ptr<pc::PointCloud> subsampleCloud(const pc::PointCloud& cloud, size_t nbrPts) {
+	std::shared_ptr<pc::PointCloud> subset(new pc::PointCloud());
+	nbrPts = std::min(nbrPts, cloud.size());
+
+	std::vector<glm::vec3> pos(nbrPts);
+	std::vector<float> conf(nbrPts);
+	for (size_t i = 0; i < nbrPts; i++) {
+		size_t idx = i * cloud.size() / nbrPts;
+		pos[i] = cloud.getPositionPtr()[idx];
+		conf[i] = cloud.getConfidencePtr()[idx];
+	}
+	subset->addPoints(pos.data(), nullptr, nullptr, conf.data(), nbrPts);
+
+	return subset;
+}
+
+/*
+ * Creates query positions around the points of a point cloud.
+ * @param cloud Point cloud queried.
+ * @param nbrQueries Number of queries.
+ * @return Query positions, within a query radius of a point.
+ */
+std::vector<glm::vec3> createQueries(const pc::PointCloud& cloud, size_t nbrQueries) {
+	std::mt19937 rng(1);
+	std::uniform_int_distribution<size_t> point(0, cloud.size() - 1);
+	std::uniform_real_distribution<float> offset(-QueryRadius, QueryRadius);
+
+	std::vector<glm::vec3> queries(nbrQueries);
+	for (size_t i = 0; i < nbrQueries; i++)
+		queries[i] = cloud.getPositionPtr()[point(rng)] + glm::vec3(offset(rng), offset(rng), offset(rng));
+
+	return queries;
+}
+
+/*
+ * Answers radius and k-nearest queries with the spatial hash and checking every point, which must find the same points
+ * (the same distances for the k-nearest, as ties can be broken differently).
+ * @param cloud Point cloud queried.
+ * @param details Queries compared and points found.
+ * @return True if every query finds the same points.
+ */
+bool checkSpatialHash(const pc::PointCloud& cloud, std::string& details) {
+	pc::SpatialHash hash(HashCellSize);
+	if (!hash.build(cloud)) {
+		details = "unable to build the spatial hash";
+		return false;
+	}
+
+	std::vector<glm::vec3> queries = createQueries(cloud, NbrCheckQueries);
+	const glm::vec3* pos = cloud.getPositionPtr();
+
+	std::vector<size_t> indices;
+	std::vector<float> sqDistances;
+	std::vector<std::pair<float, size_t> > bruteForce(cloud.size());
+
+	size_t nbrRadiusDiff = 0, nbrNearestDiff = 0, nbrFound = 0;
+	for (const glm::vec3& query : queries) {
+		for (size_t i = 0; i < cloud.size(); i++) {
+			glm::vec3 diff = pos[i] - query;
+			bruteForce[i] = std::make_pair(diff.x*diff.x + diff.y*diff.y + diff.z*diff.z, i);
+		}
+
+		// Points within the radius, in index order
+		std::vector<size_t> inside;
+		for (size_t i = 0; i < cloud.size(); i++) {
+			if (bruteForce[i].first <= QueryRadius*QueryRadius)
+				inside.push_back(i);
+		}
+
+		hash.radiusSearch(query, QueryRadius, indices, sqDistances);
+		std::sort(indices.begin(), indices.end());
+		if (indices != inside)
+			nbrRadiusDiff++;
+		nbrFound += inside.size();
+
+		// Closest points, compared by distance
+		size_t k = std::min(QueryNeighbors, cloud.size());
+		std::partial_sort(bruteForce.begin(), bruteForce.begin() + k, bruteForce.end());
+
+		hash.knnSearch(query, QueryNeighbors, indices, sqDistances);
+		bool isSame = indices.size() == k;
+		for (size_t i = 0; isSame && (i < k); i++)
+			isSame = sqDistances[i] == bruteForce[i].first;
+		if (!isSame)
+			nbrNearestDiff++;
+	}
+
+	char buffer[192];
+	sprintf(buffer, "%u queries on %u points in %u cells, %u radius and %u k-nearest mismatches, %.1f points per radius query", (unsigned int)queries.size(),
+		(unsigned int)cloud.size(), (unsigned int)hash.nbrCells(), (unsigned int)nbrRadiusDiff, (unsigned int)nbrNearestDiff, (double)nbrFound / queries.size());
+	details = buffer;
+
+	return !nbrRadiusDiff && !nbrNearestDiff;
+}
+
+/*
+ * Transforms a set of positions one at a time and bounds them in a second pass, as the point cloud did before
+ * pc::PointTransform.
+ * @param pose Transformation to apply.
+ * @param in Pointer to the input positions.
+ * @param out Pointer to the output positions.
+ * @param nbrPts Number of positions.
+ * @param bb Bounding box of the transformed positions.
+ */
+void transformScalar(const glm::mat4& pose, const glm::vec3* in, glm::vec3* out, size_t nbrPts, pc::BoundingBox& bb) {
+	for (size_t i = 0; i < nbrPts; i++) {
+		const glm::vec3& p = in[i];
+		glm::vec3& q = out[i];
+		q.x = pose[0][0] * p.x + pose[1][0] * p.y + pose[2][0] * p.z + pose[3][0];
+		q.y = pose[0][1] * p.x + pose[1][1] * p.y + pose[2][1] * p.z + pose[3][1];
+		q.z = pose[0][2] * p.x + pose[1][2] * p.y + pose[2][2] * p.z + pose[3][2];
+	}
+
+	bb = pc::BoundingBox();
+	for (size_t i = 0; i < nbrPts; i++) {
+		bb.min = glm::min(bb.min, out[i]);
+		bb.max = glm::max(bb.max, out[i]);
+	}
+	bb.valid = nbrPts > 0;
+}
+
+/*
+ * Calculates the largest difference between two sets of positions.
+ * @param a First set of positions.
+ * @param b Second set of positions.
+ * @param nbrPts Number of positions.
+ * @return Largest difference of any coordinate.
+ */
+float maxPositionDiff(const glm::vec3* a, const glm::vec3* b, size_t nbrPts) {
+	float maxDiff = 0.f;
+	for (size_t i = 0; i < nbrPts; i++) {
+		glm::vec3 diff = glm::abs(a[i] - b[i]);
+		maxDiff = std::max(maxDiff, std::max(diff.x, std::max(diff.y, diff.z)));
+	}
+
+	return maxDiff;
+}
+
+/*
+ * Transforms a point cloud with pc::PointTransform, sequentially and over several threads, and checks the positions
+ * and bounding boxes match the scalar transformation.
+ * @param cloud Point cloud transformed.
+ * @param pose Transformation to apply.
+ * @param details Largest differences found.
+ * @return True if the positions and the bounding boxes match within tolerance.
+ */
+bool checkTransform(const pc::PointCloud& cloud, const glm::mat4& pose, std::string& details) {
+	const float Tolerance = 1e-4f; // The SIMD code may round the products differently
+
+	size_t nbrPts = cloud.size();
+	std::vector<glm::vec3> ref(nbrPts), simd(nbrPts), parallel(nbrPts);
+	pc::BoundingBox bbRef, bbSimd, bbParallel;
+
+	transformScalar(pose, cloud.getPositionPtr(), ref.data(), nbrPts, bbRef);
+	pc::PointTransform::transform(pose, cloud.getPositionPtr(), simd.data(), nbrPts, &bbSimd);
+	pc::PointTransform::transformParallel(pose, cloud.getPositionPtr(), parallel.data(), nbrPts, &bbParallel);
+
+	float diffSimd = maxPositionDiff(ref.data(), simd.data(), nbrPts);
+	float diffParallel = maxPositionDiff(ref.data(), parallel.data(), nbrPts);
+	float diffBB = std::max(maxPositionDiff(&bbRef.min, &bbSimd.min, 1), maxPositionDiff(&bbRef.max, &bbSimd.max, 1));
+	diffBB = std::max(diffBB, std::max(maxPositionDiff(&bbRef.min, &bbParallel.min, 1), maxPositionDiff(&bbRef.max, &bbParallel.max, 1)));
+
+	char buffer[160];
+	sprintf(buffer, "%u points, %g with SIMD, %g in parallel, %g in the bounding boxes", (unsigned int)nbrPts, diffSimd, diffParallel, diffBB);
+	details = buffer;
+
+	return bbSimd.valid && bbParallel.valid && diffSimd <= Tolerance && diffParallel <= Tolerance && diffBB <= Tolerance;
+}
+
+/*
+ * Reads a point cloud file as saved by the app one value at a time, as io::PointCloudReader did before reading the
+ * payload at once.
+ * @param filename Filename of the point cloud.
+ * @param pc Point cloud where the points are added.
+ * @param pcData Metadata of the point cloud.
+ * @param minConf Minimum confidence for the point to be included.
+ * @return True if successful.
+ */
+bool readPerFloat(const std::string& filename, pc::PointCloud& pc, io::PointCloudMetadata& pcData, float minConf = -1) {
+	std::ifstream file(filename, std::ios::in | std::ios::binary);
+	if (!file.is_open())
+		return false;
+
+	file.read((char*)&pcData.width_, sizeof(uint32_t));
+	file.read((char*)&pcData.height_, sizeof(uint32_t));
+	file.read((char*)&pcData.f_.x, sizeof(double) * 2);
+	file.read((char*)&pcData.c_.x, sizeof(double) * 2);
+	file.read((char*)pcData.distortion_, sizeof(double) * 5);
+	file.read((char*)&pcData.nbrPoints_, sizeof(uint32_t));
+	file.read((char*)&pcData.timestamp_, sizeof(double));
+	file.read((char*)pcData.translation_, sizeof(double) * 3);
+	file.read((char*)pcData.orientation_, sizeof(double) * 4);
+	file.read((char*)&pcData.accuracy_, sizeof(float));
+
+	for (int i = 0; i < 5; i++)
+		pcData.distortionF_[i] = pcData.distortion_[i];
+
+	pc::Point pt;
+	float conf;
+
+	pc.reserve(pc.size() + pcData.nbrPoints_);
+
+	for (unsigned int i = 0; i < pcData.nbrPoints_; i++) {
+		for (int j = 0; j < 3; j++)
+			file.read((char*)&pt.pos[j], sizeof(float));
+		file.read((char*)&conf, sizeof(float));
+
+		if (conf >= minConf) {
+			pt.confidence = conf;
+			pc.addPoint(pt);
+		}
+	}
+
+	pcData.nbrPoints_ = (unsigned int)pc.size();
+
+	return file.good();
+}
+
+/*
+ * Reads a point cloud saved as by the app with the bulk and the per-value readers, which must agree, and writes it in
+ * the compact format in single and reduced precision, which must be read back within the precision stored. The file cut
+ * in the middle of the points must be reported as truncated.
+ * @param frame Frame whose point cloud is written.
+ * @param details Points read and largest differences found.
+ * @return True if every point cloud is read back as expected.
+ */
+bool checkPointCloudIO(const SessionFrame& frame, std::string& details) {
+	if (!io::PointCloudWriter::writeTango(TangoFile, frame.pc, frame.pcData)) {
+		details = "unable to write the point cloud";
+		return false;
+	}
+
+	pc::PointCloud bulk, perFloat;
+	io::PointCloudMetadata bulkData, perFloatData;
+	bool isRead = io::PointCloudReader::read(TangoFile, bulk, bulkData) && readPerFloat(TangoFile, perFloat, perFloatData);
+
+	// The same file cut in the middle of the points must be reported
+	std::ifstream in(TangoFile, std::ios::in | std::ios::binary);
+	std::string content((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+	in.close();
+	std::ofstream out(TangoFile, std::ios::out | std::ios::binary);
+	out.write(content.data(), content.size() / 2);
+	out.close();
+
+	pc::PointCloud truncated;
+	io::PointCloudMetadata truncatedData;
+	bool isTruncatedRead = io::PointCloudReader::read(TangoFile, truncated, truncatedData);
+	remove(TangoFile);
+
+	if (!isRead || (bulk.size() != frame.pc.size()) || (perFloat.size() != bulk.size())) {
+		details = "unable to read the point cloud back";
+		return false;
+	}
+
+	if (isTruncatedRead) {
+		details = "truncated point cloud read as complete";
+		return false;
+	}
+
+	float diffRead = maxPositionDiff(bulk.getPositionPtr(), perFloat.getPositionPtr(), bulk.size());
+	for (size_t i = 0; i < bulk.size(); i++)
+		diffRead = std::max(diffRead, fabsf(bulk.getConfidencePtr()[i] - perFloat.getConfidencePtr()[i]));
+
+	// Half precision keeps 11 significant bits, the confidence in 8 bits is rounded
+	float maxCoord = 0.f;
+	const glm::vec3* pos = frame.pc.getPositionPtr();
+	for (size_t i = 0; i < frame.pc.size(); i++)
+		maxCoord = std::max(maxCoord, std::max(fabsf(pos[i].x), std::max(fabsf(pos[i].y), fabsf(pos[i].z))));
+
+	float diffCompact = -1.f, diffHalf = -1.f, diffConf = -1.f;
+
+	pc::PointCloud compact;
+	if (io::PointCloudWriter::write(CompactFile, frame.pc) && io::PointCloudReader::readCompact(CompactFile, compact) && (compact.size() == frame.pc.size()))
+		diffCompact = maxPositionDiff(compact.getPositionPtr(), pos, compact.size());
+
+	pc::PointCloud half;
+	if (io::PointCloudWriter::write(CompactFile, frame.pc, io::HalfPositions | io::ByteConfidence) && io::PointCloudReader::readCompact(CompactFile, half) && (half.size() == frame.pc.size())) {
+		diffHalf = maxPositionDiff(half.getPositionPtr(), pos, half.size());
+		diffConf = 0.f;
+		for (size_t i = 0; i < half.size(); i++)
+			diffConf = std::max(diffConf, fabsf(half.getConfidencePtr()[i] - frame.pc.getConfidencePtr()[i]));
+	}
+	remove(CompactFile);
+
+	char buffer[192];
+	sprintf(buffer, "%u points, %g between readers, compact %g, half %g (coordinates up to %.2f), byte confidence %g", (unsigned int)bulk.size(), diffRead, diffCompact, diffHalf, maxCoord, diffConf);
+	details = buffer;
+
+	return diffRead == 0.f && diffCompact == 0.f && diffHalf >= 0.f && diffHalf <= maxCoord / 1024.f && diffConf >= 0.f && diffConf <= 0.5f / 255.f + 1e-6f;
+}
+
+void addPCBenchmarks(BenchmarkSuite& suite, const std::shared_ptr<Session>& session) {
+	if (!session || !session->size())
+		return;
+
+	std::shared_ptr<pc::PointCloud> cloud = accumulateSession(*session);
+
+	// Downsampling and neighbor queries on subsets of the accumulated cloud of growing size, covering the same extent
+	const size_t ScaleSizes[] = { 10000, 100000, 1000000 };
+	const char* ScaleNames[] = { "10k", "100k", "1M" };
+
+	suite.addCheck("pc.spatialHash.equivalence", [cloud](std::string& details) {
+		return checkSpatialHash(*subsampleCloud(*cloud, 100000), details);
+	});
+
+	for (size_t i = 0; i < sizeof(ScaleSizes) / sizeof(ScaleSizes[0]); i++) {
+		if (cloud->size() < ScaleSizes[i])
+			break;
+
+		std::shared_ptr<pc::PointCloud> subset = subsampleCloud(*cloud, ScaleSizes[i]);
+		std::shared_ptr<pc::SpatialHash> hash(new pc::SpatialHash(HashCellSize));
+		std::shared_ptr<std::vector<glm::vec3> > queries(new std::vector<glm::vec3>(createQueries(*subset, NbrQueries)));
+		std::string suffix = std::string(".") + ScaleNames[i];
+
+		suite.add("pc.voxelGrid.downsample" + suffix, [subset]() {
+			pc::PointCloud cloudDown;
+			return BenchmarkSuite::measure([&]() {
+				pc::VoxelGrid::downsample(*subset, cloudDown, VoxelSize);
+			});
+		}, (double)subset->size());
+
+		suite.add("pc.spatialHash.build" + suffix, [subset, hash]() {
+			return BenchmarkSuite::measure([&]() {
+				hash->build(*subset);
+			});
+		}, (double)subset->size());
+
+		suite.add("pc.spatialHash.radius" + suffix, [subset, hash, queries]() {
+			if (hash->size() != subset->size())
+				hash->build(*subset);
+
+			std::vector<size_t> indices;
+			std::vector<float> sqDistances;
+			return BenchmarkSuite::measure([&]() {
+				for (const glm::vec3& query : *queries)
+					hash->radiusSearch(query, QueryRadius, indices, sqDistances);
+			});
+		}, (double)queries->size());
+
+		suite.add("pc.spatialHash.kNearest" + suffix, [subset, hash, queries]() {
+			if (hash->size() != subset->size())
+				hash->build(*subset);
+
+			std::vector<size_t> indices;
+			std::vector<float> sqDistances;
+			return BenchmarkSuite::measure([&]() {
+				for (const glm::vec3& query : *queries)
+					hash->knnSearch(query, QueryNeighbors, indices, sqDistances);
+			});
+		}, (double)queries->size());
+	}
+
+	// Plane under a touch on the frame in the middle of the session, sampling the points close to the ray or every point
+	std::shared_ptr<TouchFrame> touch = createTouchFrame(session->at(session->size() / 2));
+	suite.addCheck("pc.detectAlongRay", [touch](std::string& details) {
+		return checkDetectAlongRay(*touch, details);
+	});
+
+	suite.addCheck("pc.detectAlongRay.accuracy", [session](std::string& details) {
+		return checkPlaneDetection(*session, details);
+	});
+
+	suite.add("pc.detectAlongRay", [touch]() {
+		pc::PlaneDetector detector(PlaneThreshold, 0.f);
+
+		pc::Plane plane;
+		glm::vec3 hit;
+		return BenchmarkSuite::measure([&]() {
+			detector.detectAlongRay(touch->cloud.getPositionPtr(), touch->cloud.size(), touch->origin, touch->dir, SupportRadius, plane, hit);
+		});
+	}, (double)touch->cloud.size());
+
+	suite.add("pc.detectPlanes", [touch]() {
+		pc::PlaneDetector detector(PlaneThreshold, 0.f);
+
+		std::vector<pc::Plane> planes;
+		return BenchmarkSuite::measure([&]() {
+			detector.detect(touch->cloud, planes);
+		});
+	}, (double)touch->cloud.size());
+
+	// Transformation of the accumulated cloud, one point at a time and bounded in a second pass, with SIMD and in parallel
+	glm::mat4 pose = io::PointCloudMetadata(session->at(session->size() / 2).pcData).asPose();
+	suite.addCheck("pc.transform.equivalence", [cloud, pose](std::string& details) {
+		return checkTransform(*cloud, pose, details);
+	});
+
+	std::shared_ptr<std::vector<glm::vec3>> transformed(new std::vector<glm::vec3>(cloud->size()));
+
+	suite.add("pc.transform.scalar", [cloud, pose, transformed]() {
+		pc::BoundingBox bb;
+		return BenchmarkSuite::measure([&]() {
+			transformScalar(pose, cloud->getPositionPtr(), transformed->data(), cloud->size(), bb);
+		});
+	}, (double)cloud->size());
+
+	suite.add("pc.transform.simd", [cloud, pose, transformed]() {
+		pc::BoundingBox bb;
+		return BenchmarkSuite::measure([&]() {
+			pc::PointTransform::transform(pose, cloud->getPositionPtr(), transformed->data(), cloud->size(), &bb);
+		});
+	}, (double)cloud->size());
+
+	suite.add("pc.transform.parallel", [cloud, pose, transformed]() {
+		pc::BoundingBox bb;
+		return BenchmarkSuite::measure([&]() {
+			pc::PointTransform::transformParallel(pose, cloud->getPositionPtr(), transformed->data(), cloud->size(), &bb);
+		});
+	}, (double)cloud->size());
+
+	// Point cloud files of a frame, as saved by the app, in the compact format and as text
+	std::shared_ptr<SessionFrame> frame(new SessionFrame(session->at(session->size() / 2)));
+	suite.addCheck("pc.io.roundTrip", [frame](std::string& details) {
+		return checkPointCloudIO(*frame, details);
+	});
+
+	double nbrFramePts = (double)frame->pc.size();
+
+	suite.add("pc.io.read", [frame]() {
+		io::PointCloudWriter::writeTango(TangoFile, frame->pc, frame->pcData);
+
+		pc::PointCloud pc;
+		io::PointCloudMetadata pcData;
+		double time = BenchmarkSuite::measure([&]() {
+			pc.clear();
+			io::PointCloudReader::read(TangoFile, pc, pcData);
+		});
+		remove(TangoFile);
+
+		return time;
+	}, nbrFramePts);
+
+	suite.add("pc.io.readPerFloat", [frame]() {
+		io::PointCloudWriter::writeTango(TangoFile, frame->pc, frame->pcData);
+
+		pc::PointCloud pc;
+		io::PointCloudMetadata pcData;
+		double time = BenchmarkSuite::measure([&]() {
+			pc.clear();
+			readPerFloat(TangoFile, pc, pcData);
+		});
+		remove(TangoFile);
+
+		return time;
+	}, nbrFramePts);
+
+	suite.add("pc.io.writeCompact", [frame]() {
+		double time = BenchmarkSuite::measure([&]() {
+			io::PointCloudWriter::write(CompactFile, frame->pc);
+		});
+		remove(CompactFile);
+
+		return time;
+	}, nbrFramePts);
+
+	suite.add("pc.io.writeCompactHalf", [frame]() {
+		double time = BenchmarkSuite::measure([&]() {
+			io::PointCloudWriter::write(CompactFile, frame->pc, io::HalfPositions | io::ByteConfidence);
+		});
+		remove(CompactFile);
+
+		return time;
+	}, nbrFramePts);
+
+	suite.add("pc.io.readCompact", [frame]() {
+		io::PointCloudWriter::write(CompactFile, frame->pc);
+
+		pc::PointCloud pc;
+		double time = BenchmarkSuite::measure([&]() {
+			pc.clear();
+			io::PointCloudReader::readCompact(CompactFile, pc);
+		});
+		remove(CompactFile);
+
+		return time;
+	}, nbrFramePts);
+
+	suite.add("pc.io.writeXYZ", [frame]() {
+		double time = BenchmarkSuite::measure([&]() {
+			io::PointCloudWriter::writeXYZ(XYZFile, frame->pc);
+		});
+		remove(XYZFile);
+
+		return time;
+	}, nbrFramePts);
+}
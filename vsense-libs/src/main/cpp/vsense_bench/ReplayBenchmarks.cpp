@@ -0,0 +1,495 @@
+#include "Cases.h"
+
+#include <vsense/common/Parallel.h>
+#include <vsense/depth/DepthMap.h>
+#include <vsense/em/EnvironmentMap.h>
+#include <vsense/em/IntegrationController.h>
+#include <vsense/em/UniformityMask.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+
+using namespace vsense;
+
+const float ReplayTolerance = 0.2f; // The replays allocate the EM and are noisier than the kernels
+
+const float UniformityDelta = glm::radians(0.25f); // NeighbordHoodDelta in EnvironmentMap.cpp
+const float UniformityMaxVariance = 0.0075f;       // MaxVariance in EnvironmentMap.cpp
+const size_t UniformityPasses = 2;                 // Turns of the session, the second one revisits the filled EM
+
+volatile size_t UniformSink; // Keeps the results of the uniformity queries alive
+
+/*
+ * Replays a session processing one frame at a time.
+ * @param session Session to replay.
+ * @param dm Depth map used for every frame.
+ * @param em EM where the frames are integrated.
+ * @return Number of frames integrated.
+ */
+size_t replaySequential(const Session& session, depth::DepthMap& dm, em::EnvironmentMap& em) {
+	size_t nbrIntegrated = 0;
+	for (size_t i = 0; i < session.size(); i++) {
+		const SessionFrame& frame = session.at(i);
+		if (!dm.fillWithData(frame.pc, frame.pcData, frame.img, frame.imData))
+			continue;
+
+		if (em.addDepthMapFrame(&dm, true, false))
+			nbrIntegrated++;
+	}
+
+	return nbrIntegrated;
+}
+
+/*
+ * Replays a session processing the depth maps of as many frames as depth maps in parallel, then integrating them in
+ * order. The EM is the same as the one of the sequential replay since the depth maps don't depend on each other.
+ * @param session Session to replay.
+ * @param dms Depth maps used for a batch of frames.
+ * @param em EM where the frames are integrated.
+ * @return Number of frames integrated.
+ */
+size_t replayFrameParallel(const Session& session, std::vector<std::shared_ptr<depth::DepthMap>>& dms, em::EnvironmentMap& em) {
+	size_t nbrIntegrated = 0;
+	std::vector<char> isFilled(dms.size());
+	for (size_t first = 0; first < session.size(); first += dms.size()) {
+		size_t nbrFrames = std::min(dms.size(), session.size() - first);
+
+		common::parallelFor(nbrFrames, [&](size_t i) {
+			const SessionFrame& frame = session.at(first + i);
+			isFilled[i] = dms[i]->fillWithData(frame.pc, frame.pcData, frame.img, frame.imData);
+		}, dms.size());
+
+		for (size_t i = 0; i < nbrFrames; i++) {
+			if (isFilled[i] && em.addDepthMapFrame(dms[i].get(), true, false))
+				nbrIntegrated++;
+		}
+	}
+
+	return nbrIntegrated;
+}
+
+/*
+ * Creates the depth maps of the frame-parallel replay.
+ * @param nbrThreads Maximum number of threads, 0 to use all available.
+ * @return Depth maps, one per thread.
+ */
+std::vector<std::shared_ptr<depth::DepthMap>> createDepthMaps(size_t nbrThreads) {
+	std::vector<std::shared_ptr<depth::DepthMap>> dms(nbrThreads ? nbrThreads : common::hardwareThreads());
+	for (size_t i = 0; i < dms.size(); i++)
+		dms[i].reset(new depth::DepthMap());
+
+	return dms;
+}
+
+/*
+ * Replays a session sequentially and frame-parallel and checks both produce the same EM.
+ * @param session Session to replay.
+ * @param nbrThreads Maximum number of threads of the frame-parallel replay, 0 to use all available.
+ * @param details Frames integrated and coverage of the EM.
+ * @return True if the EMs are identical.
+ */
+bool checkReplays(const std::shared_ptr<Session>& session, size_t nbrThreads, std::string& details) {
+	session->useDepthMapping();
+
+	depth::DepthMap dm;
+	em::EnvironmentMap emSequential;
+	size_t nbrSequential = replaySequential(*session, dm, emSequential);
+
+	std::vector<std::shared_ptr<depth::DepthMap>> dms = createDepthMaps(nbrThreads);
+	em::EnvironmentMap emParallel;
+	size_t nbrParallel = replayFrameParallel(*session, dms, emParallel);
+
+	bool isEqual = nbrSequential == nbrParallel && emSequential.isEmpty() == emParallel.isEmpty();
+	if (isEqual && !emSequential.isEmpty()) {
+		size_t nbrPixels = em::EnvironmentMap::getWidth()*em::EnvironmentMap::getHeight();
+		isEqual = !memcmp(emSequential.getColorPtr(), emParallel.getColorPtr(), sizeof(glm::vec3)*nbrPixels) &&
+			!memcmp(emSequential.getDepthPtr(), emParallel.getDepthPtr(), sizeof(float)*nbrPixels) &&
+			!memcmp(emSequential.getFlagsPtr(), emParallel.getFlagsPtr(), sizeof(uchar)*nbrPixels);
+	}
+
+	std::stringstream text;
+	text << nbrSequential << "/" << session->size() << " frames integrated, coverage " << emSequential.getCoverage()*100.f
+		<< "%, frame-parallel replay " << (isEqual ? "matches" : "differs from") << " the sequential one";
+	details = text.str();
+
+	return isEqual;
+}
+
+/*
+ * Replays a session sequentially at the resolution of the depth sensor and with the depth maps upsampled, and reports
+ * the time per frame, the coverage of the EM and the EM pixels filled by every frame of both replays.
+ * @param session Session to replay.
+ * @param upsamplingFraction Fraction of the color image width the depth maps are upsampled to.
+ * @param details Time per frame, coverage and new pixels per frame of both replays.
+ * @return True if both replays integrate the same frames and the upsampled one covers at least as much of the EM.
+ */
+bool checkUpsampling(const std::shared_ptr<Session>& session, float upsamplingFraction, std::string& details) {
+	session->useDepthMapping();
+
+	const float fractions[2] = { 0.f, upsamplingFraction };
+	size_t nbrIntegrated[2] = { 0, 0 }, nbrNewPixels[2] = { 0, 0 }, upSize[2] = { 0, 0 };
+	double frameMS[2] = { 0., 0. };
+	float coverage[2] = { 0.f, 0.f };
+	for (int r = 0; r < 2; r++) {
+		depth::DepthMap::setUpsamplingColorFraction(fractions[r]);
+
+		depth::DepthMap dm;
+		em::EnvironmentMap em;
+		for (size_t i = 0; i < session->size(); i++) {
+			const SessionFrame& frame = session->at(i);
+
+			std::chrono::high_resolution_clock::time_point t = std::chrono::high_resolution_clock::now();
+			bool isIntegrated = dm.fillWithData(frame.pc, frame.pcData, frame.img, frame.imData) && em.addDepthMapFrame(&dm, true, false);
+			std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - t;
+			frameMS[r] += elapsed.count();
+
+			if (isIntegrated) {
+				nbrIntegrated[r]++;
+				nbrNewPixels[r] += em.getLastNewPixels();
+			}
+		}
+
+		frameMS[r] /= session->size();
+		coverage[r] = em.getCoverage();
+		upSize[r] = dm.upsampledWidth();
+	}
+	depth::DepthMap::setUpsamplingColorFraction(0.f);
+
+	std::stringstream text;
+	text.precision(3);
+	for (int r = 0; r < 2; r++) {
+		text << (r ? ", upsampled to " : "sensor resolution: ");
+		if (r)
+			text << upSize[r] << " pixels wide: ";
+		text << frameMS[r] << "ms per frame, coverage " << coverage[r] * 100.f << "%, " << nbrNewPixels[r] / std::max(nbrIntegrated[r], (size_t)1)
+			<< " new EM pixels per frame";
+	}
+	details = text.str();
+
+	return nbrIntegrated[0] == nbrIntegrated[1] && upSize[1] > 0 && coverage[1] >= coverage[0];
+}
+
+/*
+ * The UniformityTrace structure holds the uniformity queries made by the EM during a replay and the pixels of the EM
+ * written by every frame, so the cached mask and the evaluation of every neighborhood can be compared on the same
+ * accesses without the rest of the integration.
+ */
+struct UniformityTrace {
+	size_t                                                 width;      /*!< Width of the EM. */
+	size_t                                                 height;     /*!< Height of the EM. */
+	int                                                    radius;     /*!< Radius of the neighborhoods. */
+	std::vector<std::vector<size_t>>                       queries;    /*!< Pixels queried by every frame, in order. */
+	std::vector<std::vector<std::pair<size_t, glm::vec3>>> writes;     /*!< Pixels written by every frame and their color. */
+	size_t                                                 nbrQueries; /*!< Total number of queries. */
+
+	/*
+	 * Replays a session through the EM and records the queries and the writes of every frame, unless already recorded.
+	 * Every candidate with a reference in the EM is queried, as with the uniformity check enabled, but none is discarded.
+	 * @param session Session to replay.
+	 */
+	void record(const Session& session) {
+		if (!queries.empty())
+			return;
+
+		session.useDepthMapping();
+
+		width = em::EnvironmentMap::getWidth();
+		height = em::EnvironmentMap::getHeight();
+		radius = std::max((int)floor(UniformityDelta*(width - 1) / (2.0*M_PI) + 0.5), 1);
+		nbrQueries = 0;
+
+		depth::DepthMap dm;
+		em::EnvironmentMap em;
+		std::vector<glm::vec3> color(width*height, glm::vec3(-1.f));
+		for (size_t pass = 0; pass < UniformityPasses; pass++) {
+			for (size_t i = 0; i < session.size(); i++) {
+				const SessionFrame& frame = session.at(i);
+				if (!dm.fillWithData(frame.pc, frame.pcData, frame.img, frame.imData))
+					continue;
+
+				em.addDepthMapFrame(&dm, true, false);
+
+				queries.push_back(std::vector<size_t>());
+				const em::EMSample* samples = em.getLastSamples().get();
+				for (size_t j = 0; j < em.getSamplesNumber(); j++) {
+					if (samples[j].refDepth >= 0.f)
+						queries.back().push_back(samples[j].uvOffset);
+				}
+				nbrQueries += queries.back().size();
+
+				writes.push_back(std::vector<std::pair<size_t, glm::vec3>>());
+				const glm::vec3* emColor = em.getColorPtr();
+				for (size_t j = 0; j < width*height; j++) {
+					if (emColor[j] != color[j]) {
+						color[j] = emColor[j];
+						writes.back().push_back(std::make_pair(j, color[j]));
+					}
+				}
+			}
+		}
+	}
+};
+
+/*
+ * Evaluates the variance of the neighborhood of a pixel of the EM, wrapping around horizontally and clamped at the poles
+ * as the uniformity mask.
+ * @param color Color map.
+ * @param width Map width.
+ * @param height Map height.
+ * @param radius Radius of the neighborhood.
+ * @param offset Offset of the pixel.
+ * @return True if the variance of every channel is below the threshold of the EM.
+ */
+bool isUniformDirect(const glm::vec3* color, size_t width, size_t height, int radius, size_t offset) {
+	int x = (int)(offset % width);
+	int y = (int)(offset / width);
+
+	glm::dvec3 sum(0., 0., 0.), sumSq(0., 0., 0.);
+	for (int dy = -radius; dy <= radius; dy++) {
+		const glm::vec3* rowPtr = color + std::min(std::max(y + dy, 0), (int)height - 1)*width;
+		for (int dx = -radius; dx <= radius; dx++) {
+			glm::dvec3 c(rowPtr[(x + dx + (int)width) % (int)width]);
+			sum += c;
+			sumSq += c*c;
+		}
+	}
+
+	double invCount = 1. / ((2 * radius + 1)*(2 * radius + 1));
+	glm::dvec3 mean = sum*invCount;
+	glm::dvec3 variance = sumSq*invCount - mean*mean;
+
+	return (variance.x <= UniformityMaxVariance) && (variance.y <= UniformityMaxVariance) && (variance.z <= UniformityMaxVariance);
+}
+
+/*
+ * Replays the uniformity queries of a trace, with the cached mask or evaluating every neighborhood.
+ * @param trace Trace replayed.
+ * @param mask Mask used for the queries, NULL to evaluate every neighborhood.
+ * @param color Color map, overwritten.
+ * @param results Result of every query, NULL if not needed.
+ * @return Number of uniform neighborhoods.
+ */
+size_t replayUniformity(const UniformityTrace& trace, em::UniformityMask* mask, std::vector<glm::vec3>& color, std::vector<char>* results) {
+	color.assign(trace.width*trace.height, glm::vec3(-1.f));
+	if (mask) {
+		mask->setRadius(trace.radius);
+		mask->resize(trace.width, trace.height);
+	}
+	if (results)
+		results->clear();
+
+	size_t nbrUniform = 0;
+	for (size_t i = 0; i < trace.queries.size(); i++) {
+		for (size_t offset : trace.queries[i]) {
+			bool isUniform = mask ? mask->isUniform(color.data(), offset) : isUniformDirect(color.data(), trace.width, trace.height, trace.radius, offset);
+			nbrUniform += isUniform;
+			if (results)
+				results->push_back(isUniform);
+		}
+
+		for (const std::pair<size_t, glm::vec3>& write : trace.writes[i]) {
+			color[write.first] = write.second;
+			if (mask)
+				mask->invalidate(write.first);
+		}
+	}
+
+	return nbrUniform;
+}
+
+/*
+ * Replays the uniformity queries of a session with the cached mask and evaluating every neighborhood, and checks both
+ * give the same result for every query.
+ * @param trace Trace of the session.
+ * @param details Mismatches, queries and tiles evaluated.
+ * @return True if no query differs.
+ */
+bool checkUniformityMask(const UniformityTrace& trace, std::string& details) {
+	std::vector<glm::vec3> color;
+	std::vector<char> cached, direct;
+	em::UniformityMask mask(1, UniformityMaxVariance);
+	size_t nbrUniform = replayUniformity(trace, &mask, color, &cached);
+	replayUniformity(trace, NULL, color, &direct);
+
+	size_t nbrMismatches = 0;
+	for (size_t i = 0; i < cached.size(); i++)
+		nbrMismatches += cached[i] != direct[i];
+
+	std::stringstream text;
+	text.precision(3);
+	text << nbrMismatches << " mismatches in " << trace.nbrQueries << " queries over " << trace.queries.size() << " frames, "
+		<< 100.0*nbrUniform / std::max(trace.nbrQueries, (size_t)1) << "% uniform, " << mask.getNbrTileUpdates() << " tiles evaluated";
+	details = text.str();
+
+	return trace.nbrQueries > 0 && nbrMismatches == 0;
+}
+
+/*
+ * Retrieves the pose of every frame of a session and the intrinsics of its depth sensor, as received by the app.
+ * @param session Session.
+ * @param poses Pose of every frame.
+ * @param f Focal length in pixels.
+ * @param c Optical center in pixels.
+ * @param size Size of the depth map.
+ */
+void getSessionPoses(const Session& session, std::vector<em::RecordedPose>& poses, glm::vec2& f, glm::vec2& c, glm::uvec2& size) {
+	poses.resize(session.size());
+	for (size_t i = 0; i < session.size(); i++) {
+		io::PointCloudMetadata pcData = session.at(i).pcData;
+		poses[i].timestamp = pcData.timestamp_;
+		poses[i].pose = pcData.asPose();
+	}
+
+	const io::PointCloudMetadata& pcData = session.at(0).pcData;
+	f = glm::vec2(pcData.f_);
+	c = glm::vec2(pcData.c_);
+	size = glm::uvec2(pcData.width_, pcData.height_);
+}
+
+/*
+ * Replays the poses of a session through the integration controller, as the app decides how every frame is added to
+ * the EM, and reports the decisions and the coverage of the EM as the session goes.
+ * @param poses Pose of every frame.
+ * @param f Focal length in pixels.
+ * @param c Optical center in pixels.
+ * @param size Size of the depth map.
+ * @param details Decisions, coverage at every quarter of the session and time spent.
+ * @return True if every frame was reported and the time spent is within the budget.
+ */
+bool checkIntegration(const std::vector<em::RecordedPose>& poses, const glm::vec2& f, const glm::vec2& c, const glm::uvec2& size, std::string& details) {
+	em::IntegrationParams params;
+	em::IntegrationController controller(params);
+	controller.setCamera(f, c, size);
+	const em::IntegrationStats& stats = controller.replay(poses);
+	const std::vector<em::CoverageSample>& report = controller.getReport();
+
+	// The credit starts full and is refilled with the budget of every frame
+	double maxSpentMS = std::max(params.burstFrames*params.budgetMS, params.fullCostMS) + (double)params.budgetMS*poses.size();
+	double everyFrameMS = (double)params.fullCostMS*poses.size();
+
+	std::stringstream text;
+	text.precision(3);
+	text << stats.nbrFull << "/" << stats.nbrReduced << "/" << stats.nbrSkipped << " of " << stats.nbrFrames << " frames full/reduced/skipped, coverage";
+	for (int quarter = 1; quarter <= 4 && !report.empty(); quarter++)
+		text << (quarter > 1 ? "/" : " ") << 100.f*report[(report.size()*quarter) / 4 - (quarter == 4 ? 1 : 0)].coverage;
+	text << "% at every quarter, " << stats.spentMS << "ms spent (" << everyFrameMS << "ms integrating every frame)";
+	details = text.str();
+
+	return report.size() == poses.size() && stats.nbrFull + stats.nbrReduced + stats.nbrSkipped == stats.nbrFrames && stats.spentMS <= maxSpentMS;
+}
+
+void addReplayBenchmarks(BenchmarkSuite& suite, const std::shared_ptr<Session>& session, size_t nbrThreads, float upsamplingFraction, const std::string& folder) {
+	if (!session || !session->size())
+		return;
+
+	std::string name = "replay." + session->getName();
+
+	std::shared_ptr<depth::DepthMap> dm(new depth::DepthMap());
+	suite.add(name + ".sequential", [session, dm]() {
+		session->useDepthMapping();
+
+		return BenchmarkSuite::measure([&]() {
+			em::EnvironmentMap em;
+			replaySequential(*session, *dm, em);
+		});
+	}, (double)session->size(), ReplayTolerance);
+
+	std::shared_ptr<std::vector<std::shared_ptr<depth::DepthMap>>> dms(new std::vector<std::shared_ptr<depth::DepthMap>>(createDepthMaps(nbrThreads)));
+	suite.add(name + ".frameParallel", [session, dms]() {
+		session->useDepthMapping();
+
+		return BenchmarkSuite::measure([&]() {
+			em::EnvironmentMap em;
+			replayFrameParallel(*session, *dms, em);
+		});
+	}, (double)session->size(), ReplayTolerance);
+
+	// Sequential replay discarding the points whose EM neighborhood isn't uniform, the check is disabled by default. It
+	// integrates fewer points than the sequential replay, the cost of the queries alone is timed by the uniformity cases
+	suite.add(name + ".uniformityCheck", [session, dm]() {
+		session->useDepthMapping();
+		em::EnvironmentMap::setUniformityCheckEnabled(true);
+
+		double time = BenchmarkSuite::measure([&]() {
+			em::EnvironmentMap em;
+			replaySequential(*session, *dm, em);
+		});
+
+		em::EnvironmentMap::setUniformityCheckEnabled(false);
+
+		return time;
+	}, (double)session->size(), ReplayTolerance);
+
+	// Uniformity queries of two turns of the session, with the cached mask or evaluating the neighborhood of every query
+	std::shared_ptr<UniformityTrace> trace(new UniformityTrace());
+	suite.addCheck(name + ".uniformity.equivalence", [session, trace](std::string& details) {
+		trace->record(*session);
+		return checkUniformityMask(*trace, details);
+	});
+
+	suite.add(name + ".uniformity.cached", [session, trace]() {
+		trace->record(*session);
+
+		std::vector<glm::vec3> color;
+		em::UniformityMask mask(1, UniformityMaxVariance);
+		return BenchmarkSuite::measure([&]() {
+			UniformSink = replayUniformity(*trace, &mask, color, NULL);
+		});
+	}, (double)UniformityPasses*session->size());
+
+	suite.add(name + ".uniformity.direct", [session, trace]() {
+		trace->record(*session);
+
+		std::vector<glm::vec3> color;
+		return BenchmarkSuite::measure([&]() {
+			UniformSink = replayUniformity(*trace, NULL, color, NULL);
+		});
+	}, (double)UniformityPasses*session->size());
+
+	// Sequential replay with the depth maps upsampled before being added to the EM, disabled by default
+	suite.add(name + ".upsampled", [session, dm, upsamplingFraction]() {
+		session->useDepthMapping();
+		depth::DepthMap::setUpsamplingColorFraction(upsamplingFraction);
+
+		double time = BenchmarkSuite::measure([&]() {
+			em::EnvironmentMap em;
+			replaySequential(*session, *dm, em);
+		});
+
+		depth::DepthMap::setUpsamplingColorFraction(0.f);
+
+		return time;
+	}, (double)session->size(), ReplayTolerance);
+
+	suite.addCheck(name + ".upsampling", [session, upsamplingFraction](std::string& details) {
+		return checkUpsampling(session, upsamplingFraction, details);
+	});
+
+	// The frame-parallel replays must integrate the same EM as the sequential ones
+	suite.addCheck(name + ".consistency", [session, nbrThreads](std::string& details) {
+		return checkReplays(session, nbrThreads, details);
+	});
+
+	// The poses of the frames recorded by the app are read from their headers, as done offline
+	std::shared_ptr<std::vector<em::RecordedPose>> poses(new std::vector<em::RecordedPose>());
+	glm::vec2 f, c;
+	glm::uvec2 size;
+	if (folder.empty() || !em::IntegrationController::readRecordedPoses(folder, *poses, f, c, size))
+		getSessionPoses(*session, *poses, f, c, size);
+
+	suite.addCheck(name + ".integrationReport", [poses, f, c, size](std::string& details) {
+		return checkIntegration(*poses, f, c, size, details);
+	});
+
+	suite.add(name + ".integrationController", [poses, f, c, size]() {
+		return BenchmarkSuite::measure([&]() {
+			em::IntegrationController controller;
+			controller.setCamera(f, c, size);
+			controller.replay(*poses);
+		});
+	}, (double)poses->size());
+}
+
@@ -0,0 +1,396 @@
+#include "Cases.h"
+
+#include <vsense/sh/BandLimit.h>
+#include <vsense/sh/SphericalHarmonics.h>
+#include <vsense/sh/TemporalFilter.h>
+#include <vsense/sh/TransferEvaluator.h>
+#include <vsense/sh/TransferPacker.h>
+#include <vsense/synth/Scene.h>
+#include <vsense/synth/SessionGenerator.h>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <sstream>
+
+using namespace vsense;
+
+const size_t NbrTransferVertices = 256;
+const size_t NbrTransferDirections = 2048; // Directions integrated per vertex
+const int EnvironmentGridWidth = 128;
+const float OrderErrorBudget = 0.05f;      // Relative error of the order selected in the report
+const int TransferOrder = 4;               // Default order of the SH renderers
+const size_t EvaluatorVertices[] = { 1000, 10000, 100000 };
+const size_t EvaluatorCheckVertices = 10001; // Not a multiple of the SIMD width
+const size_t NbrFilterFrames = 600;          // 20s at 30 fps, the lighting switches halfway
+const int FilterCoeffs = 100;                // Order 9
+const float FilterNoise = 0.0005f;           // Deviation of the coefficients calculated every frame
+
+/*
+ * Transfer coefficients of a mesh and the ambient coefficients lighting it, as loaded by the SH renderers.
+ */
+struct TransferMesh {
+	std::vector<float>  transfer;     /*!< Transfer coefficients of every vertex. */
+	size_t              nbrVertices;  /*!< Number of vertices. */
+	int                 vertexCoeffs; /*!< Number of transfer coefficients per vertex. */
+	sh::SHCoefficients3 ambient;      /*!< Ambient coefficients. */
+};
+
+/*
+ * Calculates the transfer coefficients of vertices with random normals, each one occluded by a random cone, by
+ * integrating the clamped cosine over a fixed set of directions, and takes the ambient coefficients from the radiance
+ * reaching the device in the synthetic room.
+ * @param order SH order of the coefficients.
+ * @return Transfer and ambient coefficients.
+ */
+std::shared_ptr<TransferMesh> createTransferMesh(int order) {
+	std::mt19937 rng(1);
+	std::uniform_real_distribution<float> uniform(0.f, 1.f);
+
+	std::shared_ptr<TransferMesh> mesh(new TransferMesh());
+	mesh->nbrVertices = NbrTransferVertices;
+	mesh->vertexCoeffs = sh::BandLimit::getNbrCoefficients(order);
+	mesh->transfer.assign(mesh->nbrVertices*mesh->vertexCoeffs, 0.f);
+
+	std::vector<glm::vec3> dirs(NbrTransferDirections);
+	std::vector<float> basis(NbrTransferDirections*mesh->vertexCoeffs);
+	for (size_t d = 0; d < NbrTransferDirections; d++) {
+		float theta = acos(1.f - 2.f*uniform(rng));
+		float phi = 6.2831853f*uniform(rng);
+		dirs[d] = sh::SphericalHarmonics::toVector(phi, theta);
+
+		// Projecting a single unit sample gives the basis functions of its direction times 4PI
+		std::vector<sh::SphericalSample1> sample(1, sh::SphericalSample1(glm::vec2(theta, phi), 1.f));
+		std::shared_ptr<sh::SHCoefficients1> coeffs = sh::SphericalHarmonics::projectSamples(order, sample);
+		std::copy(coeffs->begin(), coeffs->end(), basis.begin() + d*mesh->vertexCoeffs);
+	}
+
+	float weight = 1.f / NbrTransferDirections;
+	for (size_t v = 0; v < mesh->nbrVertices; v++) {
+		glm::vec3 normal = dirs[(size_t)(uniform(rng)*(NbrTransferDirections - 1))];
+		glm::vec3 occluder = dirs[(size_t)(uniform(rng)*(NbrTransferDirections - 1))];
+		float cosOccluder = 0.5f + 0.5f*uniform(rng);
+
+		float* transfer = mesh->transfer.data() + v*mesh->vertexCoeffs;
+		for (size_t d = 0; d < NbrTransferDirections; d++) {
+			float cosine = glm::dot(normal, dirs[d]);
+			if ((cosine <= 0.f) || (glm::dot(occluder, dirs[d]) > cosOccluder))
+				continue;
+
+			const float* curBasis = basis.data() + d*mesh->vertexCoeffs;
+			for (int i = 0; i < mesh->vertexCoeffs; i++)
+				transfer[i] += weight*cosine*curBasis[i];
+		}
+	}
+
+	synth::SessionGenerator generator(synth::Scene::createRoom(), Session::getSyntheticConfig(1));
+	mesh->ambient = *generator.groundTruthSH(0, order);
+
+	return mesh;
+}
+
+/*
+ * Formats the error of every order.
+ * @param errors Error of every order.
+ * @return Relative error of every order as text.
+ */
+std::string formatOrderErrors(const std::vector<sh::OrderError>& errors) {
+	std::stringstream text;
+	for (size_t i = 0; i < errors.size(); i++) {
+		char buffer[32];
+		sprintf(buffer, "%s%d: %.2e", i ? ", " : "", errors[i].order, errors[i].relativeError);
+		text << buffer;
+	}
+
+	return text.str();
+}
+
+/*
+ * Reports the error of the diffuse lighting of a mesh and of the ambient environment for every order with respect to
+ * the highest one, and the orders selected within the error budget. The errors can't increase with the order, as the
+ * bands are orthogonal, and the selected order must be within the budget.
+ * @param details Relative error of every order and orders selected.
+ * @return True if the errors decrease with the order and the selected orders are within the budget.
+ */
+bool checkBandLimit(std::string& details) {
+	std::shared_ptr<TransferMesh> mesh = createTransferMesh(sh::MaxSHOrder);
+
+	std::vector<sh::OrderError> diffuseErrors, environmentErrors;
+	sh::BandLimit::computeDiffuseErrors(mesh->transfer.data(), mesh->nbrVertices, mesh->vertexCoeffs, mesh->ambient.data(), (int)mesh->ambient.size(),
+		diffuseErrors);
+	sh::BandLimit::computeEnvironmentErrors(mesh->ambient, EnvironmentGridWidth, environmentErrors);
+
+	int diffuseOrder = sh::BandLimit::selectOrder(diffuseErrors, OrderErrorBudget);
+	int environmentOrder = sh::BandLimit::selectOrder(environmentErrors, OrderErrorBudget);
+
+	bool isValid = !diffuseErrors.empty() && !environmentErrors.empty() && (diffuseErrors.back().order == sh::MaxSHOrder) &&
+		(diffuseErrors.back().relativeError == 0.f) && (environmentErrors.back().relativeError == 0.f);
+	for (size_t i = 1; isValid && (i < environmentErrors.size()); i++)
+		isValid = environmentErrors[i].relativeError <= environmentErrors[i - 1].relativeError*(1.f + 1e-3f);
+	isValid = isValid && (diffuseErrors[diffuseOrder - sh::MinSHOrder].relativeError <= OrderErrorBudget) &&
+		(environmentErrors[environmentOrder - sh::MinSHOrder].relativeError <= OrderErrorBudget);
+
+	std::stringstream text;
+	text << "diffuse {" << formatOrderErrors(diffuseErrors) << "} order " << diffuseOrder << ", environment {" << formatOrderErrors(environmentErrors)
+		<< "} order " << environmentOrder << " within " << OrderErrorBudget;
+	details = text.str();
+
+	return isValid;
+}
+
+/*
+ * Packs the transfer coefficients of a mesh with every quantization and checks the error of every coefficient is
+ * within half a quantization step of the scale of its vertex (rounded up to half precision), and that the texture
+ * shrinks with the number of bits.
+ * @param details Size relative to single precision and relative lighting error of every quantization.
+ * @return True if the coefficients are within the rounding bound and the textures are smaller.
+ */
+bool checkTransferPacker(std::string& details) {
+	std::shared_ptr<TransferMesh> mesh = createTransferMesh(TransferOrder);
+
+	float maxCoeff = 0.f;
+	for (size_t i = 0; i < mesh->transfer.size(); i++)
+		maxCoeff = std::max(maxCoeff, std::abs(mesh->transfer[i]));
+
+	const sh::TransferQuantization quantizations[] = { sh::TransferFloat, sh::Transfer16Bit, sh::Transfer8Bit };
+
+	std::stringstream text;
+	bool isValid = true;
+	size_t prevSize = 0;
+	for (int q = 0; q < 3; q++) {
+		sh::TransferPacker packer(quantizations[q], mesh->vertexCoeffs);
+		sh::TransferPackingStats stats = packer.measure(mesh->transfer.data(), mesh->nbrVertices, mesh->ambient.data());
+
+		float bound = 0.f;
+		if (quantizations[q] != sh::TransferFloat) {
+			float maxLevel = (float)((1 << ((int)quantizations[q] - 1)) - 1);
+			bound = maxCoeff*(1.f + 1.f / 1024.f)*0.5f / maxLevel + FLT_EPSILON*maxCoeff;
+		}
+
+		isValid = isValid && (stats.maxCoeffError <= bound) && (!q || (stats.sizeBytes < prevSize));
+		prevSize = stats.sizeBytes;
+
+		char buffer[128];
+		sprintf(buffer, "%s%s: %.2f of float, error %.1e", q ? ", " : "", q ? (q == 1 ? "16-bit" : "8-bit") : "float",
+			(double)stats.sizeBytes / stats.floatSizeBytes, stats.relativeLightingError);
+		text << buffer;
+		if (stats.maxCoeffError > bound)
+			text << " (coefficient error " << stats.maxCoeffError << " above " << bound << ")";
+	}
+	details = text.str();
+
+	return isValid;
+}
+
+/*
+ * Creates random transfer and environment coefficients of order TransferOrder.
+ * @param nbrVertices Number of vertices.
+ * @param transfer Transfer coefficients of every vertex.
+ * @param env Environment coefficients.
+ */
+void createEvaluatorCoefficients(size_t nbrVertices, std::vector<float>& transfer, std::vector<glm::vec4>& env) {
+	std::mt19937 rng(1);
+	std::uniform_real_distribution<float> uniform(-1.f, 1.f);
+
+	int nbrCoeffs = sh::BandLimit::getNbrCoefficients(TransferOrder);
+	transfer.resize(nbrVertices*nbrCoeffs);
+	for (size_t i = 0; i < transfer.size(); i++)
+		transfer[i] = uniform(rng);
+
+	env.resize(nbrCoeffs);
+	for (int i = 0; i < nbrCoeffs; i++)
+		env[i] = glm::vec4(uniform(rng), uniform(rng), uniform(rng), 1.f);
+}
+
+/*
+ * Evaluates the lighting of random coefficients with the transfer evaluator, on one thread and on every thread, and
+ * compares it with the scalar dot product of every vertex, within the rounding of the different summation order.
+ * @param details Largest difference found.
+ * @return True if every vertex is within the rounding bound.
+ */
+bool checkTransferEvaluator(std::string& details) {
+	std::vector<float> transfer;
+	std::vector<glm::vec4> env;
+	createEvaluatorCoefficients(EvaluatorCheckVertices, transfer, env);
+
+	int nbrCoeffs = (int)env.size();
+	sh::TransferEvaluator evaluator;
+	evaluator.setTransfer(transfer.data(), EvaluatorCheckVertices, nbrCoeffs);
+	evaluator.setEnvironment(env.data(), nbrCoeffs);
+
+	size_t nbrOutside = 0;
+	float maxDiff = 0.f;
+	const size_t nbrThreads[] = { 1, 0 }; // One thread and every thread
+	for (int t = 0; t < 2; t++) {
+		evaluator.evaluate(nbrThreads[t]);
+		const std::vector<glm::vec3>& lighting = evaluator.getLighting();
+		if (lighting.size() != EvaluatorCheckVertices) {
+			details = "the lighting of every vertex isn't evaluated";
+			return false;
+		}
+
+		for (size_t v = 0; v < EvaluatorCheckVertices; v++) {
+			const float* curTransfer = transfer.data() + v*nbrCoeffs;
+			glm::vec3 expected = sh::TransferEvaluator::dot(curTransfer, env.data(), nbrCoeffs);
+
+			glm::vec3 sumAbs(0.f);
+			for (int i = 0; i < nbrCoeffs; i++)
+				sumAbs += std::abs(curTransfer[i])*glm::abs(glm::vec3(env[i]));
+
+			glm::vec3 diff = glm::abs(lighting[v] - expected);
+			glm::vec3 bound = 2.f*nbrCoeffs*FLT_EPSILON*sumAbs;
+			if ((diff.x > bound.x) || (diff.y > bound.y) || (diff.z > bound.z))
+				nbrOutside++;
+			maxDiff = std::max(maxDiff, std::max(diff.x, std::max(diff.y, diff.z)));
+		}
+	}
+
+	char buffer[128];
+	sprintf(buffer, "%u of %u vertices outside the rounding bound, largest difference %.1e", (unsigned int)nbrOutside,
+		(unsigned int)(2 * EvaluatorCheckVertices), maxDiff);
+	details = buffer;
+
+	return !nbrOutside;
+}
+
+/*
+ * Creates a sequence of SH coefficient sets calculated every frame: noise around a set of coefficients, replaced by
+ * another set halfway to emulate a lighting switch.
+ * @return Coefficient sets, one after the other.
+ */
+std::shared_ptr<std::vector<glm::vec4>> createFilterSequence() {
+	std::mt19937 rng(1);
+	std::uniform_real_distribution<float> uniform(-1.f, 1.f);
+	std::normal_distribution<float> noise(0.f, FilterNoise);
+
+	std::vector<glm::vec4> before(FilterCoeffs), after(FilterCoeffs);
+	for (int i = 0; i < FilterCoeffs; i++) {
+		float decay = 1.f / (1.f + (float)std::sqrt((float)i)); // Lower energy in the higher bands
+		before[i] = glm::vec4(uniform(rng), uniform(rng), uniform(rng), 0.f)*decay;
+		after[i] = glm::vec4(uniform(rng), uniform(rng), uniform(rng), 0.f)*decay;
+	}
+
+	std::shared_ptr<std::vector<glm::vec4>> sequence(new std::vector<glm::vec4>(NbrFilterFrames*FilterCoeffs));
+	for (size_t f = 0; f < NbrFilterFrames; f++) {
+		const std::vector<glm::vec4>& base = (f < NbrFilterFrames / 2) ? before : after;
+		for (int i = 0; i < FilterCoeffs; i++)
+			(*sequence)[f*FilterCoeffs + i] = base[i] + glm::vec4(noise(rng), noise(rng), noise(rng), 0.f);
+	}
+
+	return sequence;
+}
+
+/*
+ * Filters the sequence with the exponential and the One Euro filters and checks that most sets are skipped, that the
+ * lighting of a random vertex with the published set stays within |T|*threshold of its lighting with the filtered set
+ * whenever a set is skipped, that the filter wakes up at the lighting switch, and that a reset clears the counters and
+ * publishes the next set as calculated.
+ * @param details Skipped fraction, largest lighting error and re-projections of every filter.
+ * @return True if both filters skip sets within the error bound and follow the switch.
+ */
+bool checkTemporalFilter(std::string& details) {
+	std::shared_ptr<std::vector<glm::vec4>> sequence = createFilterSequence();
+
+	std::mt19937 rng(2);
+	std::uniform_real_distribution<float> uniform(-1.f, 1.f);
+	std::vector<float> transfer(FilterCoeffs);
+	float transferNorm = 0.f;
+	for (int i = 0; i < FilterCoeffs; i++) {
+		transfer[i] = uniform(rng);
+		transferNorm += transfer[i] * transfer[i];
+	}
+	transferNorm = std::sqrt(transferNorm);
+
+	const sh::TemporalFilterMode modes[] = { sh::FilterExponential, sh::FilterOneEuro };
+
+	std::stringstream text;
+	bool isValid = true;
+	for (int m = 0; m < 2; m++) {
+		sh::TemporalFilterParams params;
+		params.mode = modes[m];
+		sh::TemporalFilter filter(params, FilterCoeffs);
+
+		float maxError = 0.f;
+		bool isWokenUp = false;
+		for (size_t f = 0; f < NbrFilterFrames; f++) {
+			bool wasStatic = filter.isStatic();
+			filter.needsReprojection();
+			bool isPublished = filter.update(sequence->data() + f*FilterCoeffs, f / 30.0);
+			if ((f >= NbrFilterFrames / 2) && wasStatic && !filter.isStatic())
+				isWokenUp = true;
+			if (isPublished)
+				continue;
+
+			// Lighting error of the skipped set, bounded by |T|*change
+			glm::vec3 error(0.f);
+			for (int i = 0; i < FilterCoeffs; i++)
+				error += transfer[i] * glm::vec3(filter.getPublished()[i] - filter.getFiltered()[i]);
+			maxError = std::max(maxError, glm::length(error) / transferNorm);
+		}
+
+		sh::TemporalFilterStats stats = filter.getStats();
+		float skipped = filter.getSkippedFraction();
+		isValid = isValid && isWokenUp && (skipped > 0.5f) && (maxError <= params.changeThreshold) && (stats.maxSkippedChange < params.changeThreshold) &&
+			(stats.nbrReprojections < stats.nbrFrames);
+
+		// Reset, the counters are cleared and the next set is published as calculated
+		filter.reset();
+		bool isReset = (filter.getStats().nbrUpdates == 0) && !filter.isStatic() && filter.update(sequence->data(), 0.0) &&
+			(filter.getPublished()[0] == (*sequence)[0]) && (filter.getStats().nbrPublished == 1);
+		isValid = isValid && isReset;
+
+		char buffer[192];
+		sprintf(buffer, "%s%s: %.0f%% skipped, lighting error %.4f/|T| (threshold %.2f), %u/%u re-projections%s%s", m ? ", " : "",
+			m ? "One Euro" : "exponential", 100.f*skipped, maxError, params.changeThreshold, (unsigned int)stats.nbrReprojections,
+			(unsigned int)stats.nbrFrames, isWokenUp ? "" : ", no wake up", isReset ? "" : ", not reset");
+		text << buffer;
+	}
+	details = text.str();
+
+	return isValid;
+}
+
+void addSHBenchmarks(BenchmarkSuite& suite) {
+	suite.addCheck("sh.bandLimit.errors", checkBandLimit);
+	suite.addCheck("sh.transferPacker.quantization", checkTransferPacker);
+	suite.addCheck("sh.transferEvaluator", checkTransferEvaluator);
+	suite.addCheck("sh.temporalFilter", checkTemporalFilter);
+
+	std::shared_ptr<std::vector<glm::vec4>> sequence = createFilterSequence();
+	suite.add("sh.temporalFilter.update", [sequence]() {
+		sh::TemporalFilter filter(sh::TemporalFilterParams(), FilterCoeffs);
+
+		return BenchmarkSuite::measure([&]() {
+			filter.reset();
+			for (size_t f = 0; f < NbrFilterFrames; f++)
+				filter.update(sequence->data() + f*FilterCoeffs, f / 30.0);
+		});
+	}, (double)NbrFilterFrames);
+
+	// Lighting of the vertices on the CPU, on one thread and on every thread
+	for (size_t n = 0; n < sizeof(EvaluatorVertices) / sizeof(EvaluatorVertices[0]); n++) {
+		size_t nbrVertices = EvaluatorVertices[n];
+
+		std::shared_ptr<std::vector<float>> transfer(new std::vector<float>());
+		std::shared_ptr<std::vector<glm::vec4>> env(new std::vector<glm::vec4>());
+		createEvaluatorCoefficients(nbrVertices, *transfer, *env);
+
+		for (int threaded = 0; threaded < 2; threaded++) {
+			char name[64];
+			sprintf(name, "sh.transferEvaluator.%u%s", (unsigned int)nbrVertices, threaded ? ".threads" : "");
+
+			size_t nbrThreads = threaded ? 0 : 1;
+			suite.add(name, [transfer, env, nbrVertices, nbrThreads]() {
+				sh::TransferEvaluator evaluator;
+				evaluator.setTransfer(transfer->data(), nbrVertices, (int)env->size());
+				evaluator.setEnvironment(env->data(), (int)env->size());
+
+				return BenchmarkSuite::measure([&]() {
+					evaluator.evaluate(nbrThreads);
+				});
+			}, (double)nbrVertices);
+		}
+	}
+}
@@ -0,0 +1,154 @@
+#include "Session.h"
+
+#include <vsense/common/Parallel.h>
+#include <vsense/depth/DepthMap.h>
+#include <vsense/io/Image.h>
+#include <vsense/synth/Scene.h>
+#include <vsense/synth/SessionContainer.h>
+#include <vsense/synth/SessionGenerator.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+
+using namespace vsense;
+
+const uint32_t SyntheticImageWidth = 960;   // Half the resolution of the color camera, the depth maps only sample it
+const uint32_t SyntheticImageHeight = 540;
+const double   SyntheticImageFocal = 740.0;
+
+std::shared_ptr<Session> Session::createSynthetic(size_t nbrFrames, uint32_t seed) {
+	char buffer[64];
+	sprintf(buffer, "synthetic%u", (unsigned int)nbrFrames);
+
+	std::shared_ptr<Session> session(new Session(buffer));
+	session->frames_.resize(nbrFrames);
+
+	synth::SessionConfig config = getSyntheticConfig(nbrFrames, seed);
+	synth::SessionGenerator generator(synth::Scene::createRoom(), config);
+
+	glm::dvec2 depthC(0.5*(config.depthWidth_ - 1), 0.5*(config.depthHeight_ - 1));
+	session->ptMap_ = createDepthMapping(config.depthF_, depthC, NULL);
+
+	// Every frame is generated on its own so the frames are generated in parallel
+	common::parallelFor(nbrFrames, [&](size_t idx) {
+		generator.generate(idx, session->frames_[idx]);
+	});
+
+	return session;
+}
+
+synth::SessionConfig Session::getSyntheticConfig(size_t nbrFrames, uint32_t seed) {
+	// The session makes a single turn of the room
+	synth::SessionConfig config;
+	config.depthWidth_ = (uint32_t)depth::DepthMap::width();
+	config.depthHeight_ = (uint32_t)depth::DepthMap::height();
+	config.imageWidth_ = SyntheticImageWidth;
+	config.imageHeight_ = SyntheticImageHeight;
+	config.imageF_ = glm::dvec2(SyntheticImageFocal, SyntheticImageFocal);
+	config.framesPerTurn_ = std::max(nbrFrames, (size_t)1);
+	config.seed_ = seed;
+
+	return config;
+}
+
+std::shared_ptr<Session> Session::readRecorded(const std::string& folder, size_t maxFrames, float confidence) {
+	std::shared_ptr<Session> session(new Session("recorded:" + folder));
+
+	for (size_t idx = 0; !maxFrames || idx < maxFrames; idx++) {
+		char buffer[32];
+		sprintf(buffer, "%u", (unsigned int)idx);
+
+		std::string filenamePC = folder + "/PointCloud" + buffer + ".pc";
+		std::string filenameIM = folder + "/PointCloud" + buffer + ".im";
+		if (!std::ifstream(filenamePC).good() || !std::ifstream(filenameIM).good())
+			break;
+
+		SessionFrame frame;
+		if (!io::PointCloudReader::read(filenamePC, frame.pc, frame.pcData, confidence) ||
+			!io::ImageReader::read(filenameIM, frame.img, frame.imData))
+			break;
+
+		session->frames_.push_back(frame);
+	}
+
+	if (session->frames_.empty()) {
+		std::cout << "No frames found in " << folder << std::endl;
+		return std::shared_ptr<Session>();
+	}
+
+	if (!session->setDepthMapping(folder))
+		return std::shared_ptr<Session>();
+
+	return session;
+}
+
+std::shared_ptr<Session> Session::readContainer(const std::string& filename, size_t maxFrames, float confidence) {
+	synth::SessionContainerReader reader;
+	if (!reader.open(filename))
+		return std::shared_ptr<Session>();
+
+	std::shared_ptr<Session> session(new Session("container:" + filename));
+
+	size_t nbrFrames = maxFrames ? std::min(maxFrames, reader.size()) : reader.size();
+	session->frames_.resize(nbrFrames);
+	for (size_t idx = 0; idx < nbrFrames; idx++) {
+		if (!reader.read(idx, session->frames_[idx], NULL, confidence)) {
+			std::cout << filename << " is truncated at frame " << idx << std::endl;
+			session->frames_.resize(idx);
+			break;
+		}
+	}
+
+	if (session->frames_.empty()) {
+		std::cout << "No frames found in " << filename << std::endl;
+		return std::shared_ptr<Session>();
+	}
+
+	if (!session->setDepthMapping(filename))
+		return std::shared_ptr<Session>();
+
+	return session;
+}
+
+bool Session::setDepthMapping(const std::string& source) {
+	const io::PointCloudMetadata& pcData = frames_[0].pcData;
+	if (pcData.width_ != depth::DepthMap::width() || pcData.height_ != depth::DepthMap::height()) {
+		std::cout << "The depth maps of " << source << " are " << pcData.width_ << "x" << pcData.height_ << ", "
+			<< depth::DepthMap::width() << "x" << depth::DepthMap::height() << " expected" << std::endl;
+		return false;
+	}
+
+	ptMap_ = createDepthMapping(pcData.f_, pcData.c_, pcData.distortion_);
+
+	return true;
+}
+
+void Session::useDepthMapping() const {
+	depth::DepthMap::setDepthMapping(ptMap_);
+}
+
+std::shared_ptr<glm::vec2> Session::createDepthMapping(const glm::dvec2& f, const glm::dvec2& c, const double* distortion) {
+	size_t width = depth::DepthMap::width();
+	size_t height = depth::DepthMap::height();
+
+	std::shared_ptr<glm::vec2> ptMap(new glm::vec2[width*height], std::default_delete<glm::vec2[]>());
+
+	// The depth map is flipped in both axes with respect to the sensor (see DepthMap::fillWithData)
+	glm::vec2* curPt = ptMap.get();
+	for (size_t row = 0; row < height; row++) {
+		for (size_t col = 0; col < width; col++, curPt++) {
+			glm::vec2 distorted((float)((width - 1 - col - c.x) / f.x), (float)((height - 1 - row - c.y) / f.y));
+
+			// Inverts the distortion model of io::Image iteratively
+			glm::vec2 pt = distorted;
+			for (int it = 0; distortion && it < 10; it++)
+				pt += distorted - io::Image::undistort(pt, distortion);
+
+			*curPt = pt;
+		}
+	}
+
+	return ptMap;
+}
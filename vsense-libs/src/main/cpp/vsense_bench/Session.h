@@ -0,0 +1,106 @@
+#pragma once
+
+#include <vsense/synth/SessionGenerator.h>
+
+#include <glm/glm.hpp>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+/*
+ * An RGB-D frame kept in memory, so the replays don't include reading the files.
+ */
+typedef vsense::synth::Frame SessionFrame;
+
+/*
+ * The Session class holds the frames of a recorded or synthetic RGB-D session for the replays.
+ */
+class Session {
+public:
+	/*
+	 * Creates a session making a turn of the reference room of the generator (see synth::Scene::createRoom), the color
+	 * images are half the resolution of the camera.
+	 * @param nbrFrames Number of frames.
+	 * @param seed Seed of the depth noise and holes.
+	 * @return Session.
+	 */
+	static std::shared_ptr<Session> createSynthetic(size_t nbrFrames, uint32_t seed = 1);
+
+	/*
+	 * Retrieves the configuration of the generator used by createSynthetic.
+	 * @param nbrFrames Number of frames, making a single turn of the room.
+	 * @param seed Seed of the depth noise and holes.
+	 * @return Configuration.
+	 */
+	static vsense::synth::SessionConfig getSyntheticConfig(size_t nbrFrames, uint32_t seed = 1);
+
+	/*
+	 * Reads the frames saved by the app (PointCloud<i>.pc and PointCloud<i>.im).
+	 * @param folder Folder holding the frames.
+	 * @param maxFrames Maximum number of frames to read, 0 to read all.
+	 * @param confidence Minimum confidence of the points kept.
+	 * @return Session, NULL if no frame was found.
+	 */
+	static std::shared_ptr<Session> readRecorded(const std::string& folder, size_t maxFrames = 0, float confidence = 0.7f);
+
+	/*
+	 * Reads the frames of a session container (see synth::SessionContainerWriter).
+	 * @param filename Filename of the container.
+	 * @param maxFrames Maximum number of frames to read, 0 to read all.
+	 * @param confidence Minimum confidence of the points kept.
+	 * @return Session, NULL if no frame was found.
+	 */
+	static std::shared_ptr<Session> readContainer(const std::string& filename, size_t maxFrames = 0, float confidence = 0.7f);
+
+	/*
+	 * Makes the depth maps use the pixel mapping of the session's depth sensor.
+	 */
+	void useDepthMapping() const;
+
+	/*
+	 * Retrieves the name of the session.
+	 * @return Name.
+	 */
+	const std::string& getName() const { return name_; }
+
+	/*
+	 * Retrieves the number of frames.
+	 * @return Number of frames.
+	 */
+	size_t size() const { return frames_.size(); }
+
+	/*
+	 * Retrieves a frame.
+	 * @param idx Index of the frame.
+	 * @return Frame.
+	 */
+	const SessionFrame& at(size_t idx) const { return frames_[idx]; }
+
+private:
+	/*
+	 * Session constructor.
+	 * @param name Name of the session.
+	 */
+	Session(const std::string& name) : name_(name) {}
+
+	/*
+	 * Sets the pixel mapping from the depth sensor of the first frame.
+	 * @param source Origin of the frames, for the messages.
+	 * @return True if the depth frames match the depth maps.
+	 */
+	bool setDepthMapping(const std::string& source);
+
+	/*
+	 * Creates the mapping from the pixels of the depth map to X/Z, Y/Z coordinates.
+	 * @param f Focal length in pixels.
+	 * @param c Optical center in pixels.
+	 * @param distortion Distortion coefficients (see io::Image::undistort), NULL if none.
+	 * @return Mapping of every pixel.
+	 */
+	static std::shared_ptr<glm::vec2> createDepthMapping(const glm::dvec2& f, const glm::dvec2& c, const double* distortion);
+
+	std::string                name_;   /*!< Name of the session. */
+	std::vector<SessionFrame>  frames_; /*!< Frames. */
+	std::shared_ptr<glm::vec2> ptMap_;  /*!< Mapping from the pixels of the depth map to X/Z, Y/Z coordinates. */
+};
@@ -0,0 +1,169 @@
+#include "Cases.h"
+
+#include <vsense/common/Parallel.h>
+#include <vsense/io/Image.h>
+#include <vsense/synth/Scene.h>
+#include <vsense/synth/SessionContainer.h>
+#include <vsense/synth/SessionGenerator.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+using namespace vsense;
+
+const size_t NbrCheckFrames = 4;
+const size_t MinCheckThreads = 4;  // The frames are also generated on several threads on single core machines
+const char*  CheckContainer = "vsense_bench_check.vsc";
+
+/*
+ * Checks two frames hold the same bytes.
+ * @param frameA First frame.
+ * @param frameB Second frame.
+ * @param isColorCompared True to compare the colors, false when they went through the lossy NV21 of the containers.
+ * @return True if the point clouds, the poses and the images are identical.
+ */
+bool isSameFrame(const synth::Frame& frameA, const synth::Frame& frameB, bool isColorCompared = true) {
+	const pc::PointCloud& pcA = frameA.pc;
+	const pc::PointCloud& pcB = frameB.pc;
+	if (pcA.size() != pcB.size() || frameA.pcData.timestamp_ != frameB.pcData.timestamp_ ||
+		memcmp(frameA.pcData.translation_, frameB.pcData.translation_, sizeof(frameA.pcData.translation_)) ||
+		memcmp(frameA.pcData.orientation_, frameB.pcData.orientation_, sizeof(frameA.pcData.orientation_)))
+		return false;
+
+	if (pcA.size() && memcmp(pcA.getPositionPtr(), pcB.getPositionPtr(), sizeof(glm::vec3)*pcA.size()))
+		return false;
+
+	if (!frameA.img || !frameB.img)
+		return !frameA.img && !frameB.img;
+
+	const io::Image& imgA = *frameA.img;
+	const io::Image& imgB = *frameB.img;
+	if (imgA.rows() != imgB.rows() || imgA.cols() != imgB.cols())
+		return false;
+
+	if (!isColorCompared)
+		return true;
+
+	for (size_t row = 0; row < imgA.rows(); row++) {
+		if (memcmp(imgA.row_const(row), imgB.row_const(row), imgA.cols()*imgA.NbrChannels))
+			return false;
+	}
+
+	return true;
+}
+
+/*
+ * Generates the frames of the synthetic session with one thread, with several threads per image and with several
+ * frames in parallel, and checks all of them hold the same bytes.
+ * @param details Frames compared.
+ * @return True if the frames are identical.
+ */
+bool checkGeneratorThreads(std::string& details) {
+	synth::SessionGenerator generator(synth::Scene::createRoom(), Session::getSyntheticConfig(NbrCheckFrames));
+	size_t nbrThreads = std::max(common::hardwareThreads(), MinCheckThreads);
+
+	std::vector<synth::Frame> single(NbrCheckFrames), multi(NbrCheckFrames), parallel(NbrCheckFrames);
+	for (size_t idx = 0; idx < NbrCheckFrames; idx++) {
+		generator.generate(idx, single[idx], 1);
+		generator.generate(idx, multi[idx], nbrThreads);
+	}
+
+	common::parallelFor(NbrCheckFrames, [&](size_t idx) {
+		generator.generate(idx, parallel[idx], 1);
+	}, nbrThreads);
+
+	size_t nbrEqual = 0;
+	for (size_t idx = 0; idx < NbrCheckFrames; idx++) {
+		if (isSameFrame(single[idx], multi[idx]) && isSameFrame(single[idx], parallel[idx]))
+			nbrEqual++;
+	}
+
+	std::stringstream text;
+	text << nbrEqual << "/" << NbrCheckFrames << " frames identical with 1 and " << nbrThreads << " threads";
+	details = text.str();
+
+	return nbrEqual == NbrCheckFrames;
+}
+
+/*
+ * Overwrites part of the header of a container.
+ * @param filename Filename of the container.
+ * @param offset Offset of the field in the header.
+ * @param value Value written.
+ * @return True if successful.
+ */
+template<typename T>
+bool patchHeader(const std::string& filename, size_t offset, T value) {
+	std::fstream file(filename, std::ios::in | std::ios::out | std::ios::binary);
+	file.seekp(offset);
+	file.write((const char*)&value, sizeof(T));
+
+	return file.good();
+}
+
+/*
+ * Writes a synthetic frame to a container, reads it back and checks containers whose header doesn't match the file are
+ * rejected when they are opened.
+ * @param details Step that failed.
+ * @return True if the frame is read back and the damaged containers are rejected.
+ */
+bool checkContainer(std::string& details) {
+	synth::SessionGenerator generator(synth::Scene::createRoom(), Session::getSyntheticConfig(NbrCheckFrames));
+
+	synth::Frame frame;
+	generator.generate(0, frame);
+
+	synth::SessionContainerWriter writer;
+	if (!writer.open(CheckContainer, 2) || !writer.append(frame, generator.groundTruthSH(0, 2, 1000).get()) || !writer.close()) {
+		details = "the container couldn't be written";
+		return false;
+	}
+
+	// The images are stored as NV21, only the depth and the poses are read back exactly
+	synth::SessionContainerReader reader;
+	synth::Frame frameRead;
+	bool isValid = reader.open(CheckContainer) && reader.size() == 1 && reader.read(0, frameRead, NULL, -1.f) &&
+		isSameFrame(frame, frameRead, false);
+	if (!isValid)
+		details = "the frame read differs from the one written";
+
+	// Number of frames, SH order and offset of the table, see the header of SessionContainer.cpp
+	const size_t FramesOffset = 8, OrderOffset = 12, TableOffset = 16;
+	if (isValid && (!patchHeader(CheckContainer, FramesOffset, (uint32_t)0xFFFFFFFF) || reader.open(CheckContainer))) {
+		details = "a container with too many frames was opened";
+		isValid = false;
+	}
+	if (isValid && (!patchHeader(CheckContainer, FramesOffset, (uint32_t)1) || !patchHeader(CheckContainer, OrderOffset, (int32_t)1000) ||
+		reader.open(CheckContainer))) {
+		details = "a container with an invalid SH order was opened";
+		isValid = false;
+	}
+	if (isValid && (!patchHeader(CheckContainer, OrderOffset, (int32_t)2) || !patchHeader(CheckContainer, TableOffset, (uint64_t)1 << 40) ||
+		reader.open(CheckContainer))) {
+		details = "a container with its table past the end was opened";
+		isValid = false;
+	}
+	if (isValid)
+		details = "frame read back, damaged headers rejected";
+
+	remove(CheckContainer);
+
+	return isValid;
+}
+
+void addSynthBenchmarks(BenchmarkSuite& suite) {
+	suite.addCheck("synth.generate.threads", checkGeneratorThreads);
+	suite.addCheck("synth.container", checkContainer);
+
+	std::shared_ptr<synth::SessionGenerator> generator(new synth::SessionGenerator(synth::Scene::createRoom(),
+		Session::getSyntheticConfig(NbrCheckFrames)));
+	std::shared_ptr<synth::Frame> frame(new synth::Frame());
+	suite.add("synth.generate", [generator, frame]() {
+		return BenchmarkSuite::measure([&]() {
+			generator->generate(1, *frame, 0);
+		});
+	}, 1.0);
+}
@@ -0,0 +1,16 @@
+# Writes the assembled reduction shaders with vsense_bench and validates them with glslangValidator.
+# Usage: cmake -DBENCH=<vsense_bench> -DVALIDATOR=<glslangValidator> -DFOLDER=<output folder> -P ValidateShaders.cmake
+FILE(MAKE_DIRECTORY ${FOLDER})
+
+EXECUTE_PROCESS(COMMAND ${BENCH} --shaders ${FOLDER} RESULT_VARIABLE RESULT)
+IF(NOT RESULT EQUAL 0)
+	MESSAGE(FATAL_ERROR "The shaders couldn't be assembled")
+ENDIF()
+
+FILE(GLOB SHADER_FILES ${FOLDER}/*.comp)
+FOREACH(SHADER_FILE ${SHADER_FILES})
+	EXECUTE_PROCESS(COMMAND ${VALIDATOR} ${SHADER_FILE} RESULT_VARIABLE RESULT)
+	IF(NOT RESULT EQUAL 0)
+		MESSAGE(FATAL_ERROR "${SHADER_FILE} isn't valid")
+	ENDIF()
+ENDFOREACH()
@@ -0,0 +1,171 @@
+#include "Benchmark.h"
+#include "Cases.h"
+#include "Session.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/*
+ * Prints the options of the benchmark.
+ */
+void printUsage() {
+	std::cout << "Usage: vsense_bench [options]" << std::endl
+		<< "  --filter <text>      Runs only the cases whose name contains the text" << std::endl
+		<< "  --runs <n>           Timed runs per case (15)" << std::endl
+		<< "  --warmup <n>         Untimed runs per case (2)" << std::endl
+		<< "  --frames <n>         Frames of the synthetic session (30)" << std::endl
+		<< "  --recorded <folder>  Also replays the frames recorded in a folder, can be repeated" << std::endl
+		<< "  --container <file>   Also replays the frames of a session container, can be repeated" << std::endl
+		<< "  --threads <n>        Threads of the frame-parallel replays, 0 for all (0)" << std::endl
+		<< "  --upsampling <f>     Fraction of the color image width the depth maps are upsampled to (0.5)" << std::endl
+		<< "  --out <file>         Writes the results as JSON" << std::endl
+		<< "  --label <text>       Label written with the results" << std::endl
+		<< "  --baseline <file>    Compares the results with a previous JSON file" << std::endl
+		<< "  --tolerance <f>      Relative slowdown allowed against the baseline (0.1)" << std::endl
+		<< "  --min-delta <ms>     Absolute slowdown ignored against the baseline (0.05)" << std::endl
+		<< "  --checks             Runs only the checks, without timing the cases" << std::endl
+		<< "  --list               Lists the checks and the cases without running them" << std::endl
+		<< "  --shaders <folder>   Writes the assembled reduction shaders to a folder and exits" << std::endl
+		<< "Exit code: 0 if successful, 1 if a case regressed or a check failed, 2 on error." << std::endl;
+}
+
+int main(int argc, char** argv) {
+	std::string filter, outFile, baselineFile, label, shaderFolder;
+	std::vector<std::string> recordedFolders, containerFiles;
+	size_t nbrRuns = 15, nbrWarmup = 2, nbrFrames = 30, nbrThreads = 0;
+	float tolerance = 0.1f, upsamplingFraction = 0.5f;
+	double minDeltaMS = 0.05;
+	bool isListOnly = false, isChecksOnly = false;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--list") {
+			isListOnly = true;
+			continue;
+		}
+		if (arg == "--checks") {
+			isChecksOnly = true;
+			continue;
+		}
+		if (arg == "--help" || arg == "-h") {
+			printUsage();
+			return 0;
+		}
+		if (i + 1 >= argc) {
+			std::cout << "Missing value of " << arg << std::endl;
+			printUsage();
+			return 2;
+		}
+
+		const char* value = argv[++i];
+		if (arg == "--filter")
+			filter = value;
+		else if (arg == "--runs")
+			nbrRuns = strtoul(value, NULL, 10);
+		else if (arg == "--warmup")
+			nbrWarmup = strtoul(value, NULL, 10);
+		else if (arg == "--frames")
+			nbrFrames = strtoul(value, NULL, 10);
+		else if (arg == "--recorded")
+			recordedFolders.push_back(value);
+		else if (arg == "--container")
+			containerFiles.push_back(value);
+		else if (arg == "--threads")
+			nbrThreads = strtoul(value, NULL, 10);
+		else if (arg == "--upsampling")
+			upsamplingFraction = (float)atof(value);
+		else if (arg == "--out")
+			outFile = value;
+		else if (arg == "--label")
+			label = value;
+		else if (arg == "--baseline")
+			baselineFile = value;
+		else if (arg == "--tolerance")
+			tolerance = (float)atof(value);
+		else if (arg == "--min-delta")
+			minDeltaMS = atof(value);
+		else if (arg == "--shaders")
+			shaderFolder = value;
+		else {
+			std::cout << "Unknown option " << arg << std::endl;
+			printUsage();
+			return 2;
+		}
+	}
+
+	if (!shaderFolder.empty())
+		return writeReductionShaders(shaderFolder) ? 0 : 2;
+
+	std::vector<std::shared_ptr<Session>> sessions;
+	sessions.push_back(Session::createSynthetic(nbrFrames));
+	for (size_t i = 0; i < recordedFolders.size(); i++) {
+		std::shared_ptr<Session> session = Session::readRecorded(recordedFolders[i]);
+		if (!session) {
+			std::cout << "No frames found in " << recordedFolders[i] << std::endl;
+			return 2;
+		}
+		sessions.push_back(session);
+	}
+	for (size_t i = 0; i < containerFiles.size(); i++) {
+		std::shared_ptr<Session> session = Session::readContainer(containerFiles[i]);
+		if (!session)
+			return 2;
+		sessions.push_back(session);
+	}
+
+	BenchmarkSuite suite(nbrRuns, nbrWarmup);
+	addMicroBenchmarks(suite, sessions[0], upsamplingFraction);
+	addIOBenchmarks(suite, sessions[0]);
+	addPCBenchmarks(suite, sessions[0]);
+	addEMBenchmarks(suite, sessions[0]);
+	addSHBenchmarks(suite);
+	addSynthBenchmarks(suite);
+	addGLBenchmarks(suite);
+	for (size_t i = 0; i < sessions.size(); i++)
+		addReplayBenchmarks(suite, sessions[i], nbrThreads, upsamplingFraction, (i > 0 && i <= recordedFolders.size()) ? recordedFolders[i - 1] + "/" : "");
+
+	if (isListOnly) {
+		std::vector<std::string> names = suite.getCheckNames();
+		for (size_t i = 0; i < names.size(); i++)
+			std::cout << names[i] << std::endl;
+		names = suite.getNames();
+		for (size_t i = 0; i < names.size(); i++)
+			std::cout << names[i] << std::endl;
+		return 0;
+	}
+
+	// The results are verified before any of the code is timed
+	size_t nbrChecks = 0;
+	size_t nbrFailed = suite.runChecks(filter, nbrChecks);
+	if (isChecksOnly) {
+		if (!nbrChecks) {
+			std::cout << "No check matches " << filter << std::endl;
+			return 2;
+		}
+		std::cout << nbrFailed << " of " << nbrChecks << " check(s) failed" << std::endl;
+		return nbrFailed ? 1 : 0;
+	}
+
+	if (!suite.run(filter)) {
+		std::cout << "No case matches " << filter << std::endl;
+		return 2;
+	}
+
+	if (!outFile.empty() && !suite.writeJSON(outFile, label))
+		return 2;
+
+	size_t nbrRegressions = 0;
+	if (!baselineFile.empty()) {
+		std::vector<BenchmarkResult> baseline;
+		if (!BenchmarkSuite::readJSON(baselineFile, baseline))
+			return 2;
+
+		nbrRegressions = suite.compare(baseline, tolerance, minDeltaMS);
+		std::cout << nbrRegressions << " regression(s) against " << baselineFile << std::endl;
+	}
+
+	return (nbrRegressions || nbrFailed) ? 1 : 0;
+}
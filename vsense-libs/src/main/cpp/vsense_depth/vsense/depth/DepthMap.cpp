@@ -1,11 +1,15 @@
 #include <vsense/depth/DepthMap.h>
+#include <vsense/depth/JointBilateralUpsampler.h>
 
 #include <vsense/io/ImageReader.h>
 #include <vsense/io/PointCloudReader.h>
 #include <vsense/io/Image.h>
+#include <vsense/io/RemapCache.h>
 
 #include <vsense/pc/PointCloud.h>
 
+#include <vsense/common/Parallel.h>
+
 #ifdef __ANDROID__
 #include <tango_client_api.h>
 #include <tango_support_api.h>
@@ -15,6 +19,16 @@
 
 #include <iostream>
 #include <fstream>
+#include <chrono>
+#include <cmath>
+
+#if defined(__aarch64__) && (defined(__ARM_NEON) || defined(__ARM_NEON__))
+#include <arm_neon.h>
+#define USE_NEON
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#include <emmintrin.h>
+#define USE_SSE
+#endif
 
 using namespace std;
 using namespace vsense;
@@ -27,6 +41,11 @@ size_t DepthMap::nbrPixels_ = DepthMap::width_*DepthMap::height_;
 bool DepthMap::fillHoles_ = true;
 bool DepthMap::fillWithMax_ = false;
 
+float DepthMap::upsamplingColorFraction_ = 0.f;
+
+ReliabilityMode DepthMap::reliabilityMode_ = ReliabilitySlidingWindow;
+size_t DepthMap::reliabilityWindow_ = 3;
+
 const float MaxExposure = 0.95f;
 const float MinExposure = 0.05f;
 
@@ -39,11 +58,16 @@ const std::string MaskFile = "D:/dev/vsense_AR/data/ptMap.bin";
 
 #elif __ANDROID__
 const std::string MaskFile = "/sdcard/TCD/map/ptMap.bin";
+#else
+const std::string MaskFile = "data/ptMap.bin";
 #endif
 
-const float LimitChiSquare = 14.07f;
+const float LimitChiSquare = 14.07f;    // 7 degrees of freedom (3x3 window), p = 0.05
+const float LimitChiSquare5x5 = 35.17f; // 23 degrees of freedom (5x5 window), p = 0.05
+
+const size_t ReliabilityBlock = 8; // Pixels evaluated at once by the sliding-window test
 
-DepthMap::DepthMap() {
+DepthMap::DepthMap() : upWidth_(0), upHeight_(0), lastUpsamplingTime_(0.f), lastReliabilityTime_(0.f), lastHoleFillingTime_(0.f) {
 	if (!ptMap_)
 		readDepthMappingFile();
 }
@@ -123,9 +147,14 @@ bool DepthMap::fillWithFrame(const TangoPointCloud* pointCloud, const TangoPoseD
 
 	markReliablePoints();
 
-	if (!fillHoles_)
+	upsample(imPose, image, imData->distortion, f_i, c_i);
+
+	lastHoleFillingTime_ = 0.f;
+	if (!fillHoles_ || !ptMap_)
 		return true;
 
+	std::chrono::high_resolution_clock::time_point t = std::chrono::high_resolution_clock::now();
+
 	DepthPoint *curPt = pts_.get();
   glm::vec2 *ptDepth = ptMap_.get();
   for (int row = 0; row < height_; row++) {
@@ -174,9 +203,13 @@ bool DepthMap::fillWithFrame(const TangoPointCloud* pointCloud, const TangoPoseD
     }    
   }
 
+	std::chrono::duration<float, std::milli> elapsed = std::chrono::high_resolution_clock::now() - t;
+	lastHoleFillingTime_ = elapsed.count();
+
 	return true;
 }
-#elif _WINDOWS
+#endif
+
 bool DepthMap::readFiles(const std::string& filenamePC, const std::string& filenameIM, float confidence) {
 	pc::PointCloud pc;
 	io::PointCloudMetadata pcData;
@@ -184,13 +217,23 @@ bool DepthMap::readFiles(const std::string& filenamePC, const std::string& filen
 	if (!io::PointCloudReader::read(filenamePC, pc, pcData, confidence))
 		return false;
 	
+	std::shared_ptr<io::Image> img;
 	io::ImageMetadata imData;
 
-	if (!io::ImageReader::read(filenameIM, img_, imData))
+	if (!io::ImageReader::read(filenameIM, img, imData))
+		return false;
+
+	return fillWithData(pc, pcData, img, imData);
+}
+
+bool DepthMap::fillWithData(const pc::PointCloud& pc, const io::PointCloudMetadata& pcData, const std::shared_ptr<io::Image>& img, const io::ImageMetadata& imData) {
+	if (!img)
 		return false;
 
-	pose_ = pcData.asPose();
-	glm::mat4 imPose = imData.asPose();
+	img_ = img;
+
+	pose_ = io::PointCloudMetadata(pcData).asPose();
+	glm::mat4 imPose = io::ImageMetadata(imData).asPose();
 
 	if (!pts_)
 		pts_.reset(new DepthPoint[nbrPixels_], std::default_delete<DepthPoint[]>());
@@ -198,10 +241,10 @@ bool DepthMap::readFiles(const std::string& filenamePC, const std::string& filen
 		clearData();
 
 	// Store points we're confident about	
-	for (size_t i = 0; i < pcData.nbrPoints_; i++) {		
-		const pc::Point* pt = &pc.at(i);
+	for (size_t i = 0; i < pc.size(); i++) {		
+		const pc::Point pt = pc.at(i);
 		
-		glm::vec3 ptTrans = imPose*glm::vec4(pt->pos.x, pt->pos.y, pt->pos.z, 1.f);
+		glm::vec3 ptTrans = imPose*glm::vec4(pt.pos.x, pt.pos.y, pt.pos.z, 1.f);
 		glm::vec2 ptColor = io::Image::undistortAndProject(ptTrans, imData.distortion_, imData.f_, imData.c_);
 		ptColor.x = floor(ptColor.x + 0.5f);
 		ptColor.y = floor(ptColor.y + 0.5f);
@@ -215,14 +258,14 @@ bool DepthMap::readFiles(const std::string& filenamePC, const std::string& filen
 		if (ptColor.y >= imData.height_)
 			continue;	
 
-		glm::vec2 ptDepth = io::Image::undistortAndProject(pt->pos, pcData.distortion_, pcData.f_, pcData.c_);
+		glm::vec2 ptDepth = io::Image::undistortAndProject(pt.pos, pcData.distortion_, pcData.f_, pcData.c_);
 		ptDepth = glm::vec2(width_ - 1.f, height_ - 1.f) - ptDepth;
 		ptDepth.x = std::max(0.f, std::min(width_ - 1.f, floor(ptDepth.x + 0.5f)));
 		ptDepth.y = std::max(0.f, std::min(height_ - 1.f, floor(ptDepth.y + 0.5f)));
 
 		DepthPoint* curPt = &pts_.get()[(int)(ptDepth.y*width_ + ptDepth.x)];
 		curPt->color = img_->pixelAsVector((size_t)ptColor.y, (size_t)ptColor.x, true);
-		curPt->pos = pt->pos;
+		curPt->pos = pt.pos;
 
 		curPt->depth = ptTrans.z;
 		curPt->flags = pc::KnownPoint;
@@ -235,10 +278,21 @@ bool DepthMap::readFiles(const std::string& filenamePC, const std::string& filen
 
 	markReliablePoints();
 
+	upsample(imPose, img_.get(), imData.distortion_, imData.f_, imData.c_);
+
 	// Fill-in missing pixels	
-	if (!fillHoles_)
+	lastHoleFillingTime_ = 0.f;
+	if (!fillHoles_ || !ptMap_)
 		return true;
 
+	std::chrono::high_resolution_clock::time_point t = std::chrono::high_resolution_clock::now();
+
+	// The color pixel of every depth pixel only changes with the intrinsics and the pose between the cameras
+	if (!colorMap_)
+		colorMap_.reset(new io::RemapCache());
+	if (!colorMap_->matches(ptMap_.get(), imPose, imData.width_, imData.height_, imData.distortion_, imData.f_, imData.c_))
+		colorMap_->build(ptMap_.get(), width_, height_, imPose, imData.width_, imData.height_, imData.distortion_, imData.f_, imData.c_, 1);
+
 	DepthPoint* curPt = pts_.get();
 	glm::vec2* ptDepth = ptMap_.get();
 	for (int row = 0; row < height_; row++) {
@@ -251,30 +305,17 @@ bool DepthMap::readFiles(const std::string& filenamePC, const std::string& filen
 				validDepthPx = false;
 
 			if (validDepthPx) {
-				glm::vec3 ptTrans = imPose*glm::vec4(ptDepth->x, ptDepth->y, 1.f, 1.f);
-				glm::vec2 ptColor = io::Image::undistortAndProject(ptTrans, imData.distortion_, imData.f_, imData.c_);
-				ptColor.x = floor(ptColor.x + 0.5f);
-				ptColor.y = floor(ptColor.y + 0.5f);
-
-				bool validColorPx = true;
-				if (ptColor.x < 0)
-					validColorPx = false;
-				else if (ptColor.x >= imData.width_)
-					validColorPx = false;
-				else if (ptColor.y < 0)
-					validColorPx = false;
-				else if (ptColor.y >= imData.height_)
-					validColorPx = false;
-
-				if (validColorPx) {
-					curPt->color = img_->pixelAsVector((size_t)ptColor.y, (size_t)ptColor.x, true);
+				int32_t colorIdx = colorMap_->nearestSource(row*width_ + col);
+
+				if (colorIdx >= 0) {
+					curPt->color = img_->pixelAsVector(colorIdx / imData.width_, colorIdx % imData.width_, true);
 					
 					if (fillWithMax_)
 						curPt->depth = MaxDepth;
 					else
 						curPt->depth = estimateDepth(glm::i16vec2(col, row));
 
-					if (!isnan(curPt->depth)) {
+					if (!std::isnan(curPt->depth)) {
 						float den = (imPose[0][2] * ptDepth->x + imPose[1][2] * ptDepth->y + imPose[2][2]);
 						curPt->pos.z = (curPt->depth - imPose[3][2]) / den;
 						curPt->pos.x = ptDepth->x*curPt->pos.z;
@@ -289,9 +330,11 @@ bool DepthMap::readFiles(const std::string& filenamePC, const std::string& filen
 		}
 	}	
 
+	std::chrono::duration<float, std::milli> elapsed = std::chrono::high_resolution_clock::now() - t;
+	lastHoleFillingTime_ = elapsed.count();
+
 	return true;
 }
-#endif
 
 void DepthMap::readDepthMappingFile() {
 	ifstream file(MaskFile, ios::in | ios::binary);
@@ -303,6 +346,168 @@ void DepthMap::readDepthMappingFile() {
 	}
 }
 
+/*
+ * Creates a lookup table to linearize 8-bit sRGB values.
+ * @return Lookup table.
+ */
+static std::vector<float> createLinearLUT() {
+	std::vector<float> lut(256);
+	for (int i = 0; i < 256; i++)
+		lut[i] = color::Color::sRGB2linRGB(glm::vec3(i / 255.f)).r;
+
+	return lut;
+}
+
+/*
+ * Retrieves the linearized color of a pixel using a lookup table.
+ * @param image Image to read.
+ * @param r Row of the pixel.
+ * @param c Column of the pixel.
+ * @return Linear RGB color.
+ */
+static inline glm::vec3 linearPixel(const io::Image* image, size_t r, size_t c) {
+	static const std::vector<float> lut = createLinearLUT();
+
+	const uchar* data = image->pixel(r, c);
+
+	return glm::vec3(lut[data[0]], lut[data[1]], lut[data[2]]);
+}
+
+void DepthMap::upsample(const glm::mat4& imPose, const io::Image* image, const double* distortion, const glm::dvec2& f, const glm::dvec2& c) {
+	size_t factor = (size_t)floor(upsamplingColorFraction_*image->cols() / width_ + 0.5f);
+
+	if ((factor <= 1) || !ptMap_) {
+		upPts_.reset();
+		return;
+	}
+
+	std::chrono::high_resolution_clock::time_point t = std::chrono::high_resolution_clock::now();
+
+	size_t imWidth = image->cols();
+	size_t imHeight = image->rows();
+
+	if (!upPts_ || (upWidth_ != width_*factor)) {
+		upWidth_ = width_*factor;
+		upHeight_ = height_*factor;
+		upPts_.reset(new DepthPoint[upWidth_*upHeight_], std::default_delete<DepthPoint[]>());
+	}
+
+	if (!upsampler_)
+		upsampler_.reset(new JointBilateralUpsampler(factor));
+	else
+		upsampler_->setFactor(factor);
+
+	// Low-resolution input, only the points measured by the sensor are used
+	std::vector<float> lowDepth(nbrPixels_);
+	std::vector<glm::vec3> lowColor(nbrPixels_);
+	std::vector<uchar> lowValid(nbrPixels_);
+
+	const DepthPoint* curPt = pts_.get();
+	for (size_t i = 0; i < nbrPixels_; i++) {
+		lowValid[i] = (curPt[i].flags & pc::KnownPoint) ? 1 : 0;
+		lowDepth[i] = lowValid[i] ? curPt[i].depth : 0.f;
+		lowColor[i] = curPt[i].color;
+	}
+
+	// Guide image, the rays are interpolated from the depth-mapping table and projected at unit depth
+	size_t nbrUpPixels = upWidth_*upHeight_;
+	std::vector<glm::vec3> guide(nbrUpPixels);
+	std::vector<glm::vec2> rays(nbrUpPixels);
+	std::vector<uchar> validRays(nbrUpPixels);
+
+	common::parallelFor(upHeight_, [&](size_t row) {
+		float y = std::max(0.f, std::min(height_ - 1.f, (row + 0.5f) / factor - 0.5f));
+		size_t y0 = std::min((size_t)y, height_ - 2);
+		float fy = y - y0;
+
+		for (size_t col = 0; col < upWidth_; col++) {
+			size_t idx = row*upWidth_ + col;
+
+			float x = std::max(0.f, std::min(width_ - 1.f, (col + 0.5f) / factor - 0.5f));
+			size_t x0 = std::min((size_t)x, width_ - 2);
+			float fx = x - x0;
+
+			const glm::vec2* map = ptMap_.get() + y0*width_ + x0;
+			validRays[idx] = 0;
+			guide[idx] = glm::vec3(0.f, 0.f, 0.f);
+
+			bool mapped = true;
+			for (size_t i = 0; i < 4; i++) {
+				const glm::vec2& curMap = map[(i / 2)*width_ + (i % 2)];
+				if ((curMap.x == 0) && (curMap.y == 0)) // The pixel is not mapped to a valid location
+					mapped = false;
+			}
+
+			if (!mapped)
+				continue;
+
+			glm::vec2 ray = (map[0] * (1.f - fx) + map[1] * fx)*(1.f - fy) + (map[width_] * (1.f - fx) + map[width_ + 1] * fx)*fy;
+
+			glm::vec3 ptTrans = imPose*glm::vec4(ray.x, ray.y, 1.f, 1.f);
+			glm::vec2 ptColor = io::Image::undistortAndProject(ptTrans, distortion, f, c);
+			ptColor.x = floor(ptColor.x + 0.5f);
+			ptColor.y = floor(ptColor.y + 0.5f);
+
+			if ((ptColor.x < 0) || (ptColor.x >= imWidth) || (ptColor.y < 0) || (ptColor.y >= imHeight))
+				continue;
+
+			rays[idx] = ray;
+			guide[idx] = linearPixel(image, (size_t)ptColor.y, (size_t)ptColor.x);
+			validRays[idx] = 1;
+		}
+	});
+
+	std::vector<float> upDepth(nbrUpPixels);
+	std::vector<float> upWeight(nbrUpPixels);
+	upsampler_->upsample(lowDepth.data(), lowColor.data(), lowValid.data(), width_, height_, guide.data(), upDepth.data(), upWeight.data());
+
+	// Back-projects the estimated depth and fetches the color at the final location
+	common::parallelFor(upHeight_, [&](size_t row) {
+		size_t lowRow = std::min(row / factor, height_ - 1);
+		DepthPoint* upPt = upPts_.get() + row*upWidth_;
+
+		for (size_t col = 0; col < upWidth_; col++) {
+			size_t idx = row*upWidth_ + col;
+			DepthPoint* curUpPt = upPt + col;
+
+			curUpPt->depth = FLT_MAX;
+			curUpPt->flags = pc::UnknownPoint;
+
+			if (!validRays[idx] || (upWeight[idx] <= 0.f))
+				continue;
+
+			const glm::vec2& ray = rays[idx];
+			float den = (imPose[0][2] * ray.x + imPose[1][2] * ray.y + imPose[2][2]);
+
+			curUpPt->depth = upDepth[idx];
+			curUpPt->pos.z = (curUpPt->depth - imPose[3][2]) / den;
+			curUpPt->pos.x = ray.x*curUpPt->pos.z;
+			curUpPt->pos.y = ray.y*curUpPt->pos.z;
+			curUpPt->color = guide[idx];
+
+			glm::vec3 ptTrans = imPose*glm::vec4(curUpPt->pos, 1.f);
+			glm::vec2 ptColor = io::Image::undistortAndProject(ptTrans, distortion, f, c);
+			ptColor.x = floor(ptColor.x + 0.5f);
+			ptColor.y = floor(ptColor.y + 0.5f);
+
+			if ((ptColor.x >= 0) && (ptColor.x < imWidth) && (ptColor.y >= 0) && (ptColor.y < imHeight))
+				curUpPt->color = linearPixel(image, (size_t)ptColor.y, (size_t)ptColor.x);
+
+#ifdef _WINDOWS
+			curUpPt->x = (size_t)std::max(0.f, ptColor.x);
+			curUpPt->y = (size_t)std::max(0.f, ptColor.y);
+#endif
+
+			// The nearest sensor pixel decides whether the point is measured or estimated
+			uchar lowFlags = pts_.get()[lowRow*width_ + std::min(col / factor, width_ - 1)].flags;
+			curUpPt->flags = (lowFlags & pc::KnownPoint) ? lowFlags : pc::EstimatedPoint;
+		}
+	});
+
+	std::chrono::duration<float, std::milli> elapsed = std::chrono::high_resolution_clock::now() - t;
+	lastUpsamplingTime_ = elapsed.count();
+}
+
 float DepthMap::estimateDepth(const glm::i16vec2& pos) {
 	float d[8];
 	float dt[8];
@@ -406,46 +611,83 @@ void DepthMap::findKnownDepth(const glm::i16vec2& pos, const glm::i16vec2& dir,
 	 return img;
  }
  
- void DepthMap::markReliablePoints() {	 
+ bool DepthMap::setReliabilityWindow(size_t size) {
+	 if ((size != 3) && (size != 5))
+		 return false;
+
+	 reliabilityWindow_ = size;
+
+	 return true;
+ }
+
+ void DepthMap::markReliablePoints() {
+	 std::chrono::high_resolution_clock::time_point t = std::chrono::high_resolution_clock::now();
+
+	 if (reliabilityMode_ == ReliabilityReference)
+		 markReliablePointsReference();
+	 else
+		 markReliablePointsSlidingWindow();
+
+	 std::chrono::duration<float, std::milli> elapsed = std::chrono::high_resolution_clock::now() - t;
+	 lastReliabilityTime_ = elapsed.count();
+ }
+
+ /*
+  * Checks if the color of the point is neither under- nor over-exposed.
+  * @param pt Point to be checked.
+  * @return True if the exposure is valid.
+  */
+ inline bool isWellExposed(const DepthPoint* pt) {
+	 if (pt->color.r < MinExposure)
+		 return false;
+	 if (pt->color.r > MaxExposure)
+		 return false;
+	 if (pt->color.g < MinExposure)
+		 return false;
+	 if (pt->color.g > MaxExposure)
+		 return false;
+	 if (pt->color.b < MinExposure)
+		 return false;
+	 if (pt->color.b > MaxExposure)
+		 return false;
+
+	 return true;
+ }
+
+ void DepthMap::markReliablePointsReference() {
+	 int radius = (int)reliabilityWindow_ / 2;
+	 int nbrNeighbors = (int)(reliabilityWindow_*reliabilityWindow_) - 1;
+	 float limitChiSquare = DepthMap::limitChiSquare(reliabilityWindow_);
+
 	 DepthPoint* curPt = pts_.get() - 1;
 	 for (int row = 0; row < height_; row++) {
 		 for (int col = 0; col < width_; col++) {
 			 ++curPt;
 
 			 // Border pixels are not reliable
-			 if (row == 0)
+			 if (row < radius)
 				 continue;
-			 else if (row == (height_ - 1))
+			 else if (row >= ((int)height_ - radius))
 				 continue;
 
-			 if (col == 0)
+			 if (col < radius)
 				 continue;
-			 else if (col == (width_ - 1))
+			 else if (col >= ((int)width_ - radius))
 				 continue;
 			 
 			 if (curPt->flags != pc::KnownPoint) // Only trusted pixels are marked as reliable
 				 continue;
 
 			 // Under- and over-exposed pixels aren't considered
-			 if (curPt->color.r < MinExposure)
-				 continue;
-			 if (curPt->color.r > MaxExposure)
-				 continue;
-			 if (curPt->color.g < MinExposure)
-				 continue;
-			 if (curPt->color.g > MaxExposure)
-				 continue;
-			 if (curPt->color.b < MinExposure)
-				 continue;
-			 if (curPt->color.b > MaxExposure)
+			 if (!isWellExposed(curPt))
 				 continue;
 
-			 DepthPoint* neighPt = curPt - width_ - 1;
+			 DepthPoint* neighPt = curPt - radius*width_ - radius;
 			 float sqSumD = 0.f;
 			 float sumD = 0.f;
 			 bool valid = true;
-			 for (int i = 0; i < 3; i++) {
-				 for (int j = 0; j < 3; j++) {
+			 for (int i = -radius; i <= radius; i++) {
+				 for (int j = -radius; j <= radius; j++) {
 					 if (neighPt != curPt) {
 						 if ((neighPt->flags == pc::KnownPoint) || (neighPt->flags == pc::ReliableKnownPoint)) { // Only trusted pixels are marked as reliable
 							 sqSumD += neighPt->depth*neighPt->depth;
@@ -462,15 +704,235 @@ void DepthMap::findKnownDepth(const glm::i16vec2& pos, const glm::i16vec2& dir,
 				 if (!valid)
 					 break;
 
-				 neighPt += width_ - 3;
+				 neighPt += width_ - reliabilityWindow_;
 			 }
 
 			 if (valid) {
-				 float chiSqValue = (sqSumD - 2 * curPt->depth*sumD + 8 * curPt->depth*curPt->depth) / curPt->depth;
+				 float chiSqValue = (sqSumD - 2 * curPt->depth*sumD + nbrNeighbors * curPt->depth*curPt->depth) / curPt->depth;
 
-				 if (chiSqValue <= LimitChiSquare)
+				 if (chiSqValue <= limitChiSquare)
 					 curPt->flags |= pc::ReliablePoint;					 				 
 			 }			 
 		 }
 	 }
- }
\ No newline at end of file
+ }
+
+ /*
+  * Evaluates the chi-square test for a block of pixels given the sums over their windows (center included).
+  * @param sumD Sum of the depth in the windows.
+  * @param sqSumD Sum of the squared depth in the windows.
+  * @param invalid Number of untrusted pixels in the windows.
+  * @param depth Depth of the center pixels.
+  * @param candidate Non-zero for the pixels that can be marked as reliable.
+  * @param nbrNeighbors Number of neighbors in the window.
+  * @param limitChiSquare Maximum chi-square value for a reliable pixel.
+  * @param reliable Output, one entry per pixel set to true if the pixel is reliable.
+  */
+ inline void evaluateReliableBlock(const float* sumD, const float* sqSumD, const float* invalid, const float* depth, const float* candidate, float nbrNeighbors, float limitChiSquare, bool* reliable) {
+#ifdef USE_SSE
+	 const __m128 zero = _mm_setzero_ps();
+	 const __m128 nbrNeigh = _mm_set1_ps(nbrNeighbors);
+	 const __m128 limit = _mm_set1_ps(limitChiSquare);
+
+	 for (size_t i = 0; i < ReliabilityBlock; i += 4) {
+		 __m128 d = _mm_loadu_ps(depth + i);
+		 __m128 s = _mm_sub_ps(_mm_loadu_ps(sumD + i), d);
+		 __m128 q = _mm_sub_ps(_mm_loadu_ps(sqSumD + i), _mm_mul_ps(d, d));
+
+		 __m128 num = _mm_sub_ps(q, _mm_mul_ps(_mm_add_ps(d, d), s));
+		 num = _mm_add_ps(num, _mm_mul_ps(_mm_mul_ps(nbrNeigh, d), d));
+		 __m128 chiSq = _mm_div_ps(num, d);
+
+		 __m128 ok = _mm_cmple_ps(chiSq, limit);
+		 ok = _mm_and_ps(ok, _mm_cmpeq_ps(_mm_loadu_ps(invalid + i), zero));
+		 ok = _mm_and_ps(ok, _mm_cmpneq_ps(_mm_loadu_ps(candidate + i), zero));
+
+		 int mask = _mm_movemask_ps(ok);
+		 reliable[i] = (mask & 0x1) != 0;
+		 reliable[i + 1] = (mask & 0x2) != 0;
+		 reliable[i + 2] = (mask & 0x4) != 0;
+		 reliable[i + 3] = (mask & 0x8) != 0;
+	 }
+#elif defined(USE_NEON)
+	 const float32x4_t zero = vdupq_n_f32(0.f);
+	 const float32x4_t nbrNeigh = vdupq_n_f32(nbrNeighbors);
+	 const float32x4_t limit = vdupq_n_f32(limitChiSquare);
+
+	 for (size_t i = 0; i < ReliabilityBlock; i += 4) {
+		 float32x4_t d = vld1q_f32(depth + i);
+		 float32x4_t s = vsubq_f32(vld1q_f32(sumD + i), d);
+		 float32x4_t q = vsubq_f32(vld1q_f32(sqSumD + i), vmulq_f32(d, d));
+
+		 float32x4_t num = vsubq_f32(q, vmulq_f32(vaddq_f32(d, d), s));
+		 num = vaddq_f32(num, vmulq_f32(vmulq_f32(nbrNeigh, d), d));
+		 float32x4_t chiSq = vdivq_f32(num, d);
+
+		 uint32x4_t ok = vcleq_f32(chiSq, limit);
+		 ok = vandq_u32(ok, vceqq_f32(vld1q_f32(invalid + i), zero));
+		 ok = vandq_u32(ok, vmvnq_u32(vceqq_f32(vld1q_f32(candidate + i), zero)));
+
+		 uint32_t mask[4];
+		 vst1q_u32(mask, ok);
+		 for (size_t j = 0; j < 4; j++)
+			 reliable[i + j] = mask[j] != 0;
+	 }
+#else
+	 for (size_t i = 0; i < ReliabilityBlock; i++) {
+		 reliable[i] = false;
+
+		 if ((candidate[i] == 0.f) || (invalid[i] != 0.f))
+			 continue;
+
+		 float d = depth[i];
+		 float s = sumD[i] - d;
+		 float q = sqSumD[i] - d*d;
+		 float chiSqValue = (q - 2 * d*s + nbrNeighbors * d*d) / d;
+
+		 reliable[i] = chiSqValue <= limitChiSquare;
+	 }
+#endif
+ }
+
+ void DepthMap::markReliablePointsSlidingWindow() {
+	 size_t radius = reliabilityWindow_ / 2;
+	 float nbrNeighbors = (float)(reliabilityWindow_*reliabilityWindow_ - 1);
+	 float limitChiSquare = DepthMap::limitChiSquare(reliabilityWindow_);
+
+	 // Rows are padded so the last block of every row can be loaded at once
+	 size_t stride = ((width_ + ReliabilityBlock - 1) / ReliabilityBlock)*ReliabilityBlock;
+	 size_t planeSize = stride*height_;
+
+	 reliabilityData_.assign(planeSize * 6 + stride * 3, 0.f);
+	 float* depth = &reliabilityData_[0];      // Depth of the trusted pixels (0 otherwise)
+	 float* invalid = depth + planeSize;       // 1 for untrusted pixels
+	 float* candidate = invalid + planeSize;   // 1 for the pixels that can be marked as reliable
+	 float* rowSumD = candidate + planeSize;   // Horizontal window sums
+	 float* rowSqSumD = rowSumD + planeSize;
+	 float* rowInvalid = rowSqSumD + planeSize;
+	 float* sumD = rowInvalid + planeSize;     // Vertical running sums (full window)
+	 float* sqSumD = sumD + stride;
+	 float* sumInvalid = sqSumD + stride;
+
+	 const DepthPoint* curPt = pts_.get();
+	 for (size_t row = 0; row < height_; row++) {
+		 size_t rowIdx = row*stride;
+		 bool borderRow = (row < radius) || (row >= (height_ - radius));
+
+		 for (size_t col = 0; col < width_; col++) {
+			 if ((curPt->flags == pc::KnownPoint) || (curPt->flags == pc::ReliableKnownPoint))
+				 depth[rowIdx + col] = curPt->depth;
+			 else
+				 invalid[rowIdx + col] = 1.f;
+
+			 if (!borderRow && (col >= radius) && (col < (width_ - radius)) && (curPt->flags == pc::KnownPoint) && isWellExposed(curPt))
+				 candidate[rowIdx + col] = 1.f;
+
+			 ++curPt;
+		 }
+
+		 // Horizontal pass, running sums along the row
+		 const float* dRow = depth + rowIdx;
+		 const float* iRow = invalid + rowIdx;
+		 float s = 0.f;
+		 float q = 0.f;
+		 float inv = 0.f;
+		 for (size_t col = 0; col < reliabilityWindow_; col++) {
+			 s += dRow[col];
+			 q += dRow[col] * dRow[col];
+			 inv += iRow[col];
+		 }
+
+		 for (size_t col = radius; col < (width_ - radius); col++) {
+			 rowSumD[rowIdx + col] = s;
+			 rowSqSumD[rowIdx + col] = q;
+			 rowInvalid[rowIdx + col] = inv;
+
+			 size_t colIn = col + radius + 1;
+			 if (colIn < width_) {
+				 size_t colOut = col - radius;
+				 s += dRow[colIn] - dRow[colOut];
+				 q += dRow[colIn] * dRow[colIn] - dRow[colOut] * dRow[colOut];
+				 inv += iRow[colIn] - iRow[colOut];
+			 }
+		 }
+	 }
+
+	 // Vertical pass, running sums along the columns
+	 for (size_t row = 0; row < reliabilityWindow_; row++) {
+		 size_t rowIdx = row*stride;
+		 for (size_t col = 0; col < stride; col++) {
+			 sumD[col] += rowSumD[rowIdx + col];
+			 sqSumD[col] += rowSqSumD[rowIdx + col];
+			 sumInvalid[col] += rowInvalid[rowIdx + col];
+		 }
+	 }
+
+	 bool reliable[ReliabilityBlock];
+	 for (size_t row = radius; row < (height_ - radius); row++) {
+		 size_t rowIdx = row*stride;
+		 DepthPoint* rowPt = pts_.get() + row*width_;
+
+		 for (size_t col = 0; col < width_; col += ReliabilityBlock) {
+			 evaluateReliableBlock(sumD + col, sqSumD + col, sumInvalid + col, depth + rowIdx + col, candidate + rowIdx + col, nbrNeighbors, limitChiSquare, reliable);
+
+			 size_t nbrCols = std::min(ReliabilityBlock, width_ - col);
+			 for (size_t i = 0; i < nbrCols; i++) {
+				 if (reliable[i])
+					 rowPt[col + i].flags |= pc::ReliablePoint;
+			 }
+		 }
+
+		 size_t rowIn = row + radius + 1;
+		 if (rowIn < height_) {
+			 const float* sIn = rowSumD + rowIn*stride;
+			 const float* qIn = rowSqSumD + rowIn*stride;
+			 const float* iIn = rowInvalid + rowIn*stride;
+			 const float* sOut = rowSumD + (row - radius)*stride;
+			 const float* qOut = rowSqSumD + (row - radius)*stride;
+			 const float* iOut = rowInvalid + (row - radius)*stride;
+
+			 for (size_t col = 0; col < stride; col++) {
+				 sumD[col] += sIn[col] - sOut[col];
+				 sqSumD[col] += qIn[col] - qOut[col];
+				 sumInvalid[col] += iIn[col] - iOut[col];
+			 }
+		 }
+	 }
+ }
+
+ float DepthMap::limitChiSquare(size_t size) {
+	 return size == 3 ? LimitChiSquare : LimitChiSquare5x5;
+ }
+
+ size_t DepthMap::compareReliabilityModes() {
+	 if (!pts_)
+		 return 0;
+
+	 std::vector<uchar> flagsRef(nbrPixels_);
+	 ReliabilityMode curMode = reliabilityMode_;
+
+	 // Removes the reliable flag so both modes start from the same state
+	 DepthPoint* curPt = pts_.get();
+	 for (size_t i = 0; i < nbrPixels_; i++)
+		 curPt[i].flags &= ~pc::ReliablePoint;
+
+	 markReliablePointsReference();
+
+	 for (size_t i = 0; i < nbrPixels_; i++) {
+		 flagsRef[i] = curPt[i].flags;
+		 curPt[i].flags &= ~pc::ReliablePoint;
+	 }
+
+	 markReliablePointsSlidingWindow();
+
+	 size_t nbrDiff = 0;
+	 for (size_t i = 0; i < nbrPixels_; i++) {
+		 if (curPt[i].flags != flagsRef[i])
+			 nbrDiff++;
+
+		 if (curMode == ReliabilityReference)
+			 curPt[i].flags = flagsRef[i];
+	 }
+
+	 return nbrDiff;
+ }
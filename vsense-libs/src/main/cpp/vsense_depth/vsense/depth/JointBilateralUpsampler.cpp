@@ -0,0 +1,159 @@
+#include <vsense/depth/JointBilateralUpsampler.h>
+
+#include <vsense/common/Parallel.h>
+
+#include <algorithm>
+#include <cmath>
+
+using namespace vsense;
+using namespace vsense::depth;
+
+const int NbrTaps = 4; // Low-resolution taps per direction
+
+const size_t NbrRangeBins = 1024;
+const float MaxSqColorDist = 3.f; // Largest squared distance between two colors in [0, 1]
+
+const size_t TileSize = 64; // Output tile size in pixels (vertical pass)
+
+JointBilateralUpsampler::JointBilateralUpsampler(size_t factor, float sigmaSpatial, float sigmaRange) : factor_(std::max(factor, (size_t)1)),
+	sigmaSpatial_(sigmaSpatial), sigmaRange_(sigmaRange), nbrThreads_(0) {
+	updateTables();
+}
+
+void JointBilateralUpsampler::setFactor(size_t factor) {
+	factor = std::max(factor, (size_t)1);
+
+	if (factor == factor_)
+		return;
+
+	factor_ = factor;
+	updateTables();
+}
+
+void JointBilateralUpsampler::setSigmas(float sigmaSpatial, float sigmaRange) {
+	sigmaSpatial_ = sigmaSpatial;
+	sigmaRange_ = sigmaRange;
+	updateTables();
+}
+
+void JointBilateralUpsampler::updateTables() {
+	// The high-resolution pixel i is centered at (i + 0.5)/factor - 0.5 in low-resolution coordinates, so the taps only
+	// depend on i % factor (phase)
+	spatialWeights_.resize(factor_*NbrTaps);
+	tapOffsets_.resize(factor_);
+
+	float spatialDen = 2.f*sigmaSpatial_*sigmaSpatial_;
+	for (size_t phase = 0; phase < factor_; phase++) {
+		float pos = (phase + 0.5f) / factor_ - 0.5f;
+		int firstTap = (int)floor(pos) - NbrTaps / 2 + 1;
+
+		tapOffsets_[phase] = firstTap;
+
+		for (int t = 0; t < NbrTaps; t++) {
+			float d = (firstTap + t) - pos;
+			spatialWeights_[phase*NbrTaps + t] = exp(-d*d / spatialDen);
+		}
+	}
+
+	rangeWeights_.resize(NbrRangeBins);
+
+	float rangeDen = 2.f*sigmaRange_*sigmaRange_;
+	for (size_t i = 0; i < NbrRangeBins; i++) {
+		float sqDist = i*MaxSqColorDist / (NbrRangeBins - 1);
+		rangeWeights_[i] = exp(-sqDist / rangeDen);
+	}
+}
+
+inline float JointBilateralUpsampler::rangeWeight(const glm::vec3& a, const glm::vec3& b) const {
+	glm::vec3 diff = a - b;
+	float sqDist = diff.x*diff.x + diff.y*diff.y + diff.z*diff.z;
+
+	size_t bin = std::min((size_t)(sqDist*(NbrRangeBins - 1) / MaxSqColorDist), NbrRangeBins - 1);
+
+	return rangeWeights_[bin];
+}
+
+void JointBilateralUpsampler::upsample(const float* depth, const glm::vec3* color, const uchar* valid, size_t width, size_t height, const glm::vec3* guide, float* depthOut, float* weightOut) {
+	size_t outWidth = width*factor_;
+	size_t outHeight = height*factor_;
+
+	rowDepth_.resize(height*outWidth);
+	rowWeight_.resize(height*outWidth);
+
+	// Horizontal pass, low-resolution rows to high-resolution columns
+	common::parallelFor(height, [&](size_t row) {
+		const float* rowD = depth + row*width;
+		const glm::vec3* rowC = color + row*width;
+		const uchar* rowV = valid + row*width;
+		const glm::vec3* rowG = guide + (row*factor_ + factor_ / 2)*outWidth; // Guide at the center of the low-resolution row
+
+		float* outD = &rowDepth_[row*outWidth];
+		float* outW = &rowWeight_[row*outWidth];
+
+		for (size_t col = 0; col < outWidth; col++) {
+			size_t phase = col % factor_;
+			int firstCol = (int)(col / factor_) + tapOffsets_[phase];
+			const float* spatial = &spatialWeights_[phase*NbrTaps];
+
+			float sumD = 0.f;
+			float sumW = 0.f;
+			for (int t = 0; t < NbrTaps; t++) {
+				int curCol = firstCol + t;
+				if ((curCol < 0) || (curCol >= (int)width))
+					continue;
+				if (!rowV[curCol])
+					continue;
+
+				float w = spatial[t] * rangeWeight(rowG[col], rowC[curCol]);
+				sumD += w*rowD[curCol];
+				sumW += w;
+			}
+
+			outD[col] = sumW > 0.f ? sumD / sumW : 0.f;
+			outW[col] = sumW;
+		}
+	}, nbrThreads_);
+
+	// Vertical pass, high-resolution tiles
+	size_t tilesX = (outWidth + TileSize - 1) / TileSize;
+	size_t tilesY = (outHeight + TileSize - 1) / TileSize;
+
+	common::parallelFor(tilesX*tilesY, [&](size_t tile) {
+		size_t startCol = (tile % tilesX)*TileSize;
+		size_t startRow = (tile / tilesX)*TileSize;
+		size_t endCol = std::min(startCol + TileSize, outWidth);
+		size_t endRow = std::min(startRow + TileSize, outHeight);
+
+		for (size_t row = startRow; row < endRow; row++) {
+			size_t phase = row % factor_;
+			int firstRow = (int)(row / factor_) + tapOffsets_[phase];
+			const float* spatial = &spatialWeights_[phase*NbrTaps];
+
+			const glm::vec3* rowG = guide + row*outWidth;
+			float* outD = depthOut + row*outWidth;
+			float* outW = weightOut + row*outWidth;
+
+			for (size_t col = startCol; col < endCol; col++) {
+				float sumD = 0.f;
+				float sumW = 0.f;
+				for (int t = 0; t < NbrTaps; t++) {
+					int curRow = firstRow + t;
+					if ((curRow < 0) || (curRow >= (int)height))
+						continue;
+
+					size_t idx = curRow*outWidth + col;
+					if (rowWeight_[idx] <= 0.f)
+						continue;
+
+					const glm::vec3& refG = guide[(curRow*factor_ + factor_ / 2)*outWidth + col];
+					float w = spatial[t] * rangeWeight(rowG[col], refG) * rowWeight_[idx];
+					sumD += w*rowDepth_[idx];
+					sumW += w;
+				}
+
+				outD[col] = sumW > 0.f ? sumD / sumW : 0.f;
+				outW[col] = sumW;
+			}
+		}
+	}, nbrThreads_);
+}
@@ -0,0 +1,70 @@
+#include <vsense/em/ColorMoments.h>
+
+#include <algorithm>
+
+using namespace vsense;
+using namespace vsense::em;
+
+void ColorMoments::add(const glm::vec3& cur, const glm::vec3& ref) {
+	for (int col = 0; col < 3; col++) {
+		for (int row = 0; row < 3; row++) {
+			curCur[col][row] += (double)cur[row] * cur[col];
+			refCur[col][row] += (double)ref[row] * cur[col];
+		}
+	}
+
+	refRef += (double)ref.r*ref.r + (double)ref.g*ref.g + (double)ref.b*ref.b;
+	count++;
+}
+
+bool ColorMoments::addReliable(const glm::vec4& cur, const glm::vec4& ref) {
+	if ((cur.a <= 0.f) || (ref.a <= 0.f))
+		return false;
+
+	add(glm::vec3(cur), glm::vec3(ref));
+
+	return true;
+}
+
+void ColorMoments::add(const ColorMoments& moments) {
+	curCur += moments.curCur;
+	refCur += moments.refCur;
+	refRef += moments.refRef;
+	count += moments.count;
+}
+
+ColorMoments ColorMoments::fromCorrectionData(const float* data, size_t width) {
+	ColorMoments moments;
+	for (int row = 0; row < 3; row++) {
+		for (int col = 0; col < 3; col++) {
+			moments.curCur[col][row] = data[row * width + col + 7];
+			moments.refCur[col][row] = data[row * width + col + 10];
+		}
+	}
+	moments.count = (uint32_t)data[width + 6];
+	moments.refRef = data[width * 2 + 6];
+
+	return moments;
+}
+
+double ColorMoments::meanSquaredError(const glm::mat3& corr) const {
+	if (!count)
+		return -1.0;
+
+	glm::dmat3 m(corr);
+
+	// trace(M*refCur^T) and trace(M*curCur*M^T)
+	double cross = 0.0;
+	double quad = 0.0;
+
+	glm::dmat3 mc = m*curCur;
+	for (int col = 0; col < 3; col++) {
+		for (int row = 0; row < 3; row++) {
+			cross += m[col][row] * refCur[col][row];
+			quad += mc[col][row] * m[col][row];
+		}
+	}
+
+	// The residual is never negative, small negative values come from rounding
+	return std::max(0.0, (refRef - 2.0*cross + quad) / count);
+}
@@ -0,0 +1,136 @@
+#include <vsense/em/CoverageMap.h>
+
+#include <algorithm>
+#include <limits>
+#include <utility>
+
+using namespace vsense;
+using namespace vsense::em;
+
+CoverageMap::CoverageMap(size_t tileSize) : width_(0), height_(0), tileSize_(1), tileShift_(0), tilesX_(0), tilesY_(0) {
+	// Power of two so observe() finds the tile with shifts
+	while ((tileSize_ << 1) <= tileSize) {
+		tileSize_ <<= 1;
+		tileShift_++;
+	}
+}
+
+void CoverageMap::resize(size_t width, size_t height) {
+	width_ = width;
+	height_ = height;
+
+	tilesX_ = (width_ + tileSize_ - 1) / tileSize_;
+	tilesY_ = (height_ + tileSize_ - 1) / tileSize_;
+
+	packed_.resize(width_*height_);
+	tileObserved_.resize(tilesX_*tilesY_);
+	tileSingle_.resize(tilesX_*tilesY_);
+	tileFrameSum_.resize(tilesX_*tilesY_);
+
+	clear();
+}
+
+void CoverageMap::clear() {
+	std::fill(packed_.begin(), packed_.end(), 0);
+	std::fill(tileObserved_.begin(), tileObserved_.end(), 0);
+	std::fill(tileSingle_.begin(), tileSingle_.end(), 0);
+	std::fill(tileFrameSum_.begin(), tileFrameSum_.end(), 0);
+}
+
+void CoverageMap::load(const uint32_t* packed) {
+	clear();
+
+	for (size_t y = 0; y < height_; y++) {
+		size_t tileRow = (y / tileSize_)*tilesX_;
+		for (size_t x = 0; x < width_; x++) {
+			size_t offset = y*width_ + x;
+			uint32_t texel = packed[offset];
+			packed_[offset] = texel;
+
+			uint32_t count = texel & CoverageMaxCount;
+			if (count == 0)
+				continue;
+
+			size_t tile = tileRow + x / tileSize_;
+			tileObserved_[tile]++;
+			tileFrameSum_[tile] += texel >> CoverageCountBits;
+			if (count == 1)
+				tileSingle_[tile]++;
+		}
+	}
+}
+
+uint32_t CoverageMap::getAge(size_t offset, uint32_t frame) const {
+	uint32_t texel = packed_[offset];
+	if ((texel & CoverageMaxCount) == 0)
+		return std::numeric_limits<uint32_t>::max();
+
+	uint32_t lastFrame = texel >> CoverageCountBits;
+
+	return (frame > lastFrame) ? frame - lastFrame : 0;
+}
+
+TileCoverage CoverageMap::getTile(size_t tile, uint32_t frame) const {
+	size_t x0 = (tile % tilesX_)*tileSize_;
+	size_t y0 = (tile / tilesX_)*tileSize_;
+	size_t nbrTexels = (std::min(x0 + tileSize_, width_) - x0)*(std::min(y0 + tileSize_, height_) - y0);
+
+	return toCoverage(nbrTexels, tileObserved_[tile], tileSingle_[tile], tileFrameSum_[tile], frame);
+}
+
+TileCoverage CoverageMap::getTotal(uint32_t frame) const {
+	uint64_t frameSum = 0;
+	for (size_t tile = 0; tile < tileFrameSum_.size(); tile++)
+		frameSum += tileFrameSum_[tile];
+
+	return toCoverage(packed_.size(), getNbrObserved(), getNbrSingle(), frameSum, frame);
+}
+
+size_t CoverageMap::getNbrObserved() const {
+	size_t nbrObserved = 0;
+	for (size_t tile = 0; tile < tileObserved_.size(); tile++)
+		nbrObserved += tileObserved_[tile];
+
+	return nbrObserved;
+}
+
+size_t CoverageMap::getNbrSingle() const {
+	size_t nbrSingle = 0;
+	for (size_t tile = 0; tile < tileSingle_.size(); tile++)
+		nbrSingle += tileSingle_[tile];
+
+	return nbrSingle;
+}
+
+size_t CoverageMap::findStaleTiles(uint32_t frame, float maxMeanAge, float minCoverage, std::vector<size_t>& tiles) const {
+	std::vector<std::pair<float, size_t>> candidates;
+	for (size_t tile = 0; tile < tileObserved_.size(); tile++) {
+		TileCoverage coverage = getTile(tile, frame);
+		if (coverage.coverage >= minCoverage && coverage.meanAge <= maxMeanAge)
+			continue;
+
+		// Missing texels count as never refreshed, ahead of any age
+		float priority = (1.f - coverage.coverage)*(maxMeanAge + 1.f) + coverage.coverage*coverage.meanAge;
+		candidates.push_back(std::make_pair(-priority, tile));
+	}
+
+	std::sort(candidates.begin(), candidates.end());
+
+	tiles.resize(candidates.size());
+	for (size_t i = 0; i < candidates.size(); i++)
+		tiles[i] = candidates[i].second;
+
+	return tiles.size();
+}
+
+TileCoverage CoverageMap::toCoverage(size_t nbrTexels, size_t observed, size_t single, uint64_t frameSum, uint32_t frame) {
+	TileCoverage coverage;
+	if (nbrTexels == 0 || observed == 0)
+		return coverage;
+
+	coverage.coverage = (float)observed / nbrTexels;
+	coverage.singleFraction = (float)single / observed;
+	coverage.meanAge = std::max(0.f, (float)((double)frame - (double)frameSum / observed));
+
+	return coverage;
+}
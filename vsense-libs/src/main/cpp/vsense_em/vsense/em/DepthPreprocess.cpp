@@ -0,0 +1,346 @@
+#include <vsense/em/DepthPreprocess.h>
+
+#include <cmath>
+
+using namespace vsense;
+using namespace vsense::em;
+
+const int GroupSize = 8;
+const int MaxRadius = 2;
+const int TileSize = GroupSize + 2 * MaxRadius;
+
+const float MinExposure = 0.05f;
+const float MaxExposure = 0.95f;
+
+const float KnownPoint = 1.f;
+const float ReliablePoint = 2.f;
+
+const float MaxDepth = 2.f;
+
+const int SearchDirs[8][2] = { { -1, -1 }, { -1, 0 }, { -1, 1 }, { 0, -1 }, { 0, 1 }, { 1, -1 }, { 1, 0 }, { 1, 1 } };
+
+/*
+ * Undistorts and projects a point to the color image, as done by the shaders.
+ * @param pt Point in the coordinates of the color camera.
+ * @param params Parameters holding the intrinsics.
+ * @return Pixel coordinates.
+ */
+static glm::vec2 undistortAndProject(const glm::vec3& pt, const DepthPreprocessParams& params) {
+	glm::vec2 p(pt.x / pt.z, pt.y / pt.z);
+	const float* coeff = params.coeff;
+
+	float x2 = p.x*p.x;
+	float y2 = p.y*p.y;
+	float r2 = x2 + y2;
+
+	glm::vec2 uv;
+	if (coeff[4] != 0.f) { // Brown's 5-Polynomial
+		float xy2 = 2.f * p.x*p.y;
+		float kr = 1.f + ((coeff[4] * r2 + coeff[1])*r2 + coeff[0])*r2;
+
+		uv.x = p.x*kr + coeff[2] * xy2 + coeff[3] * (r2 + 2.f * x2);
+		uv.y = p.y*kr + coeff[2] * (r2 + 2.f * y2) + coeff[3] * xy2;
+	} else { // Brown's 3 Polynomial
+		float kr = 1.f + ((coeff[2] * r2 + coeff[1])*r2 + coeff[0])*r2;
+
+		uv.x = p.x*kr;
+		uv.y = p.y*kr;
+	}
+
+	return glm::vec2(uv.x*params.f.x + params.c.x, uv.y*params.f.y + params.c.y);
+}
+
+DepthPreprocess::DepthPreprocess(int width, int height) : width_(width), height_(height), tileOriginX_(0), tileOriginY_(0),
+	tileDepth_(TileSize*TileSize), tileInvalid_(TileSize*TileSize), tileRowSums_(TileSize*GroupSize) {
+
+}
+
+void DepthPreprocess::loadTile(int groupX, int groupY, const glm::vec4* depthMap, const glm::vec4* pointsMap, int radius) {
+	tileOriginX_ = groupX*GroupSize - MaxRadius;
+	tileOriginY_ = groupY*GroupSize - MaxRadius;
+
+	for (int i = 0; i < TileSize*TileSize; i++) {
+		int x = tileOriginX_ + i % TileSize;
+		int y = tileOriginY_ + i / TileSize;
+
+		tileDepth_[i] = 0.f;
+		tileInvalid_[i] = 1.f;
+		if ((x >= 0) && (y >= 0) && (x < width_) && (y < height_)) {
+			traffic_.nbrReads++;
+			if (pointsMap[y*width_ + x].w >= KnownPoint) {
+				traffic_.nbrReads++;
+				tileDepth_[i] = depthMap[y*width_ + x].w;
+				tileInvalid_[i] = 0.f;
+			}
+		}
+	}
+
+	for (int i = 0; i < TileSize*GroupSize; i++) {
+		int row = i / GroupSize;
+		int col = i % GroupSize + MaxRadius;
+
+		glm::vec3 sums(0.f);
+		for (int j = -radius; j <= radius; j++) {
+			float depth = tileDepth_[row*TileSize + col + j];
+			sums += glm::vec3(depth, depth*depth, tileInvalid_[row*TileSize + col + j]);
+		}
+
+		tileRowSums_[i] = sums;
+	}
+}
+
+bool DepthPreprocess::isReliable(int x, int y, int localX, int localY, const glm::vec4& depthData, const DepthPreprocessParams& params) const {
+	int radius = params.radius;
+
+	// The window must fit within the depth map
+	if ((x < radius) || (x >= (width_ - radius)) || (y < radius) || (y >= (height_ - radius)))
+		return false;
+
+	bool lowExp = true;
+	bool highExp = true;
+	for (int i = 0; i < 3; i++) { // Over- and under-exposed points discarded
+		if (depthData[i] > MinExposure)
+			lowExp = false;
+		if (depthData[i] < MaxExposure)
+			highExp = false;
+	}
+
+	if (lowExp || highExp)
+		return false;
+
+	// Vertical pass, the window sums include the center pixel
+	glm::vec3 sums(0.f);
+	for (int j = -radius; j <= radius; j++)
+		sums += tileRowSums_[(localY + MaxRadius + j)*GroupSize + localX];
+
+	if (sums.z != 0.f) // Not all neighbors are known
+		return false;
+
+	float depth = depthData.w;
+	float sumD = sums.x - depth;
+	float sqSumD = sums.y - depth*depth;
+	float nbrNeighbors = (float)((2 * radius + 1)*(2 * radius + 1) - 1);
+	float chiSqValue = (sqSumD - 2.f * depth*sumD + nbrNeighbors * depth*depth) / depth;
+
+	return chiSqValue <= params.limitChiSquare;
+}
+
+template <typename KnownFunc>
+float DepthPreprocess::estimateDepth(int x, int y, KnownFunc isKnown) const {
+	glm::vec2 d[8];
+
+	for (int i = 0; i < 8; i++) {
+		int curX = x;
+		int curY = y;
+		d[i] = glm::vec2(0.f);
+
+		while (true) {
+			curX += SearchDirs[i][0];
+			curY += SearchDirs[i][1];
+
+			if ((curX < 0) || (curX >= width_) || (curY < 0) || (curY >= height_))
+				break;
+
+			float depth;
+			if (isKnown(curX, curY, depth)) {
+				float dx = (float)(curX - x);
+				float dy = (float)(curY - y);
+
+				d[i] = glm::vec2(depth, sqrt(dx*dx + dy*dy));
+				break;
+			}
+		}
+	}
+
+	float dSum = 0.f;
+	float dSumWeight = 0.f;
+	for (int i = 0; i < 8; i++) {
+		float dtWeight = (d[i].y != 0.f ? ((float)width_ - d[i].y) / (float)width_ : 0.f);
+		dSum += (d[i].x * dtWeight);
+		dSumWeight += dtWeight;
+	}
+
+	return dSum / dSumWeight;
+}
+
+template <typename KnownFunc>
+bool DepthPreprocess::fillHole(int x, int y, const glm::vec4* colorImage, int colorWidth, int colorHeight, const glm::vec2* ptMapping,
+	const DepthPreprocessParams& params, KnownFunc isKnown, glm::vec4& depthOut, glm::vec4& pointOut) {
+	traffic_.nbrReads++;
+	glm::vec2 ptDepth = ptMapping[y*width_ + x];
+	if ((ptDepth.x == 0.f) && (ptDepth.y == 0.f)) // The pixel is not mapped to a valid location
+		return false;
+
+	glm::vec3 ptTrans = glm::vec3(params.pose*glm::vec4(ptDepth.x, ptDepth.y, 1.f, 1.f));
+	glm::vec2 uv = undistortAndProject(ptTrans, params) + 0.5f;
+	int colorX = (int)uv.x;
+	int colorY = (int)uv.y;
+
+	if ((colorX < 0) || (colorX >= colorWidth) || (colorY < 0) || (colorY >= colorHeight))
+		return false;
+
+	traffic_.nbrReads++;
+	glm::vec4 color = colorImage[colorY*colorWidth + colorX];
+
+	if (params.fillWithMax)
+		color.a = MaxDepth;
+	else
+		color.a = estimateDepth(x, y, isKnown);
+
+	depthOut = color;
+
+	const glm::mat4& pose = params.pose;
+	pointOut.z = (color.a - pose[3][2]) / (pose[0][2] * ptDepth.x + pose[1][2] * ptDepth.y + pose[2][2]);
+	pointOut.x = ptDepth.x*pointOut.z;
+	pointOut.y = ptDepth.y*pointOut.z;
+	pointOut.w = KnownPoint;
+	traffic_.nbrWrites += 2;
+
+	return true;
+}
+
+void DepthPreprocess::runFused(const glm::vec4* depthMap, const glm::vec4* pointsMap, const glm::vec4* colorImage, int colorWidth, int colorHeight,
+	const glm::vec2* ptMapping, const DepthPreprocessParams& params, glm::vec4* depthOut, glm::vec4* pointsOut) {
+	traffic_ = ImageTraffic();
+	traffic_.nbrDispatches = 1;
+
+	int nbrGroupsX = (width_ + GroupSize - 1) / GroupSize;
+	int nbrGroupsY = (height_ + GroupSize - 1) / GroupSize;
+
+	// The border pixels are not copied by the reliability pass, so the hole filling sees them as unknown
+	auto isKnown = [&](int curX, int curY, float& depth) -> bool {
+		depth = 0.f;
+		if ((curX <= 0) || (curY <= 0) || (curX >= (width_ - 1)) || (curY >= (height_ - 1)))
+			return false;
+
+		int tileX = curX - tileOriginX_;
+		int tileY = curY - tileOriginY_;
+		if ((tileX >= 0) && (tileY >= 0) && (tileX < TileSize) && (tileY < TileSize)) {
+			traffic_.nbrSharedReads++;
+			depth = tileDepth_[tileY*TileSize + tileX];
+			return tileInvalid_[tileY*TileSize + tileX] == 0.f;
+		}
+
+		traffic_.nbrReads++;
+		if (pointsMap[curY*width_ + curX].w >= KnownPoint) {
+			traffic_.nbrReads++;
+			depth = depthMap[curY*width_ + curX].w;
+			return true;
+		}
+
+		return false;
+	};
+
+	for (int groupY = 0; groupY < nbrGroupsY; groupY++) {
+		for (int groupX = 0; groupX < nbrGroupsX; groupX++) {
+			loadTile(groupX, groupY, depthMap, pointsMap, params.radius);
+
+			for (int localY = 0; localY < GroupSize; localY++) {
+				for (int localX = 0; localX < GroupSize; localX++) {
+					int x = groupX*GroupSize + localX;
+					int y = groupY*GroupSize + localY;
+					if ((x >= width_) || (y >= height_))
+						continue;
+
+					size_t idx = y*width_ + x;
+					glm::vec4 pointsData = pointsMap[idx];
+					glm::vec4 depthData = depthMap[idx];
+					traffic_.nbrReads += 2;
+
+					float flags = 0.f;
+					if ((x > 0) && (y > 0) && (x < (width_ - 1)) && (y < (height_ - 1))) {
+						flags = pointsData.w;
+						if ((flags != 0.f) && isReliable(x, y, localX, localY, depthData, params))
+							flags += ReliablePoint;
+					}
+
+					if (flags >= KnownPoint) {
+						pointsData.w = flags;
+						pointsOut[idx] = pointsData;
+						depthOut[idx] = depthData;
+						traffic_.nbrWrites += 2;
+						continue;
+					}
+
+					// The pixels left unfilled keep the initialized point
+					pointsOut[idx] = pointsData;
+					traffic_.nbrWrites++;
+
+					fillHole(x, y, colorImage, colorWidth, colorHeight, ptMapping, params, isKnown, depthOut[idx], pointsOut[idx]);
+				}
+			}
+		}
+	}
+}
+
+void DepthPreprocess::runMultiPass(const glm::vec4* depthMap, glm::vec4* pointsMap, const glm::vec4* colorImage, int colorWidth, int colorHeight,
+	const glm::vec2* ptMapping, const DepthPreprocessParams& params, glm::vec4* depthOut, glm::vec4* pointsTmp) {
+	traffic_ = ImageTraffic();
+	traffic_.nbrDispatches = 2;
+
+	int nbrGroupsX = (width_ + GroupSize - 1) / GroupSize;
+	int nbrGroupsY = (height_ + GroupSize - 1) / GroupSize;
+
+	// Mark points as reliable
+	for (int groupY = 0; groupY < nbrGroupsY; groupY++) {
+		for (int groupX = 0; groupX < nbrGroupsX; groupX++) {
+			loadTile(groupX, groupY, depthMap, pointsMap, params.radius);
+
+			for (int localY = 0; localY < GroupSize; localY++) {
+				for (int localX = 0; localX < GroupSize; localX++) {
+					int x = groupX*GroupSize + localX;
+					int y = groupY*GroupSize + localY;
+					if ((x <= 0) || (y <= 0) || (x >= (width_ - 1)) || (y >= (height_ - 1)))
+						continue;
+
+					size_t idx = y*width_ + x;
+					glm::vec4 pointsData = pointsMap[idx];
+					pointsTmp[idx] = pointsData;
+					traffic_.nbrReads++;
+					traffic_.nbrWrites++;
+
+					if ((x < params.radius) || (x >= (width_ - params.radius)) || (y < params.radius) || (y >= (height_ - params.radius)))
+						continue;
+					if (pointsData.w == 0.f) // Unknown point
+						continue;
+
+					traffic_.nbrReads++;
+					if (isReliable(x, y, localX, localY, depthMap[idx], params)) {
+						pointsData.w += ReliablePoint;
+						pointsTmp[idx] = pointsData;
+						traffic_.nbrWrites++;
+					}
+				}
+			}
+		}
+	}
+
+	// Fill holes
+	auto isKnown = [&](int curX, int curY, float& depth) -> bool {
+		traffic_.nbrReads++;
+		if (pointsTmp[curY*width_ + curX].w >= KnownPoint) {
+			traffic_.nbrReads++;
+			depth = depthMap[curY*width_ + curX].w;
+			return true;
+		}
+
+		return false;
+	};
+
+	for (int y = 0; y < height_; y++) {
+		for (int x = 0; x < width_; x++) {
+			size_t idx = y*width_ + x;
+
+			traffic_.nbrReads++;
+			if (pointsTmp[idx].w >= KnownPoint) { // Known, no need to do anything
+				pointsMap[idx] = pointsTmp[idx];
+				depthOut[idx] = depthMap[idx];
+				traffic_.nbrReads += 2;
+				traffic_.nbrWrites += 2;
+				continue;
+			}
+
+			fillHole(x, y, colorImage, colorWidth, colorHeight, ptMapping, params, isKnown, depthOut[idx], pointsMap[idx]);
+		}
+	}
+}
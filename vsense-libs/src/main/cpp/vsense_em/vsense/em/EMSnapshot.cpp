@@ -0,0 +1,617 @@
+#include <vsense/em/EMSnapshot.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+using namespace vsense;
+using namespace vsense::em;
+
+const uint64_t HashOffset = 14695981039346656037ULL; // FNV-1a
+const uint64_t HashPrime = 1099511628211ULL;
+
+const uint32_t MaxRunLength = 0xFFFF;
+
+/*
+ * Region of a plane covered by a tile.
+ */
+struct TileRect {
+	uint32_t x0; /*!< First column. */
+	uint32_t y0; /*!< First row. */
+	uint32_t x1; /*!< Column after the last one. */
+	uint32_t y1; /*!< Row after the last one. */
+};
+
+/*
+ * Calculates the region covered by a tile.
+ * @param tile Index of the tile.
+ * @param width Plane width.
+ * @param height Plane height.
+ * @param tileSize Size in texels of the tiles.
+ * @return Region of the tile.
+ */
+inline TileRect tileRect(size_t tile, uint32_t width, uint32_t height, uint32_t tileSize) {
+	uint32_t tilesX = (width + tileSize - 1) / tileSize;
+
+	TileRect rect;
+	rect.x0 = (uint32_t)(tile % tilesX)*tileSize;
+	rect.y0 = (uint32_t)(tile / tilesX)*tileSize;
+	rect.x1 = std::min(rect.x0 + tileSize, width);
+	rect.y1 = std::min(rect.y0 + tileSize, height);
+
+	return rect;
+}
+
+/*
+ * Calculates the number of tiles of a plane.
+ * @param width Plane width.
+ * @param height Plane height.
+ * @param tileSize Size in texels of the tiles.
+ * @return Number of tiles.
+ */
+inline size_t nbrTiles(uint32_t width, uint32_t height, uint32_t tileSize) {
+	return (size_t)((width + tileSize - 1) / tileSize)*((height + tileSize - 1) / tileSize);
+}
+
+/*
+ * Mixes a word so every bit of it reaches every bit of the hash (splitmix64 finalizer), with the multiplication alone
+ * the top bit of a word only reaches the top bit of the hash and two changes of it cancel out.
+ * @param word Word.
+ * @return Mixed word.
+ */
+inline uint64_t mixWord(uint64_t word) {
+	word = (word ^ (word >> 30))*0xBF58476D1CE4E5B9ULL;
+	word = (word ^ (word >> 27))*0x94D049BB133111EBULL;
+
+	return word ^ (word >> 31);
+}
+
+/*
+ * Calculates the hash of a tile, 8 bytes at a time.
+ * @param plane Plane.
+ * @param width Plane width.
+ * @param rect Region of the tile.
+ * @return Hash.
+ */
+uint64_t hashTile(const SnapshotPlane& plane, uint32_t width, const TileRect& rect) {
+	uint64_t hash = HashOffset;
+	size_t rowBytes = (size_t)(rect.x1 - rect.x0)*plane.elementSize;
+
+	for (uint32_t y = rect.y0; y < rect.y1; y++) {
+		const uint8_t* ptr = plane.data.data() + ((size_t)y*width + rect.x0)*plane.elementSize;
+
+		size_t i = 0;
+		for (; i + sizeof(uint64_t) <= rowBytes; i += sizeof(uint64_t)) {
+			uint64_t word;
+			memcpy(&word, ptr + i, sizeof(uint64_t));
+			hash = mixWord(hash ^ word);
+		}
+		for (; i < rowBytes; i++)
+			hash = (hash ^ ptr[i])*HashPrime;
+	}
+
+	return hash;
+}
+
+/*
+ * Appends a value to a buffer.
+ * @param buffer Buffer.
+ * @param data Pointer to the value.
+ * @param size Size in bytes.
+ */
+inline void append(std::vector<uint8_t>& buffer, const void* data, size_t size) {
+	const uint8_t* bytes = (const uint8_t*)data;
+	buffer.insert(buffer.end(), bytes, bytes + size);
+}
+
+/*
+ * Encodes a tile as runs of empty texels and of literal values: number of empty texels and number of literals (16 bits
+ * each) followed by the literals.
+ * @param plane Plane.
+ * @param width Plane width.
+ * @param rect Region of the tile.
+ * @param buffer Buffer the runs are appended to.
+ * @param isEmpty Functor checking if a texel is empty.
+ * @return True if every texel of the tile is empty.
+ */
+template <typename IsEmpty>
+bool encodeRuns(const SnapshotPlane& plane, uint32_t width, const TileRect& rect, std::vector<uint8_t>& buffer, IsEmpty isEmpty) {
+	size_t elementSize = plane.elementSize;
+	uint16_t run[2] = { 0, 0 };
+	size_t header = buffer.size();
+	append(buffer, run, sizeof(run));
+
+	bool allEmpty = true;
+	for (uint32_t y = rect.y0; y < rect.y1; y++) {
+		const uint8_t* row = plane.data.data() + ((size_t)y*width + rect.x0)*elementSize;
+		uint32_t tileWidth = rect.x1 - rect.x0;
+
+		uint32_t x = 0;
+		while (x < tileWidth) {
+			if (isEmpty(row + x*elementSize)) {
+				if (run[1] || run[0] == MaxRunLength) { // New run
+					memcpy(buffer.data() + header, run, sizeof(run));
+					run[0] = run[1] = 0;
+					header = buffer.size();
+					append(buffer, run, sizeof(run));
+				}
+				run[0]++;
+				x++;
+			} else {
+				if (run[1] == MaxRunLength) {
+					memcpy(buffer.data() + header, run, sizeof(run));
+					run[0] = run[1] = 0;
+					header = buffer.size();
+					append(buffer, run, sizeof(run));
+				}
+
+				// The literals of a row are copied at once
+				uint32_t start = x;
+				while (x < tileWidth && run[1] < MaxRunLength && !isEmpty(row + x*elementSize)) {
+					run[1]++;
+					x++;
+				}
+				append(buffer, row + start*elementSize, (x - start)*elementSize);
+				allEmpty = false;
+			}
+		}
+	}
+
+	memcpy(buffer.data() + header, run, sizeof(run));
+
+	return allEmpty;
+}
+
+/*
+ * Encodes a tile, comparing the texels with the empty value for the usual element sizes without calling memcmp.
+ * @param plane Plane.
+ * @param width Plane width.
+ * @param rect Region of the tile.
+ * @param buffer Buffer the runs are appended to.
+ * @return True if every texel of the tile is empty.
+ */
+bool encodeTile(const SnapshotPlane& plane, uint32_t width, const TileRect& rect, std::vector<uint8_t>& buffer) {
+	const uint8_t* empty = plane.empty.data();
+
+	switch (plane.elementSize) {
+	case 1:
+		return encodeRuns(plane, width, rect, buffer, [=](const uint8_t* ptr) { return *ptr == *empty; });
+	case 4:
+		return encodeRuns(plane, width, rect, buffer, [=](const uint8_t* ptr) { return !memcmp(ptr, empty, 4); });
+	case 12:
+		return encodeRuns(plane, width, rect, buffer, [=](const uint8_t* ptr) { return !memcmp(ptr, empty, 12); });
+	case 16:
+		return encodeRuns(plane, width, rect, buffer, [=](const uint8_t* ptr) { return !memcmp(ptr, empty, 16); });
+	default:
+		size_t elementSize = plane.elementSize;
+		return encodeRuns(plane, width, rect, buffer, [=](const uint8_t* ptr) { return !memcmp(ptr, empty, elementSize); });
+	}
+}
+
+/*
+ * Fills a buffer with the empty value of a plane.
+ * @param plane Plane.
+ * @param data Pointer to the buffer.
+ * @param count Number of texels.
+ */
+void fillEmpty(const SnapshotPlane& plane, uint8_t* data, size_t count) {
+	if (!count)
+		return;
+
+	// The filled part is doubled every copy
+	size_t size = count*plane.elementSize;
+	memcpy(data, plane.empty.data(), plane.elementSize);
+	for (size_t filled = plane.elementSize; filled < size; filled *= 2)
+		memcpy(data + filled, data, std::min(filled, size - filled));
+}
+
+/*
+ * Decodes a tile encoded by encodeTile.
+ * @param plane Plane, NULL to only check the runs.
+ * @param elementSize Size in bytes of the value of a texel.
+ * @param width Plane width.
+ * @param rect Region of the tile.
+ * @param data Pointer to the runs.
+ * @param size Size in bytes of the runs.
+ * @param emptyRow Row of empty texels as wide as the tile.
+ * @return True if the runs cover the tile exactly.
+ */
+bool decodeTile(SnapshotPlane* plane, size_t elementSize, uint32_t width, const TileRect& rect, const uint8_t* data, size_t size, const uint8_t* emptyRow) {
+	uint32_t tileWidth = rect.x1 - rect.x0;
+
+	uint32_t x = 0;
+	uint32_t y = rect.y0;
+	const uint8_t* end = data + size;
+	while (data < end) {
+		uint16_t run[2];
+		if ((size_t)(end - data) < sizeof(run))
+			return false;
+		memcpy(run, data, sizeof(run));
+		data += sizeof(run);
+
+		if ((size_t)(end - data) < (size_t)run[1] * elementSize)
+			return false;
+
+		// Empty texels then literals, split at the end of the rows of the tile
+		for (int part = 0; part < 2; part++) {
+			uint32_t count = run[part];
+			while (count) {
+				if (y >= rect.y1)
+					return false;
+
+				uint32_t nbr = std::min(count, tileWidth - x);
+				if (plane) {
+					uint8_t* dst = plane->data.data() + ((size_t)y*width + rect.x0 + x)*elementSize;
+					memcpy(dst, part == 0 ? emptyRow : data, nbr*elementSize);
+				}
+				if (part == 1)
+					data += nbr*elementSize;
+
+				count -= nbr;
+				x += nbr;
+				if (x == tileWidth) {
+					x = 0;
+					y++;
+				}
+			}
+		}
+	}
+
+	return x == 0 && y == rect.y1;
+}
+
+/*
+ * Reads a value from a buffer.
+ * @param ptr Pointer to the data, moved after the value.
+ * @param end Pointer after the last byte of the buffer.
+ * @param value Pointer to the value.
+ * @param size Size in bytes.
+ * @return True if the buffer holds the value.
+ */
+inline bool extract(const uint8_t*& ptr, const uint8_t* end, void* value, size_t size) {
+	if ((size_t)(end - ptr) < size)
+		return false;
+
+	memcpy(value, ptr, size);
+	ptr += size;
+
+	return true;
+}
+
+EMSnapshot::EMSnapshot() : width_(0), height_(0), sequence_(0), origin_(0.f), corrMtx_(1.f), frameIdx_(0) {
+
+}
+
+void EMSnapshot::reset(uint32_t width, uint32_t height) {
+	width_ = width;
+	height_ = height;
+	planes_.clear();
+}
+
+void EMSnapshot::addPlane(uint32_t id, uint32_t elementSize, const void* empty, const void* data) {
+	SnapshotPlane plane;
+	plane.id = id;
+	plane.elementSize = elementSize;
+	plane.empty.assign((const uint8_t*)empty, (const uint8_t*)empty + elementSize);
+	plane.data.assign((const uint8_t*)data, (const uint8_t*)data + (size_t)width_*height_*elementSize);
+
+	for (size_t i = 0; i < planes_.size(); i++) {
+		if (planes_[i].id == id) {
+			planes_[i].elementSize = elementSize;
+			planes_[i].empty.swap(plane.empty);
+			planes_[i].data.swap(plane.data);
+			return;
+		}
+	}
+
+	planes_.push_back(plane);
+}
+
+const SnapshotPlane* EMSnapshot::getPlane(uint32_t id) const {
+	for (size_t i = 0; i < planes_.size(); i++) {
+		if (planes_[i].id == id)
+			return &planes_[i];
+	}
+
+	return NULL;
+}
+
+bool EMSnapshot::read(const std::string& filename) {
+	std::ifstream file(filename, std::ios::in | std::ios::binary | std::ios::ate);
+	if (!file.is_open()) {
+		std::cout << "Unable to open " << filename << std::endl;
+		return false;
+	}
+
+	// The whole file is parsed from memory
+	std::vector<uint8_t> buffer((size_t)file.tellg());
+	file.seekg(0);
+	file.read((char*)buffer.data(), buffer.size());
+	if (!file) {
+		std::cout << "Unable to read " << filename << std::endl;
+		return false;
+	}
+
+	// Checked before anything is modified, so the content is left unchanged on errors without decoding on a copy
+	if (!parse(buffer, filename, false))
+		return false;
+
+	return parse(buffer, filename, true);
+}
+
+bool EMSnapshot::parse(const std::vector<uint8_t>& buffer, const std::string& filename, bool apply) {
+	const uint8_t* ptr = buffer.data();
+	const uint8_t* end = ptr + buffer.size();
+
+	uint32_t header[8]; // Magic, version, flags, sequence, base sequence, width, height, tile size
+	if (!extract(ptr, end, header, sizeof(header)) || header[0] != EMSnapshotMagic) {
+		std::cout << filename << " is not an EM snapshot" << std::endl;
+		return false;
+	}
+	if (header[1] != EMSnapshotVersion) {
+		std::cout << "Unsupported EM snapshot version: " << header[1] << std::endl;
+		return false;
+	}
+
+	bool delta = (header[2] & SnapshotDelta) != 0;
+	uint32_t width = header[5];
+	uint32_t height = header[6];
+	uint32_t tileSize = header[7];
+	if (tileSize == 0) {
+		std::cout << "Invalid tile size in " << filename << std::endl;
+		return false;
+	}
+	if (delta && (header[4] != sequence_ || width != width_ || height != height_)) {
+		std::cout << filename << " is not based on the current EM snapshot" << std::endl;
+		return false;
+	}
+
+	glm::vec3 origin;
+	glm::mat3 corrMtx;
+	uint32_t frameIdx, nbrCoeffs;
+	if (!extract(ptr, end, &origin[0], sizeof(float) * 3) || !extract(ptr, end, &corrMtx[0][0], sizeof(float) * 9) ||
+		!extract(ptr, end, &frameIdx, sizeof(uint32_t)) || !extract(ptr, end, &nbrCoeffs, sizeof(uint32_t)) ||
+		(size_t)(end - ptr) < (size_t)nbrCoeffs*sizeof(glm::vec4)) {
+		std::cout << "Truncated EM snapshot: " << filename << std::endl;
+		return false;
+	}
+	const uint8_t* coeffs = ptr;
+	ptr += nbrCoeffs*sizeof(glm::vec4);
+
+	uint32_t nbrPlanes;
+	if (!extract(ptr, end, &nbrPlanes, sizeof(uint32_t))) {
+		std::cout << "Truncated EM snapshot: " << filename << std::endl;
+		return false;
+	}
+
+	if (apply) {
+		width_ = width;
+		height_ = height;
+		sequence_ = header[3];
+		origin_ = origin;
+		corrMtx_ = corrMtx;
+		frameIdx_ = frameIdx;
+		shCoeffs_.resize(nbrCoeffs);
+		memcpy(shCoeffs_.data(), coeffs, nbrCoeffs*sizeof(glm::vec4));
+	}
+
+	// A full snapshot keeps the storage of the planes it still holds
+	std::vector<SnapshotPlane> oldPlanes;
+	if (apply && !delta)
+		oldPlanes.swap(planes_);
+
+	size_t tiles = nbrTiles(width, height, tileSize);
+	std::vector<uint8_t> emptyRow;
+	for (uint32_t p = 0; p < nbrPlanes; p++) {
+		uint32_t planeHeader[2]; // Identifier, element size
+		if (!extract(ptr, end, planeHeader, sizeof(planeHeader)) || planeHeader[1] == 0 || (size_t)(end - ptr) < planeHeader[1]) {
+			std::cout << "Truncated EM snapshot: " << filename << std::endl;
+			return false;
+		}
+		const uint8_t* empty = ptr;
+		ptr += planeHeader[1];
+
+		SnapshotPlane* plane = NULL;
+		if (delta) {
+			for (size_t i = 0; i < planes_.size(); i++) {
+				if (planes_[i].id == planeHeader[0])
+					plane = &planes_[i];
+			}
+
+			if (!plane || plane->elementSize != planeHeader[1] || memcmp(plane->empty.data(), empty, planeHeader[1])) {
+				std::cout << filename << " doesn't match the planes of the current EM snapshot" << std::endl;
+				return false;
+			}
+		} else if (apply) {
+			SnapshotPlane newPlane;
+			for (size_t i = 0; i < oldPlanes.size(); i++) {
+				if (oldPlanes[i].id == planeHeader[0])
+					newPlane.data.swap(oldPlanes[i].data);
+			}
+			newPlane.id = planeHeader[0];
+			newPlane.elementSize = planeHeader[1];
+			newPlane.empty.assign(empty, empty + planeHeader[1]);
+
+			// The tiles not stored are empty
+			newPlane.data.resize((size_t)width*height*newPlane.elementSize);
+			fillEmpty(newPlane, newPlane.data.data(), (size_t)width*height);
+
+			planes_.push_back(SnapshotPlane());
+			planes_.back().id = newPlane.id;
+			planes_.back().elementSize = newPlane.elementSize;
+			planes_.back().empty.swap(newPlane.empty);
+			planes_.back().data.swap(newPlane.data);
+			plane = &planes_.back();
+		}
+
+		uint32_t nbrStored;
+		if (!extract(ptr, end, &nbrStored, sizeof(uint32_t))) {
+			std::cout << "Truncated EM snapshot: " << filename << std::endl;
+			return false;
+		}
+
+		if (!apply)
+			plane = NULL;
+		else {
+			emptyRow.resize((size_t)tileSize*plane->elementSize);
+			fillEmpty(*plane, emptyRow.data(), tileSize);
+		}
+
+		for (uint32_t t = 0; t < nbrStored; t++) {
+			uint32_t tileHeader[2]; // Index, size in bytes
+			if (!extract(ptr, end, tileHeader, sizeof(tileHeader)) || tileHeader[0] >= tiles || (size_t)(end - ptr) < tileHeader[1] ||
+				!decodeTile(plane, planeHeader[1], width, tileRect(tileHeader[0], width, height, tileSize), ptr, tileHeader[1], emptyRow.data())) {
+				std::cout << "Corrupted EM snapshot: " << filename << std::endl;
+				return false;
+			}
+			ptr += tileHeader[1];
+		}
+	}
+
+	return true;
+}
+
+SnapshotWriter::SnapshotWriter(uint32_t tileSize) : tileSize_(std::max(tileSize, 1u)), hasBase_(false), sequence_(0), width_(0), height_(0) {
+
+}
+
+void SnapshotWriter::reset() {
+	hasBase_ = false;
+	sequence_ = 0;
+	layout_.clear();
+	hashes_.clear();
+}
+
+void SnapshotWriter::setBase(const EMSnapshot& snapshot) {
+	hashTiles(snapshot, hashes_);
+
+	layout_.clear();
+	for (size_t p = 0; p < snapshot.getPlanes().size(); p++)
+		layout_.push_back(std::make_pair(snapshot.getPlanes()[p].id, snapshot.getPlanes()[p].elementSize));
+
+	width_ = snapshot.getWidth();
+	height_ = snapshot.getHeight();
+	sequence_ = snapshot.getSequence();
+	hasBase_ = true;
+}
+
+void SnapshotWriter::hashTiles(const EMSnapshot& snapshot, std::vector<std::vector<uint64_t>>& hashes) const {
+	size_t tiles = nbrTiles(snapshot.getWidth(), snapshot.getHeight(), tileSize_);
+	const std::vector<SnapshotPlane>& planes = snapshot.getPlanes();
+
+	hashes.resize(planes.size());
+	for (size_t p = 0; p < planes.size(); p++) {
+		hashes[p].resize(tiles);
+		for (size_t tile = 0; tile < tiles; tile++)
+			hashes[p][tile] = hashTile(planes[p], snapshot.getWidth(), tileRect(tile, snapshot.getWidth(), snapshot.getHeight(), tileSize_));
+	}
+}
+
+bool SnapshotWriter::matchesBase(const EMSnapshot& snapshot) const {
+	if (!hasBase_ || snapshot.getWidth() != width_ || snapshot.getHeight() != height_ || snapshot.getPlanes().size() != layout_.size())
+		return false;
+
+	for (size_t p = 0; p < layout_.size(); p++) {
+		if (snapshot.getPlanes()[p].id != layout_[p].first || snapshot.getPlanes()[p].elementSize != layout_[p].second)
+			return false;
+	}
+
+	return true;
+}
+
+bool SnapshotWriter::write(const std::string& filename, const EMSnapshot& snapshot, bool delta) {
+	std::chrono::high_resolution_clock::time_point t = std::chrono::high_resolution_clock::now();
+
+	delta = delta && matchesBase(snapshot);
+
+	uint32_t width = snapshot.getWidth();
+	uint32_t height = snapshot.getHeight();
+	uint32_t sequence = hasBase_ ? sequence_ + 1 : 0;
+	size_t tiles = nbrTiles(width, height, tileSize_);
+
+	std::vector<std::vector<uint64_t>> hashes;
+	hashTiles(snapshot, hashes);
+
+	std::vector<uint8_t> buffer;
+	uint32_t header[8] = { EMSnapshotMagic, EMSnapshotVersion, delta ? SnapshotDelta : 0, sequence, sequence_, width, height, tileSize_ };
+	append(buffer, header, sizeof(header));
+
+	uint32_t nbrCoeffs = (uint32_t)snapshot.getSHCoefficients().size();
+	append(buffer, &snapshot.getOrigin()[0], sizeof(float) * 3);
+	append(buffer, &snapshot.getCorrectionMatrix()[0][0], sizeof(float) * 9);
+	uint32_t frameIdx = snapshot.getFrameIndex();
+	append(buffer, &frameIdx, sizeof(uint32_t));
+	append(buffer, &nbrCoeffs, sizeof(uint32_t));
+	if (nbrCoeffs)
+		append(buffer, snapshot.getSHCoefficients().data(), nbrCoeffs*sizeof(glm::vec4));
+
+	const std::vector<SnapshotPlane>& planes = snapshot.getPlanes();
+	uint32_t nbrPlanes = (uint32_t)planes.size();
+	append(buffer, &nbrPlanes, sizeof(uint32_t));
+
+	SnapshotStats stats;
+	stats.nbrTiles = tiles;
+	stats.delta = delta;
+
+	std::vector<uint8_t> runs;
+	for (size_t p = 0; p < planes.size(); p++) {
+		const SnapshotPlane& plane = planes[p];
+		stats.rawBytes += plane.data.size();
+
+		uint32_t planeHeader[2] = { plane.id, plane.elementSize };
+		append(buffer, planeHeader, sizeof(planeHeader));
+		append(buffer, plane.empty.data(), plane.elementSize);
+
+		size_t countPos = buffer.size();
+		uint32_t nbrStored = 0;
+		append(buffer, &nbrStored, sizeof(uint32_t));
+
+		for (size_t tile = 0; tile < tiles; tile++) {
+			if (delta && hashes[p][tile] == hashes_[p][tile])
+				continue;
+
+			// The empty tiles are only stored to clear them in a delta
+			runs.clear();
+			if (encodeTile(plane, width, tileRect(tile, width, height, tileSize_), runs) && !delta)
+				continue;
+
+			uint32_t tileHeader[2] = { (uint32_t)tile, (uint32_t)runs.size() };
+			append(buffer, tileHeader, sizeof(tileHeader));
+			append(buffer, runs.data(), runs.size());
+			nbrStored++;
+		}
+
+		memcpy(buffer.data() + countPos, &nbrStored, sizeof(uint32_t));
+		stats.nbrWritten += nbrStored;
+	}
+
+	std::ofstream file(filename, std::ios::out | std::ios::binary);
+	if (!file.is_open()) {
+		std::cout << "Unable to open " << filename << std::endl;
+		return false;
+	}
+	file.write((const char*)buffer.data(), buffer.size());
+	if (!file) {
+		std::cout << "Unable to write " << filename << std::endl;
+		return false;
+	}
+
+	// The file written is the base of the next delta
+	hashes_.swap(hashes);
+	layout_.clear();
+	for (size_t p = 0; p < planes.size(); p++)
+		layout_.push_back(std::make_pair(planes[p].id, planes[p].elementSize));
+	width_ = width;
+	height_ = height;
+	sequence_ = sequence;
+	hasBase_ = true;
+
+	stats.fileBytes = buffer.size();
+	std::chrono::duration<float, std::milli> elapsed = std::chrono::high_resolution_clock::now() - t;
+	stats.ms = elapsed.count();
+	stats_ = stats;
+
+	return true;
+}
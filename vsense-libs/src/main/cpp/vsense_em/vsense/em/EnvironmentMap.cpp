@@ -6,8 +6,10 @@
 
 #include <iostream>
 #include <algorithm>
+#include <cstring>
 #include <fstream>
 #include <iomanip>
+#include <chrono>
 #include <time.h>
 
 using namespace vsense;
@@ -34,6 +36,7 @@ float EnvironmentMap::maxError_ = 0.1f;
 int EnvironmentMap::minNbrPoints_ = 100;
 bool EnvironmentMap::colorCorrection_ = true;
 float EnvironmentMap::maxAllowedWarpDif_ = 0.01f;
+bool EnvironmentMap::trackCoverage_ = true;
 
 const int NeighborPixels = 2;
 
@@ -44,7 +47,14 @@ const int Precision = 18;
 #define CHECK_RELIABLE_REFERENCE
 #define CHECK_RELIABLE_CURRENT
 
-EnvironmentMap::EnvironmentMap(const glm::vec3& origin) : origin_(origin), isEmpty_(true), depthRange_(FLT_MAX, -FLT_MAX), lastError_(-1.f) {
+#ifdef CHECK_EM_UNIFORM
+bool EnvironmentMap::checkUniformity_ = true;
+#else
+bool EnvironmentMap::checkUniformity_ = false;
+#endif
+
+EnvironmentMap::EnvironmentMap(const glm::vec3& origin) : origin_(origin), isEmpty_(true), uniformMask_(1, MaxVariance), frameIdx_(0), depthRange_(FLT_MAX, -FLT_MAX),
+	lastError_(-1.f), nbrSamples_(0), samplesCapacity_(0), lastNbrNewPixels_(0), lastCorrectionTime_(0.f) {
 
 }
 
@@ -55,7 +65,7 @@ void EnvironmentMap::clearEM() {
 bool EnvironmentMap::addDepthMapFrame(const depth::DepthMap* dm, bool projectPts, bool renderImage) {
 #ifdef _WINDOWS
 	clock_t t = clock();
-  uint16_t discardedNotUniform = 0;
+  uint32_t discardedNotUniform = 0;
 #endif
 
 	if (isEmpty_) { // Initializing maps
@@ -75,11 +85,26 @@ bool EnvironmentMap::addDepthMapFrame(const depth::DepthMap* dm, bool projectPts
 
 		memset(flags_.get(), 0, sizeof(uchar)*width_*height_);
 
-		lastSamples_.reset(new EMSample[depth::DepthMap::width()*depth::DepthMap::height()], std::default_delete<EMSample[]>());
+		resetUniformityMask();
+		resetCoverage();
+	} else if (checkUniformity_ && uniformMask_.isEmpty()) // The check was enabled after the maps were allocated
+		resetUniformityMask();
+
+	// The upsampled depth map is used when available (see DepthMap::setUpsamplingColorFraction)
+	const depth::DepthPoint* dataPtr = dm->getDataPtr();
+	size_t nbrPixels = depth::DepthMap::nbrPixels();
+	if (dm->getUpsampledDataPtr()) {
+		dataPtr = dm->getUpsampledDataPtr();
+		nbrPixels = dm->nbrUpsampledPixels();
+	}
+
+	if (samplesCapacity_ < nbrPixels) {
+		lastSamples_.reset(new EMSample[nbrPixels], std::default_delete<EMSample[]>());
+		samplesCapacity_ = nbrPixels;
 	}
 	
 	const float* pose = &(*dm->getPose())[0][0];
-	const depth::DepthPoint* curPt = dm->getDataPtr() - 1;
+	const depth::DepthPoint* curPt = dataPtr - 1;
 
 	glm::vec3 ptDir;
 	glm::vec3 ptPos;
@@ -92,12 +117,11 @@ bool EnvironmentMap::addDepthMapFrame(const depth::DepthMap* dm, bool projectPts
 	glm::vec3 devDir(pose[8], pose[9], pose[10]);
 	devDir = glm::normalize(devDir);	
 
-	uint16_t totalPts = 0;
+	uint32_t totalPts = 0;
 	nbrSamples_ = 0;
 
 	EMSample* samplesPtr = lastSamples_.get();
 
-	size_t nbrPixels = depth::DepthMap::nbrPixels();
 	for(size_t k = 0; k < nbrPixels; k++) {
 		totalPts++;
 
@@ -149,8 +173,7 @@ bool EnvironmentMap::addDepthMapFrame(const depth::DepthMap* dm, bool projectPts
 			sample.refColor = *(color_.get() + sample.uvOffset);
 			sample.refDepth = *(depth_.get() + sample.uvOffset);
 
-#ifdef CHECK_EM_UNIFORM
-			if (sample.refDepth >= 0) {
+			if (checkUniformity_ && (sample.refDepth >= 0)) {
 				if (!isEMNeighborhoodUniform(sample)) {
 #ifdef _WINDOWS
 					discardedNotUniform++;
@@ -158,7 +181,6 @@ bool EnvironmentMap::addDepthMapFrame(const depth::DepthMap* dm, bool projectPts
 					continue;
 				}
 			}
-#endif
 
 			sample.refIsReliable = *(flags_.get() + sample.uvOffset) != 0;
 			sample.curIsReliable = (curPt->flags == pc::ReliableKnownPoint);
@@ -172,16 +194,25 @@ bool EnvironmentMap::addDepthMapFrame(const depth::DepthMap* dm, bool projectPts
 	system("cls");
 	std::cout << "Total points: " << totalPts << std::endl;
 	std::cout << "Discarded Non-Uniform: " << discardedNotUniform << std::endl;
+	if (dataPtr != dm->getDataPtr())
+		std::cout << "Upsampling time: " << dm->getLastUpsamplingTime() << "ms" << std::endl;
 
 	t = clock() - t;
 	lastElapsedTime_ = (float) t / CLOCKS_PER_SEC;
 #endif
 
 	glm::mat3 corrMtx;
+	lastCorrectionTime_ = 0.f;
 	if (!isEmpty_ && colorCorrection_) {
-		if (calculateCorrectionMtx()) {
+		std::chrono::high_resolution_clock::time_point tCorr = std::chrono::high_resolution_clock::now();
+		bool isValid = calculateCorrectionMtx();
+		if (isValid)
 			lastError_ = calculateError();
 
+		std::chrono::duration<float, std::milli> elapsed = std::chrono::high_resolution_clock::now() - tCorr;
+		lastCorrectionTime_ = elapsed.count();
+
+		if (isValid) {
 			if (lastError_ > maxError_)
 				return false;
 		} else {
@@ -193,6 +224,10 @@ bool EnvironmentMap::addDepthMapFrame(const depth::DepthMap* dm, bool projectPts
 	if (!projectPts)
 		return true;
 
+	if (frameIdx_ >= CoverageMaxFrame) // Restarts the ages rather than overflowing them
+		resetCoverage();
+	frameIdx_++;
+
 	projectPoints(distToDev);
 	isEmpty_ = false;
 
@@ -210,12 +245,13 @@ bool EnvironmentMap::calculateCorrectionMtx() {
 	glm::vec3 wRef(0.f, 0.f, 0.f);
 
 	lastNbrUsedPts_ = 0;
+	lastMoments_ = ColorMoments();
 
 #ifdef _WINDOWS
-	uint16_t discNoRef = 0;
-	uint16_t discLargeDepthDelta = 0;
-	uint16_t discCurUnreliable = 0;
-	uint16_t discRefUnreliable = 0;
+	uint32_t discNoRef = 0;
+	uint32_t discLargeDepthDelta = 0;
+	uint32_t discCurUnreliable = 0;
+	uint32_t discRefUnreliable = 0;
 #endif
 
 	EMSample* pSample = lastSamples_.get() - 1;
@@ -258,6 +294,8 @@ bool EnvironmentMap::calculateCorrectionMtx() {
 			continue;
 		}
 
+		lastMoments_.add(pSample->curColor, pSample->refColor);
+
 #ifdef WITH_EXTRA
 		glm::vec3 curHSV = color::Color::rgb2hsv(pSample->curColor);
 		glm::vec3 refHSV = color::Color::rgb2hsv(pSample->refColor);
@@ -384,6 +422,7 @@ void EnvironmentMap::asSHCoefficients(std::shared_ptr<sh::SHCoefficients3>& coef
 
 void EnvironmentMap::projectPoints(float distToDev) {
 	size_t nbrAdded = 0;
+	lastNbrNewPixels_ = 0;
 	EMSample* sample = lastSamples_.get() - 1;
 	glm::vec3* colorPtr = color_.get();
 	float* depthPtr = depth_.get();
@@ -414,8 +453,14 @@ void EnvironmentMap::projectPoints(float distToDev) {
 		}
 
 		*(colorPtr + sample->uvOffset) = sample->curColor;
+		uniformMask_.invalidate(sample->uvOffset);
+		if (trackCoverage_)
+			coverage_.observe(sample->uvOffset, frameIdx_);
 
     float* curDepthPtr = depthPtr + sample->uvOffset;
+		if (*curDepthPtr < 0.f)
+			lastNbrNewPixels_++;
+
 		if(sample->refDepth < 0.f)
 			*curDepthPtr = sample->curDepth;
 		else
@@ -437,34 +482,27 @@ void EnvironmentMap::projectPoints(float distToDev) {
 	std::cout << "Added: " << nbrAdded << "/" << nbrSamples_ << std::endl;
 }
 
-float EnvironmentMap::calculateError() {
-	float meanError = 0.f;
-
-	size_t nbrPts = 0;
-	const EMSample* pSample = lastSamples_.get() - 1;
-	for (size_t i = 0; i < nbrSamples_; i++) {
-		++pSample;
-
-		if (!pSample->used) // Not used for calibration
-			continue;
-		
-		meanError += getSquaredError(*pSample);
+float EnvironmentMap::getCoverage() const {
+	if (!depth_ || isEmpty_)
+		return 0.f;
 
-		nbrPts++;
+	size_t nbrFilled = 0;
+	const float* depthPtr = depth_.get();
+	for (size_t i = 0; i < width_*height_; i++) {
+		if (depthPtr[i] >= 0.f)
+			nbrFilled++;
 	}
 
-	meanError /= nbrPts;
+	return (float)nbrFilled / (width_*height_);
+}
+
+float EnvironmentMap::calculateError() {
+	float meanError = (float)lastMoments_.meanSquaredError(lastCorrMtx_);
 	std::cout << "Correction error: " << meanError << std::endl;
 
 	return meanError;
 }
 
-float EnvironmentMap::getSquaredError(const EMSample& sample) {
-	glm::vec3 diff = sample.refColor - glm::vec3(lastCorrMtx_*sample.curColor);
-	
-	return diff.x*diff.x + diff.y*diff.y + diff.z*diff.z;
-}
-
 void EnvironmentMap::renderToImage() {	
 	if (!img_)
 		img_.reset(new io::Image(width_, height_));
@@ -521,61 +559,25 @@ void EnvironmentMap::updateOrigin(const glm::vec3 &origin) {
 }
 
 bool EnvironmentMap::isEMNeighborhoodUniform(const EMSample& sample) {
-	glm::vec3 sumSq(0.f, 0.f, 0.f);
-	glm::vec3 sum(0.f, 0.f, 0.f);
-
-	float theta, phi;
-	for (int i = -1; i <= 1; i++) {
-		for (int j = -1; j <= 1; j++) {
-			theta = sample.sphCoords.x + i*NeighbordHoodDelta;
-			phi = sample.sphCoords.y + j*NeighbordHoodDelta;
-			
-			if (phi < 0)
-				phi += M_2PI;
-
-			if (theta < 0) {
-				theta += M_PI;
-				phi += M_PI; // Invert direction
-
-				if (phi < M_2PI)
-					phi -= M_2PI;				
-			}
-
-			if (theta > M_PI) {
-				theta -= M_PI;
-
-				phi += M_PI; // Invert direction
-
-				if (phi < M_2PI)
-					phi -= M_2PI;
-			}
-			
-			if (phi > M_2PI)
-				phi -= M_2PI;
-			
-			
-			size_t offsetX = (int)floor(phi*(width_ - 1) / M_2PI + 0.5f); 
-			size_t offsetY = (int)floor(theta*(height_ - 1) / M_PI + 0.5f); 
-			size_t offset = offsetY*width_ + offsetX;
+	return uniformMask_.isUniform(color_.get(), sample.uvOffset);
+}
 
-			glm::vec3 curColor = *(color_.get() + offset);
-			sum += curColor;
-			sumSq += curColor * curColor;
-		}
+void EnvironmentMap::resetUniformityMask() {
+	if (!checkUniformity_) {
+		uniformMask_.clear();
+		return;
 	}
 
-	sumSq /= 9.f;
-	sum /= 9.f;
-	sum *= sum;	
+	// The angular neighborhood is converted to a square of pixels around the sample
+	int radius = (int)floor(NeighbordHoodDelta*(width_ - 1) / M_2PI + 0.5f);
 
-	sumSq -= sum;
+	uniformMask_.setRadius(std::max(radius, 1));
+	uniformMask_.resize(width_, height_);
+}
 
-	for (int i = 0; i < 3; i++) {
-		if (sumSq[i] > MaxVariance)
-			return false;
-	}
-	
-	return true;
+void EnvironmentMap::resetCoverage() {
+	coverage_.resize(width_, height_);
+	frameIdx_ = 0;
 }
 
 #ifdef _WINDOWS
@@ -730,6 +732,9 @@ void EnvironmentMap::loadFromData(const uchar* data, size_t bytesPerRow) {
 				*colorPtr++ = (float)(*dataPtr++) / 255.f;
 		}
 	}
+
+	resetUniformityMask();
+	resetCoverage();
 }
 
 void EnvironmentMap::loadFromData(const float* data, const glm::vec3& origin) {
@@ -752,6 +757,9 @@ void EnvironmentMap::loadFromData(const float* data, const glm::vec3& origin) {
 			}
 		}
 	}
+
+	resetUniformityMask();
+	resetCoverage();
 }
 
 void EnvironmentMap::copy(const EnvironmentMap& srcEM) {
@@ -762,6 +770,10 @@ void EnvironmentMap::copy(const EnvironmentMap& srcEM) {
 	memcpy(color_.get(), srcEM.getColorPtr(), sizeof(glm::vec3)*width_*height_);
 	memcpy(depth_.get(), srcEM.getDepthPtr(), sizeof(float)*width_*height_);
 	memcpy(flags_.get(), srcEM.getFlagsPtr(), sizeof(uchar)*width_*height_);
+
+	resetUniformityMask();
+	coverage_ = srcEM.coverage_;
+	frameIdx_ = srcEM.frameIdx_;
 }
 
 void EnvironmentMap::setEMSize(size_t width, size_t height) {
@@ -808,6 +820,73 @@ void EnvironmentMap::saveMaps() {
 
 #endif
 
+void EnvironmentMap::toSnapshot(EMSnapshot& snapshot) const {
+	snapshot.reset(width_, height_);
+	snapshot.setOrigin(origin_);
+	snapshot.setCorrectionMatrix(lastCorrMtx_);
+	snapshot.setFrameIndex(frameIdx_);
+
+	if (isEmpty_ || !color_)
+		return;
+
+	glm::vec3 emptyColor(-1.f);
+	float emptyDepth = -1.f;
+	uchar emptyFlags = 0;
+	uint32_t emptyCoverage = 0;
+	snapshot.addPlane(PlaneColor, sizeof(glm::vec3), &emptyColor, color_.get());
+	snapshot.addPlane(PlaneDepth, sizeof(float), &emptyDepth, depth_.get());
+	snapshot.addPlane(PlaneFlags, sizeof(uchar), &emptyFlags, flags_.get());
+	snapshot.addPlane(PlaneCoverage, sizeof(uint32_t), &emptyCoverage, coverage_.getPackedPtr());
+}
+
+bool EnvironmentMap::fromSnapshot(const EMSnapshot& snapshot) {
+	if (snapshot.getWidth() != width_ || snapshot.getHeight() != height_) {
+		std::cout << "Snapshot size " << snapshot.getWidth() << "x" << snapshot.getHeight() << " doesn't match the EM" << std::endl;
+		return false;
+	}
+
+	const SnapshotPlane* color = snapshot.getPlane(PlaneColor);
+	const SnapshotPlane* depth = snapshot.getPlane(PlaneDepth);
+	const SnapshotPlane* flags = snapshot.getPlane(PlaneFlags);
+	if (!color || !depth || !flags || color->elementSize != sizeof(glm::vec3) || depth->elementSize != sizeof(float) || flags->elementSize != sizeof(uchar)) {
+		std::cout << "Snapshot without the EM planes" << std::endl;
+		return false;
+	}
+
+	color_.reset(new glm::vec3[width_*height_], std::default_delete<glm::vec3[]>());
+	depth_.reset(new float[width_*height_], std::default_delete<float[]>());
+	flags_.reset(new uchar[width_*height_], std::default_delete<uchar[]>());
+
+	memcpy(color_.get(), color->data.data(), color->data.size());
+	memcpy(depth_.get(), depth->data.data(), depth->data.size());
+	memcpy(flags_.get(), flags->data.data(), flags->data.size());
+
+	origin_ = snapshot.getOrigin();
+	lastCorrMtx_ = snapshot.getCorrectionMatrix();
+
+	resetUniformityMask();
+	resetCoverage();
+
+	const SnapshotPlane* coverage = snapshot.getPlane(PlaneCoverage);
+	if (coverage && coverage->elementSize == sizeof(uint32_t)) {
+		coverage_.load((const uint32_t*)coverage->data.data());
+		frameIdx_ = snapshot.getFrameIndex();
+	}
+
+	depthRange_ = glm::vec2(FLT_MAX, -FLT_MAX);
+	const float* depthPtr = depth_.get();
+	for (size_t i = 0; i < width_*height_; i++) {
+		if (depthPtr[i] >= 0.f) {
+			depthRange_.x = std::min(depthRange_.x, depthPtr[i]);
+			depthRange_.y = std::max(depthRange_.y, depthPtr[i]);
+		}
+	}
+
+	isEmpty_ = false;
+
+	return true;
+}
+
 glm::vec3 EnvironmentMap::findDisplacementUS(const glm::vec3& posWorld) const {
 	glm::vec3 dir = posWorld - origin_;
 	float sqDist = dir.x*dir.x + dir.z*dir.z; // Projected squared distance on the X/Z plane
@@ -892,6 +971,11 @@ bool EnvironmentMap::fromWarp(const EnvironmentMap& srcEM, const glm::vec3& posU
 	const float* srcDepth = srcEM.getDepthPtr();
 	const uchar* srcFlags = srcEM.getFlagsPtr();
 
+	// The observations follow the pixels they were made for
+	const uint32_t* srcCoverage = srcEM.coverage_.getPackedPtr();
+	std::vector<uint32_t> warpedCoverage(srcCoverage ? width_*height_ : 0);
+	uint32_t* thisCoverage = warpedCoverage.data();
+
 	double deltaTheta = M_PI / height_;
 	double deltaPhi = M_2PI / width_;
 
@@ -943,6 +1027,9 @@ bool EnvironmentMap::fromWarp(const EnvironmentMap& srcEM, const glm::vec3& posU
 			// Update flags map
 			*thisFlags++ = *(srcFlags + offset);
 
+			if (thisCoverage)
+				*thisCoverage++ = *(srcCoverage + offset);
+
 			phiP += deltaPhi;
 		}
 
@@ -960,10 +1047,17 @@ bool EnvironmentMap::fromWarp(const EnvironmentMap& srcEM, const glm::vec3& posU
     origin_ = srcEM.getOrigin();
 
   isEmpty_ = false;
+	resetUniformityMask();
+
+	coverage_.resize(width_, height_);
+	if (!warpedCoverage.empty())
+		coverage_.load(warpedCoverage.data());
+	frameIdx_ = srcEM.frameIdx_;
 
 	depthRange_ = srcEM.getDepthRange();
 	lastCorrMtx_ = srcEM.getLastCorrectionMatrix();
   lastSamples_ = srcEM.getLastSamples();
+  samplesCapacity_ = srcEM.samplesCapacity_;
 
   return validWarp;
 }
\ No newline at end of file
@@ -0,0 +1,275 @@
+#include <vsense/em/IntegrationController.h>
+
+#include <glm/gtc/quaternion.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+
+using namespace vsense;
+using namespace vsense::em;
+
+const float Pi = 3.14159265358979323846f;
+const float TwoPi = 2.f*Pi;
+
+IntegrationController::IntegrationController(const IntegrationParams& params) : params_(params), f_(1.f), c_(0.f), size_(1), origin_(0.f),
+	fullCost_(params.fullCostMS), reducedCost_(params.reducedCostMS), stamp_(0) {
+	params_.gridWidth = std::max(params_.gridWidth, 1);
+	params_.gridHeight = std::max(params_.gridHeight, 1);
+	params_.raysX = std::max(params_.raysX, 1);
+	params_.raysY = std::max(params_.raysY, 1);
+
+	reset();
+}
+
+void IntegrationController::setCamera(const glm::vec2& f, const glm::vec2& c, const glm::uvec2& size) {
+	f_ = f;
+	c_ = c;
+	size_ = size;
+}
+
+void IntegrationController::setOrigin(const glm::vec3& origin) {
+	if (origin == origin_)
+		return;
+
+	// The directions of the covered regions are relative to the old origin
+	origin_ = origin;
+	std::fill(refreshed_.begin(), refreshed_.end(), -1.0);
+	nbrCovered_ = 0;
+}
+
+void IntegrationController::reset() {
+	size_t nbrCells = (size_t)params_.gridWidth*params_.gridHeight;
+	refreshed_.assign(nbrCells, -1.0);
+	cellStamps_.assign(nbrCells, 0);
+	nbrCovered_ = 0;
+
+	lastPose_ = glm::mat4(1.f);
+	hasPose_ = false;
+	credit_ = std::max(params_.burstFrames*params_.budgetMS, fullCost_);
+	charged_ = 0.f;
+
+	lastNovelty_ = FrameNovelty();
+	stats_ = IntegrationStats();
+	report_.clear();
+}
+
+void IntegrationController::footprint(const glm::mat4& pose, std::vector<int>& cells) const {
+	cells.clear();
+	if (++stamp_ == 0) { // Wrapped around, older stamps could match
+		std::fill(cellStamps_.begin(), cellStamps_.end(), 0);
+		stamp_ = 1;
+	}
+
+	for (int y = 0; y < params_.raysY; y++) {
+		float v = (y + 0.5f)*size_.y / params_.raysY;
+		for (int x = 0; x < params_.raysX; x++) {
+			float u = (x + 0.5f)*size_.x / params_.raysX;
+
+			glm::vec3 ptCam((u - c_.x) / f_.x, (v - c_.y) / f_.y, 1.f);
+			glm::vec3 pt = glm::vec3(pose*glm::vec4(ptCam*params_.nominalDepth, 1.f));
+
+			glm::vec3 dir = pt - origin_;
+			float len = glm::length(dir);
+			if (len <= 0.f)
+				continue;
+			dir /= len;
+
+			// Same mapping as the EM: theta from the y axis, phi from the z axis towards x
+			float theta = acos(std::min(1.f, std::max(-1.f, dir.y)));
+			float phi = atan2(dir.x, dir.z);
+			if (phi < 0.f)
+				phi += TwoPi;
+
+			int col = std::min(params_.gridWidth - 1, (int)(phi*params_.gridWidth / TwoPi));
+			int row = std::min(params_.gridHeight - 1, (int)(theta*params_.gridHeight / Pi));
+			int cell = row*params_.gridWidth + col;
+
+			if (cellStamps_[cell] != stamp_) {
+				cellStamps_[cell] = stamp_;
+				cells.push_back(cell);
+			}
+		}
+	}
+}
+
+FrameNovelty IntegrationController::estimate(const glm::mat4& pose, double timestamp) const {
+	FrameNovelty novelty;
+
+	if (hasPose_) {
+		float translation = glm::length(glm::vec3(pose[3]) - glm::vec3(lastPose_[3]));
+
+		// Angle of the relative rotation from the trace of R_last^T * R
+		float trace = 0.f;
+		for (int i = 0; i < 3; i++)
+			trace += glm::dot(glm::vec3(lastPose_[i]), glm::vec3(pose[i]));
+		float angle = acos(std::min(1.f, std::max(-1.f, 0.5f*(trace - 1.f))));
+
+		novelty.poseDelta = std::min(1.f, translation / params_.translationScale + angle / params_.rotationScale);
+	} else {
+		novelty.poseDelta = 1.f;
+	}
+
+	footprint(pose, cells_);
+	if (!cells_.empty()) {
+		size_t nbrEmpty = 0;
+		double staleness = 0.0;
+		for (size_t i = 0; i < cells_.size(); i++) {
+			double refreshed = refreshed_[cells_[i]];
+			if (refreshed < 0.0) {
+				nbrEmpty++;
+				staleness += 1.0;
+			} else {
+				staleness += std::min(1.0, std::max(0.0, timestamp - refreshed) / params_.staleTime);
+			}
+		}
+
+		novelty.emptyFraction = (float)nbrEmpty / cells_.size();
+		novelty.staleness = (float)(staleness / cells_.size());
+	}
+
+	float weights = params_.poseWeight + params_.emptyWeight + params_.staleWeight;
+	if (weights > 0.f)
+		novelty.novelty = (params_.poseWeight*novelty.poseDelta + params_.emptyWeight*novelty.emptyFraction + params_.staleWeight*novelty.staleness) / weights;
+
+	return novelty;
+}
+
+IntegrationDecision IntegrationController::update(const glm::mat4& pose, double timestamp) {
+	lastNovelty_ = estimate(pose, timestamp);
+	stats_.nbrFrames++;
+
+	// The budget of every frame is added to the credit, which can hold a few frames so costly integrations are possible
+	float maxCredit = std::max(params_.burstFrames*params_.budgetMS, fullCost_);
+	credit_ = std::min(credit_ + params_.budgetMS, maxCredit);
+
+	// A novel enough frame is fully integrated when affordable, also below the full threshold if the credit is saturated
+	IntegrationDecision decision = IntegrationSkip;
+	if (lastNovelty_.novelty >= params_.reducedThreshold) {
+		bool saturated = credit_ >= maxCredit;
+		if (credit_ >= fullCost_ && (lastNovelty_.novelty >= params_.fullThreshold || saturated))
+			decision = IntegrationFull;
+		else if (credit_ >= reducedCost_)
+			decision = IntegrationReduced;
+	}
+
+	if (decision == IntegrationSkip) {
+		stats_.nbrSkipped++;
+		charged_ = 0.f;
+	} else {
+		if (decision == IntegrationFull)
+			stats_.nbrFull++;
+		else
+			stats_.nbrReduced++;
+
+		charged_ = getCost(decision);
+		credit_ -= charged_;
+		stats_.spentMS += charged_;
+
+		// The footprint found by estimate() is refreshed
+		for (size_t i = 0; i < cells_.size(); i++) {
+			if (refreshed_[cells_[i]] < 0.0)
+				nbrCovered_++;
+			refreshed_[cells_[i]] = timestamp;
+		}
+
+		lastPose_ = pose;
+		hasPose_ = true;
+	}
+
+	CoverageSample sample;
+	sample.timestamp = timestamp;
+	sample.decision = decision;
+	sample.novelty = lastNovelty_.novelty;
+	sample.coverage = getCoverage();
+	sample.spentMS = stats_.spentMS;
+	report_.push_back(sample);
+
+	return decision;
+}
+
+void IntegrationController::reportCost(IntegrationDecision decision, float ms) {
+	if (decision == IntegrationSkip)
+		return;
+
+	float& cost = (decision == IntegrationFull) ? fullCost_ : reducedCost_;
+	cost += params_.costSmoothing*(ms - cost);
+
+	// The charged time is replaced by the measured one
+	float diff = ms - charged_;
+	credit_ -= diff;
+	stats_.spentMS += diff;
+	if (!report_.empty())
+		report_.back().spentMS += diff;
+	charged_ = ms;
+}
+
+const IntegrationStats& IntegrationController::replay(const std::vector<RecordedPose>& poses) {
+	for (size_t i = 0; i < poses.size(); i++)
+		update(poses[i].pose, poses[i].timestamp);
+
+	return stats_;
+}
+
+float IntegrationController::getCoverage() const {
+	if (refreshed_.empty())
+		return 0.f;
+
+	return (float)nbrCovered_ / refreshed_.size();
+}
+
+float IntegrationController::getCost(IntegrationDecision decision) const {
+	if (decision == IntegrationFull)
+		return fullCost_;
+	else if (decision == IntegrationReduced)
+		return reducedCost_;
+
+	return 0.f;
+}
+
+bool IntegrationController::readRecordedPoses(const std::string& folder, std::vector<RecordedPose>& poses, glm::vec2& f, glm::vec2& c,
+	glm::uvec2& size) {
+	poses.clear();
+
+	for (int frame = 0; ; frame++) {
+		char buffer[20];
+		sprintf(buffer, "%d", frame);
+
+		std::ifstream file(folder + "PointCloud" + buffer + ".pc", std::ios::binary);
+		if (!file.is_open())
+			break;
+
+		// Header written by PointCloudApp::saveFiles, the points aren't needed
+		uint32_t width, height, nbrPoints;
+		double fx, fy, cx, cy, distortion[5], timestamp, translation[3], orientation[4];
+		file.read((char*)&width, sizeof(uint32_t));
+		file.read((char*)&height, sizeof(uint32_t));
+		file.read((char*)&fx, sizeof(double));
+		file.read((char*)&fy, sizeof(double));
+		file.read((char*)&cx, sizeof(double));
+		file.read((char*)&cy, sizeof(double));
+		file.read((char*)distortion, sizeof(double) * 5);
+		file.read((char*)&nbrPoints, sizeof(uint32_t));
+		file.read((char*)&timestamp, sizeof(double));
+		file.read((char*)translation, sizeof(double) * 3);
+		file.read((char*)orientation, sizeof(double) * 4);
+		if (!file)
+			break;
+
+		if (poses.empty()) {
+			f = glm::vec2((float)fx, (float)fy);
+			c = glm::vec2((float)cx, (float)cy);
+			size = glm::uvec2(width, height);
+		}
+
+		RecordedPose recorded;
+		recorded.timestamp = timestamp;
+		recorded.pose = glm::mat4_cast(glm::quat((float)orientation[3], (float)orientation[0], (float)orientation[1], (float)orientation[2]));
+		recorded.pose[3] = glm::vec4((float)translation[0], (float)translation[1], (float)translation[2], 1.f);
+		poses.push_back(recorded);
+	}
+
+	return !poses.empty();
+}
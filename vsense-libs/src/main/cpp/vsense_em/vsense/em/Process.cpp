@@ -1,12 +1,21 @@
 #include <vsense/em/Process.h>
+#include <vsense/em/ColorMoments.h>
 
+#include <vsense/depth/DepthMap.h>
+#include <vsense/gl/GLComputeCommands.h>
+#include <vsense/gl/PixelPackReadback.h>
+#include <vsense/gl/ReadbackRing.h>
+#include <vsense/gl/ShaderSource.h>
 #include <vsense/gl/Texture.h>
 #include <vsense/gl/Util.h>
 #include <vsense/sh/SphericalHarmonics.h>
 
+#include <algorithm>
 #include <iostream>
 
-#ifdef __ANDROID__
+#ifdef _WINDOWS
+#include <QFile>
+#elif __ANDROID__
 #include <android/asset_manager_jni.h>
 #endif
 
@@ -42,20 +51,42 @@ const uint32_t EnvironmentMapHeight = EnvironmentMapWidth / 2;
 // Constants for 18,432 samples
 const uint32_t RandSamplesWidth = 72;
 const uint32_t RandSamplesHeight = 128;
-const glm::ivec2 SHWorkGroups(9, 8);
-const int MaxOrder = 9;
-const int NbrCoefficients = (MaxOrder + 1)*(MaxOrder + 1);
+const int NbrCoefficients = sh::BandLimit::getNbrCoefficients(sh::MaxSHOrder); // Storage of the highest order, maxOrder_ selects the bands used
 
 const float TrustedRadius = 0.10f; // 10cm
 
 const float NbrDiv = 8.f;
 
+// Work-group sizes of the reductions, the number of invocations must be a power of two
+const glm::ivec2 CorrLocalSize(8, 8);
+const glm::ivec2 CorrSamplesPerInvocation(4, 4); // SamplesX, SamplesY in environmentMapCorrect.comp
+const glm::ivec2 CorrWorkGroups((DepthMapWidth + CorrLocalSize.x*CorrSamplesPerInvocation.x - 1) / (CorrLocalSize.x*CorrSamplesPerInvocation.x),
+	(DepthMapHeight + CorrLocalSize.y*CorrSamplesPerInvocation.y - 1) / (CorrLocalSize.y*CorrSamplesPerInvocation.y));
+
+const glm::ivec2 SHLocalSize(4, 4);
+const glm::ivec2 SHTexelsPerInvocation(2, 4); // TexelsX, TexelsY in envMapSHCoefficients.comp
+const glm::ivec2 SHWorkGroups((RandSamplesWidth + SHLocalSize.x*SHTexelsPerInvocation.x - 1) / (SHLocalSize.x*SHTexelsPerInvocation.x),
+	(RandSamplesHeight + SHLocalSize.y*SHTexelsPerInvocation.y - 1) / (SHLocalSize.y*SHTexelsPerInvocation.y));
+
+// Sorted scatter of the EM samples
+const uint32_t SortGroupSize = 64; // local_size_x in radixSort.comp and environmentMapResolve.comp
+const uint32_t SortNbrGroups = (DepthNbrPoints + SortGroupSize - 1) / SortGroupSize;
+const uint32_t SortNbrDigits = 16;
+const uint32_t SortDigitBits = 4;
+
+const int FinalDataWidth = 13; // Matrices A and B, counts and ref.ref, unweighted moments
+
+// Readback buffers per GPU result, a single one makes the color correction use the data of the current frame
+const size_t CorrReadbackSlots = 1;
+const size_t SHReadbackSlots = 3;
+
 const float MaxDepthDiff = 0.01f;
 
 const size_t MinNbrPoints = 500;
 
 const float MaxAllowedError = 0.1f;
 
+
 #ifdef KEEP_STATS
 #define STAT_START(idx)                                              \
 		curTimeStats_.start(idx);                                           
@@ -63,23 +94,29 @@ const float MaxAllowedError = 0.1f;
 #define STAT_STOP(idx)                                               \
 		curTimeStats_.stop(idx);                                            
 	
+#define STAT_DISPATCH(idx)                                           \
+		curTimeStats_.addDispatch(idx);                                     
+	
 #else
 #define STAT_START(idx){}
 #define STAT_STOP(idx){}
+#define STAT_DISPATCH(idx){}
 #endif
 
 #ifdef _WINDOWS
 const std::string MaskFile = "D:/dev/vsense_AR/data/ptMap.bin";
-
+const std::string ShaderDir = ":/resources/shaders/";
 #elif __ANDROID__
 const std::string MaskFile = "/sdcard/TCD/map/ptMap.bin";
+const std::string ShaderDir = "shaders/";
 #endif
 
 #ifdef _WINDOWS
 void TimeStats::printStats() {
 	//std::cout << "Frames: " << nbrFrames << std::endl;
 	for (int i = 0; i <= EMTranslate; i++)
-		std::cout << i << " " << timeMS[i] << std::endl;
+		std::cout << i << " " << timeMS[i] << " " << nbrDispatches[i] << std::endl;
+	std::cout << "Barriers: " << nbrBarriers << " (" << nbrStages << " in fixed order)" << std::endl;
 }
 
 #elif __ANDROID__
@@ -89,6 +126,9 @@ void TimeStats::printStats(std::ofstream& file) {
 	file << curFrame << ",";
 	for (int i = 0; i <= EMTranslate; i++)
 		file << timeMS[i] << ",";
+	for (int i = 0; i <= EMTranslate; i++)
+		file << nbrDispatches[i] << ",";
+	file << nbrStages << "," << nbrBarriers << ",";
 	file << std::endl;
 
 	curFrame++;
@@ -97,11 +137,16 @@ void TimeStats::printStats(std::ofstream& file) {
 
 #ifdef _WINDOWS
 Process::Process() : emIsEmpty_(true), emTranslatedOrigin_(0.f, 0.f, 0.f), emOrigin_(0.f, 0.f, 0.f), lastCorrError_(-1.f), overwriteOld_(true), 
-	maxMSE_(MaxAllowedError), needsTranslateEM_(false), maxOrder_(9), curProject_(false), doColorCorrection_(true) {
+	maxMSE_(MaxAllowedError), needsTranslateEM_(false), maxOrder_(sh::MaxSHOrder), curProject_(false), doColorCorrection_(true), reliabilityWindow_(3), 
+	fusedDepthPreprocessing_(true), scatterMode_(ScatterUnordered), reductionCounter_(0), frameIdx_(0), coverageFrame_(0), lastCorrAge_(0), shCoeffsFrame_(0), hasSHCoeffs_(false) {
 	initializeOpenGLFunctions();
 
+	computeCommands_.reset(new gl::GLComputeCommands());
+
 	initializeShaders();
 
+	setReadbackSlots(CorrReadbackSlots, SHReadbackSlots);
+
 	readPointMappingFile();
 }
 
@@ -150,6 +195,9 @@ void Process::initializeShaders() {
 	shaderProgram3_->link();
 	shaderProgram3_->bind();
 
+	radiusLocation_ = shaderProgram3_->uniformLocation("radius");
+	limitChiSquareLocation_ = shaderProgram3_->uniformLocation("limitChiSquare");
+
 	shaderProgram3_->release();
 
 	// Fill holes
@@ -166,6 +214,22 @@ void Process::initializeShaders() {
 
 	shaderProgram4_->release();
 
+	// Fused mark reliable and fill holes
+	shaderProgram12_ = new QOpenGLShaderProgram;
+	shaderProgram12_->addShaderFromSourceFile(QOpenGLShader::Compute, ":/resources/shaders/depthMapPreprocess.comp");
+	shaderProgram12_->link();
+	shaderProgram12_->bind();
+
+	f_imLocation12_ = shaderProgram12_->uniformLocation("f_im");
+	c_imLocation12_ = shaderProgram12_->uniformLocation("c_im");
+	pose_imLocation12_ = shaderProgram12_->uniformLocation("pose_im");
+	coeff_imLocation12_ = shaderProgram12_->uniformLocation("coeff_im");
+	fillWithMaxLocation12_ = shaderProgram12_->uniformLocation("fillWithMax");
+	radiusLocation12_ = shaderProgram12_->uniformLocation("radius");
+	limitChiSquareLocation12_ = shaderProgram12_->uniformLocation("limitChiSquare");
+
+	shaderProgram12_->release();
+
 	// Environment map samples
 	shaderProgram5_ = new QOpenGLShaderProgram;
 	shaderProgram5_->addShaderFromSourceFile(QOpenGLShader::Compute, ":/resources/shaders/environmentMapSample.comp");
@@ -177,6 +241,8 @@ void Process::initializeShaders() {
 	GL_CHECK(textureSamplesRef_.reset(new gl::Texture(DepthMapWidth, DepthMapHeight, 4, GL_FLOAT, NULL)));
 	GL_CHECK(textureSamplesCur_.reset(new gl::Texture(DepthMapWidth, DepthMapHeight, 4, GL_FLOAT, NULL)));
 	GL_CHECK(textureSamplesData_.reset(new gl::Texture(DepthMapWidth, DepthMapHeight, 4, GL_FLOAT, NULL)));
+	GL_CHECK(textureCoverage_.reset(new gl::Texture(EnvironmentMapWidth, EnvironmentMapHeight, 1, GL_UNSIGNED_INT, NULL)));
+	GL_CHECK(textureCoverageWarped_.reset(new gl::Texture(EnvironmentMapWidth, EnvironmentMapHeight, 1, GL_UNSIGNED_INT, NULL)));
 	textureEnvironmentMapCur_ = textureEnvironmentMap1_;
 
 	pose_pcLocation_ = shaderProgram5_->uniformLocation("pose_pc");
@@ -187,39 +253,18 @@ void Process::initializeShaders() {
 	shaderProgram5_->release();
 
 	// Environment map colour correction matrix
-	shaderProgram6_ = new QOpenGLShaderProgram;
-	shaderProgram6_->addShaderFromSourceFile(QOpenGLShader::Compute, ":/resources/shaders/environmentMapCorrect.comp");
-	shaderProgram6_->link();
+	shaderProgram6_ = createReductionShaderProgram("environmentMapCorrect.comp", CorrLocalSize, { "float", "vec3", "mat3" });
 	shaderProgram6_->bind();
 
-	int accWidth = DepthMapWidth / (NbrDiv*4.f);
-	int accHeight = DepthMapHeight / (NbrDiv*4.f);
-	textureMatAAcc_.reset(new gl::Texture(accWidth * 3, accHeight * 3, 1, GL_FLOAT, NULL));
-	textureMatBAcc_.reset(new gl::Texture(accWidth * 3, accHeight * 3, 1, GL_FLOAT, NULL));
-	textureWCurAcc_.reset(new gl::Texture(accWidth * 3, accHeight, 1, GL_FLOAT, NULL));
-	textureWRefAcc_.reset(new gl::Texture(accWidth * 3, accHeight, 1, GL_FLOAT, NULL));
-	textureUsedAcc_.reset(new gl::Texture(accWidth, accHeight, 1, GL_FLOAT, NULL));	
-	textureFinalData_.reset(new gl::Texture(7, 3, 1, GL_FLOAT, NULL));
-	
-	numWGLocation6_ = shaderProgram6_->uniformLocation("numWG");
+	textureMatAAcc_.reset(new gl::Texture(CorrWorkGroups.x * 3, CorrWorkGroups.y * 6, 1, GL_FLOAT, NULL)); // Unweighted moments in the lower half
+	textureMatBAcc_.reset(new gl::Texture(CorrWorkGroups.x * 3, CorrWorkGroups.y * 6, 1, GL_FLOAT, NULL));
+	textureWCurAcc_.reset(new gl::Texture(CorrWorkGroups.x * 3, CorrWorkGroups.y, 1, GL_FLOAT, NULL));
+	textureWRefAcc_.reset(new gl::Texture(CorrWorkGroups.x * 3, CorrWorkGroups.y, 1, GL_FLOAT, NULL));
+	textureUsedAcc_.reset(new gl::Texture(CorrWorkGroups.x * 3, CorrWorkGroups.y, 1, GL_FLOAT, NULL));	
+	textureFinalData_.reset(new gl::Texture(FinalDataWidth, 3, 1, GL_FLOAT, NULL));
 
 	shaderProgram6_->release();
 
-	// Environment map error estimation
-	shaderProgram7_ = new QOpenGLShaderProgram;
-	shaderProgram7_->addShaderFromSourceFile(QOpenGLShader::Compute, ":/resources/shaders/environmentMapError.comp");
-	shaderProgram7_->link();
-	shaderProgram7_->bind();
-
-	textureErrorAcc_.reset(new gl::Texture(accWidth, accHeight, 1, GL_FLOAT, NULL));
-	textureCountAcc_.reset(new gl::Texture(accWidth, accHeight, 1, GL_FLOAT, NULL));
-	textureFinalError_.reset(new gl::Texture(1, 1, 1, GL_FLOAT, NULL));
-
-	corrMtxLocation7_ = shaderProgram7_->uniformLocation("corrMtx");
-	numWGLocation7_ = shaderProgram7_->uniformLocation("numWG");
-
-	shaderProgram7_->release();
-
 	// Environment map project
 	shaderProgram8_ = new QOpenGLShaderProgram;
 	shaderProgram8_->addShaderFromSourceFile(QOpenGLShader::Compute, ":/resources/shaders/environmentMapProject.comp");
@@ -228,13 +273,60 @@ void Process::initializeShaders() {
 
 	corrMtxLocation8_ = shaderProgram8_->uniformLocation("corrMtx");
 	withinTrustedSphereLocation_ = shaderProgram8_->uniformLocation("withinTrustedSphere");
+	frameIdxLocation8_ = shaderProgram8_->uniformLocation("frameIdx");
 
 	shaderProgram8_->release();
 
+	// Environment map project (sorted scatter)
+	shaderProgram13_ = new QOpenGLShaderProgram;
+	shaderProgram13_->addShaderFromSourceFile(QOpenGLShader::Compute, ":/resources/shaders/environmentMapProjectKeys.comp");
+	shaderProgram13_->link();
+	shaderProgram13_->bind();
+
+	GL_CHECK(textureSortElements1_.reset(new gl::Texture(DepthMapWidth, DepthMapHeight, 4, GL_UNSIGNED_INT, NULL)));
+	GL_CHECK(textureSortElements2_.reset(new gl::Texture(DepthMapWidth, DepthMapHeight, 4, GL_UNSIGNED_INT, NULL)));
+	GL_CHECK(textureDigitOffsets_.reset(new gl::Texture(SortNbrGroups, SortNbrDigits, 1, GL_UNSIGNED_INT, NULL)));
+	GL_CHECK(textureProjected_.reset(new gl::Texture(DepthMapWidth, DepthMapHeight, 4, GL_FLOAT, NULL)));
+
+	corrMtxLocation13_ = shaderProgram13_->uniformLocation("corrMtx");
+	withinTrustedSphereLocation13_ = shaderProgram13_->uniformLocation("withinTrustedSphere");
+	envMapSizeLocation13_ = shaderProgram13_->uniformLocation("envMapSize");
+
+	shaderProgram13_->release();
+
+	shaderProgram14_ = new QOpenGLShaderProgram;
+	shaderProgram14_->addShaderFromSourceFile(QOpenGLShader::Compute, ":/resources/shaders/radixSort.comp");
+	shaderProgram14_->link();
+	shaderProgram14_->bind();
+
+	nbrElementsLocation14_ = shaderProgram14_->uniformLocation("nbrElements");
+	shiftLocation14_ = shaderProgram14_->uniformLocation("shift");
+	scatterLocation14_ = shaderProgram14_->uniformLocation("scatter");
+
+	shaderProgram14_->release();
+
+	shaderProgram15_ = new QOpenGLShaderProgram;
+	shaderProgram15_->addShaderFromSourceFile(QOpenGLShader::Compute, ":/resources/shaders/radixSortScan.comp");
+	shaderProgram15_->link();
+	shaderProgram15_->bind();
+
+	nbrGroupsLocation15_ = shaderProgram15_->uniformLocation("nbrGroups");
+
+	shaderProgram15_->release();
+
+	shaderProgram16_ = new QOpenGLShaderProgram;
+	shaderProgram16_->addShaderFromSourceFile(QOpenGLShader::Compute, ":/resources/shaders/environmentMapResolve.comp");
+	shaderProgram16_->link();
+	shaderProgram16_->bind();
+
+	nbrElementsLocation16_ = shaderProgram16_->uniformLocation("nbrElements");
+	modeLocation16_ = shaderProgram16_->uniformLocation("mode");
+	frameIdxLocation16_ = shaderProgram16_->uniformLocation("frameIdx");
+
+	shaderProgram16_->release();
+
 	// Spherical coefficients
-	shaderProgram9_ = new QOpenGLShaderProgram;
-	shaderProgram9_->addShaderFromSourceFile(QOpenGLShader::Compute, ":/resources/shaders/envMapSHCoefficients.comp");
-	shaderProgram9_->link();
+	shaderProgram9_ = createReductionShaderProgram("envMapSHCoefficients.comp", SHLocalSize, { "vec4" });
 	shaderProgram9_->bind();
 
 	const std::shared_ptr<glm::vec2> randomSphCoords = sh::SphericalHarmonics::getRandomSphericalCoords();
@@ -247,7 +339,6 @@ void Process::initializeShaders() {
 	GL_CHECK(textureCoeffFinal2_.reset(new gl::Texture(1, NbrCoefficients, 4, GL_FLOAT, NULL)));
 	textureCoeffFinalCur_ = textureCoeffFinal1_;
 
-	numWGLocation9_ = shaderProgram9_->uniformLocation("numWG");
 	maxOrderLocation_ = shaderProgram9_->uniformLocation("maxOrder");
 
 	shaderProgram9_->release();	
@@ -273,6 +364,28 @@ void Process::initializeShaders() {
 	shaderProgram11_->release();
 }
 
+std::string Process::readShaderSource(const std::string& filename) {
+	QFile file(QString::fromStdString(filename));
+	if (!file.open(QIODevice::ReadOnly)) {
+		std::cout << "Unable to open " << filename << std::endl;
+		return std::string();
+	}
+
+	return file.readAll().toStdString();
+}
+
+SHADER_OBJECT Process::createReductionShaderProgram(const std::string& filename, const glm::ivec2& localSize, const std::vector<std::string>& types) {
+	QOpenGLShaderProgram* program = new QOpenGLShaderProgram;
+
+	std::string source;
+	if (assembleReductionShader(filename, localSize, types, source)) {
+		program->addShaderFromSourceCode(QOpenGLShader::Compute, source.c_str());
+		program->link();
+	}
+
+	return program;
+}
+
 void Process::readImage(const std::string& fileIM) {
 	ifstream file(fileIM, ios::in | ios::binary);
 	if (file.is_open()) {
@@ -352,23 +465,46 @@ void Process::loadDepthMap(const std::string& filePC, const std::string& fileIM,
 #elif __ANDROID__
 
 Process::Process(AAssetManager* assetManager) : emIsEmpty_(true), assetManager_(assetManager), emOrigin_(0.f, 0.f, 0.f), overwriteOld_(true), 
-	maxMSE_(MaxAllowedError), needsTranslateEM_(false), curProject_(false), doColorCorrection_(true) {
+	maxMSE_(MaxAllowedError), needsTranslateEM_(false), maxOrder_(sh::MaxSHOrder), curProject_(false), doColorCorrection_(true), reliabilityWindow_(3), fusedDepthPreprocessing_(true),
+	scatterMode_(ScatterUnordered), reductionCounter_(0), frameIdx_(0), coverageFrame_(0), lastCorrAge_(0), shCoeffsFrame_(0), hasSHCoeffs_(false) {
+	computeCommands_.reset(new gl::GLComputeCommands());
 	
 	initializeShaders();
 
+	setReadbackSlots(CorrReadbackSlots, SHReadbackSlots);
+
 	readPointMappingFile();
 }
 
+std::string Process::readShaderSource(const std::string& filename) {
+	AAsset* shaderAsset = AAssetManager_open(assetManager_, filename.c_str(), AASSET_MODE_BUFFER);
+	if (!shaderAsset) {
+		LOGE("Unable to open %s", filename.c_str());
+		return std::string();
+	}
+
+	const void *shaderBuf = AAsset_getBuffer(shaderAsset);
+	off_t shaderLength = AAsset_getLength(shaderAsset);
+	std::string shaderSource = std::string((const char*)shaderBuf, (size_t)shaderLength);
+	AAsset_close(shaderAsset);
+
+	return shaderSource;
+}
+
 GLuint Process::createComputeShaderProgram(const std::string& filename) {
-	AAsset* computeShaderAsset = AAssetManager_open(assetManager_, filename.c_str(), AASSET_MODE_BUFFER);
-	const void *computeShaderBuf = AAsset_getBuffer(computeShaderAsset);
-	off_t computeShaderLength = AAsset_getLength(computeShaderAsset);
-	std::string computeShaderSource = std::string((const char*)computeShaderBuf, (size_t)computeShaderLength);
-	AAsset_close(computeShaderAsset);
+	std::string computeShaderSource = readShaderSource(filename);
 
 	return gl::util::createProgram(computeShaderSource.c_str());
 }
 
+SHADER_OBJECT Process::createReductionShaderProgram(const std::string& filename, const glm::ivec2& localSize, const std::vector<std::string>& types) {
+	std::string source;
+	if (!assembleReductionShader(filename, localSize, types, source))
+		return 0;
+
+	return gl::util::createProgram(source.c_str());
+}
+
 void Process::initializeShaders() {
   // Convert YUV420 -> Color
 	LOGI("colorImage.comp");
@@ -403,6 +539,9 @@ void Process::initializeShaders() {
 	// Mark points as reliable
 	LOGI("depthMapMarkReliable.comp");
 	shaderProgram3_ = createComputeShaderProgram("shaders/depthMapMarkReliable.comp");
+
+	radiusLocation_ = glGetUniformLocation(shaderProgram3_, "radius");
+	limitChiSquareLocation_ = glGetUniformLocation(shaderProgram3_, "limitChiSquare");
 	
 	// Fill holes
 	LOGI("depthMapFillHoles.comp");
@@ -414,6 +553,18 @@ void Process::initializeShaders() {
 	coeff_imLocation4_ = glGetUniformLocation(shaderProgram4_, "coeff_im");
 	fillWithMaxLocation_ = glGetUniformLocation(shaderProgram4_, "fillWithMax");
 
+	// Fused mark reliable and fill holes
+	LOGI("depthMapPreprocess.comp");
+	shaderProgram12_ = createComputeShaderProgram("shaders/depthMapPreprocess.comp");
+
+	f_imLocation12_ = glGetUniformLocation(shaderProgram12_, "f_im");
+	c_imLocation12_ = glGetUniformLocation(shaderProgram12_, "c_im");
+	pose_imLocation12_ = glGetUniformLocation(shaderProgram12_, "pose_im");
+	coeff_imLocation12_ = glGetUniformLocation(shaderProgram12_, "coeff_im");
+	fillWithMaxLocation12_ = glGetUniformLocation(shaderProgram12_, "fillWithMax");
+	radiusLocation12_ = glGetUniformLocation(shaderProgram12_, "radius");
+	limitChiSquareLocation12_ = glGetUniformLocation(shaderProgram12_, "limitChiSquare");
+
 	// Environment map samples
 	LOGI("environmentMapSample.comp");
 	shaderProgram5_ = createComputeShaderProgram("shaders/environmentMapSample.comp");
@@ -424,6 +575,8 @@ void Process::initializeShaders() {
 	textureSamplesRef_.reset(new gl::Texture(DepthMapWidth, DepthMapHeight, 4, GL_FLOAT, NULL));
 	textureSamplesCur_.reset(new gl::Texture(DepthMapWidth, DepthMapHeight, 4, GL_FLOAT, NULL));
 	textureSamplesData_.reset(new gl::Texture(DepthMapWidth, DepthMapHeight, 4, GL_FLOAT, NULL));
+	textureCoverage_.reset(new gl::Texture(EnvironmentMapWidth, EnvironmentMapHeight, 1, GL_UNSIGNED_INT, NULL));
+	textureCoverageWarped_.reset(new gl::Texture(EnvironmentMapWidth, EnvironmentMapHeight, 1, GL_UNSIGNED_INT, NULL));
 
 	pose_pcLocation_ = glGetUniformLocation(shaderProgram5_, "pose_pc");
 	devPosLocation_ = glGetUniformLocation(shaderProgram5_, "devPos");
@@ -432,29 +585,14 @@ void Process::initializeShaders() {
 
 	// Environment map colour correction matrix
 	LOGI("environmentMapCorrect.comp");
-	shaderProgram6_ = createComputeShaderProgram("shaders/environmentMapCorrect.comp");
+	shaderProgram6_ = createReductionShaderProgram("environmentMapCorrect.comp", CorrLocalSize, { "float", "vec3", "mat3" });
 	
-	int accWidth = DepthMapWidth / (NbrDiv*4.f);
-	int accHeight = DepthMapHeight / (NbrDiv*4.f);
-	textureMatAAcc_.reset(new gl::Texture(accWidth * 3, accHeight * 3, 1, GL_FLOAT, NULL));
-	textureMatBAcc_.reset(new gl::Texture(accWidth * 3, accHeight * 3, 1, GL_FLOAT, NULL));
-	textureWCurAcc_.reset(new gl::Texture(accWidth * 3, accHeight, 1, GL_FLOAT, NULL));
-	textureWRefAcc_.reset(new gl::Texture(accWidth * 3, accHeight, 1, GL_FLOAT, NULL));
-	textureUsedAcc_.reset(new gl::Texture(accWidth, accHeight, 1, GL_FLOAT, NULL));
-	textureFinalData_.reset(new gl::Texture(7, 3, 1, GL_FLOAT, NULL));
-
-	numWGLocation6_ = glGetUniformLocation(shaderProgram6_, "numWG");
-
-	// Environment map error estimation
-	LOGI("environmentMapError.comp");
-	shaderProgram7_ = createComputeShaderProgram("shaders/environmentMapError.comp");
-
-	textureErrorAcc_.reset(new gl::Texture(accWidth, accHeight, 1, GL_FLOAT, NULL));
-	textureCountAcc_.reset(new gl::Texture(accWidth, accHeight, 1, GL_FLOAT, NULL));
-	textureFinalError_.reset(new gl::Texture(1, 1, 1, GL_FLOAT, NULL));
-
-	corrMtxLocation7_ = glGetUniformLocation(shaderProgram7_, "corrMtx");
-  numWGLocation7_ = glGetUniformLocation(shaderProgram7_, "numWG");
+	textureMatAAcc_.reset(new gl::Texture(CorrWorkGroups.x * 3, CorrWorkGroups.y * 6, 1, GL_FLOAT, NULL)); // Unweighted moments in the lower half
+	textureMatBAcc_.reset(new gl::Texture(CorrWorkGroups.x * 3, CorrWorkGroups.y * 6, 1, GL_FLOAT, NULL));
+	textureWCurAcc_.reset(new gl::Texture(CorrWorkGroups.x * 3, CorrWorkGroups.y, 1, GL_FLOAT, NULL));
+	textureWRefAcc_.reset(new gl::Texture(CorrWorkGroups.x * 3, CorrWorkGroups.y, 1, GL_FLOAT, NULL));
+	textureUsedAcc_.reset(new gl::Texture(CorrWorkGroups.x * 3, CorrWorkGroups.y, 1, GL_FLOAT, NULL));
+	textureFinalData_.reset(new gl::Texture(FinalDataWidth, 3, 1, GL_FLOAT, NULL));
 
 	// Environment map project
 	LOGI("environmentMapProject.comp");
@@ -462,10 +600,43 @@ void Process::initializeShaders() {
 	
 	corrMtxLocation8_ = glGetUniformLocation(shaderProgram8_, "corrMtx");
 	withinTrustedSphereLocation_ = glGetUniformLocation(shaderProgram8_, "withinTrustedSphere");
+	frameIdxLocation8_ = glGetUniformLocation(shaderProgram8_, "frameIdx");
+
+	// Environment map project (sorted scatter)
+	LOGI("environmentMapProjectKeys.comp");
+	shaderProgram13_ = createComputeShaderProgram("shaders/environmentMapProjectKeys.comp");
+
+	textureSortElements1_.reset(new gl::Texture(DepthMapWidth, DepthMapHeight, 4, GL_UNSIGNED_INT, NULL));
+	textureSortElements2_.reset(new gl::Texture(DepthMapWidth, DepthMapHeight, 4, GL_UNSIGNED_INT, NULL));
+	textureDigitOffsets_.reset(new gl::Texture(SortNbrGroups, SortNbrDigits, 1, GL_UNSIGNED_INT, NULL));
+	textureProjected_.reset(new gl::Texture(DepthMapWidth, DepthMapHeight, 4, GL_FLOAT, NULL));
+
+	corrMtxLocation13_ = glGetUniformLocation(shaderProgram13_, "corrMtx");
+	withinTrustedSphereLocation13_ = glGetUniformLocation(shaderProgram13_, "withinTrustedSphere");
+	envMapSizeLocation13_ = glGetUniformLocation(shaderProgram13_, "envMapSize");
+
+	LOGI("radixSort.comp");
+	shaderProgram14_ = createComputeShaderProgram("shaders/radixSort.comp");
+
+	nbrElementsLocation14_ = glGetUniformLocation(shaderProgram14_, "nbrElements");
+	shiftLocation14_ = glGetUniformLocation(shaderProgram14_, "shift");
+	scatterLocation14_ = glGetUniformLocation(shaderProgram14_, "scatter");
+
+	LOGI("radixSortScan.comp");
+	shaderProgram15_ = createComputeShaderProgram("shaders/radixSortScan.comp");
+
+	nbrGroupsLocation15_ = glGetUniformLocation(shaderProgram15_, "nbrGroups");
+
+	LOGI("environmentMapResolve.comp");
+	shaderProgram16_ = createComputeShaderProgram("shaders/environmentMapResolve.comp");
+
+	nbrElementsLocation16_ = glGetUniformLocation(shaderProgram16_, "nbrElements");
+	modeLocation16_ = glGetUniformLocation(shaderProgram16_, "mode");
+	frameIdxLocation16_ = glGetUniformLocation(shaderProgram16_, "frameIdx");
 
   // Spherical coefficients
   LOGI("envMapSHCoefficients.comp");
-  shaderProgram9_ = createComputeShaderProgram("shaders/envMapSHCoefficients.comp");
+  shaderProgram9_ = createReductionShaderProgram("envMapSHCoefficients.comp", SHLocalSize, { "vec4" });
 
   const std::shared_ptr<glm::vec2> randomSphCoords = sh::SphericalHarmonics::getRandomSphericalCoords();
   GL_CHECK(textureRandomSamples_.reset(new gl::Texture(RandSamplesWidth, RandSamplesHeight, 4, GL_FLOAT, (unsigned char*)randomSphCoords.get())));
@@ -477,7 +648,6 @@ void Process::initializeShaders() {
 	GL_CHECK(textureCoeffFinal2_.reset(new gl::Texture(1, NbrCoefficients, 4, GL_FLOAT, NULL)));
 	textureCoeffFinalCur_ = textureCoeffFinal1_;
 
-  numWGLocation9_ = glGetUniformLocation(shaderProgram9_, "numWG");
 	maxOrderLocation_ = glGetUniformLocation(shaderProgram9_, "maxOrder");
 
 	// Environment map relocate
@@ -550,7 +720,49 @@ void Process::addFrame(const TangoPointCloud* pointCloud, const TangoPoseData* p
 }
 #endif
 
+bool Process::assembleReductionShader(const std::string& filename, const glm::ivec2& localSize, const std::vector<std::string>& types, std::string& source) {
+	gl::ShaderSource shaderSource(readShaderSource(ShaderDir + filename));
+	if (!shaderSource.setLocalSize(localSize.x, localSize.y))
+		return false;
+
+	for (size_t i = 0; i < types.size(); i++)
+		shaderSource.addReductionType(types[i]);
+
+	return shaderSource.assemble(readShaderSource(ShaderDir + "reduction.glsl"), readShaderSource(ShaderDir + "reductionType.glsl"), source);
+}
+
+void Process::resetReductionCounter() {
+	GLuint zero = 0;
+
+	if (!reductionCounter_) {
+		glGenBuffers(1, &reductionCounter_);
+		glBindBuffer(GL_ATOMIC_COUNTER_BUFFER, reductionCounter_);
+		glBufferData(GL_ATOMIC_COUNTER_BUFFER, sizeof(GLuint), &zero, GL_DYNAMIC_DRAW);
+	} else {
+		glBindBuffer(GL_ATOMIC_COUNTER_BUFFER, reductionCounter_);
+		glBufferSubData(GL_ATOMIC_COUNTER_BUFFER, 0, sizeof(GLuint), &zero);
+	}
+
+	glBindBufferBase(GL_ATOMIC_COUNTER_BUFFER, 0, reductionCounter_);
+	glBindBuffer(GL_ATOMIC_COUNTER_BUFFER, 0);
+}
+
+void Process::setReadbackSlots(size_t corrSlots, size_t shSlots) {
+	size_t corrSize = textureFinalData_->width()*textureFinalData_->height()*textureFinalData_->channels()*textureFinalData_->sizeBytes();
+	corrReadback_.reset(new gl::PixelPackReadback());
+	corrRing_.reset(new gl::ReadbackRing(corrReadback_, corrSlots, corrSize));
+
+	shReadback_.reset(new gl::PixelPackReadback());
+	shRing_.reset(new gl::ReadbackRing(shReadback_, shSlots, NbrCoefficients*sizeof(glm::vec4)));
+	if (!shCoeffs_)
+		shCoeffs_.reset(new glm::vec4[NbrCoefficients], std::default_delete<glm::vec4[]>());
+	hasSHCoeffs_ = false;
+}
+
 void Process::runEMShaders(float confidence, bool project, bool calculateSH) {
+	frameIdx_++;
+	scheduler_.resetCounters();
+
 	/*if (curProject_ != project) {
 #ifdef __ANDROID__
 		if (project)
@@ -562,148 +774,210 @@ void Process::runEMShaders(float confidence, bool project, bool calculateSH) {
 		curProject_ = project;
 	}*/
 
-	GLuint wgX, wgY;
+	GLuint wgX = ceil(textureColorImg_->width() / NbrDiv);
+	GLuint wgY = ceil(textureColorImg_->height() / NbrDiv);
 	
 	// Convert YUV420 -> Color
-	STAT_START(ConvertRGB);
+	scheduler_.addStage("ConvertRGB", { gl::ResourceAccess(textureY_.get(), gl::AccessImageLoad), gl::ResourceAccess(textureC_.get(), gl::AccessImageLoad),
+		gl::ResourceAccess(textureColorImg_.get(), gl::AccessImageStore) }, [=]() {
+		STAT_START(ConvertRGB);
 #ifdef _WINDOWS
-	shaderProgram1_->bind();
+		shaderProgram1_->bind();
 #elif __ANDROID__
-	glUseProgram(shaderProgram1_);
+		glUseProgram(shaderProgram1_);
 #endif
-	wgX = ceil(textureColorImg_->width() / NbrDiv);
-	wgY = ceil(textureColorImg_->height() / NbrDiv);
-	GL_CHECK(textureY_->bind(0, GL_READ_ONLY));
-	GL_CHECK(textureC_->bind(1, GL_READ_ONLY));
-	GL_CHECK(textureColorImg_->bind(2, GL_WRITE_ONLY));
-	glDispatchCompute(wgX, wgY, 1);
-	glBindImageTexture(0, 0, 0, false, 0, GL_READ_WRITE, GL_RGBA32F);
-	glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+		GL_CHECK(textureY_->bind(0, GL_READ_ONLY));
+		GL_CHECK(textureC_->bind(1, GL_READ_ONLY));
+		GL_CHECK(textureColorImg_->bind(2, GL_WRITE_ONLY));
+		glDispatchCompute(wgX, wgY, 1);
+		STAT_DISPATCH(ConvertRGB);
+		glBindImageTexture(0, 0, 0, false, 0, GL_READ_WRITE, GL_RGBA32F);
 #ifdef _WINDOWS
-	shaderProgram1_->release();
+		shaderProgram1_->release();
 #elif __ANDROID__
-	glUseProgram(0);
+		glUseProgram(0);
 #endif
-	STAT_STOP(ConvertRGB);
-	
+		STAT_STOP(ConvertRGB);
+	});
+
+	wgX = ceil(textureDepthMap1_->width() / NbrDiv);
+	wgY = ceil(textureDepthMap1_->height() / NbrDiv);
+
 	// Depth map Initialization
-	STAT_START(DepthMapInit);
+	scheduler_.addStage("DepthMapInit", { gl::ResourceAccess(textureDepthMap1_.get(), gl::AccessTextureUpdate), gl::ResourceAccess(textureDepthMap2_.get(), gl::AccessTextureUpdate),
+		gl::ResourceAccess(texturePointsMap1_.get(), gl::AccessTextureUpdate), gl::ResourceAccess(texturePointsMap2_.get(), gl::AccessTextureUpdate),
+		gl::ResourceAccess(texturePointCloud_.get(), gl::AccessImageLoad), gl::ResourceAccess(textureColorImg_.get(), gl::AccessImageLoad),
+		gl::ResourceAccess(textureDepthMap1_.get(), gl::AccessImageStore), gl::ResourceAccess(texturePointsMap1_.get(), gl::AccessImageStore) }, [=]() {
+		STAT_START(DepthMapInit);
 #ifdef _WINDOWS
-	shaderProgram2_->bind();
+		shaderProgram2_->bind();
 #elif __ANDROID__
-	glUseProgram(shaderProgram2_);
+		glUseProgram(shaderProgram2_);
 #endif
-	textureDepthMap1_->clearTexture();
-	textureDepthMap2_->clearTexture();
-	texturePointsMap1_->clearTexture();
-	texturePointsMap2_->clearTexture();
-	wgX = ceil(textureDepthMap1_->width() / NbrDiv);
-	wgY = ceil(textureDepthMap1_->height() / NbrDiv);
-	GL_CHECK(texturePointCloud_->bind(0, GL_READ_ONLY));
-	GL_CHECK(textureColorImg_->bind(1, GL_READ_ONLY));
-	GL_CHECK(textureDepthMap1_->bind(2, GL_WRITE_ONLY));
-	GL_CHECK(texturePointsMap1_->bind(3, GL_WRITE_ONLY));
-	glUniform2fv(f_pcLocation_, 1, glm::value_ptr(glm::vec2(pcData_.f_)));
-	glUniform2fv(c_pcLocation_, 1, glm::value_ptr(glm::vec2(pcData_.c_)));
-	glUniform1fv(coeff_pcLocation_, 5, pcData_.distortionF_);
-	glUniform2fv(f_imLocation2_, 1, glm::value_ptr(glm::vec2(imData_.f_)));
-	glUniform2fv(c_imLocation2_, 1, glm::value_ptr(glm::vec2(imData_.c_)));
-	glUniform1fv(coeff_imLocation2_, 5, imData_.distortionF_);
-	glUniformMatrix4fv(pose_imLocation2_, 1, GL_FALSE, glm::value_ptr(imPose_));
-	glUniform1f(minConfidenceLocation_, confidence);
-	glUniform1i(nbrPointsLocation_, pcData_.nbrPoints_);
-	glDispatchCompute(wgX, wgY, 1);
-	glBindImageTexture(0, 0, 0, false, 0, GL_READ_WRITE, GL_RGBA32F);
-	glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+		textureDepthMap1_->clearTexture();
+		textureDepthMap2_->clearTexture();
+		texturePointsMap1_->clearTexture();
+		texturePointsMap2_->clearTexture();
+		GL_CHECK(texturePointCloud_->bind(0, GL_READ_ONLY));
+		GL_CHECK(textureColorImg_->bind(1, GL_READ_ONLY));
+		GL_CHECK(textureDepthMap1_->bind(2, GL_WRITE_ONLY));
+		GL_CHECK(texturePointsMap1_->bind(3, GL_WRITE_ONLY));
+		glUniform2fv(f_pcLocation_, 1, glm::value_ptr(glm::vec2(pcData_.f_)));
+		glUniform2fv(c_pcLocation_, 1, glm::value_ptr(glm::vec2(pcData_.c_)));
+		glUniform1fv(coeff_pcLocation_, 5, pcData_.distortionF_);
+		glUniform2fv(f_imLocation2_, 1, glm::value_ptr(glm::vec2(imData_.f_)));
+		glUniform2fv(c_imLocation2_, 1, glm::value_ptr(glm::vec2(imData_.c_)));
+		glUniform1fv(coeff_imLocation2_, 5, imData_.distortionF_);
+		glUniformMatrix4fv(pose_imLocation2_, 1, GL_FALSE, glm::value_ptr(imPose_));
+		glUniform1f(minConfidenceLocation_, confidence);
+		glUniform1i(nbrPointsLocation_, pcData_.nbrPoints_);
+		glDispatchCompute(wgX, wgY, 1);
+		STAT_DISPATCH(DepthMapInit);
+		glBindImageTexture(0, 0, 0, false, 0, GL_READ_WRITE, GL_RGBA32F);
 #ifdef _WINDOWS
-  shaderProgram2_->release();
+		shaderProgram2_->release();
 #elif __ANDROID__
-	glUseProgram(0);
+		glUseProgram(0);
 #endif
-	STAT_STOP(DepthMapInit);
-
-	// Mark points as reliable
-	STAT_START(DepthMapReliable);
+		STAT_STOP(DepthMapInit);
+	});
+
+	if (fusedDepthPreprocessing_) {
+		// Mark points as reliable and fill holes
+		scheduler_.addStage("DepthMapPreprocess", { gl::ResourceAccess(textureColorImg_.get(), gl::AccessImageLoad), gl::ResourceAccess(texturePtMappingMap_.get(), gl::AccessImageLoad),
+			gl::ResourceAccess(textureDepthMap1_.get(), gl::AccessImageLoad), gl::ResourceAccess(textureDepthMap2_.get(), gl::AccessImageStore),
+			gl::ResourceAccess(texturePointsMap1_.get(), gl::AccessImageLoad), gl::ResourceAccess(texturePointsMap2_.get(), gl::AccessImageStore) }, [=]() {
+			STAT_START(DepthMapHoleFilling);
 #ifdef _WINDOWS
-	shaderProgram3_->bind();
+			shaderProgram12_->bind();
 #elif __ANDROID__
-	glUseProgram(shaderProgram3_);
+			glUseProgram(shaderProgram12_);
 #endif
-	GL_CHECK(textureDepthMap1_->bind(0, GL_READ_ONLY));
-	GL_CHECK(texturePointsMap1_->bind(1, GL_READ_ONLY));
-	GL_CHECK(texturePointsMap2_->bind(2, GL_WRITE_ONLY));
-	GL_CHECK(glDispatchCompute(wgX, wgY, 1));
-	GL_CHECK(glBindImageTexture(0, 0, 0, false, 0, GL_READ_WRITE, GL_RGBA32F));
-	GL_CHECK(glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT));
+			GL_CHECK(textureColorImg_->bind(0, GL_READ_ONLY));
+			GL_CHECK(texturePtMappingMap_->bind(1, GL_READ_ONLY));
+			GL_CHECK(textureDepthMap1_->bind(2, GL_READ_ONLY));
+			GL_CHECK(textureDepthMap2_->bind(3, GL_WRITE_ONLY));
+			GL_CHECK(texturePointsMap1_->bind(4, GL_READ_ONLY));
+			GL_CHECK(texturePointsMap2_->bind(5, GL_WRITE_ONLY));
+			glUniform2fv(f_imLocation12_, 1, glm::value_ptr(glm::vec2(imData_.f_)));
+			glUniform2fv(c_imLocation12_, 1, glm::value_ptr(glm::vec2(imData_.c_)));
+			glUniform1fv(coeff_imLocation12_, 5, imData_.distortionF_);
+			glUniformMatrix4fv(pose_imLocation12_, 1, GL_FALSE, glm::value_ptr(imPose_));
+			glUniform1i(fillWithMaxLocation12_, false);
+			glUniform1i(radiusLocation12_, reliabilityWindow_ / 2);
+			glUniform1f(limitChiSquareLocation12_, depth::DepthMap::limitChiSquare(reliabilityWindow_));
+			glDispatchCompute(wgX, wgY, 1);
+			STAT_DISPATCH(DepthMapHoleFilling);
+			glBindImageTexture(0, 0, 0, false, 0, GL_READ_WRITE, GL_RGBA32F);
 #ifdef _WINDOWS
-  shaderProgram3_->release();
+			shaderProgram12_->release();
 #elif __ANDROID__
-	glUseProgram(0);
+			glUseProgram(0);
 #endif
-	STAT_STOP(DepthMapReliable);
-
-	// Fill holes
-	STAT_START(DepthMapHoleFilling);
+			STAT_STOP(DepthMapHoleFilling);
+		});
+	} else {
+		// Mark points as reliable
+		scheduler_.addStage("DepthMapReliable", { gl::ResourceAccess(textureDepthMap1_.get(), gl::AccessImageLoad), gl::ResourceAccess(texturePointsMap1_.get(), gl::AccessImageLoad),
+			gl::ResourceAccess(texturePointsMap2_.get(), gl::AccessImageStore) }, [=]() {
+			STAT_START(DepthMapReliable);
 #ifdef _WINDOWS
-	shaderProgram4_->bind();
+			shaderProgram3_->bind();
 #elif __ANDROID__
-	glUseProgram(shaderProgram4_);
+			glUseProgram(shaderProgram3_);
 #endif
-	GL_CHECK(textureColorImg_->bind(0, GL_READ_ONLY));
-	GL_CHECK(texturePtMappingMap_->bind(1, GL_READ_ONLY));
-	GL_CHECK(textureDepthMap1_->bind(2, GL_READ_ONLY));
-	GL_CHECK(textureDepthMap2_->bind(3, GL_WRITE_ONLY));
-	GL_CHECK(texturePointsMap2_->bind(4, GL_READ_ONLY));
-	GL_CHECK(texturePointsMap1_->bind(5, GL_WRITE_ONLY));
-	glUniform2fv(f_imLocation4_, 1, glm::value_ptr(glm::vec2(imData_.f_)));
-	glUniform2fv(c_imLocation4_, 1, glm::value_ptr(glm::vec2(imData_.c_)));
-	glUniform1fv(coeff_imLocation4_, 5, imData_.distortionF_);
-	glUniformMatrix4fv(pose_imLocation4_, 1, GL_FALSE, glm::value_ptr(imPose_));
-	glUniform1i(fillWithMaxLocation_, false);
-	glDispatchCompute(wgX, wgY, 1);
-	glBindImageTexture(0, 0, 0, false, 0, GL_READ_WRITE, GL_RGBA32F);
-	glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+			GL_CHECK(textureDepthMap1_->bind(0, GL_READ_ONLY));
+			GL_CHECK(texturePointsMap1_->bind(1, GL_READ_ONLY));
+			GL_CHECK(texturePointsMap2_->bind(2, GL_WRITE_ONLY));
+			glUniform1i(radiusLocation_, reliabilityWindow_ / 2);
+			glUniform1f(limitChiSquareLocation_, depth::DepthMap::limitChiSquare(reliabilityWindow_));
+			GL_CHECK(glDispatchCompute(wgX, wgY, 1));
+			STAT_DISPATCH(DepthMapReliable);
+			GL_CHECK(glBindImageTexture(0, 0, 0, false, 0, GL_READ_WRITE, GL_RGBA32F));
 #ifdef _WINDOWS
-  shaderProgram4_->release();
+			shaderProgram3_->release();
 #elif __ANDROID__
-	glUseProgram(0);
+			glUseProgram(0);
+#endif
+			STAT_STOP(DepthMapReliable);
+		});
+
+		// Fill holes
+		scheduler_.addStage("DepthMapHoleFilling", { gl::ResourceAccess(textureColorImg_.get(), gl::AccessImageLoad), gl::ResourceAccess(texturePtMappingMap_.get(), gl::AccessImageLoad),
+			gl::ResourceAccess(textureDepthMap1_.get(), gl::AccessImageLoad), gl::ResourceAccess(textureDepthMap2_.get(), gl::AccessImageStore),
+			gl::ResourceAccess(texturePointsMap2_.get(), gl::AccessImageLoad), gl::ResourceAccess(texturePointsMap1_.get(), gl::AccessImageStore) }, [=]() {
+			STAT_START(DepthMapHoleFilling);
+#ifdef _WINDOWS
+			shaderProgram4_->bind();
+#elif __ANDROID__
+			glUseProgram(shaderProgram4_);
 #endif
-	STAT_STOP(DepthMapHoleFilling);
+			GL_CHECK(textureColorImg_->bind(0, GL_READ_ONLY));
+			GL_CHECK(texturePtMappingMap_->bind(1, GL_READ_ONLY));
+			GL_CHECK(textureDepthMap1_->bind(2, GL_READ_ONLY));
+			GL_CHECK(textureDepthMap2_->bind(3, GL_WRITE_ONLY));
+			GL_CHECK(texturePointsMap2_->bind(4, GL_READ_ONLY));
+			GL_CHECK(texturePointsMap1_->bind(5, GL_WRITE_ONLY));
+			glUniform2fv(f_imLocation4_, 1, glm::value_ptr(glm::vec2(imData_.f_)));
+			glUniform2fv(c_imLocation4_, 1, glm::value_ptr(glm::vec2(imData_.c_)));
+			glUniform1fv(coeff_imLocation4_, 5, imData_.distortionF_);
+			glUniformMatrix4fv(pose_imLocation4_, 1, GL_FALSE, glm::value_ptr(imPose_));
+			glUniform1i(fillWithMaxLocation_, false);
+			glDispatchCompute(wgX, wgY, 1);
+			STAT_DISPATCH(DepthMapHoleFilling);
+			glBindImageTexture(0, 0, 0, false, 0, GL_READ_WRITE, GL_RGBA32F);
+#ifdef _WINDOWS
+			shaderProgram4_->release();
+#elif __ANDROID__
+			glUseProgram(0);
+#endif
+			STAT_STOP(DepthMapHoleFilling);
+		});
+	}
+
+	// The fused pass writes the final points in the second map
+	std::shared_ptr<gl::Texture> pointsMap = fusedDepthPreprocessing_ ? texturePointsMap2_ : texturePointsMap1_;
 
 	// Environment map samples
-	STAT_START(EMSampling);
 	glm::vec3 devPos(pcPose_[3][0], pcPose_[3][1], pcPose_[3][2]);
 	glm::vec3 devOr(devPos - emOrigin_);
 	glm::vec3 devDir(pcPose_[2][0], pcPose_[2][1], pcPose_[2][2]);
 	devDir = glm::normalize(devDir);
 
+	scheduler_.addStage("EMSampling", { gl::ResourceAccess(textureSamplesRef_.get(), gl::AccessTextureUpdate), gl::ResourceAccess(textureSamplesCur_.get(), gl::AccessTextureUpdate),
+		gl::ResourceAccess(textureSamplesData_.get(), gl::AccessTextureUpdate), gl::ResourceAccess(textureDepthMap2_.get(), gl::AccessImageLoad),
+		gl::ResourceAccess(pointsMap.get(), gl::AccessImageLoad), gl::ResourceAccess(textureEnvironmentMapCur_.get(), gl::AccessImageLoad),
+		gl::ResourceAccess(textureSamplesRef_.get(), gl::AccessImageStore), gl::ResourceAccess(textureSamplesCur_.get(), gl::AccessImageStore),
+		gl::ResourceAccess(textureSamplesData_.get(), gl::AccessImageStore) }, [=]() {
+		STAT_START(EMSampling);
 #ifdef _WINDOWS
-	shaderProgram5_->bind();
+		shaderProgram5_->bind();
 #elif __ANDROID__
-	glUseProgram(shaderProgram5_);
+		glUseProgram(shaderProgram5_);
 #endif
-	textureSamplesRef_->clearTexture();
-	textureSamplesCur_->clearTexture();
-	textureSamplesData_->clearTexture();
-	GL_CHECK(textureDepthMap2_->bind(0, GL_READ_ONLY));
-	GL_CHECK(texturePointsMap1_->bind(1, GL_READ_ONLY));
-	GL_CHECK(textureEnvironmentMapCur_->bind(2, GL_READ_ONLY));
-	GL_CHECK(textureSamplesRef_->bind(3, GL_WRITE_ONLY));
-	GL_CHECK(textureSamplesCur_->bind(4, GL_WRITE_ONLY));
-	GL_CHECK(textureSamplesData_->bind(5, GL_WRITE_ONLY));
-	glUniformMatrix4fv(pose_pcLocation_, 1, GL_FALSE, glm::value_ptr(pcPose_));
-	glUniform3f(devPosLocation_, devPos.x, devPos.y, devPos.z);
-	glUniform3f(devOrLocation_, devOr.x, devOr.y, devOr.z);
-	glUniform3f(devDirLocation_, devDir.x, devDir.y, devDir.z);
-	glDispatchCompute(wgX, wgY, 1);
-	glBindImageTexture(0, 0, 0, false, 0, GL_READ_WRITE, GL_RGBA32F);
-	glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+		textureSamplesRef_->clearTexture();
+		textureSamplesCur_->clearTexture();
+		textureSamplesData_->clearTexture();
+		GL_CHECK(textureDepthMap2_->bind(0, GL_READ_ONLY));
+		GL_CHECK(pointsMap->bind(1, GL_READ_ONLY));
+		GL_CHECK(textureEnvironmentMapCur_->bind(2, GL_READ_ONLY));
+		GL_CHECK(textureSamplesRef_->bind(3, GL_WRITE_ONLY));
+		GL_CHECK(textureSamplesCur_->bind(4, GL_WRITE_ONLY));
+		GL_CHECK(textureSamplesData_->bind(5, GL_WRITE_ONLY));
+		glUniformMatrix4fv(pose_pcLocation_, 1, GL_FALSE, glm::value_ptr(pcPose_));
+		glUniform3f(devPosLocation_, devPos.x, devPos.y, devPos.z);
+		glUniform3f(devOrLocation_, devOr.x, devOr.y, devOr.z);
+		glUniform3f(devDirLocation_, devDir.x, devDir.y, devDir.z);
+		glDispatchCompute(wgX, wgY, 1);
+		STAT_DISPATCH(EMSampling);
+		glBindImageTexture(0, 0, 0, false, 0, GL_READ_WRITE, GL_RGBA32F);
 #ifdef _WINDOWS
-  shaderProgram5_->release();
+		shaderProgram5_->release();
 #elif __ANDROID__
-	glUseProgram(0);
+		glUseProgram(0);
 #endif
-	STAT_STOP(EMSampling);
+		STAT_STOP(EMSampling);
+	});
 
 	// For double-precision accuracy, it's done on CPU
 	if (!emIsEmpty_ && doColorCorrection_)
@@ -711,33 +985,50 @@ void Process::runEMShaders(float confidence, bool project, bool calculateSH) {
 
 	if (project && (((lastCorrError_ >= 0.f) && (lastCorrError_ < maxMSE_)) || emIsEmpty_)) {
 		// Environment map project
-		STAT_START(EMProjection);
 		float distToDev = sqrt(glm::dot(devOr, devOr));
 		bool trustedRadius = (distToDev <= TrustedRadius);
 
+		// The frames are counted from 1 as 0 marks the texels never observed, restarting once they don't fit anymore
+		if (coverageFrame_ >= CoverageMaxFrame) {
+			textureCoverage_->clearTexture();
+			coverageFrame_ = 0;
+		}
+		coverageFrame_++;
+		uint32_t coverageFrame = coverageFrame_;
+
+		if (scatterMode_ == ScatterUnordered) {
+			scheduler_.addStage("EMProjection", { gl::ResourceAccess(textureSamplesRef_.get(), gl::AccessImageLoad), gl::ResourceAccess(textureSamplesCur_.get(), gl::AccessImageLoad),
+				gl::ResourceAccess(textureSamplesData_.get(), gl::AccessImageLoad), gl::ResourceAccess(textureEnvironmentMapCur_.get(), gl::AccessImageStore),
+				gl::ResourceAccess(textureCoverage_.get(), gl::AccessImageLoad), gl::ResourceAccess(textureCoverage_.get(), gl::AccessImageStore) }, [=]() {
+				STAT_START(EMProjection);
 #ifdef _WINDOWS
-		shaderProgram8_->bind();
+				shaderProgram8_->bind();
 #elif __ANDROID__
-		glUseProgram(shaderProgram8_);
+				glUseProgram(shaderProgram8_);
 #endif
-		GL_CHECK(textureSamplesRef_->bind(0, GL_READ_ONLY));
-		GL_CHECK(textureSamplesCur_->bind(1, GL_READ_ONLY));
-		GL_CHECK(textureSamplesData_->bind(2, GL_READ_ONLY));
-		GL_CHECK(textureEnvironmentMapCur_->bind(3, GL_WRITE_ONLY));
-		glUniformMatrix3fv(corrMtxLocation8_, 1, GL_FALSE, glm::value_ptr(corrMtx_));
-		glUniform1i(withinTrustedSphereLocation_, trustedRadius);
-		glDispatchCompute(wgX, wgY, 1);
-		glBindImageTexture(0, 0, 0, false, 0, GL_READ_WRITE, GL_RGBA32F);
-		glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+				GL_CHECK(textureSamplesRef_->bind(0, GL_READ_ONLY));
+				GL_CHECK(textureSamplesCur_->bind(1, GL_READ_ONLY));
+				GL_CHECK(textureSamplesData_->bind(2, GL_READ_ONLY));
+				GL_CHECK(textureEnvironmentMapCur_->bind(3, GL_WRITE_ONLY));
+				GL_CHECK(textureCoverage_->bind(4, GL_READ_WRITE));
+				glUniformMatrix3fv(corrMtxLocation8_, 1, GL_FALSE, glm::value_ptr(corrMtx_));
+				glUniform1i(withinTrustedSphereLocation_, trustedRadius);
+				glUniform1ui(frameIdxLocation8_, coverageFrame);
+				glDispatchCompute(wgX, wgY, 1);
+				STAT_DISPATCH(EMProjection);
+				glBindImageTexture(0, 0, 0, false, 0, GL_READ_WRITE, GL_RGBA32F);
 #ifdef _WINDOWS
-    shaderProgram8_->release();
+				shaderProgram8_->release();
 #elif __ANDROID__
-		glUseProgram(0);
+				glUseProgram(0);
 #endif
-		STAT_STOP(EMProjection);
+				STAT_STOP(EMProjection);
+			});
+		} else {
+			projectSorted(trustedRadius, coverageFrame);
+		}
 
 		if (calculateSH) {
-			STAT_START(EMSHCoefficients);
 			updateSHCoefficients(textureEnvironmentMapCur_);
 			STAT_STOP(EMSHCoefficients);
 
@@ -751,14 +1042,223 @@ void Process::runEMShaders(float confidence, bool project, bool calculateSH) {
 
 		emIsEmpty_ = false;
 	}
+
+	// Hands over the textures to the rendering and to the uploads of the next frame
+	scheduler_.synchronize(*computeCommands_);
+	curTimeStats_.nbrStages = scheduler_.getNbrStages();
+	curTimeStats_.nbrBarriers = scheduler_.getNbrBarriers();
+}
+
+void Process::projectSorted(bool withinTrustedSphere, uint32_t coverageFrame) {
+	GLuint wgX = ceil(DepthMapWidth / NbrDiv);
+	GLuint wgY = ceil(DepthMapHeight / NbrDiv);
+
+	// Key (EM texel) and new value of every sample
+	scheduler_.addStage("EMProjectionKeys", { gl::ResourceAccess(textureSamplesRef_.get(), gl::AccessImageLoad), gl::ResourceAccess(textureSamplesCur_.get(), gl::AccessImageLoad),
+		gl::ResourceAccess(textureSamplesData_.get(), gl::AccessImageLoad), gl::ResourceAccess(textureSortElements1_.get(), gl::AccessImageStore),
+		gl::ResourceAccess(textureProjected_.get(), gl::AccessImageStore) }, [=]() {
+		STAT_START(EMProjection);
+#ifdef _WINDOWS
+		shaderProgram13_->bind();
+#elif __ANDROID__
+		glUseProgram(shaderProgram13_);
+#endif
+		GL_CHECK(textureSamplesRef_->bind(0, GL_READ_ONLY));
+		GL_CHECK(textureSamplesCur_->bind(1, GL_READ_ONLY));
+		GL_CHECK(textureSamplesData_->bind(2, GL_READ_ONLY));
+		GL_CHECK(textureSortElements1_->bind(3, GL_WRITE_ONLY));
+		GL_CHECK(textureProjected_->bind(4, GL_WRITE_ONLY));
+		glUniformMatrix3fv(corrMtxLocation13_, 1, GL_FALSE, glm::value_ptr(corrMtx_));
+		glUniform1i(withinTrustedSphereLocation13_, withinTrustedSphere);
+		glUniform2i(envMapSizeLocation13_, EnvironmentMapWidth, EnvironmentMapHeight);
+		glDispatchCompute(wgX, wgY, 1);
+		STAT_DISPATCH(EMProjection);
+		glBindImageTexture(0, 0, 0, false, 0, GL_READ_WRITE, GL_RGBA32F);
+#ifdef _WINDOWS
+		shaderProgram13_->release();
+#elif __ANDROID__
+		glUseProgram(0);
+#endif
+	});
+
+	// Radix sort by key, the elements ping-pong between both textures
+	std::shared_ptr<gl::Texture> elementsIn = textureSortElements1_;
+	std::shared_ptr<gl::Texture> elementsOut = textureSortElements2_;
+
+	int nbrPasses = SortedScatter::getNbrPasses(EnvironmentMapWidth*EnvironmentMapHeight);
+	for (int pass = 0; pass < nbrPasses; pass++) {
+		GLuint shift = pass*SortDigitBits;
+
+		// Digit counts of every work group
+		scheduler_.addStage("EMProjectionSortCount", { gl::ResourceAccess(elementsIn.get(), gl::AccessImageLoad),
+			gl::ResourceAccess(textureDigitOffsets_.get(), gl::AccessImageStore) }, [=]() {
+			dispatchRadixSort(elementsIn, elementsOut, shift, false);
+		});
+
+		// Digit counts -> first destination of every digit and work group
+		scheduler_.addStage("EMProjectionSortScan", { gl::ResourceAccess(textureDigitOffsets_.get(), gl::AccessImageLoad),
+			gl::ResourceAccess(textureDigitOffsets_.get(), gl::AccessImageStore) }, [=]() {
+#ifdef _WINDOWS
+			shaderProgram15_->bind();
+#elif __ANDROID__
+			glUseProgram(shaderProgram15_);
+#endif
+			GL_CHECK(textureDigitOffsets_->bind(0, GL_READ_WRITE));
+			glUniform1ui(nbrGroupsLocation15_, SortNbrGroups);
+			glDispatchCompute(1, 1, 1);
+			STAT_DISPATCH(EMProjection);
+			glBindImageTexture(0, 0, 0, false, 0, GL_READ_WRITE, GL_RGBA32F);
+#ifdef _WINDOWS
+			shaderProgram15_->release();
+#elif __ANDROID__
+			glUseProgram(0);
+#endif
+		});
+
+		// Elements moved to their destination
+		scheduler_.addStage("EMProjectionSortScatter", { gl::ResourceAccess(elementsIn.get(), gl::AccessImageLoad),
+			gl::ResourceAccess(textureDigitOffsets_.get(), gl::AccessImageLoad), gl::ResourceAccess(elementsOut.get(), gl::AccessImageStore) }, [=]() {
+			dispatchRadixSort(elementsIn, elementsOut, shift, true);
+		});
+
+		std::swap(elementsIn, elementsOut);
+	}
+
+	// Every texel stored once from its samples
+	scheduler_.addStage("EMProjectionResolve", { gl::ResourceAccess(elementsIn.get(), gl::AccessImageLoad), gl::ResourceAccess(textureProjected_.get(), gl::AccessImageLoad),
+		gl::ResourceAccess(textureEnvironmentMapCur_.get(), gl::AccessImageStore), gl::ResourceAccess(textureCoverage_.get(), gl::AccessImageLoad),
+		gl::ResourceAccess(textureCoverage_.get(), gl::AccessImageStore) }, [=]() {
+#ifdef _WINDOWS
+		shaderProgram16_->bind();
+#elif __ANDROID__
+		glUseProgram(shaderProgram16_);
+#endif
+		GL_CHECK(elementsIn->bind(0, GL_READ_ONLY));
+		GL_CHECK(textureProjected_->bind(1, GL_READ_ONLY));
+		GL_CHECK(textureEnvironmentMapCur_->bind(2, GL_WRITE_ONLY));
+		GL_CHECK(textureCoverage_->bind(3, GL_READ_WRITE));
+		glUniform1ui(nbrElementsLocation16_, DepthNbrPoints);
+		glUniform1i(modeLocation16_, scatterMode_);
+		glUniform1ui(frameIdxLocation16_, coverageFrame);
+		glDispatchCompute(SortNbrGroups, 1, 1);
+		STAT_DISPATCH(EMProjection);
+		glBindImageTexture(0, 0, 0, false, 0, GL_READ_WRITE, GL_RGBA32F);
+#ifdef _WINDOWS
+		shaderProgram16_->release();
+#elif __ANDROID__
+		glUseProgram(0);
+#endif
+		STAT_STOP(EMProjection);
+	});
+}
+
+void Process::dispatchRadixSort(std::shared_ptr<gl::Texture> elementsIn, std::shared_ptr<gl::Texture> elementsOut, GLuint shift, bool scatter) {
+#ifdef _WINDOWS
+	shaderProgram14_->bind();
+#elif __ANDROID__
+	glUseProgram(shaderProgram14_);
+#endif
+	GL_CHECK(elementsIn->bind(0, GL_READ_ONLY));
+	GL_CHECK(elementsOut->bind(1, GL_WRITE_ONLY));
+	GL_CHECK(textureDigitOffsets_->bind(2, scatter ? GL_READ_ONLY : GL_WRITE_ONLY));
+	glUniform1ui(nbrElementsLocation14_, DepthNbrPoints);
+	glUniform1ui(shiftLocation14_, shift);
+	glUniform1i(scatterLocation14_, scatter);
+	glDispatchCompute(SortNbrGroups, 1, 1);
+	STAT_DISPATCH(EMProjection);
+	glBindImageTexture(0, 0, 0, false, 0, GL_READ_WRITE, GL_RGBA32F);
+#ifdef _WINDOWS
+	shaderProgram14_->release();
+#elif __ANDROID__
+	glUseProgram(0);
+#endif
 }
 
 void Process::clear() {
 	textureEnvironmentMap1_->clearTexture();
 	textureEnvironmentMap2_->clearTexture();
+	textureCoverage_->clearTexture();
+	coverageFrame_ = 0;
 	emIsEmpty_ = true;
 }
 
+void Process::readCoverage(CoverageMap& coverage) {
+	std::vector<uint32_t> packed(EnvironmentMapWidth*EnvironmentMapHeight);
+	glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_FRAMEBUFFER_BARRIER_BIT);
+	textureCoverage_->writeTo(packed.data());
+
+	coverage.resize(EnvironmentMapWidth, EnvironmentMapHeight);
+	coverage.load(packed.data());
+}
+
+void Process::toSnapshot(EMSnapshot& snapshot) {
+	std::vector<glm::vec4> emData(EnvironmentMapWidth*EnvironmentMapHeight);
+	std::vector<uint32_t> coverage(EnvironmentMapWidth*EnvironmentMapHeight);
+	std::vector<glm::vec4> shCoeffs(NbrCoefficients);
+
+	glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_FRAMEBUFFER_BARRIER_BIT);
+	textureEnvironmentMapCur_->writeTo(emData.data());
+	textureCoverage_->writeTo(coverage.data());
+	textureCoeffFinalCur_->writeTo(shCoeffs.data());
+
+	snapshot.reset(EnvironmentMapWidth, EnvironmentMapHeight);
+	snapshot.setOrigin(emOrigin_);
+	snapshot.setCorrectionMatrix(corrMtx_);
+	snapshot.setFrameIndex(coverageFrame_);
+	snapshot.setSHCoefficients(shCoeffs.data(), shCoeffs.size());
+
+	// The texels never projected keep the value of the cleared textures
+	glm::vec4 emptyTexel(0.f);
+	uint32_t emptyCoverage = 0;
+	snapshot.addPlane(PlaneColorDepth, sizeof(glm::vec4), &emptyTexel, emData.data());
+	snapshot.addPlane(PlaneCoverage, sizeof(uint32_t), &emptyCoverage, coverage.data());
+}
+
+bool Process::fromSnapshot(const EMSnapshot& snapshot) {
+	const SnapshotPlane* emData = snapshot.getPlane(PlaneColorDepth);
+	if (snapshot.getWidth() != EnvironmentMapWidth || snapshot.getHeight() != EnvironmentMapHeight || !emData || emData->elementSize != sizeof(glm::vec4)) {
+		std::cout << "Snapshot doesn't match the EM textures" << std::endl;
+		return false;
+	}
+
+	textureEnvironmentMapCur_->updateData((void*)emData->data.data());
+
+	const SnapshotPlane* coverage = snapshot.getPlane(PlaneCoverage);
+	if (coverage && coverage->elementSize == sizeof(uint32_t) && snapshot.getFrameIndex() <= CoverageMaxFrame) {
+		textureCoverage_->updateData((void*)coverage->data.data());
+		coverageFrame_ = snapshot.getFrameIndex();
+	} else {
+		textureCoverage_->clearTexture();
+		coverageFrame_ = 0;
+	}
+
+	// The SH coefficients are calculated again with the next frame if they were stored with another order
+	const std::vector<glm::vec4>& shCoeffs = snapshot.getSHCoefficients();
+	if (shCoeffs.size() == (size_t)NbrCoefficients && shCoeffs_) {
+		textureCoeffFinalCur_->updateData((void*)shCoeffs.data());
+		std::copy(shCoeffs.begin(), shCoeffs.end(), shCoeffs_.get());
+		shCoeffsFrame_ = frameIdx_;
+		hasSHCoeffs_ = true;
+	}
+
+	emOrigin_ = emTranslatedOrigin_ = snapshot.getOrigin();
+	corrMtx_ = snapshot.getCorrectionMatrix();
+	invCorrMtx_ = glm::inverse(corrMtx_);
+	needsTranslateEM_ = false;
+	emIsEmpty_ = false;
+
+	return true;
+}
+
+bool Process::setReliabilityWindow(int size) {
+	if ((size != 3) && (size != 5))
+		return false;
+
+	reliabilityWindow_ = size;
+
+	return true;
+}
+
 void Process::readPointMappingFile() {
 	if(texturePtMappingMap_)
 		return;
@@ -777,82 +1277,79 @@ void Process::readPointMappingFile() {
 }
 
 glm::mat3 Process::calculateCorrectionMatrix() {
+	ColorMoments moments; // Pairs used for the error estimation
+
 #ifdef COLOR_CORRECTION_GPU
 	// Color correction - GPU Version
 	// First pass (Color correction)
-	STAT_START(EMColorCorrection);
+	scheduler_.addStage("EMColorCorrection", { gl::ResourceAccess(textureFinalData_.get(), gl::AccessTextureUpdate),
+		gl::ResourceAccess(&reductionCounter_, gl::AccessBufferUpdate), gl::ResourceAccess(&reductionCounter_, gl::AccessAtomicCounter),
+		gl::ResourceAccess(textureSamplesRef_.get(), gl::AccessImageLoad), gl::ResourceAccess(textureSamplesCur_.get(), gl::AccessImageLoad),
+		gl::ResourceAccess(textureMatAAcc_.get(), gl::AccessImageStore), gl::ResourceAccess(textureMatBAcc_.get(), gl::AccessImageStore),
+		gl::ResourceAccess(textureWCurAcc_.get(), gl::AccessImageStore), gl::ResourceAccess(textureWRefAcc_.get(), gl::AccessImageStore),
+		gl::ResourceAccess(textureUsedAcc_.get(), gl::AccessImageStore), gl::ResourceAccess(textureFinalData_.get(), gl::AccessImageStore) }, [=]() {
+		STAT_START(EMColorCorrection);
 #ifdef _WINDOWS
-	shaderProgram6_->bind();
+		shaderProgram6_->bind();
 #elif __ANDROID__
-	glUseProgram(shaderProgram6_);
+		glUseProgram(shaderProgram6_);
 #endif
-	GL_CHECK(textureMatAAcc_->clearTexture());
-	GL_CHECK(textureMatBAcc_->clearTexture());
-	GL_CHECK(textureWCurAcc_->clearTexture());
-	GL_CHECK(textureWRefAcc_->clearTexture());
-	GL_CHECK(textureUsedAcc_->clearTexture());
-	GL_CHECK(textureFinalData_->clearTexture());
-	GL_CHECK(textureSamplesRef_->bind(0, GL_READ_ONLY));
-	GL_CHECK(textureSamplesCur_->bind(1, GL_READ_ONLY));
-	GL_CHECK(textureMatAAcc_->bind(2, GL_READ_WRITE));
-	GL_CHECK(textureMatBAcc_->bind(3, GL_READ_WRITE));
-	GL_CHECK(textureWCurAcc_->bind(4, GL_READ_WRITE));
-	GL_CHECK(textureWRefAcc_->bind(5, GL_READ_WRITE));
-	GL_CHECK(textureUsedAcc_->bind(6, GL_READ_WRITE));
-	GL_CHECK(textureFinalData_->bind(7, GL_WRITE_ONLY));
-	glDispatchCompute(textureUsedAcc_->width(), textureUsedAcc_->height(), 1);
-	glBindImageTexture(0, 0, 0, false, 0, GL_READ_WRITE, GL_RGBA32F);
-	glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+		GL_CHECK(textureFinalData_->clearTexture());
+		GL_CHECK(textureSamplesRef_->bind(0, GL_READ_ONLY));
+		GL_CHECK(textureSamplesCur_->bind(1, GL_READ_ONLY));
+		GL_CHECK(textureMatAAcc_->bind(2, GL_READ_WRITE));
+		GL_CHECK(textureMatBAcc_->bind(3, GL_READ_WRITE));
+		GL_CHECK(textureWCurAcc_->bind(4, GL_READ_WRITE));
+		GL_CHECK(textureWRefAcc_->bind(5, GL_READ_WRITE));
+		GL_CHECK(textureUsedAcc_->bind(6, GL_READ_WRITE));
+		GL_CHECK(textureFinalData_->bind(7, GL_WRITE_ONLY));
+		resetReductionCounter();
+		glDispatchCompute(CorrWorkGroups.x, CorrWorkGroups.y, 1); // The last work group does the final accumulation
+		STAT_DISPATCH(EMColorCorrection);
+		glBindImageTexture(0, 0, 0, false, 0, GL_READ_WRITE, GL_RGBA32F);
 #ifdef _WINDOWS
-	shaderProgram6_->release();
+		shaderProgram6_->release();
 #elif __ANDROID__
-	glUseProgram(0);
+		glUseProgram(0);
 #endif
+	});
 
-	// Final accumulation
-#ifdef _WINDOWS
-	shaderProgram6_->bind();
-#elif __ANDROID__
-	glUseProgram(shaderProgram6_);
-#endif
-	GL_CHECK(textureSamplesRef_->bind(0, GL_READ_ONLY));
-	GL_CHECK(textureSamplesCur_->bind(1, GL_READ_ONLY));
-	GL_CHECK(textureMatAAcc_->bind(2, GL_READ_WRITE));
-	GL_CHECK(textureMatBAcc_->bind(3, GL_READ_WRITE));
-	GL_CHECK(textureWCurAcc_->bind(4, GL_READ_WRITE));
-	GL_CHECK(textureWRefAcc_->bind(5, GL_READ_WRITE));
-	GL_CHECK(textureUsedAcc_->bind(6, GL_READ_WRITE));
-	GL_CHECK(textureFinalData_->bind(7, GL_WRITE_ONLY));
-	glUniform2i(numWGLocation6_, textureUsedAcc_->width(), textureUsedAcc_->height());
-	glDispatchCompute(1, 1, 1);
-	glBindImageTexture(0, 0, 0, false, 0, GL_READ_WRITE, GL_RGBA32F);
-	glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
-#ifdef _WINDOWS
-	shaderProgram6_->release();
-#elif __ANDROID__
-	glUseProgram(0);
-#endif
+	scheduler_.addStage("EMColorCorrectionReadback", { gl::ResourceAccess(textureFinalData_.get(), gl::AccessPixelRead) }, [=]() {
+		size_t slot = corrRing_->acquire(frameIdx_);
+		corrReadback_->copyTexture(slot, *textureFinalData_);
+		corrRing_->submit(slot);
+	});
+	scheduler_.flush(*computeCommands_);
+
+	float finalData[FinalDataWidth * 3];
+	if (!corrRing_->retrieve(finalData, frameIdx_, lastCorrAge_)) { // Still in flight
+		STAT_STOP(EMColorCorrection);
 
-	float finalData[30];
-	textureFinalData_->writeTo(finalData);
+		lastCorrError_ = -1.0;
+		return corrMtx_;
+	}
 
 	glm::dmat3 gpuMatA;
 	glm::dmat3 gpuMatB;
 	for (int i = 0; i < 3; i++) {
 		for (int j = 0; j < 3; j++) {
-			gpuMatA[j][i] = finalData[i * 7 + j];
-			gpuMatB[j][i] = finalData[i * 7+ j + 3];
+			gpuMatA[j][i] = finalData[i * FinalDataWidth + j];
+			gpuMatB[j][i] = finalData[i * FinalDataWidth + j + 3];
 		}
 	}
 	uint32_t gpuUsedPoints = (uint32_t)finalData[6];
+	moments = ColorMoments::fromCorrectionData(finalData, FinalDataWidth);
 
 	if (gpuUsedPoints < MinNbrPoints) {
+		STAT_STOP(EMColorCorrection);
+
 		lastCorrError_ = -1.0;
 		return corrMtx_;
 	}
 
 	if (glm::determinant(gpuMatA) == 0) { // Non-invertible																		
 		std::cout << "Determinant is zero!" << std::endl;
+		STAT_STOP(EMColorCorrection);
 
 		lastCorrError_ = -1.0;
 		return corrMtx_;
@@ -909,6 +1406,8 @@ glm::mat3 Process::calculateCorrectionMatrix() {
 		if (std::abs(std::abs(sampleRef->a) - std::abs(sampleCur->a)) >= MaxDepthDiff) // If the difference with the current and current depth is larger than allowed
 			continue;
 
+		moments.addReliable(*sampleCur, *sampleRef); // Only reliable pairs are used for the error
+
 #ifdef WITH_EXTRA
 
 #ifdef WITH_SINGLE_PRECISION
@@ -984,6 +1483,8 @@ glm::mat3 Process::calculateCorrectionMatrix() {
 	}
 
 	if (usedPoints < MinNbrPoints) {
+		STAT_STOP(EMColorCorrection);
+
 		lastCorrError_ = -1.0;
 		return corrMtx_;
 	}
@@ -1012,6 +1513,7 @@ glm::mat3 Process::calculateCorrectionMatrix() {
 
 	if (glm::determinant(matA) == 0) { // Non-invertible																		
 		std::cout << "Determinant is zero!" << std::endl;
+		STAT_STOP(EMColorCorrection);
 
 		lastCorrError_ = -1.0;
 		return corrMtx_;
@@ -1030,56 +1532,12 @@ glm::mat3 Process::calculateCorrectionMatrix() {
 	STAT_STOP(EMColorCorrection);
 #endif
 
-	// First pass (MSE Error)
+	// Mean squared error in closed form from the moments accumulated with the normal equations
 	STAT_START(EMError);
-#ifdef _WINDOWS
-	shaderProgram7_->bind();
-#elif __ANDROID__
-	glUseProgram(shaderProgram7_);
-#endif
-	GL_CHECK(textureErrorAcc_->clearTexture());
-	GL_CHECK(textureCountAcc_->clearTexture());
-	GL_CHECK(textureFinalError_->clearTexture());
-	GL_CHECK(textureSamplesRef_->bind(0, GL_READ_ONLY));
-	GL_CHECK(textureSamplesCur_->bind(1, GL_READ_ONLY));
-	GL_CHECK(textureErrorAcc_->bind(2, GL_READ_WRITE));
-	GL_CHECK(textureCountAcc_->bind(3, GL_READ_WRITE));
-	GL_CHECK(textureFinalError_->bind(4, GL_WRITE_ONLY));
-	glUniformMatrix3fv(corrMtxLocation7_, 1, GL_FALSE, glm::value_ptr(newCorrMtx));
-	glDispatchCompute(textureErrorAcc_->width(), textureErrorAcc_->height(), 1);
-	glBindImageTexture(0, 0, 0, false, 0, GL_READ_WRITE, GL_RGBA32F);
-	glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
-#ifdef _WINDOWS
-	shaderProgram7_->release();
-#elif __ANDROID__
-	glUseProgram(0);
-#endif
-
-	// Final accumulation
-#ifdef _WINDOWS
-	shaderProgram7_->bind();
-#elif __ANDROID__
-	glUseProgram(shaderProgram7_);
-#endif
-	GL_CHECK(textureSamplesRef_->bind(0, GL_READ_ONLY));
-	GL_CHECK(textureSamplesCur_->bind(1, GL_READ_ONLY));
-	GL_CHECK(textureErrorAcc_->bind(2, GL_READ_WRITE));
-	GL_CHECK(textureCountAcc_->bind(3, GL_READ_WRITE));
-	GL_CHECK(textureFinalError_->bind(4, GL_WRITE_ONLY));
-	glUniform2i(numWGLocation7_, textureErrorAcc_->width(), textureErrorAcc_->height());
-	glDispatchCompute(1, 1, 1);
-	glBindImageTexture(0, 0, 0, false, 0, GL_READ_WRITE, GL_RGBA32F);
-	glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
-#ifdef _WINDOWS
-	shaderProgram7_->release();
-#elif __ANDROID__
-	glUseProgram(0);
-#endif
-
-	textureFinalError_->writeTo(&lastCorrError_);
+	lastCorrError_ = (float)moments.meanSquaredError(newCorrMtx);
 	STAT_STOP(EMError);
 
-	if (lastCorrError_ < maxMSE_) {
+	if ((lastCorrError_ >= 0.f) && (lastCorrError_ < maxMSE_)) {
 		invCorrMtx_ = glm::mat3(tmpInvCorrMtx_);
 
 		return newCorrMtx;
@@ -1122,6 +1580,26 @@ std::shared_ptr<glm::vec4> Process::getSHCoefficients() {
 	return shCoeffs;
 }
 
+std::shared_ptr<glm::vec4> Process::getSHCoefficients(uint64_t& age) {
+	uint64_t ringAge;
+	if (shRing_->retrieve(shCoeffs_.get(), frameIdx_, ringAge) || (!hasSHCoeffs_ && shRing_->retrieveNewest(shCoeffs_.get(), frameIdx_, ringAge))) {
+		shCoeffsFrame_ = frameIdx_ - ringAge;
+		hasSHCoeffs_ = true;
+	} else if (!hasSHCoeffs_) { // Nothing was calculated yet
+		textureCoeffFinalCur_->writeTo(shCoeffs_.get());
+		shCoeffsFrame_ = frameIdx_;
+		hasSHCoeffs_ = true;
+	}
+
+	age = frameIdx_ - shCoeffsFrame_;
+
+	std::shared_ptr<glm::vec4> shCoeffs;
+	shCoeffs.reset(new glm::vec4[NbrCoefficients], std::default_delete<glm::vec4[]>());
+	std::copy(shCoeffs_.get(), shCoeffs_.get() + NbrCoefficients, shCoeffs.get());
+
+	return shCoeffs;
+}
+
 void Process::translateEM() {
 	STAT_START(EMTranslate);
 
@@ -1143,11 +1621,15 @@ void Process::translateEM() {
 	glUseProgram(shaderProgram10_);
 #endif
 	destEnvMap->clearTexture();
+	textureCoverageWarped_->clearTexture();
 	GL_CHECK(textureEnvironmentMapCur_->bind(0, GL_READ_ONLY));
 	GL_CHECK(destEnvMap->bind(1, GL_WRITE_ONLY));
+	GL_CHECK(textureCoverage_->bind(2, GL_READ_ONLY));
+	GL_CHECK(textureCoverageWarped_->bind(3, GL_WRITE_ONLY));
 	glUniform3f(curOriginLocation_, emOrigin_.x, emOrigin_.y, emOrigin_.z);
 	glUniform3f(newOriginLocation_, emTranslatedOrigin_.x, emTranslatedOrigin_.y, emTranslatedOrigin_.z);
 	glDispatchCompute(textureEnvironmentMapCur_->width() / NbrDiv, textureEnvironmentMapCur_->height() / NbrDiv, 1);
+	STAT_DISPATCH(EMTranslate);
 	glBindImageTexture(0, 0, 0, false, 0, GL_READ_WRITE, GL_RGBA32F);
 	glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
 #ifdef _WINDOWS
@@ -1163,6 +1645,9 @@ void Process::translateEM() {
 	if (overwriteOld_) { // Swap environment maps
 		textureEnvironmentMapCur_ = destEnvMap;
 		emOrigin_ = emTranslatedOrigin_;
+
+		// The observations follow the texels they were made for, as in EnvironmentMap::fromWarp
+		std::swap(textureCoverage_, textureCoverageWarped_);
 	}	
 }
 
@@ -1183,56 +1668,47 @@ void Process::updateSHCoefficients(std::shared_ptr<gl::Texture> emTexture) {
 	if(textureCoeffFinalCur_ == textureCoeffFinal1_)
 		desTexture = textureCoeffFinal2_;
 
-	// SH coefficients	
+	// SH coefficients
+	scheduler_.addStage("EMSHCoefficients", { gl::ResourceAccess(desTexture.get(), gl::AccessTextureUpdate),
+		gl::ResourceAccess(&reductionCounter_, gl::AccessBufferUpdate), gl::ResourceAccess(&reductionCounter_, gl::AccessAtomicCounter),
+		gl::ResourceAccess(emTexture.get(), gl::AccessImageLoad), gl::ResourceAccess(textureRandomSamples_.get(), gl::AccessImageLoad),
+		gl::ResourceAccess(textureCoeffRAcc_.get(), gl::AccessImageStore), gl::ResourceAccess(textureCoeffGAcc_.get(), gl::AccessImageStore),
+		gl::ResourceAccess(textureCoeffBAcc_.get(), gl::AccessImageStore), gl::ResourceAccess(textureCoeffAAcc_.get(), gl::AccessImageStore),
+		gl::ResourceAccess(desTexture.get(), gl::AccessImageStore) }, [=]() {
+		STAT_START(EMSHCoefficients);
 #ifdef _WINDOWS
-	shaderProgram9_->bind();
+		shaderProgram9_->bind();
 #elif __ANDROID__
-	glUseProgram(shaderProgram9_);
+		glUseProgram(shaderProgram9_);
 #endif
-	textureCoeffRAcc_->clearTexture();
-	textureCoeffGAcc_->clearTexture();
-	textureCoeffBAcc_->clearTexture();
-	textureCoeffAAcc_->clearTexture();
-	desTexture->clearTexture();
-	GL_CHECK(emTexture->bind(0, GL_READ_ONLY));
-	GL_CHECK(textureRandomSamples_->bind(1, GL_READ_ONLY));
-	GL_CHECK(textureCoeffRAcc_->bind(2, GL_READ_WRITE));
-	GL_CHECK(textureCoeffGAcc_->bind(3, GL_READ_WRITE));
-	GL_CHECK(textureCoeffBAcc_->bind(4, GL_READ_WRITE));
-	GL_CHECK(textureCoeffAAcc_->bind(5, GL_READ_WRITE));
-	GL_CHECK(desTexture->bind(6, GL_WRITE_ONLY));
-	glUniform1i(maxOrderLocation_, maxOrder_);
-	glDispatchCompute(SHWorkGroups.x, SHWorkGroups.y, 1);
-	glBindImageTexture(0, 0, 0, false, 0, GL_READ_WRITE, GL_RGBA32F);
-	glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+		desTexture->clearTexture();
+		GL_CHECK(emTexture->bind(0, GL_READ_ONLY));
+		GL_CHECK(textureRandomSamples_->bind(1, GL_READ_ONLY));
+		GL_CHECK(textureCoeffRAcc_->bind(2, GL_READ_WRITE));
+		GL_CHECK(textureCoeffGAcc_->bind(3, GL_READ_WRITE));
+		GL_CHECK(textureCoeffBAcc_->bind(4, GL_READ_WRITE));
+		GL_CHECK(textureCoeffAAcc_->bind(5, GL_READ_WRITE));
+		GL_CHECK(desTexture->bind(6, GL_WRITE_ONLY));
+		glUniform1i(maxOrderLocation_, maxOrder_);
+		resetReductionCounter();
+		glDispatchCompute(SHWorkGroups.x, SHWorkGroups.y, 1); // The last work group does the final accumulation
+		STAT_DISPATCH(EMSHCoefficients);
+		glBindImageTexture(0, 0, 0, false, 0, GL_READ_WRITE, GL_RGBA32F);
 #ifdef _WINDOWS
-	shaderProgram9_->release();
+		shaderProgram9_->release();
 #elif __ANDROID__
-	glUseProgram(0);
+		glUseProgram(0);
 #endif
+	});
 
-#ifdef _WINDOWS
-	shaderProgram9_->bind();
-#elif __ANDROID__
-	glUseProgram(shaderProgram9_);
-#endif
-	GL_CHECK(emTexture->bind(0, GL_READ_ONLY));
-	GL_CHECK(textureRandomSamples_->bind(1, GL_READ_ONLY));
-	GL_CHECK(textureCoeffRAcc_->bind(2, GL_READ_WRITE));
-	GL_CHECK(textureCoeffGAcc_->bind(3, GL_READ_WRITE));
-	GL_CHECK(textureCoeffBAcc_->bind(4, GL_READ_WRITE));
-	GL_CHECK(textureCoeffAAcc_->bind(5, GL_READ_WRITE));
-	GL_CHECK(desTexture->bind(6, GL_WRITE_ONLY));
-	glUniform2i(numWGLocation9_, SHWorkGroups.x, SHWorkGroups.y);
-	glUniform1i(maxOrderLocation_, maxOrder_);
-	glDispatchCompute(1, 1, 1);
-	glBindImageTexture(0, 0, 0, false, 0, GL_READ_WRITE, GL_RGBA32F);
-	glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
-#ifdef _WINDOWS
-	shaderProgram9_->release();
-#elif __ANDROID__
-	glUseProgram(0);
-#endif
+	scheduler_.addStage("EMSHCoefficientsReadback", { gl::ResourceAccess(desTexture.get(), gl::AccessPixelRead) }, [=]() {
+		size_t slot = shRing_->acquire(frameIdx_);
+		shReadback_->copyTexture(slot, *desTexture);
+		shRing_->submit(slot);
+	});
+
+	// The coefficients texture is handed over to the rendering
+	scheduler_.synchronize(*computeCommands_);
 
 	textureCoeffFinalCur_ = desTexture;
 }
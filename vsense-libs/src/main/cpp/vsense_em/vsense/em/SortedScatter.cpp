@@ -0,0 +1,200 @@
+#include <vsense/em/SortedScatter.h>
+
+#include <algorithm>
+#include <cmath>
+
+using namespace vsense;
+using namespace vsense::em;
+
+const uint32_t DigitBits = 4;
+const uint32_t NbrDigits = 1 << DigitBits;
+
+const float MaxAllowedDistance = 0.10f; // 10cm
+
+/*
+ * Resolves the value of a texel from its samples, as done by environmentMapResolve.comp.
+ * @param values New value of every sample.
+ * @param indices Indices of the samples of the texel, in sample order.
+ * @param count Number of samples of the texel.
+ * @param mode Resolution of the samples.
+ * @return Value of the texel.
+ */
+static glm::vec4 resolveTexel(const std::vector<glm::vec4>& values, const uint32_t* indices, size_t count, ScatterMode mode) {
+	if (mode == ScatterNearest) {
+		glm::vec4 nearest = values[indices[0]];
+		for (size_t i = 1; i < count; i++) {
+			const glm::vec4& value = values[indices[i]];
+			if (std::abs(value.w) < std::abs(nearest.w))
+				nearest = value;
+		}
+
+		return nearest;
+	}
+
+	glm::vec4 sumReliable(0.f);
+	glm::vec4 sumAll(0.f);
+	float nbrReliable = 0.f;
+	for (size_t i = 0; i < count; i++) {
+		const glm::vec4& value = values[indices[i]];
+		glm::vec4 absValue(value.x, value.y, value.z, std::abs(value.w));
+
+		if (value.w > 0.f) {
+			sumReliable += absValue;
+			nbrReliable += 1.f;
+		}
+		sumAll += absValue;
+	}
+
+	if (nbrReliable > 0.f)
+		return sumReliable / nbrReliable;
+
+	glm::vec4 average = sumAll / (float)count;
+	average.w = -average.w; // Unreliable depth
+
+	return average;
+}
+
+SortedScatter::SortedScatter(size_t groupSize) : groupSize_(std::min(groupSize, (size_t)255)), nbrDispatches_(0) {
+
+}
+
+bool SortedScatter::projectSample(const glm::vec4& sampleRef, const glm::vec4& sampleCur, const glm::vec4& sampleData, const glm::mat3& corrMtx,
+	bool withinTrustedSphere, glm::vec4& newData) {
+	if (sampleCur.w == 0.f) // Nothing to add
+		return false;
+
+	glm::vec3 color = corrMtx*glm::vec3(sampleCur);
+	if ((color.r < 0.f) || (color.g < 0.f) || (color.b < 0.f))
+		return false;
+
+	float refDepth = std::abs(sampleRef.w);
+	float curDepth = std::abs(sampleCur.w);
+
+	bool isValid = (sampleRef.w <= 0.f); // No reference data (anything is better than that)
+	if (!isValid)
+		isValid = (refDepth > curDepth) || withinTrustedSphere || (sampleData.z < MaxAllowedDistance);
+
+	if (!isValid)
+		return false;
+
+	newData = glm::vec4(color, (refDepth == 0.f) ? curDepth : (curDepth + refDepth) / 2.f);
+	if (sampleCur.w < 0.f) // If we're not sure about the current depth, leave it unreliable
+		newData.w = -newData.w;
+
+	return true;
+}
+
+void SortedScatter::computeKeys(const glm::vec4* samplesRef, const glm::vec4* samplesCur, const glm::vec4* samplesData, size_t nbrSamples, int emWidth,
+	int emHeight, const glm::mat3& corrMtx, bool withinTrustedSphere, std::vector<uint32_t>& keys, std::vector<glm::vec4>& values) {
+	uint32_t nbrTexels = (uint32_t)(emWidth*emHeight);
+
+	keys.resize(nbrSamples);
+	values.resize(nbrSamples);
+	for (size_t i = 0; i < nbrSamples; i++) {
+		if (projectSample(samplesRef[i], samplesCur[i], samplesData[i], corrMtx, withinTrustedSphere, values[i]))
+			keys[i] = (uint32_t)((int)samplesData[i].y*emWidth + (int)samplesData[i].x);
+		else
+			keys[i] = nbrTexels;
+	}
+}
+
+int SortedScatter::getNbrPasses(uint32_t nbrTexels) {
+	uint32_t nbrBits = 0;
+	while ((nbrBits < 32) && (nbrTexels >> nbrBits))
+		nbrBits++;
+
+	return std::max((int)((nbrBits + DigitBits - 1) / DigitBits), 1);
+}
+
+void SortedScatter::sort(const std::vector<uint32_t>& keys, uint32_t nbrTexels, std::vector<uint32_t>& order) {
+	size_t nbrElements = keys.size();
+	size_t nbrGroups = (nbrElements + groupSize_ - 1) / groupSize_;
+
+	order.resize(nbrElements);
+	for (size_t i = 0; i < nbrElements; i++)
+		order[i] = (uint32_t)i;
+
+	keys_ = keys;
+	sorted_.resize(nbrElements);
+	sortedKeys_.resize(nbrElements);
+	offsets_.resize(nbrGroups*NbrDigits);
+
+	int nbrPasses = getNbrPasses(nbrTexels);
+	for (int pass = 0; pass < nbrPasses; pass++) {
+		uint32_t shift = pass*DigitBits;
+
+		// Digit counts of every work group
+		std::fill(offsets_.begin(), offsets_.end(), 0);
+		for (size_t i = 0; i < nbrElements; i++)
+			offsets_[((keys_[i] >> shift) & (NbrDigits - 1))*nbrGroups + i / groupSize_]++;
+
+		// Exclusive scan in digit-major order, the first destination of every digit and work group
+		uint32_t sum = 0;
+		for (size_t i = 0; i < offsets_.size(); i++) {
+			uint32_t count = offsets_[i];
+			offsets_[i] = sum;
+			sum += count;
+		}
+
+		// Destination is the offset plus the rank among the previous elements of the work group with the same digit
+		for (size_t i = 0; i < nbrElements; i++) {
+			uint32_t dst = offsets_[((keys_[i] >> shift) & (NbrDigits - 1))*nbrGroups + i / groupSize_]++;
+			sorted_[dst] = order[i];
+			sortedKeys_[dst] = keys_[i];
+		}
+
+		order.swap(sorted_);
+		keys_.swap(sortedKeys_);
+	}
+}
+
+size_t SortedScatter::resolve(const std::vector<uint32_t>& keys, const std::vector<glm::vec4>& values, const std::vector<uint32_t>& order,
+	uint32_t nbrTexels, ScatterMode mode, glm::vec4* envMap) {
+	size_t nbrStores = 0;
+
+	size_t first = 0;
+	while (first < order.size()) {
+		uint32_t key = keys[order[first]];
+		if (key >= nbrTexels) // The discarded samples are sorted last
+			break;
+
+		size_t last = first + 1;
+		while ((last < order.size()) && (keys[order[last]] == key))
+			last++;
+
+		envMap[key] = resolveTexel(values, &order[first], last - first, mode);
+		nbrStores++;
+
+		first = last;
+	}
+
+	return nbrStores;
+}
+
+size_t SortedScatter::project(const glm::vec4* samplesRef, const glm::vec4* samplesCur, const glm::vec4* samplesData, size_t nbrSamples, int emWidth,
+	int emHeight, const glm::mat3& corrMtx, bool withinTrustedSphere, ScatterMode mode, glm::vec4* envMap) {
+	if (mode == ScatterUnordered) {
+		size_t nbrStores = 0;
+		for (size_t i = 0; i < nbrSamples; i++) {
+			glm::vec4 newData;
+			if (!projectSample(samplesRef[i], samplesCur[i], samplesData[i], corrMtx, withinTrustedSphere, newData))
+				continue;
+
+			envMap[(int)samplesData[i].y*emWidth + (int)samplesData[i].x] = newData;
+			nbrStores++;
+		}
+
+		nbrDispatches_ = 1;
+
+		return nbrStores;
+	}
+
+	uint32_t nbrTexels = (uint32_t)(emWidth*emHeight);
+
+	computeKeys(samplesRef, samplesCur, samplesData, nbrSamples, emWidth, emHeight, corrMtx, withinTrustedSphere, computedKeys_, values_);
+	sort(computedKeys_, nbrTexels, order_);
+
+	nbrDispatches_ = 2 + 3 * getNbrPasses(nbrTexels); // Keys, count/scan/scatter per pass, resolve
+
+	return resolve(computedKeys_, values_, order_, nbrTexels, mode, envMap);
+}
@@ -0,0 +1,158 @@
+#include <vsense/em/UniformityMask.h>
+
+#include <algorithm>
+
+using namespace vsense;
+using namespace vsense::em;
+
+UniformityMask::UniformityMask(int radius, float maxVariance, size_t tileSize) : width_(0), height_(0), radius_(std::max(radius, 0)),
+	maxVariance_(maxVariance), tileSize_(std::max(tileSize, (size_t)1)), tilesX_(0), tilesY_(0), nbrTileUpdates_(0) {
+
+}
+
+void UniformityMask::resize(size_t width, size_t height) {
+	nbrTileUpdates_ = 0;
+
+	// The mask is only reallocated when the dimensions change
+	if ((width == width_) && (height == height_) && !mask_.empty()) {
+		invalidateAll();
+		return;
+	}
+
+	width_ = width;
+	height_ = height;
+
+	tilesX_ = (width_ + tileSize_ - 1) / tileSize_;
+	tilesY_ = (height_ + tileSize_ - 1) / tileSize_;
+
+	mask_.assign(width_*height_, 0);
+	valid_.assign(tilesX_*tilesY_, 0);
+
+	resizeTables();
+}
+
+void UniformityMask::setRadius(int radius) {
+	radius = std::max(radius, 0);
+	if (radius == radius_)
+		return;
+
+	radius_ = radius;
+
+	resizeTables();
+	invalidateAll();
+}
+
+void UniformityMask::clear() {
+	width_ = height_ = 0;
+	tilesX_ = tilesY_ = 0;
+	nbrTileUpdates_ = 0;
+
+	std::vector<unsigned char>().swap(mask_);
+	std::vector<unsigned char>().swap(valid_);
+	std::vector<glm::dvec3>().swap(sum_);
+	std::vector<glm::dvec3>().swap(sumSq_);
+}
+
+void UniformityMask::resizeTables() {
+	size_t satSize = (tileSize_ + 2 * radius_ + 1)*(tileSize_ + 2 * radius_ + 1);
+	sum_.resize(satSize);
+	sumSq_.resize(satSize);
+}
+
+void UniformityMask::invalidateAll() {
+	std::fill(valid_.begin(), valid_.end(), 0);
+}
+
+void UniformityMask::invalidate(size_t offset) {
+	if (valid_.empty())
+		return;
+
+	int x = (int)(offset % width_);
+	int y = (int)(offset / width_);
+
+	// The radius is smaller than a tile in practice, so the corners of the neighborhood cover every tile reading the pixel
+	int left = (x - radius_ + (int)width_) % (int)width_;
+	int right = (x + radius_) % (int)width_;
+	int top = std::max(y - radius_, 0);
+	int bottom = std::min(y + radius_, (int)height_ - 1);
+
+	size_t tilesCol[2] = { left / tileSize_, right / tileSize_ };
+	size_t tilesRow[2] = { top / tileSize_, bottom / tileSize_ };
+
+	for (int i = 0; i < 2; i++) {
+		for (int j = 0; j < 2; j++)
+			valid_[tilesRow[i] * tilesX_ + tilesCol[j]] = 0;
+	}
+}
+
+bool UniformityMask::isUniform(const glm::vec3* color, size_t offset) {
+	size_t tile = (offset / width_ / tileSize_)*tilesX_ + (offset % width_) / tileSize_;
+
+	if (!valid_[tile])
+		updateTile(color, tile);
+
+	return mask_[offset] != 0;
+}
+
+void UniformityMask::updateTile(const glm::vec3* color, size_t tile) {
+	size_t x0 = (tile % tilesX_)*tileSize_;
+	size_t y0 = (tile / tilesX_)*tileSize_;
+	size_t x1 = std::min(x0 + tileSize_, width_);
+	size_t y1 = std::min(y0 + tileSize_, height_);
+
+	// The tables cover the tile extended by the radius on every side
+	size_t extWidth = x1 - x0 + 2 * radius_;
+	size_t extHeight = y1 - y0 + 2 * radius_;
+	size_t stride = extWidth + 1;
+
+	std::fill(sum_.begin(), sum_.begin() + stride, glm::dvec3(0., 0., 0.));
+	std::fill(sumSq_.begin(), sumSq_.begin() + stride, glm::dvec3(0., 0., 0.));
+
+	for (size_t j = 0; j < extHeight; j++) {
+		int y = std::min(std::max((int)(y0 + j) - radius_, 0), (int)height_ - 1);
+		const glm::vec3* rowPtr = color + y*width_;
+
+		glm::dvec3* curSum = &sum_[(j + 1)*stride];
+		glm::dvec3* curSumSq = &sumSq_[(j + 1)*stride];
+		const glm::dvec3* prevSum = curSum - stride;
+		const glm::dvec3* prevSumSq = curSumSq - stride;
+
+		glm::dvec3 rowSum(0., 0., 0.);
+		glm::dvec3 rowSumSq(0., 0., 0.);
+
+		curSum[0] = curSumSq[0] = glm::dvec3(0., 0., 0.);
+		for (size_t i = 0; i < extWidth; i++) {
+			int x = ((int)(x0 + i) - radius_ + (int)width_) % (int)width_;
+			glm::dvec3 c(rowPtr[x]);
+
+			rowSum += c;
+			rowSumSq += c*c;
+
+			curSum[i + 1] = prevSum[i + 1] + rowSum;
+			curSumSq[i + 1] = prevSumSq[i + 1] + rowSumSq;
+		}
+	}
+
+	size_t side = 2 * radius_ + 1;
+	double invCount = 1. / (side*side);
+
+	for (size_t y = y0; y < y1; y++) {
+		size_t top = (y - y0)*stride;
+		size_t bottom = top + side*stride;
+		unsigned char* maskPtr = &mask_[y*width_];
+
+		for (size_t x = x0; x < x1; x++) {
+			size_t left = x - x0;
+			size_t right = left + side;
+
+			glm::dvec3 mean = (sum_[bottom + right] - sum_[top + right] - sum_[bottom + left] + sum_[top + left])*invCount;
+			glm::dvec3 meanSq = (sumSq_[bottom + right] - sumSq_[top + right] - sumSq_[bottom + left] + sumSq_[top + left])*invCount;
+			glm::dvec3 variance = meanSq - mean*mean;
+
+			maskPtr[x] = (variance.x <= maxVariance_) && (variance.y <= maxVariance_) && (variance.z <= maxVariance_);
+		}
+	}
+
+	valid_[tile] = 1;
+	nbrTileUpdates_++;
+}
@@ -0,0 +1,175 @@
+#include <vsense/gl/ComputeScheduler.h>
+
+#include <algorithm>
+#include <sstream>
+
+using namespace vsense;
+using namespace vsense::gl;
+
+/*
+ * Checks if an access writes the resource.
+ * @param type Type of access.
+ * @return True if the resource is written.
+ */
+bool isWrite(AccessType type) {
+	return type != AccessImageLoad && type != AccessPixelRead;
+}
+
+void RecordedComputeCommands::memoryBarrier(unsigned int bits) {
+	Command command;
+	command.isBarrier = true;
+	command.bits = bits;
+	trace_.push_back(command);
+}
+
+void RecordedComputeCommands::runStage(const ComputeStage& stage) {
+	Command command;
+	command.isBarrier = false;
+	command.bits = BarrierNone;
+	command.stage = stage.name;
+	trace_.push_back(command);
+
+	if (runStages_ && stage.run)
+		stage.run();
+}
+
+std::string RecordedComputeCommands::toString() const {
+	std::ostringstream text;
+	for (size_t i = 0; i < trace_.size(); i++) {
+		if (trace_[i].isBarrier)
+			text << "barrier 0x" << std::hex << trace_[i].bits << std::dec << "\n";
+		else
+			text << "stage " << trace_[i].stage << "\n";
+	}
+
+	return text.str();
+}
+
+ComputeScheduler::ComputeScheduler() : nbrStages_(0), nbrBarriers_(0) {
+
+}
+
+void ComputeScheduler::addStage(const std::string& name, const std::vector<ResourceAccess>& accesses, const std::function<void()>& run) {
+	ComputeStage stage;
+	stage.name = name;
+	stage.accesses = accesses;
+	stage.run = run;
+	queue_.push_back(stage);
+}
+
+bool ComputeScheduler::dependsOn(const ComputeStage& first, const ComputeStage& second) {
+	for (size_t i = 0; i < first.accesses.size(); i++) {
+		for (size_t j = 0; j < second.accesses.size(); j++) {
+			if ((first.accesses[i].resource == second.accesses[j].resource) && (isWrite(first.accesses[i].type) || isWrite(second.accesses[j].type)))
+				return true;
+		}
+	}
+
+	return false;
+}
+
+unsigned int ComputeScheduler::requiredBits(const ResourceAccess& access) {
+	std::map<const void*, ResourceState>::const_iterator it = resources_.find(access.resource);
+	if (it == resources_.end())
+		return BarrierNone;
+
+	const ResourceState& state = it->second;
+	switch (access.type) {
+	case AccessImageLoad:
+		return state.dirtyBits & BarrierImageAccess;
+	case AccessImageStore:
+		return (state.dirtyBits | state.readBits) & BarrierImageAccess;
+	case AccessAtomicCounter:
+		return state.dirtyBits & BarrierAtomicCounter;
+	case AccessTextureUpdate:
+		return (state.dirtyBits | state.readBits) & BarrierTextureUpdate;
+	case AccessBufferUpdate:
+		return state.dirtyBits & BarrierBufferUpdate;
+	case AccessPixelRead:
+		return state.dirtyBits & BarrierFramebuffer;
+	}
+
+	return BarrierNone;
+}
+
+void ComputeScheduler::recordAccess(const ResourceAccess& access) {
+	switch (access.type) {
+	case AccessImageStore:
+	case AccessAtomicCounter: // Shader writes are incoherent with every other access
+		resources_[access.resource].dirtyBits = BarrierAll;
+		break;
+	case AccessImageLoad: // A later write must wait for the shader reads
+		resources_[access.resource].readBits |= BarrierImageAccess | BarrierTextureUpdate;
+		break;
+	default: // The client updates and reads are ordered by GL
+		break;
+	}
+}
+
+void ComputeScheduler::issueBarrier(unsigned int bits, ComputeCommands& commands) {
+	commands.memoryBarrier(bits);
+	nbrBarriers_++;
+
+	std::map<const void*, ResourceState>::iterator it = resources_.begin();
+	while (it != resources_.end()) {
+		it->second.dirtyBits &= ~bits;
+		it->second.readBits &= ~bits;
+
+		if (!it->second.dirtyBits && !it->second.readBits)
+			it = resources_.erase(it);
+		else
+			++it;
+	}
+}
+
+void ComputeScheduler::flush(ComputeCommands& commands) {
+	std::vector<size_t> levels(queue_.size(), 0);
+	size_t nbrLevels = 0;
+	for (size_t i = 0; i < queue_.size(); i++) {
+		for (size_t j = 0; j < i; j++) {
+			if (dependsOn(queue_[j], queue_[i]))
+				levels[i] = std::max(levels[i], levels[j] + 1);
+		}
+
+		nbrLevels = std::max(nbrLevels, levels[i] + 1);
+	}
+
+	for (size_t level = 0; level < nbrLevels; level++) {
+		// The stages within a level are independent, one barrier covers all of them
+		unsigned int bits = BarrierNone;
+		for (size_t i = 0; i < queue_.size(); i++) {
+			if (levels[i] != level)
+				continue;
+
+			for (size_t j = 0; j < queue_[i].accesses.size(); j++)
+				bits |= requiredBits(queue_[i].accesses[j]);
+		}
+
+		if (bits)
+			issueBarrier(bits, commands);
+
+		for (size_t i = 0; i < queue_.size(); i++) {
+			if (levels[i] != level)
+				continue;
+
+			commands.runStage(queue_[i]);
+			nbrStages_++;
+
+			for (size_t j = 0; j < queue_[i].accesses.size(); j++)
+				recordAccess(queue_[i].accesses[j]);
+		}
+	}
+
+	queue_.clear();
+}
+
+void ComputeScheduler::synchronize(ComputeCommands& commands) {
+	flush(commands);
+
+	unsigned int bits = BarrierNone;
+	for (std::map<const void*, ResourceState>::const_iterator it = resources_.begin(); it != resources_.end(); ++it)
+		bits |= it->second.dirtyBits | it->second.readBits;
+
+	if (bits)
+		issueBarrier(bits, commands);
+}
@@ -2,7 +2,11 @@
 
 #include <vsense/gl/Camera.h>
 
-#ifdef __ANDROID__
+#include <iostream>
+
+#ifdef _WINDOWS
+#include <QFile>
+#elif __ANDROID__
 #include <android/asset_manager_jni.h>
 #endif
 
@@ -48,4 +52,29 @@ glm::mat4 DrawableObject::getTransformMatrix() const {
 
 void DrawableObject::render(const Camera *camera) {
   render(camera->getViewMatrix(), camera->getProjectionMatrix());
-}
\ No newline at end of file
+}
+
+std::string DrawableObject::readShaderSource(const std::string& filename) {
+#ifdef _WINDOWS
+  QFile file(QString::fromStdString(filename));
+  if (!file.open(QIODevice::ReadOnly)) {
+    std::cout << "Unable to open " << filename << std::endl;
+    return std::string();
+  }
+
+  return file.readAll().toStdString();
+#elif __ANDROID__
+  AAsset* shaderAsset = AAssetManager_open(assetManager_, filename.c_str(), AASSET_MODE_BUFFER);
+  if (!shaderAsset) {
+    std::cout << "Unable to open " << filename << std::endl;
+    return std::string();
+  }
+
+  const void *shaderBuf = AAsset_getBuffer(shaderAsset);
+  off_t shaderLength = AAsset_getLength(shaderAsset);
+  std::string shaderSource = std::string((const char*)shaderBuf, (size_t)shaderLength);
+  AAsset_close(shaderAsset);
+
+  return shaderSource;
+#endif
+}
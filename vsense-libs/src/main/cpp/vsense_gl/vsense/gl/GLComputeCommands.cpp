@@ -0,0 +1,34 @@
+#include <vsense/gl/GLComputeCommands.h>
+
+#include <vsense/gl/Util.h>
+
+using namespace vsense;
+using namespace vsense::gl;
+
+GLComputeCommands::GLComputeCommands() {
+#ifdef _WINDOWS
+	initializeOpenGLFunctions();
+#endif
+}
+
+void GLComputeCommands::memoryBarrier(unsigned int bits) {
+	GLbitfield glBits = 0;
+	if (bits & BarrierImageAccess)
+		glBits |= GL_SHADER_IMAGE_ACCESS_BARRIER_BIT;
+	if (bits & BarrierTextureFetch)
+		glBits |= GL_TEXTURE_FETCH_BARRIER_BIT;
+	if (bits & BarrierTextureUpdate)
+		glBits |= GL_TEXTURE_UPDATE_BARRIER_BIT;
+	if (bits & BarrierFramebuffer)
+		glBits |= GL_FRAMEBUFFER_BARRIER_BIT;
+	if (bits & BarrierAtomicCounter)
+		glBits |= GL_ATOMIC_COUNTER_BARRIER_BIT;
+	if (bits & BarrierBufferUpdate)
+		glBits |= GL_BUFFER_UPDATE_BARRIER_BIT;
+
+	GL_CHECK(glMemoryBarrier(glBits));
+}
+
+void GLComputeCommands::runStage(const ComputeStage& stage) {
+	stage.run();
+}
@@ -0,0 +1,161 @@
+#include <vsense/gl/GLProgramDriver.h>
+
+#include <vsense/gl/Util.h>
+
+#include <algorithm>
+#include <iostream>
+
+using namespace vsense;
+using namespace vsense::gl;
+
+GLProgramDriver::GLProgramDriver() {
+#ifdef _WINDOWS
+	initializeOpenGLFunctions();
+#endif
+}
+
+std::string GLProgramDriver::getDriverId() {
+	std::string driverId;
+
+	GLenum names[] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+	for (int i = 0; i < 3; i++) {
+		const GLubyte* value = glGetString(names[i]);
+		if (value)
+			driverId += std::string((const char*)value);
+		driverId += "|";
+	}
+
+	return driverId;
+}
+
+bool GLProgramDriver::supportsBinaries() {
+	GLint nbrFormats = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &nbrFormats);
+
+	return nbrFormats > 0;
+}
+
+unsigned int GLProgramDriver::compile(const std::vector<std::pair<ShaderStage, std::string>>& sources) {
+	GLuint program = glCreateProgram();
+	if (!program)
+		return 0;
+
+	std::vector<GLuint> shaders;
+	bool success = true;
+	for (size_t i = 0; i < sources.size(); i++) {
+		GLenum type = GL_COMPUTE_SHADER;
+		if (sources[i].first == StageVertex)
+			type = GL_VERTEX_SHADER;
+		else if (sources[i].first == StageFragment)
+			type = GL_FRAGMENT_SHADER;
+
+		const char* source = sources[i].second.c_str();
+
+		GLuint shader = glCreateShader(type);
+		glShaderSource(shader, 1, &source, nullptr);
+		glCompileShader(shader);
+
+		GLint compiled = GL_FALSE;
+		glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+		if (compiled != GL_TRUE) {
+			GLint logLength = 0;
+			glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &logLength);
+
+			std::string log(std::max(logLength, 1), '\0');
+			glGetShaderInfoLog(shader, logLength, nullptr, &log[0]);
+			std::cout << "Could not compile shader " << type << ":" << std::endl << log << std::endl;
+
+			glDeleteShader(shader);
+			success = false;
+			break;
+		}
+
+		glAttachShader(program, shader);
+		shaders.push_back(shader);
+	}
+
+	if (success) {
+		glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+		glLinkProgram(program);
+		success = checkLinkStatus(program);
+	}
+
+	// The shaders are no longer needed once linked
+	for (size_t i = 0; i < shaders.size(); i++) {
+		glDetachShader(program, shaders[i]);
+		glDeleteShader(shaders[i]);
+	}
+
+	if (!success) {
+		glDeleteProgram(program);
+		return 0;
+	}
+
+	return program;
+}
+
+bool GLProgramDriver::getBinary(unsigned int program, uint32_t& format, std::vector<unsigned char>& binary) {
+	GLint length = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0)
+		return false;
+
+	binary.resize(length);
+
+	GLenum binaryFormat = 0;
+	GLsizei written = 0;
+	glGetProgramBinary(program, length, &written, &binaryFormat, binary.data());
+	if (written <= 0)
+		return false;
+
+	binary.resize(written);
+	format = (uint32_t)binaryFormat;
+
+	return true;
+}
+
+unsigned int GLProgramDriver::loadBinary(uint32_t format, const std::vector<unsigned char>& binary) {
+	// A format the driver doesn't list would raise GL_INVALID_ENUM, so it's rejected before loading
+	GLint nbrFormats = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &nbrFormats);
+	if (nbrFormats <= 0)
+		return 0;
+
+	std::vector<GLint> formats(nbrFormats);
+	glGetIntegerv(GL_PROGRAM_BINARY_FORMATS, formats.data());
+	if (std::find(formats.begin(), formats.end(), (GLint)format) == formats.end())
+		return 0;
+
+	GLuint program = glCreateProgram();
+	if (!program)
+		return 0;
+
+	glProgramBinary(program, (GLenum)format, binary.data(), (GLsizei)binary.size());
+
+	// An outdated binary is reported as a link failure, not as an error
+	GLint linkStatus = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &linkStatus);
+
+	if (linkStatus != GL_TRUE) {
+		glDeleteProgram(program);
+		return 0;
+	}
+
+	return program;
+}
+
+bool GLProgramDriver::checkLinkStatus(GLuint program) {
+	GLint linkStatus = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &linkStatus);
+	if (linkStatus == GL_TRUE)
+		return true;
+
+	GLint logLength = 0;
+	glGetProgramiv(program, GL_INFO_LOG_LENGTH, &logLength);
+
+	std::string log(std::max(logLength, 1), '\0');
+	glGetProgramInfoLog(program, logLength, nullptr, &log[0]);
+	std::cout << "Could not link program:" << std::endl << log << std::endl;
+
+	return false;
+}
@@ -0,0 +1,112 @@
+#include <vsense/gl/PixelPackReadback.h>
+
+#include <vsense/gl/Texture.h>
+#include <vsense/gl/Util.h>
+
+#include <cstring>
+#include <iostream>
+
+using namespace vsense;
+using namespace vsense::gl;
+
+const GLuint64 WaitTimeout = 1000000000; // Nanoseconds between the checks of a blocking wait
+
+PixelPackReadback::PixelPackReadback() : slotSize_(0) {
+#ifdef _WINDOWS
+	initializeOpenGLFunctions();
+#endif
+}
+
+PixelPackReadback::~PixelPackReadback() {
+	release();
+}
+
+void PixelPackReadback::release() {
+	for (size_t i = 0; i < syncs_.size(); i++) {
+		if (syncs_[i])
+			glDeleteSync(syncs_[i]);
+	}
+	syncs_.clear();
+
+	if (!buffers_.empty()) {
+		GL_CHECK(glDeleteBuffers((GLsizei)buffers_.size(), buffers_.data()));
+		buffers_.clear();
+	}
+}
+
+void PixelPackReadback::allocate(size_t nbrSlots, size_t slotSize) {
+	release();
+
+	slotSize_ = slotSize;
+	buffers_.resize(nbrSlots);
+	syncs_.assign(nbrSlots, 0);
+
+	GL_CHECK(glGenBuffers((GLsizei)nbrSlots, buffers_.data()));
+	for (size_t i = 0; i < nbrSlots; i++) {
+		GL_CHECK(glBindBuffer(GL_PIXEL_PACK_BUFFER, buffers_[i]));
+		GL_CHECK(glBufferData(GL_PIXEL_PACK_BUFFER, slotSize_, NULL, GL_STREAM_READ));
+	}
+	GL_CHECK(glBindBuffer(GL_PIXEL_PACK_BUFFER, 0));
+}
+
+void PixelPackReadback::copyTexture(size_t slot, Texture& texture) {
+	if (texture.width()*texture.height()*texture.channels()*texture.sizeBytes() != slotSize_) {
+		std::cout << "The texture does not match the size of the readback buffers" << std::endl;
+		return;
+	}
+
+	GL_CHECK(glBindBuffer(GL_PIXEL_PACK_BUFFER, buffers_[slot]));
+	texture.writeTo(0); // Offset in the bound pixel buffer, the call returns without waiting for the GPU
+	GL_CHECK(glBindBuffer(GL_PIXEL_PACK_BUFFER, 0));
+}
+
+void PixelPackReadback::fence(size_t slot) {
+	if (syncs_[slot])
+		glDeleteSync(syncs_[slot]);
+
+	syncs_[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	GL_CHECK(glFlush()); // Otherwise the fence might never reach the GPU while polling
+}
+
+bool PixelPackReadback::isReady(size_t slot) {
+	if (!syncs_[slot])
+		return false;
+
+	GLint status = GL_UNSIGNALED;
+	GL_CHECK(glGetSynciv(syncs_[slot], GL_SYNC_STATUS, 1, NULL, &status));
+
+	return status == GL_SIGNALED;
+}
+
+void PixelPackReadback::wait(size_t slot) {
+	if (!syncs_[slot])
+		return;
+
+	GLenum result;
+	do {
+		result = glClientWaitSync(syncs_[slot], GL_SYNC_FLUSH_COMMANDS_BIT, WaitTimeout);
+	} while (result == GL_TIMEOUT_EXPIRED);
+
+	if (result == GL_WAIT_FAILED)
+		std::cout << "Failed waiting for the readback of slot " << slot << std::endl;
+}
+
+bool PixelPackReadback::read(size_t slot, void* data) {
+	if (syncs_[slot]) {
+		glDeleteSync(syncs_[slot]);
+		syncs_[slot] = 0;
+	}
+
+	GL_CHECK(glBindBuffer(GL_PIXEL_PACK_BUFFER, buffers_[slot]));
+	void* mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, slotSize_, GL_MAP_READ_BIT);
+	bool success = mapped != NULL;
+	if (success) {
+		memcpy(data, mapped, slotSize_);
+		GL_CHECK(glUnmapBuffer(GL_PIXEL_PACK_BUFFER));
+	} else {
+		std::cout << "Failed mapping the readback buffer of slot " << slot << std::endl;
+	}
+	GL_CHECK(glBindBuffer(GL_PIXEL_PACK_BUFFER, 0));
+
+	return success;
+}
@@ -8,6 +8,7 @@
 #include <vsense/io/Image.h>
 
 #include <vsense/pc/PointCloud.h>
+#include <vsense/pc/PointTransform.h>
 
 #include <vector>
 
@@ -314,22 +315,25 @@ void PointCloudObject::addRandomPoints(const float *points, const io::PointCloud
   unsigned int pts = std::min(nbrPoints, (unsigned int)indices.size());
   glm::vec4 color(1.f, 0.f, 0.f, 1.f);
 
-  for(unsigned int i = 0; i < pts; i++) {
-    if (indices.size() == 0)
-      break;
+  if (pts == 0) {
+    renderMutex_.unlock();
+    return;
+  }
 
-    unsigned int idx = rand() % indices.size();
+  // The selected points are appended untransformed and then transformed in place in a single pass
+  size_t firstVertex = mesh_->vertices_.size();
+  mesh_->vertices_.resize(firstVertex + pts);
+  mesh_->colors_.resize(firstVertex + pts, color);
 
-    const float* ptPtr = points + idx*4;
-    glm::vec3 pt;
-    pt[0] = static_cast<float> (pose[0][0] * ptPtr[0] + pose[1][0] * ptPtr[1] + pose[2][0] * ptPtr[2] + pose[3][0]);
-    pt[1] = static_cast<float> (pose[0][1] * ptPtr[0] + pose[1][1] * ptPtr[1] + pose[2][1] * ptPtr[2] + pose[3][1]);
-    pt[2] = static_cast<float> (pose[0][2] * ptPtr[0] + pose[1][2] * ptPtr[1] + pose[2][2] * ptPtr[2] + pose[3][2]);
+  for(unsigned int i = 0; i < pts; i++) {
+    unsigned int idx = indices[rand() % indices.size()];
 
-    mesh_->vertices_.push_back(pt);
-    mesh_->colors_.push_back(color);
+    const float* ptPtr = points + idx*4;
+    mesh_->vertices_[firstVertex + i] = glm::vec3(ptPtr[0], ptPtr[1], ptPtr[2]);
   }
 
+  pc::PointTransform::transform(pose, &mesh_->vertices_[firstVertex], &mesh_->vertices_[firstVertex], pts);
+
   renderMutex_.unlock();
 }
 
@@ -0,0 +1,218 @@
+#include <vsense/gl/ProgramCache.h>
+#include <vsense/gl/ShaderSource.h>
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+
+using namespace vsense;
+using namespace vsense::gl;
+
+void ShaderVariant::addStage(ShaderStage stage, const std::string& source) {
+	stages_.push_back(std::make_pair(stage, source));
+}
+
+void ShaderVariant::addDefine(const std::string& name, const std::string& value) {
+	defines_.push_back(std::make_pair(name, value));
+}
+
+void ShaderVariant::addDefine(const std::string& name, int value) {
+	addDefine(name, std::to_string(value));
+}
+
+bool ShaderVariant::assemble(std::vector<std::pair<ShaderStage, std::string>>& sources) const {
+	sources.clear();
+	for (size_t i = 0; i < stages_.size(); i++) {
+		ShaderSource shaderSource(stages_[i].second);
+		for (size_t j = 0; j < defines_.size(); j++)
+			shaderSource.addDefine(defines_[j].first, defines_[j].second);
+
+		std::string source;
+		if (!shaderSource.assemble(std::string(), std::string(), source))
+			return false;
+
+		sources.push_back(std::make_pair(stages_[i].first, source));
+	}
+
+	return true;
+}
+
+ProgramCache::ProgramCache(std::shared_ptr<ProgramDriver> driver, const std::string& directory) : driver_(driver), directory_(directory),
+	nbrCompiled_(0), nbrLoaded_(0), nbrDiscarded_(0) {
+
+}
+
+unsigned int ProgramCache::getProgram(const ShaderVariant& variant) {
+	std::vector<std::pair<ShaderStage, std::string>> sources;
+	if (!variant.assemble(sources))
+		return 0;
+
+	return getProgram(sources);
+}
+
+unsigned int ProgramCache::getProgram(const std::vector<std::pair<ShaderStage, std::string>>& sources) {
+	uint64_t key = getKey(sources);
+	bool useBinaries = driver_->supportsBinaries();
+
+	if (useBinaries) {
+		std::map<uint64_t, ProgramBinary>::iterator it = binaries_.find(key);
+		if (it == binaries_.end()) {
+			ProgramBinary binary;
+			if (readBinary(key, binary))
+				it = binaries_.insert(std::make_pair(key, binary)).first;
+		}
+
+		if (it != binaries_.end()) {
+			unsigned int program = driver_->loadBinary(it->second.format, it->second.data);
+			if (program) {
+				nbrLoaded_++;
+				return program;
+			}
+
+			// The driver changed without changing its identifier, or the binary is corrupted
+			std::cout << "Cached program " << getFilename(key) << " rejected by the driver, compiling from source" << std::endl;
+			nbrDiscarded_++;
+			invalidate(key);
+		}
+	}
+
+	unsigned int program = driver_->compile(sources);
+	if (!program)
+		return 0;
+
+	nbrCompiled_++;
+
+	if (useBinaries) {
+		ProgramBinary binary;
+		if (driver_->getBinary(program, binary.format, binary.data) && !binary.data.empty()) {
+			writeBinary(key, binary);
+			binaries_[key] = binary;
+		}
+	}
+
+	return program;
+}
+
+uint64_t ProgramCache::getKey(const std::vector<std::pair<ShaderStage, std::string>>& sources) {
+	std::string driverId = driver_->getDriverId();
+
+	uint64_t key = hash(&ProgramBinaryVersion, sizeof(uint32_t));
+	key = hash(driverId.data(), driverId.size(), key);
+	for (size_t i = 0; i < sources.size(); i++) {
+		uint32_t stage = (uint32_t)sources[i].first;
+		uint64_t size = sources[i].second.size();
+
+		key = hash(&stage, sizeof(uint32_t), key);
+		key = hash(&size, sizeof(uint64_t), key);
+		key = hash(sources[i].second.data(), sources[i].second.size(), key);
+	}
+
+	return key;
+}
+
+void ProgramCache::invalidate(uint64_t key) {
+	binaries_.erase(key);
+
+	if (!directory_.empty())
+		std::remove(getFilename(key).c_str());
+}
+
+std::string ProgramCache::getFilename(uint64_t key) const {
+	if (directory_.empty())
+		return std::string();
+
+	char name[17];
+	snprintf(name, sizeof(name), "%016llx", (unsigned long long)key);
+
+	return directory_ + name + ".bin";
+}
+
+uint64_t ProgramCache::hash(const void* data, size_t size, uint64_t seed) {
+	const unsigned char* bytes = (const unsigned char*)data;
+
+	uint64_t result = seed;
+	for (size_t i = 0; i < size; i++) {
+		result ^= bytes[i];
+		result *= 0x100000001b3ULL;
+	}
+
+	return result;
+}
+
+bool ProgramCache::readBinary(uint64_t key, ProgramBinary& binary) {
+	if (directory_.empty())
+		return false;
+
+	std::string filename = getFilename(key);
+	std::ifstream file(filename, std::ios::in | std::ios::binary);
+	if (!file.is_open()) // Not cached yet
+		return false;
+
+	uint32_t magic = 0, version = 0, size = 0;
+	uint64_t fileKey = 0, dataHash = 0;
+
+	file.read((char*)&magic, sizeof(uint32_t));
+	file.read((char*)&version, sizeof(uint32_t));
+	file.read((char*)&fileKey, sizeof(uint64_t));
+	file.read((char*)&binary.format, sizeof(uint32_t));
+	file.read((char*)&size, sizeof(uint32_t));
+	file.read((char*)&dataHash, sizeof(uint64_t));
+
+	bool isValid = file.good() && (magic == ProgramBinaryMagic) && (version == ProgramBinaryVersion) && (fileKey == key);
+	if (isValid) {
+		binary.data.resize(size);
+		if (size)
+			file.read((char*)binary.data.data(), size);
+
+		isValid = file.good() && (hash(binary.data.data(), binary.data.size()) == dataHash);
+	}
+
+	file.close();
+
+	if (!isValid) {
+		std::cout << filename << " is not a valid cached program, compiling from source" << std::endl;
+		std::remove(filename.c_str());
+		nbrDiscarded_++;
+		return false;
+	}
+
+	return true;
+}
+
+bool ProgramCache::writeBinary(uint64_t key, const ProgramBinary& binary) {
+	if (directory_.empty())
+		return false;
+
+	// Written aside and renamed, so an interrupted write never leaves a truncated file under the final name
+	std::string filename = getFilename(key);
+	std::string tmpFilename = filename + ".tmp";
+
+	std::ofstream file(tmpFilename, std::ios::out | std::ios::binary);
+	if (!file.is_open()) {
+		std::cout << "Unable to open " << tmpFilename << std::endl;
+		return false;
+	}
+
+	uint32_t size = (uint32_t)binary.data.size();
+	uint64_t dataHash = hash(binary.data.data(), binary.data.size());
+
+	file.write((const char*)&ProgramBinaryMagic, sizeof(uint32_t));
+	file.write((const char*)&ProgramBinaryVersion, sizeof(uint32_t));
+	file.write((const char*)&key, sizeof(uint64_t));
+	file.write((const char*)&binary.format, sizeof(uint32_t));
+	file.write((const char*)&size, sizeof(uint32_t));
+	file.write((const char*)&dataHash, sizeof(uint64_t));
+	file.write((const char*)binary.data.data(), size);
+
+	bool success = file.good();
+	file.close();
+
+	std::remove(filename.c_str());
+	if (!success || std::rename(tmpFilename.c_str(), filename.c_str())) {
+		std::cout << "Unable to write " << filename << std::endl;
+		std::remove(tmpFilename.c_str());
+		return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,129 @@
+#include <vsense/gl/ReadbackRing.h>
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+using namespace vsense;
+using namespace vsense::gl;
+
+ReadbackRing::ReadbackRing(std::shared_ptr<ReadbackBackend> backend, size_t nbrSlots, size_t slotSize) : backend_(backend),
+	nbrSlots_(std::max(nbrSlots, (size_t)1)), slotSize_(slotSize), frames_(nbrSlots_, 0), oldest_(0), nbrInFlight_(0), nbrDropped_(0), nbrBlocking_(0) {
+	backend_->allocate(nbrSlots_, slotSize_);
+}
+
+size_t ReadbackRing::acquire(uint64_t frame) {
+	if (nbrInFlight_ == nbrSlots_) { // The oldest result is overwritten
+		if (!backend_->isReady(oldest_)) {
+			backend_->wait(oldest_);
+			nbrBlocking_++;
+		}
+
+		oldest_ = (oldest_ + 1) % nbrSlots_;
+		nbrInFlight_--;
+		nbrDropped_++;
+	}
+
+	size_t slot = (oldest_ + nbrInFlight_) % nbrSlots_;
+	frames_[slot] = frame;
+
+	return slot;
+}
+
+void ReadbackRing::submit(size_t slot) {
+	backend_->fence(slot);
+	nbrInFlight_++;
+}
+
+bool ReadbackRing::retrieve(void* data, uint64_t curFrame, uint64_t& age) {
+	// The copies finish in order, so the finished slots are the oldest ones
+	size_t nbrReady = 0;
+	while ((nbrReady < nbrInFlight_) && backend_->isReady((oldest_ + nbrReady) % nbrSlots_))
+		nbrReady++;
+
+	if (!nbrReady) {
+		if (nbrInFlight_ < nbrSlots_)
+			return false;
+
+		backend_->wait(oldest_);
+		nbrBlocking_++;
+		nbrReady = 1;
+	}
+
+	return release(nbrReady, data, curFrame, age);
+}
+
+bool ReadbackRing::retrieveNewest(void* data, uint64_t curFrame, uint64_t& age) {
+	if (!nbrInFlight_)
+		return false;
+
+	size_t newest = (oldest_ + nbrInFlight_ - 1) % nbrSlots_;
+	if (!backend_->isReady(newest)) {
+		backend_->wait(newest);
+		nbrBlocking_++;
+	}
+
+	return release(nbrInFlight_, data, curFrame, age);
+}
+
+bool ReadbackRing::release(size_t count, void* data, uint64_t curFrame, uint64_t& age) {
+	size_t slot = (oldest_ + count - 1) % nbrSlots_;
+	age = curFrame - frames_[slot];
+
+	bool success = backend_->read(slot, data);
+
+	oldest_ = (oldest_ + count) % nbrSlots_;
+	nbrInFlight_ -= count;
+	nbrDropped_ += count - 1;
+
+	return success;
+}
+
+CPUReadbackBackend::CPUReadbackBackend(size_t latency) : latency_(latency), slotSize_(0), nbrStalls_(0) {
+
+}
+
+void CPUReadbackBackend::allocate(size_t nbrSlots, size_t slotSize) {
+	slotSize_ = slotSize;
+	buffers_.assign(nbrSlots*slotSize, 0);
+	remaining_.assign(nbrSlots, -1);
+}
+
+void CPUReadbackBackend::write(size_t slot, const void* data) {
+	memcpy(&buffers_[slot*slotSize_], data, slotSize_);
+	remaining_[slot] = -1;
+}
+
+void CPUReadbackBackend::advance() {
+	for (size_t i = 0; i < remaining_.size(); i++) {
+		if (remaining_[i] > 0)
+			remaining_[i]--;
+	}
+}
+
+void CPUReadbackBackend::fence(size_t slot) {
+	remaining_[slot] = (int)latency_;
+}
+
+bool CPUReadbackBackend::isReady(size_t slot) {
+	return remaining_[slot] == 0;
+}
+
+void CPUReadbackBackend::wait(size_t slot) {
+	if (remaining_[slot] > 0) {
+		remaining_[slot] = 0;
+		nbrStalls_++;
+	}
+}
+
+bool CPUReadbackBackend::read(size_t slot, void* data) {
+	if (remaining_[slot] != 0) {
+		std::cout << "Reading slot " << slot << " before its fence was signaled" << std::endl;
+		return false;
+	}
+
+	memcpy(data, &buffers_[slot*slotSize_], slotSize_);
+	remaining_[slot] = -1;
+
+	return true;
+}
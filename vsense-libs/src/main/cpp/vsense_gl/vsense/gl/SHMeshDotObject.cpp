@@ -1,15 +1,18 @@
 #include <vsense/gl/SHMeshDotObject.h>
+#include <vsense/gl/ProgramCache.h>
 #include <vsense/gl/StaticMesh.h>
 #include <vsense/gl/Camera.h>
 #include <vsense/gl/Texture.h>
 #include <vsense/gl/Util.h>
 #include <vsense/io/Image.h>
 #include <vsense/io/ObjReader.h>
+#include <vsense/sh/TransferPacker.h>
 
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtc/quaternion.hpp>
 
+#include <algorithm>
 #include <iostream>
 #include <fstream>
 
@@ -24,70 +27,181 @@ using namespace vsense::gl;
 
 const int VerticesPerRow = 40;
 
+const int DefaultSHOrder = 4;
+
 #ifdef _WINDOWS
-SHMeshDotObject::SHMeshDotObject(std::shared_ptr<gl::StaticMesh>& mesh) : DrawableObject(Mesh), baseColor_(1.f, 1.f, 1.f) {
+SHMeshDotObject::SHMeshDotObject(std::shared_ptr<gl::StaticMesh>& mesh) : DrawableObject(Mesh), baseColor_(1.f, 1.f, 1.f), meshOrder_(-1), shOrder_(0),
+  nbrVertices_(0), quantization_(sh::TransferFloat), cpuLighting_(false) {
 	mesh_ = mesh;
 
-	shaderProgram_ = new QOpenGLShaderProgram;
-	shaderProgram_->addShaderFromSourceFile(QOpenGLShader::Vertex, ":resources/shaders/shmeshDot.vert");
-	shaderProgram_->addShaderFromSourceFile(QOpenGLShader::Fragment, ":resources/shaders/shmeshDot.frag");
-	shaderProgram_->link();
-	shaderProgram_->bind();
+	shaderProgram_ = nullptr;
+	vertexSource_ = readShaderSource(":resources/shaders/shmeshDot.vert");
+	fragmentSource_ = readShaderSource(":resources/shaders/shmeshDot.frag");
 
-	vertexLocation_ = shaderProgram_->attributeLocation("vertex");
-	uvLocation_ = shaderProgram_->attributeLocation("uv");;
-	normalLocation_ = shaderProgram_->attributeLocation("normal");
+	initialized_ = setSHOrder(DefaultSHOrder);
+}
+#elif __ANDROID__
+SHMeshDotObject::SHMeshDotObject(AAssetManager* assetManager, std::shared_ptr<gl::StaticMesh>& mesh) : DrawableObject(assetManager, Mesh), baseColor_(1.f, 1.f, 1.f),
+  meshOrder_(-1), shOrder_(0), nbrVertices_(0), quantization_(sh::TransferFloat), cpuLighting_(false) {
+  mesh_ = mesh;
 
-	mvpLocation_ = shaderProgram_->uniformLocation("mvp");
+  shaderProgram_ = 0;
+  vertexSource_ = readShaderSource("shaders/shmeshDot.vert");
+  fragmentSource_ = readShaderSource("shaders/shmeshDot.frag");
 
-	coeffNbrLocation_ = shaderProgram_->uniformLocation("coeffNbr");
+  initialized_ = setSHOrder(DefaultSHOrder);
+}
+#endif
 
-	baseColorLocation_ = shaderProgram_->uniformLocation("baseColor");
+SHMeshDotObject::~SHMeshDotObject() {
+  for (auto it = programs_.begin(); it != programs_.end(); ++it) {
+#ifdef _WINDOWS
+    delete it->second;
+#elif __ANDROID__
+    glDeleteProgram(it->second);
+#endif
+  }
+}
+
+bool SHMeshDotObject::setSHOrder(int order) {
+  order = sh::BandLimit::clampOrder(order);
+  if (meshOrder_ >= 0) // Only the bands stored for the mesh can be rendered
+    order = std::min(order, meshOrder_);
+
+  // The variant lit on the CPU doesn't depend on the order nor on the storage of the coefficients
+  auto key = cpuLighting_ ? std::make_tuple(0, 0, true) : std::make_tuple(order, (int)quantization_, false);
+  auto it = programs_.find(key);
+  if (it == programs_.end()) {
+    ShaderVariant variant;
+    variant.addStage(StageVertex, vertexSource_);
+    variant.addStage(StageFragment, fragmentSource_);
+    if (cpuLighting_) {
+      variant.addDefine("SH_CPU_LIGHTING", 1);
+    } else {
+      variant.addDefine("SH_ORDER", order);
+      variant.addDefine("SH_TRANSFER_BITS", (int)quantization_);
+    }
+
+    std::vector<std::pair<ShaderStage, std::string>> sources;
+    if (!variant.assemble(sources))
+      return false;
+
+#ifdef _WINDOWS
+    QOpenGLShaderProgram* program = new QOpenGLShaderProgram;
+    program->addShaderFromSourceCode(QOpenGLShader::Vertex, sources[0].second.c_str());
+    program->addShaderFromSourceCode(QOpenGLShader::Fragment, sources[1].second.c_str());
+    if (!program->link()) {
+      std::cout << "Could not create the program of SH order " << order << " (" << (int)quantization_ << "-bit transfer)" << std::endl;
+      delete program;
+      return false;
+    }
+#elif __ANDROID__
+    GLuint program = util::createProgram(sources[0].second.c_str(), sources[1].second.c_str());
+    if (!program) {
+      LOGE("Could not create the program of SH order %d (%d-bit transfer)", order, (int)quantization_);
+      return false;
+    }
+#endif
 
-	renderCoeffNbrLocation_ = shaderProgram_->uniformLocation("renderCoeffNbr");
+    it = programs_.insert(std::make_pair(key, program)).first;
+  }
 
-	selfOccCoeffTextureLocation_ = shaderProgram_->uniformLocation("selfOccCoeff");
-	coeffAmbTextureLocation_ = shaderProgram_->uniformLocation("coeffAmb");
+  if (shaderProgram_ != it->second) {
+    shaderProgram_ = it->second;
+    initializeLocations();
+  }
 
-	colorCorrectionLocation_ = shaderProgram_->uniformLocation("colorCorrection");
-	materialParamLocation_ = shaderProgram_->uniformLocation("materialParams");
-	diffTextureLocation_ = shaderProgram_->uniformLocation("diffTexture");
+  shOrder_ = order;
+  renderCoeffNbr_ = sh::BandLimit::getNbrCoefficients(order);
+  evaluator_.setOrder(order);
 
-	shFactorLocation_ = shaderProgram_->uniformLocation("shFactor");
+  return true;
+}
 
-	colorCorrectionMtxLocation_ = shaderProgram_->uniformLocation("colorCorrectionMtx");
+bool SHMeshDotObject::setTransferQuantization(sh::TransferQuantization quantization) {
+  if (shaderProgram_ && (quantization == quantization_))
+    return true;
 
-	renderCoeffNbr_ = 25;
+  sh::TransferQuantization previous = quantization_;
+  quantization_ = quantization;
+  if (!setSHOrder(shOrder_)) {
+    quantization_ = previous;
+    return false;
+  }
 
-	shaderProgram_->release();
+  if (soCoeff_)
+    updateTransferTexture();
 
-	initialized_ = true;
+  return true;
 }
-#elif __ANDROID__
-SHMeshDotObject::SHMeshDotObject(AAssetManager* assetManager, std::shared_ptr<gl::StaticMesh>& mesh) : DrawableObject(assetManager, Mesh), baseColor_(1.f, 1.f, 1.f) {
-  mesh_ = mesh;
 
-  AAsset* vertexShaderAsset = AAssetManager_open(assetManager, "shaders/shmeshDot.vert", AASSET_MODE_BUFFER);
-  const void *vertexShaderBuf = AAsset_getBuffer(vertexShaderAsset);
-  off_t vertexShaderLength = AAsset_getLength(vertexShaderAsset);
-  std::string vertexShaderSource = std::string((const char*)vertexShaderBuf, (size_t)vertexShaderLength);
-  AAsset_close(vertexShaderAsset);
+bool SHMeshDotObject::setCPULighting(bool enable) {
+  if (shaderProgram_ && (enable == cpuLighting_))
+    return true;
 
-  AAsset* fragmentShaderAsset;
-  fragmentShaderAsset = AAssetManager_open(assetManager, "shaders/shmeshDot.frag", AASSET_MODE_BUFFER);
-  const void *fragmentShaderBuf = AAsset_getBuffer(fragmentShaderAsset);
-  off_t fragmentShaderLength = AAsset_getLength(fragmentShaderAsset);
-  std::string fragmentShaderSource = std::string((const char*)fragmentShaderBuf, (size_t)fragmentShaderLength);
-  AAsset_close(fragmentShaderAsset);
+  cpuLighting_ = enable;
+  if (!setSHOrder(shOrder_)) {
+    cpuLighting_ = !enable;
+    return false;
+  }
 
-  shaderProgram_ = util::createProgram(vertexShaderSource.c_str(), fragmentShaderSource.c_str());
+  // The coefficients are only kept in the evaluator while used
+  if (cpuLighting_ && soCoeff_)
+    evaluator_.setTransfer(soCoeff_.get(), nbrVertices_, coeffNbr_);
+  else
+    evaluator_.setTransfer(nullptr, 0, 0);
 
-  if (!shaderProgram_) {
-    LOGE("Could not create program.");
+  return true;
+}
+
+void SHMeshDotObject::updateTransferTexture() {
+  std::vector<TexParam> texParams;
+  texParams.push_back(TexParam(GL_TEXTURE_MAG_FILTER, GL_NEAREST));
+  texParams.push_back(TexParam(GL_TEXTURE_MIN_FILTER, GL_NEAREST));
+
+  if (quantization_ == sh::TransferFloat) {
+    soTexture_.reset(new gl::Texture(coeffTexDim_.x/4, coeffTexDim_.y, 4, GL_FLOAT, texParams, (unsigned char*)soCoeff_.get()));
+    return;
   }
 
+  // Per-vertex scale and quantized coefficients, unpacked by the SH_TRANSFER_BITS variants
+  sh::TransferPacker packer(quantization_, coeffNbr_, VerticesPerRow);
+  std::vector<unsigned char> packed;
+  packer.pack(soCoeff_.get(), nbrVertices_, packed);
+
+  GLenum dType = (quantization_ == sh::Transfer16Bit) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_BYTE;
+  soTexture_.reset(new gl::Texture(packer.getWidth(), packer.getHeight(nbrVertices_), 4, dType, texParams, packed.data()));
+}
+
+void SHMeshDotObject::initializeLocations() {
+#ifdef _WINDOWS
+  vertexLocation_ = shaderProgram_->attributeLocation("vertex");
+  uvLocation_ = shaderProgram_->attributeLocation("uv");
+  normalLocation_ = shaderProgram_->attributeLocation("normal");
+
+  mvpLocation_ = shaderProgram_->uniformLocation("mvp");
+
+  coeffNbrLocation_ = shaderProgram_->uniformLocation("coeffNbr");
+
+  baseColorLocation_ = shaderProgram_->uniformLocation("baseColor");
+
+  renderCoeffNbrLocation_ = shaderProgram_->uniformLocation("renderCoeffNbr");
+
+  selfOccCoeffTextureLocation_ = shaderProgram_->uniformLocation("selfOccCoeff");
+  coeffAmbTextureLocation_ = shaderProgram_->uniformLocation("coeffAmb");
+
+  colorCorrectionLocation_ = shaderProgram_->uniformLocation("colorCorrection");
+  materialParamLocation_ = shaderProgram_->uniformLocation("materialParams");
+  diffTextureLocation_ = shaderProgram_->uniformLocation("diffTexture");
+
+  shFactorLocation_ = shaderProgram_->uniformLocation("shFactor");
+
+  shLightLocation_ = shaderProgram_->attributeLocation("shLight");
+
+  colorCorrectionMtxLocation_ = shaderProgram_->uniformLocation("colorCorrectionMtx");
+#elif __ANDROID__
   vertexLocation_ = glGetAttribLocation(shaderProgram_, "vertex");
-  uvLocation_ = glGetAttribLocation(shaderProgram_, "uv");;
+  uvLocation_ = glGetAttribLocation(shaderProgram_, "uv");
   normalLocation_ = glGetAttribLocation(shaderProgram_, "normal");
 
   mvpLocation_ = glGetUniformLocation(shaderProgram_, "mvp");
@@ -107,19 +221,11 @@ SHMeshDotObject::SHMeshDotObject(AAssetManager* assetManager, std::shared_ptr<gl
 
   shFactorLocation_ = glGetUniformLocation(shaderProgram_, "shFactor");
 
-  colorCorrectionMtxLocation_ = glGetUniformLocation(shaderProgram_, "colorCorrectionMtx");
-
-  renderCoeffNbr_ = 25;
+  shLightLocation_ = glGetAttribLocation(shaderProgram_, "shLight");
 
-#ifdef _WINDOWS
-  shaderProgram_->release();
-#elif __ANDROID__
-  glUseProgram(0);
+  colorCorrectionMtxLocation_ = glGetUniformLocation(shaderProgram_, "colorCorrectionMtx");
 #endif
-
-  initialized_ = true;
 }
-#endif
 
 void SHMeshDotObject::render(const glm::mat4 &viewMat, const glm::mat4 &projMat) {
   if (!initialized_ || !visible_)
@@ -148,6 +254,12 @@ void SHMeshDotObject::render(const glm::mat4 &viewMat, const glm::mat4 &projMat)
     glVertexAttribPointer(normalLocation_, 3, GL_FLOAT, GL_FALSE, 0, mesh_->normals_.data());
   }
 
+  if (cpuLighting_ && (shLightLocation_ != -1)) {
+    evaluator_.update(); // Only evaluated if the environment or the order changed
+    glEnableVertexAttribArray(shLightLocation_);
+    glVertexAttribPointer(shLightLocation_, 3, GL_FLOAT, GL_FALSE, 0, evaluator_.getLighting().data());
+  }
+
   if (mvpLocation_ != -1) {
     glm::mat4 mvpMat = projMat * viewMat * modelMat;
     glUniformMatrix4fv(mvpLocation_, 1, GL_FALSE, glm::value_ptr(mvpMat));
@@ -195,16 +307,21 @@ void SHMeshDotObject::render(const glm::mat4 &viewMat, const glm::mat4 &projMat)
   shaderProgram_->disableAttributeArray(vertexLocation_);
   shaderProgram_->disableAttributeArray(uvLocation_);
   shaderProgram_->disableAttributeArray(normalLocation_);
+  if (cpuLighting_)
+    shaderProgram_->disableAttributeArray(shLightLocation_);
 
   shaderProgram_->release();
 #elif __ANDROID__
+  if (cpuLighting_ && (shLightLocation_ != -1))
+    glDisableVertexAttribArray(shLightLocation_);
+
   glUseProgram(0);
 
   initialized_ = true;
 #endif
 }
 
-void SHMeshDotObject::updateCoefficients(const std::string& meshFilename) {
+void SHMeshDotObject::updateCoefficients(const std::string& meshFilename, int maxOrder) {
   std::ifstream soFile;
   soFile.open(meshFilename, std::ios::in | std::ios::binary);
 
@@ -213,25 +330,29 @@ void SHMeshDotObject::updateCoefficients(const std::string& meshFilename) {
   soFile.read((char*)&nbrVertices, sizeof(uint32_t));
   soFile.read((char*)&nbrOrder, sizeof(uint8_t));
 
-  coeffNbr_ = (nbrOrder + 1)*(nbrOrder + 1);
+  // Only the bands that can be rendered are kept
+  uint32_t fileCoeffNbr = (nbrOrder + 1)*(nbrOrder + 1);
+  meshOrder_ = std::min((int)nbrOrder, std::max(maxOrder, 0));
+  coeffNbr_ = sh::BandLimit::getNbrCoefficients(meshOrder_);
 
-  glm::ivec2 coeffTexDim;
-  coeffTexDim.x = coeffNbr_ * VerticesPerRow;
-  coeffTexDim.y = (floor(nbrVertices / coeffTexDim.x) + 1)*coeffTexDim.x / (coeffTexDim.x / coeffNbr_);
+  nbrVertices_ = nbrVertices;
+  coeffTexDim_.x = coeffNbr_ * VerticesPerRow;
+  coeffTexDim_.y = (floor(nbrVertices / coeffTexDim_.x) + 1)*coeffTexDim_.x / (coeffTexDim_.x / coeffNbr_);
 
-  soCoeff_.reset(new float[(int)coeffTexDim.x*(int)coeffTexDim.y], std::default_delete<float[]>());
+  soCoeff_.reset(new float[(int)coeffTexDim_.x*(int)coeffTexDim_.y], std::default_delete<float[]>());
   float* curCoeff = soCoeff_.get();
   for (size_t i = 0; i < nbrVertices; i++) {
     soFile.read((char*)curCoeff, sizeof(float)*coeffNbr_);
+    soFile.seekg(sizeof(float)*(fileCoeffNbr - coeffNbr_), std::ios::cur);
     curCoeff += coeffNbr_;
   }
   soFile.close();
 
-  std::vector<TexParam> texParams;
-  texParams.push_back(TexParam(GL_TEXTURE_MAG_FILTER, GL_NEAREST));
-  texParams.push_back(TexParam(GL_TEXTURE_MIN_FILTER, GL_NEAREST));
+  updateTransferTexture();
+  if (cpuLighting_)
+    evaluator_.setTransfer(soCoeff_.get(), nbrVertices_, coeffNbr_);
 
-  soTexture_.reset(new gl::Texture(coeffTexDim.x/4, coeffTexDim.y, 4, GL_FLOAT, texParams, (unsigned char*)soCoeff_.get()));
+  setSHOrder(shOrder_);
 }
 
 void SHMeshDotObject::loadFromFile(const std::string& filename) {
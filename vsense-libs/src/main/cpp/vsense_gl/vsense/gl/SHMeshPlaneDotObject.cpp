@@ -1,15 +1,18 @@
 #include <vsense/gl/SHMeshPlaneDotObject.h>
+#include <vsense/gl/ProgramCache.h>
 #include <vsense/gl/StaticMesh.h>
 #include <vsense/gl/Camera.h>
 #include <vsense/gl/Texture.h>
 #include <vsense/gl/Util.h>
 #include <vsense/io/Image.h>
 #include <vsense/io/ObjReader.h>
+#include <vsense/sh/TransferPacker.h>
 
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtc/quaternion.hpp>
 
+#include <algorithm>
 #include <iostream>
 #include <fstream>
 
@@ -24,71 +27,193 @@ using namespace vsense::gl;
 
 const int VerticesPerRow = 40;
 
+const int DefaultSHOrder = 4;
+
 const float MinVal = -10.f;
 const float MaxVal = 10.f;
 const int NbrSteps = 200;
 const float StepSize = (MaxVal - MinVal) / NbrSteps;
 
 #ifdef _WINDOWS
-SHMeshPlaneDotObject::SHMeshPlaneDotObject(float scale) : DrawableObject(Mesh) {
+SHMeshPlaneDotObject::SHMeshPlaneDotObject(float scale) : DrawableObject(Mesh), meshOrder_(-1), shOrder_(0),
+	nbrVertices_(0), quantization_(sh::TransferFloat), cpuLighting_(false) {
 	createMesh(scale);
-  
-  shaderProgram_ = new QOpenGLShaderProgram;
-  shaderProgram_->addShaderFromSourceFile(QOpenGLShader::Vertex, ":/resources/shaders/shmeshPlaneDot.vert");
-  shaderProgram_->addShaderFromSourceFile(QOpenGLShader::Fragment, ":/resources/shaders/shmeshPlaneDot.frag");
-  shaderProgram_->link();
-  shaderProgram_->bind();
 
-  vertexLocation_ = shaderProgram_->attributeLocation("vertex");
-  normalLocation_ = shaderProgram_->attributeLocation("normal");
+	shaderProgram_ = nullptr;
+	vertexSource_ = readShaderSource(":/resources/shaders/shmeshPlaneDot.vert");
+	fragmentSource_ = readShaderSource(":/resources/shaders/shmeshPlaneDot.frag");
 
-  mvpLocation_ = shaderProgram_->uniformLocation("mvp");
+	colorCorrection_ = false;
 
-	coeffNbrLocation_ = shaderProgram_->uniformLocation("coeffNbr");
+	initialized_ = setSHOrder(DefaultSHOrder);
+}
+#elif __ANDROID__
+SHMeshPlaneDotObject::SHMeshPlaneDotObject(AAssetManager* assetManager, float scale) : DrawableObject(assetManager, Mesh), meshOrder_(-1), shOrder_(0),
+	nbrVertices_(0), quantization_(sh::TransferFloat), cpuLighting_(false) {
+	createMesh(scale);
 
-	coeffsPlaneLocation_ = shaderProgram_->uniformLocation("coeffsPlane");
+	shaderProgram_ = 0;
+	vertexSource_ = readShaderSource("shaders/shmeshPlaneDot.vert");
+	fragmentSource_ = readShaderSource("shaders/shmeshPlaneDot.frag");
 
-	renderCoeffNbrLocation_ = shaderProgram_->uniformLocation("renderCoeffNbr");
+	colorCorrection_ = false;
 
-	colorCorrectionMtxLocation_ = shaderProgram_->uniformLocation("colorCorrectionMtx");
-	colorCorrectionLocation_ = shaderProgram_->uniformLocation("colorCorrection");
+	shadowColor_ = 0.1f;
 
-	shFactorLocation_ = shaderProgram_->uniformLocation("shFactor");
-	shadowColorLocation_ = shaderProgram_->uniformLocation("shadowColor");
+	initialized_ = setSHOrder(DefaultSHOrder);
+}
+#endif
 
-	shadowCoeffsTextureLocation_ = shaderProgram_->uniformLocation("shadowCoeffs");
-	coeffAmbTextureLocation_ = shaderProgram_->uniformLocation("coeffAmb");
+SHMeshPlaneDotObject::~SHMeshPlaneDotObject() {
+	for (auto it = programs_.begin(); it != programs_.end(); ++it) {
+#ifdef _WINDOWS
+		delete it->second;
+#elif __ANDROID__
+		glDeleteProgram(it->second);
+#endif
+	}
+}
 
-	renderCoeffNbr_ = 100;
-	colorCorrectionLocation_ = false;
+bool SHMeshPlaneDotObject::setSHOrder(int order) {
+	order = sh::BandLimit::clampOrder(order);
+	if (meshOrder_ >= 0) // Only the bands stored for the plane can be rendered
+		order = std::min(order, meshOrder_);
+
+	// The variant lit on the CPU doesn't depend on the order nor on the storage of the coefficients
+	auto key = cpuLighting_ ? std::make_tuple(0, 0, true) : std::make_tuple(order, (int)quantization_, false);
+	auto it = programs_.find(key);
+	if (it == programs_.end()) {
+		ShaderVariant variant;
+		variant.addStage(StageVertex, vertexSource_);
+		variant.addStage(StageFragment, fragmentSource_);
+		if (cpuLighting_) {
+			variant.addDefine("SH_CPU_LIGHTING", 1);
+		} else {
+			variant.addDefine("SH_ORDER", order);
+			variant.addDefine("SH_TRANSFER_BITS", (int)quantization_);
+		}
 
-  shaderProgram_->release();
+		std::vector<std::pair<ShaderStage, std::string>> sources;
+		if (!variant.assemble(sources))
+			return false;
 
-  initialized_ = true;
-}
+#ifdef _WINDOWS
+		QOpenGLShaderProgram* program = new QOpenGLShaderProgram;
+		program->addShaderFromSourceCode(QOpenGLShader::Vertex, sources[0].second.c_str());
+		program->addShaderFromSourceCode(QOpenGLShader::Fragment, sources[1].second.c_str());
+		if (!program->link()) {
+			std::cout << "Could not create the program of SH order " << order << " (" << (int)quantization_ << "-bit transfer)" << std::endl;
+			delete program;
+			return false;
+		}
 #elif __ANDROID__
-SHMeshPlaneDotObject::SHMeshPlaneDotObject(AAssetManager* assetManager, float scale) : DrawableObject(assetManager, Mesh) {
-	createMesh(scale);
+		GLuint program = util::createProgram(sources[0].second.c_str(), sources[1].second.c_str());
+		if (!program) {
+			LOGE("Could not create the program of SH order %d (%d-bit transfer)", order, (int)quantization_);
+			return false;
+		}
+#endif
+
+		it = programs_.insert(std::make_pair(key, program)).first;
+	}
+
+	if (shaderProgram_ != it->second) {
+		shaderProgram_ = it->second;
+		initializeLocations();
+	}
+
+	shOrder_ = order;
+	renderCoeffNbr_ = sh::BandLimit::getNbrCoefficients(order);
+	evaluator_.setOrder(order);
 
-	AAsset* vertexShaderAsset = AAssetManager_open(assetManager, "shaders/shmeshPlaneDot.vert", AASSET_MODE_BUFFER);
-	const void *vertexShaderBuf = AAsset_getBuffer(vertexShaderAsset);
-	off_t vertexShaderLength = AAsset_getLength(vertexShaderAsset);
-	std::string vertexShaderSource = std::string((const char*)vertexShaderBuf, (size_t)vertexShaderLength);
-	AAsset_close(vertexShaderAsset);
+	return true;
+}
+
+bool SHMeshPlaneDotObject::setTransferQuantization(sh::TransferQuantization quantization) {
+	if (shaderProgram_ && (quantization == quantization_))
+		return true;
+
+	sh::TransferQuantization previous = quantization_;
+	quantization_ = quantization;
+	if (!setSHOrder(shOrder_)) {
+		quantization_ = previous;
+		return false;
+	}
+
+	if (shadowCoeff_)
+		updateTransferTexture();
 
-	AAsset* fragmentShaderAsset;
-	fragmentShaderAsset = AAssetManager_open(assetManager, "shaders/shmeshPlaneDot.frag", AASSET_MODE_BUFFER);
-	const void *fragmentShaderBuf = AAsset_getBuffer(fragmentShaderAsset);
-	off_t fragmentShaderLength = AAsset_getLength(fragmentShaderAsset);
-	std::string fragmentShaderSource = std::string((const char*)fragmentShaderBuf, (size_t)fragmentShaderLength);
-	AAsset_close(fragmentShaderAsset);
+	return true;
+}
 
-	shaderProgram_ = util::createProgram(vertexShaderSource.c_str(), fragmentShaderSource.c_str());
+bool SHMeshPlaneDotObject::setCPULighting(bool enable) {
+	if (shaderProgram_ && (enable == cpuLighting_))
+		return true;
 
-	if (!shaderProgram_) {
-		LOGE("Could not create program.");
+	cpuLighting_ = enable;
+	if (!setSHOrder(shOrder_)) {
+		cpuLighting_ = !enable;
+		return false;
 	}
 
+	// The coefficients are only kept in the evaluator while used
+	if (cpuLighting_ && shadowCoeff_)
+		evaluator_.setTransfer(shadowCoeff_.get(), nbrVertices_, coeffNbr_);
+	else
+		evaluator_.setTransfer(nullptr, 0, 0);
+
+	return true;
+}
+
+void SHMeshPlaneDotObject::updateAmbientCoefficients(const glm::vec4* coeffs, int nbrCoeffs) {
+	ambientCoeffs_.assign(coeffs, coeffs + nbrCoeffs);
+	evaluator_.setEnvironment(coeffs, nbrCoeffs);
+}
+
+void SHMeshPlaneDotObject::updateTransferTexture() {
+	std::vector<TexParam> texParams;
+	texParams.push_back(TexParam(GL_TEXTURE_MAG_FILTER, GL_NEAREST));
+	texParams.push_back(TexParam(GL_TEXTURE_MIN_FILTER, GL_NEAREST));
+
+	if (quantization_ == sh::TransferFloat) {
+		shadowTexture_.reset(new gl::Texture(coeffTexDim_.x/4, coeffTexDim_.y, 4, GL_FLOAT, texParams, (unsigned char*)shadowCoeff_.get()));
+		return;
+	}
+
+	// Per-vertex scale and quantized coefficients, unpacked by the SH_TRANSFER_BITS variants
+	sh::TransferPacker packer(quantization_, coeffNbr_, VerticesPerRow);
+	std::vector<unsigned char> packed;
+	packer.pack(shadowCoeff_.get(), nbrVertices_, packed);
+
+	GLenum dType = (quantization_ == sh::Transfer16Bit) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_BYTE;
+	shadowTexture_.reset(new gl::Texture(packer.getWidth(), packer.getHeight(nbrVertices_), 4, dType, texParams, packed.data()));
+}
+
+void SHMeshPlaneDotObject::initializeLocations() {
+#ifdef _WINDOWS
+	vertexLocation_ = shaderProgram_->attributeLocation("vertex");
+	normalLocation_ = shaderProgram_->attributeLocation("normal");
+
+	mvpLocation_ = shaderProgram_->uniformLocation("mvp");
+
+	coeffNbrLocation_ = shaderProgram_->uniformLocation("coeffNbr");
+
+	coeffsPlaneLocation_ = shaderProgram_->uniformLocation("coeffsPlane");
+
+	renderCoeffNbrLocation_ = shaderProgram_->uniformLocation("renderCoeffNbr");
+
+	colorCorrectionMtxLocation_ = shaderProgram_->uniformLocation("colorCorrectionMtx");
+	colorCorrectionLocation_ = shaderProgram_->uniformLocation("colorCorrection");
+
+	shFactorLocation_ = shaderProgram_->uniformLocation("shFactor");
+	shadowColorLocation_ = shaderProgram_->uniformLocation("shadowColor");
+
+	shBlockedLocation_ = shaderProgram_->attributeLocation("shBlocked");
+	shUnblockedLocation_ = shaderProgram_->uniformLocation("shUnblocked");
+
+	shadowCoeffsTextureLocation_ = shaderProgram_->uniformLocation("shadowCoeffs");
+	coeffAmbTextureLocation_ = shaderProgram_->uniformLocation("coeffAmb");
+#elif __ANDROID__
 	vertexLocation_ = glGetAttribLocation(shaderProgram_, "vertex");
 	normalLocation_ = glGetAttribLocation(shaderProgram_, "normal");
 
@@ -109,14 +234,10 @@ SHMeshPlaneDotObject::SHMeshPlaneDotObject(AAssetManager* assetManager, float sc
 	shFactorLocation_ = glGetUniformLocation(shaderProgram_, "shFactor");
 	shadowColorLocation_ = glGetUniformLocation(shaderProgram_, "shadowColor");
 
-	renderCoeffNbr_ = 100;
-	colorCorrectionLocation_ = false;
-
-	shadowColor_ = 0.1f;
-
-	initialized_ = true;
-}
+	shBlockedLocation_ = glGetAttribLocation(shaderProgram_, "shBlocked");
+	shUnblockedLocation_ = glGetUniformLocation(shaderProgram_, "shUnblocked");
 #endif
+}
 
 void SHMeshPlaneDotObject::createMesh(float scale) {
 	mesh_.reset(new gl::StaticMesh());
@@ -183,6 +304,18 @@ void SHMeshPlaneDotObject::render(const glm::mat4 &viewMat, const glm::mat4 &pro
 		GL_CHECK(glVertexAttribPointer(normalLocation_, 3, GL_FLOAT, GL_FALSE, 0, mesh_->normals_.data()));
 	}
 
+	if (cpuLighting_ && (shBlockedLocation_ != -1)) {
+		evaluator_.update(); // Only evaluated if the environment or the order changed
+		GL_CHECK(glEnableVertexAttribArray(shBlockedLocation_));
+		GL_CHECK(glVertexAttribPointer(shBlockedLocation_, 3, GL_FLOAT, GL_FALSE, 0, evaluator_.getLighting().data()));
+	}
+
+	if (cpuLighting_ && planeCoeff_ && (shUnblockedLocation_ != -1)) {
+		int nbrCoeffs = std::min((int)renderCoeffNbr_, (int)ambientCoeffs_.size());
+		glm::vec3 unblocked = sh::TransferEvaluator::dot(planeCoeff_.get(), ambientCoeffs_.data(), nbrCoeffs);
+		GL_CHECK(glUniform3f(shUnblockedLocation_, unblocked.r, unblocked.g, unblocked.b));
+	}
+
 	if (mvpLocation_ != -1) {
 		glm::mat4 mvpMat = projMat * viewMat * modelMat;
 		GL_CHECK(glUniformMatrix4fv(mvpLocation_, 1, GL_FALSE, glm::value_ptr(mvpMat)));
@@ -224,14 +357,19 @@ void SHMeshPlaneDotObject::render(const glm::mat4 &viewMat, const glm::mat4 &pro
 #ifdef _WINDOWS
 	shaderProgram_->disableAttributeArray(vertexLocation_);
   shaderProgram_->disableAttributeArray(normalLocation_);
+	if (cpuLighting_)
+		shaderProgram_->disableAttributeArray(shBlockedLocation_);
 
   shaderProgram_->release();
 #elif __ANDROID__
+	if (cpuLighting_ && (shBlockedLocation_ != -1))
+		GL_CHECK(glDisableVertexAttribArray(shBlockedLocation_));
+
 	GL_CHECK(glUseProgram(0));
 #endif
 }
 
-void SHMeshPlaneDotObject::updateCoefficients(const std::string& shadowFilename, const std::string& planeFilename) {
+void SHMeshPlaneDotObject::updateCoefficients(const std::string& shadowFilename, const std::string& planeFilename, int maxOrder) {
 	std::ifstream shadowFile;
 	shadowFile.open(shadowFilename, std::ios::in | std::ios::binary);
 
@@ -240,25 +378,27 @@ void SHMeshPlaneDotObject::updateCoefficients(const std::string& shadowFilename,
 	shadowFile.read((char*)&nbrVertices, sizeof(uint32_t));
 	shadowFile.read((char*)&nbrOrder, sizeof(uint8_t));
 
-	coeffNbr_ = (nbrOrder + 1)*(nbrOrder + 1);
+	// Only the bands that can be rendered are kept
+	uint32_t fileCoeffNbr = (nbrOrder + 1)*(nbrOrder + 1);
+	meshOrder_ = std::min((int)nbrOrder, std::max(maxOrder, 0));
+	coeffNbr_ = sh::BandLimit::getNbrCoefficients(meshOrder_);
 
-	glm::ivec2 coeffTexDim;
-	coeffTexDim.x = coeffNbr_ * VerticesPerRow;
-	coeffTexDim.y = (floor(nbrVertices / coeffTexDim.x) + 1)*coeffTexDim.x/(coeffTexDim.x/coeffNbr_);
+	nbrVertices_ = nbrVertices;
+	coeffTexDim_.x = coeffNbr_ * VerticesPerRow;
+	coeffTexDim_.y = (floor(nbrVertices / coeffTexDim_.x) + 1)*coeffTexDim_.x/(coeffTexDim_.x/coeffNbr_);
 
-	shadowCoeff_.reset(new float[(int)coeffTexDim.x*(int)coeffTexDim.y], std::default_delete<float[]>());
+	shadowCoeff_.reset(new float[(int)coeffTexDim_.x*(int)coeffTexDim_.y], std::default_delete<float[]>());
 	float* curCoeff = shadowCoeff_.get();
 	for (size_t i = 0; i < nbrVertices; i++) {
 		shadowFile.read((char*)curCoeff, sizeof(float)*coeffNbr_);
+		shadowFile.seekg(sizeof(float)*(fileCoeffNbr - coeffNbr_), std::ios::cur);
 		curCoeff += coeffNbr_;
 	}
 	shadowFile.close();
 
-	std::vector<TexParam> texParams;
-	texParams.push_back(TexParam(GL_TEXTURE_MAG_FILTER, GL_NEAREST));
-	texParams.push_back(TexParam(GL_TEXTURE_MIN_FILTER, GL_NEAREST));
-
-	shadowTexture_.reset(new gl::Texture(coeffTexDim.x/4, coeffTexDim.y, 4, GL_FLOAT, texParams, (unsigned char*)shadowCoeff_.get()));
+	updateTransferTexture();
+	if (cpuLighting_)
+		evaluator_.setTransfer(shadowCoeff_.get(), nbrVertices_, coeffNbr_);
 
 	std::ifstream planeFile;
 	planeFile.open(planeFilename, std::ios::in | std::ios::binary);
@@ -266,11 +406,16 @@ void SHMeshPlaneDotObject::updateCoefficients(const std::string& shadowFilename,
 	planeFile.read((char*)&nbrVertices, sizeof(uint32_t));
 	planeFile.read((char*)&nbrOrder, sizeof(uint8_t));
 
-	planeCoeff_.reset(new float[coeffNbr_], std::default_delete<float[]>());
+	// The shader declares the coefficients of the highest order, the bands not stored are left to zero
+	int maxCoeffNbr = sh::BandLimit::getNbrCoefficients(sh::MaxSHOrder);
+	planeCoeff_.reset(new float[maxCoeffNbr], std::default_delete<float[]>());
+	std::fill(planeCoeff_.get(), planeCoeff_.get() + maxCoeffNbr, 0.f);
 
 	planeFile.read((char*)planeCoeff_.get(), sizeof(float) * coeffNbr_);
 
 	planeFile.close();
+
+	setSHOrder(shOrder_);
 }
 
 void SHMeshPlaneDotObject::loadFromFile(const std::string& filename) {
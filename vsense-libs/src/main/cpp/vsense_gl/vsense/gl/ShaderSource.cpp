@@ -0,0 +1,106 @@
+#include <vsense/gl/ShaderSource.h>
+
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+
+using namespace vsense;
+using namespace vsense::gl;
+
+const std::string ReductionTypeToken = "REDUCTION_TYPE";
+
+/*
+ * Replaces every occurrence of a token.
+ * @param text Text to process.
+ * @param token Token to replace.
+ * @param value Replacement.
+ * @return Processed text.
+ */
+std::string replaceToken(const std::string& text, const std::string& token, const std::string& value) {
+	std::string result;
+	result.reserve(text.size());
+
+	size_t start = 0;
+	size_t pos;
+	while ((pos = text.find(token, start)) != std::string::npos) {
+		result.append(text, start, pos - start);
+		result.append(value);
+		start = pos + token.size();
+	}
+	result.append(text, start, std::string::npos);
+
+	return result;
+}
+
+ShaderSource::ShaderSource(const std::string& source) : source_(source), hasLocalSize_(false) {
+
+}
+
+void ShaderSource::addDefine(const std::string& name, const std::string& value) {
+	defines_.push_back(std::make_pair(name, value));
+}
+
+void ShaderSource::addDefine(const std::string& name, int value) {
+	addDefine(name, std::to_string(value));
+}
+
+bool ShaderSource::setLocalSize(int sizeX, int sizeY) {
+	if ((sizeX <= 0) || (sizeY <= 0) || !isValidGroupSize(sizeX*sizeY)) {
+		std::cout << "Unsupported work group size: " << sizeX << "x" << sizeY << std::endl;
+		return false;
+	}
+
+	addDefine("LOCAL_SIZE_X", sizeX);
+	addDefine("LOCAL_SIZE_Y", sizeY);
+	addDefine("REDUCTION_GROUP_SIZE", sizeX*sizeY);
+	hasLocalSize_ = true;
+
+	return true;
+}
+
+void ShaderSource::addReductionType(const std::string& type) {
+	if (std::find(reductionTypes_.begin(), reductionTypes_.end(), type) == reductionTypes_.end())
+		reductionTypes_.push_back(type);
+}
+
+bool ShaderSource::assemble(const std::string& reductionLib, const std::string& reductionTemplate, std::string& result) const {
+	size_t versionPos = source_.find("#version");
+	if (versionPos == std::string::npos) {
+		std::cout << "The shader source has no #version directive" << std::endl;
+		return false;
+	}
+
+	if (!reductionTypes_.empty() && !hasLocalSize_) {
+		std::cout << "The work group size is required by the reductions" << std::endl;
+		return false;
+	}
+
+	size_t bodyPos = source_.find('\n', versionPos);
+	if (bodyPos == std::string::npos)
+		bodyPos = source_.size();
+	else
+		bodyPos++;
+
+	std::ostringstream assembled;
+	assembled << source_.substr(0, bodyPos);
+	if (bodyPos == source_.size())
+		assembled << "\n";
+
+	for (size_t i = 0; i < defines_.size(); i++)
+		assembled << "#define " << defines_[i].first << " " << defines_[i].second << "\n";
+
+	if (!reductionTypes_.empty()) {
+		assembled << reductionLib << "\n";
+
+		for (size_t i = 0; i < reductionTypes_.size(); i++)
+			assembled << replaceToken(reductionTemplate, ReductionTypeToken, reductionTypes_[i]) << "\n";
+	}
+
+	// Keeps the line numbers of the compilation errors relative to the shader file
+	assembled << "#line 2\n";
+	assembled << source_.substr(bodyPos);
+
+	result = assembled.str();
+
+	return true;
+}
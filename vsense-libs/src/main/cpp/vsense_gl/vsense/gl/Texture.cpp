@@ -193,6 +193,26 @@ void Texture::initialize(uint32_t width, uint32_t height, uint8_t channels, GLen
 
 		sizeBytes_ = sizeof(int32_t);
 	}
+	else if (dType == GL_UNSIGNED_SHORT) {
+		if (channels == 1) {
+			intFormat_ = GL_R16UI;
+			format_ = GL_RED_INTEGER;
+		}
+		else if (channels == 2) {
+			intFormat_ = GL_RG16UI;
+			format_ = GL_RG_INTEGER;
+		}
+		else if (channels == 3) {
+			intFormat_ = GL_RGB16UI;
+			format_ = GL_RGB_INTEGER;
+		}
+		else if (channels == 4) {
+			intFormat_ = GL_RGBA16UI;
+			format_ = GL_RGBA_INTEGER;
+		}
+
+		sizeBytes_ = sizeof(uint16_t);
+	}
 	else { // GL_UNSIGNED_INT
 		if (channels == 1) {
 			intFormat_ = GL_R32UI;
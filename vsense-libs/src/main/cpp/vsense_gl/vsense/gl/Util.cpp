@@ -59,6 +59,12 @@ int normalizedColorCameraRotation(int cameraRotation) {
   return cameraN;
 }
 
+static std::shared_ptr<ProgramCache> programCache; // Cache used by createProgram, if any
+
+void setProgramCache(std::shared_ptr<ProgramCache> cache) {
+  programCache = cache;
+}
+
 void checkGlError(const char *operation) {
   for (GLint error = glGetError(); error; error = glGetError()) {
     LOGI("after %s() glError (0x%x)\n", operation, error);
@@ -93,6 +99,14 @@ static GLuint loadShader(GLenum shaderType, const char *shaderSource) {
 }
 
 GLuint createProgram(const char* vertexSource, const char* fragmentSource) {
+  if (programCache) {
+    std::vector<std::pair<ShaderStage, std::string>> sources;
+    sources.push_back(std::make_pair(StageVertex, std::string(vertexSource)));
+    sources.push_back(std::make_pair(StageFragment, std::string(fragmentSource)));
+
+    return programCache->getProgram(sources);
+  }
+
   GLuint vertexShader = loadShader(GL_VERTEX_SHADER, vertexSource);
   if (!vertexShader) {
     return 0;
@@ -131,6 +145,13 @@ GLuint createProgram(const char* vertexSource, const char* fragmentSource) {
 }
 
 GLuint createProgram(const char* computeSource) {
+  if (programCache) {
+    std::vector<std::pair<ShaderStage, std::string>> sources;
+    sources.push_back(std::make_pair(StageCompute, std::string(computeSource)));
+
+    return programCache->getProgram(sources);
+  }
+
   GLuint computeShader = loadShader(GL_COMPUTE_SHADER, computeSource);
 	if (!computeShader) {
 		return 0;
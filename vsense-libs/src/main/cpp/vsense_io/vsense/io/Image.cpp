@@ -1,9 +1,11 @@
 #include <vsense/io/Image.h>
+#include <vsense/io/YUVConverter.h>
 
 #include <vsense/common/Util.h>
 #include <vsense/color/Color.h>
 
 #include <algorithm>
+#include <cstring>
 
 #ifdef __ANDROID__
 #include <tango_client_api.h>
@@ -41,28 +43,8 @@ Image::Image(const TangoImageBuffer* imgBuffer) {
 	const uchar* Y = imgBuffer->data;
 	const uchar* C = Y + nbrPixels;
 
-	const uchar* rowDataC;
-	float crVal, cbVal;
-	for (uint32_t row = 0; row < imgBuffer->height; row++) {
-		uchar* rowDataOut = this->row(row);
-		const uchar* rowDataY = Y + imgBuffer->width*row;
-
-		rowDataC = C + imgBuffer->width*(row >> 1);
-
-		for (uint32_t col = 0; col < imgBuffer->width; col++) {
-			float yVal = *rowDataY++;
-
-			if (col % 2 == 0) {
-				crVal = *rowDataC++;
-				cbVal = *rowDataC++;
-			}
-
-			*rowDataOut++ = (uchar)std::max(std::min(yVal + (1.370705f*(crVal - 128)), 255.f), 0.f);
-			*rowDataOut++ = (uchar)std::max(std::min(yVal - (0.698001f*(crVal - 128)) - (0.337633f*(cbVal - 128)), 255.f), 0.f);
-			*rowDataOut++ = (uchar)std::max(std::min(yVal + (1.732446f*(cbVal - 128)), 255.f), 0.f);
-			*rowDataOut++ = 255;
-		}
-	}
+	if (!YUVConverter::convertNV21(Y, C, width_, height_, width_, data_.get())) // The frame is left black rather than uninitialized
+		memset(data_.get(), 0, nbrPixels * NbrChannels);
 }
 #endif
 
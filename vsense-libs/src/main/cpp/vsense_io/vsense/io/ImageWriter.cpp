@@ -0,0 +1,48 @@
+#include <vsense/io/ImageWriter.h>
+#include <vsense/io/Image.h>
+#include <vsense/io/YUVConverter.h>
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+
+using namespace std;
+using namespace vsense::io;
+
+bool ImageWriter::write(const std::string& filename, const Image& img, const ImageMetadata& imData) {
+	ofstream file(filename, ios::out | ios::binary);
+	if (!file.is_open()) {
+		cout << "Unable to open " << filename << endl;
+		return false;
+	}
+
+	bool success = write(file, img, imData);
+	file.close();
+
+	return success;
+}
+
+bool ImageWriter::write(std::ostream& out, const Image& img, const ImageMetadata& imData) {
+	uint32_t width = (uint32_t)img.cols();
+	uint32_t height = (uint32_t)img.rows();
+
+	vector<uchar> Y((size_t)width*height);
+	vector<uchar> C((size_t)width*height / 2);
+	if (!YUVConverter::convertToNV21(img.data(), width, height, Y.data(), C.data()))
+		return false;
+
+	out.write((const char*)&width, sizeof(uint32_t));
+	out.write((const char*)&height, sizeof(uint32_t));
+	out.write((const char*)&imData.exposure_, sizeof(int64_t));
+	out.write((const char*)&imData.timestamp_, sizeof(double));
+	out.write((const char*)&imData.f_.x, sizeof(double) * 2);
+	out.write((const char*)&imData.c_.x, sizeof(double) * 2);
+	out.write((const char*)imData.distortion_, sizeof(double) * 5);
+	out.write((const char*)imData.translation_, sizeof(double) * 3);
+	out.write((const char*)imData.orientation_, sizeof(double) * 4);
+	out.write((const char*)&imData.accuracy_, sizeof(float));
+	out.write((const char*)Y.data(), Y.size());
+	out.write((const char*)C.data(), C.size());
+
+	return out.good();
+}
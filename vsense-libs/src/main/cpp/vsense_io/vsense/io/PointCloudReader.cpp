@@ -1,52 +1,148 @@
 #include <vsense/io/PointCloudReader.h>
+#include <vsense/io/PointCloudWriter.h>
+
+#include <vsense/common/Half.h>
 
 #include <glm/gtc/quaternion.hpp>
 
 #include <iostream>
 #include <fstream>
+#include <vector>
 
 using namespace std;
+using namespace vsense;
 using namespace vsense::io;
 using namespace vsense::pc;
 
 bool PointCloudReader::read(const std::string& filename, PointCloud& pc, PointCloudMetadata& pcData, float minConf) {
 	ifstream file(filename, ios::in | ios::binary);
-	if (file.is_open()) {
-		file.read((char*)&pcData.width_, sizeof(uint32_t));
-		file.read((char*)&pcData.height_, sizeof(uint32_t));
-		file.read((char*)&pcData.f_.x, sizeof(double) * 2);
-		file.read((char*)&pcData.c_.x, sizeof(double) * 2);
-		file.read((char*)pcData.distortion_, sizeof(double) * 5);
-		file.read((char*)&pcData.nbrPoints_, sizeof(uint32_t));
-		file.read((char*)&pcData.timestamp_, sizeof(double));
-		file.read((char*)pcData.translation_, sizeof(double) * 3);
-		file.read((char*)pcData.orientation_, sizeof(double) * 4);
-		file.read((char*)&pcData.accuracy_, sizeof(float));
-
-		for (int i = 0; i < 5; i++)
-			pcData.distortionF_[i] = pcData.distortion_[i];
-		
-		glm::vec3 pos;
-		Point pt;
-		float conf;
-
-		for (unsigned int i = 0; i < pcData.nbrPoints_; i++) {									
-			for(int j = 0; j < 3; j++)
-				file.read((char*)&pt.pos[j], sizeof(float));
-			file.read((char*)&conf, sizeof(float));
-
-			if (conf >= minConf)
-				pc.addPoint(pt);
+	if (!file.is_open())
+		return false;
+
+	bool isComplete = read(file, pc, pcData, minConf);
+	if (!isComplete)
+		cout << "Point cloud file " << filename << " is truncated" << endl;
+
+	file.close();
+
+	return isComplete;
+}
+
+bool PointCloudReader::read(std::istream& in, PointCloud& pc, PointCloudMetadata& pcData, float minConf) {
+	in.read((char*)&pcData.width_, sizeof(uint32_t));
+	in.read((char*)&pcData.height_, sizeof(uint32_t));
+	in.read((char*)&pcData.f_.x, sizeof(double) * 2);
+	in.read((char*)&pcData.c_.x, sizeof(double) * 2);
+	in.read((char*)pcData.distortion_, sizeof(double) * 5);
+	in.read((char*)&pcData.nbrPoints_, sizeof(uint32_t));
+	in.read((char*)&pcData.timestamp_, sizeof(double));
+	in.read((char*)pcData.translation_, sizeof(double) * 3);
+	in.read((char*)pcData.orientation_, sizeof(double) * 4);
+	in.read((char*)&pcData.accuracy_, sizeof(float));
+
+	if (!in.good())
+		return false;
+
+	for (int i = 0; i < 5; i++)
+		pcData.distortionF_[i] = pcData.distortion_[i];
+	
+	// The payload is read at once and split into positions and confidence
+	vector<float> payload((size_t)pcData.nbrPoints_ * 4);
+	if (!payload.empty())
+		in.read((char*)payload.data(), sizeof(float)*payload.size());
+
+	size_t nbrRead = (size_t)in.gcount() / (sizeof(float) * 4);
+	if (payload.empty())
+		nbrRead = 0;
+
+	vector<glm::vec3> pos;
+	vector<float> conf;
+	pos.reserve(nbrRead);
+	conf.reserve(nbrRead);
+
+	const float* curPt = payload.data();
+	for (size_t i = 0; i < nbrRead; i++, curPt += 4) {
+		if (curPt[3] >= minConf) {
+			pos.push_back(glm::vec3(curPt[0], curPt[1], curPt[2]));
+			conf.push_back(curPt[3]);
+		}
+	}
+
+	bool isComplete = nbrRead == pcData.nbrPoints_;
+
+	if (!pos.empty())
+		pc.addPoints(pos.data(), nullptr, nullptr, conf.data(), pos.size());
+
+	pcData.nbrPoints_ = (unsigned int)pc.size();
+
+	return isComplete;
+}
+
+bool PointCloudReader::readCompact(const std::string& filename, PointCloud& pc) {
+	ifstream file(filename, ios::in | ios::binary);
+	if (!file.is_open()) {
+		cout << "Unable to open " << filename << endl;
+		return false;
+	}
+
+	uint32_t magic = 0, options = 0, nbrPoints = 0;
+	glm::vec3 devPos;
+
+	file.read((char*)&magic, sizeof(uint32_t));
+	file.read((char*)&options, sizeof(uint32_t));
+	file.read((char*)&nbrPoints, sizeof(uint32_t));
+	file.read((char*)&devPos.x, sizeof(float) * 3);
+
+	if (!file.good() || (magic != CompactPointCloudMagic)) {
+		cout << filename << " is not a compact point cloud file" << endl;
+		return false;
+	}
+
+	vector<glm::vec3> pos(nbrPoints);
+	vector<glm::vec4> col(nbrPoints);
+	vector<uchar> flags(nbrPoints);
+	vector<float> conf(nbrPoints);
+
+	if (nbrPoints) {
+		if (options & HalfPositions) {
+			vector<uint16_t> halfPos((size_t)nbrPoints * 3);
+			file.read((char*)halfPos.data(), sizeof(uint16_t)*halfPos.size());
+
+			float* curPos = &pos[0].x;
+			for (size_t i = 0; i < halfPos.size(); i++)
+				curPos[i] = common::halfToFloat(halfPos[i]);
+		} else {
+			file.read((char*)&pos[0].x, sizeof(float)*nbrPoints * 3);
 		}
 
-		pcData.nbrPoints_ = (unsigned int)pc.size();
+		vector<float> rgb((size_t)nbrPoints * 3);
+		file.read((char*)rgb.data(), sizeof(float)*rgb.size());
+		for (size_t i = 0; i < nbrPoints; i++)
+			col[i] = glm::vec4(rgb[i * 3], rgb[i * 3 + 1], rgb[i * 3 + 2], 1.f);
+
+		file.read((char*)flags.data(), nbrPoints);
+
+		if (options & ByteConfidence) {
+			vector<uchar> byteConf(nbrPoints);
+			file.read((char*)byteConf.data(), nbrPoints);
+			for (size_t i = 0; i < nbrPoints; i++)
+				conf[i] = (float)byteConf[i] / 255.f;
+		} else {
+			file.read((char*)conf.data(), sizeof(float)*nbrPoints);
+		}
+
+		if (!file.good()) {
+			cout << "Compact point cloud file " << filename << " is truncated" << endl;
+			return false;
+		}
 
-		file.close();
+		pc.addPoints(pos.data(), col.data(), flags.data(), conf.data(), nbrPoints);
+	}
 
-		return true;
-	}	
+	pc.setPosition(devPos);
+	pc.recalculateBoundingBox();
 
-	return false;
+	return true;
 }
 
 glm::mat4 PointCloudMetadata::asPose() {
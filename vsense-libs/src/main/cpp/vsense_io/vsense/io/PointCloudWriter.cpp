@@ -0,0 +1,228 @@
+#include <vsense/io/PointCloudWriter.h>
+
+#include <vsense/common/Half.h>
+
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+using namespace std;
+using namespace vsense;
+using namespace vsense::io;
+using namespace vsense::pc;
+
+const size_t XYZBufferSize = 1 << 20; // Bytes formatted before each write
+const size_t XYZMaxLineSize = 128;
+
+const uint64_t DecimalScale[] = { 1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000 };
+
+/*
+ * Writes the digits of an unsigned integer.
+ * @param buf Pointer to the output characters.
+ * @param value Value to write.
+ * @param minDigits Minimum number of digits, padded with zeros.
+ * @return Pointer after the last character written.
+ */
+inline char* writeDigits(char* buf, uint64_t value, int minDigits = 1) {
+	char digits[20];
+	int nbrDigits = 0;
+
+	do {
+		digits[nbrDigits++] = (char)('0' + value % 10);
+		value /= 10;
+	} while (value);
+
+	while (nbrDigits < minDigits)
+		digits[nbrDigits++] = '0';
+
+	while (nbrDigits)
+		*buf++ = digits[--nbrDigits];
+
+	return buf;
+}
+
+/*
+ * Writes a float with a fixed number of decimals, trailing zeros are removed.
+ * @param buf Pointer to the output characters.
+ * @param value Value to write.
+ * @param decimals Number of decimals.
+ * @return Pointer after the last character written.
+ */
+inline char* writeFloat(char* buf, float value, int decimals) {
+	double absValue = fabs((double)value);
+	if (!(absValue < 1e9)) // Large values and NaN
+		return buf + sprintf(buf, "%g", value);
+
+	uint64_t scale = DecimalScale[decimals];
+	uint64_t scaled = (uint64_t)(absValue*scale + 0.5);
+	uint64_t intPart = scaled / scale;
+	uint64_t fracPart = scaled % scale;
+
+	if (value < 0.f && scaled)
+		*buf++ = '-';
+
+	buf = writeDigits(buf, intPart);
+
+	if (fracPart) {
+		int nbrDigits = decimals;
+		while (!(fracPart % 10)) {
+			fracPart /= 10;
+			nbrDigits--;
+		}
+
+		*buf++ = '.';
+		buf = writeDigits(buf, fracPart, nbrDigits);
+	}
+
+	return buf;
+}
+
+bool PointCloudWriter::write(const std::string& filename, const PointCloud& pc, uint32_t options) {
+	ofstream file(filename, ios::out | ios::binary);
+	if (!file.is_open()) {
+		cout << "Unable to open " << filename << endl;
+		return false;
+	}
+
+	uint32_t nbrPoints = (uint32_t)pc.size();
+	glm::vec3 devPos = pc.getPosition();
+
+	file.write((const char*)&CompactPointCloudMagic, sizeof(uint32_t));
+	file.write((const char*)&options, sizeof(uint32_t));
+	file.write((const char*)&nbrPoints, sizeof(uint32_t));
+	file.write((const char*)&devPos.x, sizeof(float) * 3);
+
+	if (nbrPoints) {
+		const float* pos = &pc.getPositionPtr()->x;
+		if (options & HalfPositions) {
+			vector<uint16_t> halfPos(nbrPoints * 3);
+			for (size_t i = 0; i < halfPos.size(); i++)
+				halfPos[i] = common::floatToHalf(pos[i]);
+
+			file.write((const char*)halfPos.data(), sizeof(uint16_t)*halfPos.size());
+		} else {
+			file.write((const char*)pos, sizeof(float)*nbrPoints * 3);
+		}
+
+		const glm::vec4* col = pc.getColorsPtr();
+		vector<float> rgb(nbrPoints * 3);
+		for (size_t i = 0; i < nbrPoints; i++) {
+			rgb[i * 3] = col[i].r;
+			rgb[i * 3 + 1] = col[i].g;
+			rgb[i * 3 + 2] = col[i].b;
+		}
+		file.write((const char*)rgb.data(), sizeof(float)*rgb.size());
+
+		file.write((const char*)pc.getFlagsPtr(), nbrPoints);
+
+		const float* conf = pc.getConfidencePtr();
+		if (options & ByteConfidence) {
+			vector<uchar> byteConf(nbrPoints);
+			for (size_t i = 0; i < nbrPoints; i++)
+				byteConf[i] = (uchar)(std::min(std::max(conf[i], 0.f), 1.f)*255.f + 0.5f);
+
+			file.write((const char*)byteConf.data(), nbrPoints);
+		} else {
+			file.write((const char*)conf, sizeof(float)*nbrPoints);
+		}
+	}
+
+	bool success = file.good();
+	file.close();
+
+	return success;
+}
+
+bool PointCloudWriter::writeXYZ(const std::string& filename, const PointCloud& pc, int decimals) {
+	ofstream file(filename, ios::out | ios::binary);
+	if (!file.is_open()) {
+		cout << "Unable to open " << filename << endl;
+		return false;
+	}
+
+	decimals = std::min(std::max(decimals, 0), 9);
+
+	const glm::vec3* pos = pc.getPositionPtr();
+	const glm::vec4* col = pc.getColorsPtr();
+
+	vector<char> buffer(XYZBufferSize + XYZMaxLineSize);
+	char* cur = buffer.data();
+
+	for (size_t i = 0; i < pc.size(); i++) {
+		for (int j = 0; j < 3; j++) {
+			cur = writeFloat(cur, pos[i][j], decimals);
+			*cur++ = ' ';
+		}
+
+		for (int j = 0; j < 3; j++) {
+			int value = (int)(col[i][j] * 255);
+			if (value < 0) {
+				*cur++ = '-';
+				value = -value;
+			}
+
+			cur = writeDigits(cur, (uint64_t)value);
+			*cur++ = j < 2 ? ' ' : '\n';
+		}
+
+		if ((size_t)(cur - buffer.data()) >= XYZBufferSize) {
+			file.write(buffer.data(), cur - buffer.data());
+			cur = buffer.data();
+		}
+	}
+
+	file.write(buffer.data(), cur - buffer.data());
+
+	bool success = file.good();
+	file.close();
+
+	return success;
+}
+
+bool PointCloudWriter::writeTango(const std::string& filename, const PointCloud& pc, const PointCloudMetadata& pcData) {
+	ofstream file(filename, ios::out | ios::binary);
+	if (!file.is_open()) {
+		cout << "Unable to open " << filename << endl;
+		return false;
+	}
+
+	bool success = writeTango(file, pc, pcData);
+	file.close();
+
+	return success;
+}
+
+bool PointCloudWriter::writeTango(std::ostream& out, const PointCloud& pc, const PointCloudMetadata& pcData) {
+	uint32_t nbrPoints = (uint32_t)pc.size();
+
+	out.write((const char*)&pcData.width_, sizeof(uint32_t));
+	out.write((const char*)&pcData.height_, sizeof(uint32_t));
+	out.write((const char*)&pcData.f_.x, sizeof(double) * 2);
+	out.write((const char*)&pcData.c_.x, sizeof(double) * 2);
+	out.write((const char*)pcData.distortion_, sizeof(double) * 5);
+	out.write((const char*)&nbrPoints, sizeof(uint32_t));
+	out.write((const char*)&pcData.timestamp_, sizeof(double));
+	out.write((const char*)pcData.translation_, sizeof(double) * 3);
+	out.write((const char*)pcData.orientation_, sizeof(double) * 4);
+	out.write((const char*)&pcData.accuracy_, sizeof(float));
+
+	// Interleaved as delivered by Tango: X, Y, Z and confidence
+	if (nbrPoints) {
+		const glm::vec3* pos = pc.getPositionPtr();
+		const float* conf = pc.getConfidencePtr();
+
+		vector<float> payload((size_t)nbrPoints * 4);
+		for (size_t i = 0; i < nbrPoints; i++) {
+			payload[i * 4] = pos[i].x;
+			payload[i * 4 + 1] = pos[i].y;
+			payload[i * 4 + 2] = pos[i].z;
+			payload[i * 4 + 3] = conf ? conf[i] : 1.f;
+		}
+
+		out.write((const char*)payload.data(), sizeof(float)*payload.size());
+	}
+
+	return out.good();
+}
@@ -0,0 +1,202 @@
+#include <vsense/io/RemapCache.h>
+#include <vsense/io/Image.h>
+
+#include <vsense/common/Parallel.h>
+#include <vsense/common/Util.h>
+
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+#if defined(__aarch64__) && (defined(__ARM_NEON) || defined(__ARM_NEON__))
+#include <arm_neon.h>
+#define USE_NEON
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#include <emmintrin.h>
+#define USE_SSE
+#endif
+
+using namespace vsense;
+using namespace vsense::io;
+
+const int FractionOne = 1 << RemapCache::FractionBits;
+const int WeightShift = 2 * RemapCache::FractionBits;
+const int WeightRound = 1 << (WeightShift - 1);
+
+RemapCache::RemapCache() : width_(0), height_(0), srcWidth_(0), srcHeight_(0), f_(0., 0.), c_(0., 0.), rays_(NULL), pose_(1.f) {
+	memset(coeff_, 0, sizeof(double) * 5);
+}
+
+void RemapCache::reset(size_t width, size_t height, size_t srcWidth, size_t srcHeight, const double* coeff, const glm::dvec2& f, const glm::dvec2& c) {
+	width_ = width;
+	height_ = height;
+	srcWidth_ = srcWidth;
+	srcHeight_ = srcHeight;
+	memcpy(coeff_, coeff, sizeof(double) * 5);
+	f_ = f;
+	c_ = c;
+
+	size_t nbrPixels = width*height;
+	nearest_.resize(nbrPixels);
+	offset_.resize(nbrPixels);
+	fracX_.resize(nbrPixels);
+	fracY_.resize(nbrPixels);
+}
+
+void RemapCache::setLocation(size_t idx, const glm::vec2& loc) {
+	// Same rounding and bounds as the callers of Image::undistortAndProject
+	float xn = floor(loc.x + 0.5f);
+	float yn = floor(loc.y + 0.5f);
+	if ((xn < 0) || (xn >= srcWidth_) || (yn < 0) || (yn >= srcHeight_))
+		nearest_[idx] = -1;
+	else
+		nearest_[idx] = (int32_t)((size_t)yn*srcWidth_ + (size_t)xn);
+
+	float x0 = floor(loc.x);
+	float y0 = floor(loc.y);
+	if ((x0 < 0.f) || (y0 < 0.f) || (x0 + 1.f >= (float)srcWidth_) || (y0 + 1.f >= (float)srcHeight_)) {
+		offset_[idx] = -1;
+		fracX_[idx] = 0;
+		fracY_[idx] = 0;
+		return;
+	}
+
+	offset_[idx] = (int32_t)((size_t)y0*srcWidth_ + (size_t)x0);
+	fracX_[idx] = (uint8_t)floor((loc.x - x0)*FractionOne + 0.5f);
+	fracY_[idx] = (uint8_t)floor((loc.y - y0)*FractionOne + 0.5f);
+}
+
+void RemapCache::build(size_t width, size_t height, const double* coeff, const glm::dvec2& f, const glm::dvec2& c, size_t nbrThreads) {
+	reset(width, height, width, height, coeff, f, c);
+	rays_ = NULL;
+	pose_ = glm::mat4(1.f);
+
+	common::parallelFor(height, [&](size_t row) {
+		for (size_t col = 0; col < width; col++) {
+			glm::vec3 ray((float)((col - c.x) / f.x), (float)((row - c.y) / f.y), 1.f);
+			setLocation(row*width + col, Image::undistortAndProject(ray, coeff, f, c));
+		}
+	}, nbrThreads);
+}
+
+void RemapCache::build(const glm::vec2* rays, size_t width, size_t height, const glm::mat4& pose, size_t srcWidth, size_t srcHeight,
+	const double* coeff, const glm::dvec2& f, const glm::dvec2& c, size_t nbrThreads) {
+	reset(width, height, srcWidth, srcHeight, coeff, f, c);
+	rays_ = rays;
+	pose_ = pose;
+
+	common::parallelFor(height, [&](size_t row) {
+		for (size_t col = 0; col < width; col++) {
+			size_t idx = row*width + col;
+
+			glm::vec3 ptTrans = glm::vec3(pose*glm::vec4(rays[idx].x, rays[idx].y, 1.f, 1.f));
+			setLocation(idx, Image::undistortAndProject(ptTrans, coeff, f, c));
+		}
+	}, nbrThreads);
+}
+
+bool RemapCache::matches(size_t width, size_t height, const double* coeff, const glm::dvec2& f, const glm::dvec2& c) const {
+	if (rays_ || (width != width_) || (height != height_) || (width != srcWidth_) || (height != srcHeight_) || (f != f_) || (c != c_))
+		return false;
+
+	return memcmp(coeff, coeff_, sizeof(double) * 5) == 0;
+}
+
+bool RemapCache::matches(const glm::vec2* rays, const glm::mat4& pose, size_t srcWidth, size_t srcHeight, const double* coeff,
+	const glm::dvec2& f, const glm::dvec2& c) const {
+	if (!rays || (rays != rays_) || (pose != pose_) || (srcWidth != srcWidth_) || (srcHeight != srcHeight_) || (f != f_) || (c != c_))
+		return false;
+
+	return memcmp(coeff, coeff_, sizeof(double) * 5) == 0;
+}
+
+bool RemapCache::sourceLocation(size_t row, size_t col, glm::vec2& loc) const {
+	size_t idx = row*width_ + col;
+	if (offset_[idx] < 0)
+		return false;
+
+	loc.x = (float)(offset_[idx] % srcWidth_) + (float)fracX_[idx] / FractionOne;
+	loc.y = (float)(offset_[idx] / srcWidth_) + (float)fracY_[idx] / FractionOne;
+
+	return true;
+}
+
+bool RemapCache::remap(const Image& src, Image& dst, size_t nbrThreads) const {
+	if ((src.cols() != srcWidth_) || (src.rows() != srcHeight_) || (dst.cols() != width_) || (dst.rows() != height_)) {
+		std::cout << "Image size does not match the remap cache" << std::endl;
+		return false;
+	}
+
+	const uchar* srcData = src.data();
+	size_t rowSize = srcWidth_ * 4;
+
+	common::parallelFor(height_, [&](size_t row) {
+		uchar* out = dst.row(row);
+		const int32_t* offset = &offset_[row*width_];
+		const uint8_t* fracX = &fracX_[row*width_];
+		const uint8_t* fracY = &fracY_[row*width_];
+
+#ifdef USE_SSE
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i round = _mm_set1_epi32(WeightRound);
+#endif
+
+		for (size_t col = 0; col < width_; col++, out += 4) {
+			if (offset[col] < 0) {
+				memset(out, 0, 4);
+				continue;
+			}
+
+			const uchar* p = srcData + (size_t)offset[col] * 4;
+			int wx = fracX[col];
+			int wy = fracY[col];
+
+#ifdef USE_SSE
+			// Two neighbors per row, vertical blend in 16 bits then horizontal blend with madd
+			__m128i top = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)p), zero);
+			__m128i bottom = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(p + rowSize)), zero);
+			__m128i vert = _mm_add_epi16(_mm_mullo_epi16(top, _mm_set1_epi16((short)(FractionOne - wy))), _mm_mullo_epi16(bottom, _mm_set1_epi16((short)wy)));
+
+			__m128i pairs = _mm_unpacklo_epi16(vert, _mm_srli_si128(vert, 8));
+			__m128i res = _mm_madd_epi16(pairs, _mm_set1_epi32((wx << 16) | (FractionOne - wx)));
+			res = _mm_srli_epi32(_mm_add_epi32(res, round), WeightShift);
+			res = _mm_packs_epi32(res, res);
+			res = _mm_packus_epi16(res, res);
+
+			int32_t pixel = _mm_cvtsi128_si32(res);
+			memcpy(out, &pixel, 4);
+#elif defined(USE_NEON)
+			uint16x8_t top = vmovl_u8(vld1_u8(p));
+			uint16x8_t bottom = vmovl_u8(vld1_u8(p + rowSize));
+			uint16x8_t vert = vmlaq_n_u16(vmulq_n_u16(top, (uint16_t)(FractionOne - wy)), bottom, (uint16_t)wy);
+
+			uint32x4_t res = vmlal_n_u16(vmull_n_u16(vget_low_u16(vert), (uint16_t)(FractionOne - wx)), vget_high_u16(vert), (uint16_t)wx);
+			uint16x4_t res16 = vrshrn_n_u32(res, WeightShift);
+			uint8x8_t res8 = vmovn_u16(vcombine_u16(res16, res16));
+
+			vst1_lane_u32((uint32_t*)out, vreinterpret_u32_u8(res8), 0);
+#else
+			for (int chan = 0; chan < 4; chan++) {
+				int top = p[chan] * (FractionOne - wx) + p[chan + 4] * wx;
+				int bottom = p[rowSize + chan] * (FractionOne - wx) + p[rowSize + chan + 4] * wx;
+
+				out[chan] = (uchar)((top*(FractionOne - wy) + bottom*wy + WeightRound) >> WeightShift);
+			}
+#endif
+		}
+	}, nbrThreads);
+
+	return true;
+}
+
+void RemapCache::sphericalTables(size_t width, size_t height, std::vector<float>& phi, std::vector<float>& theta) {
+	phi.resize(width);
+	theta.resize(height);
+
+	// Same expressions as Image::imageXToPhi and Image::imageYToTheta
+	for (size_t x = 0; x < width; x++)
+		phi[x] = M_2PI * ((int)x + 0.5f) / width;
+
+	for (size_t y = 0; y < height; y++)
+		theta[y] = M_PI * ((int)y + 0.5f) / height;
+}
@@ -0,0 +1,327 @@
+#include <vsense/io/YUVConverter.h>
+
+#include <vsense/common/Parallel.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+#if defined(__aarch64__) && (defined(__ARM_NEON) || defined(__ARM_NEON__))
+#include <arm_neon.h>
+#define USE_NEON
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#include <emmintrin.h>
+#define USE_SSE
+#endif
+
+using namespace vsense;
+using namespace vsense::io;
+
+// With 20 fractional bits the results match the float conversion for all Y, Cr and Cb values
+const int FixedShift = 20;
+const int CoeffSplit = 10; // The SSE2 path multiplies 16-bit halves of the coefficients
+
+const int32_t CoeffRV = (int32_t)(1.370705*(1 << FixedShift) + 0.5);
+const int32_t CoeffGV = (int32_t)(0.698001*(1 << FixedShift) + 0.5);
+const int32_t CoeffGU = (int32_t)(0.337633*(1 << FixedShift) + 0.5);
+const int32_t CoeffBU = (int32_t)(1.732446*(1 << FixedShift) + 0.5);
+
+// Inverse of the decoding matrix, rows give Y, Cr - 128 and Cb - 128 from R, G and B
+const float EncodeY[3] = { 0.298822f, 0.586815f, 0.114363f };
+const float EncodeV[3] = { 0.511545f, -0.428112f, -0.083434f };
+const float EncodeU[3] = { -0.172486f, -0.338720f, 0.511206f };
+
+const size_t RowsPerJob = 8;
+
+/*
+ * Clamps a fixed-point channel value to 8 bits.
+ * @param val Fixed-point value.
+ * @return Clamped value.
+ */
+inline uchar clampFixed(int32_t val) {
+	val >>= FixedShift;
+
+	return (uchar)(val < 0 ? 0 : (val > 255 ? 255 : val));
+}
+
+/*
+ * Converts a YCrCb triplet to RGBA.
+ * @param yVal Luma.
+ * @param vVal Red-difference chroma.
+ * @param uVal Blue-difference chroma.
+ * @param out Pointer to the output pixel.
+ */
+inline void convertPixel(int32_t yVal, int32_t vVal, int32_t uVal, uchar* out) {
+	int32_t yFixed = yVal << FixedShift;
+	vVal -= 128;
+	uVal -= 128;
+
+	out[0] = clampFixed(yFixed + CoeffRV*vVal);
+	out[1] = clampFixed(yFixed - CoeffGV*vVal - CoeffGU*uVal);
+	out[2] = clampFixed(yFixed + CoeffBU*uVal);
+	out[3] = 255;
+}
+
+/*
+ * Converts a full-resolution row.
+ * @param rowY Pointer to the luma row.
+ * @param rowC Pointer to the chroma row.
+ * @param width Row width.
+ * @param out Pointer to the output row.
+ */
+void convertRow(const uchar* rowY, const uchar* rowC, size_t width, uchar* out) {
+	size_t col = 0;
+
+#ifdef USE_SSE
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i offset = _mm_set1_epi16(128);
+	const __m128i alpha = _mm_set1_epi8((char)0xFF);
+
+	// Coefficients for the (V, U) pairs, split in 16-bit halves
+	const int16_t mask = (1 << CoeffSplit) - 1;
+	const __m128i rHi = _mm_set_epi16(0, CoeffRV >> CoeffSplit, 0, CoeffRV >> CoeffSplit, 0, CoeffRV >> CoeffSplit, 0, CoeffRV >> CoeffSplit);
+	const __m128i rLo = _mm_set_epi16(0, CoeffRV & mask, 0, CoeffRV & mask, 0, CoeffRV & mask, 0, CoeffRV & mask);
+	const __m128i gHi = _mm_set_epi16(CoeffGU >> CoeffSplit, CoeffGV >> CoeffSplit, CoeffGU >> CoeffSplit, CoeffGV >> CoeffSplit, CoeffGU >> CoeffSplit, CoeffGV >> CoeffSplit, CoeffGU >> CoeffSplit, CoeffGV >> CoeffSplit);
+	const __m128i gLo = _mm_set_epi16(CoeffGU & mask, CoeffGV & mask, CoeffGU & mask, CoeffGV & mask, CoeffGU & mask, CoeffGV & mask, CoeffGU & mask, CoeffGV & mask);
+	const __m128i bHi = _mm_set_epi16(CoeffBU >> CoeffSplit, 0, CoeffBU >> CoeffSplit, 0, CoeffBU >> CoeffSplit, 0, CoeffBU >> CoeffSplit, 0);
+	const __m128i bLo = _mm_set_epi16(CoeffBU & mask, 0, CoeffBU & mask, 0, CoeffBU & mask, 0, CoeffBU & mask, 0);
+
+	for (; col + 8 <= width; col += 8, out += 32) {
+		__m128i y16 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(rowY + col)), zero);
+		__m128i yLo = _mm_slli_epi32(_mm_unpacklo_epi16(y16, zero), FixedShift);
+		__m128i yHi = _mm_slli_epi32(_mm_unpackhi_epi16(y16, zero), FixedShift);
+
+		// Four (V, U) pairs, one per two pixels
+		__m128i c16 = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(rowC + col)), zero), offset);
+
+		__m128i rC = _mm_add_epi32(_mm_slli_epi32(_mm_madd_epi16(c16, rHi), CoeffSplit), _mm_madd_epi16(c16, rLo));
+		__m128i gC = _mm_add_epi32(_mm_slli_epi32(_mm_madd_epi16(c16, gHi), CoeffSplit), _mm_madd_epi16(c16, gLo));
+		__m128i bC = _mm_add_epi32(_mm_slli_epi32(_mm_madd_epi16(c16, bHi), CoeffSplit), _mm_madd_epi16(c16, bLo));
+
+		__m128i r = _mm_packs_epi32(_mm_srai_epi32(_mm_add_epi32(yLo, _mm_unpacklo_epi32(rC, rC)), FixedShift),
+		                            _mm_srai_epi32(_mm_add_epi32(yHi, _mm_unpackhi_epi32(rC, rC)), FixedShift));
+		__m128i g = _mm_packs_epi32(_mm_srai_epi32(_mm_sub_epi32(yLo, _mm_unpacklo_epi32(gC, gC)), FixedShift),
+		                            _mm_srai_epi32(_mm_sub_epi32(yHi, _mm_unpackhi_epi32(gC, gC)), FixedShift));
+		__m128i b = _mm_packs_epi32(_mm_srai_epi32(_mm_add_epi32(yLo, _mm_unpacklo_epi32(bC, bC)), FixedShift),
+		                            _mm_srai_epi32(_mm_add_epi32(yHi, _mm_unpackhi_epi32(bC, bC)), FixedShift));
+
+		__m128i rg = _mm_unpacklo_epi8(_mm_packus_epi16(r, zero), _mm_packus_epi16(g, zero));
+		__m128i ba = _mm_unpacklo_epi8(_mm_packus_epi16(b, zero), alpha);
+
+		_mm_storeu_si128((__m128i*)out, _mm_unpacklo_epi16(rg, ba));
+		_mm_storeu_si128((__m128i*)(out + 16), _mm_unpackhi_epi16(rg, ba));
+	}
+#elif defined(USE_NEON)
+	for (; col + 16 <= width; col += 16, out += 64) {
+		uint8x16_t yv = vld1q_u8(rowY + col);
+		uint8x8x2_t c = vld2_u8(rowC + col); // Eight (V, U) pairs
+
+		int16x8_t v16 = vreinterpretq_s16_u16(vsubl_u8(c.val[0], vdup_n_u8(128)));
+		int16x8_t u16 = vreinterpretq_s16_u16(vsubl_u8(c.val[1], vdup_n_u8(128)));
+		int32x4_t v32[2] = { vmovl_s16(vget_low_s16(v16)), vmovl_s16(vget_high_s16(v16)) };
+		int32x4_t u32[2] = { vmovl_s16(vget_low_s16(u16)), vmovl_s16(vget_high_s16(u16)) };
+
+		uint16x8_t yLo = vmovl_u8(vget_low_u8(yv));
+		uint16x8_t yHi = vmovl_u8(vget_high_u8(yv));
+		int32x4_t y32[4] = { vshlq_n_s32(vreinterpretq_s32_u32(vmovl_u16(vget_low_u16(yLo))), FixedShift),
+		                     vshlq_n_s32(vreinterpretq_s32_u32(vmovl_u16(vget_high_u16(yLo))), FixedShift),
+		                     vshlq_n_s32(vreinterpretq_s32_u32(vmovl_u16(vget_low_u16(yHi))), FixedShift),
+		                     vshlq_n_s32(vreinterpretq_s32_u32(vmovl_u16(vget_high_u16(yHi))), FixedShift) };
+
+		uint8x16x4_t rgba;
+		for (int chan = 0; chan < 3; chan++) {
+			int32x4_t contrib[2];
+			for (int h = 0; h < 2; h++) {
+				if (chan == 0)
+					contrib[h] = vmulq_n_s32(v32[h], CoeffRV);
+				else if (chan == 1)
+					contrib[h] = vnegq_s32(vmlaq_n_s32(vmulq_n_s32(v32[h], CoeffGV), u32[h], CoeffGU));
+				else
+					contrib[h] = vmulq_n_s32(u32[h], CoeffBU);
+			}
+
+			// Every chroma value is shared by two pixels
+			int32x4x2_t lo = vzipq_s32(contrib[0], contrib[0]);
+			int32x4x2_t hi = vzipq_s32(contrib[1], contrib[1]);
+
+			int16x8_t val0 = vcombine_s16(vqmovn_s32(vshrq_n_s32(vaddq_s32(y32[0], lo.val[0]), FixedShift)),
+			                              vqmovn_s32(vshrq_n_s32(vaddq_s32(y32[1], lo.val[1]), FixedShift)));
+			int16x8_t val1 = vcombine_s16(vqmovn_s32(vshrq_n_s32(vaddq_s32(y32[2], hi.val[0]), FixedShift)),
+			                              vqmovn_s32(vshrq_n_s32(vaddq_s32(y32[3], hi.val[1]), FixedShift)));
+
+			rgba.val[chan] = vcombine_u8(vqmovun_s16(val0), vqmovun_s16(val1));
+		}
+		rgba.val[3] = vdupq_n_u8(255);
+
+		vst4q_u8(out, rgba);
+	}
+#endif
+
+	for (; col < width; col += 2, out += 8) {
+		convertPixel(rowY[col], rowC[col], rowC[col + 1], out);
+		convertPixel(rowY[col + 1], rowC[col], rowC[col + 1], out + 4);
+	}
+}
+
+/*
+ * Converts a downscaled row, luma and chroma are averaged over each block before the conversion.
+ * @param y Pointer to the first luma row of the block.
+ * @param c Pointer to the first chroma row of the block.
+ * @param stride Distance in bytes between two rows.
+ * @param outWidth Output row width.
+ * @param scale Downscaling factor (2 or 4).
+ * @param out Pointer to the output row.
+ */
+void convertRowDownscaled(const uchar* y, const uchar* c, size_t stride, size_t outWidth, size_t scale, uchar* out) {
+	size_t chromaScale = scale / 2; // Chroma pairs (and rows) per block
+	int32_t roundY = (int32_t)(scale*scale / 2);
+	int32_t roundC = (int32_t)(chromaScale*chromaScale / 2);
+	int shiftY = scale == 4 ? 4 : 2;
+	int shiftC = scale == 4 ? 2 : 0;
+
+	for (size_t col = 0; col < outWidth; col++, out += 4) {
+		int32_t sumY = 0;
+		for (size_t r = 0; r < scale; r++) {
+			const uchar* rowY = y + r*stride + col*scale;
+			for (size_t i = 0; i < scale; i++)
+				sumY += rowY[i];
+		}
+
+		int32_t sumV = 0;
+		int32_t sumU = 0;
+		for (size_t r = 0; r < chromaScale; r++) {
+			const uchar* rowC = c + r*stride + col*scale;
+			for (size_t i = 0; i < chromaScale; i++) {
+				sumV += rowC[2 * i];
+				sumU += rowC[2 * i + 1];
+			}
+		}
+
+		convertPixel((sumY + roundY) >> shiftY, (sumV + roundC) >> shiftC, (sumU + roundC) >> shiftC, out);
+	}
+}
+
+/*
+ * Converts a range of output rows.
+ * @param y Pointer to the luma plane.
+ * @param vu Pointer to the chroma plane.
+ * @param width Frame width.
+ * @param stride Distance in bytes between two rows.
+ * @param scale Downscaling factor.
+ * @param startRow First output row.
+ * @param endRow Row after the last output row.
+ * @param out Pointer to the output image.
+ */
+void convertRows(const uchar* y, const uchar* vu, size_t width, size_t stride, size_t scale, size_t startRow, size_t endRow, uchar* out) {
+	size_t outWidth = width / scale;
+
+	for (size_t row = startRow; row < endRow; row++) {
+		const uchar* rowY = y + row*scale*stride;
+		const uchar* rowC = vu + (row*scale >> 1)*stride;
+		uchar* rowOut = out + row*outWidth * 4;
+
+		if (scale == 1)
+			convertRow(rowY, rowC, width, rowOut);
+		else
+			convertRowDownscaled(rowY, rowC, stride, outWidth, scale, rowOut);
+	}
+}
+
+/*
+ * Checks the parameters of a conversion.
+ * @param width Frame width.
+ * @param height Frame height.
+ * @param stride Distance in bytes between two rows.
+ * @param scale Downscaling factor.
+ * @return True if the conversion is supported.
+ */
+bool checkParameters(size_t width, size_t height, size_t stride, size_t scale) {
+	if ((scale != 1) && (scale != 2) && (scale != 4)) {
+		std::cout << "Unsupported downscaling factor: " << scale << std::endl;
+		return false;
+	}
+
+	if ((width % (2 * scale)) || (height % (2 * scale)) || (stride < width)) {
+		std::cout << "Invalid frame size: " << width << "x" << height << " (stride " << stride << ")" << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+bool YUVConverter::convertNV21(const uchar* y, const uchar* vu, size_t width, size_t height, size_t stride, uchar* rgba, size_t scale, size_t nbrThreads) {
+	if (!checkParameters(width, height, stride, scale))
+		return false;
+
+	size_t outHeight = height / scale;
+	size_t nbrJobs = (outHeight + RowsPerJob - 1) / RowsPerJob;
+
+	common::parallelFor(nbrJobs, [&](size_t job) {
+		convertRows(y, vu, width, stride, scale, job*RowsPerJob, std::min((job + 1)*RowsPerJob, outHeight), rgba);
+	}, nbrThreads);
+
+	return true;
+}
+
+bool YUVConverter::convertNV21(const uchar* y, const uchar* vu, size_t width, size_t height, size_t stride, float* rgba, size_t scale, size_t nbrThreads) {
+	if (!checkParameters(width, height, stride, scale))
+		return false;
+
+	size_t outWidth = width / scale;
+	size_t outHeight = height / scale;
+	size_t nbrJobs = (outHeight + RowsPerJob - 1) / RowsPerJob;
+
+	common::parallelFor(nbrJobs, [&](size_t job) {
+		size_t startRow = job*RowsPerJob;
+		size_t endRow = std::min(startRow + RowsPerJob, outHeight);
+
+		// The rows are converted to 8 bits first, then expanded
+		std::vector<uchar> rows((endRow - startRow)*outWidth * 4);
+		convertRows(y + startRow*scale*stride, vu + (startRow*scale >> 1)*stride, width, stride, scale, 0, endRow - startRow, &rows[0]);
+
+		float* out = rgba + startRow*outWidth * 4;
+		for (size_t i = 0; i < rows.size(); i++)
+			out[i] = rows[i] / 255.f;
+	}, nbrThreads);
+
+	return true;
+}
+
+/*
+ * Rounds and clamps an encoded channel to 8 bits.
+ * @param val Channel value.
+ * @return Clamped value.
+ */
+inline uchar clampEncoded(float val) {
+	return (uchar)std::min(std::max(val + 0.5f, 0.f), 255.f);
+}
+
+bool YUVConverter::convertToNV21(const uchar* rgba, size_t width, size_t height, uchar* y, uchar* vu, size_t nbrThreads) {
+	if (!checkParameters(width, height, width, 1))
+		return false;
+
+	// Every job encodes a pair of rows, which share a row of chroma
+	common::parallelFor(height / 2, [&](size_t job) {
+		const uchar* in[2] = { rgba + 2 * job*width * 4, rgba + (2 * job + 1)*width * 4 };
+		uchar* outY[2] = { y + 2 * job*width, y + (2 * job + 1)*width };
+		uchar* outVU = vu + job*width;
+
+		for (size_t col = 0; col < width; col += 2) {
+			float v = 0.f, u = 0.f;
+			for (int r = 0; r < 2; r++) {
+				for (size_t c = col; c < col + 2; c++) {
+					const uchar* px = in[r] + c * 4;
+					outY[r][c] = clampEncoded(EncodeY[0] * px[0] + EncodeY[1] * px[1] + EncodeY[2] * px[2]);
+					v += EncodeV[0] * px[0] + EncodeV[1] * px[1] + EncodeV[2] * px[2];
+					u += EncodeU[0] * px[0] + EncodeU[1] * px[1] + EncodeU[2] * px[2];
+				}
+			}
+
+			*outVU++ = clampEncoded(0.25f*v + 128.f);
+			*outVU++ = clampEncoded(0.25f*u + 128.f);
+		}
+	}, nbrThreads);
+
+	return true;
+}
@@ -0,0 +1,412 @@
+#include <vsense/pc/PlaneDetector.h>
+#include <vsense/pc/PointCloud.h>
+
+#include <vsense/common/Parallel.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iterator>
+#include <numeric>
+#include <random>
+
+using namespace vsense;
+using namespace vsense::pc;
+
+const size_t HypothesesPerRound = 64;   // Hypotheses competing in a preemptive round
+const size_t BlockSize = 100;           // Points scored before each preemption
+const size_t MaxEvalPoints = 4096;      // Points used to score the hypotheses
+const size_t MaxSampleTries = 10;       // Attempts to draw a non-degenerate sample
+const size_t NbrRefinements = 3;        // Least squares iterations of the local optimization
+const float  MinNormalLength = 1e-6f;
+
+/*
+ * Calculates the eigenvector of a symmetric 3x3 matrix with the smallest eigenvalue (Jacobi method).
+ * @param m Symmetric matrix, destroyed during the calculation.
+ * @return Unit eigenvector.
+ */
+glm::vec3 smallestEigenvector(double m[3][3]) {
+	double v[3][3] = { { 1., 0., 0. }, { 0., 1., 0. }, { 0., 0., 1. } };
+
+	for (int sweep = 0; sweep < 16; sweep++) {
+		double offDiag = fabs(m[0][1]) + fabs(m[0][2]) + fabs(m[1][2]);
+		if (offDiag < 1e-15)
+			break;
+
+		for (int p = 0; p < 2; p++) {
+			for (int q = p + 1; q < 3; q++) {
+				if (fabs(m[p][q]) < 1e-20)
+					continue;
+
+				double theta = (m[q][q] - m[p][p]) / (2.*m[p][q]);
+				double t = (theta >= 0. ? 1. : -1.) / (fabs(theta) + sqrt(theta*theta + 1.));
+				double c = 1. / sqrt(t*t + 1.);
+				double s = t*c;
+
+				for (int k = 0; k < 3; k++) {
+					double mkp = m[k][p];
+					double mkq = m[k][q];
+					m[k][p] = c*mkp - s*mkq;
+					m[k][q] = s*mkp + c*mkq;
+				}
+				for (int k = 0; k < 3; k++) {
+					double mpk = m[p][k];
+					double mqk = m[q][k];
+					m[p][k] = c*mpk - s*mqk;
+					m[q][k] = s*mpk + c*mqk;
+				}
+				for (int k = 0; k < 3; k++) {
+					double vkp = v[k][p];
+					double vkq = v[k][q];
+					v[k][p] = c*vkp - s*vkq;
+					v[k][q] = s*vkp + c*vkq;
+				}
+			}
+		}
+	}
+
+	int minIdx = 0;
+	for (int i = 1; i < 3; i++) {
+		if (m[i][i] < m[minIdx][minIdx])
+			minIdx = i;
+	}
+
+	return glm::normalize(glm::vec3((float)v[0][minIdx], (float)v[1][minIdx], (float)v[2][minIdx]));
+}
+
+PlaneDetector::PlaneDetector(float threshold, float timeBudget) : threshold_(threshold), timeBudget_(timeBudget), confidence_(0.99f),
+	maxHypotheses_(2000), maxPlanes_(4), minInliers_(100), nbrThreads_(0), seed_(0), startTime_(0.), lastDetectionTime_(0.f), lastNbrHypotheses_(0) {
+
+}
+
+float PlaneDetector::elapsed() const {
+	double now = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+
+	return (float)(now - startTime_);
+}
+
+size_t PlaneDetector::countInliers(const glm::vec3* points, const std::vector<uint32_t>& indices, const Plane& plane) const {
+	size_t nbrInliers = 0;
+	for (size_t i = 0; i < indices.size(); i++) {
+		if (fabs(plane.signedDistance(points[indices[i]])) <= threshold_)
+			nbrInliers++;
+	}
+
+	return nbrInliers;
+}
+
+bool PlaneDetector::refinePlane(const glm::vec3* points, const std::vector<uint32_t>& indices, Plane& plane) const {
+	for (size_t iter = 0; iter <= NbrRefinements; iter++) {
+		plane.inliers.clear();
+
+		glm::dvec3 sum(0., 0., 0.);
+		double sqSum = 0.;
+		for (size_t i = 0; i < indices.size(); i++) {
+			float dist = plane.signedDistance(points[indices[i]]);
+			if (fabs(dist) <= threshold_) {
+				plane.inliers.push_back(indices[i]);
+				sum += glm::dvec3(points[indices[i]]);
+				sqSum += dist*dist;
+			}
+		}
+
+		size_t nbrInliers = plane.inliers.size();
+		if (nbrInliers < 3)
+			return false;
+
+		plane.centroid = glm::vec3(sum / (double)nbrInliers);
+		plane.rmsError = (float)sqrt(sqSum / nbrInliers);
+
+		if (iter == NbrRefinements)
+			break;
+
+		// Least squares fit, the normal is the direction of least variance
+		double cov[3][3] = { { 0., 0., 0. }, { 0., 0., 0. }, { 0., 0., 0. } };
+		for (size_t i = 0; i < nbrInliers; i++) {
+			glm::dvec3 d = glm::dvec3(points[plane.inliers[i]] - plane.centroid);
+			cov[0][0] += d.x*d.x;
+			cov[0][1] += d.x*d.y;
+			cov[0][2] += d.x*d.z;
+			cov[1][1] += d.y*d.y;
+			cov[1][2] += d.y*d.z;
+			cov[2][2] += d.z*d.z;
+		}
+		cov[1][0] = cov[0][1];
+		cov[2][0] = cov[0][2];
+		cov[2][1] = cov[1][2];
+
+		glm::vec3 normal = smallestEigenvector(cov);
+		if (glm::dot(normal, plane.normal) < 0.f)
+			normal = -normal;
+
+		plane.normal = normal;
+		plane.distance = -glm::dot(normal, plane.centroid);
+	}
+
+	return true;
+}
+
+bool PlaneDetector::findPlane(const glm::vec3* points, const std::vector<uint32_t>& candidates, float deadline, uint32_t seed, Plane& plane) {
+	size_t nbrCandidates = candidates.size();
+	if (nbrCandidates < std::max(minInliers_, (size_t)3))
+		return false;
+
+	// Random subset of the candidates used to score the hypotheses
+	std::mt19937 evalRng(seed);
+	std::vector<uint32_t> evalIdx;
+	if (nbrCandidates <= MaxEvalPoints) {
+		evalIdx = candidates;
+		std::shuffle(evalIdx.begin(), evalIdx.end(), evalRng);
+	} else {
+		std::uniform_int_distribution<size_t> pick(0, nbrCandidates - 1);
+		evalIdx.resize(MaxEvalPoints);
+		for (size_t i = 0; i < MaxEvalPoints; i++)
+			evalIdx[i] = candidates[pick(evalRng)];
+	}
+
+	size_t nbrEval = evalIdx.size();
+	size_t nbrBlocks = (nbrEval + BlockSize - 1) / BlockSize;
+
+	size_t nbrRounds = (maxHypotheses_ + HypothesesPerRound - 1) / HypothesesPerRound;
+	size_t roundsPerBatch = nbrThreads_ ? nbrThreads_ : common::hardwareThreads();
+
+	std::vector<Plane> survivors;
+	std::vector<size_t> survivorScores;
+
+	Plane best;
+	size_t bestScore = 0;
+
+	size_t neededRounds = nbrRounds;
+	size_t round = 0;
+	while (round < neededRounds) {
+		if ((deadline > 0.f) && (elapsed() > deadline))
+			break;
+
+		size_t batchSize = std::min(roundsPerBatch, neededRounds - round);
+		survivors.assign(batchSize, Plane());
+		survivorScores.assign(batchSize, 0);
+
+		// Every round has its own generator, seeded by the round index
+		common::parallelFor(batchSize, [&](size_t job) {
+			std::mt19937 rng(seed + 7919u*(uint32_t)(round + job + 1));
+			std::uniform_int_distribution<size_t> pick(0, nbrCandidates - 1);
+
+			std::vector<Plane> hyps;
+			hyps.reserve(HypothesesPerRound);
+			for (size_t h = 0; h < HypothesesPerRound; h++) {
+				for (size_t tries = 0; tries < MaxSampleTries; tries++) {
+					const glm::vec3& a = points[candidates[pick(rng)]];
+					const glm::vec3& b = points[candidates[pick(rng)]];
+					const glm::vec3& c = points[candidates[pick(rng)]];
+
+					glm::vec3 normal = glm::cross(b - a, c - a);
+					float length = glm::length(normal);
+					if (length > MinNormalLength) {
+						Plane hyp;
+						hyp.normal = normal / length;
+						hyp.distance = -glm::dot(hyp.normal, a);
+						hyps.push_back(hyp);
+						break;
+					}
+				}
+			}
+
+			if (hyps.empty())
+				return;
+
+			// Preemptive scoring, the best half of the hypotheses survives every block
+			std::vector<size_t> scores(hyps.size(), 0);
+			std::vector<size_t> active(hyps.size());
+			std::iota(active.begin(), active.end(), 0);
+
+			for (size_t block = 0; block < nbrBlocks; block++) {
+				size_t start = block*BlockSize;
+				size_t end = std::min(start + BlockSize, nbrEval);
+
+				for (size_t i = 0; i < active.size(); i++) {
+					const Plane& hyp = hyps[active[i]];
+
+					size_t nbrInliers = 0;
+					for (size_t j = start; j < end; j++) {
+						if (fabs(hyp.signedDistance(points[evalIdx[j]])) <= threshold_)
+							nbrInliers++;
+					}
+
+					scores[active[i]] += nbrInliers;
+				}
+
+				if (active.size() > 1) {
+					size_t keep = active.size() / 2;
+					std::nth_element(active.begin(), active.begin() + keep, active.end(), [&](size_t a, size_t b) {
+						return (scores[a] > scores[b]) || ((scores[a] == scores[b]) && (a < b));
+					});
+					active.resize(keep);
+				}
+			}
+
+			// Small subsets can run out of blocks before a single hypothesis remains
+			size_t winner = active[0];
+			for (size_t i = 1; i < active.size(); i++) {
+				if ((scores[active[i]] > scores[winner]) || ((scores[active[i]] == scores[winner]) && (active[i] < winner)))
+					winner = active[i];
+			}
+
+			survivors[job] = hyps[winner];
+			survivorScores[job] = scores[winner];
+		}, nbrThreads_);
+
+		round += batchSize;
+		lastNbrHypotheses_ += batchSize*HypothesesPerRound;
+
+		size_t batchBest = std::max_element(survivorScores.begin(), survivorScores.end()) - survivorScores.begin();
+		if (survivorScores[batchBest] <= bestScore)
+			continue;
+
+		// Local optimization of the new best hypothesis
+		Plane candidate = survivors[batchBest];
+		size_t score = survivorScores[batchBest];
+		if (refinePlane(points, evalIdx, candidate)) {
+			size_t refinedScore = countInliers(points, evalIdx, candidate);
+			if (refinedScore >= score)
+				score = refinedScore;
+			else
+				candidate = survivors[batchBest];
+		}
+
+		best = candidate;
+		bestScore = score;
+
+		// Adaptive termination, enough samples were drawn to find an outlier-free one with the given confidence
+		double inlierRatio = (double)bestScore / nbrEval;
+		double noOutlierProb = inlierRatio*inlierRatio*inlierRatio;
+		if (noOutlierProb >= 1.) {
+			neededRounds = round;
+		} else if (noOutlierProb > 0.) {
+			double nbrSamples = log(1. - confidence_) / log(1. - noOutlierProb);
+			size_t rounds = (size_t)ceil(nbrSamples / HypothesesPerRound);
+			neededRounds = std::min(nbrRounds, std::max(rounds, (size_t)1));
+		}
+	}
+
+	if (!bestScore)
+		return false;
+
+	if (!refinePlane(points, candidates, best))
+		return false;
+
+	if (best.inliers.size() < minInliers_)
+		return false;
+
+	plane = best;
+
+	return true;
+}
+
+size_t PlaneDetector::detect(const glm::vec3* points, size_t nbrPoints, std::vector<Plane>& planes) {
+	startTime_ = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+
+	std::vector<uint32_t> candidates(nbrPoints);
+	std::iota(candidates.begin(), candidates.end(), 0);
+
+	return detectAmong(points, candidates, planes);
+}
+
+size_t PlaneDetector::detect(const PointCloud& pc, std::vector<Plane>& planes) {
+	return detect(pc.getPositionPtr(), pc.size(), planes);
+}
+
+size_t PlaneDetector::detectAmong(const glm::vec3* points, std::vector<uint32_t>& candidates, std::vector<Plane>& planes) {
+	lastNbrHypotheses_ = 0;
+
+	planes.clear();
+
+	float deadline = timeBudget_;
+	while (planes.size() < maxPlanes_) {
+		Plane plane;
+		if (!findPlane(points, candidates, deadline, seed_ + (uint32_t)planes.size(), plane))
+			break;
+
+		// Inliers and candidates are both sorted, the remaining planes are searched among the outliers
+		std::vector<uint32_t> outliers;
+		outliers.reserve(candidates.size() - plane.inliers.size());
+		std::set_difference(candidates.begin(), candidates.end(), plane.inliers.begin(), plane.inliers.end(), std::back_inserter(outliers));
+		candidates.swap(outliers);
+
+		planes.push_back(plane);
+
+		if ((deadline > 0.f) && (elapsed() > deadline))
+			break;
+	}
+
+	std::stable_sort(planes.begin(), planes.end(), [](const Plane& a, const Plane& b) {
+		return a.inliers.size() > b.inliers.size();
+	});
+
+	lastDetectionTime_ = elapsed();
+
+	return planes.size();
+}
+
+bool PlaneDetector::detectAlongRay(const glm::vec3* points, size_t nbrPoints, const glm::vec3& origin, const glm::vec3& direction, float supportRadius, Plane& plane, glm::vec3& intersection) {
+	startTime_ = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+
+	// Only the points close to the ray can support the plane under it, the rest of the cloud isn't sampled
+	float sqRadius = supportRadius*supportRadius;
+	glm::vec3 rayDir = glm::normalize(direction);
+
+	std::vector<uint32_t> candidates;
+	for (size_t i = 0; i < nbrPoints; i++) {
+		glm::vec3 rel = points[i] - origin;
+		float t = glm::dot(rel, rayDir);
+		if (t <= 0.f)
+			continue;
+
+		glm::vec3 perp = rel - rayDir*t;
+		if (glm::dot(perp, perp) <= sqRadius)
+			candidates.push_back((uint32_t)i);
+	}
+
+	std::vector<Plane> planes;
+	if (candidates.size() < minInliers_ || !detectAmong(points, candidates, planes)) {
+		lastDetectionTime_ = elapsed();
+		return false;
+	}
+
+	float closestHit = -1.f;
+	for (size_t i = 0; i < planes.size(); i++) {
+		const Plane& cur = planes[i];
+
+		float cosAngle = glm::dot(cur.normal, direction);
+		if (fabs(cosAngle) < MinNormalLength)
+			continue;
+
+		float t = -cur.signedDistance(origin) / cosAngle;
+		if ((t <= 0.f) || ((closestHit >= 0.f) && (t >= closestHit)))
+			continue;
+
+		// The plane must be supported by points close to the hit, not only by a distant part of it
+		glm::vec3 hit = origin + direction*t;
+		bool supported = false;
+		for (size_t j = 0; j < cur.inliers.size() && !supported; j++) {
+			glm::vec3 diff = points[cur.inliers[j]] - hit;
+			supported = (diff.x*diff.x + diff.y*diff.y + diff.z*diff.z) <= sqRadius;
+		}
+
+		if (!supported)
+			continue;
+
+		closestHit = t;
+		plane = cur;
+		intersection = hit;
+	}
+
+	if (closestHit < 0.f)
+		return false;
+
+	if (plane.signedDistance(origin) < 0.f) {
+		plane.normal = -plane.normal;
+		plane.distance = -plane.distance;
+	}
+
+	return true;
+}
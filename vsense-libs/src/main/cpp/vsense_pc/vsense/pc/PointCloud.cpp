@@ -1,8 +1,10 @@
 #include <vsense/pc/PointCloud.h>
+#include <vsense/pc/PointTransform.h>
 
 #include <vsense/io/Image.h>
 #include <vsense/io/ImageReader.h>
 #include <vsense/io/PointCloudReader.h>
+#include <vsense/io/PointCloudWriter.h>
 
 #include <glm/gtc/quaternion.hpp>
 
@@ -16,16 +18,85 @@ void PointCloud::resize(size_t size) {
 	pos_.resize(size);
 	col_.resize(size);
 	flag_.resize(size);
+	conf_.resize(size);
+}
+
+void PointCloud::reserve(size_t size) {
+	pos_.reserve(size);
+	col_.reserve(size);
+	flag_.reserve(size);
+	conf_.reserve(size);
 }
 
 void PointCloud::addPoint(const Point& pt) {
 	pos_.push_back(pt.pos);
 	col_.push_back(glm::vec4(pt.color, 1.f));
 	flag_.push_back(pt.flags);	
+	conf_.push_back(pt.confidence);
+}
+
+void PointCloud::addPoints(const Point* pts, size_t nbrPts) {
+	size_t newSize = pos_.size() + nbrPts;
+	if (newSize > pos_.capacity()) // Grows geometrically so repeated bulk insertions stay amortized
+		reserve(std::max(newSize, pos_.capacity() * 2));
+
+	for (size_t i = 0; i < nbrPts; i++) {
+		pos_.push_back(pts[i].pos);
+		col_.push_back(glm::vec4(pts[i].color, 1.f));
+		flag_.push_back(pts[i].flags);
+		conf_.push_back(pts[i].confidence);
+	}
+}
+
+void PointCloud::addPoints(const PointCloud& pc) {
+	bool wasEmpty = pos_.empty();
+
+	size_t newSize = pos_.size() + pc.size();
+	if (newSize > pos_.capacity())
+		reserve(std::max(newSize, pos_.capacity() * 2));
+
+	pos_.insert(pos_.end(), pc.pos_.begin(), pc.pos_.end());
+	col_.insert(col_.end(), pc.col_.begin(), pc.col_.end());
+	flag_.insert(flag_.end(), pc.flag_.begin(), pc.flag_.end());
+	conf_.insert(conf_.end(), pc.conf_.begin(), pc.conf_.end());
+
+	// The bounding box stays valid only if both were valid
+	if (wasEmpty)
+		bb_ = pc.bb_;
+	else if (bb_.valid && pc.bb_.valid)
+		bb_.adoptBoundaries(pc.bb_);
+	else
+		bb_.valid = false;
+}
+
+void PointCloud::addPoints(const glm::vec3* pos, const glm::vec4* col, const uchar* flags, const float* conf, size_t nbrPts) {
+	size_t oldSize = pos_.size();
+	size_t newSize = oldSize + nbrPts;
+	if (newSize > pos_.capacity())
+		reserve(std::max(newSize, pos_.capacity() * 2));
+
+	pos_.insert(pos_.end(), pos, pos + nbrPts);
+
+	if (col)
+		col_.insert(col_.end(), col, col + nbrPts);
+	else
+		col_.resize(newSize, glm::vec4(1.f, 1.f, 1.f, 1.f));
+
+	if (flags)
+		flag_.insert(flag_.end(), flags, flags + nbrPts);
+	else
+		flag_.resize(newSize, UnknownPoint);
+
+	if (conf)
+		conf_.insert(conf_.end(), conf, conf + nbrPts);
+	else
+		conf_.resize(newSize, 1.f);
+
+	bb_.valid = false;
 }
 
 Point PointCloud::at(size_t idx) const {
-	Point pt(pos_[idx], col_[idx], flag_[idx]);
+	Point pt(pos_[idx], col_[idx], flag_[idx], conf_[idx]);
 	return pt;
 }
 
@@ -95,62 +166,38 @@ void PointCloud::loadFromFile(const std::string &pcFilename, const std::string &
 
 	recalculateBoundingBox();
 }
+#endif
 
-void PointCloud::transformPointCloud(const glm::mat4& pose, PointCloud& pcOut) {
-	pcOut.resize(this->size());
-
-	for (size_t i = 0; i < pcOut.size(); i++) {
-		const Point* ptIn = &this->at(i);
-		Point* ptOut = &pcOut.at(i);
-
-		glm::vec3 pt(ptIn->pos.x, ptIn->pos.y, ptIn->pos.z);		
-		ptOut->pos.x = static_cast<float> (pose[0][0] * pt[0] + pose[1][0] * pt[1] + pose[2][0] * pt[2] + pose[3][0]);
-		ptOut->pos.y = static_cast<float> (pose[0][1] * pt[0] + pose[1][1] * pt[1] + pose[2][1] * pt[2] + pose[3][1]);
-		ptOut->pos.z = static_cast<float> (pose[0][2] * pt[0] + pose[1][2] * pt[1] + pose[2][2] * pt[2] + pose[3][2]);
-
-		ptOut->color.r = ptIn->color.r;
-		ptOut->color.g = ptIn->color.g;
-		ptOut->color.b = ptIn->color.b;
-	}
-	
-	pcOut.recalculateBoundingBox();	
+void PointCloud::saveToXYZFile(const std::string& filename) {
+	if (io::PointCloudWriter::writeXYZ(filename, *this))
+		std::cout << "Point cloud saved!" << std::endl;
 }
 
-void PointCloud::recalculateBoundingBox() {
-	for (size_t i = 0; i < pos_.size(); i++) {
-		Point* pt = &this->at(i);
+void PointCloud::transformPointCloud(const glm::mat4& pose, PointCloud& pcOut) {
+	pcOut.resize(this->size());
 
-		bb_.min.x = std::min(bb_.min.x, pt->pos.x);
-		bb_.min.y = std::min(bb_.min.y, pt->pos.y);
-		bb_.min.z = std::min(bb_.min.z, pt->pos.z);
+	pcOut.col_ = col_;
+	pcOut.flag_ = flag_;
+	pcOut.conf_ = conf_;
 
-		bb_.max.x = std::max(bb_.max.x, pt->pos.x);
-		bb_.max.y = std::max(bb_.max.y, pt->pos.y);
-		bb_.max.z = std::max(bb_.max.z, pt->pos.z);		
+	if (pos_.empty()) {
+		pcOut.bb_ = BoundingBox();
+		return;
 	}
 
-	bb_.valid = true;
+	PointTransform::transformParallel(pose, &pos_[0], &pcOut.pos_[0], pos_.size(), &pcOut.bb_);
 }
 
-void PointCloud::saveToXYZFile(const std::string& filename) {
-	std::ofstream xyzFile;
-	xyzFile.open(filename, std::ios::out);
+void PointCloud::transform(const glm::mat4& pose) {
+	if (pos_.empty())
+		return;
 
-	glm::vec3* curPos = &pos_[0];
-	glm::vec4* curCol = &col_[0];
-	for (size_t i = 0; i < pos_.size(); i++) {
-		xyzFile << curPos->x << " " << curPos->y << " " << curPos->z << " ";
-		xyzFile << (int)(curCol->r*255) << " " << (int)(curCol->g*255) << " " << (int)(curCol->b*255) << std::endl;
-
-		curPos++;
-		curCol++;
-	}
-	
-	xyzFile.close();
+	PointTransform::transformParallel(pose, &pos_[0], &pos_[0], pos_.size(), &bb_);
+}
 
-	std::cout << "Point cloud saved!" << std::endl;
+void PointCloud::recalculateBoundingBox() {
+	PointTransform::bound(getPositionPtr(), pos_.size(), bb_);
 }
-#endif
 
 const glm::vec3* PointCloud::getPositionPtr() const {
 	if (!pos_.size())
@@ -164,4 +211,18 @@ const glm::vec4* PointCloud::getColorsPtr() const {
 		return nullptr;
 
 	return &col_[0];
+}
+
+const uchar* PointCloud::getFlagsPtr() const {
+	if (!pos_.size())
+		return nullptr;
+
+	return &flag_[0];
+}
+
+const float* PointCloud::getConfidencePtr() const {
+	if (!pos_.size())
+		return nullptr;
+
+	return &conf_[0];
 }
\ No newline at end of file
@@ -0,0 +1,217 @@
+#include <vsense/pc/PointTransform.h>
+#include <vsense/pc/PointCloud.h>
+
+#include <vsense/common/Parallel.h>
+
+#include <algorithm>
+#include <cfloat>
+#include <vector>
+
+#if defined(__aarch64__) && (defined(__ARM_NEON) || defined(__ARM_NEON__))
+#include <arm_neon.h>
+#define USE_NEON
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#include <emmintrin.h>
+#define USE_SSE
+#endif
+
+using namespace vsense;
+using namespace vsense::pc;
+
+static_assert(sizeof(glm::vec3) == 3 * sizeof(float), "Positions must be tightly packed");
+
+const size_t PointsPerJob = 65536; // Multiple of the SIMD width
+
+/*
+ * Transforms (optionally) a set of positions and finds their limits.
+ * @param pose Transformation to apply.
+ * @param in Pointer to the input positions.
+ * @param out Pointer to the output positions, not used if Transform is false.
+ * @param nbrPts Number of positions.
+ * @param minPos Minimum coordinates found.
+ * @param maxPos Maximum coordinates found.
+ */
+template<bool Transform>
+void processPositions(const glm::mat4& pose, const glm::vec3* in, glm::vec3* out, size_t nbrPts, glm::vec3& minPos, glm::vec3& maxPos) {
+	minPos = glm::vec3(FLT_MAX, FLT_MAX, FLT_MAX);
+	maxPos = glm::vec3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+
+	const float* src = &in[0].x;
+	float* dst = Transform ? &out[0].x : nullptr;
+
+	size_t nbrBlocks = nbrPts / 4;
+	size_t i = 0;
+
+#ifdef USE_SSE
+	__m128 m00 = _mm_set1_ps(pose[0][0]), m01 = _mm_set1_ps(pose[0][1]), m02 = _mm_set1_ps(pose[0][2]);
+	__m128 m10 = _mm_set1_ps(pose[1][0]), m11 = _mm_set1_ps(pose[1][1]), m12 = _mm_set1_ps(pose[1][2]);
+	__m128 m20 = _mm_set1_ps(pose[2][0]), m21 = _mm_set1_ps(pose[2][1]), m22 = _mm_set1_ps(pose[2][2]);
+	__m128 m30 = _mm_set1_ps(pose[3][0]), m31 = _mm_set1_ps(pose[3][1]), m32 = _mm_set1_ps(pose[3][2]);
+
+	__m128 minX = _mm_set1_ps(FLT_MAX), minY = minX, minZ = minX;
+	__m128 maxX = _mm_set1_ps(-FLT_MAX), maxY = maxX, maxZ = maxX;
+
+	for (size_t b = 0; b < nbrBlocks; b++, src += 12) {
+		// Four packed positions: (x0 y0 z0 x1) (y1 z1 x2 y2) (z2 x3 y3 z3)
+		__m128 v0 = _mm_loadu_ps(src);
+		__m128 v1 = _mm_loadu_ps(src + 4);
+		__m128 v2 = _mm_loadu_ps(src + 8);
+
+		__m128 x = _mm_shuffle_ps(v0, _mm_shuffle_ps(v1, v2, _MM_SHUFFLE(1, 0, 0, 2)), _MM_SHUFFLE(3, 0, 3, 0));
+		__m128 y = _mm_shuffle_ps(_mm_shuffle_ps(v0, v1, _MM_SHUFFLE(0, 0, 1, 1)), _mm_shuffle_ps(v1, v2, _MM_SHUFFLE(2, 2, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0));
+		__m128 z = _mm_shuffle_ps(_mm_shuffle_ps(v0, v1, _MM_SHUFFLE(1, 1, 2, 2)), v2, _MM_SHUFFLE(3, 0, 2, 0));
+
+		if (Transform) {
+			__m128 tx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m00, x), _mm_mul_ps(m10, y)), _mm_add_ps(_mm_mul_ps(m20, z), m30));
+			__m128 ty = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m01, x), _mm_mul_ps(m11, y)), _mm_add_ps(_mm_mul_ps(m21, z), m31));
+			__m128 tz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m02, x), _mm_mul_ps(m12, y)), _mm_add_ps(_mm_mul_ps(m22, z), m32));
+			x = tx;
+			y = ty;
+			z = tz;
+
+			__m128 xyLo = _mm_unpacklo_ps(x, y);
+			__m128 xyHi = _mm_unpackhi_ps(x, y);
+			_mm_storeu_ps(dst, _mm_shuffle_ps(xyLo, _mm_shuffle_ps(z, x, _MM_SHUFFLE(1, 1, 0, 0)), _MM_SHUFFLE(2, 0, 1, 0)));
+			_mm_storeu_ps(dst + 4, _mm_shuffle_ps(_mm_shuffle_ps(y, z, _MM_SHUFFLE(2, 1, 2, 1)), xyHi, _MM_SHUFFLE(1, 0, 2, 0)));
+			_mm_storeu_ps(dst + 8, _mm_shuffle_ps(_mm_shuffle_ps(z, x, _MM_SHUFFLE(3, 3, 2, 2)), _mm_shuffle_ps(y, z, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0)));
+			dst += 12;
+		}
+
+		minX = _mm_min_ps(minX, x);
+		minY = _mm_min_ps(minY, y);
+		minZ = _mm_min_ps(minZ, z);
+		maxX = _mm_max_ps(maxX, x);
+		maxY = _mm_max_ps(maxY, y);
+		maxZ = _mm_max_ps(maxZ, z);
+	}
+
+	float lanes[6][4];
+	_mm_storeu_ps(lanes[0], minX);
+	_mm_storeu_ps(lanes[1], minY);
+	_mm_storeu_ps(lanes[2], minZ);
+	_mm_storeu_ps(lanes[3], maxX);
+	_mm_storeu_ps(lanes[4], maxY);
+	_mm_storeu_ps(lanes[5], maxZ);
+
+	for (int l = 0; l < 4; l++) {
+		minPos = glm::min(minPos, glm::vec3(lanes[0][l], lanes[1][l], lanes[2][l]));
+		maxPos = glm::max(maxPos, glm::vec3(lanes[3][l], lanes[4][l], lanes[5][l]));
+	}
+
+	i = nbrBlocks * 4;
+#elif defined(USE_NEON)
+	float32x4_t minX = vdupq_n_f32(FLT_MAX), minY = minX, minZ = minX;
+	float32x4_t maxX = vdupq_n_f32(-FLT_MAX), maxY = maxX, maxZ = maxX;
+
+	for (size_t b = 0; b < nbrBlocks; b++, src += 12) {
+		float32x4x3_t v = vld3q_f32(src); // Deinterleaves four positions
+
+		if (Transform) {
+			float32x4x3_t t;
+			for (int r = 0; r < 3; r++) {
+				float32x4_t acc = vdupq_n_f32(pose[3][r]);
+				acc = vmlaq_n_f32(acc, v.val[0], pose[0][r]);
+				acc = vmlaq_n_f32(acc, v.val[1], pose[1][r]);
+				t.val[r] = vmlaq_n_f32(acc, v.val[2], pose[2][r]);
+			}
+			v = t;
+
+			vst3q_f32(dst, v);
+			dst += 12;
+		}
+
+		minX = vminq_f32(minX, v.val[0]);
+		minY = vminq_f32(minY, v.val[1]);
+		minZ = vminq_f32(minZ, v.val[2]);
+		maxX = vmaxq_f32(maxX, v.val[0]);
+		maxY = vmaxq_f32(maxY, v.val[1]);
+		maxZ = vmaxq_f32(maxZ, v.val[2]);
+	}
+
+	if (nbrBlocks) {
+		minPos = glm::vec3(vminvq_f32(minX), vminvq_f32(minY), vminvq_f32(minZ));
+		maxPos = glm::vec3(vmaxvq_f32(maxX), vmaxvq_f32(maxY), vmaxvq_f32(maxZ));
+	}
+
+	i = nbrBlocks * 4;
+#endif
+
+	for (; i < nbrPts; i++) {
+		glm::vec3 pt = in[i];
+
+		if (Transform) {
+			pt = glm::vec3(pose[0][0] * in[i].x + pose[1][0] * in[i].y + pose[2][0] * in[i].z + pose[3][0],
+			               pose[0][1] * in[i].x + pose[1][1] * in[i].y + pose[2][1] * in[i].z + pose[3][1],
+			               pose[0][2] * in[i].x + pose[1][2] * in[i].y + pose[2][2] * in[i].z + pose[3][2]);
+			out[i] = pt;
+		}
+
+		minPos = glm::min(minPos, pt);
+		maxPos = glm::max(maxPos, pt);
+	}
+}
+
+/*
+ * Updates a bounding box with the limits found.
+ * @param bb Bounding box to update.
+ * @param minPos Minimum coordinates.
+ * @param maxPos Maximum coordinates.
+ * @param nbrPts Number of positions used to find the limits.
+ */
+inline void setBoundingBox(BoundingBox& bb, const glm::vec3& minPos, const glm::vec3& maxPos, size_t nbrPts) {
+	bb = BoundingBox();
+
+	if (!nbrPts)
+		return;
+
+	bb.min = minPos;
+	bb.max = maxPos;
+	bb.valid = true;
+}
+
+void PointTransform::transform(const glm::mat4& pose, const glm::vec3* in, glm::vec3* out, size_t nbrPts, BoundingBox* bb) {
+	glm::vec3 minPos, maxPos;
+	if (nbrPts)
+		processPositions<true>(pose, in, out, nbrPts, minPos, maxPos);
+
+	if (bb)
+		setBoundingBox(*bb, minPos, maxPos, nbrPts);
+}
+
+void PointTransform::transformParallel(const glm::mat4& pose, const glm::vec3* in, glm::vec3* out, size_t nbrPts, BoundingBox* bb, size_t nbrThreads) {
+	if (nbrPts < ParallelThreshold) {
+		transform(pose, in, out, nbrPts, bb);
+		return;
+	}
+
+	size_t nbrJobs = (nbrPts + PointsPerJob - 1) / PointsPerJob;
+	std::vector<glm::vec3> jobMin(nbrJobs);
+	std::vector<glm::vec3> jobMax(nbrJobs);
+
+	common::parallelFor(nbrJobs, [&](size_t job) {
+		size_t start = job*PointsPerJob;
+		size_t count = std::min(PointsPerJob, nbrPts - start);
+
+		processPositions<true>(pose, in + start, out + start, count, jobMin[job], jobMax[job]);
+	}, nbrThreads);
+
+	if (!bb)
+		return;
+
+	glm::vec3 minPos = jobMin[0];
+	glm::vec3 maxPos = jobMax[0];
+	for (size_t job = 1; job < nbrJobs; job++) {
+		minPos = glm::min(minPos, jobMin[job]);
+		maxPos = glm::max(maxPos, jobMax[job]);
+	}
+
+	setBoundingBox(*bb, minPos, maxPos, nbrPts);
+}
+
+void PointTransform::bound(const glm::vec3* in, size_t nbrPts, BoundingBox& bb) {
+	glm::vec3 minPos, maxPos;
+	if (nbrPts)
+		processPositions<false>(glm::mat4(1.f), in, nullptr, nbrPts, minPos, maxPos);
+
+	setBoundingBox(bb, minPos, maxPos, nbrPts);
+}
@@ -0,0 +1,232 @@
+#include <vsense/pc/SpatialHash.h>
+#include <vsense/pc/PointCloud.h>
+#include <vsense/pc/VoxelGrid.h>
+
+#include <algorithm>
+#include <iostream>
+#include <utility>
+
+using namespace vsense;
+using namespace vsense::pc;
+
+const uint32_t EmptySlot = 0xFFFFFFFF;
+
+/*
+ * Mixes the bits of a cell key.
+ * @param key Key to hash.
+ * @return Hashed key.
+ */
+inline uint64_t hashKey(uint64_t key) {
+	key ^= key >> 33;
+	key *= 0xff51afd7ed558ccdULL;
+	key ^= key >> 33;
+
+	return key;
+}
+
+SpatialHash::SpatialHash(float cellSize) : cellSize_(cellSize), origin_(0.f, 0.f, 0.f), maxCell_(-1, -1, -1), tableMask_(0) {
+
+}
+
+bool SpatialHash::build(const PointCloud& pc) {
+	cellKeys_.clear();
+	cellStart_.clear();
+	table_.clear();
+	pos_.clear();
+	idx_.clear();
+	maxCell_ = glm::ivec3(-1, -1, -1);
+
+	size_t nbrPts = pc.size();
+	if (!nbrPts)
+		return true;
+
+	if (cellSize_ <= 0.f) {
+		std::cout << "Invalid cell size: " << cellSize_ << std::endl;
+		return false;
+	}
+
+	const glm::vec3* pos = pc.getPositionPtr();
+
+	glm::vec3 minPos = pos[0];
+	glm::vec3 maxPos = pos[0];
+	for (size_t i = 1; i < nbrPts; i++) {
+		minPos = glm::min(minPos, pos[i]);
+		maxPos = glm::max(maxPos, pos[i]);
+	}
+
+	glm::vec3 range = (maxPos - minPos) / cellSize_;
+	if ((range.x >= VoxelGrid::MaxCoord) || (range.y >= VoxelGrid::MaxCoord) || (range.z >= VoxelGrid::MaxCoord)) {
+		std::cout << "Cell size too small for the point cloud extent" << std::endl;
+		return false;
+	}
+
+	origin_ = minPos;
+	maxCell_ = glm::ivec3(range);
+
+	// Points are sorted by cell, so every cell is a contiguous range
+	std::vector<std::pair<uint64_t, uint32_t> > keys(nbrPts);
+	float invSize = 1.f / cellSize_;
+	for (size_t i = 0; i < nbrPts; i++) {
+		glm::vec3 cell = (pos[i] - origin_)*invSize;
+		keys[i] = std::make_pair(VoxelGrid::cellKey((uint32_t)cell.x, (uint32_t)cell.y, (uint32_t)cell.z), (uint32_t)i);
+	}
+
+	std::sort(keys.begin(), keys.end());
+
+	pos_.resize(nbrPts);
+	idx_.resize(nbrPts);
+	for (size_t i = 0; i < nbrPts; i++) {
+		idx_[i] = keys[i].second;
+		pos_[i] = pos[keys[i].second];
+
+		if (!i || (keys[i].first != keys[i - 1].first)) {
+			cellKeys_.push_back(keys[i].first);
+			cellStart_.push_back((uint32_t)i);
+		}
+	}
+	cellStart_.push_back((uint32_t)nbrPts);
+
+	// Hash table with a load factor below 0.5
+	size_t tableSize = 1;
+	while (tableSize < cellKeys_.size() * 2)
+		tableSize <<= 1;
+
+	table_.assign(tableSize, EmptySlot);
+	tableMask_ = tableSize - 1;
+
+	for (size_t i = 0; i < cellKeys_.size(); i++) {
+		uint64_t slot = hashKey(cellKeys_[i]) & tableMask_;
+		while (table_[slot] != EmptySlot)
+			slot = (slot + 1) & tableMask_;
+
+		table_[slot] = (uint32_t)i;
+	}
+
+	return true;
+}
+
+int64_t SpatialHash::findCell(const glm::ivec3& cell) const {
+	if ((cell.x < 0) || (cell.y < 0) || (cell.z < 0))
+		return -1;
+	if ((cell.x > maxCell_.x) || (cell.y > maxCell_.y) || (cell.z > maxCell_.z))
+		return -1;
+
+	uint64_t key = VoxelGrid::cellKey(cell.x, cell.y, cell.z);
+	uint64_t slot = hashKey(key) & tableMask_;
+	while (table_[slot] != EmptySlot) {
+		if (cellKeys_[table_[slot]] == key)
+			return table_[slot];
+
+		slot = (slot + 1) & tableMask_;
+	}
+
+	return -1;
+}
+
+size_t SpatialHash::radiusSearch(const glm::vec3& pt, float radius, std::vector<size_t>& indices, std::vector<float>& sqDistances) const {
+	indices.clear();
+	sqDistances.clear();
+
+	if (pos_.empty())
+		return 0;
+
+	glm::ivec3 minCell = glm::ivec3(glm::floor((pt - radius - origin_) / cellSize_));
+	glm::ivec3 maxCell = glm::ivec3(glm::floor((pt + radius - origin_) / cellSize_));
+
+	minCell = glm::max(minCell, glm::ivec3(0, 0, 0));
+	maxCell = glm::min(maxCell, maxCell_);
+
+	float sqRadius = radius*radius;
+	for (int z = minCell.z; z <= maxCell.z; z++) {
+		for (int y = minCell.y; y <= maxCell.y; y++) {
+			for (int x = minCell.x; x <= maxCell.x; x++) {
+				int64_t cellIdx = findCell(glm::ivec3(x, y, z));
+				if (cellIdx < 0)
+					continue;
+
+				for (uint32_t i = cellStart_[cellIdx]; i < cellStart_[cellIdx + 1]; i++) {
+					glm::vec3 diff = pos_[i] - pt;
+					float sqDist = diff.x*diff.x + diff.y*diff.y + diff.z*diff.z;
+
+					if (sqDist <= sqRadius) {
+						indices.push_back(idx_[i]);
+						sqDistances.push_back(sqDist);
+					}
+				}
+			}
+		}
+	}
+
+	return indices.size();
+}
+
+void SpatialHash::collectNearest(size_t cellIdx, const glm::vec3& pt, size_t k, std::vector<std::pair<float, uint32_t> >& heap) const {
+	for (uint32_t i = cellStart_[cellIdx]; i < cellStart_[cellIdx + 1]; i++) {
+		glm::vec3 diff = pos_[i] - pt;
+		float sqDist = diff.x*diff.x + diff.y*diff.y + diff.z*diff.z;
+
+		if (heap.size() < k) {
+			heap.push_back(std::make_pair(sqDist, i));
+			std::push_heap(heap.begin(), heap.end());
+		} else if (sqDist < heap.front().first) {
+			std::pop_heap(heap.begin(), heap.end());
+			heap.back() = std::make_pair(sqDist, i);
+			std::push_heap(heap.begin(), heap.end());
+		}
+	}
+}
+
+size_t SpatialHash::knnSearch(const glm::vec3& pt, size_t k, std::vector<size_t>& indices, std::vector<float>& sqDistances) const {
+	indices.clear();
+	sqDistances.clear();
+
+	if (pos_.empty() || !k)
+		return 0;
+
+	std::vector<std::pair<float, uint32_t> > heap;
+	heap.reserve(k);
+
+	glm::ivec3 center = glm::ivec3(glm::floor((pt - origin_) / cellSize_));
+
+	// Largest ring needed to cover the whole grid from the query cell
+	glm::ivec3 farCorner = glm::max(glm::abs(center), glm::abs(maxCell_ - center));
+	int maxRing = std::max(farCorner.x, std::max(farCorner.y, farCorner.z));
+
+	// Distance from the query to the closest face of its cell, every point outside ring r is at least this far plus r cells
+	glm::vec3 local = (pt - origin_) / cellSize_ - glm::vec3(center);
+	float minFace = std::min(std::min(std::min(local.x, 1.f - local.x), std::min(local.y, 1.f - local.y)), std::min(local.z, 1.f - local.z));
+	minFace = std::max(minFace, 0.f);
+
+	for (int ring = 0; ring <= maxRing; ring++) {
+		for (int z = -ring; z <= ring; z++) {
+			for (int y = -ring; y <= ring; y++) {
+				bool onShell = (std::abs(z) == ring) || (std::abs(y) == ring);
+
+				// Inner rows only need the two cells on the shell
+				int step = onShell ? 1 : 2*ring;
+				for (int x = -ring; x <= ring; x += std::max(step, 1)) {
+					int64_t cellIdx = findCell(center + glm::ivec3(x, y, z));
+					if (cellIdx >= 0)
+						collectNearest((size_t)cellIdx, pt, k, heap);
+				}
+			}
+		}
+
+		if (heap.size() == k) {
+			float bound = (ring + minFace)*cellSize_;
+			if (heap.front().first <= bound*bound)
+				break;
+		}
+	}
+
+	std::sort_heap(heap.begin(), heap.end());
+
+	indices.resize(heap.size());
+	sqDistances.resize(heap.size());
+	for (size_t i = 0; i < heap.size(); i++) {
+		indices[i] = idx_[heap[i].second];
+		sqDistances[i] = heap[i].first;
+	}
+
+	return indices.size();
+}
@@ -0,0 +1,104 @@
+#include <vsense/pc/VoxelGrid.h>
+#include <vsense/pc/PointCloud.h>
+
+#include <vsense/common/Parallel.h>
+
+#include <algorithm>
+#include <iostream>
+#include <utility>
+#include <vector>
+
+using namespace vsense;
+using namespace vsense::pc;
+
+const size_t PointsPerJob = 65536;
+
+bool VoxelGrid::downsample(const PointCloud& pcIn, PointCloud& pcOut, float voxelSize) {
+	pcOut.clear();
+
+	size_t nbrPts = pcIn.size();
+	if (!nbrPts)
+		return true;
+
+	if (voxelSize <= 0.f) {
+		std::cout << "Invalid voxel size: " << voxelSize << std::endl;
+		return false;
+	}
+
+	const glm::vec3* pos = pcIn.getPositionPtr();
+	const glm::vec4* col = pcIn.getColorsPtr();
+	const uchar* flags = pcIn.getFlagsPtr();
+	const float* conf = pcIn.getConfidencePtr();
+
+	glm::vec3 minPos = pos[0];
+	glm::vec3 maxPos = pos[0];
+	for (size_t i = 1; i < nbrPts; i++) {
+		minPos = glm::min(minPos, pos[i]);
+		maxPos = glm::max(maxPos, pos[i]);
+	}
+
+	glm::vec3 range = (maxPos - minPos) / voxelSize;
+	if ((range.x >= MaxCoord) || (range.y >= MaxCoord) || (range.z >= MaxCoord)) {
+		std::cout << "Voxel size too small for the point cloud extent" << std::endl;
+		return false;
+	}
+
+	// Points are sorted by voxel so each voxel is a contiguous run
+	std::vector<std::pair<uint64_t, uint32_t> > keys(nbrPts);
+	float invSize = 1.f / voxelSize;
+	common::parallelFor((nbrPts + PointsPerJob - 1) / PointsPerJob, [&](size_t job) {
+		size_t end = std::min(nbrPts, (job + 1)*PointsPerJob);
+		for (size_t i = job*PointsPerJob; i < end; i++) {
+			glm::vec3 cell = (pos[i] - minPos)*invSize;
+			keys[i] = std::make_pair(cellKey((uint32_t)cell.x, (uint32_t)cell.y, (uint32_t)cell.z), (uint32_t)i);
+		}
+	});
+
+	std::sort(keys.begin(), keys.end());
+
+	std::vector<Point> voxels;
+	voxels.reserve(nbrPts / 4);
+
+	size_t start = 0;
+	while (start < nbrPts) {
+		size_t end = start + 1;
+		while ((end < nbrPts) && (keys[end].first == keys[start].first))
+			end++;
+
+		glm::vec3 sumPos(0.f, 0.f, 0.f);
+		glm::vec3 sumCol(0.f, 0.f, 0.f);
+		float sumConf = 0.f;
+		float maxConf = -1.f;
+		uchar voxelFlags = UnknownPoint;
+
+		for (size_t i = start; i < end; i++) {
+			uint32_t idx = keys[i].second;
+
+			sumPos += pos[idx];
+			sumCol += glm::vec3(col[idx])*conf[idx];
+			sumConf += conf[idx];
+
+			if (conf[idx] > maxConf) {
+				maxConf = conf[idx];
+				voxelFlags = flags[idx];
+			}
+		}
+
+		float nbrVoxelPts = (float)(end - start);
+
+		Point pt;
+		pt.pos = sumPos / nbrVoxelPts;
+		pt.color = sumConf > 0.f ? sumCol / sumConf : glm::vec3(col[keys[start].second]);
+		pt.confidence = sumConf / nbrVoxelPts;
+		pt.flags = voxelFlags;
+
+		voxels.push_back(pt);
+
+		start = end;
+	}
+
+	pcOut.addPoints(voxels.data(), voxels.size());
+	pcOut.setPosition(pcIn.getPosition());
+
+	return true;
+}
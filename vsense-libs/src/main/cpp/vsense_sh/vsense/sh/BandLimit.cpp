@@ -0,0 +1,142 @@
+#include <vsense/sh/BandLimit.h>
+
+#include <algorithm>
+#include <cmath>
+
+using namespace vsense;
+using namespace vsense::sh;
+
+const float Pi = 3.14159265358979323846f;
+
+/*
+ * Calculates the error figures from the accumulated squared errors.
+ * @param order SH order.
+ * @param sumSqError Weighted sum of the squared errors.
+ * @param sumSqReference Weighted sum of the squared reference values.
+ * @param sumWeights Sum of the weights.
+ * @return Error of the order.
+ */
+OrderError toOrderError(int order, double sumSqError, double sumSqReference, double sumWeights) {
+	OrderError error;
+	error.order = order;
+	if (sumWeights <= 0.0)
+		return error;
+
+	error.rmse = (float)std::sqrt(sumSqError / sumWeights);
+	if (sumSqReference > 0.0)
+		error.relativeError = (float)std::sqrt(sumSqError / sumSqReference);
+
+	return error;
+}
+
+int BandLimit::getOrder(int nbrCoeffs) {
+	if (nbrCoeffs <= 0)
+		return -1;
+
+	int order = (int)std::sqrt((float)nbrCoeffs) - 1;
+	while (getNbrCoefficients(order + 1) <= nbrCoeffs)
+		order++;
+	while ((order >= 0) && (getNbrCoefficients(order) > nbrCoeffs))
+		order--;
+
+	return order;
+}
+
+int BandLimit::clampOrder(int order) {
+	return std::min(std::max(order, MinSHOrder), MaxSHOrder);
+}
+
+glm::vec3 BandLimit::evalDiffuse(int order, const float* transfer, const glm::vec3* ambient) {
+	glm::vec3 diffuse(0.f);
+
+	int nbrCoeffs = getNbrCoefficients(order);
+	for (int i = 0; i < nbrCoeffs; i++)
+		diffuse += transfer[i] * ambient[i];
+
+	return diffuse;
+}
+
+void BandLimit::computeDiffuseErrors(const float* transfer, size_t nbrVertices, int vertexCoeffs, const glm::vec3* ambient, int ambientCoeffs,
+	std::vector<OrderError>& errors) {
+	errors.clear();
+
+	int maxOrder = std::min(getOrder(std::min(vertexCoeffs, ambientCoeffs)), MaxSHOrder);
+	if (maxOrder < MinSHOrder)
+		return;
+
+	std::vector<double> sumSqError(maxOrder + 1, 0.0);
+	double sumSqReference = 0.0;
+
+	std::vector<glm::vec3> partial(maxOrder + 1);
+	for (size_t v = 0; v < nbrVertices; v++) {
+		const float* curTransfer = transfer + v*vertexCoeffs;
+
+		// Band by band, so every order reuses the sum of the previous ones
+		glm::vec3 sum(0.f);
+		for (int l = 0; l <= maxOrder; l++) {
+			for (int i = l*l; i < getNbrCoefficients(l); i++)
+				sum += curTransfer[i] * ambient[i];
+			partial[l] = sum;
+		}
+
+		const glm::vec3& reference = partial[maxOrder];
+		sumSqReference += glm::dot(reference, reference);
+		for (int l = MinSHOrder; l <= maxOrder; l++) {
+			glm::vec3 diff = partial[l] - reference;
+			sumSqError[l] += glm::dot(diff, diff);
+		}
+	}
+
+	for (int l = MinSHOrder; l <= maxOrder; l++)
+		errors.push_back(toOrderError(l, sumSqError[l], sumSqReference, (double)nbrVertices));
+}
+
+void BandLimit::computeEnvironmentErrors(const SHCoefficients3& coeffs, int gridWidth, std::vector<OrderError>& errors) {
+	errors.clear();
+
+	int maxOrder = std::min(getOrder((int)coeffs.size()), MaxSHOrder);
+	if ((maxOrder < MinSHOrder) || (gridWidth < 2))
+		return;
+
+	int gridHeight = gridWidth / 2;
+
+	std::vector<double> sumSqError(maxOrder + 1, 0.0);
+	double sumSqReference = 0.0;
+	double sumWeights = 0.0;
+
+	std::vector<glm::vec3> values(maxOrder + 1);
+	for (int row = 0; row < gridHeight; row++) {
+		float theta = Pi*(row + 0.5f) / gridHeight;
+		float weight = std::sin(theta); // Solid angle of the row
+
+		for (int col = 0; col < gridWidth; col++) {
+			float phi = 2.f*Pi*(col + 0.5f) / gridWidth;
+
+			for (int l = MinSHOrder; l <= maxOrder; l++)
+				values[l] = SphericalHarmonics::evalSHSum(l, coeffs, phi, theta);
+
+			const glm::vec3& reference = values[maxOrder];
+			sumSqReference += weight*glm::dot(reference, reference);
+			for (int l = MinSHOrder; l <= maxOrder; l++) {
+				glm::vec3 diff = values[l] - reference;
+				sumSqError[l] += weight*glm::dot(diff, diff);
+			}
+			sumWeights += weight;
+		}
+	}
+
+	for (int l = MinSHOrder; l <= maxOrder; l++)
+		errors.push_back(toOrderError(l, sumSqError[l], sumSqReference, sumWeights));
+}
+
+int BandLimit::selectOrder(const std::vector<OrderError>& errors, float maxRelativeError) {
+	if (errors.empty())
+		return MinSHOrder;
+
+	for (size_t i = 0; i < errors.size(); i++) {
+		if (errors[i].relativeError <= maxRelativeError)
+			return errors[i].order;
+	}
+
+	return errors.back().order;
+}
@@ -1,11 +1,13 @@
 #include <vsense/sh/SphericalHarmonics.h>
 
 #include <vsense/common/Util.h>
+#include <vsense/io/RemapCache.h>
 
 #include <glm/gtx/norm.hpp>
 
 #include <iostream>
 #include <fstream>
+#include <cstring>
 
 using namespace vsense;
 using namespace vsense::sh;
@@ -22,6 +24,8 @@ std::shared_ptr<glm::vec2> SphericalHarmonics::randSph_;
 const std::string RandomSphFile = "D:/dev/vsense_AR/data/random.bin";
 #elif __ANDROID__
 const std::string RandomSphFile = "/sdcard/TCD/map/random.bin";
+#else
+const std::string RandomSphFile = "data/random.bin";
 #endif
 
 /*
@@ -315,18 +319,22 @@ std::shared_ptr<SHCoefficients3> SphericalHarmonics::projectEnvironment(int orde
 	if(nbrSamples < 0) {
 		float pixelArea = (2.f * M_PI / img.cols()) * (M_PI / img.rows());
 
+		std::vector<float> phiTable, thetaTable;
+		io::RemapCache::sphericalTables(img.cols(), img.rows(), phiTable, thetaTable);
+
 		for (int row = 0; row < img.rows(); row++) {
 			const uchar* dataPtr = img.row_const(row);
-			float theta = img.imageYToTheta(row);
+			float theta = thetaTable[row];
 			// The differential area of each pixel in the map is constant across a row. Must scale the pixel_area by sin(theta) to account for the
 			// stretching that occurs at the poles with this parameterization.
 			float weight = pixelArea * sin(theta);
 
 			for (int col = 0; col < img.cols(); col++) {
-				float phi = img.imageXToPhi(col);
+				float phi = phiTable[col];
 
 				for (int c = 0; c < 3; c++)
-					color[c] = (float)(*dataPtr++) / 255.f;
+					color[c] = (float)dataPtr[c] / 255.f;
+				dataPtr += img.NbrChannels;
 
 				for (int l = 0; l <= order; l++) {
 					for (int m = -l; m <= l; m++) {
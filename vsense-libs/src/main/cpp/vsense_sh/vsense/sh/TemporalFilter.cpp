@@ -0,0 +1,140 @@
+#include <vsense/sh/TemporalFilter.h>
+
+#include <algorithm>
+#include <cmath>
+
+using namespace vsense;
+using namespace vsense::sh;
+
+const float Pi = 3.14159265358979323846f;
+
+const float MinTimeStep = 1e-3f; // Sets closer in time are considered 1ms apart
+
+TemporalFilter::TemporalFilter(const TemporalFilterParams& params, int nbrCoeffs) : params_(params), nbrCoeffs_(std::max(nbrCoeffs, 0)) {
+	reset();
+}
+
+void TemporalFilter::reset() {
+	previous_.assign(nbrCoeffs_, glm::vec4(0.f));
+	filtered_.assign(nbrCoeffs_, glm::vec4(0.f));
+	speed_.assign(nbrCoeffs_, glm::vec4(0.f));
+	published_.assign(nbrCoeffs_, glm::vec4(0.f));
+
+	lastTime_ = 0.0;
+	hasSet_ = false;
+	lastChange_ = 0.f;
+	static_ = false;
+	quietSets_ = 0;
+	quietFrames_ = 0;
+	stats_ = TemporalFilterStats();
+}
+
+bool TemporalFilter::update(const glm::vec4* coeffs, double timestamp) {
+	stats_.nbrUpdates++;
+
+	if (!hasSet_) { // Nothing to filter with
+		filtered_.assign(coeffs, coeffs + nbrCoeffs_);
+		published_ = filtered_;
+		std::fill(speed_.begin(), speed_.end(), glm::vec4(0.f));
+
+		lastTime_ = timestamp;
+		hasSet_ = true;
+		lastChange_ = 0.f;
+		stats_.nbrPublished++;
+
+		return true;
+	}
+
+	float innovation = distance(coeffs, filtered_.data(), nbrCoeffs_, params_.bandWeights);
+	previous_ = filtered_;
+
+	float dt = std::max((float)(timestamp - lastTime_), MinTimeStep);
+
+	for (int i = 0; i < nbrCoeffs_; i++) {
+		const glm::vec4& x = coeffs[i];
+		glm::vec4& xHat = filtered_[i];
+
+		if (params_.mode == FilterExponential) {
+			for (int c = 0; c < 3; c++)
+				xHat[c] += params_.alpha*(x[c] - xHat[c]);
+			xHat.w = x.w;
+		} else if (params_.mode == FilterOneEuro) {
+			float alphaSpeed = smoothingFactor(params_.derivativeCutoff, dt);
+			for (int c = 0; c < 3; c++) {
+				float speed = (x[c] - xHat[c]) / dt;
+				speed_[i][c] += alphaSpeed*(speed - speed_[i][c]);
+
+				float cutoff = params_.minCutoff + params_.beta*std::abs(speed_[i][c]);
+				xHat[c] += smoothingFactor(cutoff, dt)*(x[c] - xHat[c]);
+			}
+			xHat.w = x.w;
+		} else {
+			xHat = x;
+		}
+	}
+
+	lastTime_ = timestamp;
+
+	// Hysteresis of the static state, entered once the filtered sets settle and left as soon as a set departs from them
+	float step = distance(filtered_.data(), previous_.data(), nbrCoeffs_, params_.bandWeights);
+	if (step < params_.changeThreshold)
+		quietSets_++;
+	else
+		quietSets_ = 0;
+
+	if (!static_ && (quietSets_ >= params_.staticUpdates)) {
+		static_ = true;
+		quietFrames_ = 0;
+	} else if (static_ && (innovation > params_.wakeThreshold)) {
+		static_ = false;
+	}
+
+	lastChange_ = distance(filtered_.data(), published_.data(), nbrCoeffs_, params_.bandWeights);
+	if (lastChange_ < params_.changeThreshold) {
+		stats_.maxSkippedChange = std::max(stats_.maxSkippedChange, lastChange_);
+		return false;
+	}
+
+	published_ = filtered_;
+	stats_.nbrPublished++;
+
+	return true;
+}
+
+bool TemporalFilter::needsReprojection() {
+	stats_.nbrFrames++;
+
+	if (static_ && (++quietFrames_ < params_.staticInterval))
+		return false;
+
+	quietFrames_ = 0;
+	stats_.nbrReprojections++;
+
+	return true;
+}
+
+float TemporalFilter::getSkippedFraction() const {
+	if (!stats_.nbrUpdates)
+		return 0.f;
+
+	return (float)(stats_.nbrUpdates - stats_.nbrPublished) / stats_.nbrUpdates;
+}
+
+float TemporalFilter::distance(const glm::vec4* a, const glm::vec4* b, int nbrCoeffs, const std::vector<float>& bandWeights) {
+	float sum = 0.f;
+	for (int i = 0; i < nbrCoeffs; i++) {
+		size_t band = (size_t)std::sqrt((float)i);
+		float weight = (band < bandWeights.size()) ? bandWeights[band] : 1.f;
+
+		glm::vec3 diff = glm::vec3(a[i]) - glm::vec3(b[i]);
+		sum += weight*glm::dot(diff, diff);
+	}
+
+	return std::sqrt(sum);
+}
+
+float TemporalFilter::smoothingFactor(float cutoff, float dt) {
+	float tau = 1.f / (2.f*Pi*cutoff);
+
+	return 1.f / (1.f + tau / dt);
+}
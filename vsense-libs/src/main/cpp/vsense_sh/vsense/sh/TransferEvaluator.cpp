@@ -0,0 +1,152 @@
+#include <vsense/sh/TransferEvaluator.h>
+
+#include <vsense/common/Parallel.h>
+
+#include <algorithm>
+
+#if defined(__aarch64__) && (defined(__ARM_NEON) || defined(__ARM_NEON__))
+#include <arm_neon.h>
+#define USE_NEON
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#include <emmintrin.h>
+#define USE_SSE
+#endif
+
+using namespace vsense;
+using namespace vsense::sh;
+
+const size_t GroupSize = 4; // SIMD width
+
+TransferEvaluator::TransferEvaluator() : nbrVertices_(0), coeffNbr_(0), order_(-1), dirty_(false), nbrEvaluations_(0) {
+
+}
+
+void TransferEvaluator::setTransfer(const float* coeffs, size_t nbrVertices, int coeffNbr) {
+	nbrVertices_ = nbrVertices;
+	coeffNbr_ = std::max(coeffNbr, 0);
+
+	size_t nbrGroups = (nbrVertices_ + GroupSize - 1) / GroupSize;
+	transfer_.assign(nbrGroups*coeffNbr_*GroupSize, 0.f);
+	for (size_t v = 0; v < nbrVertices_; v++) {
+		float* dst = &transfer_[(v / GroupSize)*coeffNbr_*GroupSize + v % GroupSize];
+		for (int i = 0; i < coeffNbr_; i++)
+			dst[i*GroupSize] = coeffs[v*coeffNbr_ + i];
+	}
+
+	lighting_.assign(nbrVertices_, glm::vec3(0.f));
+	dirty_ = true;
+}
+
+void TransferEvaluator::setEnvironment(const glm::vec4* coeffs, int nbrCoeffs) {
+	std::vector<float> env(3 * std::max(nbrCoeffs, 0));
+	for (int i = 0; i < nbrCoeffs; i++) {
+		env[3 * i] = coeffs[i].r;
+		env[3 * i + 1] = coeffs[i].g;
+		env[3 * i + 2] = coeffs[i].b;
+	}
+
+	if (env == env_) // Same environment, the lighting is still valid
+		return;
+
+	env_.swap(env);
+	dirty_ = true;
+}
+
+void TransferEvaluator::setOrder(int order) {
+	if (order == order_)
+		return;
+
+	order_ = order;
+	dirty_ = true;
+}
+
+bool TransferEvaluator::update(size_t nbrThreads) {
+	if (!dirty_)
+		return false;
+
+	evaluate(nbrThreads);
+
+	return true;
+}
+
+void TransferEvaluator::evaluate(size_t nbrThreads) {
+	size_t nbrGroups = (nbrVertices_ + GroupSize - 1) / GroupSize;
+	size_t groupsPerJob = VerticesPerJob / GroupSize;
+	size_t nbrJobs = (nbrGroups + groupsPerJob - 1) / groupsPerJob;
+
+	common::parallelFor(nbrJobs, [&](size_t job) {
+		size_t firstGroup = job*groupsPerJob;
+		evaluateGroups(firstGroup, std::min(groupsPerJob, nbrGroups - firstGroup));
+	}, nbrThreads);
+
+	nbrEvaluations_++;
+	dirty_ = false;
+}
+
+int TransferEvaluator::getNbrEvaluatedCoefficients() const {
+	int nbrCoeffs = std::min(coeffNbr_, (int)env_.size() / 3);
+	if (order_ >= 0)
+		nbrCoeffs = std::min(nbrCoeffs, (order_ + 1)*(order_ + 1));
+
+	return nbrCoeffs;
+}
+
+glm::vec3 TransferEvaluator::dot(const float* transfer, const glm::vec4* env, int nbrCoeffs) {
+	glm::vec3 lighting(0.f);
+	for (int i = 0; i < nbrCoeffs; i++)
+		lighting += transfer[i] * glm::vec3(env[i]);
+
+	return lighting;
+}
+
+void TransferEvaluator::evaluateGroups(size_t firstGroup, size_t nbrGroups) {
+	int nbrCoeffs = getNbrEvaluatedCoefficients();
+	const float* env = env_.data();
+
+	for (size_t g = firstGroup; g < firstGroup + nbrGroups; g++) {
+		const float* transfer = &transfer_[g*coeffNbr_*GroupSize];
+
+		float lanes[3][GroupSize];
+#ifdef USE_SSE
+		__m128 r = _mm_setzero_ps(), gr = r, b = r;
+		for (int i = 0; i < nbrCoeffs; i++, transfer += GroupSize) {
+			__m128 t = _mm_loadu_ps(transfer);
+			r = _mm_add_ps(r, _mm_mul_ps(t, _mm_set1_ps(env[3 * i])));
+			gr = _mm_add_ps(gr, _mm_mul_ps(t, _mm_set1_ps(env[3 * i + 1])));
+			b = _mm_add_ps(b, _mm_mul_ps(t, _mm_set1_ps(env[3 * i + 2])));
+		}
+
+		_mm_storeu_ps(lanes[0], r);
+		_mm_storeu_ps(lanes[1], gr);
+		_mm_storeu_ps(lanes[2], b);
+#elif defined(USE_NEON)
+		float32x4_t r = vdupq_n_f32(0.f), gr = r, b = r;
+		for (int i = 0; i < nbrCoeffs; i++, transfer += GroupSize) {
+			float32x4_t t = vld1q_f32(transfer);
+			r = vmlaq_n_f32(r, t, env[3 * i]);
+			gr = vmlaq_n_f32(gr, t, env[3 * i + 1]);
+			b = vmlaq_n_f32(b, t, env[3 * i + 2]);
+		}
+
+		vst1q_f32(lanes[0], r);
+		vst1q_f32(lanes[1], gr);
+		vst1q_f32(lanes[2], b);
+#else
+		for (size_t l = 0; l < GroupSize; l++)
+			lanes[0][l] = lanes[1][l] = lanes[2][l] = 0.f;
+
+		for (int i = 0; i < nbrCoeffs; i++, transfer += GroupSize) {
+			for (size_t l = 0; l < GroupSize; l++) {
+				lanes[0][l] += transfer[l] * env[3 * i];
+				lanes[1][l] += transfer[l] * env[3 * i + 1];
+				lanes[2][l] += transfer[l] * env[3 * i + 2];
+			}
+		}
+#endif
+
+		size_t firstVertex = g*GroupSize;
+		size_t nbrLanes = std::min(GroupSize, nbrVertices_ - firstVertex);
+		for (size_t l = 0; l < nbrLanes; l++)
+			lighting_[firstVertex + l] = glm::vec3(lanes[0][l], lanes[1][l], lanes[2][l]);
+	}
+}
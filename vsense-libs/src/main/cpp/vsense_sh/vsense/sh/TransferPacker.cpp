@@ -0,0 +1,146 @@
+#include <vsense/sh/TransferPacker.h>
+#include <vsense/sh/BandLimit.h>
+#include <vsense/common/Half.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+using namespace vsense;
+using namespace vsense::sh;
+
+TransferPacker::TransferPacker(TransferQuantization quantization, int coeffNbr, int verticesPerRow) : quantization_(quantization),
+	coeffNbr_(std::max(coeffNbr, 1)), verticesPerRow_(std::max(verticesPerRow, 1)) {
+	texelsPerVertex_ = (coeffNbr_ + getScaleSlots() + 3) / 4;
+}
+
+int TransferPacker::getScaleSlots() const {
+	if (quantization_ == Transfer16Bit)
+		return 1;
+	else if (quantization_ == Transfer8Bit)
+		return 2;
+
+	return 0;
+}
+
+size_t TransferPacker::getSizeBytes(size_t nbrVertices) const {
+	size_t componentBytes = (quantization_ == TransferFloat) ? sizeof(float) : quantization_ / 8;
+
+	return (size_t)getWidth()*getHeight(nbrVertices) * 4 * componentBytes;
+}
+
+void TransferPacker::pack(const float* coeffs, size_t nbrVertices, std::vector<unsigned char>& packed) const {
+	packed.assign(getSizeBytes(nbrVertices), 0);
+
+	size_t slotsPerVertex = texelsPerVertex_ * 4;
+	for (size_t v = 0; v < nbrVertices; v++) {
+		const float* curCoeffs = coeffs + v*coeffNbr_;
+		size_t firstSlot = v*slotsPerVertex;
+
+		if (quantization_ == TransferFloat) {
+			memcpy(&packed[firstSlot*sizeof(float)], curCoeffs, sizeof(float)*coeffNbr_);
+			continue;
+		}
+
+		float maxAbs = 0.f;
+		for (int i = 0; i < coeffNbr_; i++)
+			maxAbs = std::max(maxAbs, std::abs(curCoeffs[i]));
+
+		// The scale is rounded up so every coefficient stays within [-M, M]
+		uint16_t scaleBits = common::floatToHalf(maxAbs);
+		if (common::halfToFloat(scaleBits) < maxAbs)
+			scaleBits++;
+		float scale = common::halfToFloat(scaleBits);
+
+		int maxLevel = (1 << (quantization_ - 1)) - 1;
+		for (int i = 0; i < coeffNbr_; i++) {
+			int level = (scale > 0.f) ? (int)std::floor(curCoeffs[i] / scale*maxLevel + 0.5f) : 0;
+			level = std::min(std::max(level, -maxLevel), maxLevel);
+
+			setSlot(packed, firstSlot + i, (uint32_t)(level + maxLevel + 1));
+		}
+
+		if (quantization_ == Transfer16Bit) {
+			setSlot(packed, firstSlot + coeffNbr_, scaleBits);
+		} else {
+			setSlot(packed, firstSlot + coeffNbr_, scaleBits & 0xff);
+			setSlot(packed, firstSlot + coeffNbr_ + 1, scaleBits >> 8);
+		}
+	}
+}
+
+void TransferPacker::unpack(const std::vector<unsigned char>& packed, size_t vertex, float* coeffs) const {
+	size_t firstSlot = vertex*texelsPerVertex_*4;
+
+	if (quantization_ == TransferFloat) {
+		memcpy(coeffs, &packed[firstSlot*sizeof(float)], sizeof(float)*coeffNbr_);
+		return;
+	}
+
+	uint32_t scaleBits = getSlot(packed, firstSlot + coeffNbr_);
+	if (quantization_ == Transfer8Bit)
+		scaleBits |= getSlot(packed, firstSlot + coeffNbr_ + 1) << 8;
+
+	int maxLevel = (1 << (quantization_ - 1)) - 1;
+	float step = common::halfToFloat((uint16_t)scaleBits) / maxLevel;
+
+	for (int i = 0; i < coeffNbr_; i++)
+		coeffs[i] = (float)((int)getSlot(packed, firstSlot + i) - maxLevel - 1)*step;
+}
+
+TransferPackingStats TransferPacker::measure(const float* coeffs, size_t nbrVertices, const glm::vec3* ambient) const {
+	TransferPackingStats stats;
+	stats.sizeBytes = getSizeBytes(nbrVertices);
+	stats.floatSizeBytes = TransferPacker(TransferFloat, coeffNbr_, verticesPerRow_).getSizeBytes(nbrVertices);
+
+	std::vector<unsigned char> packed;
+	pack(coeffs, nbrVertices, packed);
+
+	int order = BandLimit::getOrder(coeffNbr_);
+
+	double sumSqError = 0.0;
+	double sumSqReference = 0.0;
+
+	std::vector<float> unpacked(coeffNbr_);
+	for (size_t v = 0; v < nbrVertices; v++) {
+		const float* curCoeffs = coeffs + v*coeffNbr_;
+		unpack(packed, v, unpacked.data());
+
+		for (int i = 0; i < coeffNbr_; i++)
+			stats.maxCoeffError = std::max(stats.maxCoeffError, std::abs(unpacked[i] - curCoeffs[i]));
+
+		glm::vec3 reference = BandLimit::evalDiffuse(order, curCoeffs, ambient);
+		glm::vec3 diff = BandLimit::evalDiffuse(order, unpacked.data(), ambient) - reference;
+
+		sumSqError += glm::dot(diff, diff);
+		sumSqReference += glm::dot(reference, reference);
+	}
+
+	if (nbrVertices) {
+		stats.lightingRmse = (float)std::sqrt(sumSqError / nbrVertices);
+		if (sumSqReference > 0.0)
+			stats.relativeLightingError = (float)std::sqrt(sumSqError / sumSqReference);
+	}
+
+	return stats;
+}
+
+uint32_t TransferPacker::getSlot(const std::vector<unsigned char>& packed, size_t slot) const {
+	if (quantization_ == Transfer8Bit)
+		return packed[slot];
+
+	uint16_t value;
+	memcpy(&value, &packed[slot*sizeof(uint16_t)], sizeof(uint16_t));
+
+	return value;
+}
+
+void TransferPacker::setSlot(std::vector<unsigned char>& packed, size_t slot, uint32_t value) const {
+	if (quantization_ == Transfer8Bit) {
+		packed[slot] = (unsigned char)value;
+		return;
+	}
+
+	uint16_t value16 = (uint16_t)value;
+	memcpy(&packed[slot*sizeof(uint16_t)], &value16, sizeof(uint16_t));
+}
@@ -0,0 +1,264 @@
+#include <vsense/synth/Scene.h>
+
+#include <vsense/common/Util.h>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+using namespace vsense;
+using namespace vsense::synth;
+
+const float RayEpsilon = 1e-3f;    // Offset of the shadow rays, avoids hitting the surface they start from
+const float StripeDarkening = 0.8f; // Albedo factor of the dark stripes of the spheres
+const float CheckerDarkening = 0.7f; // Albedo factor of the dark squares of the walls
+
+const glm::vec3 DefaultRoomMin(-2.5f, -1.3f, -3.f);
+const glm::vec3 DefaultRoomMax(2.5f, 1.4f, 3.f);
+
+/*
+ * Generates pseudo-random numbers (xorshift), the same sequence on every platform.
+ * @param state State of the generator, updated.
+ * @return Number in [0, 1).
+ */
+float nextRandom(uint32_t& state) {
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+
+	return (state >> 8) * (1.f / 16777216.f);
+}
+
+Scene::Scene(const glm::vec3& roomMin, const glm::vec3& roomMax) : roomMin_(roomMin), roomMax_(roomMax), checkerSize_(0.4f), ambient_(0.15f) {
+	wallAlbedo_[0] = glm::vec3(0.6f, 0.25f, 0.2f);
+	wallAlbedo_[1] = glm::vec3(0.2f, 0.45f, 0.25f);
+	wallAlbedo_[2] = glm::vec3(0.35f, 0.3f, 0.25f);
+	wallAlbedo_[3] = glm::vec3(0.8f, 0.8f, 0.75f);
+	wallAlbedo_[4] = glm::vec3(0.2f, 0.3f, 0.6f);
+	wallAlbedo_[5] = glm::vec3(0.7f, 0.55f, 0.2f);
+}
+
+std::shared_ptr<Scene> Scene::createRoom(uint32_t seed) {
+	std::shared_ptr<Scene> scene(new Scene(DefaultRoomMin, DefaultRoomMax));
+
+	SceneBox boxes[] = {
+		{ glm::vec3(-2.3f, -1.3f, 0.5f), glm::vec3(-1.5f, -0.5f, 1.7f), glm::vec3(0.5f, 0.35f, 0.2f) }, // Cabinet
+		{ glm::vec3(0.8f, -1.3f, -2.2f), glm::vec3(1.8f, -0.6f, -1.4f), glm::vec3(0.7f, 0.7f, 0.65f) }  // Table
+	};
+	SceneSphere spheres[] = {
+		{ glm::vec3(1.f, -0.8f, 1.5f), 0.5f, glm::vec3(0.8f, 0.75f, 0.1f) },
+		{ glm::vec3(-0.9f, -0.9f, -1.2f), 0.4f, glm::vec3(0.1f, 0.6f, 0.7f) },
+		{ glm::vec3(0.3f, 0.6f, -2.f), 0.3f, glm::vec3(0.7f, 0.15f, 0.6f) }
+	};
+
+	// Every object is moved on the floor plane and its albedo changed, the room and the lights stay
+	uint32_t state = seed * 2654435761u;
+	for (size_t i = 0; seed && i < sizeof(boxes) / sizeof(SceneBox); i++) {
+		glm::vec3 offset(nextRandom(state) - 0.5f, 0.f, nextRandom(state) - 0.5f);
+		boxes[i].min_ += offset*0.6f;
+		boxes[i].max_ += offset*0.6f;
+		boxes[i].albedo_ = glm::vec3(0.2f + 0.6f*nextRandom(state), 0.2f + 0.6f*nextRandom(state), 0.2f + 0.6f*nextRandom(state));
+	}
+	for (size_t i = 0; seed && i < sizeof(spheres) / sizeof(SceneSphere); i++) {
+		spheres[i].center_ += glm::vec3(nextRandom(state) - 0.5f, 0.f, nextRandom(state) - 0.5f)*0.6f;
+		spheres[i].albedo_ = glm::vec3(0.1f + 0.8f*nextRandom(state), 0.1f + 0.8f*nextRandom(state), 0.1f + 0.8f*nextRandom(state));
+	}
+
+	for (size_t i = 0; i < sizeof(boxes) / sizeof(SceneBox); i++)
+		scene->addBox(boxes[i]);
+	for (size_t i = 0; i < sizeof(spheres) / sizeof(SceneSphere); i++)
+		scene->addSphere(spheres[i]);
+
+	// Panels just below the ceiling facing down, a warm one and a cool one
+	float lightY = DefaultRoomMax.y - 0.01f;
+	SceneLight warm = { glm::vec3(-1.f, lightY, 1.2f), glm::vec3(0.3f, 0.f, 0.f), glm::vec3(0.f, 0.f, 0.4f), glm::vec3(6.f, 5.f, 3.8f) };
+	SceneLight cool = { glm::vec3(1.2f, lightY, -1.f), glm::vec3(0.3f, 0.f, 0.f), glm::vec3(0.f, 0.f, 0.3f), glm::vec3(3.8f, 4.6f, 6.f) };
+	scene->addLight(warm);
+	scene->addLight(cool);
+
+	return scene;
+}
+
+bool Scene::intersect(const glm::vec3& org, const glm::vec3& dir, SceneHit& hit, bool includeLights) const {
+	float tMin = FLT_MAX;
+
+	// Walls, the ray leaves the room through the closest one
+	int wall = -1;
+	for (int axis = 0; axis < 3; axis++) {
+		if (dir[axis] == 0.f)
+			continue;
+
+		float t = ((dir[axis] > 0.f ? roomMax_[axis] : roomMin_[axis]) - org[axis]) / dir[axis];
+		if (t > 0.f && t < tMin) {
+			tMin = t;
+			wall = 2 * axis + (dir[axis] > 0.f ? 1 : 0);
+		}
+	}
+
+	if (wall >= 0) {
+		int axis = wall / 2;
+		hit.dist_ = tMin;
+		hit.pos_ = org + dir*tMin;
+		hit.normal_ = glm::vec3(0.f);
+		hit.normal_[axis] = (wall & 1) ? -1.f : 1.f;
+		hit.emission_ = glm::vec3(0.f);
+
+		int axisU = (axis + 1) % 3;
+		int axisV = (axis + 2) % 3;
+		int checker = ((int)floor(hit.pos_[axisU] / checkerSize_) + (int)floor(hit.pos_[axisV] / checkerSize_)) & 1;
+		hit.albedo_ = wallAlbedo_[wall] * (checker ? 1.f : CheckerDarkening);
+	}
+
+	// Boxes, slab test from outside
+	for (size_t i = 0; i < boxes_.size(); i++) {
+		const SceneBox& box = boxes_[i];
+
+		float tNear = -FLT_MAX, tFar = FLT_MAX;
+		int nearAxis = 0;
+		bool isMissed = false;
+		for (int axis = 0; axis < 3 && !isMissed; axis++) {
+			if (dir[axis] == 0.f) {
+				isMissed = org[axis] < box.min_[axis] || org[axis] > box.max_[axis];
+				continue;
+			}
+
+			float t0 = (box.min_[axis] - org[axis]) / dir[axis];
+			float t1 = (box.max_[axis] - org[axis]) / dir[axis];
+			if (t0 > t1)
+				std::swap(t0, t1);
+
+			if (t0 > tNear) {
+				tNear = t0;
+				nearAxis = axis;
+			}
+			tFar = std::min(tFar, t1);
+			isMissed = tNear > tFar;
+		}
+
+		if (isMissed || tNear <= 0.f || tNear >= tMin)
+			continue;
+
+		tMin = tNear;
+		hit.dist_ = tNear;
+		hit.pos_ = org + dir*tNear;
+		hit.normal_ = glm::vec3(0.f);
+		hit.normal_[nearAxis] = dir[nearAxis] > 0.f ? -1.f : 1.f;
+		hit.albedo_ = box.albedo_;
+		hit.emission_ = glm::vec3(0.f);
+	}
+
+	for (size_t i = 0; i < spheres_.size(); i++) {
+		const SceneSphere& sphere = spheres_[i];
+
+		glm::vec3 oc = org - sphere.center_;
+		float b = glm::dot(oc, dir);
+		float disc = b*b - (glm::dot(oc, oc) - sphere.radius_*sphere.radius_);
+		if (disc < 0.f)
+			continue;
+
+		float t = -b - sqrt(disc);
+		if (t <= 0.f || t >= tMin)
+			continue;
+
+		tMin = t;
+		hit.dist_ = t;
+		hit.pos_ = org + dir*t;
+		hit.normal_ = (hit.pos_ - sphere.center_) / sphere.radius_;
+		hit.emission_ = glm::vec3(0.f);
+
+		float y = (hit.pos_.y - sphere.center_.y) / sphere.radius_;
+		hit.albedo_ = sphere.albedo_ * (((int)floor(y*4.f) & 1) ? 1.f : StripeDarkening);
+	}
+
+	for (size_t i = 0; includeLights && i < lights_.size(); i++) {
+		const SceneLight& light = lights_[i];
+
+		glm::vec3 normal = glm::normalize(glm::cross(light.halfU_, light.halfV_));
+		float denom = glm::dot(dir, normal);
+		if (denom == 0.f)
+			continue;
+
+		float t = glm::dot(light.center_ - org, normal) / denom;
+		if (t <= 0.f || t >= tMin)
+			continue;
+
+		glm::vec3 local = org + dir*t - light.center_;
+		if (fabs(glm::dot(local, light.halfU_)) > glm::dot(light.halfU_, light.halfU_) ||
+			fabs(glm::dot(local, light.halfV_)) > glm::dot(light.halfV_, light.halfV_))
+			continue;
+
+		tMin = t;
+		hit.dist_ = t;
+		hit.pos_ = org + dir*t;
+		hit.normal_ = denom < 0.f ? normal : -normal;
+		hit.albedo_ = glm::vec3(0.f);
+		hit.emission_ = denom < 0.f ? light.radiance_ : glm::vec3(0.f); // The back of the panels is dark
+	}
+
+	return tMin < FLT_MAX;
+}
+
+glm::vec3 Scene::shade(const SceneHit& hit) const {
+	glm::vec3 irradiance = ambient_*(float)M_PI;
+
+	// Every light is approximated by a point at its center, weighted by its area
+	for (size_t i = 0; i < lights_.size(); i++) {
+		const SceneLight& light = lights_[i];
+
+		glm::vec3 toLight = light.center_ - hit.pos_;
+		float dist = glm::length(toLight);
+		toLight /= dist;
+
+		glm::vec3 lightNormal = glm::cross(light.halfU_, light.halfV_);
+		float area = 4.f*glm::length(lightNormal);
+		lightNormal /= 0.25f*area;
+
+		float cosSurface = glm::dot(hit.normal_, toLight);
+		float cosLight = -glm::dot(lightNormal, toLight);
+		if (cosSurface <= 0.f || cosLight <= 0.f)
+			continue;
+
+		SceneHit occluder;
+		if (intersect(hit.pos_ + hit.normal_*RayEpsilon, toLight, occluder, false) && occluder.dist_ < dist - RayEpsilon)
+			continue;
+
+		irradiance += light.radiance_*(area*cosSurface*cosLight / (dist*dist));
+	}
+
+	return hit.emission_ + hit.albedo_*irradiance / (float)M_PI;
+}
+
+glm::vec3 Scene::radiance(const glm::vec3& org, const glm::vec3& dir, float* dist) const {
+	SceneHit hit;
+	if (!intersect(org, dir, hit)) {
+		if (dist)
+			*dist = FLT_MAX;
+		return glm::vec3(0.f);
+	}
+
+	if (dist)
+		*dist = hit.dist_;
+
+	return shade(hit);
+}
+
+std::shared_ptr<sh::SHCoefficients3> Scene::projectSH(const glm::vec3& pos, int order, size_t nbrSamples, float exposure) const {
+	const float GoldenAngle = (float)(M_PI*(3.0 - sqrt(5.0)));
+
+	std::vector<sh::SphericalSample3> samples(nbrSamples);
+	for (size_t i = 0; i < nbrSamples; i++) {
+		float theta = acos(1.f - 2.f*(i + 0.5f) / nbrSamples);
+		float phi = fmod(GoldenAngle*i, (float)M_2PI);
+
+		glm::vec3 value = glm::min(exposure*radiance(pos, toDirection(theta, phi)), glm::vec3(1.f));
+		samples[i] = sh::SphericalSample3(glm::vec2(theta, phi), value);
+	}
+
+	return sh::SphericalHarmonics::projectSamples(order, samples);
+}
+
+glm::vec3 Scene::toDirection(float theta, float phi) {
+	float r = sin(theta);
+
+	return glm::vec3(r*sin(phi), cos(theta), r*cos(phi));
+}
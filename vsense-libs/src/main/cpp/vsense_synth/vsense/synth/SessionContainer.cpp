@@ -0,0 +1,198 @@
+#include <vsense/synth/SessionContainer.h>
+
+#include <vsense/io/Image.h>
+#include <vsense/io/ImageReader.h>
+#include <vsense/io/ImageWriter.h>
+#include <vsense/io/PointCloudReader.h>
+#include <vsense/io/PointCloudWriter.h>
+#include <vsense/sh/BandLimit.h>
+
+#include <iostream>
+
+using namespace std;
+using namespace vsense;
+using namespace vsense::synth;
+
+// Header: magic, version, number of frames, SH order and offset of the table of the frames
+const size_t HeaderSize = sizeof(uint32_t) * 3 + sizeof(int32_t) + sizeof(uint64_t);
+
+/*
+ * Retrieves the number of SH coefficients of an order.
+ * @param order SH order, -1 if none.
+ * @return Number of coefficients.
+ */
+inline size_t nbrCoeffs(int order) {
+	return order < 0 ? 0 : (size_t)(order + 1)*(order + 1);
+}
+
+SessionContainerWriter::SessionContainerWriter() : shOrder_(-1) {
+}
+
+SessionContainerWriter::~SessionContainerWriter() {
+	close();
+}
+
+bool SessionContainerWriter::open(const std::string& filename, int shOrder) {
+	close();
+
+	if (shOrder < -1 || shOrder > sh::MaxSHOrder) {
+		cout << "Invalid SH order: " << shOrder << endl;
+		return false;
+	}
+
+	file_.open(filename, ios::out | ios::binary);
+	if (!file_.is_open()) {
+		cout << "Unable to open " << filename << endl;
+		return false;
+	}
+
+	shOrder_ = shOrder;
+	offsets_.clear();
+
+	// The number of frames and the offset of the table are written when the container is closed
+	vector<char> header(HeaderSize, 0);
+	file_.write(header.data(), header.size());
+
+	return file_.good();
+}
+
+bool SessionContainerWriter::append(const Frame& frame, const sh::SHCoefficients3* groundTruth) {
+	if (!file_.is_open() || !frame.img)
+		return false;
+
+	offsets_.push_back((uint64_t)file_.tellp());
+
+	if (!io::PointCloudWriter::writeTango(file_, frame.pc, frame.pcData) || !io::ImageWriter::write(file_, *frame.img, frame.imData))
+		return false;
+
+	vector<glm::vec3> coeffs(nbrCoeffs(shOrder_), glm::vec3(0.f));
+	if (groundTruth) {
+		for (size_t i = 0; i < coeffs.size() && i < groundTruth->size(); i++)
+			coeffs[i] = (*groundTruth)[i];
+	}
+
+	if (!coeffs.empty())
+		file_.write((const char*)&coeffs[0].x, sizeof(glm::vec3)*coeffs.size());
+
+	return file_.good();
+}
+
+bool SessionContainerWriter::close() {
+	if (!file_.is_open())
+		return false;
+
+	uint64_t tableOffset = (uint64_t)file_.tellp();
+	if (!offsets_.empty())
+		file_.write((const char*)offsets_.data(), sizeof(uint64_t)*offsets_.size());
+
+	uint32_t nbrFrames = (uint32_t)offsets_.size();
+	int32_t shOrder = shOrder_;
+
+	file_.seekp(0);
+	file_.write((const char*)&SessionContainerMagic, sizeof(uint32_t));
+	file_.write((const char*)&SessionContainerVersion, sizeof(uint32_t));
+	file_.write((const char*)&nbrFrames, sizeof(uint32_t));
+	file_.write((const char*)&shOrder, sizeof(int32_t));
+	file_.write((const char*)&tableOffset, sizeof(uint64_t));
+
+	bool success = file_.good();
+	file_.close();
+
+	return success;
+}
+
+bool SessionContainerReader::open(const std::string& filename) {
+	if (file_.is_open())
+		file_.close();
+
+	offsets_.clear();
+	shOrder_ = -1;
+
+	file_.open(filename, ios::in | ios::binary);
+	if (!file_.is_open()) {
+		cout << "Unable to open " << filename << endl;
+		return false;
+	}
+
+	uint32_t magic = 0, version = 0, nbrFrames = 0;
+	int32_t shOrder = -1;
+	uint64_t tableOffset = 0;
+
+	file_.read((char*)&magic, sizeof(uint32_t));
+	file_.read((char*)&version, sizeof(uint32_t));
+	file_.read((char*)&nbrFrames, sizeof(uint32_t));
+	file_.read((char*)&shOrder, sizeof(int32_t));
+	file_.read((char*)&tableOffset, sizeof(uint64_t));
+
+	if (!file_.good() || magic != SessionContainerMagic) {
+		cout << filename << " is not a session container" << endl;
+		return false;
+	}
+
+	if (version > SessionContainerVersion) {
+		cout << filename << " has an unsupported version: " << version << endl;
+		return false;
+	}
+
+	if (!tableOffset) {
+		cout << filename << " wasn't closed, its frames can't be found" << endl;
+		return false;
+	}
+
+	if (shOrder < -1 || shOrder > sh::MaxSHOrder) {
+		cout << filename << " has an invalid SH order: " << shOrder << endl;
+		return false;
+	}
+
+	// The header is checked against the size of the file before the table is allocated
+	file_.seekg(0, ios::end);
+	uint64_t fileSize = (uint64_t)file_.tellg();
+	if (tableOffset < HeaderSize || tableOffset > fileSize || (fileSize - tableOffset) / sizeof(uint64_t) < nbrFrames) {
+		cout << filename << " is truncated" << endl;
+		return false;
+	}
+
+	offsets_.resize(nbrFrames);
+	file_.seekg(tableOffset);
+	if (nbrFrames)
+		file_.read((char*)offsets_.data(), sizeof(uint64_t)*nbrFrames);
+
+	if (!file_.good()) {
+		cout << filename << " is truncated" << endl;
+		offsets_.clear();
+		return false;
+	}
+
+	for (size_t i = 0; i < offsets_.size(); i++) {
+		if (offsets_[i] < HeaderSize || offsets_[i] >= tableOffset) {
+			cout << filename << " has an invalid offset for frame " << i << endl;
+			offsets_.clear();
+			return false;
+		}
+	}
+
+	shOrder_ = shOrder;
+
+	return true;
+}
+
+bool SessionContainerReader::read(size_t idx, Frame& frame, sh::SHCoefficients3* groundTruth, float minConf) {
+	if (idx >= offsets_.size())
+		return false;
+
+	file_.clear();
+	file_.seekg(offsets_[idx]);
+
+	frame.pc.clear();
+	if (!io::PointCloudReader::read(file_, frame.pc, frame.pcData, minConf) || !io::ImageReader::read(file_, frame.img, frame.imData))
+		return false;
+
+	size_t nbrSH = nbrCoeffs(shOrder_);
+	if (groundTruth) {
+		groundTruth->resize(nbrSH);
+		if (nbrSH)
+			file_.read((char*)&(*groundTruth)[0].x, sizeof(glm::vec3)*nbrSH);
+	}
+
+	return file_.good();
+}
@@ -0,0 +1,172 @@
+#include <vsense/synth/SessionGenerator.h>
+#include <vsense/synth/Scene.h>
+
+#include <vsense/color/Color.h>
+#include <vsense/common/Parallel.h>
+#include <vsense/common/Util.h>
+#include <vsense/io/Image.h>
+
+#include <glm/gtc/quaternion.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+using namespace vsense;
+using namespace vsense::synth;
+
+const size_t ImageRowsPerJob = 16;
+
+/*
+ * Advances a xorshift generator, the same sequence on every platform.
+ * @param state State of the generator, updated.
+ * @return Number in [0, 1).
+ */
+inline float nextUniform(uint32_t& state) {
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+
+	return (state >> 8) * (1.f / 16777216.f);
+}
+
+/*
+ * Generates a normally distributed number (Box-Muller).
+ * @param state State of the generator, updated.
+ * @return Number with mean 0 and standard deviation 1.
+ */
+inline float nextGaussian(uint32_t& state) {
+	float u1 = std::max(nextUniform(state), 1e-7f);
+	float u2 = nextUniform(state);
+
+	return sqrt(-2.f*log(u1))*cos((float)M_2PI*u2);
+}
+
+SessionConfig::SessionConfig() : depthWidth_(224), depthHeight_(172), depthF_(215.0, 215.0), imageWidth_(1920), imageHeight_(1080),
+	imageF_(1480.0, 1480.0), exposure_(4.f), frameTime_(0.2), noise_(0.002f), holeRate_(0.08f), maxDepth_(4.f), framesPerTurn_(100),
+	pathRadius_(0.25f), seed_(1) {
+}
+
+SessionGenerator::SessionGenerator(const std::shared_ptr<Scene>& scene, const SessionConfig& config) : scene_(scene), config_(config) {
+}
+
+void SessionGenerator::getPose(size_t idx, glm::mat3& rot, glm::vec3& pos) const {
+	float progress = (float)(idx % config_.framesPerTurn_) / config_.framesPerTurn_;
+
+	float yaw = (float)M_2PI*progress;
+	float pitch = 0.2f*std::sin(2.f*(float)M_2PI*progress);
+
+	glm::mat3 rotY(std::cos(yaw), 0.f, -std::sin(yaw), 0.f, 1.f, 0.f, std::sin(yaw), 0.f, std::cos(yaw));
+	glm::mat3 rotX(1.f, 0.f, 0.f, 0.f, std::cos(pitch), std::sin(pitch), 0.f, -std::sin(pitch), std::cos(pitch));
+	rot = rotY*rotX;
+
+	float radius = config_.pathRadius_;
+	pos = glm::vec3(radius*std::sin((float)M_2PI*progress), 0.2f*radius*std::sin(2.f*(float)M_2PI*progress), radius*std::cos((float)M_2PI*progress) - radius);
+}
+
+void SessionGenerator::generate(size_t idx, Frame& frame, size_t nbrThreads) const {
+	glm::mat3 rot;
+	glm::vec3 pos;
+	getPose(idx, rot, pos);
+
+	glm::dvec2 depthC(0.5*(config_.depthWidth_ - 1), 0.5*(config_.depthHeight_ - 1));
+	glm::dvec2 imageC(0.5*(config_.imageWidth_ - 1), 0.5*(config_.imageHeight_ - 1));
+
+	// Depth, the generator depends only on the seed and the frame
+	uint32_t state = (config_.seed_ + 1) * 2654435761u ^ (uint32_t)(idx + 1) * 40503u;
+	if (!state)
+		state = 1;
+
+	std::vector<glm::vec3> pts;
+	pts.reserve(config_.depthWidth_*config_.depthHeight_);
+	SceneHit hit;
+	for (uint32_t v = 0; v < config_.depthHeight_; v++) {
+		for (uint32_t u = 0; u < config_.depthWidth_; u++) {
+			float noise = nextGaussian(state);
+			if (nextUniform(state) < config_.holeRate_)
+				continue;
+
+			glm::vec3 dirCam((float)((u - depthC.x) / config_.depthF_.x), (float)((v - depthC.y) / config_.depthF_.y), 1.f);
+			float len = glm::length(dirCam);
+			if (!scene_->intersect(pos, rot*(dirCam / len), hit))
+				continue;
+
+			float z = hit.dist_ / len;
+			z += noise*config_.noise_*z*z;
+			if (z <= 0.f || z > config_.maxDepth_)
+				continue;
+
+			pts.push_back(dirCam*z);
+		}
+	}
+
+	frame.pc.clear();
+	frame.pc.addPoints(pts.data(), nullptr, nullptr, nullptr, pts.size());
+
+	// Color, the linear radiance is encoded as sRGB as the camera does
+	if (!frame.img || frame.img->cols() != config_.imageWidth_ || frame.img->rows() != config_.imageHeight_)
+		frame.img.reset(new io::Image(config_.imageWidth_, config_.imageHeight_));
+
+	io::Image* img = frame.img.get();
+	size_t nbrJobs = (config_.imageHeight_ + ImageRowsPerJob - 1) / ImageRowsPerJob;
+	common::parallelFor(nbrJobs, [&](size_t job) {
+		size_t endRow = std::min((job + 1)*ImageRowsPerJob, (size_t)config_.imageHeight_);
+		for (size_t y = job*ImageRowsPerJob; y < endRow; y++) {
+			uchar* px = img->row(y);
+			for (uint32_t x = 0; x < config_.imageWidth_; x++, px += 4) {
+				glm::vec3 dirCam((float)((x - imageC.x) / config_.imageF_.x), (float)((y - imageC.y) / config_.imageF_.y), 1.f);
+				glm::vec3 radiance = glm::clamp(config_.exposure_*scene_->radiance(pos, rot*glm::normalize(dirCam)), glm::vec3(0.f), glm::vec3(1.f));
+				glm::vec3 color = color::Color::linRGB2sRGB(radiance);
+
+				px[0] = (uchar)(color.r*255.f + 0.5f);
+				px[1] = (uchar)(color.g*255.f + 0.5f);
+				px[2] = (uchar)(color.b*255.f + 0.5f);
+				px[3] = 255;
+			}
+		}
+	}, nbrThreads);
+
+	glm::quat q = glm::quat_cast(rot);
+
+	io::PointCloudMetadata& pcData = frame.pcData;
+	pcData.width_ = config_.depthWidth_;
+	pcData.height_ = config_.depthHeight_;
+	pcData.f_ = config_.depthF_;
+	pcData.c_ = depthC;
+	pcData.nbrPoints_ = (uint32_t)frame.pc.size();
+	pcData.timestamp_ = idx*config_.frameTime_;
+	pcData.translation_[0] = pos.x;
+	pcData.translation_[1] = pos.y;
+	pcData.translation_[2] = pos.z;
+	pcData.orientation_[0] = q.x;
+	pcData.orientation_[1] = q.y;
+	pcData.orientation_[2] = q.z;
+	pcData.orientation_[3] = q.w;
+	pcData.accuracy_ = 0.f;
+
+	// The color camera is placed at the depth sensor
+	io::ImageMetadata& imData = frame.imData;
+	imData.width_ = config_.imageWidth_;
+	imData.height_ = config_.imageHeight_;
+	imData.exposure_ = 0;
+	imData.timestamp_ = pcData.timestamp_;
+	imData.f_ = config_.imageF_;
+	imData.c_ = imageC;
+	imData.translation_[0] = imData.translation_[1] = imData.translation_[2] = 0.0;
+	imData.orientation_[0] = imData.orientation_[1] = imData.orientation_[2] = 0.0;
+	imData.orientation_[3] = 1.0;
+	imData.accuracy_ = 0.f;
+
+	for (int i = 0; i < 5; i++) {
+		pcData.distortion_[i] = imData.distortion_[i] = 0.0;
+		pcData.distortionF_[i] = imData.distortionF_[i] = 0.f;
+	}
+}
+
+std::shared_ptr<sh::SHCoefficients3> SessionGenerator::groundTruthSH(size_t idx, int order, size_t nbrSamples) const {
+	glm::mat3 rot;
+	glm::vec3 pos;
+	getPose(idx, rot, pos);
+
+	return scene_->projectSH(pos, order, nbrSamples, config_.exposure_);
+}
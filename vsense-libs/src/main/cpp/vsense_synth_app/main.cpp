@@ -0,0 +1,171 @@
+#include <vsense/io/ImageWriter.h>
+#include <vsense/io/PointCloudWriter.h>
+#include <vsense/synth/Scene.h>
+#include <vsense/synth/SessionContainer.h>
+#include <vsense/synth/SessionGenerator.h>
+
+#include <vsense/common/Parallel.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace vsense;
+
+/*
+ * Prints the options of the generator.
+ */
+void printUsage() {
+	std::cout << "Usage: vsense_synth_app [options]" << std::endl
+		<< "  --frames <n>           Number of frames (100)" << std::endl
+		<< "  --seed <n>             Seed of the depth noise and holes (1)" << std::endl
+		<< "  --scene <n>            Layout of the room, 0 for the reference one (0)" << std::endl
+		<< "  --frames-per-turn <n>  Frames of a full turn of the device (100)" << std::endl
+		<< "  --image-size <w> <h>   Size of the color images (1920 1080), the focal length is scaled" << std::endl
+		<< "  --folder <folder>      Writes PointCloud<i>.pc/.im and GroundTruthSH.csv to an existing folder" << std::endl
+		<< "  --container <file>     Writes the session to a single file" << std::endl
+		<< "  --sh-order <n>         Order of the ground-truth SH, -1 to skip them (2)" << std::endl
+		<< "  --threads <n>          Number of threads, 0 for all (0)" << std::endl;
+}
+
+/*
+ * Writes a frame in the layout of the Tango recordings.
+ * @param folder Folder of the session.
+ * @param idx Index of the frame.
+ * @param frame Frame to write.
+ * @return True if successful.
+ */
+bool writeFrameFiles(const std::string& folder, size_t idx, const synth::Frame& frame) {
+	char buffer[32];
+	sprintf(buffer, "%u", (unsigned int)idx);
+
+	return io::PointCloudWriter::writeTango(folder + "/PointCloud" + buffer + ".pc", frame.pc, frame.pcData) &&
+		io::ImageWriter::write(folder + "/PointCloud" + buffer + ".im", *frame.img, frame.imData);
+}
+
+int main(int argc, char** argv) {
+	synth::SessionConfig config;
+	size_t nbrFrames = 100, nbrThreads = 0;
+	uint32_t sceneSeed = 0;
+	int shOrder = 2;
+	std::string folder, containerFile;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--help" || arg == "-h") {
+			printUsage();
+			return 0;
+		}
+
+		int nbrValues = arg == "--image-size" ? 2 : 1;
+		if (i + nbrValues >= argc) {
+			std::cout << "Missing value of " << arg << std::endl;
+			printUsage();
+			return 2;
+		}
+
+		const char* value = argv[++i];
+		if (arg == "--frames")
+			nbrFrames = strtoul(value, NULL, 10);
+		else if (arg == "--seed")
+			config.seed_ = (uint32_t)strtoul(value, NULL, 10);
+		else if (arg == "--scene")
+			sceneSeed = (uint32_t)strtoul(value, NULL, 10);
+		else if (arg == "--frames-per-turn")
+			config.framesPerTurn_ = std::max(strtoul(value, NULL, 10), 1ul);
+		else if (arg == "--image-size") {
+			uint32_t width = (uint32_t)strtoul(value, NULL, 10) & ~1u;
+			uint32_t height = (uint32_t)strtoul(argv[++i], NULL, 10) & ~1u;
+			if (!width || !height) {
+				std::cout << "Invalid image size" << std::endl;
+				return 2;
+			}
+
+			config.imageF_ *= (double)width / config.imageWidth_;
+			config.imageWidth_ = width;
+			config.imageHeight_ = height;
+		} else if (arg == "--folder")
+			folder = value;
+		else if (arg == "--container")
+			containerFile = value;
+		else if (arg == "--sh-order")
+			shOrder = atoi(value);
+		else if (arg == "--threads")
+			nbrThreads = strtoul(value, NULL, 10);
+		else {
+			std::cout << "Unknown option " << arg << std::endl;
+			printUsage();
+			return 2;
+		}
+	}
+
+	if (folder.empty() && containerFile.empty()) {
+		std::cout << "No output given, use --folder and/or --container" << std::endl;
+		printUsage();
+		return 2;
+	}
+
+	synth::SessionGenerator generator(synth::Scene::createRoom(sceneSeed), config);
+
+	std::ofstream shFile;
+	if (!folder.empty() && shOrder >= 0) {
+		shFile.open(folder + "/GroundTruthSH.csv");
+		if (!shFile.is_open()) {
+			std::cout << "Unable to write to " << folder << std::endl;
+			return 2;
+		}
+		shFile << "frame,x,y,z";
+		for (int i = 0; i < (shOrder + 1)*(shOrder + 1); i++)
+			shFile << ",r" << i << ",g" << i << ",b" << i;
+		shFile << std::endl;
+	}
+
+	synth::SessionContainerWriter container;
+	if (!containerFile.empty() && !container.open(containerFile, shOrder))
+		return 2;
+
+	// Frames are generated in batches, one per thread, and written in order so memory doesn't grow with the session
+	if (!nbrThreads)
+		nbrThreads = common::hardwareThreads();
+
+	std::vector<synth::Frame> frames(nbrThreads);
+	std::vector<std::shared_ptr<sh::SHCoefficients3>> groundTruth(nbrThreads);
+	for (size_t first = 0; first < nbrFrames; first += nbrThreads) {
+		size_t batchSize = std::min(nbrThreads, nbrFrames - first);
+
+		common::parallelFor(batchSize, [&](size_t i) {
+			generator.generate(first + i, frames[i]);
+			if (shOrder >= 0)
+				groundTruth[i] = generator.groundTruthSH(first + i, shOrder);
+		}, nbrThreads);
+
+		for (size_t i = 0; i < batchSize; i++) {
+			size_t idx = first + i;
+			if (!folder.empty() && !writeFrameFiles(folder, idx, frames[i]))
+				return 2;
+
+			if (shFile.is_open()) {
+				const double* pos = frames[i].pcData.translation_;
+				shFile << idx << "," << pos[0] << "," << pos[1] << "," << pos[2];
+				for (size_t j = 0; j < groundTruth[i]->size(); j++)
+					shFile << "," << (*groundTruth[i])[j].r << "," << (*groundTruth[i])[j].g << "," << (*groundTruth[i])[j].b;
+				shFile << std::endl;
+			}
+
+			if (!containerFile.empty() && !container.append(frames[i], groundTruth[i].get()))
+				return 2;
+		}
+
+		std::cout << "\r" << first + batchSize << "/" << nbrFrames << " frames" << std::flush;
+	}
+	std::cout << std::endl;
+
+	if (!containerFile.empty() && !container.close())
+		return 2;
+
+	return 0;
+}